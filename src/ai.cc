@@ -6,6 +6,7 @@
 #include <algorithm>  // to satisfy cpplint
 
 #include "src/ai.h"
+#include "src/profiler.h"
 
 
 /* TO DO
@@ -208,10 +209,18 @@
 
 */
 
-AI::AI(PGame current_game, unsigned int _player_index, AIPlusOptions _aiplus_options) {
+std::string AI::debug_save_folder;
+
+AI::AI(PGame current_game, unsigned int _player_index, AIPlusOptions _aiplus_options)
+  : governor(cpu_budget_us_per_tick, cpu_slice_us) {
 
 
   has_autosave_mutex = false;
+  loop_phase = LoopStart;
+  loop_task = 0;
+  loop_stock = 0;
+  loop_start_tick = 0;
+  resume_tick = 0;
   ai_status = "INITIALIZING";
   player_index = _player_index;
   aiplus_options = _aiplus_options;
@@ -225,6 +234,9 @@ AI::AI(PGame current_game, unsigned int _player_index, AIPlusOptions _aiplus_opt
 
   game = current_game;
   map = game->get_map();
+  // started on a worker thread by the first AI, it is ready by the time the
+  //  AIs are done placing their castles
+  map_analysis = MapAnalysis::get(map);
   player = game->get_player(player_index);
   // for "build something" functions that return a MapPos of where built, stopbuilding_pos is a flag that can be returned that says to quit trying to build that thing
   stopbuilding_pos = std::numeric_limits<unsigned int>::max() - 2;
@@ -239,11 +251,9 @@ AI::AI(PGame current_game, unsigned int _player_index, AIPlusOptions _aiplus_opt
   serfs_total = {};
   unfinished_building_count = 0;
   unfinished_hut_count = 0;
-  expand_towards = {};
-  last_expand_towards = {};
-  no_transporter_timers = {};
+  expand_towards.reset();
+  last_expand_towards.reset();
   serf_wait_timers = {};
-  serf_wait_idle_on_road_timers = {};
   realm_occupied_military_pos = {};
   bad_building_pos = {};   // AI STATEFULNESS WARNING - this bad_building_pos list is lost on save/load or if AI thread terminated
   stocks_pos = {};
@@ -254,6 +264,10 @@ AI::AI(PGame current_game, unsigned int _player_index, AIPlusOptions _aiplus_opt
   cannot_expand_borders_this_loop = false;
   change_buffer = 0;
   previous_knight_occupation_level = -1;
+  flag_dists_loop = 0;
+  flag_dists_changes = 0;
+  game_events = game->get_events()->subscribe();
+  init_tasks();
 
   road_options.reset(RoadOption::Direct);
   road_options.set(RoadOption::SplitRoads);
@@ -281,229 +295,404 @@ AI::AI(PGame current_game, unsigned int _player_index, AIPlusOptions _aiplus_opt
 
 void
 AI::start() {
-  AILogInfo["start"] << name << " AI is starting, thread_id: " << std::this_thread::get_id();
-  // try to get autosave_mutex, only one AI thread will get it so they are not all saving
-  if (game->get_autosave_mutex()->try_lock()) {
+  AILogInfo["start"] << name << " AI is starting";
+  // try to get autosave_mutex, only one AI will get it so they are not all saving
+  if (game->get_autosave_mutex()->try_lock(LOCK_SITE())) {
     has_autosave_mutex = true;
-    AILogDebug["start"] << name << " this AI thread has the autosave mutex";
+    AILogDebug["start"] << name << " this AI has the autosave mutex";
   }
-  // the Interface must pass the options bitset to each AI thread when initializing them
+  // the Interface must pass the options bitset to each AI when initializing them
   AILogInfo["start"] << name << " AIOption::Foo is " << std::to_string(aiplus_options.test(AIPlusOption::Foo));
   AILogInfo["start"] << name << " AIOption::Bar is " << std::to_string(aiplus_options.test(AIPlusOption::Bar));
   AILogInfo["start"] << name << " AIOption::Baz is " << std::to_string(aiplus_options.test(AIPlusOption::Baz));
-  while (true) {
-    //AILogDebug["start"] << name << " start AI::start while(true)";
-    if (game->should_ai_stop() == true) {
-      AILogInfo["start"] << name << " received stop_ai_threads signal, exiting!";
-      game->ai_thread_exiting();
-      return;
-    }
-    else if (game->get_game_speed() == 0) {
-      AILogInfo["start"] << name << " game is paused, not running AI loops until unpaused";
-      ai_status.assign("AI_PAUSED");
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-    else if (game->is_ai_locked()) {
-      AILogInfo["start"] << name << " AI is still locked, sleeping until game->unlock_ai called (when game init_box is closed)";
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-    else {
-      next_loop();
-      //AILogDebug["start"] << name << " done next_loop()";
-    }
-    //AILogDebug["start"] << name << " end AI::start while(true)";
+  AIPool::get_instance().add(this);
+}
+
+// run by an AIPool worker.  Instead of sleeping on its own thread the AI
+//  says how long to wait before its next step, returns false once it stops.
+//  A step goes on with the loop where the last one left off and runs until
+//  its time slice is used, or the loop comes to a rest
+bool
+AI::step(unsigned int *wait_ms) {
+  if (game->should_ai_stop() == true) {
+    AILogInfo["step"] << name << " received stop_ai_threads signal, exiting!";
+    game->ai_thread_exiting();
+    return false;
+  }
+  else if (game->get_game_speed() == 0) {
+    AILogInfo["step"] << name << " game is paused, not running AI loops until unpaused";
+    ai_status.assign("AI_PAUSED");
+    *wait_ms = 100;
   }
+  else if (game->is_ai_locked()) {
+    AILogInfo["step"] << name << " AI is still locked, sleeping until game->unlock_ai called (when game init_box is closed)";
+    *wait_ms = 100;
+  }
+  else if (game->get_tick() < resume_tick) {
+    *wait_ms = AIGovernor::ticks_to_ms(resume_tick - game->get_tick(), game->get_game_speed());
+  }
+  else {
+    governor.start_slice(game->get_tick(), game->get_game_speed());
+    stats.begin_step();
+    continue_loop();
+    stats.end_step();
+    *wait_ms = governor.end_slice(game->get_tick());
+    if (game->get_tick() < resume_tick) {
+      *wait_ms = std::max(*wait_ms, AIGovernor::ticks_to_ms(resume_tick - game->get_tick(), game->get_game_speed()));
+    }
+  }
+  *wait_ms = std::min(*wait_ms, max_step_wait_ms);
+  publish_overlay();
+  return true;
 }
 
+// wait this many game ticks before the loop goes on
 void
-AI::next_loop(){
-  AILogDebug["next_loop"] << name << " inside AI::next_loop()";
-  loop_count++;
-
-  ai_status.assign("SLEEPING_AT_START");
-  AILogDebug["next_loop"] << name << " sleeping 6sec at start of new loop";
-  std::this_thread::sleep_for(std::chrono::milliseconds(6000));
-
-  AILogInfo["next_loop"] << name << " starting AI loop #" << loop_count;
-  // time entire loop
-  std::clock_t loop_clock_start;
-  double loop_clock_duration;
-  loop_clock_start = std::clock();
-
-  do_place_castle();
-  do_save_game();   // enable to automatically save game every X turns
-  do_update_clear_reset();
-  update_stocks_pos();
-  update_building_counts();
-  do_get_inventory(castle_pos);
-  do_get_serfs();
-  do_debug_building_triggers();
-
-  //-----------------------------------------------------------
-  // housekeeping tasks
-  //  NOTE - all of these should probably be moved to run AFTER the main game loop.
-  //    for example, we shouldn't send geologists out as the very first action when starting a game,
-  //      rather it should be done after first few buildings/roads placed
-  //-----------------------------------------------------------
-
-  do_connect_disconnected_flags(); // except unfinished mines
-  do_build_better_roads_for_important_buildings();  // is this working?  I still see pretty inefficient roads for important buildings
-  //do_spiderweb_roads1();   // this might be too close to the castle, do some more testing
-  do_spiderweb_roads2();
-  do_pollute_castle_area_roads_with_flags();
-  do_fix_stuck_serfs();
-  do_fix_missing_transporters();
-  //do_send_geologists();  move this to inside warehouse / stock loop only because it uses occupied_building_count which uses stock_pos
-  do_build_rangers();
-  do_remove_road_stubs();
-  do_demolish_unproductive_3rd_lumberjacks();
-  do_demolish_unproductive_stonecutters();
-  do_demolish_unproductive_mines();
-  do_manage_tool_priorities();
-  do_manage_mine_food_priorities();
-  do_balance_sword_shield_priorities();
-  do_attack();
-  do_manage_knight_occupation_levels();
-
-  update_stocks_pos();
-  for (MapPos this_stock_pos : stocks_pos) {
-    stock_pos = this_stock_pos;
-    AILogDebug["next_loop"] << name << " Starting economy loop for stock at pos " << stock_pos;
-
-    // debug
-    AILogDebug["next_loop"] << name << " stock at pos " << stock_pos << " has all/completed/occupied buildings: ";
-    for (int x = 0; x < 25; x++) {
-      AILogDebug["next_loop"] << name << " type " << x << " / " << NameBuilding[x] << ": " << stock_buildings.at(stock_pos).count[x]
-        << "/" << stock_buildings.at(stock_pos).completed_count[x] << "/" << stock_buildings.at(stock_pos).occupied_count[x];
-    }
+AI::rest(unsigned int ticks) {
+  resume_tick = game->get_tick() + ticks;
+}
 
-    do_get_inventory(stock_pos);
-    do_demolish_excess_lumberjacks();
-    do_demolish_excess_fishermen();
-    do_promote_serfs_to_knights();
-    do_send_geologists();
+// run the loop from where it left off.  Each pass of the switch is one piece
+//  of work that cannot be split; the loop stops between them once the time
+//  slice is used, and always gets at least one done
+void
+AI::continue_loop() {
+  do {
+    switch (loop_phase) {
+    case LoopStart:
+      ai_status.assign("SLEEPING_AT_START");
+      AILogDebug["continue_loop"] << name << " resting " << loop_rest_ticks << " ticks at start of new loop";
+      loop_phase = LoopPrepare;
+      rest(loop_rest_ticks);
+      return;
 
-    // PLACE MINES EARLY - but do not connect them to roads so they do not actually get built until later
-    //   this is to secure good placement when resources are found, before the signs fade
-    do_place_coal_mines();
-    do_place_iron_mines();
-    do_place_gold_mines();
+    case LoopPrepare:
+      loop_count++;
+      loop_start_tick = game->get_tick();
+      AILogInfo["continue_loop"] << name << " starting AI loop #" << loop_count;
+      do_place_castle();
+      do_save_game();   // enable to automatically save game every X turns
+      read_game_events();
+      do_update_clear_reset();
+      update_stocks_pos();
+      update_building_counts();
+      do_get_inventory(castle_pos);
+      do_get_serfs();
+      do_debug_building_triggers();
+      loop_task = 0;
+      loop_phase = LoopHousekeeping;
+      break;
 
+    //-----------------------------------------------------------
+    // housekeeping tasks
+    //  NOTE - all of these should probably be moved to run AFTER the main game loop.
+    //    for example, we shouldn't send geologists out as the very first action when starting a game,
+    //      rather it should be done after first few buildings/roads placed
+    //-----------------------------------------------------------
+    //  do_spiderweb_roads1 is left out, it might be too close to the castle, do some more testing
+    //  do_send_geologists is run inside warehouse / stock loop only because it uses occupied_building_count which uses stock_pos
+    case LoopHousekeeping:
+      if (loop_task < housekeeping_tasks.size()) {
+        run_task(&housekeeping_tasks[loop_task++]);
+        break;
+      }
+      update_stocks_pos();
+      loop_stock = 0;
+      loop_phase = LoopStocks;
+      break;
 
-    do_build_sawmill_lumberjacks();
-    // really need to change stocks_pos to be the pos of the stock itself and not the flag
-    //   it should be simple to do, need to test a bunch after to make sure nothing breaks
-    //if (stock_pos == castle_pos && do_wait_until_sawmill_lumberjacks_built() == false)
-    if (map->move_up_left(stock_pos) == castle_pos && do_wait_until_sawmill_lumberjacks_built() == false)
+    case LoopStocks:
+      if (loop_stock >= stocks_pos.size()) {
+        loop_phase = LoopWarehouse;
+        break;
+      }
+      stock_pos = stocks_pos[loop_stock++];
+      if (!run_stock_loop()) {
+        stats.end_loop(loop_count, game->get_tick() - loop_start_tick);
+        game->get_tick_watchdog()->check_ai_loop(player_index, stats.get_loops()->front().step_ns);
+        publish_memory_usage();
+        loop_arena.reset();
+        loop_phase = LoopStart;
+        return;
+      }
+      publish_overlay();
+      rest(stock_rest_ticks);
       return;
-    unsigned int planks_count = realm_inv[Resource::TypePlank];
-    if (planks_count < planks_crit) {
-      AILogDebug["next_loop"] << name << " planks below crit, ending loop early";
+
+    case LoopWarehouse:
+      // create parallel infrastructure!
+      do_build_warehouse();
+      //ai_mark_pos.clear();
+      AILogInfo["continue_loop"] << name << " Done AI Loop #" << loop_count;
+      ai_status.assign("END OF LOOP");
+      AILogDebug["continue_loop"] << name << " done loop, it took " << game->get_tick() - loop_start_tick << " ticks, resting " << loop_end_rest_ticks << " ticks";
+      stats.end_loop(loop_count, game->get_tick() - loop_start_tick);
+      game->get_tick_watchdog()->check_ai_loop(player_index, stats.get_loops()->front().step_ns);
+      publish_memory_usage();
+      loop_arena.reset();
+      loop_phase = LoopStart;
+      rest(loop_end_rest_ticks);
       return;
     }
+  } while (!governor.slice_used());
+}
 
-    do_build_stonecutter();
+// the economy loop for stock_pos.  Returns false to end the whole loop early
+bool
+AI::run_stock_loop() {
+  AILogDebug["run_stock_loop"] << name << " Starting economy loop for stock at pos " << stock_pos;
+
+  // debug
+  AILogDebug["run_stock_loop"] << name << " stock at pos " << stock_pos << " has all/completed/occupied buildings: ";
+  for (int x = 0; x < 25; x++) {
+    AILogDebug["run_stock_loop"] << name << " type " << x << " / " << NameBuilding[x] << ": " << stock_buildings.at(stock_pos).count[x]
+      << "/" << stock_buildings.at(stock_pos).completed_count[x] << "/" << stock_buildings.at(stock_pos).occupied_count[x];
+  }
+
+  do_get_inventory(stock_pos);
+  do_demolish_excess_lumberjacks();
+  do_demolish_excess_fishermen();
+  do_promote_serfs_to_knights();
+  do_send_geologists();
+
+  // PLACE MINES EARLY - but do not connect them to roads so they do not actually get built until later
+  //   this is to secure good placement when resources are found, before the signs fade
+  do_place_coal_mines();
+  do_place_iron_mines();
+  do_place_gold_mines();
+
+
+  do_build_sawmill_lumberjacks();
+  // really need to change stocks_pos to be the pos of the stock itself and not the flag
+  //   it should be simple to do, need to test a bunch after to make sure nothing breaks
+  //if (stock_pos == castle_pos && do_wait_until_sawmill_lumberjacks_built() == false)
+  if (map->move_up_left(stock_pos) == castle_pos && do_wait_until_sawmill_lumberjacks_built() == false)
+    return false;
+  unsigned int planks_count = realm_inv[Resource::TypePlank];
+  if (planks_count < planks_crit) {
+    AILogDebug["run_stock_loop"] << name << " planks below crit, ending loop early";
+    return false;
+  }
 
-    // is this the right place for this?  ... yes I think so..
-    //  but it should be limited to buffer around CASTLE only to avoid enemy encroaching critical castle roads area
-    //   and another defensive buffer scoring should be kept to defend the rest of the territory/buildings
-    do_create_defensive_buffer();
+  do_build_stonecutter();
 
-    do_build_toolmaker_steelsmelter();
+  // is this the right place for this?  ... yes I think so..
+  //  but it should be limited to buffer around CASTLE only to avoid enemy encroaching critical castle roads area
+  //   and another defensive buffer scoring should be kept to defend the rest of the territory/buildings
+  do_create_defensive_buffer();
 
-    do_build_food_buildings_and_3rd_lumberjack();
+  do_build_toolmaker_steelsmelter();
 
-    do_connect_coal_mines();
-    do_connect_iron_mines();
-    do_build_steelsmelter();
-    do_build_blacksmith();
+  do_build_food_buildings_and_3rd_lumberjack();
 
-    do_build_gold_smelter_and_connect_gold_mines();
+  do_connect_coal_mines();
+  do_connect_iron_mines();
+  do_build_steelsmelter();
+  do_build_blacksmith();
 
-    AILogDebug["next_loop"] << name << " Done with economy loop for stock at pos " << stock_pos;
-    std::this_thread::sleep_for(std::chrono::milliseconds(2000));
-  }
+  do_build_gold_smelter_and_connect_gold_mines();
 
-  // create parallel infrastructure!
-  do_build_warehouse();
+  AILogDebug["run_stock_loop"] << name << " Done with economy loop for stock at pos " << stock_pos;
+  return true;
+}
 
-  //ai_mark_pos.clear();
-  AILogInfo["next_loop"] << name << " Done AI Loop #" << loop_count;
-  ai_status.assign("END OF LOOP");
-  AILogDebug["next_loop"] << name << " loop complete, sleeping 2sec";
-  loop_clock_duration = (std::clock() - loop_clock_start) / static_cast<double>(CLOCKS_PER_SEC);
-  AILogDebug["next_loop"] << name << " done next_loop, call took " << loop_clock_duration;
-  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+
+
+
+
+
+
+const Color &
+AI::get_overlay_color(uint8_t index) {
+  return mark_colors[index];
 }
 
+// copy ai_mark_pos and ai_mark_serf for the viewport.  The copy is made into
+//  the previous overlay if the viewport is done with it, then swapped in whole
+void
+AI::publish_overlay() {
+  std::shared_ptr<Overlay> next = std::move(spare_overlay);
+  if (!next) {
+    next = std::make_shared<Overlay>();
+  }
+  next->mark_pos.clear();
+  next->mark_color.clear();
+  for (const ColorDot &dot : ai_mark_pos) {
+    next->mark_pos.push_back(dot.first);
+    next->mark_color.push_back(static_cast<uint8_t>(dot.second));
+  }
+  next->mark_serf = ai_mark_serf;
+  std::sort(next->mark_serf.begin(), next->mark_serf.end());
 
+  std::shared_ptr<const Overlay> previous = std::atomic_load(&overlay);
+  std::atomic_store(&overlay, std::shared_ptr<const Overlay>(next));
+  if (previous.use_count() == 1) {
+    spare_overlay = std::const_pointer_cast<Overlay>(previous);
+  }
+}
 
+// the containers that live as long as the AI does.  Strings in them are not
+//  counted, only the entries
+void
+AI::publish_memory_usage() {
+  std::shared_ptr<MemoryUsage> usage = std::make_shared<MemoryUsage>();
+  usage->add("ai.mark_pos", ai_mark_pos.size(), MemoryUsage::vector_bytes(ai_mark_pos.get_dots()) +
+             MemoryUsage::vector_bytes(ai_mark_serf));
+  usage->add("ai.serf_wait_timers", serf_wait_timers.size(), MemoryUsage::tree_bytes(serf_wait_timers));
+  usage->add("ai.bad_building_pos", bad_building_pos.size(), MemoryUsage::tree_bytes(bad_building_pos));
+  usage->add("ai.road_builders", road_builders.get_idle_count(), road_builders.get_allocated_bytes());
+  usage->add("ai.loop_arena", loop_arena.get_block_count(), loop_arena.get_allocated_bytes());
+  {
+    std::lock_guard<std::mutex> lock(road_plot_cache_mutex);
+    size_t bytes = MemoryUsage::tree_bytes(road_plot_cache);
+    for (const std::pair<const std::pair<MapPos, MapPos>, RoadPlot> &plot : road_plot_cache) {
+      bytes += MemoryUsage::vector_bytes(plot.second.stamps) +
+               MemoryUsage::vector_bytes(plot.second.split_roads);
+    }
+    usage->add("ai.road_plot_cache", road_plot_cache.size(), bytes);
+  }
+  {
+    std::lock_guard<std::mutex> lock(road_clusters_mutex);
+    usage->add("ai.road_clusters", road_clusters.get_node_count(), road_clusters.get_allocated_bytes());
+  }
+  size_t arena_bytes = 0;
+  for (const std::unique_ptr<SearchArena> &arena : road_arenas) {
+    arena_bytes += arena->get_allocated_bytes();
+  }
+  usage->add("ai.road_arenas", road_arenas.size(), arena_bytes);
+  usage->add("ai.area_score_cache", area_score_cache.size(), MemoryUsage::tree_bytes(area_score_cache));
+  usage->add("ai.flag_dists", 1, flag_dists.get_allocated_bytes());
+  std::atomic_store(&memory_usage, std::shared_ptr<const MemoryUsage>(usage));
+}
 
+// the steps that walk or build roads are the expensive ones, they run less
+//  often and get a larger budget
+void
+AI::init_tasks() {
+  housekeeping_tasks = {
+    { "connect_disconnected_flags", &AI::do_connect_disconnected_flags, 1, 0.5, 0, 1 },  // except unfinished mines
+    { "build_better_roads_for_important_buildings", &AI::do_build_better_roads_for_important_buildings, 3, 0.5, 0, 1 },
+    { "spiderweb_roads2", &AI::do_spiderweb_roads2, 4, 0.5, 0, 1 },
+    { "pollute_castle_area_roads_with_flags", &AI::do_pollute_castle_area_roads_with_flags, 4, 0.5, 0, 1 },
+    { "fix_stuck_serfs", &AI::do_fix_stuck_serfs, 1, 0.1, 0, 1 },
+    { "fix_missing_transporters", &AI::do_fix_missing_transporters, 1, 0.1, 0, 1 },
+    { "build_rangers", &AI::do_build_rangers, 2, 0.5, 0, 1 },
+    { "remove_road_stubs", &AI::do_remove_road_stubs, 3, 0.1, 0, 1 },
+    { "demolish_unproductive_3rd_lumberjacks", &AI::do_demolish_unproductive_3rd_lumberjacks, 3, 0.1, 0, 1 },
+    { "demolish_unproductive_stonecutters", &AI::do_demolish_unproductive_stonecutters, 3, 0.1, 0, 1 },
+    { "demolish_unproductive_mines", &AI::do_demolish_unproductive_mines, 3, 0.1, 0, 1 },
+    { "manage_tool_priorities", &AI::do_manage_tool_priorities, 1, 0.1, 0, 1 },
+    { "manage_mine_food_priorities", &AI::do_manage_mine_food_priorities, 1, 0.1, 0, 1 },
+    { "balance_sword_shield_priorities", &AI::do_balance_sword_shield_priorities, 1, 0.1, 0, 1 },
+    { "attack", &AI::do_attack, 1, 0.5, 0, 1 },
+    { "manage_knight_occupation_levels", &AI::do_manage_knight_occupation_levels, 1, 0.1, 0, 1 },
+  };
+}
 
+// run a task if it is due this loop.  The steps check their own conditions
+//  (e.g. attack only when there is something worth attacking), so a due task
+//  always runs
+void
+AI::run_task(Task *task) {
+  if (loop_count < task->next_loop) {
+    AILogDebug["run_task"] << name << " skipping " << task->name << " until loop #" << task->next_loop;
+    return;
+  }
+  std::clock_t task_clock_start = std::clock();
+  (this->*task->run)();
+  double task_clock_duration = (std::clock() - task_clock_start) / static_cast<double>(CLOCKS_PER_SEC);
+  if (task_clock_duration > task->budget) {
+    if (task->backoff < 8) {
+      task->backoff *= 2;
+    }
+    AILogDebug["run_task"] << name << " " << task->name << " took " << task_clock_duration << ", over its budget of " << task->budget << ", putting it off for " << task->every * task->backoff << " loops";
+  } else {
+    task->backoff = 1;
+  }
+  task->next_loop = loop_count + task->every * task->backoff;
+  publish_overlay();
+}
 
+// catch up on what changed in the game since the last loop.  The game's events are read
+//  here on the AI's own thread without the game lock; if the AI fell so far behind that
+//  some were lost, that is counted and the rest of the loop looks the game over anyway
+void
+AI::read_game_events() {
+  PROFILE_SCOPE("ai.read_game_events");
+  unsigned int count = 0;
+  bool complete = game->get_events()->read(&game_events, [this, &count](const GameEvent &event) {
+    count++;
+    if (event.type == GameEvent::TypeBuildingChanged && event.player == player_index &&
+        event.data == GameEvent::BuildingBurning) {
+      AILogDebug["read_game_events"] << name << " building #" << event.index << " at pos " << event.pos << " started burning at tick " << event.tick;
+      stats.count(AIStats::BuildingsBurnt);
+    }
+  });
+  stats.count(AIStats::GameEventsRead, count);
+  if (!complete) {
+    AILogDebug["read_game_events"] << name << " fell behind the game's events, some were lost";
+    stats.count(AIStats::GameEventsLost);
+  }
+}
 
 void
 AI::do_place_castle() {
+  PROFILE_SCOPE("ai.do_place_castle");
   AILogDebug["do_place_castle"] << name << " inside do_place_castle()";
   ai_status.assign("HAS_CASTLE_CHECK");
   if (!player->has_castle()) {
     AILogDebug["do_place_castle"] << name << " does not yet have a castle";
     // place castle
     //   improve this so that it is more intelligent about other resources than trees/stones/building_sites
-    //    but have the minimum scores reduced a bit for each area scored so it eventually settles on something
     //
-    // pick random spots on the map until an acceptable area found, and try building there
-    //
-    // IMPORTANT - with multiple AI threads all starting at the same time, they are trying to build castle at the same time,
-    //    this Random rnd will actually be IDENTICAL across all threads!  To mix them up, sleep a bit so that
-    //      the time that is fed to seed the random function gets a different time-seed for each player
-    // changed this to mutex.lock() instead, but keeping this because... I dunno it seems nicer when they don't all start at exactly the same time
-    //   maybe start doing random wait instead?  meh
-    AILogDebug["do_place_castle"] << name << " sleeping " << player_index << "sec so each AI player thread gets different seed for random map pos";
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000 * player_index));
-    Random rnd;
-    int tries = 200;
-    int x = 0;
-    while (true) {
+    // every place on the map a castle could go is scored once, on all cores, for the trees, stones and
+    //  building sites around it, and kept for the map seed so every AI in this game and in later games on the
+    //  same map shares it.  The best sites that are castle_spacing apart are dealt out by player index, so
+    //  which AI starts where only depends on the map and not on which AI thread gets here first.  If that site
+    //  is taken (by a human player, say) try the next ones, then any acceptable site at all
+    CastleSites::Minimums min = { near_trees_min * 4, near_stones_min, near_building_sites_min };
+    std::shared_ptr<const CastleSites::Sites> sites = CastleSites::get(game.get(), min);
+    CastleSites::Sites spread = CastleSites::spread(*map, *sites, castle_spacing);
+    AILogDebug["do_place_castle"] << name << " found " << sites->size() << " acceptable castle sites, " << spread.size() << " of them " << castle_spacing << " tiles apart";
+    std::vector<const CastleSites::Site *> tries;
+    for (size_t i = 0; i < spread.size(); i++) {
+      tries.push_back(&spread[(player_index + i) % spread.size()]);
+    }
+    for (const CastleSites::Site &site : *sites) {
+      tries.push_back(&site);
+    }
+    unsigned int x = 0;
+    for (const CastleSites::Site *site : tries) {
       x++;
-      if (x > tries) {
-        AILogDebug["do_place_castle"] << name << " unable to place castle after " << x << " tries!";
-        exit(1);
-      }
-      MapPos pos = map->get_rnd_coord(NULL, NULL, &rnd);
-      AILogDebug["do_place_castle"] << name << ": considering placing castle at random pos " << pos;
+      MapPos pos = site->pos;
+      AILogDebug["do_place_castle"] << name << ": considering placing castle at pos " << pos << " with trees: " << site->trees << ", stones: " << site->stones << ", building_sites: " << site->building_sites;
       if (!game->can_build_castle(pos, player)) {
         AILogDebug["do_place_castle"] << name << " cannot build a castle at pos " << pos;
         continue;
       }
-      if (place_castle(game, pos, spiral_dist(8))) {
-        AILogDebug["do_place_castle"] << name << " found acceptable place to build castle, at pos: " << pos;
-        AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->build_castle";
-        game->get_mutex()->lock();
-        AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->build_castle";
-        bool was_built = game->build_castle(pos, player);
-        AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->build_castle";
-        game->get_mutex()->unlock();
-        AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->build_castle";
-        if (was_built) {
-          AILogDebug["do_place_castle"] << name << ": built castle at pos: " << pos << " after " << x << " tries";
-          castle_pos = pos;
-          castle_flag_pos = map->move_down_right(castle_pos);
-          AILogDebug["do_place_castle"] << name << " castle has position " << castle_pos << ", with castle_flag_pos " << castle_flag_pos;
-          return;
-        }
-        AILogDebug["do_place_castle"] << name << " failed to build castle at pos: " << pos << ", will keep trying";
+      AILogDebug["do_place_castle"] << name << " found acceptable place to build castle, at pos: " << pos;
+      AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply build_castle";
+      bool was_built = wait_for_command(game->get_commands()->build_castle(pos, player_index));
+      if (was_built) {
+        AILogDebug["do_place_castle"] << name << ": built castle at pos: " << pos << " after " << x << " tries";
+        castle_pos = pos;
+        castle_flag_pos = map->move_down_right(castle_pos);
+        AILogDebug["do_place_castle"] << name << " castle has position " << castle_pos << ", with castle_flag_pos " << castle_flag_pos;
+        return;
       }
+      AILogDebug["do_place_castle"] << name << " failed to build castle at pos: " << pos << ", will keep trying";
     }
+    AILogDebug["do_place_castle"] << name << " unable to place castle after " << x << " tries!";
+    exit(1);
   }
   // on game load, castle_pos is unknown even though castle exists, need to find it
   if (castle_pos == bad_map_pos) {
     AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for finding castle on game load)";
-    game->get_mutex()->lock();
+    game->get_mutex()->lock_shared(LOCK_SITE());
     AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for finding castle on game load)";
     Game::ListBuildings buildings = game->get_player_buildings(player);
     AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for finding castle on game load)";
-    game->get_mutex()->unlock();
+    game->get_mutex()->unlock_shared();
     AILogDebug["do_place_castle"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for finding castle on game load)";
     for (Building *building : buildings) {
       if (building->get_type() == Building::TypeCastle) {
@@ -517,6 +706,7 @@ AI::do_place_castle() {
 
 void
 AI::do_save_game() {
+  PROFILE_SCOPE("ai.do_save_game");
   AILogDebug["do_save_game"] << name << " inside do_save_game()";
   // only one AI thread should be auto-saving, and really it should be the main game auto-saving anyway but that is harder to do
   if (!has_autosave_mutex) {
@@ -529,34 +719,31 @@ AI::do_save_game() {
     return;
   }
   ai_status.assign("SAVING_GAME");
-  // save game for debugging
-  AILogDebug["do_save_game"] << name << " preparing to save game...";
-  AILogDebug["do_get_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before auto-saving game";
-  game->get_mutex()->lock();
-  AILogDebug["do_get_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before auto-saving game";
-  std::string savetick = std::to_string(game->get_tick());
-  std::string savename = "ai_debug_" + savetick + ".save";
-  AILogDebug["do_save_game"] << name << " savegame name is '" << savename << " '";
-  if (GameStore::get_instance().save(savename, game.get())) {
-    AILogDebug["do_save_game"] << name << " succesfully saved game name " << savename;
+  // save game for debugging, the game thread takes it at the end of its next update
+  //  and it is written on the autosave thread, so neither this AI nor the game waits for the file
+  std::string folder = debug_save_folder;
+  if (folder.empty()) {
+    folder = GameStore::get_instance().get_folder_path();
+  }
+  AILogDebug["do_save_game"] << name << " asking for an autosave named '" << folder << "/ai_debug_<tick>.save'";
+  game->get_autosave()->request(folder + "/ai_debug_");
+  GameAutosave::Timing last = game->get_autosave()->get_last_timing();
+  if (!last.path.empty()) {
+    AILogDebug["do_save_game"] << name << " last autosave " << last.path << (last.saved ? " saved, " : " FAILED, ")
+      << last.snapshot_ms << "ms in the game, " << last.write_ms << "ms writing";
   }
-  else {
-    AILogDebug["do_save_game"] << name << " FAILED TO SAVE GAME NAME " << savename;
-  }
-  AILogDebug["do_get_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after auto-saving game";
-  game->get_mutex()->unlock();
-  AILogDebug["do_get_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after auto-saving game";
 }
 
 
 void
 AI::do_update_clear_reset() {
+  PROFILE_SCOPE("ai.do_update_clear_reset");
   AILogDebug["do_update_clear_reset"] << name << " inside do_update_clear_reset";
   ai_status.assign("CLEARING_AND_RESETTING");
   ai_mark_pos.clear();
   ai_mark_serf.clear();
   last_expand_towards = expand_towards;
-  expand_towards.clear();
+  expand_towards.reset();
   road_options.reset(RoadOption::Direct);
   road_options.set(RoadOption::SplitRoads);
   road_options.set(RoadOption::PenalizeNewLength);
@@ -565,6 +752,7 @@ AI::do_update_clear_reset() {
   unfinished_hut_count = 0;
   unfinished_building_count = 0;
   realm_inv = player->get_stats_resources();
+  economy.update(game->get_snapshot(), player_index);
   scoring_attack = false;
   scoring_warehouse = false;
   cannot_expand_borders_this_loop = false;
@@ -574,6 +762,7 @@ AI::do_update_clear_reset() {
 
 void
 AI::do_get_serfs() {
+  PROFILE_SCOPE("ai.do_get_serfs");
   // time this function for debugging
   std::clock_t start;
   double duration;
@@ -582,13 +771,13 @@ AI::do_get_serfs() {
   AILogDebug["do_get_serfs"] << name << " inside do_get_serfs";
   AILogDebug["do_get_serfs"] << name << " getting serfs";
   AILogDebug["do_get_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before getting serfs at AI loop start";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_get_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before getting serfs at AI loop start";
   serfs_idle = player->get_stats_serfs_idle();
   serfs_potential = player->get_stats_serfs_potential();
   serfs_total = player->get_serfs();
   AILogDebug["do_get_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after getting serfs at AI loop start";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["do_get_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after getting serfs at AI loop start";
   duration = (std::clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
   AILogDebug["do_get_serfs"] << name << " done do_get_serfs call took " << duration;
@@ -600,6 +789,7 @@ AI::do_get_serfs() {
 //  building certain buildings manually triggers some function
 void
 AI::do_debug_building_triggers() {
+  PROFILE_SCOPE("ai.do_debug_building_triggers");
   AILogDebug["do_debug_building_triggers"] << name << " inside do_debug_building_triggers";
   update_building_counts();
   // DEBUG
@@ -609,12 +799,12 @@ AI::do_debug_building_triggers() {
     rebuild_all_roads();
     // then destroy the pig farm so it doesn't keep rebuilding forever
     AILogDebug["do_debug_building_triggers"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before demolishing pig farm";
-    game->get_mutex()->lock();
+    game->get_mutex()->lock(LOCK_SITE());
     AILogDebug["do_debug_building_triggers"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before demolishing pig farm";
     Game::ListBuildings buildings = game->get_player_buildings(player);
     for (Building *building : buildings) {
       if (building->get_type() == Building::TypePigFarm)
-        game->demolish_building(building->get_position(), player);
+        game->get_commands()->demolish_building(building->get_position(), player_index);
     }
     AILogDebug["do_debug_building_triggers"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after demolishing pig farm";
     game->get_mutex()->unlock();
@@ -649,6 +839,7 @@ AI::do_debug_building_triggers() {
 
 void
 AI::do_promote_serfs_to_knights() {
+  PROFILE_SCOPE("ai.do_promote_serfs_to_knights");
   AILogDebug["do_promote_serfs_to_knights"] << name << " inside do_promote_serfs_to_knights";
   ai_status.assign("HOUSEKEEPING - promote serfs to knights");
   unsigned int idle_serfs = static_cast<unsigned int>(stock_inv->free_serf_count());
@@ -663,11 +854,10 @@ AI::do_promote_serfs_to_knights() {
   //int promoted = player->promote_serfs_to_knights(promotable);
   int promoted = 0;
   AILogDebug["do_promote_serfs_to_knights"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_serfs(player) (for do_manage_knight_occupation_levels is_waiting)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock(LOCK_SITE());
   AILogDebug["do_promote_serfs_to_knights"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_serfs(player) (for do_manage_knight_occupation_levels is_waiting)";
-  // this returns a copy, so it should be thread-safe
-  //  maybe not, beause game->get_player_serfs internally just does for (Serf *serf : serfs)
-  for (Serf *serf : game->get_player_serfs(player)) {
+  // lists the serfs in place, so only while the mutex is held
+  for (Serf *serf : game->get_owned_serfs(player)) {
     if (promotable < 1) { break; }
     if (serf->get_state() == Serf::StateIdleInStock &&
       serf->get_type() == Serf::TypeGeneric) {
@@ -686,6 +876,7 @@ AI::do_promote_serfs_to_knights() {
 
 void
 AI::do_connect_disconnected_flags() {
+  PROFILE_SCOPE("ai.do_connect_disconnected_flags");
   // time this function for debugging
   std::clock_t start;
   double duration;
@@ -722,16 +913,16 @@ AI::do_connect_disconnected_flags() {
     bool was_built = AI::build_best_road(flag->get_position(), road_options);
     if (!was_built) {
       AILogDebug["do_connect_disconnected_flags"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling demolish_flag (and maybe attached building)";
-      game->get_mutex()->lock();
+      game->get_mutex()->lock(LOCK_SITE());
       AILogDebug["do_connect_disconnected_flags"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling demolish_flag (and maybe attached building)";
       // should I look for an attached building an burn it?
       // yes!  let's try that
       if (flag->has_building()) {
         AILogDebug["do_connect_disconnected_flags"] << name << " failed to connect disconnected flag to road network!  BURNING ATTACHED BUILDING!";
-        game->demolish_building(flag->get_position(), player);
+        game->get_commands()->demolish_building(flag->get_position(), player_index);
       }
       AILogDebug["do_connect_disconnected_flags"] << name << " failed to connect disconnected flag to road network!  removing it";
-      game->demolish_flag(flag->get_position(), player);
+      game->get_commands()->demolish_flag(flag->get_position(), player_index);
       AILogDebug["do_connect_disconnected_flags"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling demolish_flag (and maybe attached building)";
       game->get_mutex()->unlock();
       AILogDebug["do_connect_disconnected_flags"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling demolish_flag (and maybe attached building)";
@@ -745,6 +936,7 @@ AI::do_connect_disconnected_flags() {
 
 void
 AI::do_spiderweb_roads2() {
+  PROFILE_SCOPE("ai.do_spiderweb_roads2");
   // time this function for debugging
   std::clock_t start;
   double duration;
@@ -776,7 +968,7 @@ AI::do_spiderweb_roads2() {
     for (unsigned int i = AI::spiral_dist(14); i < AI::spiral_dist(15); i++) {
       MapPos ring_pos = map->pos_add_extended_spirally(castle_pos, i);
       //ai_mark_pos.erase(ring_pos);
-      //ai_mark_pos.insert(ColorDot(ring_pos, "dk_coral"));
+      //ai_mark_pos.insert(ColorDot(ring_pos, MarkDkCoral));
       // only every X positions or on last spot in ring
       if (i % 4 != 0 || i == AI::spiral_dist(15) - 1 )
         continue;
@@ -786,14 +978,14 @@ AI::do_spiderweb_roads2() {
       for (unsigned int x = 0; x < AI::spiral_dist(4); x++) {
         MapPos area_pos = map->pos_add_extended_spirally(ring_pos, x);
         //ai_mark_pos.erase(area_pos);
-        //ai_mark_pos.insert(ColorDot(area_pos, "lavender"));
+        //ai_mark_pos.insert(ColorDot(area_pos, MarkLavender));
         //std::this_thread::sleep_for(std::chrono::milliseconds(5));
         if (!map->has_flag(area_pos) || map->get_owner(area_pos) != player_index)
           continue;
         if (!game->get_flag_at_pos(area_pos)->is_connected())
           continue;
         //ai_mark_pos.erase(area_pos);
-        //ai_mark_pos.insert(ColorDot(area_pos, "red"));
+        //ai_mark_pos.insert(ColorDot(area_pos, MarkRed));
         flag_list.push_back(area_pos);
         //std::this_thread::sleep_for(std::chrono::milliseconds(5));
       }
@@ -836,8 +1028,8 @@ AI::do_spiderweb_roads2() {
 
           AILogDebug["do_spiderweb_roads2"] << name << " still considering";
           //ai_mark_pos.clear();
-          //ai_mark_pos.insert(ColorDot(area_flag_pos, "green"));
-          //ai_mark_pos.insert(ColorDot(other_area_flag_pos, "red"));
+          //ai_mark_pos.insert(ColorDot(area_flag_pos, MarkGreen));
+          //ai_mark_pos.insert(ColorDot(other_area_flag_pos, MarkRed));
           //std::this_thread::sleep_for(std::chrono::milliseconds(200));
           road_options.set(RoadOption::Improve);
           AILogDebug["do_spiderweb_roads2"] << name << " about to call build_best_road";
@@ -867,6 +1059,7 @@ AI::do_spiderweb_roads2() {
 //  to disfavor transport paths that would otherwise route through the castle, encouraging alternate routes
 void
 AI::do_pollute_castle_area_roads_with_flags() {
+  PROFILE_SCOPE("ai.do_pollute_castle_area_roads_with_flags");
   AILogDebug["do_pollute_castle_area_roads_with_flags"] << name << " inside do_pollute_castle_area_roads_with_flagsderweb_roads2";
   ai_status.assign("HOUSEKEEPING - do_pollute_castle_area_roads_with_flags");
   // only do this every X loops, and only once a certain number of huts have been built
@@ -884,15 +1077,11 @@ AI::do_pollute_castle_area_roads_with_flags() {
     if (map->has_any_path(pos)){
       if (game->can_build_flag(pos, player)) {
         AILogDebug["do_pollute_castle_area_roads_with_flags"] << name << " building a pollution flag at pos " << pos;
-        AILogDebug["do_pollute_castle_area_roads_with_flags"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->build_flag";
-        game->get_mutex()->lock();
-        AILogDebug["do_pollute_castle_area_roads_with_flags"] << name << " thread #" << std::this_thread::get_id() << " AI has locking mutex before calling game->build_flag";
-        if (game->build_flag(pos, player)) {
+        // waits for each flag, so the next can_build_flag sees it
+        AILogDebug["do_pollute_castle_area_roads_with_flags"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply build_flag";
+        if (wait_for_command(game->get_commands()->build_flag(pos, player_index))) {
           created_flags++;
         }
-        AILogDebug["do_pollute_castle_area_roads_with_flags"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->build_flag";
-        game->get_mutex()->unlock();
-        AILogDebug["do_pollute_castle_area_roads_with_flags"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->build_flag";
       }
     }
   }
@@ -903,6 +1092,7 @@ AI::do_pollute_castle_area_roads_with_flags() {
 
 void
 AI::do_spiderweb_roads1() {
+  PROFILE_SCOPE("ai.do_spiderweb_roads1");
   AILogDebug["do_spiderweb_roads1"] << name << " inside do_spiderweb_roads1";
   ai_status.assign("HOUSEKEEPING - do_spiderweb_roads1");
   // "spider-web" roads - because a "star network" pattern naturally emerges with castle at center, try to
@@ -928,7 +1118,7 @@ AI::do_spiderweb_roads1() {
     for (unsigned int i = AI::spiral_dist(8); i < AI::spiral_dist(9); i++) {
       MapPos ring_pos = map->pos_add_extended_spirally(castle_pos, i);
       //ai_mark_pos.erase(ring_pos);
-      //ai_mark_pos.insert(ColorDot(ring_pos, "dk_coral"));
+      //ai_mark_pos.insert(ColorDot(ring_pos, MarkDkCoral));
       // only every X positions or on last spot in ring
       if (i % 3 != 0 || i == AI::spiral_dist(9) - 1)
         continue;
@@ -938,14 +1128,14 @@ AI::do_spiderweb_roads1() {
       for (unsigned int x = 0; x < AI::spiral_dist(3); x++) {
         MapPos area_pos = map->pos_add_extended_spirally(ring_pos, x);
         //ai_mark_pos.erase(area_pos);
-        //ai_mark_pos.insert(ColorDot(area_pos, "white"));
+        //ai_mark_pos.insert(ColorDot(area_pos, MarkWhite));
         //std::this_thread::sleep_for(std::chrono::milliseconds(5));
         if (!map->has_flag(area_pos) || map->get_owner(area_pos) != player_index)
           continue;
         if (!game->get_flag_at_pos(area_pos)->is_connected())
           continue;
         //ai_mark_pos.erase(area_pos);
-        //ai_mark_pos.insert(ColorDot(area_pos, "red"));
+        //ai_mark_pos.insert(ColorDot(area_pos, MarkRed));
         flag_list.push_back(area_pos);
         //std::this_thread::sleep_for(std::chrono::milliseconds(5));
       }
@@ -988,8 +1178,8 @@ AI::do_spiderweb_roads1() {
 
           AILogDebug["do_spiderweb_roads1"] << name << " still considering";
           //ai_mark_pos.clear();
-          //ai_mark_pos.insert(ColorDot(area_flag_pos, "green"));
-          //ai_mark_pos.insert(ColorDot(other_area_flag_pos, "red"));
+          //ai_mark_pos.insert(ColorDot(area_flag_pos, MarkGreen));
+          //ai_mark_pos.insert(ColorDot(other_area_flag_pos, MarkRed));
           //std::this_thread::sleep_for(std::chrono::milliseconds(200));
           road_options.set(RoadOption::Improve);
           AILogDebug["do_spiderweb_roads1"] << name << " about to call build_best_road";
@@ -1016,6 +1206,7 @@ AI::do_spiderweb_roads1() {
 
 void
 AI::do_fix_stuck_serfs() {
+  PROFILE_SCOPE("ai.do_fix_stuck_serfs");
   // time this function for debugging
   std::clock_t start;
   double duration;
@@ -1033,101 +1224,56 @@ AI::do_fix_stuck_serfs() {
   //  occupied!  I saw this early in a game where a fisherman was on way to a new fisherman hut, got stuck, was booted, returned to castle, but never was sent back to hut!
   // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
-  // handle serf_wait_idle_on_path_timer that have already been set
-  SerfWaitTimer::iterator serf_wait_idle_on_road_timer;
-  for (serf_wait_idle_on_road_timer = serf_wait_idle_on_road_timers.begin(); serf_wait_idle_on_road_timer != serf_wait_idle_on_road_timers.end(); ) {
-    unsigned int serf_index = serf_wait_idle_on_road_timer->first;
-    Serf *serf = game->get_serf(serf_index);
-    if (serf == nullptr) {
-      ++serf_wait_idle_on_road_timer;
+  // the game keeps the serfs waiting on roads and since when, see GameWatchdog, so only
+  //  those that have waited too long need looking at
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  const std::vector<GameSnapshot::WaitingSerfView> &waiting_serfs = snapshot->get_player(player_index).waiting_serfs;
+  AILogDebug["do_fix_stuck_serfs"] << name << " there are " << waiting_serfs.size() << " serfs waiting on roads";
+  for (const GameSnapshot::WaitingSerfView &waiting : waiting_serfs) {
+    if (snapshot->get_tick() - waiting.since <= stuck_serf_wait_ticks)
       continue;
-    }
-    unsigned int trigger_tick = serf_wait_idle_on_road_timer->second;
-    if (serf->get_state() != Serf::StateWaitIdleOnPath) {
-      AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer serf is no longer stuck, skipping";
-      AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer erasing serf_wait_idle_on_road_timer for serf " << serf->get_index() << " at pos " << serf->get_pos();
-      // found in C++ example... iterator is set by the result of the erase call on the current iterator pos (which is serf_index)
-      serf_wait_idle_on_road_timer = serf_wait_idle_on_road_timers.erase(serf_wait_idle_on_road_timer);
+    Serf *serf = game->get_serf(waiting.index);
+    if (serf == nullptr || serf->get_state() != Serf::StateWaitIdleOnPath)
+      continue;
+    AILogDebug["do_fix_stuck_serfs"] << name << " serf " << serf->get_index() << " at pos " << serf->get_pos() << " has been in WAIT_IDLE_ON_PATH since tick " << waiting.since;
+    ai_mark_serf.push_back(serf->get_index());
+    AILogDebug["do_fix_stuck_serfs"] << name << " detected WAIT_IDLE_ON_PATH STUCK SERF at pos " << serf->get_pos() << ", marking its current pos in lt_purple";
+    ai_mark_pos.insert(ColorDot(serf->get_pos(), MarkLtPurple));
+    //std::this_thread::sleep_for(std::chrono::milliseconds(10000));
+    AILogDebug["do_fix_stuck_serfs"] << name << " attempting to set serf to lost state, updating marking to purple";
+    ai_mark_pos.erase(serf->get_pos());
+    ai_mark_pos.insert(ColorDot(serf->get_pos(), MarkPurple));
+    Serf::Type serf_job = serf->get_type();
+    // got a nullptr here for flag->get_position, maybe break it up and mutex lock?
+    // got another nullptr. trying a slight modification...
+    //  haven't seen a nullptr in forever here, think its fixed  (oct28 2020)
+    MapPos serf_dest_flag_pos = bad_map_pos;
+    Flag *serf_dest_flag = game->get_flag(serf->get_walking_dest());
+    if (serf_dest_flag == nullptr) {
+      AILogDebug["do_fix_stuck_serfs"] << name << " the flag that is the walking dest of serf about to be booted is nullptr!  serf_dest_flag_pos will remain bad_map_pos";
     }
     else {
-      if (game->get_tick() > trigger_tick) {
-        AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer triggering serf_wait_idle_on_road_timer for serf " << serf->get_index() << " at pos " << serf->get_pos();
-
-        AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer detected WAIT_IDLE_ON_PATH STUCK SERF at pos " << serf->get_pos() << ", marking its current pos in lt_purple";
-        ai_mark_pos.insert(ColorDot(serf->get_pos(), "lt_purple"));
-        //std::this_thread::sleep_for(std::chrono::milliseconds(10000));
-        // don't erase timer if problem isn't fixed yet, keep checking each AI loop
-        AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer attempting to set serf to lost state, updating marking to purple";
-        ai_mark_pos.erase(serf->get_pos());
-        ai_mark_pos.insert(ColorDot(serf->get_pos(), "purple"));
-        Serf::Type serf_job = serf->get_type();
-        // got a nullptr here for flag->get_position, maybe break it up and mutex lock?
-        // got another nullptr. trying a slight modification...
-        //  haven't seen a nullptr in forever here, think its fixed  (oct28 2020)
-        MapPos serf_dest_flag_pos = bad_map_pos;
-        Flag *serf_dest_flag = game->get_flag(serf->get_walking_dest());
-        if (serf_dest_flag == nullptr) {
-          AILogDebug["do_fix_stuck_serfs"] << name << " the flag that is the walking dest of serf about to be booted is nullptr!  serf_dest_flag_pos will remain bad_map_pos";
-        }
-        else {
-          serf_dest_flag_pos = serf_dest_flag->get_position();
-        }
-        // more info, saw case of a stuck Digger (leveller) that was on way to a construction site, but when stuck his walking_dest flag was a flag somewhere totally different
-        //   in the realm and not a place where a Digger was even needed.  Maybe a bad pointer somewhere is causing the walking_dest to be set to someplace invalid and this is
-        //     the cause of the stuck serf WAIT_IDLE_ON_PATH issue???
-        AILogDebug["do_fix_stuck_serfs"] << name << " about to boot serf with job type: " << serf->get_type() << " " << NameSerf[serf->get_type()] << name << " with walking_dest/flag_pos " << serf_dest_flag_pos;
-        if (serf_job == Serf::TypeTransporter) {
-          AILogDebug["do_fix_stuck_serfs"] << name << " WARNING - a transporter was booted, see if this causes flag at map_pos " << serf_dest_flag_pos << " to be without a transporter!";
-        }
-        if (serf_job != Serf::TypeTransporter && serf_job != Serf::TypeGeologist && serf_job != Serf::TypeDigger && serf_job != Serf::TypeBuilder
-          && serf_job != Serf::TypeKnight0 && serf_job != Serf::TypeKnight1 && serf_job != Serf::TypeKnight2 && serf_job != Serf::TypeKnight3 && serf_job != Serf::TypeKnight4) {
-          AILogDebug["do_fix_stuck_serfs"] << name << " WARNING - a building-occupying professional serf was booted, see if this causes building with flag pos " << serf_dest_flag_pos << " to stay forever unoccupied!";
-          //std::this_thread::sleep_for(std::chrono::milliseconds(6000));
-        }
-        if (serf_job == Serf::TypeKnight0 || serf_job == Serf::TypeKnight1 || serf_job == Serf::TypeKnight2 || serf_job == Serf::TypeKnight3 || serf_job == Serf::TypeKnight4) {
-          AILogDebug["do_fix_stuck_serfs"] << name << " WARNING - a knight was booted, see if this causes military building with flag pos " << serf_dest_flag_pos << " to have a forever empty slot!";
-          //::this_thread::sleep_for(std::chrono::milliseconds(6000));
-        }
-        AILogDebug["do_fix_stuck_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling serf->set_lost_state (for bug workaround stuck serfs)";
-        game->get_mutex()->lock();
-        AILogDebug["do_fix_stuck_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling serf->set_lost_state (for bug workaround stuck serfs)";
-        serf->set_lost_state();
-        AILogDebug["do_fix_stuck_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after after serf->set_lost_state (for bug workaround stuck serfs)";
-        game->get_mutex()->unlock();
-        AILogDebug["do_fix_stuck_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after after serf->set_lost_state (for bug workaround stuck serfs)";
-      }
-      ++serf_wait_idle_on_road_timer;
+      serf_dest_flag_pos = serf_dest_flag->get_position();
     }
-  }
-  AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer after checking timeouts, there are now " << serf_wait_idle_on_road_timers.size() << " TOTAL serf_wait_idle_on_road_timers set";
-
-  // look for new waiting serfs and set serf_wait_timers
-  AILogDebug["do_fix_stuck_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_serfs(player) (for serf_wait_timers StateWaitIdleOnPath)";
-  game->get_mutex()->lock();
-  AILogDebug["do_fix_stuck_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_serfs(player) (for serf_wait_timers StateWaitIdleOnPath)";
-  // this returns a copy, so it should be thread-safe
-  //  maybe not, beause game->get_player_serfs internally just does for (Serf *serf : serfs)
-  for (Serf *serf : game->get_player_serfs(player)) {
-    if (serf->get_state() == Serf::StateIdleInStock)
-      continue;
-    if (serf->get_state() == Serf::StateWaitIdleOnPath) {
-      // see if a serf_wait_timer already set for this flag & dir
-      if (serf_wait_idle_on_road_timers.count(serf->get_index()) == 0) {
-        AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer WAIT_IDLE_ON_PATH DETECTED setting countdown serf_wait_idle_on_road_timer for serf with index " << serf->get_index();
-        serf_wait_idle_on_road_timers.insert(std::make_pair(serf->get_index(), game->get_tick() + 10000));
-        AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer WAIT_IDLE_ON_PATH DETECTED marking serf on AI overlay";
-        ai_mark_serf.push_back(serf->get_index());
-        //std::this_thread::sleep_for(std::chrono::milliseconds(12000));
-      }
-      else {
-        int trigger_ticks = static_cast<int>(serf_wait_idle_on_road_timers.at(serf->get_index()) - game->get_tick());
-        AILogDebug["do_fix_stuck_serfs"] << name << " SerfWaitTimer WAIT_IDLE_ON_PATH a serf_wait_idle_on_road_timer is already set for this serf, it will trigger in " << trigger_ticks << " ticks";
-      }
+    // more info, saw case of a stuck Digger (leveller) that was on way to a construction site, but when stuck his walking_dest flag was a flag somewhere totally different
+    //   in the realm and not a place where a Digger was even needed.  Maybe a bad pointer somewhere is causing the walking_dest to be set to someplace invalid and this is
+    //     the cause of the stuck serf WAIT_IDLE_ON_PATH issue???
+    AILogDebug["do_fix_stuck_serfs"] << name << " about to boot serf with job type: " << serf->get_type() << " " << NameSerf[serf->get_type()] << name << " with walking_dest/flag_pos " << serf_dest_flag_pos;
+    if (serf_job == Serf::TypeTransporter) {
+      AILogDebug["do_fix_stuck_serfs"] << name << " WARNING - a transporter was booted, see if this causes flag at map_pos " << serf_dest_flag_pos << " to be without a transporter!";
     }
+    if (serf_job != Serf::TypeTransporter && serf_job != Serf::TypeGeologist && serf_job != Serf::TypeDigger && serf_job != Serf::TypeBuilder
+      && serf_job != Serf::TypeKnight0 && serf_job != Serf::TypeKnight1 && serf_job != Serf::TypeKnight2 && serf_job != Serf::TypeKnight3 && serf_job != Serf::TypeKnight4) {
+      AILogDebug["do_fix_stuck_serfs"] << name << " WARNING - a building-occupying professional serf was booted, see if this causes building with flag pos " << serf_dest_flag_pos << " to stay forever unoccupied!";
+      //std::this_thread::sleep_for(std::chrono::milliseconds(6000));
+    }
+    if (serf_job == Serf::TypeKnight0 || serf_job == Serf::TypeKnight1 || serf_job == Serf::TypeKnight2 || serf_job == Serf::TypeKnight3 || serf_job == Serf::TypeKnight4) {
+      AILogDebug["do_fix_stuck_serfs"] << name << " WARNING - a knight was booted, see if this causes military building with flag pos " << serf_dest_flag_pos << " to have a forever empty slot!";
+      //::this_thread::sleep_for(std::chrono::milliseconds(6000));
+    }
+    // the game boots it between ticks, after checking it is still stuck
+    game->get_commands()->boot_serf(serf->get_index(), player_index);
   }
-  AILogDebug["do_fix_stuck_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_serfs(player) (for serf_wait_timers StateWaitIdleOnPath)";
-  game->get_mutex()->unlock();
-  AILogDebug["do_fix_stuck_serfs"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_serfs(player) (for serf_wait_timers StateWaitIdleOnPath)";
   duration = (std::clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
   AILogDebug["do_fix_stuck_serfs"] << name << " done do_fix_stuck_serfs call took " << duration;
 }
@@ -1137,6 +1283,7 @@ AI::do_fix_stuck_serfs() {
 //     Detect this and force sending a transporter using internal game function
 void
 AI::do_fix_missing_transporters() {
+  PROFILE_SCOPE("ai.do_fix_missing_transporters");
   // time this function for debugging
   std::clock_t start;
   double duration;
@@ -1144,164 +1291,90 @@ AI::do_fix_missing_transporters() {
   AILogDebug["do_fix_missing_transporters"] << name << " inside do_fix_missing_transporters";
   ai_status.assign("HOUSEKEEPING - send transporters");
   //
-  // first, check any timers already set
-  //
-  AILogDebug["do_fix_missing_transporters"] << name << " there are " << no_transporter_timers.size() << " TOTAL no_transporter_timers set";
-  FlagDirTimer::iterator no_transporter_timer;
-  for (no_transporter_timer = no_transporter_timers.begin(); no_transporter_timer != no_transporter_timers.end(); ) {
-    std::pair<unsigned int, Direction> flag_dir = no_transporter_timer->first;
-    unsigned int flag_index = flag_dir.first;
-    Direction dir = flag_dir.second;
-    unsigned int trigger_tick = no_transporter_timer->second;
-    if (game->get_tick() > trigger_tick) {
-      AILogDebug["do_fix_missing_transporters"] << name << " triggering timer for flag-dir " << flag_index << "-" << dir << " / " << NameDirection[dir];
-      Flag *flag = game->get_flag(flag_index);
-      if (flag == nullptr || flag->get_owner() != player_index) {
-        ++no_transporter_timer;
-        continue;
-      }
-      if (flag->has_transporter(dir)) {
-        AILogDebug["do_fix_missing_transporters"] << name << " looks like a transporter finally arrived, not calling another";
-        AILogDebug["do_fix_missing_transporters"] << name << " erasing timer for flag-dir " << flag_index << "-" << dir << " / " << NameDirection[dir];
-        // found in C++ example... iterator is set by the result of the erase call on the current iterator pos (which is serf_index)
-        no_transporter_timer = no_transporter_timers.erase(no_transporter_timer);
-      }
-      else {
-        AILogDebug["do_fix_missing_transporters"] << name << " timer detected BUG FOUND - NO TRANSPORTER on road at pos " << game->get_flag(flag_index)->get_position() << ", marking in cyan";
-        ai_mark_pos.insert(ColorDot(flag->get_position(), "cyan"));
-        AILogDebug["do_fix_missing_transporters"] << name << " timer trying to force call a transporter";
-        AILogDebug["do_fix_missing_transporters"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling flag->call_transporter, to work around no-transporter issue";
-        game->get_mutex()->lock();
-        AILogDebug["do_fix_missing_transporters"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling flag->call_transporter, to work around no-transporter issue";
-        // got access violation w/ 2x AIs, even with mutex, look for a foreach loop being invalidated elsewhere
-        //Access violation reading location 0xFFFFFFFFFFFFFFFF.
-        // oh... I think I just wasn't checking that this player owns the flag!  adding that
-        // now getting some other read access violation after Inventory->have serfs... on Load Game testing though, dunno
-        bool was_called = flag->call_transporter(dir, false);  // hardcoding is_water_path to false because I am seeing weird crash with this checking for Serf::TypeSailor
-        AILogDebug["do_fix_missing_transporters"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling flag->call_transporter, to work around no-transporter issue";
-        game->get_mutex()->unlock();
-        AILogDebug["do_fix_missing_transporters"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling flag->call_transporter, to work around no-transporter issue";
-        if (!was_called) {
-          AILogDebug["do_fix_missing_transporters"] << name << " WARNING - flag->call_transporter failed while trying to work around no-transporter issue!  I guess let it try again next time";
-        }
-        // don't erase if it isn't fixed yet, keep checking each AI loop
-        //++no_transporter_timer;
-        //  **actually, DO erase, because in rare cases if a road is removed when a timer set, and then a different road built there(?)
-        //   it causes a neverending trigger.  Best to assume it works and let it discover all over again if it has not
-        no_transporter_timer = no_transporter_timers.erase(no_transporter_timer);
-      }
-    }
-    else {
-      ++no_transporter_timer;
-    }
-  }
-  //AILogDebug["do_fix_missing_transporters"] << name << " after checking timeouts, there are now " << no_transporter_timers.size() << " TOTAL no_transporter_timers set";
-
+  // common missing transporter bug, where no transporter is assigned at all.  The game keeps the paths
+  //  without a transporter and since when they have waited (since the road was built, the transporter
+  //  was lost or one was last called), see GameWatchdog.  This is difficult to tune... if too long the
+  //  entire economy can break down while waiting to clear it, but too soon and it could trigger for a
+  //  faraway road that the original transporter simply hasn't reached
   //
-  // look for missing transporters and if found set timers for them
-  //
-  unsigned int flag_index = 0;
-  flags_static_copy = *(game->get_flags());
-  flags = &flags_static_copy;
-  for (Flag *flag : *flags) {
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  const GameSnapshot::PlayerView &view = snapshot->get_player(player_index);
+  AILogDebug["do_fix_missing_transporters"] << name << " there are " << view.unserved_paths.size() << " paths without a transporter";
+  for (const GameSnapshot::UnservedPathView &unserved : view.unserved_paths) {
+    if (snapshot->get_tick() - unserved.since <= missing_transporter_wait_ticks)
+      continue;
+    Flag *flag = game->get_flag(unserved.flag_index);
+    Direction dir = unserved.dir;
     if (flag == nullptr || flag->get_owner() != player_index || !flag->is_connected())
       continue;
     // it seems the castle shows as having a path Up-Left into it...
     //    I wonder if any other buildings do also?  warehouses?
     if (flag->get_position() == castle_flag_pos)
       continue;
-    flag_index = flag->get_index();
+    if (map->road_segment_in_water(flag->get_position(), dir))
+      continue;
+    AILogDebug["do_fix_missing_transporters"] << name << " detected BUG FOUND - NO TRANSPORTER since tick " << unserved.since << " on road at pos " << flag->get_position() << " in dir " << NameDirection[dir] << ", marking in cyan";
+    ai_mark_pos.insert(ColorDot(flag->get_position(), MarkCyan));
+    // the game calls it between ticks.  A transporter that is sent restarts the wait, so if it
+    //  never arrives this triggers again later
+    game->get_commands()->call_transporter(unserved.flag_index, dir, player_index);
+  }
+
+  //
+  // check for rare missing transporter bug, where flag lists a transporter in dir, but no serf is actually on the road
+  //  nothing in the game notices this, so these roads are still walked, but from the snapshot's flags rather
+  //  than a copy of all of them
+  //
+  for (const GameSnapshot::FlagView &flag_view : view.flags) {
+    if (!flag_view.connected || flag_view.pos == castle_flag_pos)
+      continue;
     for (Direction dir : cycle_directions_cw()) {
-      if (!map->has_path(flag->get_position(), dir))
+      if (!BIT_TEST(flag_view.paths, dir) || !BIT_TEST(flag_view.transporters, dir))
         continue;
-      if (map->road_segment_in_water(flag->get_position(), dir))
+      if (map->road_segment_in_water(flag_view.pos, dir))
         continue;
-      //
-      // check for rare missing transporter bug, where flag lists a transporter in dir, but no serf is actually on the road
-      //
-      if (flag->has_transporter(dir)) {
-        bool found_transporter = false;
-        Road road;
-        if (!map->has_path(flag->get_position(), dir)) {
-          AILogDebug["do_fix_missing_transporters"] << name << " no path found at " << flag->get_position() << " in direction " << NameDirection[dir] << " during no_transporter check!  FIND OUT WHY";
+      bool found_transporter = false;
+      MapPos pos = flag_view.pos;
+      Direction tmp_dir = dir;
+      while (true) {
+        // check for idle transporter
+        // when transporters are idle on roads, they "disappear" and are set to index 0 with invalid job, etc.  I think this may be
+        //   so other serfs can pass through them?  Regardless of why, they can be detected by checking if map->get_idle_serf(pos) is true
+        if (map->get_idle_serf(pos)) {
+          found_transporter = true;
+          break;
         }
-        MapPos pos = flag->get_position();
-        Direction tmp_dir = dir;
-        while (true) {
-          // check for idle transporter
-          // when transporters are idle on roads, they "disappear" and are set to index 0 with invalid job, etc.  I think this may be
-          //   so other serfs can pass through them?  Regardless of why, they can be detected by checking if map->get_idle_serf(pos) is true
-          if (map->get_idle_serf(pos)) {
+        // check for an active transporter
+        Serf *serf_on_path = game->get_serf_at_pos(pos);
+        if (serf_on_path != nullptr) {
+          if (serf_on_path->get_type() == Serf::TypeTransporter) {
+            // need to check state to make sure it isn't just passing through on way to another road ???
+            // ALSO, if there is a serf working on an adjacent road that happens to be at this flag end, this will think it is
+            //    servicing this road being checked, but on some subsequent pass it should detect it
             found_transporter = true;
             break;
           }
-          // check for an active transporter
-          Serf *serf_on_path = game->get_serf_at_pos(pos);
-          if (serf_on_path != nullptr) {
-            if (serf_on_path->get_type() == Serf::TypeTransporter) {
-              // need to check state to make sure it isn't just passing through on way to another road ???
-              // ALSO, if there is a serf working on an adjacent road that happens to be at this flag end, this will think it is
-              //    servicing this road being checked, but on some subsequent pass it should detect it
-              found_transporter = true;
-              break;
-            }
-          }
-          if (map->has_flag(pos) && pos != flag->get_position()) {
-            break;
-          }
-          pos = map->move(pos, tmp_dir);
-          for (Direction new_dir : cycle_directions_cw()) {
-            if (map->has_path(pos, new_dir) && new_dir != reverse_direction(tmp_dir)) {
-              tmp_dir = new_dir;
-              break;
-            }
-          }
         }
-        if (found_transporter == false) {
-          AILogDebug["do_fix_missing_transporters"] << name << " WARNING - found rare type of missing transporter bug!  Flag #" << flag->get_index() << " at pos " << flag->get_position() << " seems to be missing a transporter on road in dir " << NameDirection[dir] << " despite it thinking there is one there!";
-          ai_mark_pos.insert(std::make_pair(flag->get_position(), "lt_blue"));
-          std::this_thread::sleep_for(std::chrono::milliseconds(5000));
-          ai_mark_pos.clear();
-          AILogDebug["do_fix_missing_transporters"] << name << " detected BUG FOUND - RARER NO TRANSPORTER on road at pos " << game->get_flag(flag_index)->get_position() << ", marking in white";
-          ai_mark_pos.insert(ColorDot(flag->get_position(), "white"));
-          AILogDebug["do_fix_missing_transporters"] << name << " trying to immediately force call a transporter";
-          AILogDebug["do_fix_missing_transporters"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling flag->call_transporter, to work around RARER no-transporter issue";
-          game->get_mutex()->lock();
-          AILogDebug["do_fix_missing_transporters"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling flag->call_transporter, to work around RARER no-transporter issue";
-          bool was_called = flag->call_transporter(dir, false);  // hardcoding is_water_path to false because I am seeing weird crash with this checking for Serf::TypeSailor
-          AILogDebug["do_fix_missing_transporters"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling flag->call_transporter, to work around RARER no-transporter issue";
-          game->get_mutex()->unlock();
-          AILogDebug["do_fix_missing_transporters"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling flag->call_transporter, to work around RARER no-transporter issue";
-          if (!was_called) {
-            AILogDebug["do_fix_missing_transporters"] << name << " WARNING - flag->call_transporter to " << flag->get_position() << ", dir " << NameDirection[dir] << " - failed while trying to work around RARER no-transporter issue!  I guess let it try again next time";
-          }
-          std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+        if (map->has_flag(pos) && pos != flag_view.pos) {
+          break;
         }
-        else {
-          AILogDebug["do_fix_missing_transporters"] << name << " found expected transporter with Flag #" << flag->get_index() << " at pos " << flag->get_position() << " on road in dir " << NameDirection[dir];
+        pos = map->move(pos, tmp_dir);
+        for (Direction new_dir : cycle_directions_cw()) {
+          if (map->has_path(pos, new_dir) && new_dir != reverse_direction(tmp_dir)) {
+            tmp_dir = new_dir;
+            break;
+          }
         }
-
       }
-      //
-      // check for common missing transporter bug, where no transporter is assigned at all
-      //
-      if (!flag->has_transporter(dir)) {
-        AILogDebug["do_fix_missing_transporters"] << name << " flag at pos " << flag->get_position() << " has no transporter on path in dir " << dir << " / " << NameDirection[dir];
-        // maybe check to see if there is a Walking Transporter serf whose dest is this path?
-        // see if a timer already set for this flag & dir
-        AILogDebug["do_fix_missing_transporters"] << name << " there are " << no_transporter_timers.count(std::make_pair(flag_index, dir)) << " no_transporter_timers set for this flag-dir " << flag_index << "-" << dir << " / " << NameDirection[dir];
-        if (no_transporter_timers.count(std::make_pair(flag_index, dir)) == 0) {
-          AILogDebug["do_fix_missing_transporters"] << name << " setting countdown timer for flag with index " << flag_index;
-          // this is difficult to tune... if too long the entire economy can break down while waiting to clear it
-          //    but too soon as it could trigger for a faraway road that the original transporter simply hasn't reached
-          //  Maybe make more advanced and check to see if there is an outgoing transporter serf with this destination flag/dir??
-          no_transporter_timers.insert(std::make_pair(std::make_pair(flag_index, dir), game->get_tick() + 20000));
-          AILogDebug["do_fix_missing_transporters"] << name << " there are now " << no_transporter_timers.count(std::make_pair(flag_index, dir)) << " no_transporter_timers set for this flag-dir " << flag_index << "-" << dir << " / " << NameDirection[dir] << name << ", value is: " << no_transporter_timers.at(std::make_pair(flag_index, dir));
-        }
-        else {
-          int trigger_ticks = static_cast<int>(no_transporter_timers.at(std::make_pair(flag_index, dir)) - game->get_tick());
-          AILogDebug["do_fix_missing_transporters"] << name << " a timer is already set for this path, it will trigger in " << trigger_ticks << " ticks";
-        }
+      if (found_transporter == false) {
+        AILogDebug["do_fix_missing_transporters"] << name << " WARNING - found rare type of missing transporter bug!  Flag #" << flag_view.index << " at pos " << flag_view.pos << " seems to be missing a transporter on road in dir " << NameDirection[dir] << " despite it thinking there is one there!";
+        AILogDebug["do_fix_missing_transporters"] << name << " detected BUG FOUND - RARER NO TRANSPORTER on road at pos " << flag_view.pos << ", marking in white";
+        ai_mark_pos.insert(ColorDot(flag_view.pos, MarkWhite));
+        AILogDebug["do_fix_missing_transporters"] << name << " trying to immediately force call a transporter";
+        game->get_commands()->call_transporter(flag_view.index, dir, player_index);
+      }
+      else {
+        AILogDebug["do_fix_missing_transporters"] << name << " found expected transporter with Flag #" << flag_view.index << " at pos " << flag_view.pos << " on road in dir " << NameDirection[dir];
       }
     }
   }
@@ -1312,6 +1385,7 @@ AI::do_fix_missing_transporters() {
 
 void
 AI::do_send_geologists() {
+  PROFILE_SCOPE("ai.do_send_geologists");
   //
   // send geologists to hills
   //
@@ -1321,7 +1395,7 @@ AI::do_send_geologists() {
   start = std::clock();
   AILogDebug["do_send_geologists"] << name << " HouseKeeping: send geologists to hills";
   ai_status.assign("HOUSEKEEPING - send geologists");
-  MapPosSet count_by_corner;
+  MapPosRanking count_by_corner;
   MapPosVector geologist_positions;
   // don't send geologists if already have enough mines
   update_building_counts();
@@ -1380,11 +1454,10 @@ AI::do_send_geologists() {
   }
   // determine where any geologists are currently operating (to later avoid sending too many to one area)
   AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_serfs(player) (for serf_wait_timers is_waiting)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_serfs(player) (for serf_wait_timers is_waiting)";
-  // this returns a copy, so it should be thread-safe
-  //  maybe not, beause game->get_player_serfs internally just does for (Serf *serf : serfs)
-  for (Serf *serf : game->get_player_serfs(player)) {
+  // lists the serfs in place, so only while the mutex is held
+  for (Serf *serf : game->get_owned_serfs(player)) {
     if (serf->get_type() == Serf::TypeGeologist) {
       MapPos pos = bad_map_pos;
       //AILogDebug["do_send_geologists"] << name << " geologist state: " << serf->print_state();
@@ -1435,7 +1508,7 @@ AI::do_send_geologists() {
     }
   }
   AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_serfs(player) (for serf_wait_timers is_waiting)";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_serfs(player) (for serf_wait_timers is_waiting)";
   AILogDebug["do_send_geologists"] << name << " active geologists found: " << geologist_positions.size();
   // count hills (Tundra0-2, Snow0, NOT Snow1 because can't build mines there)
@@ -1452,7 +1525,7 @@ AI::do_send_geologists() {
     for (MapPos corner_pos : corners) {
       AILogDebug["do_send_geologists"] << name << " considering corner_pos " << corner_pos;
       // i'm not sure why Snow0 is valid for mining, it seems to be the edge where hill meets snow
-      unsigned int count = AI::count_empty_terrain_near_pos(corner_pos, AI::spiral_dist(4), Map::TerrainTundra0, Map::TerrainSnow0, "orange");
+      unsigned int count = AI::count_empty_terrain_near_pos(corner_pos, AI::spiral_dist(4), Map::TerrainTundra0, Map::TerrainSnow0, MarkOrange);
       //AILogDebug["do_send_geologists"] << name << " corner has hills count: " << count << ", min acceptable is " << hills_min;
       if (count >= hills_min) {
         double sign_density = AI::count_geologist_sign_density(corner_pos, AI::spiral_dist(4));
@@ -1514,13 +1587,8 @@ AI::do_send_geologists() {
           }
           if (other_flags == 0) {
             AILogDebug["do_send_geologists"] << name << " no other flags nearby " << pos << ", building flag here";
-            AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->build_flag, for geologist";
-            game->get_mutex()->lock();
-            AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI has locking mutex before calling game->build_flag, for geologist";
-            built_pos = game->build_flag(pos, player);
-            AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->build_flag, for geologist";
-            game->get_mutex()->unlock();
-            AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->build_flag, for geologist";
+            AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply build_flag, for geologist";
+            built_pos = wait_for_command(game->get_commands()->build_flag(pos, player_index));
             if (!map->has_flag(pos)) {
               AILogDebug["do_send_geologists"] << name << " failed to build flag at pos " << pos << "!!! why??";
             }
@@ -1530,13 +1598,8 @@ AI::do_send_geologists() {
             }
             if (!AI::build_best_road(pos, road_options)) {
               AILogDebug["do_send_geologists"] << name << " failed to connect new gologist flag to road network!  removing the flag";
-              AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling demolish_flag (built for geoligist, couldn't connect)";
-              game->get_mutex()->lock();
-              AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling demolish_flag (built for geoligist, couldn't connect)";
-              game->demolish_flag(pos, player);
-              AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling demolish_flag (built for geoligist, couldn't connect)";
-              game->get_mutex()->unlock();
-              AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling demolish_flag (built for geoligist, couldn't connect)";
+              AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply demolish_flag (built for geoligist, couldn't connect)";
+              wait_for_command(game->get_commands()->demolish_flag(pos, player_index));
               AILogDebug["do_send_geologists"] << name << " adding this flag pos " << pos << " to bad_building_pos list";
               // because there is no Building::Type for a plain flag, use Building::TypeNone for now.
               //  alternatively, could create a new type, or use some number that has no type
@@ -1571,9 +1634,7 @@ AI::do_send_geologists() {
             AILogDebug["do_send_geologists"] << name << " no idle or potential geologists available, returning";
             return;
           }
-          AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->send_geologist(flag)";
-          game->get_mutex()->lock();
-          AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->send_geologist(flag)";
+          AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply send_geologist";
           /*
           // even with this extra check it still will likely break once warehouse/stocks come into play
           //   also, it doesn't make sense that theis check would even be required, clearly something else is wrong
@@ -1590,10 +1651,7 @@ AI::do_send_geologists() {
             }
           }
           */
-          bool was_sent = game->send_geologist(flag);
-          AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->send_geologist(flag)";
-          game->get_mutex()->unlock();
-          AILogDebug["do_send_geologists"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->send_geologist(flag)";
+          bool was_sent = wait_for_command(game->get_commands()->send_geologist(pos, player_index));
           if (was_sent) {
             //AILogDebug["do_send_geologists"] << name << " sent an geologist to pos " << pos << ", moving on to next corner";
             //break;
@@ -1626,6 +1684,7 @@ AI::do_send_geologists() {
 
 void
 AI::do_build_rangers() {
+  PROFILE_SCOPE("ai.do_build_rangers");
   AILogDebug["do_build_rangers"] << name << " inside do_build_rangers";
   //
   // build ranger near lumberjacks that have few trees and no ranger nearby
@@ -1633,17 +1692,17 @@ AI::do_build_rangers() {
   AILogDebug["do_build_rangers"] << name << " HouseKeeping: build rangers near lumberjacks that have few trees and no ranger nearby";
   ai_status.assign("HOUSEKEEPING - build rangers");
   AILogDebug["do_build_rangers"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for do_build_rangers)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_build_rangers"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for do_build_rangers)";
   Game::ListBuildings buildings = game->get_player_buildings(player);
   AILogDebug["do_build_rangers"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for do_build_rangers)";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["do_build_rangers"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for do_build_rangers)";
   for (Building *building : buildings) {
     if (building->get_type() != Building::TypeLumberjack)
       continue;
     MapPos pos = building->get_position();
-    unsigned int count = AI::count_objects_near_pos(pos, AI::spiral_dist(4), Map::ObjectTree0, Map::ObjectPine7, "lt_green");
+    unsigned int count = AI::count_objects_near_pos(pos, AI::spiral_dist(4), Map::ObjectTree0, Map::ObjectPine7, MarkLtGreen);
     AILogDebug["do_build_rangers"] << name << " lumberjack trees nearby count: " << count << ", min acceptable is " << near_trees_min;
     if (count >= near_trees_min)
       continue;
@@ -1659,17 +1718,18 @@ AI::do_build_rangers() {
 
 void
 AI::do_demolish_unproductive_3rd_lumberjacks() {
+  PROFILE_SCOPE("ai.do_demolish_unproductive_3rd_lumberjacks");
   AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " inside do_demolish_unproductive_3rd_lumberjacks";
   //
   // build ranger near lumberjacks that have few trees and no ranger nearby
   //
   ai_status.assign("HOUSEKEEPING - burn unproductive 3rd lumberjacks");
   AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player)";
   Game::ListBuildings buildings = game->get_player_buildings(player);
   AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player)";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player)";
   // find all sawmills in the realm, and check the area around each one
   // if three completed lumberjacks and a ranger are nearby, but still not many trees,
@@ -1706,13 +1766,8 @@ AI::do_demolish_unproductive_3rd_lumberjacks() {
       }
       if (ranger_count > 0 && mature_tree_count < near_trees_min) {
         AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " 3rd lumberjack at pos " << lumberjack_pos << " has a nearby ranger yet still only has " << mature_tree_count << ", less than near_trees_min " << near_trees_min << ".  Burning it so it can be replaced in a better spot";
-        AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->demolish_building";
-        game->get_mutex()->lock();
-        AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->demolish_building";
-        game->demolish_building(lumberjack_pos, player);
-        AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->demolish_building";
-        game->get_mutex()->unlock();
-        AILogDebug["do_demolish_unproductive_3rd_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->demolish_building";
+        // queued, the game thread burns it at the start of the next tick
+        game->get_commands()->demolish_building(lumberjack_pos, player_index);
         break;
       }
     }
@@ -1727,6 +1782,7 @@ AI::do_demolish_unproductive_3rd_lumberjacks() {
 //  - a mountain/geologist road, if sign density > max
 void
 AI::do_remove_road_stubs() {
+  PROFILE_SCOPE("ai.do_remove_road_stubs");
   AILogDebug["do_remove_road_stubs"] << name << " inside do_remove_road_stubs";
   // time this function for debugging
   std::clock_t start;
@@ -1737,11 +1793,11 @@ AI::do_remove_road_stubs() {
   // ...an occupied ranger building, if no other paths from ranger flag
   //
   AILogDebug["do_remove_road_stubs"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for do_remove_road_stubs)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_remove_road_stubs"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for do_remove_road_stubs)";
   Game::ListBuildings buildings = game->get_player_buildings(player);
   AILogDebug["do_remove_road_stubs"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for do_remove_road_stubs)";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["do_remove_road_stubs"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for do_remove_road_stubs)";
   for (Building *building : buildings) {
     if (building->get_type() != Building::TypeForester)
@@ -1763,7 +1819,7 @@ AI::do_remove_road_stubs() {
     }
     if (paths == 1) {
       AILogDebug["do_remove_road_stubs"] << name << " occupied ranger at pos " << pos << "'s flag has only one path, removing the stub road";
-      game->demolish_road(map->move(flag_pos, road_dir), player);
+      game->get_commands()->demolish_road(map->move(flag_pos, road_dir), player_index);
       roads_removed++;
     }
   }
@@ -1812,9 +1868,9 @@ AI::do_remove_road_stubs() {
     }
     if (paths == 1) {
       AILogDebug["do_remove_road_stubs"] << name << " eligible geologist road ending with flag at pos " << flag_pos << " has only one path, removing the stub road and its end flag";
-      game->demolish_road(map->move(flag_pos, road_dir), player);
+      game->get_commands()->demolish_road(map->move(flag_pos, road_dir), player_index);
       roads_removed++;
-      game->demolish_flag(flag_pos, player);
+      game->get_commands()->demolish_flag(flag_pos, player_index);
     }
   }
   duration = (std::clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
@@ -1827,14 +1883,15 @@ AI::do_remove_road_stubs() {
 // demolish any stonecutters with no stones nearby
 void
 AI::do_demolish_unproductive_stonecutters() {
+  PROFILE_SCOPE("ai.do_demolish_unproductive_stonecutters");
   AILogDebug["do_demolish_unproductive_stonecutters"] << name << " inside do_demolish_unproductive_stonecutters";
   ai_status.assign("HOUSEKEEPING - demolish stonecutters");
   AILogDebug["do_demolish_unproductive_stonecutters"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for demolish stonecutters)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_demolish_unproductive_stonecutters"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for demolish stonecutters)";
   Game::ListBuildings buildings = game->get_player_buildings(player);
   AILogDebug["do_demolish_unproductive_stonecutters"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for demolish stonecutters)";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["do_demolish_unproductive_stonecutters"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for demolish stonecutters)";
   for (Building *building : buildings) {
     if (building->get_type() != Building::TypeStonecutter)
@@ -1843,7 +1900,7 @@ AI::do_demolish_unproductive_stonecutters() {
     int stones_check = AI::count_stones_near_pos(pos, AI::spiral_dist(4));
     if (stones_check < 1) {
       AILogDebug["do_demolish_unproductive_stonecutters"] << name << " stonecutter at pos " << pos << " has no more stones nearby!  burning it";
-      game->demolish_building(pos, player);
+      game->get_commands()->demolish_building(pos, player_index);
       // mark as bad pos, because there should be no reason it could ever become valid again (stone piles cannot regrow)
       bad_building_pos.insert(std::make_pair(pos, Building::TypeStonecutter));
     }
@@ -1855,14 +1912,15 @@ AI::do_demolish_unproductive_stonecutters() {
 // demolish any completed mines that have food stored but are not productive
 void
 AI::do_demolish_unproductive_mines() {
+  PROFILE_SCOPE("ai.do_demolish_unproductive_mines");
   AILogDebug["do_demolish_unproductive_mines"] << name << " inside do_demolish_unproductive_mines";
   ai_status.assign("HOUSEKEEPING - demolish unproductive mines");
   AILogDebug["do_demolish_unproductive_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for demolish unproductive mines)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_demolish_unproductive_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for demolish unproductive mines)";
   Game::ListBuildings buildings = game->get_player_buildings(player);
   AILogDebug["do_demolish_unproductive_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for demolish unproductive mines)";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["do_demolish_unproductive_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for demolish unproductive mines)";
   for (Building *building : buildings) {
     if (!building->is_done())
@@ -1900,13 +1958,8 @@ AI::do_demolish_unproductive_mines() {
     AILogDebug["do_demolish_unproductive_mines"] << name << " mine at " << building_pos << " has " << building->get_res_count_in_stock(0) << " food stored";
     if (output < mine_output_min && building->get_res_count_in_stock(0) > 0) {
       AILogDebug["do_demolish_unproductive_mines"] << name << " burning unproductive mine of type " << NameBuilding[building_type] << name << " at pos " << building_pos;
-      AILogDebug["do_demolish_unproductive_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->demolish_building (for demolish unproductive mines)";
-      game->get_mutex()->lock();
-      AILogDebug["do_demolish_unproductive_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->demolish_building (for demolish unproductive mines)";
-      game->demolish_building(building_pos, player);
-      AILogDebug["do_demolish_unproductive_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->demolish_building (for demolish unproductive mines)";
-      game->get_mutex()->unlock();
-      AILogDebug["do_demolish_unproductive_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->demolish_building (for demolish unproductive mines)";
+      // queued, the game thread burns it at the start of the next tick
+      game->get_commands()->demolish_building(building_pos, player_index);
       // mark as bad pos, because rebuilding same mine type seems pointless if it is actually out of resources
       bad_building_pos.insert(std::make_pair(building_pos, building_type));
     }
@@ -1918,6 +1971,7 @@ AI::do_demolish_unproductive_mines() {
 // burn all but one lumberjack per stock if planks_max reached, to avoid clogging roads
 void
 AI::do_demolish_excess_lumberjacks() {
+  PROFILE_SCOPE("ai.do_demolish_excess_lumberjacks");
   AILogDebug["do_demolish_excess_lumberjacks"] << name << " inside do_demolish_excess_lumberjacks";
   ai_status.assign("HOUSEKEEPING - burn lumberjacks");
   update_building_counts();
@@ -1927,11 +1981,11 @@ AI::do_demolish_excess_lumberjacks() {
     AILogDebug["do_demolish_excess_lumberjacks"] << name << " planks_max reached and lumberjack_count is " << lumberjack_count << ".  Burning all but one lumberjack (nearest to this stock)";
     bool first_one_found = false;
     AILogDebug["do_demolish_excess_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player)";
-    game->get_mutex()->lock();
+    game->get_mutex()->lock_shared(LOCK_SITE());
     AILogDebug["do_demolish_excess_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player)";
     Game::ListBuildings buildings = game->get_player_buildings(player);
     AILogDebug["do_demolish_excess_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player)";
-    game->get_mutex()->unlock();
+    game->get_mutex()->unlock_shared();
     AILogDebug["do_demolish_excess_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player)";
     for (Building *building : buildings) {
       if (building->get_type() == Building::TypeLumberjack) {
@@ -1947,13 +2001,8 @@ AI::do_demolish_excess_lumberjacks() {
         }
         else {
           AILogDebug["do_demolish_excess_lumberjacks"] << name << " burning lumberjack at pos " << pos;
-          AILogDebug["do_demolish_excess_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player)";
-          game->get_mutex()->lock();
-          AILogDebug["do_demolish_excess_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player)";
-          game->demolish_building(pos, player);
-          AILogDebug["do_demolish_excess_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player)";
-          game->get_mutex()->unlock();
-          AILogDebug["do_demolish_excess_lumberjacks"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player)";
+          // queued, the game thread burns it at the start of the next tick
+          game->get_commands()->demolish_building(pos, player_index);
           // do NOT mark as bad pos
           //bad_building_pos.AI::do_demolish_excess_lumberjacks() {
         }
@@ -1969,6 +2018,7 @@ AI::do_demolish_excess_lumberjacks() {
 // burn ALL fisherman huts attached to this stock if stock food_max reached, to avoid clogging roads
 void
 AI::do_demolish_excess_fishermen() {
+  PROFILE_SCOPE("ai.do_demolish_excess_fishermen");
   AILogDebug["do_demolish_excess_fishermen"] << name << " inside do_demolish_excess_fishermen for stock at pos " << stock_pos;
   ai_status.assign("HOUSEKEEPING - burn fishermen");
   unsigned int food_count = 0;
@@ -1978,11 +2028,11 @@ AI::do_demolish_excess_fishermen() {
   if (food_count >= food_max) {
     AILogDebug["do_demolish_excess_fishermen"] << name << " food_max reached at stock_pos " << stock_pos << ", burning all fishermen attached to this stock";
     AILogDebug["do_demolish_excess_fishermen"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player)";
-    game->get_mutex()->lock();
+    game->get_mutex()->lock_shared(LOCK_SITE());
     AILogDebug["do_demolish_excess_fishermen"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player)";
     Game::ListBuildings buildings = game->get_player_buildings(player);
     AILogDebug["do_demolish_excess_fishermen"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player)";
-    game->get_mutex()->unlock();
+    game->get_mutex()->unlock_shared();
     AILogDebug["do_demolish_excess_fishermen"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player)";
     for (Building *building : buildings) {
       if (building->get_type() == Building::TypeFisher) {
@@ -1992,13 +2042,8 @@ AI::do_demolish_excess_fishermen() {
           continue;
         }
         AILogDebug["do_demolish_excess_fishermen"] << name << " burning fisherman at pos " << pos;
-        AILogDebug["do_demolish_excess_fishermen"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player)";
-        game->get_mutex()->lock();
-        AILogDebug["do_demolish_excess_fishermen"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player)";
-        game->demolish_building(pos, player);
-        AILogDebug["do_demolish_excess_fishermen"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player)";
-        game->get_mutex()->unlock();
-        AILogDebug["do_demolish_excess_fishermen"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player)";
+        // queued, the game thread burns it at the start of the next tick
+        game->get_commands()->demolish_building(pos, player_index);
         // do NOT mark as bad pos, could use this spot again if food is needed later
         //bad_building_pos.insert(std::make_pair(pos, Building::TypeStonecutter));
       }
@@ -2014,6 +2059,7 @@ AI::do_demolish_excess_fishermen() {
 // adjust tool priorities to match needed tools, reset unneccessary tools to default
 void
 AI::do_manage_tool_priorities() {
+  PROFILE_SCOPE("ai.do_manage_tool_priorities");
   AILogDebug["do_manage_tool_priorities"] << name << " inside manage_tool_priorities";
   AILogDebug["do_manage_tool_priorities"] << name << " HouseKeeping: ensure sufficient tools";
   ai_status.assign("HOUSEKEEPING - manage tools");
@@ -2085,11 +2131,11 @@ AI::do_manage_tool_priorities() {
       player->set_tool_prio(4, 65500);
     }
     AILogDebug["do_manage_tool_priorities"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for manage toolmaker)";
-    game->get_mutex()->lock();
+    game->get_mutex()->lock_shared(LOCK_SITE());
     AILogDebug["do_manage_tool_priorities"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for manage toolmaker)";
     Game::ListBuildings buildings = game->get_player_buildings(player);
     AILogDebug["do_manage_tool_priorities"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for manage toolmaker)";
-    game->get_mutex()->unlock();
+    game->get_mutex()->unlock_shared();
     AILogDebug["do_manage_tool_priorities"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for manage toolmaker)";
     for (Building *building : buildings) {
       if (building->get_type() != Building::TypeToolMaker)
@@ -2118,13 +2164,16 @@ AI::do_manage_tool_priorities() {
 
 void
 AI::do_manage_mine_food_priorities() {
+  PROFILE_SCOPE("ai.do_manage_mine_food_priorities");
   AILogDebug["do_manage_mine_food_priorities"] << name << " inside do_manage_mine_food_priorities";
   ai_status.assign("HOUSEKEEPING - manage mine food");
   // if sufficient coal/ore is stored, divert food to other resource miners
   player->reset_food_priority();
-  unsigned int coal_count = realm_inv[Resource::TypeCoal];
-  unsigned int iron_ore_count = realm_inv[Resource::TypeIronOre];
-  unsigned int gold_ore_count = realm_inv[Resource::TypeGoldOre];
+  // a stock the smelters are drawing down is counted as what it will be, so
+  //  food is not cut off just before the mine is needed again
+  unsigned int coal_count = forecast_count(Resource::TypeCoal);
+  unsigned int iron_ore_count = forecast_count(Resource::TypeIronOre);
+  unsigned int gold_ore_count = forecast_count(Resource::TypeGoldOre);
   //6550 is a near-zero value I chose to use as "very low priority"
   // default food priorities:
   //food_stonemine = 13100;
@@ -2171,6 +2220,7 @@ AI::do_manage_mine_food_priorities() {
 //    where the sword/shield icon is mising.  However I am quite sure that the function still works properly
 void
 AI::do_balance_sword_shield_priorities() {
+  PROFILE_SCOPE("ai.do_balance_sword_shield_priorities");
   AILogDebug["do_balance_sword_shield_priorities"] << name << " inside do_balance_sword_shield_priorities";
   ai_status.assign("HOUSEKEEPING - balance swords/shields");
   player->reset_flag_priority();
@@ -2216,6 +2266,7 @@ AI::do_balance_sword_shield_priorities() {
 
 void
 AI::do_manage_knight_occupation_levels() {
+  PROFILE_SCOPE("ai.do_manage_knight_occupation_levels");
   AILogDebug["do_manage_knight_occupation_levels"] << name << " inside do_manage_knight_occupation_levels";
   if (player->cycling_knight()) {
     AILogDebug["do_manage_knight_occupation_levels"] << name << " is currently cycling_knights!  waiting until this is complete";
@@ -2283,17 +2334,12 @@ AI::do_manage_knight_occupation_levels() {
   //unsigned int idle_knights = serfs_idle[Serf::TypeKnight0] + serfs_idle[Serf::TypeKnight1] + serfs_idle[Serf::TypeKnight2] + serfs_idle[Serf::TypeKnight3] + serfs_idle[Serf::TypeKnight4];
   // instead use this function I wrote elsewhere
   unsigned int idle_knights = 0;
-  AILogDebug["do_manage_knight_occupation_levels"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_serfs(player) (for do_manage_knight_occupation_levels is_waiting)";
-  game->get_mutex()->lock();
-  AILogDebug["do_manage_knight_occupation_levels"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_serfs(player) (for do_manage_knight_occupation_levels is_waiting)";
-  for (Serf *serf : game->get_player_serfs(player)) {
-    if (serf->get_state() == Serf::StateIdleInStock && serf->get_type() >= Serf::TypeKnight0 && serf->get_type() <= Serf::TypeKnight4) {
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  for (const GameSnapshot::SerfView &serf : snapshot->get_player(player_index).serfs) {
+    if (serf.state == Serf::StateIdleInStock && serf.type >= Serf::TypeKnight0 && serf.type <= Serf::TypeKnight4) {
       idle_knights++;
     }
   }
-  AILogDebug["do_manage_knight_occupation_levels"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_serfs(player) (for do_manage_knight_occupation_levels is_waiting)";
-  game->get_mutex()->unlock();
-  AILogDebug["do_manage_knight_occupation_levels"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_serfs(player) (for do_manage_knight_occupation_levels is_waiting)";
   AILogDebug["do_manage_knight_occupation_levels"] << name << " found in stocks idle_knights: " << idle_knights;
   player->change_knight_occupation(3, 0, -5);   // reset lower bound to 'min'
   player->change_knight_occupation(3, 1, -5);   // reset upper bound to 'min'
@@ -2328,6 +2374,7 @@ AI::do_manage_knight_occupation_levels() {
 
 void
 AI::do_place_mines(std::string type, Building::Type building_type, Map::Object large_sign, Map::Object small_sign, int max_mines, double sign_density_min) {
+  PROFILE_SCOPE("ai.do_place_mines");
   // time this function for debugging
   std::clock_t start;
   double duration;
@@ -2335,10 +2382,12 @@ AI::do_place_mines(std::string type, Building::Type building_type, Map::Object l
   ai_status.assign("MAIN LOOP - early mine placement - " + type);
   AILogDebug["do_place_mines"] << name << " inside do_place_mines() with type " << type << ", building_type " << NameBuilding[building_type] <<
     ", large_sign " << NameObject[large_sign] << ", small_sign " << NameObject[small_sign] << ", max_mines " << max_mines << ", sign_density_min " << sign_density_min;
+  // the signs of each mineral come large then small, from gold to stone
+  Map::Minerals mineral = static_cast<Map::Minerals>((large_sign - Map::ObjectSignLargeGold) / 2 + 1);
   update_building_counts();
   int mine_count = stock_buildings.at(stock_pos).count[building_type];
   if (mine_count < max_mines) {
-    MapPosSet count_by_corner;
+    MapPosRanking count_by_corner;
     // for mined resouce finding,  reverse the occupied_military_buildings order
     //   so the newest military building is searched first,  instead of castle first
     MapPosVector foo = stock_buildings.at(stock_pos).occupied_military_pos;
@@ -2349,10 +2398,13 @@ AI::do_place_mines(std::string type, Building::Type building_type, Map::Object l
       MapPos center_pos = *it;
       MapPosVector corners = AI::get_corners(center_pos);
       for (MapPos corner_pos : corners) {
+        // only a sign of this type is built on, so skip corners that have none
+        if (map->get_signs_in(corner_pos, 4, mineral) == 0)
+          continue;
         // count the number of signs of any type
-        double signs_count = AI::count_objects_near_pos(corner_pos, AI::spiral_dist(4), Map::ObjectSignLargeGold, Map::ObjectSignSmallStone, "dk_orange");
+        double signs_count = map->get_signs_in(corner_pos, 4);
         // count the number of empty hills (no blocking objects)
-        double empty_hills_count = AI::count_empty_terrain_near_pos(corner_pos, AI::spiral_dist(4), Map::TerrainTundra0, Map::TerrainSnow0, "orange");
+        double empty_hills_count = AI::count_empty_terrain_near_pos(corner_pos, AI::spiral_dist(4), Map::TerrainTundra0, Map::TerrainSnow0, MarkOrange);
         if (signs_count < 1 || empty_hills_count < 1)
           continue;
         double sign_density = signs_count / empty_hills_count;
@@ -2403,18 +2455,21 @@ AI::do_place_mines(std::string type, Building::Type building_type, Map::Object l
 
 void
 AI::do_place_coal_mines() {
+  PROFILE_SCOPE("ai.do_place_coal_mines");
   AILogDebug["do_place_coal_mines"] << name << " inside do_place_coal_mines()";
   do_place_mines("coal", Building::TypeCoalMine, Map::ObjectSignLargeCoal, Map::ObjectSignSmallCoal, max_coalmines, coal_sign_density_min);
 }
 
 void
 AI::do_place_iron_mines() {
+  PROFILE_SCOPE("ai.do_place_iron_mines");
   AILogDebug["do_place_iron_mines"] << name << " inside do_place_iron_mines()";
   do_place_mines("iron", Building::TypeIronMine, Map::ObjectSignLargeIron, Map::ObjectSignSmallIron, max_ironmines, iron_sign_density_min);
 }
 
 void
 AI::do_place_gold_mines(){
+  PROFILE_SCOPE("ai.do_place_gold_mines");
   AILogDebug["do_place_gold_mines"] << name << " inside do_place_gold_mines()";
   do_place_mines("gold", Building::TypeGoldMine, Map::ObjectSignLargeGold, Map::ObjectSignSmallGold, max_goldmines, gold_sign_density_min);
 }
@@ -2424,6 +2479,7 @@ AI::do_place_gold_mines(){
 // build a sawmill and two lumberjacks in area with most trees
 void
 AI::do_build_sawmill_lumberjacks() {
+  PROFILE_SCOPE("ai.do_build_sawmill_lumberjacks");
   // time this function for debugging
   std::clock_t start;
   double duration;
@@ -2436,7 +2492,7 @@ AI::do_build_sawmill_lumberjacks() {
   if (planks_count < planks_max) {
     AILogDebug["do_build_sawmill_lumberjacks"] << name << " AI: desire more planks";
     // count trees around corners of each military building, starting with castle
-    MapPosSet count_by_corner;
+    MapPosRanking count_by_corner;
     MapPos built_pos = bad_map_pos;
     for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
       update_building_counts();
@@ -2449,7 +2505,7 @@ AI::do_build_sawmill_lumberjacks() {
       MapPosVector corners = AI::get_corners(center_pos);
       // build a list of corners by tree count and sort
       for (MapPos corner_pos : corners) {
-        unsigned int count = AI::count_objects_near_pos(corner_pos, AI::spiral_dist(4), Map::ObjectTree0, Map::ObjectPine7, "lt_green");
+        unsigned int count = AI::count_objects_near_pos(corner_pos, AI::spiral_dist(4), Map::ObjectTree0, Map::ObjectPine7, MarkLtGreen);
         //AILogDebug["do_build_sawmill_lumberjacks"] << name << " corner has count: " << count << ", min acceptable is " << AI::near_trees_min;
         if (count >= near_trees_min) {
           count_by_corner.insert(std::make_pair(corner_pos, count));
@@ -2507,7 +2563,7 @@ AI::do_build_sawmill_lumberjacks() {
     lumberjack_count = stock_buildings.at(stock_pos).count[Building::TypeLumberjack];
     if (sawmill_count < 1 || lumberjack_count < 2) {
       AILogDebug["do_build_sawmill_lumberjacks"] << name << " couldn't place all of 1 sawmill and 2 lumberjacks!  expands towards some trees";
-      expand_towards.insert("trees");
+      expand_towards.set(GoalTrees);
       AI::expand_borders(castle_pos);
     }
   }
@@ -2525,6 +2581,7 @@ AI::do_build_sawmill_lumberjacks() {
 // return false if need to wait, true if ready to continue
 bool
 AI::do_wait_until_sawmill_lumberjacks_built() {
+  PROFILE_SCOPE("ai.do_wait_until_sawmill_lumberjacks_built");
   AILogDebug["do_wait_until_sawmill_lumberjacks_built"] << name << " inside do_wait_until_sawmill_lumberjacks_built";
   unsigned int planks_count = stock_inv->get_count_of(Resource::TypePlank);
   if (planks_count >= planks_min) {
@@ -2537,11 +2594,11 @@ AI::do_wait_until_sawmill_lumberjacks_built() {
   bool sawmill_has_stones = false;
   bool sawmill_has_planks = false;
   AILogDebug["do_wait_until_sawmill_lumberjacks_built"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for wait until sawmill & lumberjack built)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_wait_until_sawmill_lumberjacks_built"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for wait until sawmill & lumberjack built)";
   Game::ListBuildings buildings = game->get_player_buildings(player);
   AILogDebug["do_wait_until_sawmill_lumberjacks_built"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for wait until sawmill & lumberjack built)";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["do_wait_until_sawmill_lumberjacks_built"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for wait until sawmill & lumberjack built)";
   for (Building *building : buildings) {
     if (building->get_type() == Building::TypeSawmill && !building->is_done()) {
@@ -2596,6 +2653,7 @@ AI::do_wait_until_sawmill_lumberjacks_built() {
 //   note that stone *mines* are NEVER built - maybe in future AI improvement
 void
 AI::do_build_stonecutter() {
+  PROFILE_SCOPE("ai.do_build_stonecutter");
   AILogDebug["do_build_stonecutter"] << name << " Main Loop - stones & stonecutters";
   ai_status.assign("MAIN LOOP - stone");
   //ai_mark_pos.clear();
@@ -2604,7 +2662,7 @@ AI::do_build_stonecutter() {
   if (stones_count < stones_min) {
     AILogDebug["do_build_stonecutter"] << name << " AI: desire more stones";
     // count stones near military buildings
-    MapPosSet count_by_corner;
+    MapPosRanking count_by_corner;
     for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
       update_building_counts();
       int stonecutter_count = stock_buildings.at(stock_pos).count[Building::TypeStonecutter];
@@ -2652,7 +2710,7 @@ AI::do_build_stonecutter() {
     int stonecutter_count = stock_buildings.at(stock_pos).count[Building::TypeStonecutter];
     if (stonecutter_count < 1) {
       AILogDebug["do_build_stonecutter"] << name << " couldn't place stonecutter,  expand towards some stones";
-      expand_towards.insert("stones");
+      expand_towards.set(GoalStones);
       AI::expand_borders(castle_pos);
     }
   }
@@ -2666,8 +2724,19 @@ AI::do_build_stonecutter() {
 // expand borders to create defensive buffer
 void
 AI::do_create_defensive_buffer() {
+  PROFILE_SCOPE("ai.do_create_defensive_buffer");
   AILogDebug["do_create_defensive_buffer"] << name << " inside do_create_defensive_buffer";
-  expand_towards.insert("create_buffer");
+  if (castle_pos == bad_map_pos) {
+    return;
+  }
+  threat_map.update(game->get_snapshot(), *map);
+  int enemy_strength = threat_map.get_enemy_strength(*map, player_index, castle_pos, defensive_buffer_threat_cells);
+  if (enemy_strength == 0) {
+    AILogDebug["do_create_defensive_buffer"] << name << " no enemy knights within " << defensive_buffer_threat_cells << " threat map cells of the castle, not creating a defensive buffer";
+    return;
+  }
+  AILogDebug["do_create_defensive_buffer"] << name << " enemy knights near the castle: " << enemy_strength;
+  expand_towards.set(GoalCreateBuffer);
   unsigned int idle_knights = serfs_idle[Serf::TypeKnight0] + serfs_idle[Serf::TypeKnight1] + serfs_idle[Serf::TypeKnight2] + serfs_idle[Serf::TypeKnight3] + serfs_idle[Serf::TypeKnight4];
   if (idle_knights >= knights_min) {
     AI::expand_borders(castle_pos);
@@ -2682,6 +2751,7 @@ AI::do_create_defensive_buffer() {
 // build a toolmaker, and a steel smelter if enough coal and iron ore
 void
 AI::do_build_toolmaker_steelsmelter() {
+  PROFILE_SCOPE("ai.do_build_toolmaker_steelsmelter");
   AILogDebug["do_build_toolmaker_steelsmelter"] << name << " inside do_build_toolmaker_steelsmelter";
   ai_status.assign("MAIN LOOP - tools");
   update_building_counts();
@@ -2751,6 +2821,7 @@ AI::do_build_toolmaker_steelsmelter() {
 //
 void
 AI::do_build_food_buildings_and_3rd_lumberjack() {
+  PROFILE_SCOPE("ai.do_build_food_buildings_and_3rd_lumberjack");
   AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " Main Loop - food (and 3rd lumberjack)";
   ai_status.assign("MAIN LOOP - food");
   update_building_counts();
@@ -2765,11 +2836,11 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
     //
     // build fisherman if water found with no nearby fisherman
     //
-    MapPosSet count_by_corner;
+    MapPosRanking count_by_corner;
     for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
       MapPosVector corners = AI::get_corners(center_pos);
       for (MapPos corner_pos : corners) {
-        unsigned int count = AI::count_terrain_near_pos(corner_pos, AI::spiral_dist(4), Map::TerrainWater0, Map::TerrainWater3, "dk_blue");
+        unsigned int count = AI::count_terrain_near_pos(corner_pos, AI::spiral_dist(4), Map::TerrainWater0, Map::TerrainWater3, MarkDkBlue);
         if (count >= waters_min) {
           if (!AI::building_exists_near_pos(corner_pos, AI::spiral_dist(8), Building::TypeFisher)) {
             AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " water found and no fisherman nearby, trying to build fisherman";
@@ -2832,11 +2903,11 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
         MapPos farm_pos = bad_map_pos;
         MapPos baker_pos = bad_map_pos;
         AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for food buildings)";
-        game->get_mutex()->lock();
+        game->get_mutex()->lock_shared(LOCK_SITE());
         AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for food buildings)";
         Game::ListBuildings buildings = game->get_player_buildings(player);
         AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for food buildings)";
-        game->get_mutex()->unlock();
+        game->get_mutex()->unlock_shared();
         AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for food buildings)";
         for (Building *building : buildings) {
           // do NOT simply insert them as they are found or they won't be in priority order
@@ -2885,14 +2956,14 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
       farm_centers.push_back(castle_pos);
       // append the farm_centers to the farm_search list, which began with any existing farms
       farm_search.insert(farm_search.end(), farm_centers.begin(), farm_centers.end());
-      MapPosSet count_by_corner;
+      MapPosRanking count_by_corner;
       for (MapPos center_pos : farm_search) {
         if (need_farm == false) {
           break;
         }
         MapPosVector corners = AI::get_corners(center_pos);
         for (MapPos corner_pos : corners) {
-          int count = count_farmable_land(corner_pos, spiral_dist(4), "dk_yellow");
+          int count = count_farmable_land(corner_pos, spiral_dist(4), MarkDkYellow);
           AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " corner_pos " << corner_pos << " has open_space/fields count: " << count << ", min_openspace_farm is " << min_openspace_farm;
           if (count >= min_openspace_farm) {
             AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " corner_pos " << corner_pos << " has enough open grass tiles to build a farm, adding to list";
@@ -2924,7 +2995,7 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
     farm_count = stock_buildings.at(stock_pos).count[Building::TypeFarm];
     if (farm_count < 1) {
       AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " couldn't place first wheat farm,  expand towards some fields or water";
-      expand_towards.insert("foods");
+      expand_towards.set(GoalFoods);
       AI::expand_borders(castle_pos);
     }
   } // if food < max
@@ -2948,7 +3019,7 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
     //AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " debug, current lumberjack count: " << building_count[Building::TypeLumberjack];
     // count trees near military buildings,
     //   the third lumberjack doesn't need to be near sawmill, if there is a spot with many trees that is fine
-    MapPosSet count_by_corner;
+    MapPosRanking count_by_corner;
     for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
       update_building_counts();
       lumberjack_count = stock_buildings.at(stock_pos).count[Building::TypeLumberjack];
@@ -2959,7 +3030,7 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
       MapPosVector corners = AI::get_corners(center_pos);
       for (MapPos corner_pos : corners) {
         unsigned int count = AI::count_objects_near_pos(corner_pos,
-          AI::spiral_dist(4), Map::ObjectTree0, Map::ObjectPine7, "lt_green");
+          AI::spiral_dist(4), Map::ObjectTree0, Map::ObjectPine7, MarkLtGreen);
         if (count >= near_trees_min) {
           count_by_corner.insert(std::make_pair(corner_pos, count));
         }
@@ -2993,11 +3064,11 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
     farm_count = stock_buildings.at(stock_pos).count[Building::TypeFarm];
     if (farm_count >= 1) {
       AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for mill and baker)";
-      game->get_mutex()->lock();
+      game->get_mutex()->lock_shared(LOCK_SITE());
       AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for mill and baker)";
       Game::ListBuildings buildings = game->get_player_buildings(player);
       AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for mill and baker)";
-      game->get_mutex()->unlock();
+      game->get_mutex()->unlock_shared();
       AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for mill and baker)";
       for (Building *building : buildings) {
         if (building->get_type() != Building::TypeFarm)
@@ -3014,8 +3085,8 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
         /// disabling this because the delay in building miller and baker results it bad road connections
         ///   even though the delay would be optimal for building priorities, having a very good road connection is even more important!
         unsigned int count = 0;
-        count += AI::count_objects_near_pos(farm_pos, AI::spiral_dist(4), Map::ObjectSeeds0, Map::ObjectFieldExpired, "yellow");
-        count += AI::count_objects_near_pos(farm_pos, AI::spiral_dist(4), Map::ObjectField0, Map::ObjectField5, "dk_yellow");
+        count += AI::count_objects_near_pos(farm_pos, AI::spiral_dist(4), Map::ObjectSeeds0, Map::ObjectFieldExpired, MarkYellow);
+        count += AI::count_objects_near_pos(farm_pos, AI::spiral_dist(4), Map::ObjectField0, Map::ObjectField5, MarkDkYellow);
         AILogDebug["do_build_food_buildings_and_3rd_lumberjack"] << name << " farm at pos " << farm_pos << " fields nearby count: " << count << ", min acceptable is " << near_fields_min;
         if (count < near_fields_min)
           continue;
@@ -3057,6 +3128,7 @@ AI::do_build_food_buildings_and_3rd_lumberjack() {
 // coal mines are PLACED early in the AI loop to secure good placement, but not CONNECTED/BUILT until here
 void
 AI::do_connect_coal_mines() {
+  PROFILE_SCOPE("ai.do_connect_coal_mines");
   ai_status.assign("MAIN LOOP - coal");
   AILogDebug["do_connect_coal_mines"] << name << " inside do_connect_coal_mines()";
   unsigned int coal_count = stock_inv->get_count_of(Resource::TypeCoal);
@@ -3068,8 +3140,8 @@ AI::do_connect_coal_mines() {
     int coalmine_count = stock_buildings.at(stock_pos).count[Building::TypeCoalMine];
     if (coalmine_count < max_coalmines) {
       AILogDebug["do_connect_coal_mines"] << name << " coalmine_count < max_coalmines, expand towards hills & coal flags";
-      expand_towards.insert("hills");
-      expand_towards.insert("coal");
+      expand_towards.set(GoalHills);
+      expand_towards.set(GoalCoal);
       AI::expand_borders(castle_pos);
     }
     //  if low on miners/pickaxes, don't build a second/third coal mine unless already having
@@ -3102,11 +3174,11 @@ AI::do_connect_coal_mines() {
         // YES it should
         AILogDebug["do_connect_coal_mines"] << name << " demolishing coal mine that could not be connected to road network";
         AILogDebug["do_connect_coal_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling demolish flag&building (failed to connect coal mine)";
-        game->get_mutex()->lock();
+        game->get_mutex()->lock(LOCK_SITE());
         AILogDebug["do_connect_coal_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling demolish flag&building (failed to connect coal mine)";
-        game->demolish_building(flag->get_building()->get_position(), player);
+        game->get_commands()->demolish_building(flag->get_building()->get_position(), player_index);
         AILogDebug["do_connect_coal_mines"] << name << " demolishing flag for coal mine that could not be connected to road network";
-        game->demolish_flag(flag->get_position(), player);
+        game->get_commands()->demolish_flag(flag->get_position(), player_index);
         AILogDebug["do_connect_coal_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling demolish flag&building (failed to connect coal mine)";
         game->get_mutex()->unlock();
         AILogDebug["do_connect_coal_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling demolish flag&building (failed to connect coal mine)";
@@ -3127,6 +3199,7 @@ AI::do_connect_coal_mines() {
 // iron mines are PLACED early in the AI loop to secure good placement, but not CONNECTED/BUILT until here
 void
 AI::do_connect_iron_mines() {
+  PROFILE_SCOPE("ai.do_connect_iron_mines");
   ai_status.assign("MAIN LOOP - iron");
   AILogDebug["do_connect_iron_mines"] << name << " inside do_connect_iron_mines()";
   unsigned int iron_count = stock_inv->get_count_of(Resource::TypeIronOre);
@@ -3138,8 +3211,8 @@ AI::do_connect_iron_mines() {
     int ironmine_count = stock_buildings.at(stock_pos).count[Building::TypeIronMine];
     if (ironmine_count < max_ironmines) {
       AILogDebug["do_connect_iron_mines"] << name << " ironmine_count < max_ironmines, expand towards hills & iron flags";
-      expand_towards.insert("hills");
-      expand_towards.insert("iron_ore");
+      expand_towards.set(GoalHills);
+      expand_towards.set(GoalIronOre);
       AI::expand_borders(castle_pos);
     }
     //  if low on miners/pickaxes, don't build a second iron mine unless already having
@@ -3172,11 +3245,11 @@ AI::do_connect_iron_mines() {
         // YES it should
         AILogDebug["do_connect_iron_mines"] << name << " demolishing iron mine that could not be connected to road network";
         AILogDebug["do_connect_iron_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling demolish flag&building (failed to connect iron mine)";
-        game->get_mutex()->lock();
+        game->get_mutex()->lock(LOCK_SITE());
         AILogDebug["do_connect_iron_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling demolish flag&building (failed to connect iron mine)";
-        game->demolish_building(flag->get_building()->get_position(), player);
+        game->get_commands()->demolish_building(flag->get_building()->get_position(), player_index);
         AILogDebug["do_connect_iron_mines"] << name << " demolishing flag for iron mine that could not be connected to road network";
-        game->demolish_flag(flag->get_position(), player);
+        game->get_commands()->demolish_flag(flag->get_position(), player_index);
         AILogDebug["do_connect_iron_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling demolish flag&building (failed to connect iron mine)";
         game->get_mutex()->unlock();
         AILogDebug["do_connect_iron_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling demolish flag&building (failed to connect iron mine)";
@@ -3197,6 +3270,7 @@ AI::do_connect_iron_mines() {
 // build a steel smelter if one wasn't already created earlier to support toolmaker
 void
 AI::do_build_steelsmelter() {
+  PROFILE_SCOPE("ai.do_build_steelsmelter");
   ai_status.assign("MAIN LOOP - steel");
   // saw an infinite loop here dec11 2020, AI never ended doing update_buildings calls??
   // saw again dec13, not actually infinite loop but took very long to run... minutes
@@ -3249,6 +3323,7 @@ AI::do_build_steelsmelter() {
 // build a blacksmith (weaponsmith)
 void
 AI::do_build_blacksmith() {
+  PROFILE_SCOPE("ai.do_build_blacksmith");
   ai_status.assign("MAIN LOOP - weapons");
   AILogDebug["do_build_blacksmith"] << name << " inside do_build_blacksmith()";
   MapPos built_pos = bad_map_pos;
@@ -3300,6 +3375,7 @@ AI::do_build_blacksmith() {
 // connect any disconnected gold mines if conditions are met
 void
 AI::do_build_gold_smelter_and_connect_gold_mines() {
+  PROFILE_SCOPE("ai.do_build_gold_smelter_and_connect_gold_mines");
   ai_status.assign("MAIN LOOP - gold");
   AILogDebug["do_build_gold_smelter_and_connect_gold_mines"] << name << " inside do_build_gold_smelter_and_connect_gold_mines()";
   unsigned int gold_bars_count = stock_inv->get_count_of(Resource::TypeGoldBar);
@@ -3336,8 +3412,8 @@ AI::do_build_gold_smelter_and_connect_gold_mines() {
     int goldmine_count = stock_buildings.at(stock_pos).count[Building::TypeGoldMine];
     if (goldmine_count < 1) {
       AILogDebug["do_build_gold_smelter_and_connect_gold_mines"] << name << " has no gold mine, expand towards hills & gold flags";
-      expand_towards.insert("hills");
-      expand_towards.insert("gold_ore");
+      expand_towards.set(GoalHills);
+      expand_towards.set(GoalGoldOre);
       AI::expand_borders(castle_pos);
     }
     //  if low on miners/pickaxes, don't build a gold mine unless already having
@@ -3368,11 +3444,11 @@ AI::do_build_gold_smelter_and_connect_gold_mines() {
         // YES it should
         AILogDebug["do_build_gold_smelter_and_connect_gold_mines"] << name << " demolishing gold mine that could not be connected to road network";
         AILogDebug["do_build_gold_smelter_and_connect_gold_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling demolish flag&building (failed to connect gold mine)";
-        game->get_mutex()->lock();
+        game->get_mutex()->lock(LOCK_SITE());
         AILogDebug["do_build_gold_smelter_and_connect_gold_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling demolish flag&building (failed to connect gold mine)";
-        game->demolish_building(flag->get_building()->get_position(), player);
+        game->get_commands()->demolish_building(flag->get_building()->get_position(), player_index);
         AILogDebug["do_build_gold_smelter_and_connect_gold_mines"] << name << " demolishing flag for gold mine that could not be connected to road network";
-        game->demolish_flag(flag->get_position(), player);
+        game->get_commands()->demolish_flag(flag->get_position(), player_index);
         AILogDebug["do_build_gold_smelter_and_connect_gold_mines"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling demolish flag&building (failed to connect gold mine)";
         game->get_mutex()->unlock();
         AILogDebug["do_build_gold_smelter_and_connect_gold_mines"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling demolish flag&building (failed to connect gold mine)";
@@ -3396,6 +3472,7 @@ AI::do_build_gold_smelter_and_connect_gold_mines() {
 //   this function needs a lot more development
 void
 AI::do_attack() {
+  PROFILE_SCOPE("ai.do_attack");
   MapPosSet scored_targets = {};
   AILogDebug["do_attack"] << name << " calling score_enemy_targets...";
   score_enemy_targets(&scored_targets);
@@ -3406,13 +3483,8 @@ AI::do_attack() {
   int morale_max = 99999;
 
   //AILogDebug["do_attack"] << name << " getting serfs again";
-  AILogDebug["do_attack"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling player->get_stats_serfs_idle()";
-  game->get_mutex()->lock();
-  AILogDebug["do_attack"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling player->get_stats_serfs_idle()";
+  // the idle counts are read without the mutex
   serfs_idle = player->get_stats_serfs_idle();
-  AILogDebug["do_attack"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling player->get_stats_serfs_idle()";
-  game->get_mutex()->unlock();
-  AILogDebug["do_attack"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling player->get_stats_serfs_idle()";
   //Serf::SerfMap serfs_potential = player->get_stats_serfs_potential();
   unsigned int idle_knights = serfs_idle[Serf::TypeKnight0] + serfs_idle[Serf::TypeKnight1] + serfs_idle[Serf::TypeKnight2] + serfs_idle[Serf::TypeKnight3] + serfs_idle[Serf::TypeKnight4];
   AILogDebug["do_attack"] << name << " idle_knights: " << idle_knights << ", morale_count: " << morale;
@@ -3452,6 +3524,7 @@ AI::do_attack() {
 //    and if so, build that road in.  Do not remove any existing roads
 void
 AI::do_build_better_roads_for_important_buildings() {
+  PROFILE_SCOPE("ai.do_build_better_roads_for_important_buildings");
   // time this function for debugging
   std::clock_t start;
   double duration;
@@ -3464,25 +3537,48 @@ AI::do_build_better_roads_for_important_buildings() {
   }
   ai_status.assign("HOUSEKEEPING - build better roads");
   AILogDebug["do_build_better_roads_for_important_buildings"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for finding positions of military buildings)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["do_build_better_roads_for_important_buildings"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for finding positions of military buildings)";
   Game::ListBuildings buildings = game->get_player_buildings(player);
-  AILogDebug["do_build_better_roads_for_important_buildings"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for finding positions of military buildings)";
-  game->get_mutex()->unlock();
-  AILogDebug["do_build_better_roads_for_important_buildings"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for finding positions of military buildings)";
+  // the flags count how long resources wait there for a transporter, a building
+  //  whose flag has a congested road gets a better road whatever its type,
+  //  and the worst congested go first
+  std::vector<std::pair<unsigned int, Building*>> candidates;
   for (Building *building : buildings) {
     if (building == nullptr)
       continue;
     Building::Type type = building->get_type();
     if (!building->is_done() || building->is_burning())
       continue;
-    // only consider these building types for road improvement
-    if (type != Building::TypeWeaponSmith && type != Building::TypeSteelSmelter
+    unsigned int wait = 0;
+    bool congested = false;
+    Flag *flag = game->get_flag(building->get_flag_index());
+    if (flag != nullptr) {
+      for (Direction dir : cycle_directions_cw()) {
+        if (flag->has_path(dir)) {
+          wait = std::max(wait, flag->get_traffic_wait(dir));
+          congested |= flag->is_congested(dir);
+        }
+      }
+    }
+    // only consider these building types for road improvement, unless congested
+    if (!congested && type != Building::TypeWeaponSmith && type != Building::TypeSteelSmelter
       && type != Building::TypeGoldSmelter && type != Building::TypeCoalMine
       && type != Building::TypeIronMine && type != Building::TypeGoldMine) {
       continue;
     }
-    AILogDebug["do_build_better_roads_for_important_buildings"] << name << " do_build_better_roads_for_important_buildings found high-priority building of type " << NameBuilding[type] << name << " at pos " << building->get_position();
+    candidates.push_back(std::make_pair(wait, building));
+  }
+  AILogDebug["do_build_better_roads_for_important_buildings"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for finding positions of military buildings)";
+  game->get_mutex()->unlock_shared();
+  AILogDebug["do_build_better_roads_for_important_buildings"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for finding positions of military buildings)";
+  std::stable_sort(candidates.begin(), candidates.end(),
+    [](const std::pair<unsigned int, Building*> &a, const std::pair<unsigned int, Building*> &b) {
+      return a.first > b.first; });
+  for (const std::pair<unsigned int, Building*> &candidate : candidates) {
+    Building *building = candidate.second;
+    Building::Type type = building->get_type();
+    AILogDebug["do_build_better_roads_for_important_buildings"] << name << " do_build_better_roads_for_important_buildings found high-priority building of type " << NameBuilding[type] << name << " at pos " << building->get_position() << ", its resources wait " << candidate.first << " ticks for transport";
     road_options.set(RoadOption::Improve);
     MapPos building_flag_pos = map->move_down_right(building->get_position());
     build_best_road(building_flag_pos, road_options, type);
@@ -3497,6 +3593,7 @@ AI::do_build_better_roads_for_important_buildings() {
 // once all necessary buildings built for castle, build a warehouse and parallel infrastructure
 void
 AI::do_build_warehouse() {
+  PROFILE_SCOPE("ai.do_build_warehouse");
   AILogDebug["do_build_warehouse"] << name << " inside do_build_warehouse";
   update_building_counts();
   int warehouse_count = building_count[Building::TypeStock];
@@ -3512,7 +3609,7 @@ AI::do_build_warehouse() {
     return;
   }
   MapPosVector corners = AI::get_corners(castle_pos, 21);
-  MapPosSet count_by_corner;
+  MapPosRanking count_by_corner;
   MapPosVector warehouse_positions;
   scoring_warehouse = true;
   for (MapPos corner_pos : corners) {
@@ -3522,8 +3619,8 @@ AI::do_build_warehouse() {
     ///   the expansion goals are defined.  The better approach is to have a "stuff that happens at the end of the AI loop" code section
     ///   but right now when we shortcut the end of the loop it is doing "return" instead of goto or similar
     last_expand_towards = expand_towards;
-    expand_towards.clear();
-    expand_towards.insert("create_buffer");
+    expand_towards.reset();
+    expand_towards.set(GoalCreateBuffer);
     unsigned int score = AI::score_area(corner_pos, AI::spiral_dist(6));
     AILogDebug["do_build_warehouse"] << name << " corner " << corner_pos << " has score " << score;
     count_by_corner.insert(std::make_pair(corner_pos, score));
@@ -3557,13 +3654,13 @@ AI::do_build_warehouse() {
     AILogDebug["do_build_warehouse"] << name << " considering building warehouse around existing warehouse/stock at pos " << stock_pos;
     // this is a cut/paste, make it a proper function
     MapPosVector corners = AI::get_corners(this_stock_pos, 21);
-    MapPosSet count_by_corner;
+    MapPosRanking count_by_corner;
     MapPosVector warehouse_positions;
     for (MapPos corner_pos : corners) {
       AILogDebug["do_build_warehouse"] << name << " considering building warehouse near corner_pos " << corner_pos;
       // using expand_towards logic because it scores based on number of civ buildings, which is good for placing warehouse
-      expand_towards.clear();
-      expand_towards.insert("create_buffer");
+      expand_towards.reset();
+      expand_towards.set(GoalCreateBuffer);
       unsigned int score = AI::score_area(corner_pos, AI::spiral_dist(6));
       AILogDebug["do_build_warehouse"] << name << " corner " << corner_pos << " has score " << score;
       count_by_corner.insert(std::make_pair(corner_pos, score));
@@ -3595,6 +3692,7 @@ AI::do_build_warehouse() {
 
 void
 AI::do_get_inventory(MapPos stock_pos) {
+  PROFILE_SCOPE("ai.do_get_inventory");
   // a stock's Inventory object contains a ResourceMap object for that inventory
   //unsigned int get_count_of(Resource::Type resource) {
   //    return resources[resource];
@@ -18,24 +18,47 @@
 #include <fstream>       // for writing individual console log for each AI player
 #include <ctime>         // for timing function call runs
 #include <cstring>       // for memset
+#include <memory>        // for the published overlay
+#include <future>        //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for GameCommands results
+#include <mutex>         //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for road_plot_cache
 
 #include "src/audio.h"   // for audio notifications
 #include "src/flag.h"    // for flag->call_transporter for
 #include "src/game.h"
+#include "src/game-snapshot.h"  // lock-free reads of flags, buildings and serfs
 #include "src/gfx.h"     // for AI overlay, needed to get Color class, maybe find a simpler way?
 #include "src/log.h"     // for separate AI logger
+#include "src/memory-usage.h"  // what the AI keeps, published each loop
+#include "src/pathfinder.h"  // for the SearchArenas of plot_roads
 #include "src/savegame.h"   // for auto-saving
 #include "src/serf.h"    // for serf->is_waiting check for stuck serfs
 
+#include "src/ai_arena.h"  // memory for temporary containers, given back each loop
+#include "src/ai_castle_sites.h"  // where castles could go, scored once per map
+#include "src/ai_economy.h"  // where the stocks are heading
+#include "src/ai_flag_dists.h"  // road distances from the stocks
+#include "src/ai_governor.h"  // CPU budget per game tick
+#include "src/ai_map_analysis.h"  // what is where on the map, shared by all AIs
+#include "src/ai_pool.h"  // worker threads that run the AI players
+#include "src/ai_ranking.h"  // scored positions, tried best first
+#include "src/ai_stats.h"  // step timings of the last loops
+#include "src/ai_threat_map.h"  // military strength of every player by area
 #include "src/ai_roadbuilder.h"  // additional pathfinder functions for AI
+#include "src/road-clusters.h"  // corridors for long plot_road searches
 #include "src/lookup.h"  // for console log, has text names for enums and such
 
 
 class AI {
     //
  public:
-  typedef std::map<std::pair<unsigned int, Direction>, unsigned int> FlagDirTimer;
   typedef std::map<unsigned int, unsigned int> SerfWaitTimer;
+  // the marks to draw on the AI overlay, as of the last publish_overlay.  Never
+  //  changes once published, so the viewport can read it while the AI runs
+  typedef struct Overlay {
+    std::vector<MapPos> mark_pos;       // sorted
+    std::vector<uint8_t> mark_color;    // palette index for each mark_pos, see get_overlay_color
+    std::vector<int> mark_serf;         // sorted
+  } Overlay;
   const MapPos notplaced_pos = std::numeric_limits<unsigned int>::max() - 1;
   std::string name;          // 'Player1', 'Player2', etc.  used to tag log lines
 
@@ -56,21 +79,23 @@ class AI {
   unsigned int unfinished_hut_count;
   ColorDotMap ai_mark_pos;      // used to mark spots on map with various colored dots.  For debugging, when AI overlay is on
   std::vector<int> ai_mark_serf;    // used to mark serfs on map with status text.  For debugging, when AI overlay is on
+  // ai_mark_pos and ai_mark_serf as last published for the viewport, and the
+  //  previous copy to fill next time once the viewport has let go of it
+  std::shared_ptr<const Overlay> overlay;
+  std::shared_ptr<Overlay> spare_overlay;
   Road *ai_mark_road = (new Road);  // used to trace roads on map as pathfinding runs.  For debugging, when AI overlay is on
-  std::set<std::string> expand_towards;
-  std::set<std::string> last_expand_towards;  // quick hack to save a copy for attack scoring
+  ExpandGoals expand_towards;
+  ExpandGoals last_expand_towards;  // quick hack to save a copy for attack scoring
   MapPos stopbuilding_pos;
   MapPos castle_pos;
   MapPos castle_flag_pos;
-  FlagDirTimer no_transporter_timers;
   SerfWaitTimer serf_wait_timers;
-  SerfWaitTimer serf_wait_idle_on_road_timers;
   MapPosVector realm_occupied_military_pos;
   Building *castle;
   Inventory *stock_inv;
   RoadOptions road_options;
-  Serf::SerfMap serfs_idle;
-  Serf::SerfMap serfs_potential;
+  Serf::SerfCounts serfs_idle;
+  Serf::SerfCounts serfs_potential;
   int *serfs_total;
   bool need_tools;
   int building_count[25] = {0};
@@ -81,10 +106,73 @@ class AI {
   int change_buffer;
   int previous_knight_occupation_level;
   bool has_autosave_mutex = false;
+  // how far the current loop got.  A step runs the loop until its time slice
+  //  is used and the next step goes on from there, see continue_loop
+  typedef enum LoopPhase {
+    LoopStart = 0,      // rest before a new loop
+    LoopPrepare,        // counts, inventory and serfs for the whole realm
+    LoopHousekeeping,   // housekeeping_tasks, one at a time
+    LoopStocks,         // the economy loop, one stock at a time
+    LoopWarehouse,
+  } LoopPhase;
+  LoopPhase loop_phase;
+  size_t loop_task;       // next of housekeeping_tasks
+  size_t loop_stock;      // next of stocks_pos
+  unsigned int loop_start_tick;
+  unsigned int resume_tick;   // game tick the current rest ends at
+  AIGovernor governor;
+  AIStats stats;
   // list of bad building positions (where buildings had to be demolished for certain reasons)
   // AI STATEFULNESS WARNING - this bad_building_pos list is lost on save/load or if AI thread terminated
   MapPosSet bad_building_pos;
   std::vector<MapPos> stocks_pos; // positions of stocks - CASTLE and warehouses
+  // plot_road results by start and end pos, with the map change counts along them when plotted
+  typedef struct RoadPlot {
+    Road road;
+    Roads split_roads;
+    std::vector<std::pair<MapPos, uint32_t>> stamps;
+    unsigned int loop;
+  } RoadPlot;
+  static const unsigned int road_plot_cache_loops = 5;
+  static const size_t road_plot_cache_max = 4096;
+  std::map<std::pair<MapPos, MapPos>, RoadPlot> road_plot_cache;
+  std::mutex road_plot_cache_mutex;   // plot_roads runs plot_road on several threads
+  // portals between clusters of map tiles, for keeping the tile search of a long
+  //  plot_road to the clusters the road goes through
+  RoadClusters road_clusters;
+  std::mutex road_clusters_mutex;
+  // a SearchArena for each thread plot_roads runs plot_road on, kept from call to call
+  //  so they are only sized again when the map size changes
+  std::vector<std::unique_ptr<SearchArena>> road_arenas;
+  // score_area and count_geologist_sign_density results by what was scored and where, with
+  //  Map::get_changes_in for the area when scored.  A result is good while that count is the same
+  typedef struct AreaScore {
+    uint32_t changes;
+    double value;
+  } AreaScore;
+  static const size_t area_score_cache_max = 4096;
+  std::map<std::string, AreaScore> area_score_cache;
+  // the food, trees, stone, hills and signs of the map by tile, which score_area
+  //  adds up, with the land, water and hills clusters.  One for all the AIs
+  std::shared_ptr<MapAnalysis> map_analysis;
+  // buildings and stocks as of the last update_building_counts, to tell if anything changed since
+  std::vector<GameSnapshot::BuildingView> counted_buildings;
+  std::vector<MapPos> counted_stocks_pos;
+  // road distances from each of stocks_pos, built at most once a loop and
+  //  again when the roads change, see get_flag_dists
+  FlagDists flag_dists;
+  unsigned int flag_dists_loop;
+  unsigned int flag_dists_changes;
+  ThreatMap threat_map;   // as of the last snapshot it was updated from
+  EconomyForecast economy;   // as of the snapshot at the start of the loop
+  RoadBuilderPool road_builders;   // reused by each build_best_road attempt
+  AIArena loop_arena;   // temporary containers of this loop, reset when it ends
+  GameEvents::Reader game_events;   // where this AI is in the game's events
+  // what the structures above hold, as of the end of the last loop, published
+  //  like the overlay for the perf overlay and headless to read
+  std::shared_ptr<const MemoryUsage> memory_usage;
+  // where do_save_game writes, the save game folder when empty
+  static std::string debug_save_folder;
   Log::Logger AILogVerbose{ Log::LevelVerbose, "Verbose" };
   Log::Logger AILogDebug{ Log::LevelDebug, "Debug" };
   Log::Logger AILogInfo{ Log::LevelInfo, "Info" };
@@ -99,16 +187,31 @@ class AI {
  public:
   AI(PGame, unsigned int, AIPlusOptions);
   void start();
-  void next_loop();
-  ColorDotMap * get_ai_mark_pos() { return &ai_mark_pos; }
+  bool step(unsigned int *wait_ms);
+  void continue_loop();
   std::vector<int> * get_ai_mark_serf() { return &ai_mark_serf; }
+  std::shared_ptr<const Overlay> get_overlay() { return std::atomic_load(&overlay); }
+  static const Color &get_overlay_color(uint8_t index);
   Road * get_ai_mark_road() { return ai_mark_road; }
-  Color get_mark_color(std::string color) { return colors.at(color); }
+  const Color &get_mark_color(MarkColor color) { return mark_colors[color]; }
   std::string get_ai_status() { return ai_status; }
   // stupid way to pass game speed and AI loop count to viewport for AI overlay
   unsigned int get_game_speed() { return game->get_game_speed(); }
   unsigned int get_loop_count() { return loop_count; }
-  std::set<std::string> get_ai_expansion_goals() { return expand_towards; }
+  unsigned int get_player_index() const { return player_index; }
+  ExpandGoals get_ai_expansion_goals() { return expand_towards; }
+  std::shared_ptr<const AIStats::Loops> get_loop_stats() const { return stats.get_loops(); }
+  // nullptr until the first loop is done
+  std::shared_ptr<const MemoryUsage> get_memory_usage() const { return std::atomic_load(&memory_usage); }
+  // write the debug saves of do_save_game to this folder instead of the save game folder
+  static void set_debug_save_folder(const std::string &path) { debug_save_folder = path; }
+  // plot a road for this AI's player the way its build steps do, as if the map had
+  //  changed along every road plotted before.  Used by bench_map
+  Road plot_road_uncached(MapPos start_pos, MapPos end_pos, Roads *potential_roads);
+  // the same, through the road plot cache.  Used by the tests
+  Road plot_road_cached(MapPos start_pos, MapPos end_pos, Roads *potential_roads) {
+    return plot_road(map, player_index, start_pos, end_pos, potential_roads); }
+  uint64_t get_stats_count(AIStats::Counter counter) const { return stats.get_count(counter); }
 
  protected:
   //
@@ -117,27 +220,35 @@ class AI {
   // ai_util.cc
   //
   static bool has_terrain_type(PGame, MapPos, Map::Terrain, Map::Terrain);  // why does this need to be static?
-  bool place_castle(PGame, MapPos, unsigned int);
+  static bool has_terrain_type(const Map &, MapPos, Map::Terrain, Map::Terrain);
   static unsigned int spiral_dist(int);   // why does this need to be static?
+  static int spiral_radius(unsigned int distance);
+  bool get_cached_area_score(const std::string &key, uint32_t changes, double *value);
+  void cache_area_score(const std::string &key, uint32_t changes, double value);
+  // wait for a change queued on game->get_commands() to be applied at the start of the
+  //  next game update.  The game lock must not be held.  False if it failed or the AI is stopping
+  bool wait_for_command(std::future<bool> result);
   void rebuild_all_roads();
   bool build_best_road(MapPos, RoadOptions, Building::Type optional_affinity = Building::TypeNone, MapPos optional_target = bad_map_pos);
   MapPosVector get_affinity(MapPos);
   Building* find_nearest_building(MapPos, unsigned int, Building::Type);
   Building* find_nearest_completed_building(MapPos, unsigned int, Building::Type);
+  Building* get_live_building(const GameSnapshot::BuildingView *view);
   Road trace_existing_road(PMap, MapPos, Direction);
   MapPosVector get_corners(MapPos);
   MapPosVector get_corners(MapPos, unsigned int distance);
-  unsigned int count_terrain_near_pos(MapPos, unsigned int, Map::Terrain, Map::Terrain, std::string);
-  unsigned int count_empty_terrain_near_pos(MapPos, unsigned int, Map::Terrain, Map::Terrain, std::string);
-  unsigned int count_farmable_land(MapPos, unsigned int, std::string);
-  unsigned int count_objects_near_pos(MapPos, unsigned int, Map::Object, Map::Object, std::string);
+  unsigned int count_terrain_near_pos(MapPos, unsigned int, Map::Terrain, Map::Terrain, MarkColor);
+  unsigned int count_empty_terrain_near_pos(MapPos, unsigned int, Map::Terrain, Map::Terrain, MarkColor);
+  unsigned int count_farmable_land(MapPos, unsigned int, MarkColor);
+  unsigned int count_objects_near_pos(MapPos, unsigned int, Map::Object, Map::Object, MarkColor);
   double count_geologist_sign_density(MapPos, unsigned int);
-  MapPosVector sort_by_val_asc(MapPosSet);
-  MapPosVector sort_by_val_desc(MapPosSet);
+  MapPosVector sort_by_val_asc(const MapPosRanking &);
+  MapPosVector sort_by_val_desc(const MapPosRanking &);
   MapPos build_near_pos(MapPos, unsigned int, Building::Type);
   bool building_exists_near_pos(MapPos, unsigned int, Building::Type);
   MapPos find_halfway_pos_between_buildings(Building::Type, Building::Type);
   unsigned int count_stones_near_pos(MapPos, unsigned int);
+  unsigned int forecast_count(Resource::Type);   // stored now or forecast by the economy model, whichever is lower
   unsigned int count_knights_affected_by_occupation_level_change(unsigned int, unsigned int);
   MapPos expand_borders(MapPos);
   unsigned int score_area(MapPos, unsigned int);
@@ -165,13 +276,36 @@ class AI {
   };
   std::map<MapPos, StockBuildings> stock_buildings;
 
+  // a housekeeping step run from continue_loop.  Steps run in list order, which
+  //  is their priority, but each only once every 'every' loops.  A step whose
+  //  run takes longer than its budget (in seconds of CPU time) is put off for
+  //  twice as long each time, up to 8x its cadence, until it runs within budget
+  typedef struct Task {
+    const char *name;
+    void (AI::*run)();
+    unsigned int every;
+    double budget;
+    unsigned int next_loop;
+    unsigned int backoff;
+  } Task;
+  std::vector<Task> housekeeping_tasks;
+
   //
   // ai.cc
   //
+  void init_tasks();
+  void publish_overlay();
+  void publish_memory_usage();
+  void run_task(Task *task);
+  bool run_stock_loop();
+  void rest(unsigned int ticks);
+  // let the governor pause a long search, unless that would hold up the game
+  void checkpoint() { if (!GameLock::held_by_this_thread()) governor.checkpoint(); }
   void do_place_castle();
   void do_get_inventory(MapPos);
   void do_save_game();
   void do_update_clear_reset();
+  void read_game_events();
   void do_get_serfs();
   void do_debug_building_triggers();
   void do_promote_serfs_to_knights();
@@ -215,10 +349,15 @@ class AI {
   //
   // ai_pathfinder.cc
   //
-  Road plot_road(PMap map, unsigned int player_index, MapPos start, MapPos end, Roads * const &potential_roads);
+  // searches in arena, or in this thread's own if nullptr
+  Road plot_road(PMap map, unsigned int player_index, MapPos start, MapPos end, Roads * const &potential_roads, SearchArena *arena = nullptr);
+  bool get_cached_road_plot(PMap map, MapPos start, MapPos end, RoadPlot *plot);
+  void cache_road_plot(PMap map, MapPos start, MapPos end, uint32_t changes_before, RoadPlot *plot);
+  void plot_roads(PMap map, unsigned int player_index, MapPos start, const MapPosVector &ends, std::vector<Road> *roads, std::vector<Roads> *potential_roads);
   int get_straightline_tile_dist(PMap map, MapPos start_pos, MapPos end_pos);
-  bool score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions road_options, MapPos flag_pos, MapPos castle_flag_pos, ColorDotMap *ai_mark_pos);
-  bool find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb, MapPos flag_pos, MapPos castle_flag_pos, ColorDotMap *ai_mark_pos);
+  bool score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions road_options, MapPos flag_pos, MapPos castle_flag_pos);
+  bool find_flag_and_tile_dist(PMap map, RoadBuilder *rb, MapPos flag_pos, MapPos castle_flag_pos);
+  const FlagDists &get_flag_dists();
   RoadEnds get_roadends(PMap map, Road road);
   Road reverse_road(PMap map, Road road);
 };
@@ -236,6 +375,7 @@ static const unsigned int knights_med = 18;
 static const unsigned int knights_max = 50;
 static const unsigned int knight_occupation_change_buffer = 4; // to avoid repeatedly cycling knights, increase/lower bar to change levels again by this amount
 static const unsigned int near_building_sites_min = 250;   // don't place castle unless this many sites available.  small += 1, large += 3
+static const int castle_spacing = 24;   // AI castles start at least this many tiles apart, if the map has room
 static const unsigned int gold_bars_max = 50;  // does this do anything?  maybe use to deprioritize food to gold mines over this amount?
 static const unsigned int steel_min = 8;   // don't build blacksmith if under this value, unless sufficient iron or an iron mine
 static const unsigned int steel_max = 60;  // don't build iron foundry if over this value
@@ -255,10 +395,20 @@ static const unsigned int iron_ore_min = 8; // don't build blacksmith if under t
 static const unsigned int iron_ore_max = 30; // don't build iron mine if over this value, don't give food to mine over this value
 static const unsigned int gold_ore_min = 8;    // don't build gold smelter if under this value and no gold min.  Also, de-prioritize gold miner's food supply if over this value
 static const unsigned int gold_ore_max = 40;  // don't build gold mine over this value (is this implemented?),   don't give food to mine over this value
+static const unsigned int economy_forecast_minutes = 5;  // mine food priorities go by the coal/ore stored or forecast this far ahead, whichever is lower
 static const unsigned int hills_min = 9;   // don't send geologists unless substantial hills
 static const unsigned int waters_min = 24;  // don't build fisherman unless substantial waters
 static const unsigned int hammers_min = 6; // don't create geologists unless this many hammers in reserve
 static const unsigned int geologists_max = 4; // try not to create more geologists if have this many, hard to tell if they are out working
+static const unsigned int stuck_serf_wait_ticks = 10000;  // boot a serf that has been in WAIT_IDLE_ON_PATH this long
+static const unsigned int missing_transporter_wait_ticks = 20000;  // force call a transporter to a road that has waited this long for one
+static const unsigned int defensive_buffer_threat_cells = 2;  // only build a defensive buffer if enemy knights are within this many threat map cells of the castle
+static const unsigned int loop_rest_ticks = 600;   // rest before each loop, 6sec at normal speed
+static const unsigned int loop_end_rest_ticks = 200;  // extra rest after a loop that ran to the end
+static const unsigned int stock_rest_ticks = 200;  // rest after the economy loop for each stock
+static const unsigned int cpu_budget_us_per_tick = 1500;  // AI CPU time earned per game tick, 15% of a core at normal speed
+static const unsigned int cpu_slice_us = 200000;  // longest a step runs before waiting for more budget
+static const unsigned int max_step_wait_ms = 500;  // wake up at least this often to notice game speed changes
 
 // deprioritize sending geologists to area where signs density is over this amount (prefer send geologists to unevaluated areas)
 static constexpr double geologist_sign_density_deprio = 0.40;
@@ -0,0 +1,52 @@
+/*
+ * ai_arena.cc - memory for the AI's short-lived containers, given back once a loop
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+const size_t AIArena::block_size;
+
+AIArena::AIArena()
+  : block(0)
+  , used(0) {
+}
+
+void *
+AIArena::allocate(size_t bytes, size_t align) {
+  while (block < blocks.size()) {
+    uintptr_t start = reinterpret_cast<uintptr_t>(blocks[block].data.get());
+    uintptr_t next = (start + used + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    if (next + bytes <= start + blocks[block].size) {
+      used = next + bytes - start;
+      return reinterpret_cast<void*>(next);
+    }
+    // the rest of this block stays unused until the arena is rewound
+    block++;
+    used = 0;
+  }
+  // blocks come from new[], aligned for any type
+  size_t size = std::max(block_size, bytes);
+  blocks.push_back(Block{std::unique_ptr<char[]>(new char[size]), size});
+  block = blocks.size() - 1;
+  used = bytes;
+  return blocks[block].data.get();
+}
+
+void
+AIArena::rewind(const Mark &mark) {
+  block = mark.block;
+  used = mark.used;
+}
+
+size_t
+AIArena::get_allocated_bytes() const {
+  size_t bytes = 0;
+  for (const Block &b : blocks) {
+    bytes += b.size;
+  }
+  return bytes;
+}
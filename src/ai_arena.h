@@ -0,0 +1,94 @@
+/*
+ * ai_arena.h - memory for the AI's short-lived containers, given back once a loop
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_ARENA_H_
+#define SRC_AI_ARENA_H_
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <set>
+#include <vector>
+
+// hands out memory from a few large blocks one piece after the other, and
+//  never frees a piece on its own.  reset() gives everything back at once and
+//  keeps the blocks for the next loop, so after the first few loops the AI's
+//  temporary containers don't go to the global allocator at all.  A Scope
+//  gives back what was handed out while it lived, for searches that run many
+//  times in one loop.  Only the AI that owns it may use it, it is not locked
+class AIArena {
+ public:
+  static const size_t block_size = 64 * 1024;
+
+  typedef struct Mark {
+    size_t block;
+    size_t used;
+  } Mark;
+
+  class Scope {
+   protected:
+    AIArena *arena;
+    Mark mark;
+
+   public:
+    explicit Scope(AIArena *arena) : arena(arena), mark(arena->get_mark()) {}
+    ~Scope() { arena->rewind(mark); }
+  };
+
+ protected:
+  typedef struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  } Block;
+  std::vector<Block> blocks;
+  size_t block;   // the one being handed out from
+  size_t used;    // bytes of it handed out
+
+ public:
+  AIArena();
+
+  void *allocate(size_t bytes, size_t align);
+  void reset() { rewind(Mark{0, 0}); }
+  Mark get_mark() const { return Mark{block, used}; }
+  // everything allocated since mark is free again
+  void rewind(const Mark &mark);
+
+  size_t get_block_count() const { return blocks.size(); }
+  size_t get_allocated_bytes() const;
+};
+
+// for containers to take their memory from an AIArena.  Freeing does nothing,
+//  the memory comes back when the arena is reset
+template <class T>
+class AIArenaAllocator {
+ public:
+  typedef T value_type;
+
+  AIArena *arena;
+
+  explicit AIArenaAllocator(AIArena *arena) : arena(arena) {}
+  template <class U>
+  AIArenaAllocator(const AIArenaAllocator<U> &other) : arena(other.arena) {}  // NOLINT(runtime/explicit)
+
+  T *allocate(size_t count) {
+    return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *, size_t) {}
+
+  template <class U>
+  bool operator==(const AIArenaAllocator<U> &other) const { return arena == other.arena; }
+  template <class U>
+  bool operator!=(const AIArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+template <class T>
+using ArenaVector = std::vector<T, AIArenaAllocator<T>>;
+template <class T>
+using ArenaList = std::list<T, AIArenaAllocator<T>>;
+template <class T>
+using ArenaSet = std::set<T, std::less<T>, AIArenaAllocator<T>>;
+
+#endif  // SRC_AI_ARENA_H_
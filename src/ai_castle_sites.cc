@@ -0,0 +1,134 @@
+/*
+ * ai_castle_sites.cc - places on a map where a castle could go, scored
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_castle_sites.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <future>        //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <sstream>
+#include <thread>        //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+const int CastleSites::radius;
+
+std::mutex CastleSites::cache_mutex;
+std::map<std::string, std::shared_ptr<const CastleSites::Sites>> CastleSites::cache;
+
+CastleSites::Site
+CastleSites::score(Game *game, const Map &map, MapPos pos) {
+  Site site;
+  site.pos = pos;
+  site.trees = map.get_trees_in(pos, radius);
+  site.stones = map.get_stones_in(pos, radius);
+  site.building_sites = 0;
+  unsigned int tiles = 1 + 3 * radius * (radius + 1);
+  for (unsigned int i = 0; i < tiles; i++) {
+    unsigned int buildable = game->get_buildable(map.pos_add_extended_spirally(pos, i));
+    if (buildable & Game::BuildableLarge) {
+      site.building_sites += 3;
+    } else if (buildable & Game::BuildableSmall) {
+      site.building_sites += 1;
+    }
+  }
+  site.score = site.trees + site.stones + site.building_sites;
+  return site;
+}
+
+bool
+CastleSites::is_acceptable(const Site &site, const Minimums &min) {
+  return site.trees >= min.trees && site.stones >= min.stones &&
+         site.building_sites >= min.building_sites;
+}
+
+CastleSites::Sites
+CastleSites::find(Game *game, const Minimums &min, unsigned int threads) {
+  PMap map = game->get_map();
+  unsigned int rows = map->get_rows();
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min(threads, rows);
+
+  // each thread takes every threads-th row, the sort below puts them together
+  //  the same way however many there were
+  std::vector<Sites> found(threads);
+  auto find_rows = [game, &map, &min, &found, threads, rows](unsigned int first) {
+    for (unsigned int row = first; row < rows; row += threads) {
+      for (unsigned int col = 0; col < map->get_cols(); col++) {
+        MapPos pos = map->pos(col, row);
+        if (!(game->get_buildable(pos) & Game::BuildableCastle)) {
+          continue;
+        }
+        Site site = score(game, *map, pos);
+        if (is_acceptable(site, min)) {
+          found[first].push_back(site);
+        }
+      }
+    }
+  };
+  std::vector<std::future<void>> workers;
+  for (unsigned int first = 1; first < threads; first++) {
+    workers.push_back(std::async(std::launch::async, find_rows, first));
+  }
+  find_rows(0);
+  for (std::future<void> &worker : workers) {
+    worker.get();
+  }
+
+  Sites sites;
+  for (const Sites &part : found) {
+    sites.insert(sites.end(), part.begin(), part.end());
+  }
+  std::sort(sites.begin(), sites.end(), [](const Site &a, const Site &b) {
+    return (a.score != b.score) ? a.score > b.score : a.pos < b.pos;
+  });
+  return sites;
+}
+
+std::shared_ptr<const CastleSites::Sites>
+CastleSites::get(Game *game, const Minimums &min) {
+  PMap map = game->get_map();
+  std::ostringstream key;
+  key << std::string(game->get_map_seed()) << " " << map->get_cols() << "x" << map->get_rows()
+      << " " << min.trees << " " << min.stones << " " << min.building_sites;
+  // held while scoring, so AIs starting together wait for the first one's
+  //  sites instead of all scoring the map at once
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  std::shared_ptr<const Sites> &sites = cache[key.str()];
+  if (!sites) {
+    sites = std::make_shared<const Sites>(find(game, min));
+  }
+  return sites;
+}
+
+void
+CastleSites::clear_cache() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  cache.clear();
+}
+
+CastleSites::Sites
+CastleSites::spread(const Map &map, const Sites &sites, int spacing) {
+  Sites taken;
+  for (const Site &site : sites) {
+    bool apart = true;
+    for (const Site &other : taken) {
+      // in tiles, like AI::get_straightline_tile_dist
+      int dist_col = map.dist_x(site.pos, other.pos);
+      int dist_row = map.dist_y(site.pos, other.pos);
+      int dist = ((dist_col > 0 && dist_row > 0) || (dist_col < 0 && dist_row < 0)) ?
+                 std::max(std::abs(dist_col), std::abs(dist_row)) :
+                 std::abs(dist_col) + std::abs(dist_row);
+      if (dist < spacing) {
+        apart = false;
+        break;
+      }
+    }
+    if (apart) {
+      taken.push_back(site);
+    }
+  }
+  return taken;
+}
@@ -0,0 +1,67 @@
+/*
+ * ai_castle_sites.h - places on a map where a castle could go, scored
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_CASTLE_SITES_H_
+#define SRC_AI_CASTLE_SITES_H_
+
+#include <map>
+#include <memory>
+#include <mutex>         //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <string>
+#include <vector>
+
+#include "src/game.h"
+#include "src/map.h"
+
+// every place on a map where a castle can be built, with the trees, stone
+//  and building sites within radius of it.  The trees and stone come from
+//  the map's block totals, the building sites from the game's buildable
+//  bits, and all the places are scored on one thread per core at once.
+//  The sites of a map are kept by its seed and size, so the AIs of a game,
+//  and those of later games on the same map, share one scoring pass
+class CastleSites {
+ public:
+  static const int radius = 8;   // rows around the castle that are scored
+
+  typedef struct Site {
+    MapPos pos;
+    unsigned int trees;
+    unsigned int stones;           // by what is left of each pile
+    unsigned int building_sites;   // small += 1, large += 3
+    unsigned int score;
+  } Site;
+  typedef std::vector<Site> Sites;
+
+  typedef struct Minimums {
+    unsigned int trees;
+    unsigned int stones;
+    unsigned int building_sites;
+  } Minimums;
+
+ protected:
+  static std::mutex cache_mutex;
+  static std::map<std::string, std::shared_ptr<const Sites>> cache;
+
+ public:
+  // what is around pos.  Only reads the map and the buildable bits, so it
+  //  can run on any thread
+  static Site score(Game *game, const Map &map, MapPos pos);
+  static bool is_acceptable(const Site &site, const Minimums &min);
+
+  // the places a castle can be built on the map of game that meet min, best
+  //  first and ties by pos, so the order only depends on the map.  Land that
+  //  is owned already is not left out, callers check can_build_castle.
+  //  threads 0 is one per core
+  static Sites find(Game *game, const Minimums &min, unsigned int threads = 0);
+  // find(), worked out once for each map seed and size and minimums
+  static std::shared_ptr<const Sites> get(Game *game, const Minimums &min);
+  static void clear_cache();
+
+  // of sites, best first, those at least spacing tiles from all the ones
+  //  taken before them, so players that start on them start apart
+  static Sites spread(const Map &map, const Sites &sites, int spacing);
+};
+
+#endif  // SRC_AI_CASTLE_SITES_H_
@@ -0,0 +1,191 @@
+/*
+ * ai_economy.cc - flow model of a player's production chains
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_economy.h"
+
+#include <algorithm>
+#include <utility>
+
+const unsigned int EconomyForecast::resource_types;
+const unsigned int EconomyForecast::building_types;
+const unsigned int EconomyForecast::max_minutes;
+
+// rough cycle lengths; how far a worker walks to the trees, stones, fish
+//  or ore varies a lot with the land, so they are only good for telling
+//  which way a stock is heading.  In chain order, so each worker sees what
+//  the workers up the chain made in the same minute
+const EconomyForecast::Recipe EconomyForecast::recipes[] = {
+  { Building::TypeLumberjack, 60,
+    { Resource::TypeNone, Resource::TypeNone }, Resource::TypeLumber },
+  { Building::TypeStonecutter, 60,
+    { Resource::TypeNone, Resource::TypeNone }, Resource::TypeStone },
+  { Building::TypeFisher, 60,
+    { Resource::TypeNone, Resource::TypeNone }, Resource::TypeFish },
+  { Building::TypeFarm, 90,
+    { Resource::TypeNone, Resource::TypeNone }, Resource::TypeWheat },
+  { Building::TypeSawmill, 20,
+    { Resource::TypeLumber, Resource::TypeNone }, Resource::TypePlank },
+  { Building::TypeMill, 20,
+    { Resource::TypeWheat, Resource::TypeNone }, Resource::TypeFlour },
+  { Building::TypePigFarm, 40,
+    { Resource::TypeWheat, Resource::TypeNone }, Resource::TypePig },
+  { Building::TypeButcher, 20,
+    { Resource::TypePig, Resource::TypeNone }, Resource::TypeMeat },
+  { Building::TypeBaker, 25,
+    { Resource::TypeFlour, Resource::TypeNone }, Resource::TypeBread },
+  { Building::TypeStoneMine, 40,
+    { Resource::GroupFood, Resource::TypeNone }, Resource::TypeStone },
+  { Building::TypeCoalMine, 40,
+    { Resource::GroupFood, Resource::TypeNone }, Resource::TypeCoal },
+  { Building::TypeIronMine, 40,
+    { Resource::GroupFood, Resource::TypeNone }, Resource::TypeIronOre },
+  { Building::TypeGoldMine, 40,
+    { Resource::GroupFood, Resource::TypeNone }, Resource::TypeGoldOre },
+  { Building::TypeSteelSmelter, 30,
+    { Resource::TypeCoal, Resource::TypeIronOre }, Resource::TypeSteel },
+  { Building::TypeGoldSmelter, 30,
+    { Resource::TypeCoal, Resource::TypeGoldOre }, Resource::TypeGoldBar },
+  // which tool follows the player's priorities, only what it takes counts
+  { Building::TypeToolMaker, 40,
+    { Resource::TypePlank, Resource::TypeSteel }, Resource::TypeNone },
+  // swords and shields by turns
+  { Building::TypeWeaponSmith, 80,
+    { Resource::TypeCoal, Resource::TypeSteel }, Resource::TypeSword },
+  { Building::TypeWeaponSmith, 80,
+    { Resource::TypeCoal, Resource::TypeSteel }, Resource::TypeShield },
+  { Building::TypeBoatbuilder, 60,
+    { Resource::TypePlank, Resource::TypeNone }, Resource::TypeBoat },
+};
+
+static const Resource::Type foods[] = {
+  Resource::TypeFish, Resource::TypeMeat, Resource::TypeBread };
+
+EconomyForecast::EconomyForecast()
+  : version(0)
+  , seen(false)
+  , working{}
+  , stock{}
+  , cached{}
+  , cached_valid(false) {
+}
+
+double
+EconomyForecast::food_in(const double *stock) const {
+  double food = 0;
+  for (Resource::Type res : foods) {
+    food += stock[res];
+  }
+  return food;
+}
+
+// from the most plentiful food first
+void
+EconomyForecast::take_food(double *stock, double amount) const {
+  while (amount > 0) {
+    Resource::Type most = foods[0];
+    for (Resource::Type res : foods) {
+      if (stock[res] > stock[most]) most = res;
+    }
+    if (stock[most] <= 0) {
+      return;
+    }
+    double take = std::min(amount, stock[most]);
+    stock[most] -= take;
+    amount -= take;
+  }
+}
+
+void
+EconomyForecast::update(std::shared_ptr<const GameSnapshot> snapshot,
+                        unsigned int player) {
+  if (seen && snapshot->get_version() == version) {
+    return;
+  }
+  seen = true;
+  version = snapshot->get_version();
+  update(snapshot->get_player(player));
+}
+
+void
+EconomyForecast::update(const GameSnapshot::PlayerView &view) {
+  unsigned int new_working[building_types] = {};
+  for (const GameSnapshot::BuildingView &building : view.buildings) {
+    if (building.done && !building.burning && building.has_serf) {
+      new_working[building.type]++;
+    }
+  }
+  unsigned int new_stock[resource_types] = {};
+  for (const GameSnapshot::InventoryView &inventory : view.inventories) {
+    for (const std::pair<const Resource::Type, unsigned int> &res :
+         inventory.resources) {
+      if (res.first >= 0 && res.first < static_cast<int>(resource_types)) {
+        new_stock[res.first] += res.second;
+      }
+    }
+  }
+  // most loops nothing was finished or used up, and the forecast stands
+  if (std::equal(std::begin(new_working), std::end(new_working),
+                 std::begin(working)) &&
+      std::equal(std::begin(new_stock), std::end(new_stock),
+                 std::begin(stock))) {
+    return;
+  }
+  std::copy(std::begin(new_working), std::end(new_working),
+            std::begin(working));
+  std::copy(std::begin(new_stock), std::end(new_stock), std::begin(stock));
+  cached_valid = false;
+}
+
+const EconomyForecast::Forecast &
+EconomyForecast::forecast(unsigned int minutes) {
+  minutes = std::min(minutes, max_minutes);
+  if (cached_valid && cached.minutes == minutes) {
+    return cached;
+  }
+  cached.minutes = minutes;
+  for (unsigned int r = 0; r < resource_types; r++) {
+    cached.stock[r] = stock[r];
+    cached.short_in[r] = -1;
+  }
+  double *level = cached.stock;
+  for (unsigned int minute = 0; minute < minutes; minute++) {
+    for (const Recipe &recipe : recipes) {
+      if (working[recipe.building] == 0) {
+        continue;
+      }
+      double units = working[recipe.building] * 60.0 / recipe.seconds;
+      for (Resource::Type in : recipe.in) {
+        if (in == Resource::TypeNone) {
+          continue;
+        }
+        double have = (in == Resource::GroupFood) ? food_in(level)
+                                                  : level[in];
+        if (have >= units) {
+          continue;
+        }
+        units = have;
+        if (in == Resource::GroupFood) {
+          for (Resource::Type res : foods) {
+            if (cached.short_in[res] < 0) cached.short_in[res] = minute;
+          }
+        } else if (cached.short_in[in] < 0) {
+          cached.short_in[in] = minute;
+        }
+      }
+      for (Resource::Type in : recipe.in) {
+        if (in == Resource::GroupFood) {
+          take_food(level, units);
+        } else if (in != Resource::TypeNone) {
+          level[in] = std::max(0.0, level[in] - units);
+        }
+      }
+      if (recipe.out != Resource::TypeNone) {
+        level[recipe.out] += units;
+      }
+    }
+  }
+  cached_valid = true;
+  return cached;
+}
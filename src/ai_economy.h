@@ -0,0 +1,81 @@
+/*
+ * ai_economy.h - flow model of a player's production chains
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_ECONOMY_H_
+#define SRC_AI_ECONOMY_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "src/building.h"
+#include "src/game-snapshot.h"
+#include "src/resource.h"
+
+// the working buildings of a player and what its stocks hold, taken from a
+//  snapshot, and what they come to some minutes ahead if every building
+//  keeps working at its nominal rate as far as its inputs allow.  A worker
+//  takes its inputs from the stocks as the model goes along the chains,
+//  raw materials first, so a shortage shows up down the chain in the minute
+//  it starts.  Only the production chains are modelled; what construction
+//  sites and new knights take out of the stocks is not.  Forecasts are kept
+//  until the counts change, so asking again costs nothing
+class EconomyForecast {
+ public:
+  static const unsigned int resource_types = Resource::TypeShield + 1;
+  static const unsigned int building_types = GameSnapshot::building_types;
+  static const unsigned int max_minutes = 120;
+
+  typedef struct Forecast {
+    unsigned int minutes;
+    double stock[resource_types];
+    // minutes until a worker first has to wait for the resource, or -1 if
+    //  none does within the forecast
+    int short_in[resource_types];
+  } Forecast;
+
+ protected:
+  // a cycle of a worker with its inputs at hand, walking included, in
+  //  seconds at normal speed.  Mines take one food of any kind, and a
+  //  building making more than one thing has a recipe for each, sharing out
+  //  its time
+  typedef struct Recipe {
+    Building::Type building;
+    unsigned int seconds;
+    Resource::Type in[2];
+    Resource::Type out;
+  } Recipe;
+  static const Recipe recipes[];
+
+  uint64_t version;
+  bool seen;
+  unsigned int working[building_types];
+  unsigned int stock[resource_types];
+  Forecast cached;
+  bool cached_valid;
+
+  void take_food(double *stock, double amount) const;
+  double food_in(const double *stock) const;
+
+ public:
+  EconomyForecast();
+
+  // take the player's part of the snapshot, unless it was seen already
+  void update(std::shared_ptr<const GameSnapshot> snapshot,
+              unsigned int player);
+  void update(const GameSnapshot::PlayerView &view);
+
+  unsigned int get_working(Building::Type type) const {
+    return working[type]; }
+  unsigned int get_stock(Resource::Type res) const { return stock[res]; }
+
+  // the stocks and shortages minutes ahead, up to max_minutes
+  const Forecast &forecast(unsigned int minutes);
+  double get_projected(Resource::Type res, unsigned int minutes) {
+    return forecast(minutes).stock[res]; }
+  int get_short_in(Resource::Type res, unsigned int minutes) {
+    return forecast(minutes).short_in[res]; }
+};
+
+#endif  // SRC_AI_ECONOMY_H_
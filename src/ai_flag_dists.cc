@@ -0,0 +1,174 @@
+/*
+ * ai_flag_dists.cc - road distances from each stock flag to every flag
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_flag_dists.h"
+
+#include <functional>
+#include <queue>
+#include <tuple>
+
+const unsigned int FlagDists::none;
+
+void
+FlagDists::clear() {
+  flag_pos.clear();
+  edges.clear();
+  sources.clear();
+  dists.clear();
+  castle_flag_pos = bad_map_pos;
+}
+
+void
+FlagDists::build(const Map &map, const std::vector<MapPos> &stocks_pos,
+                 MapPos _castle_flag_pos) {
+  clear();
+  castle_flag_pos = _castle_flag_pos;
+
+  // every flag that can be reached from a stock, each road traced once
+  std::vector<unsigned int> found;
+  for (MapPos pos : stocks_pos) {
+    if (!map.has_flag(pos)) {
+      continue;
+    }
+    sources.push_back(pos);
+    unsigned int flag = map.get_obj_index(pos);
+    if (add_flag(map, pos)) {
+      found.push_back(flag);
+    }
+  }
+  for (size_t i = 0; i < found.size(); i++) {
+    unsigned int flag = found[i];
+    for (Direction dir : cycle_directions_cw()) {
+      if (!map.has_path(flag_pos[flag], dir) ||
+          edges[6 * flag + dir].to != none) {
+        continue;
+      }
+      unsigned int other = trace(map, flag, dir);
+      if (other != none) {
+        found.push_back(other);
+      }
+    }
+  }
+
+  dists.resize(sources.size());
+  for (size_t i = 0; i < sources.size(); i++) {
+    search(map.get_obj_index(sources[i]), &dists[i]);
+  }
+}
+
+// make room for the flag at pos, false if it was already there
+bool
+FlagDists::add_flag(const Map &map, MapPos pos) {
+  unsigned int flag = map.get_obj_index(pos);
+  if (flag >= flag_pos.size()) {
+    flag_pos.resize(flag + 1, bad_map_pos);
+    edges.resize(6 * (flag + 1), Edge{ none, 0 });
+  }
+  if (flag_pos[flag] == pos) {
+    return false;
+  }
+  flag_pos[flag] = pos;
+  return true;
+}
+
+// follow the road from flag in dir to the flag at its other end, as
+//  AI::trace_existing_road does, and note it at both ends.  Returns the
+//  other flag if this is the first road found to it, else none
+unsigned int
+FlagDists::trace(const Map &map, unsigned int flag, Direction dir) {
+  MapPos start_pos = flag_pos[flag];
+  MapPos pos = start_pos;
+  Direction first_dir = dir;
+  unsigned int length = 0;
+  // the map can change under the AI, don't follow a broken road forever
+  unsigned int max_length = map.get_size();
+  while (length < max_length) {
+    pos = map.move(pos, dir);
+    length++;
+    if (map.has_flag(pos)) {
+      break;
+    }
+    Direction next = DirectionNone;
+    for (Direction new_dir : cycle_directions_cw()) {
+      if (map.has_path(pos, new_dir) && new_dir != reverse_direction(dir)) {
+        next = new_dir;
+        break;
+      }
+    }
+    if (next == DirectionNone) {
+      return none;
+    }
+    dir = next;
+  }
+  if (!map.has_flag(pos)) {
+    return none;
+  }
+  bool added = add_flag(map, pos);
+  unsigned int other = map.get_obj_index(pos);
+  edges[6 * flag + first_dir] = Edge{ other, length };
+  edges[6 * other + reverse_direction(dir)] = Edge{ flag, length };
+  return added ? other : none;
+}
+
+void
+FlagDists::search(unsigned int source, std::vector<Dist> *dist) {
+  dist->assign(flag_pos.size(), Dist{ none, none, false });
+  typedef std::tuple<unsigned int, unsigned int, unsigned int> Node;
+  std::priority_queue<Node, std::vector<Node>, std::greater<Node>> open;
+  (*dist)[source] = Dist{ 0, 0, false };
+  open.push(Node(0, 0, source));
+  while (!open.empty()) {
+    unsigned int flag_dist = std::get<0>(open.top());
+    unsigned int tile_dist = std::get<1>(open.top());
+    unsigned int flag = std::get<2>(open.top());
+    open.pop();
+    const Dist &here = (*dist)[flag];
+    if (flag_dist != here.flag_dist || tile_dist != here.tile_dist) {
+      continue;
+    }
+    for (Direction dir : cycle_directions_cw()) {
+      const Edge &edge = edges[6 * flag + dir];
+      if (edge.to == none) {
+        continue;
+      }
+      Dist &there = (*dist)[edge.to];
+      unsigned int next_flag_dist = flag_dist + 1;
+      unsigned int next_tile_dist = tile_dist + edge.length;
+      if (next_flag_dist > there.flag_dist ||
+          (next_flag_dist == there.flag_dist &&
+           next_tile_dist >= there.tile_dist)) {
+        continue;
+      }
+      there.flag_dist = next_flag_dist;
+      there.tile_dist = next_tile_dist;
+      there.contains_castle_flag = (flag_pos[edge.to] == castle_flag_pos) ||
+                                   here.contains_castle_flag;
+      open.push(Node(next_flag_dist, next_tile_dist, edge.to));
+    }
+  }
+}
+
+bool
+FlagDists::get(const Map &map, MapPos source_pos, MapPos pos,
+               Dist *dist) const {
+  if (!map.has_flag(pos)) {
+    return false;
+  }
+  unsigned int flag = map.get_obj_index(pos);
+  if (flag >= flag_pos.size() || flag_pos[flag] != pos) {
+    return false;
+  }
+  for (size_t i = 0; i < sources.size(); i++) {
+    if (sources[i] != source_pos) {
+      continue;
+    }
+    if (dists[i][flag].flag_dist == none) {
+      return false;
+    }
+    *dist = dists[i][flag];
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,70 @@
+/*
+ * ai_flag_dists.h - road distances from each stock flag to every flag
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_FLAG_DISTS_H_
+#define SRC_AI_FLAG_DISTS_H_
+
+#include <vector>
+
+#include "src/map.h"
+#include "src/memory-usage.h"
+
+// flag and tile distances along the roads from each stock flag to every flag
+//  connected to it, so scoring a candidate flag is a lookup instead of a
+//  flag search of its own.  build() traces every road reachable from the
+//  stocks once and runs one Dijkstra per stock over the flag graph, fewest
+//  flags first and fewest tiles among those.  The tables are dense, indexed
+//  by flag index, and only good until the roads change
+class FlagDists {
+ public:
+  typedef struct Dist {
+    unsigned int flag_dist;
+    unsigned int tile_dist;
+    bool contains_castle_flag;   // the castle flag is on the way, not counting the stock itself
+  } Dist;
+
+ protected:
+  static const unsigned int none = static_cast<unsigned int>(-1);
+
+  typedef struct Edge {
+    unsigned int to;       // flag index, or none if no road
+    unsigned int length;   // in tiles
+  } Edge;
+
+  std::vector<MapPos> flag_pos;   // by flag index, bad_map_pos if not reached
+  std::vector<Edge> edges;        // six per flag index, by direction
+  std::vector<MapPos> sources;
+  std::vector<std::vector<Dist>> dists;   // by source, then by flag index
+  MapPos castle_flag_pos;
+
+  bool add_flag(const Map &map, MapPos pos);
+  unsigned int trace(const Map &map, unsigned int flag, Direction dir);
+  void search(unsigned int source, std::vector<Dist> *dist);
+
+ public:
+  FlagDists() : castle_flag_pos(bad_map_pos) {}
+
+  void build(const Map &map, const std::vector<MapPos> &stocks_pos,
+             MapPos castle_flag_pos);
+  void clear();
+
+  // the distances from flag_pos to the stock flag at source_pos, false if
+  //  source_pos is not a stock or flag_pos was not reached from it
+  bool get(const Map &map, MapPos source_pos, MapPos flag_pos,
+           Dist *dist) const;
+  MapPos get_castle_flag_pos() const { return castle_flag_pos; }
+  size_t get_allocated_bytes() const {
+    size_t bytes = MemoryUsage::vector_bytes(flag_pos) +
+                   MemoryUsage::vector_bytes(edges) +
+                   MemoryUsage::vector_bytes(sources) +
+                   MemoryUsage::vector_bytes(dists);
+    for (const std::vector<Dist> &dist : dists) {
+      bytes += MemoryUsage::vector_bytes(dist);
+    }
+    return bytes;
+  }
+};
+
+#endif  // SRC_AI_FLAG_DISTS_H_
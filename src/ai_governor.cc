@@ -0,0 +1,116 @@
+/*
+ * ai_governor.cc - CPU budget for an AI player, paid for in game ticks
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_governor.h"
+
+#include <algorithm>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+#include "src/freeserf.h"
+
+AIGovernor::AIGovernor(unsigned int budget_us_per_tick, unsigned int slice_us)
+  : budget_us(budget_us_per_tick)
+  , max_slice_us(slice_us)
+  , credit_us(slice_us)
+  , last_tick(0)
+  , speed(0)
+  , slice_end(0)
+  , paused_us(0) {
+}
+
+void
+AIGovernor::start_slice(unsigned int tick, unsigned int game_speed) {
+  refill(tick);
+  speed = game_speed;
+  slice_start = Clock::now();
+  Clock::time_point end = slice_start +
+                          std::chrono::microseconds(get_slice_us());
+  slice_end = end.time_since_epoch().count();
+  paused_us = 0;
+}
+
+bool
+AIGovernor::slice_used() const {
+  return Clock::now().time_since_epoch().count() >= slice_end;
+}
+
+// most callers are inner loops, only look at the clock every so often
+void
+AIGovernor::checkpoint() {
+  static thread_local unsigned int calls = 0;
+  if (++calls % 256 != 0) {
+    return;
+  }
+  int64_t end = slice_end;
+  Clock::time_point now = Clock::now();
+  if (now.time_since_epoch().count() < end) {
+    return;
+  }
+  // wait for the game to pay for one more slice, then go on with a new one.
+  //  Of the threads that find the slice over only the first moves it on and
+  //  is not charged for the pause, the others wait out the same pause
+  int64_t pause_us = std::max<int64_t>(max_slice_us, budget_us);
+  unsigned int pause_ticks = static_cast<unsigned int>(
+                               (pause_us + budget_us - 1) / budget_us);
+  std::chrono::milliseconds pause(ticks_to_ms(pause_ticks, speed));
+  Clock::time_point resume = now + pause;
+  int64_t next_end = (resume + std::chrono::microseconds(max_slice_us))
+                       .time_since_epoch().count();
+  if (slice_end.compare_exchange_strong(end, next_end)) {
+    paused_us += std::chrono::duration_cast<std::chrono::microseconds>(pause)
+                   .count();
+  } else {
+    resume = Clock::time_point(Clock::duration(end)) -
+             std::chrono::microseconds(max_slice_us);
+  }
+  std::this_thread::sleep_until(resume);
+}
+
+unsigned int
+AIGovernor::end_slice(unsigned int tick) {
+  int64_t used_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      Clock::now() - slice_start).count();
+  charge(std::max<int64_t>(0, used_us - paused_us));
+  refill(tick);
+  return get_wait_ms();
+}
+
+void
+AIGovernor::refill(unsigned int tick) {
+  // a loaded game can start over at an earlier tick
+  if (tick > last_tick) {
+    credit_us = std::min(max_slice_us,
+                         credit_us + budget_us * (tick - last_tick));
+  }
+  last_tick = tick;
+}
+
+void
+AIGovernor::charge(int64_t used_us) {
+  credit_us -= used_us;
+}
+
+int64_t
+AIGovernor::get_slice_us() const {
+  return std::max<int64_t>(0, credit_us);
+}
+
+unsigned int
+AIGovernor::get_wait_ms() const {
+  if (credit_us >= 0) {
+    return 0;
+  }
+  unsigned int ticks = static_cast<unsigned int>(
+                         (budget_us - 1 - credit_us) / budget_us);
+  return ticks_to_ms(ticks, speed);
+}
+
+unsigned int
+AIGovernor::ticks_to_ms(unsigned int ticks, unsigned int game_speed) {
+  if (game_speed == 0) {
+    game_speed = 1;
+  }
+  return (ticks * TICK_LENGTH + game_speed - 1) / game_speed;
+}
@@ -0,0 +1,59 @@
+/*
+ * ai_governor.h - CPU budget for an AI player, paid for in game ticks
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_GOVERNOR_H_
+#define SRC_AI_GOVERNOR_H_
+
+#include <atomic>
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <cstdint>
+
+// Each AI earns budget_us of CPU time for every game tick that passes and
+//  spends it in time slices.  A step runs until its slice is used, then the
+//  AI waits until the game has paid back what it spent.  Because the budget
+//  is per game tick, a faster game buys the AI more time per second and a
+//  slow one less, and a stalled game stops it.  Credit is capped at one
+//  slice so an AI that was idle cannot make up for it all at once
+//
+// Work that cannot stop half-way (a path search, scoring an area) calls
+//  checkpoint() instead, which pauses the calling thread when the slice is
+//  over.  checkpoint and slice_used can be called from the threads plot_roads
+//  starts, everything else only from the thread running the AI's step
+class AIGovernor {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+ protected:
+  int64_t budget_us;     // earned per game tick
+  int64_t max_slice_us;
+  int64_t credit_us;
+  unsigned int last_tick;
+  unsigned int speed;
+  Clock::time_point slice_start;
+  std::atomic<int64_t> slice_end;   // Clock ticks since epoch
+  std::atomic<int64_t> paused_us;   // spent in checkpoint this slice, not charged
+
+ public:
+  AIGovernor(unsigned int budget_us_per_tick, unsigned int slice_us);
+
+  // start a step at this game tick, the slice is the credit on hand
+  void start_slice(unsigned int tick, unsigned int game_speed);
+  bool slice_used() const;
+  void checkpoint();
+  // charge the step and return how long to wait before the next one
+  unsigned int end_slice(unsigned int tick);
+
+  // the accounting behind the slices
+  void refill(unsigned int tick);
+  void charge(int64_t used_us);
+  int64_t get_credit_us() const { return credit_us; }
+  int64_t get_slice_us() const;
+  unsigned int get_wait_ms() const;
+
+  // wall time the game takes for this many ticks at this speed
+  static unsigned int ticks_to_ms(unsigned int ticks, unsigned int game_speed);
+};
+
+#endif  // SRC_AI_GOVERNOR_H_
@@ -0,0 +1,275 @@
+/*
+ * ai_map_analysis.cc - what is where on a map, worked out once for all AIs
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_map_analysis.h"
+
+#include <algorithm>
+#include <deque>
+
+#include "src/profiler.h"
+#include "src/trace.h"
+
+const unsigned int MapAnalysis::no_cluster;
+const uint16_t MapAnalysis::TileFood;
+const uint16_t MapAnalysis::TileTree;
+const uint16_t MapAnalysis::TileHill;
+const unsigned int MapAnalysis::tile_stones_shift;
+const unsigned int MapAnalysis::tile_sign_shift;
+const uint16_t MapAnalysis::TileSign;
+const uint16_t MapAnalysis::TileLargeSign;
+
+std::mutex MapAnalysis::cache_mutex;
+std::map<const Map*, std::weak_ptr<MapAnalysis>> MapAnalysis::cache;
+
+MapAnalysis::MapAnalysis(PMap map_)
+  : map(map_)
+  , block_size(Map::get_change_block_size())
+  , block_cols(map_->get_cols() / Map::get_change_block_size())
+  , tiles(map_->geom().tile_count())
+  , counted_changes(map_->get_change_block_count())
+  , regions(map_->get_change_block_count())
+  , recounts(0)
+  , ready(false) {
+}
+
+MapAnalysis::~MapAnalysis() {
+  // build() may still be going over the tiles
+  if (built.valid()) {
+    built.wait();
+  }
+}
+
+std::shared_ptr<MapAnalysis>
+MapAnalysis::get(PMap map) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  for (auto it = cache.begin(); it != cache.end(); ) {
+    if (it->second.expired()) {
+      it = cache.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  std::shared_ptr<MapAnalysis> analysis = cache[map.get()].lock();
+  if (!analysis) {
+    analysis = std::make_shared<MapAnalysis>(map);
+    analysis->start();
+    cache[map.get()] = analysis;
+  }
+  return analysis;
+}
+
+uint16_t
+MapAnalysis::tile_of(const Map &map, MapPos pos) {
+  Map::Object obj = map.get_obj(pos);
+  unsigned int terrain = map.terrain_up_left(pos);
+  uint16_t tile = 0;
+  if ((obj == Map::ObjectNone &&
+       (terrain & (Map::terrain_bits(Map::TerrainGrass0, Map::TerrainGrass3) |
+                   Map::terrain_bits(Map::TerrainWater0, Map::TerrainWater3))) != 0) ||
+      (obj >= Map::ObjectSeeds0 && obj <= Map::ObjectFieldExpired) ||
+      (obj >= Map::ObjectField0 && obj <= Map::ObjectField5)) {
+    tile |= TileFood;
+  }
+  if (obj >= Map::ObjectTree0 && obj <= Map::ObjectPine7) {
+    tile |= TileTree;
+  }
+  if (obj >= Map::ObjectStone0 && obj <= Map::ObjectStone7) {
+    tile |= static_cast<uint16_t>((1 + Map::ObjectStone7 - obj) << tile_stones_shift);
+  }
+  // signs on hills are counted as hills too, as score_area always has
+  if ((terrain & Map::terrain_bits(Map::TerrainTundra0, Map::TerrainSnow0)) != 0) {
+    tile |= TileHill;
+  }
+  if (obj >= Map::ObjectSignLargeGold && obj <= Map::ObjectSignSmallStone) {
+    unsigned int sign = obj - Map::ObjectSignLargeGold;
+    tile |= static_cast<uint16_t>(TileSign | ((sign / 2) << tile_sign_shift));
+    if (sign % 2 == 0) {
+      tile |= TileLargeSign;
+    }
+  }
+  return tile;
+}
+
+void
+MapAnalysis::add_tile(Counts *counts, uint16_t tile) {
+  counts->foods += tile & TileFood;
+  counts->trees += (tile & TileTree) >> 1;
+  counts->hills += (tile & TileHill) >> 2;
+  counts->stones += (tile >> tile_stones_shift) & 0xf;
+  if (tile & TileSign) {
+    unsigned int amount = (tile & TileLargeSign) ? 3 : 1;
+    switch ((tile >> tile_sign_shift) & 3) {
+      case 0: counts->gold_signs += amount; break;
+      case 1: counts->iron_signs += amount; break;
+      case 2: counts->coal_signs += amount; break;
+      default: counts->stone_signs += amount; break;
+    }
+  }
+}
+
+void
+MapAnalysis::start() {
+  built = std::async(std::launch::async, [this]() {
+    Trace::set_thread_name("map analysis");
+    build();
+  }).share();
+}
+
+void
+MapAnalysis::build() {
+  PROFILE_SCOPE("ai.map_analysis.build");
+  for (unsigned int block = 0; block < regions.size(); block++) {
+    count_block(block, map->get_block_changes(block));
+  }
+  surface_cluster.assign(map->geom().tile_count(), no_cluster);
+  hills_cluster.assign(map->geom().tile_count(), no_cluster);
+  find_clusters(ClusterLand, &surface_cluster);
+  find_clusters(ClusterWater, &surface_cluster);
+  find_clusters(ClusterHills, &hills_cluster);
+  ready = true;
+}
+
+void
+MapAnalysis::wait() const {
+  if (!ready) {
+    built.wait();
+  }
+}
+
+// the change count is read before the tiles, so a change made while they
+//  are counted leaves the block to be counted again
+void
+MapAnalysis::count_block(unsigned int block, uint32_t changes) {
+  Region region = {};
+  region.changes = changes;
+  unsigned int first_col = (block % block_cols) * block_size;
+  unsigned int first_row = (block / block_cols) * block_size;
+  for (unsigned int row = first_row; row < first_row + block_size; row++) {
+    for (unsigned int col = first_col; col < first_col + block_size; col++) {
+      MapPos pos = map->pos(col, row);
+      uint16_t tile = tile_of(*map, pos);
+      tiles[pos].store(tile, std::memory_order_relaxed);
+      add_tile(&region.counts, tile);
+      if (map->is_in_water(pos)) {
+        region.water++;
+      }
+    }
+  }
+  regions[block] = region;
+  counted_changes[block].store(changes, std::memory_order_release);
+}
+
+unsigned int
+MapAnalysis::get_block(MapPos pos) const {
+  return (map->pos_row(pos) / block_size) * block_cols +
+         map->pos_col(pos) / block_size;
+}
+
+void
+MapAnalysis::refresh_block(unsigned int block) {
+  uint32_t changes = map->get_block_changes(block);
+  if (counted_changes[block].load(std::memory_order_acquire) == changes) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(regions_mutex);
+  // another AI may have counted it while this one waited
+  changes = map->get_block_changes(block);
+  if (counted_changes[block].load(std::memory_order_acquire) == changes) {
+    return;
+  }
+  count_block(block, changes);
+  recounts++;
+}
+
+void
+MapAnalysis::refresh_in(MapPos pos, int radius) {
+  wait();
+  // sampled like Map::get_changes_in, once per block width and at the far edge
+  const int step = static_cast<int>(block_size);
+  for (int y = -radius; ; y = std::min(y + step, radius)) {
+    for (int x = -radius; ; x = std::min(x + step, radius)) {
+      refresh_block(get_block(map->pos_add(pos, x, y)));
+      if (x == radius) break;
+    }
+    if (y == radius) break;
+  }
+}
+
+MapAnalysis::Counts
+MapAnalysis::count_in(MapPos pos, unsigned int tile_count, int radius) {
+  refresh_in(pos, radius);
+  Counts counts = {};
+  for (unsigned int i = 0; i < tile_count; i++) {
+    add_tile(&counts, tiles[map->pos_add_extended_spirally(pos, i)].load(
+                                                   std::memory_order_relaxed));
+  }
+  return counts;
+}
+
+MapAnalysis::Region
+MapAnalysis::get_region(unsigned int block) {
+  wait();
+  refresh_block(block);
+  std::lock_guard<std::mutex> lock(regions_mutex);
+  return regions[block];
+}
+
+void
+MapAnalysis::find_clusters(ClusterType type, std::vector<uint32_t> *cluster_of) {
+  auto in_cluster = [this, type](MapPos pos) {
+    switch (type) {
+      case ClusterLand: return !map->is_in_water(pos);
+      case ClusterWater: return map->is_in_water(pos);
+      default: return map->types_within(pos, Map::TerrainTundra0, Map::TerrainSnow0);
+    }
+  };
+  std::deque<MapPos> open;
+  for (MapPos first = 0; first < map->geom().tile_count(); first++) {
+    if ((*cluster_of)[first] != no_cluster || !in_cluster(first)) {
+      continue;
+    }
+    uint32_t index = static_cast<uint32_t>(clusters.size());
+    clusters.push_back(Cluster{ type, first, 0 });
+    (*cluster_of)[first] = index;
+    open.push_back(first);
+    while (!open.empty()) {
+      MapPos pos = open.front();
+      open.pop_front();
+      clusters[index].tiles++;
+      for (Direction dir : cycle_directions_cw()) {
+        MapPos next = map->move(pos, dir);
+        if ((*cluster_of)[next] == no_cluster && in_cluster(next)) {
+          (*cluster_of)[next] = index;
+          open.push_back(next);
+        }
+      }
+    }
+  }
+}
+
+const std::vector<MapAnalysis::Cluster> &
+MapAnalysis::get_clusters() const {
+  wait();
+  return clusters;
+}
+
+unsigned int
+MapAnalysis::get_surface_cluster(MapPos pos) const {
+  wait();
+  return surface_cluster[pos];
+}
+
+unsigned int
+MapAnalysis::get_hills_cluster(MapPos pos) const {
+  wait();
+  return hills_cluster[pos];
+}
+
+bool
+MapAnalysis::is_reachable(MapPos from, MapPos to) const {
+  wait();
+  return clusters[surface_cluster[from]].type == ClusterLand &&
+         surface_cluster[from] == surface_cluster[to];
+}
@@ -0,0 +1,135 @@
+/*
+ * ai_map_analysis.h - what is where on a map, worked out once for all AIs
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_MAP_ANALYSIS_H_
+#define SRC_AI_MAP_ANALYSIS_H_
+
+#include <atomic>        //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <future>        //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <map>
+#include <memory>
+#include <mutex>         //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/map.h"
+
+// what the AIs of a game look for on the map, worked out once on a worker
+//  thread and shared by all of them instead of each AI going over the same
+//  tiles.  There is
+//   - a word for each tile of what score_area counts on it: food, trees,
+//     stone, hills and geologist signs
+//   - the totals of those for each block of the map's change counts, the
+//     regions.  A block is counted again when its change count moves, by
+//     the first AI to look at it after that
+//   - the clusters of land, water and hills, which only depend on the
+//     terrain and so are found once.  Tiles in the same land cluster can
+//     reach each other without crossing water
+class MapAnalysis {
+ public:
+  typedef struct Counts {
+    unsigned int foods;        // open grass or water, seeds and fields
+    unsigned int trees;
+    unsigned int stones;       // by what is left of each pile
+    unsigned int hills;
+    unsigned int gold_signs;   // small sign += 1, large += 3
+    unsigned int iron_signs;
+    unsigned int coal_signs;
+    unsigned int stone_signs;
+  } Counts;
+
+  typedef struct Region {
+    Counts counts;
+    unsigned int water;        // tiles all in water
+    uint32_t changes;          // Map::get_block_changes when counted
+  } Region;
+
+  typedef enum ClusterType {
+    ClusterLand,
+    ClusterWater,
+    ClusterHills,
+  } ClusterType;
+
+  typedef struct Cluster {
+    ClusterType type;
+    MapPos pos;                // first tile of it, row by row
+    unsigned int tiles;
+  } Cluster;
+
+  static const unsigned int no_cluster = 0xffffffff;
+
+  // the bits of a tile word
+  static const uint16_t TileFood = 1 << 0;
+  static const uint16_t TileTree = 1 << 1;
+  static const uint16_t TileHill = 1 << 2;
+  static const unsigned int tile_stones_shift = 3;  // 4 bits, 0-8
+  static const unsigned int tile_sign_shift = 7;    // 2 bits, gold iron coal stone
+  static const uint16_t TileSign = 1 << 9;
+  static const uint16_t TileLargeSign = 1 << 10;
+
+ protected:
+  PMap map;
+  unsigned int block_size;
+  unsigned int block_cols;
+  std::vector<std::atomic<uint16_t>> tiles;
+  // Map::get_block_changes of each block as of when its tiles were counted,
+  //  checked without the lock so blocks that did not change cost nothing
+  std::vector<std::atomic<uint32_t>> counted_changes;
+  std::mutex regions_mutex;   // held while counting a block again
+  std::vector<Region> regions;
+  std::atomic<unsigned int> recounts;
+  // set once built
+  std::vector<Cluster> clusters;
+  std::vector<uint32_t> surface_cluster;   // land or water cluster of each tile
+  std::vector<uint32_t> hills_cluster;     // or no_cluster
+  std::shared_future<void> built;
+  std::atomic<bool> ready;
+
+  static std::mutex cache_mutex;
+  static std::map<const Map*, std::weak_ptr<MapAnalysis>> cache;
+
+ public:
+  explicit MapAnalysis(PMap map);
+  virtual ~MapAnalysis();
+
+  // the analysis of map, started on a worker thread by the first caller and
+  //  shared by the rest while any of them holds it
+  static std::shared_ptr<MapAnalysis> get(PMap map);
+
+  // what score_area counts on the tile at pos, from the map as it is now
+  static uint16_t tile_of(const Map &map, MapPos pos);
+  static void add_tile(Counts *counts, uint16_t tile);
+
+  // build() on a worker thread, get() does this
+  void start();
+  void build();
+  // the calls below wait for build() to finish
+  void wait() const;
+  bool is_ready() const { return ready; }
+
+  // the first tile_count tiles of the extended spiral around pos, all within
+  //  radius columns and rows of it.  The blocks of that square are counted
+  //  again first if they changed
+  Counts count_in(MapPos pos, unsigned int tile_count, int radius);
+  void refresh_in(MapPos pos, int radius);
+  void refresh_block(unsigned int block);
+  unsigned int get_block(MapPos pos) const;
+  unsigned int get_region_count() const {
+    return static_cast<unsigned int>(regions.size()); }
+  Region get_region(unsigned int block);
+  // blocks counted again since the analysis was built
+  unsigned int get_recount_count() const { return recounts; }
+
+  const std::vector<Cluster> &get_clusters() const;
+  unsigned int get_surface_cluster(MapPos pos) const;
+  unsigned int get_hills_cluster(MapPos pos) const;
+  // on land and in the same land cluster
+  bool is_reachable(MapPos from, MapPos to) const;
+
+ protected:
+  void count_block(unsigned int block, uint32_t changes);
+  void find_clusters(ClusterType type, std::vector<uint32_t> *cluster_of);
+};
+
+#endif  // SRC_AI_MAP_ANALYSIS_H_
@@ -8,6 +8,9 @@
  */
 #include "src/ai.h"
 
+#include <algorithm>
+#include <future>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for plot_roads
+
 #include "src/pathfinder.h"  // for original tile SearchNode
 
 class FlagSearchNode;
@@ -38,6 +41,87 @@ flagsearch_node_less(const PFlagSearchNode &left, const PFlagSearchNode &right)
 
 
 
+// walking rules for AI::plot_road.  Besides finding the direct road this
+//  records a "fake flag" split-road solution whenever the search bumps into
+//  an existing road at a spot where a new flag could be built
+class PlotRoadPolicy {
+ protected:
+  Map *map;
+  Game *game;
+  Player *player;
+  SearchArena *arena;
+  MapPos end_pos;
+  Roads *potential_roads;
+  const std::string &name;
+  Log::Logger &log;
+  const RoadClusters::Corridor *corridor;   // where the search may go, or everywhere if nullptr
+
+ public:
+  //putting this here for now
+  unsigned int max_fake_flags = 10;
+  unsigned int fake_flags_count = 0;
+  unsigned int split_road_solutions = 0;
+  unsigned int expanded = 0;   // tiles taken from the open set
+
+  PlotRoadPolicy(Map *map, Game *game, Player *player, SearchArena *arena,
+                 MapPos end_pos, Roads *potential_roads, const std::string &name,
+                 Log::Logger *log, const RoadClusters::Corridor *corridor)
+    : map(map), game(game), player(player), arena(arena), end_pos(end_pos)
+    , potential_roads(potential_roads), name(name), log(*log), corridor(corridor) {}
+
+  // oct21 2020 - use a RANDOM start direction to avoid issue where a road
+  //   is never built because of an obstacle in one major direction, but a road could have been built if
+  //   a different direction was chosen.  This means if many nearby spots are tried one should eventually succeed
+  DirectionCycle<Cycle::CW> directions() {
+    expanded++;
+    return cycle_directions_rand_cw();
+  }
+
+  unsigned int cost(MapPos pos, Direction dir) {
+    return actual_cost(map, pos, dir);
+  }
+
+  unsigned int heuristic(MapPos pos) {
+    return heuristic_cost(map, pos, end_pos);
+  }
+
+  bool passable(MapPos pos, Direction d, MapPos new_pos) {
+    if (corridor != nullptr && !corridor->contains(new_pos)) {
+      return false;
+    }
+    if (map->is_road_segment_valid(pos, d) &&
+      !(map->get_obj(new_pos) == Map::ObjectFlag && new_pos != end_pos)) {
+      // WARNING - not checking interface->building_road here, it looks to prevent road from being drawn over itself?
+      //  I did a year of AI runs without it
+      return true;
+    }
+    //
+    // if the pathfinder hits an existing road point where a flag could be built,
+    //   create a "fake flag" solution and include it as a potential road
+    //
+    if (fake_flags_count > max_fake_flags) {
+      log["plot_road"] << name << "reached max_fake_flags count " << max_fake_flags << ", not considering any more fake flag solutions";
+      return false;
+    }
+    // split road found if can build a flag, and that flag is already part of a road (meaning it has at least one path)
+    if (game->can_build_flag(new_pos, player) && map->paths(new_pos) != 0) {
+      fake_flags_count++;
+      log["plot_road"] << name << "plot_road: alternate/split_road solution found while pathfinding to " << end_pos << ", a new flag could be built at pos " << new_pos;
+      // follow the search path so far from start_pos to this node, then take the final step to new_pos
+      //  new_pos is NOT put in the open set because it isn't part of the original solution
+      Road split_flag_solution = arena->road_to(pos);
+      split_flag_solution.extend(d);
+      log["plot_road"] << name << "plot_road: inserting alternate/fake flag Road solution to PotentialRoads, new segment length would be " << split_flag_solution.get_length();
+      potential_roads->push_back(split_flag_solution);
+      split_road_solutions++;
+    }
+    // if this isn't rejected the pathfinder will think this node is valid and won't
+    //  complete the original requested solution
+    return false;
+  }
+};
+
+
 // plot a Road between two pos and return it
 //  *In addition*, while plotting that road, use any existing flags and anyplace that new flags
 //    could be built on existing roads along the way to populate a set of additional potential Roads.
@@ -45,220 +129,190 @@ flagsearch_node_less(const PFlagSearchNode &left, const PFlagSearchNode &right)
 //    will be included, but not positions that are not organically checked by the direct pathfinding logic.
 //    The set will include the original-specified-end direct Road if it is valid
 // is road_options actually used here??? or only by build_best_road??
+//
+// pathfinding direction is REVERSED from original pathfinder_map!  this function starts at the start_pos and ends at the end_pos.
+//    flipping it makes fake flag solutions easy because when a potential new flag position
+//    is found on an existing road, the search path so far can be used to reach this new flag.
 Road
-AI::plot_road(PMap map, unsigned int player_index, MapPos start_pos, MapPos end_pos, Roads * const &potential_roads) {
+AI::plot_road(PMap map, unsigned int player_index, MapPos start_pos, MapPos end_pos, Roads * const &potential_roads, SearchArena *search_arena) {
   AILogDebug["plot_road"] << name << " inside plot_road for Player" << player_index << " with start " << start_pos << ", end " << end_pos;
-  std::vector<PSearchNode> open;
-  std::list<PSearchNode> closed;
-  PSearchNode node(new SearchNode);
   // time this function for debugging
   std::clock_t start;
   double duration;
   start = std::clock();
-  //
-  // pathfinding direction is now REVERSED from original code!  this function starts at the start_pos and ends at the end_pos, originally it was the opposite.
-  //    As far as I can tell there is no downside to this, but flipping it makes fake flag solutions easy because when a potential new flag position
-  //    is found on an existing road, the search path so far can be used to reach this new flag.  If the original (backwards) method is used, the
-  //    search path "bread crumb trail" takes you back to the target_pos which isn't helpful - a path is needed between start_pos and new flag pos
-  //
-  node->pos = start_pos;
-  node->g_score = 0;
-  node->f_score = heuristic_cost(map.get(), end_pos, start_pos);
-  open.push_back(node);
-  Road direct_road;
-  bool found_direct_road = false;
-  //putting this here for now
-  unsigned int max_fake_flags = 10;
-  unsigned int fake_flags_count = 0;
-  unsigned int split_road_solutions = 0;
-
-  // this is a TILE search, finding open PATHs to build a single Road between two Flags
-  while (!open.empty()) {
-    std::pop_heap(open.begin(), open.end(), search_node_less);
-    node = open.back();
-    open.pop_back();
-    // if end_pos is reached, a Road solution is found
-    if (node->pos == end_pos) {
-      Road breadcrumb_solution;
-      breadcrumb_solution.start(end_pos);
-      // retrace the "bread crumb trail" tile by tile from end to start
-      //   this creates a Road with 'source' of end_pos and 'last' of start_pos
-      //     which is backwards from the direction the pathfinding ran
-      while (node->parent) {
-        // if ai_overlay is on, ai_mark_road will show the road being traced backwards from end_pos to start_pos
-        Direction dir = node->dir;
-        breadcrumb_solution.extend(reverse_direction(dir));
-        //ai_mark_road->extend(reverse_direction(dir));
-        //ai_mark_pos.insert(ColorDot(node->pos, "black"));
-        std::this_thread::sleep_for(std::chrono::milliseconds(0));
-        node = node->parent;
-      }
-      unsigned int new_length = static_cast<unsigned int>(breadcrumb_solution.get_length());
-      AILogDebug["plot_road"] << name << "plot_road: solution found, new segment length is " << breadcrumb_solution.get_length();
-      // now inverse the entire road so that it stats at start_pos and ends at end_pos, so the Road object is logical instead of backwards
-      Road solution = reverse_road(map, breadcrumb_solution);
-      // copy the solution to Road direct_road to be returned.  This isn't necessary but seems clearer,
-      //   could just return 'solution' and move its declaration to the start of the function
-      direct_road = solution;
-      found_direct_road = true;
-      break;
-    }
-
-    // otherwise, close this node and continue
-    closed.push_front(node);
-    // consider each direction for extending road
-    // oct21 2020 - changing to this use RANDOM start direction to avoid issue where a road
-    //   is never built because of an obstacle in one major direction, but a road could have been built if
-    //   a different direction was chosen.  This means if many nearby spots are tried one should eventually succeed
-    //for (Direction d : cycle_directions_cw()) {
-    for (Direction d : cycle_directions_rand_cw()) {
-      MapPos new_pos = map->move(node->pos, d);
-      unsigned int cost = actual_cost(map.get(), node->pos, d);
-      //ai_mark_road->extend(d);
-      //ai_mark_pos.insert(ColorDot(new_pos, "blue"));
-      //std::this_thread::sleep_for(std::chrono::milliseconds(10));
-      // Check if neighbour is valid
-      if (!map->is_road_segment_valid(node->pos, d) ||
-        (map->get_obj(new_pos) == Map::ObjectFlag && new_pos != end_pos)) {
-        //(avoid_castle && AI::is_near_castle(game, new_pos))) {
-        //
-        // if the pathfinder hits an existing road point where a flag could be built,
-        //   create a "fake flag" solution and include it as a potential road
-        //
-        if (fake_flags_count > max_fake_flags) {
-          AILogDebug["plot_road"] << name << "reached max_fake_flags count " << max_fake_flags << ", not considering any more fake flag solutions";
-          continue;
-        }
-        // split road found if can build a flag, and that flag is already part of a road (meaning it has at least one path)
-        if (game->can_build_flag(new_pos, player) &&
-          (map->has_path(new_pos, Direction(0)) || map->has_path(new_pos, Direction(1)) || map->has_path(new_pos, Direction(2)) ||
-            map->has_path(new_pos, Direction(3)) || map->has_path(new_pos, Direction(4)) || map->has_path(new_pos, Direction(5)))) {
-          fake_flags_count++;
-          AILogDebug["plot_road"] << name << "plot_road: alternate/split_road solution found while pathfinding to " << end_pos << ", a new flag could be built at pos " << new_pos;
-          // retrace the "bread crumb trail" tile by tile from end to start
-          //   this creates a Road with 'source' of end_pos and 'last' of start_pos
-          //     which is backwards from the direction the pathfinding ran
-
-          // we still have to create a new node for the final step or the retrace won't work right
-          PSearchNode split_flag_node(new SearchNode);
-          split_flag_node->pos = new_pos;
-          // these don't matter for this stub node
-          //split_flag_node->g_score = node->g_score + cost;
-          //split_flag_node->f_score = split_flag_node->g_score +
-          //  heuristic_cost(map.get(), new_pos, end_pos);
-          split_flag_node->parent = node;
-          split_flag_node->dir = d;
-          // and DON'T put it on any lists becase it isn't part of the original solution, it will get marked as in closed later
-          //open.push_back(new_node);
-          //std::push_heap(open.begin(), open.end(), search_node_less);
-
-          // store the current node so it can be restored after this part is done
-          PSearchNode orig_node = node;
-
-          // start the road at new_pos (where potential flag could be built), and follow the 'node' path back to start_pos
-          Road split_flag_breadcrumb_solution;
-          split_flag_breadcrumb_solution.start(split_flag_node->pos);   // same as new_pos
-
-          while (split_flag_node->parent) {
-            // if ai_overlay is on, ai_mark_road will show the road being traced backwards from end_pos to start_pos
-            Direction dir = split_flag_node->dir;
-            split_flag_breadcrumb_solution.extend(reverse_direction(dir));
-            //ai_mark_road->extend(reverse_direction(dir));
-            //ai_mark_pos.insert(ColorDot(node->pos, "black"));
-            //std::this_thread::sleep_for(std::chrono::milliseconds(0));
-            split_flag_node = split_flag_node->parent;
-          }
-          // restore original node so search can resume
-          node = orig_node;
-          unsigned int new_length = static_cast<unsigned int>(split_flag_breadcrumb_solution.get_length());
-          AILogDebug["plot_road"] << name << "plot_road: split_flag_breadcrumb_solution found, new segment length is " << split_flag_breadcrumb_solution.get_length();
-          // now inverse the entire road so that it stats at start_pos and ends at end_pos, so the Road object is logical instead of backwards
-          Road split_flag_solution = reverse_road(map, split_flag_breadcrumb_solution);
-          AILogDebug["plot_road"] << name << "plot_road: inserting alternate/fake flag Road solution to PotentialRoads, new segment length would be " << split_flag_solution.get_length();
-          potential_roads->push_back(split_flag_solution);
-          split_road_solutions++;
-        }
-        // if we don't 'continue' here, the pathfinder will think this node is valid and won't
-        //  complete the original requested solution
-        continue;
-      }
-
-      // WARNING - commenting this out to break dependency on interface->building_road
-      //   it looks to prevent road from being drawn over itself?
-      //  find a way to implement this that doesn't depend on interface->building_road?
-      ///  maybe it doesn't matter after all?  I did a year of AI runs without it
-      //if ((building_road != nullptr) && building_road->has_pos(map, new_pos) &&
-      //    (new_pos != end) && (new_pos != start)) {
-      //  continue;
-      //}
-
-      /* Check if neighbour is in closed list. */
-      bool in_closed = false;
-      for (PSearchNode closed_node : closed) {
-        if (closed_node->pos == new_pos) {
-          in_closed = true;
-          //ai_mark_pos.erase(new_pos);
-          //ai_mark_pos.insert(ColorDot(new_pos, "magenta"));
-          //std::this_thread::sleep_for(std::chrono::milliseconds(0));
-          break;
-        }
-      }
-      //ai_mark_pos.erase(new_pos);
-      //ai_mark_pos.insert(ColorDot(new_pos, "green"));
-      //std::this_thread::sleep_for(std::chrono::milliseconds(0));
-
-      if (in_closed) continue;
-
-      /* See if neighbour is already in open list. */
-      bool in_open = false;
-      for (std::vector<PSearchNode>::iterator it = open.begin();
-        it != open.end(); ++it) {
-        PSearchNode n = *it;
-        if (n->pos == new_pos) {
-          in_open = true;
-          //ai_mark_pos.erase(new_pos);
-          //ai_mark_pos.insert(ColorDot(new_pos, "seafoam"));
-          if (n->g_score >= node->g_score + cost) {
-            n->g_score = node->g_score + cost;
-            n->f_score = n->g_score + heuristic_cost(map.get(), new_pos, end_pos);
-            n->parent = node;
-            n->dir = d;
-
-            // Move element to the back and heapify
-            iter_swap(it, open.rbegin());
-            std::make_heap(open.begin(), open.end(), search_node_less);
-          }
-          break;
-        }
-      }
-
-      /* If not found in the open set, create a new node. */
-      if (!in_open) {
-        PSearchNode new_node(new SearchNode);
 
-        new_node->pos = new_pos;
-        new_node->g_score = node->g_score + cost;
-        new_node->f_score = new_node->g_score +
-          heuristic_cost(map.get(), new_pos, end_pos);
-        new_node->parent = node;
-        new_node->dir = d;
+  stats.count(AIStats::PlotRoadCalls);
+  RoadPlot cached;
+  if (get_cached_road_plot(map, start_pos, end_pos, &cached)) {
+    AILogDebug["plot_road"] << name << "plot_road: nothing changed along the road plotted before from " << start_pos << " to " << end_pos << ", reusing it";
+    potential_roads->insert(potential_roads->end(), cached.split_roads.begin(), cached.split_roads.end());
+    return cached.road;
+  }
+  size_t first_split_road = potential_roads->size();
+  // the search runs on the live map without the game lock, a change made while it
+  //  runs would be stamped as if the road had been plotted with it
+  uint32_t changes_before = map->get_changes();
+
+  // a long road is planned over clusters of tiles first (hierarchical A*), and the
+  //  tile search below then kept to the clusters it goes through and those around them.
+  //  Short roads, and long ones the clusters see no way for, are searched for everywhere
+  RoadClusters::Corridor corridor;
+  bool in_corridor = false;
+  {
+    std::lock_guard<std::mutex> lock(road_clusters_mutex);
+    in_corridor = road_clusters.find_corridor(map.get(), start_pos, end_pos, &corridor);
+  }
+  if (in_corridor) {
+    stats.count(AIStats::PlotRoadCorridors);
+    AILogDebug["plot_road"] << name << "plot_road: searching a corridor of " << corridor.get_cluster_count() << " road clusters from " << start_pos << " to " << end_pos;
+  }
 
-        open.push_back(new_node);
-        std::push_heap(open.begin(), open.end(), search_node_less);
-      }
-    } // foreach direction
-  } // while nodes left to search
+  // this is a TILE search, finding open PATHs to build a single Road between two Flags
+  //  it runs on the same A* core as pathfinder_map, in the arena plot_roads gave it or this thread's own
+  SearchArena &arena = (search_arena != nullptr) ? *search_arena : SearchArena::get_for(map.get());
+  arena.resize(map->geom().tile_count());
+  PlotRoadPolicy policy(map.get(), game.get(), player, &arena, end_pos, potential_roads, name, &AILogDebug,
+                        in_corridor ? &corridor : nullptr);
+  Road direct_road;
+  bool found_direct_road = search_map_tiles(map.get(), &arena, start_pos, end_pos, &policy);
+  stats.count(AIStats::PlotRoadNodes, policy.expanded);
+  unsigned int split_road_solutions = policy.split_road_solutions;
+  if (!found_direct_road && in_corridor) {
+    // the map changed since the clusters were looked at, or the corridor was too tight
+    AILogDebug["plot_road"] << name << "plot_road: no road in the corridor from " << start_pos << " to " << end_pos << ", searching everywhere";
+    stats.count(AIStats::PlotRoadCorridorMisses);
+    potential_roads->resize(first_split_road);
+    PlotRoadPolicy everywhere(map.get(), game.get(), player, &arena, end_pos, potential_roads, name, &AILogDebug, nullptr);
+    found_direct_road = search_map_tiles(map.get(), &arena, start_pos, end_pos, &everywhere);
+    stats.count(AIStats::PlotRoadNodes, everywhere.expanded);
+    split_road_solutions = everywhere.split_road_solutions;
+  }
+  if (found_direct_road) {
+    direct_road = arena.road_to(end_pos);
+    AILogDebug["plot_road"] << name << "plot_road: solution found, new segment length is " << direct_road.get_length();
+  }
 
   AILogDebug["plot_road"] << name << "done plot_road, found_direct_road: " << std::to_string(found_direct_road) << ".  additional potential_roads (split_roads): " << split_road_solutions;
   if (direct_road.get_source() == bad_map_pos) {
     AILogDebug["plot_road"] << name << "NO DIRECT SOLUTION FOUND for start_pos " << start_pos << " to end_pos " << end_pos;
   }
+  else {
+    // a failed search may have been stopped by anything it looked at, so only roads are kept
+    cached.road = direct_road;
+    cached.split_roads.assign(potential_roads->begin() + first_split_road, potential_roads->end());
+    cache_road_plot(map, start_pos, end_pos, changes_before, &cached);
+  }
   duration = (std::clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
   AILogDebug["plot_road"] << name << " plot road call took " << duration;
   return direct_road;
 }
 
 
+Road
+AI::plot_road_uncached(MapPos start_pos, MapPos end_pos, Roads *potential_roads) {
+  {
+    std::lock_guard<std::mutex> lock(road_plot_cache_mutex);
+    road_plot_cache.clear();
+  }
+  return plot_road(map, player_index, start_pos, end_pos, potential_roads);
+}
+
+// note Map::get_changes_near for every third tile of road.  That covers every
+//  tile of the road and the ones next to it, any change to those changes a stamp
+static void
+add_road_stamps(Map *map, const Road &road, std::vector<std::pair<MapPos, uint32_t>> *stamps) {
+  MapPos pos = road.get_source();
+  unsigned int step = 0;
+  for (Direction dir : road.get_dirs()) {
+    if (step++ % 3 == 0) {
+      stamps->push_back(std::make_pair(pos, map->get_changes_near(pos)));
+    }
+    pos = map->move(pos, dir);
+  }
+  stamps->push_back(std::make_pair(pos, map->get_changes_near(pos)));
+}
+
+// a plotted road is reused for as long as nothing changes on or next to it or
+//  its split roads.  A shorter road might have opened up elsewhere in the meantime,
+//  so entries are also dropped after road_plot_cache_loops AI loops
+bool
+AI::get_cached_road_plot(PMap map, MapPos start_pos, MapPos end_pos, RoadPlot *plot) {
+  std::lock_guard<std::mutex> lock(road_plot_cache_mutex);
+  std::map<std::pair<MapPos, MapPos>, RoadPlot>::iterator it = road_plot_cache.find(std::make_pair(start_pos, end_pos));
+  if (it == road_plot_cache.end()) {
+    stats.count(AIStats::RoadPlotCacheMisses);
+    return false;
+  }
+  bool current = (loop_count < it->second.loop + road_plot_cache_loops);
+  for (size_t i = 0; current && i < it->second.stamps.size(); i++) {
+    current = (map->get_changes_near(it->second.stamps[i].first) == it->second.stamps[i].second);
+  }
+  if (!current) {
+    road_plot_cache.erase(it);
+    stats.count(AIStats::RoadPlotCacheMisses);
+    return false;
+  }
+  *plot = it->second;
+  stats.count(AIStats::RoadPlotCacheHits);
+  return true;
+}
+
+// changes_before is Map::get_changes from before the search.  If anything changed
+//  since, up to when the stamps are taken, the plot is not cached
+void
+AI::cache_road_plot(PMap map, MapPos start_pos, MapPos end_pos, uint32_t changes_before, RoadPlot *plot) {
+  plot->loop = loop_count;
+  plot->stamps.clear();
+  add_road_stamps(map.get(), plot->road, &plot->stamps);
+  for (const Road &split_road : plot->split_roads) {
+    add_road_stamps(map.get(), split_road, &plot->stamps);
+  }
+  if (map->get_changes() != changes_before) {
+    AILogDebug["plot_road"] << name << "plot_road: the map changed while plotting from " << start_pos << " to " << end_pos << ", not caching it";
+    stats.count(AIStats::RoadPlotsNotCached);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(road_plot_cache_mutex);
+  if (road_plot_cache.size() >= road_plot_cache_max) {
+    road_plot_cache.clear();
+  }
+  road_plot_cache[std::make_pair(start_pos, end_pos)] = *plot;
+}
+
+
+// plot_road from start to each of the ends at once, on up to one thread per core.
+//  The searches only read the map and each thread has its own SearchArena, so they
+//  don't get in each other's way.  roads[i] and potential_roads[i] are what plot_road
+//  returns for ends[i], whichever thread ran it, so callers see the same results
+//  in the same order as calling plot_road for each end in turn
+void
+AI::plot_roads(PMap map, unsigned int player_index, MapPos start_pos, const MapPosVector &ends, std::vector<Road> *roads, std::vector<Roads> *potential_roads) {
+  roads->assign(ends.size(), Road());
+  potential_roads->assign(ends.size(), Roads());
+  size_t threads = std::min(static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency())), ends.size());
+  AILogDebug["plot_roads"] << name << " plotting " << ends.size() << " roads from start_pos " << start_pos << " on " << threads << " threads";
+  // the threads are new each call, the arenas are not.  A new thread's own arena
+  //  would be allocated and zeroed for the whole map every time
+  while (road_arenas.size() < threads) {
+    road_arenas.emplace_back(new SearchArena());
+  }
+  std::vector<std::future<void>> workers;
+  for (size_t first = 1; first < threads; first++) {
+    workers.push_back(std::async(std::launch::async, [&, first]() {
+      for (size_t i = first; i < ends.size(); i += threads) {
+        (*roads)[i] = plot_road(map, player_index, start_pos, ends[i], &(*potential_roads)[i], road_arenas[first].get());
+      }
+    }));
+  }
+  for (size_t i = 0; i < ends.size(); i += threads) {
+    (*roads)[i] = plot_road(map, player_index, start_pos, ends[i], &(*potential_roads)[i], road_arenas[0].get());
+  }
+  for (std::future<void> &worker : workers) {
+    worker.get();
+  }
+}
+
+
 // count how many tiles apart two MapPos are
 int
 AI::get_straightline_tile_dist(PMap map, MapPos start_pos, MapPos end_pos) {
@@ -283,7 +337,7 @@ AI::get_straightline_tile_dist(PMap map, MapPos start_pos, MapPos end_pos) {
 // this function will accept "fake flags" / splitting-flags that do not actually exist
 //  and score them based on the best score of their adjacent flags
 bool
-AI::score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions road_options, MapPos flag_pos, MapPos castle_flag_pos, ColorDotMap *ai_mark_pos) {
+AI::score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions road_options, MapPos flag_pos, MapPos castle_flag_pos) {
   AILogDebug["score_flag"] << name << " inside score_flag";
   MapPos target_pos = rb->get_target_pos();
   AILogDebug["score_flag"] << name << " preparing to score_flag for Player" << player_index << " for flag at flag_pos " << flag_pos << " to target_pos " << target_pos;
@@ -320,7 +374,7 @@ AI::score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions
       // go score the adjacent flags if they aren't already known (sometimes they will already have been checked)
       if (!rb->has_score(adjacent_flag_pos)) {
         AILogDebug["score_flag"] << name << "score_flag, rb doesn't have score yet for adjacent flag_pos " << adjacent_flag_pos << ", will try to score it";
-        if (find_flag_and_tile_dist(map, player_index, rb, adjacent_flag_pos, castle_flag_pos, ai_mark_pos)) {
+        if (find_flag_and_tile_dist(map, rb, adjacent_flag_pos, castle_flag_pos)) {
           AILogDebug["score_flag"] << name << "score_flag, splitting_flag find_flag_and_tile_dist() returend true from flag_pos " << adjacent_flag_pos << " to target_pos " << target_pos;
         }
         else{
@@ -328,7 +382,7 @@ AI::score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions
           // if not found just let rb->get_score call fail and it wlil use the default bad_scores given.
           AILogDebug["score_flag"] << name << "score_flag returned false for adjacent flag at pos " << adjacent_flag_pos;
           AILogDebug["score_flag"] << name << "for now, leaving default bogus super-high score for adjacent flag";
-          std::this_thread::sleep_for(std::chrono::milliseconds(0));
+          checkpoint();
         }
       }
       FlagScore score = rb->get_score(adjacent_flag_pos);
@@ -366,8 +420,8 @@ AI::score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions
     //     ??  need to add penalties??
     AILogDebug["score_flag"] << name << "score_flag, flag_pos *IS* target_pos, setting values 0,0";
     //ai_mark_pos->erase(flag_pos);
-    //ai_mark_pos->insert(ColorDot(flag_pos, "coral"));
-    std::this_thread::sleep_for(std::chrono::milliseconds(0));
+    //ai_mark_pos->insert(ColorDot(flag_pos, MarkCoral));
+    checkpoint();
     // note that this blindly ignores if castle flag / area part of solution, FIX!
     rb->set_score(flag_pos, 0, 0, false);
     AILogDebug["score_flag"] << name << "score_flag, flag_pos *IS* target_pos, returning true";
@@ -375,7 +429,7 @@ AI::score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions
   }
 
   // handle most common case, regular scoring
-  if (!find_flag_and_tile_dist(map, player_index, rb, flag_pos, castle_flag_pos, ai_mark_pos)) {
+  if (!find_flag_and_tile_dist(map, rb, flag_pos, castle_flag_pos)) {
     AILogDebug["score_flag"] << name << "score_flag, find_flag_and_tile_dist() returned false, cannot find flag-path solution from flag_pos " << flag_pos << " to target_pos " << target_pos << ".  Returning false";
     return false;
   }
@@ -398,8 +452,8 @@ AI::score_flag(PMap map, unsigned int player_index, RoadBuilder *rb, RoadOptions
 RoadEnds
 AI::get_roadends(PMap map, Road road) {
   AILogDebug["get_roadends"] << name << "inside get_roadends";
-  std::list<Direction> dirs = road.get_dirs();
-  std::list<Direction>::iterator i;
+  const Road::Dirs &dirs = road.get_dirs();
+  Road::Dirs::const_iterator i;
   for (i = dirs.begin(); i != dirs.end(); i++) {
     Direction dir = *i;
     AILogVerbose["get_roadends"] << name << "get_roadends - Direction " << dir << " / " << NameDirection[dir];
@@ -421,8 +475,8 @@ AI::reverse_road(PMap map, Road road) {
   AILogDebug["reverse_road"] << name << "inside reverse_road, for a road with source " << road.get_source() << ", end " << road.get_end(map.get()) << ", and length " << road.get_length();
   Road reversed_road;
   reversed_road.start(road.get_end(map.get()));
-  std::list<Direction> dirs = road.get_dirs();
-  std::list<Direction>::reverse_iterator r;
+  const Road::Dirs &dirs = road.get_dirs();
+  Road::Dirs::const_reverse_iterator r;
   for (r = dirs.rbegin(); r != dirs.rend(); r++) {
     reversed_road.extend(reverse_direction(*r));
   }
@@ -431,21 +485,53 @@ AI::reverse_road(PMap map, Road road) {
 }
 
 
+// the road distances from every stock, made again on a new loop or once the roads have
+//  changed.  Flags connected since then are not in it and are searched for as before
+const FlagDists &
+AI::get_flag_dists() {
+  unsigned int changes = game->get_snapshot()->get_flag_graph_changes();
+  if (flag_dists_loop != loop_count || flag_dists_changes != changes) {
+    AILogDebug["get_flag_dists"] << name << " building road distances from " << stocks_pos.size() << " stocks";
+    flag_dists.build(*map, stocks_pos, AI::castle_flag_pos);
+    flag_dists_loop = loop_count;
+    flag_dists_changes = changes;
+  }
+  return flag_dists;
+}
+
 // perform FlagSearch to find best flag-path from flag_pos to target_pos and determine tile path along the way.
 // return true if solution found, false if not
 //  this function will NOT work for fake flags / splitting flags
 bool
-AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb, MapPos flag_pos, MapPos castle_flag_pos, ColorDotMap *ai_mark_pos) {
+AI::find_flag_and_tile_dist(PMap map, RoadBuilder *rb, MapPos flag_pos, MapPos castle_flag_pos) {
   AILogDebug["find_flag_and_tile_dist"] << name << " inside find_flag_and_tile_dist";
   MapPos target_pos = rb->get_target_pos();
   AILogDebug["find_flag_and_tile_dist"] << name << " preparing to find_flag_and_tile_dist from flag at flag_pos " << flag_pos << " to target_pos " << target_pos;
 
+  // a stock as target is looked up.  Some callers pass the target as castle_flag_pos,
+  //  it is never counted as on the way to itself
+  const FlagDists &dists = get_flag_dists();
+  FlagDists::Dist dist;
+  if ((castle_flag_pos == dists.get_castle_flag_pos() || castle_flag_pos == target_pos) &&
+      dists.get(*map, target_pos, flag_pos, &dist)) {
+    bool contains_castle_flag = (castle_flag_pos != target_pos) && dist.contains_castle_flag;
+    AILogDebug["find_flag_and_tile_dist"] << name << " flag_pos " << flag_pos << " is flag_dist " << dist.flag_dist << ", tile_dist " << dist.tile_dist << " from stock at target_pos " << target_pos;
+    rb->set_score(flag_pos, dist.flag_dist, dist.tile_dist, contains_castle_flag);
+    stats.count(AIStats::FlagDistsHits);
+    return true;
+  }
+  stats.count(AIStats::FlagDistsMisses);
+
   //ai_mark_pos->erase(flag_pos);
-  //ai_mark_pos->insert(ColorDot(flag_pos, "dk_blue"));
-  std::this_thread::sleep_for(std::chrono::milliseconds(0));
-  std::vector<PFlagSearchNode> open;
-  std::list<PFlagSearchNode> closed;
-  PFlagSearchNode fnode(new FlagSearchNode);
+  //ai_mark_pos->insert(ColorDot(flag_pos, MarkDkBlue));
+  checkpoint();
+  // the nodes and lists are gone when this returns, so what they took from the
+  //  loop arena is given back then too
+  AIArena::Scope arena_scope(&loop_arena);
+  AIArenaAllocator<FlagSearchNode> node_allocator(&loop_arena);
+  ArenaVector<PFlagSearchNode> open(node_allocator);
+  ArenaList<PFlagSearchNode> closed(node_allocator);
+  PFlagSearchNode fnode = std::allocate_shared<FlagSearchNode>(node_allocator);
 
   fnode->pos = flag_pos;
 
@@ -462,8 +548,8 @@ AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb
     AILogVerbose["find_flag_and_tile_dist"] << name << "fsearchnode - inside fnode search for flag_pos " << flag_pos << ", inside while-open-list-not-empty loop";
     if (fnode->pos == target_pos) {
       //ai_mark_pos->erase(fnode->pos);
-      //ai_mark_pos->insert(ColorDot(fnode->pos, "cyan"));
-      std::this_thread::sleep_for(std::chrono::milliseconds(0));
+      //ai_mark_pos->insert(ColorDot(fnode->pos, MarkCyan));
+      checkpoint();
       //
       // target_pos flag reached!
       //
@@ -487,8 +573,6 @@ AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb
         //MapPos end2 = fnode->pos;
         MapPos end2 = bad_map_pos;
         Direction dir1 = fnode->parent->dir;
-        // Direction dir2 =  complicated: see below...
-        Direction dir2 = DirectionNone;
 
         // unless Road is already known inside RoadBuilder
         //   build Road object by tracing paths between flags
@@ -550,15 +634,15 @@ AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb
     for (Direction d : cycle_directions_cw()) {
       if (map->has_path(fnode->pos, d)) {
         //ai_mark_pos->erase(map->move(fnode->pos, d));
-        //ai_mark_pos->insert(ColorDot(map->move(fnode->pos, d), "gray"));
-        std::this_thread::sleep_for(std::chrono::milliseconds(0));
+        //ai_mark_pos->insert(ColorDot(map->move(fnode->pos, d), MarkGray));
+        checkpoint();
         // NOTE - if the solution is found here... can't we just quit and return it rather than continuing with this node?  there can't be a better one, right?
 
         Road fsearch_road = trace_existing_road(map, fnode->pos, d);
         MapPos new_pos = fsearch_road.get_end(map.get());
         //ai_mark_pos->erase(new_pos);
-        //ai_mark_pos->insert(ColorDot(new_pos, "dk_gray"));
-        std::this_thread::sleep_for(std::chrono::milliseconds(0));
+        //ai_mark_pos->insert(ColorDot(new_pos, MarkDkGray));
+        checkpoint();
         //Direction end_dir = reverse_direction(fsearch_road.get_last());
         AILogVerbose["find_flag_and_tile_dist"] << name << "fsearchnode - fsearch from fnode->pos " << fnode->pos << " and dir " << NameDirection[d] << name << " found flag at pos " << new_pos << " with return dir " << reverse_direction(fsearch_road.get_last());
 
@@ -570,8 +654,8 @@ AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb
           //AILogVerbose["find_flag_and_tile_dist"] << name << "fsearchnode - fnode at new_pos " << new_pos << " *IS* target_pos " << target_pos << ", breaking early";
           AILogVerbose["find_flag_and_tile_dist"] << name << "fsearchnode - fnode at new_pos " << new_pos << " *IS* target_pos " << target_pos << ", FYI only, NOT breaking early (debug)";
           //ai_mark_pos->erase(new_pos);
-          //ai_mark_pos->insert(ColorDot(new_pos, "green"));
-          std::this_thread::sleep_for(std::chrono::milliseconds(0));
+          //ai_mark_pos->insert(ColorDot(new_pos, MarkGreen));
+          checkpoint();
           /*  trying this.. commenting this out and letting it flow to new node as usual
           PFlagSearchNode new_fnode(new FlagSearchNode);
           new_fnode->pos = new_pos;
@@ -593,8 +677,8 @@ AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb
             in_closed = true;
             AILogVerbose["find_flag_and_tile_dist"] << name << "fsearchnode - fnode at new_pos " << new_pos << ", breaking because in fnode already in_closed";
             //ai_mark_pos->erase(new_pos);
-            //ai_mark_pos->insert(ColorDot(flag_pos, "dk_red"));
-            std::this_thread::sleep_for(std::chrono::milliseconds(0));
+            //ai_mark_pos->insert(ColorDot(flag_pos, MarkDkRed));
+            checkpoint();
             break;
           }
         }
@@ -604,7 +688,7 @@ AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb
 
         // check if this flag is already in open list
         bool in_open = false;
-        for (std::vector<PFlagSearchNode>::iterator it = open.begin();
+        for (ArenaVector<PFlagSearchNode>::iterator it = open.begin();
           it != open.end(); ++it) {
           PFlagSearchNode n = *it;
           if (n->pos == new_pos) {
@@ -618,8 +702,8 @@ AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb
               std::make_heap(open.begin(), open.end(), flagsearch_node_less);
             }
             //ai_mark_pos->erase(new_pos);
-            //ai_mark_pos->insert(ColorDot(new_pos, "dk_green"));
-            std::this_thread::sleep_for(std::chrono::milliseconds(0));
+            //ai_mark_pos->insert(ColorDot(new_pos, MarkDkGreen));
+            checkpoint();
             break;  // should this be continue like if (in_closed) ???  NO, because it means we've checked every direction ... right?
           }
         }
@@ -627,9 +711,9 @@ AI::find_flag_and_tile_dist(PMap map, unsigned int player_index, RoadBuilder *rb
         if (!in_open) {
           AILogVerbose["find_flag_and_tile_dist"] << name << "fnodesearch - fnode at new_pos " << new_pos << " is NOT already in_open, creating a new fnode ";
           //ai_mark_pos->erase(new_pos);
-          //ai_mark_pos->insert(ColorDot(new_pos, "lt_green"));
-          std::this_thread::sleep_for(std::chrono::milliseconds(0));
-          PFlagSearchNode new_fnode(new FlagSearchNode);
+          //ai_mark_pos->insert(ColorDot(new_pos, MarkLtGreen));
+          checkpoint();
+          PFlagSearchNode new_fnode = std::allocate_shared<FlagSearchNode>(node_allocator);
           new_fnode->pos = new_pos;
           new_fnode->parent = fnode;
           new_fnode->flag_dist = new_fnode->parent->flag_dist + 1;
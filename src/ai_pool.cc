@@ -0,0 +1,98 @@
+/*
+ * ai_pool.cc - shared worker threads that run the AI players
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_pool.h"
+
+#include <string>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <utility>
+
+#include "src/ai.h"
+#include "src/thread-policy.h"
+#include "src/trace.h"
+
+AIPool::AIPool() {
+  worker_count = 0;
+  max_workers = std::thread::hardware_concurrency();
+  if (max_workers == 0) {
+    max_workers = 1;
+  }
+}
+
+// the pool lives until the process exits, the workers are detached and are
+//  torn down with it
+AIPool &
+AIPool::get_instance() {
+  static AIPool *pool = new AIPool();
+  return *pool;
+}
+
+void
+AIPool::add(AI *ai) {
+  std::lock_guard<std::mutex> lock(mutex);
+  queue.insert(std::make_pair(Clock::now(), ai));
+  if (worker_count < max_workers && worker_count < queue.size()) {
+    worker_count++;
+    std::thread worker(&AIPool::run_worker, this);
+    worker.detach();
+  }
+  due_changed.notify_one();
+}
+
+unsigned int
+AIPool::get_worker_count() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return worker_count;
+}
+
+bool
+AIPool::has(const AI *ai) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (stepping.count(ai) > 0) {
+    return true;
+  }
+  for (const std::pair<const Clock::time_point, AI*> &entry : queue) {
+    if (entry.second == ai) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+AIPool::run_worker() {
+  std::unique_lock<std::mutex> lock(mutex);
+  Trace::set_thread_name("ai worker " + std::to_string(worker_count));
+  ThreadPolicy::apply(ThreadPolicy::RoleAI);
+  while (true) {
+    if (queue.empty()) {
+      due_changed.wait(lock);
+      continue;
+    }
+    Clock::time_point due = queue.begin()->first;
+    if (Clock::now() < due) {
+      due_changed.wait_until(lock, due);
+      continue;
+    }
+    AI *ai = queue.begin()->second;
+    queue.erase(queue.begin());
+    stepping.insert(ai);
+    Trace::counter("ai.queued", queue.size());
+
+    lock.unlock();
+    unsigned int wait_ms = 0;
+    bool keep = ai->step(&wait_ms);
+    lock.lock();
+    stepping.erase(ai);
+
+    // an AI that has stopped is dropped, its object is left as it was
+    //  when it ran on its own thread
+    if (keep) {
+      queue.insert(std::make_pair(Clock::now() +
+                                  std::chrono::milliseconds(wait_ms), ai));
+      due_changed.notify_one();
+    }
+  }
+}
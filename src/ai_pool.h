@@ -0,0 +1,49 @@
+/*
+ * ai_pool.h - shared worker threads that run the AI players
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_POOL_H_
+#define SRC_AI_POOL_H_
+
+#include <chrono>               //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <condition_variable>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <map>
+#include <set>
+#include <mutex>                //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+class AI;
+
+// One set of worker threads, sized to the core count, runs every AI player
+//  of every game in the process.  Each AI is queued with the time its next
+//  step is due; a free worker takes the earliest due AI, runs one step and
+//  queues it again with the wait that step asked for.  An AI is only ever
+//  queued once, so its steps never overlap and all of its state stays
+//  with that one AI object, whichever worker runs it
+class AIPool {
+ protected:
+  typedef std::chrono::steady_clock Clock;
+
+  std::mutex mutex;
+  std::condition_variable due_changed;
+  std::multimap<Clock::time_point, AI*> queue;
+  std::set<const AI*> stepping;  // taken off the queue by a worker
+  unsigned int worker_count;
+  unsigned int max_workers;
+
+  AIPool();
+  void run_worker();
+
+ public:
+  static AIPool &get_instance();
+
+  // queue a new AI, its first step runs right away.  A worker is started
+  //  for each AI until there are as many workers as cores
+  void add(AI *ai);
+  unsigned int get_worker_count();
+  // whether ai is queued or in a step.  Once it has stopped and this is
+  //  false no worker touches it again, so it can be deleted
+  bool has(const AI *ai);
+};
+
+#endif  // SRC_AI_POOL_H_
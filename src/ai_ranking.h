@@ -0,0 +1,70 @@
+/*
+ * ai_ranking.h - scored map positions for the AI to try best first
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_RANKING_H_
+#define SRC_AI_RANKING_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "src/map.h"
+
+// positions with a score each, filled in like a MapPosSet but kept in a flat
+//  vector, so adding a candidate doesn't allocate a tree node and clear() keeps
+//  the storage for the next round.  best_first / lowest_first sort only as many
+//  entries as are asked for.  Entries added twice with the same score are
+//  only returned once, as a MapPosSet would
+class MapPosRanking {
+ public:
+  typedef std::pair<MapPos, unsigned int> Entry;
+  typedef std::vector<Entry>::const_iterator const_iterator;
+
+ protected:
+  std::vector<Entry> entries;
+
+  // highest score first, lower pos first among equal scores
+  static bool higher(const Entry &a, const Entry &b) {
+    return (a.second != b.second) ? (a.second > b.second) : (a.first < b.first);
+  }
+  // lowest score first, higher pos first among equal scores
+  static bool lower(const Entry &a, const Entry &b) {
+    return (a.second != b.second) ? (a.second < b.second) : (a.first > b.first);
+  }
+
+  template <class Compare>
+  std::vector<MapPos> ranked(size_t count, Compare compare) const {
+    std::vector<Entry> sorted(entries);
+    count = std::min(count, sorted.size());
+    std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end(), compare);
+    std::vector<MapPos> positions;
+    positions.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      if (i > 0 && sorted[i] == sorted[i - 1]) {
+        continue;
+      }
+      positions.push_back(sorted[i].first);
+    }
+    return positions;
+  }
+
+ public:
+  void insert(const Entry &entry) { entries.push_back(entry); }
+  void clear() { entries.clear(); }
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+  const_iterator begin() const { return entries.begin(); }
+  const_iterator end() const { return entries.end(); }
+
+  // positions of the 'count' highest (or lowest) scores, in that order
+  std::vector<MapPos> best_first(size_t count = static_cast<size_t>(-1)) const {
+    return ranked(count, higher);
+  }
+  std::vector<MapPos> lowest_first(size_t count = static_cast<size_t>(-1)) const {
+    return ranked(count, lower);
+  }
+};
+
+#endif  // SRC_AI_RANKING_H_
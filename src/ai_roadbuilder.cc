@@ -42,15 +42,15 @@ RoadBuilderRoad::RoadBuilderRoad(RoadEnds ends, Road r) {
 
 
 FlagScore::FlagScore() {
-  unsigned int flag_dist = 0;
-  unsigned int tile_dist = 0;
-  bool contains_castle_flag = false;
+  flag_dist = 0;
+  tile_dist = 0;
+  contains_castle_flag = false;
 }
 
 FlagScore::FlagScore(unsigned int fd, unsigned int td) {
-  unsigned int flag_dist = fd;
-  unsigned int tile_dist = td;
-  bool contains_castle_flag = false;
+  flag_dist = fd;
+  tile_dist = td;
+  contains_castle_flag = false;
 }
 
 RoadBuilder::RoadBuilder() {
@@ -64,3 +64,23 @@ RoadBuilder::RoadBuilder(MapPos sp, MapPos tp) {
   //roads_built = 0;
 }
 
+
+void
+RoadBuilder::reset(MapPos sp, MapPos tp) {
+  eroads.clear();
+  proads.clear();
+  scores.clear();
+  start_pos = sp;
+  target_pos = tp;
+}
+
+std::unique_ptr<RoadBuilder>
+RoadBuilderPool::take(MapPos start_pos, MapPos target_pos) {
+  if (idle.empty()) {
+    return std::unique_ptr<RoadBuilder>(new RoadBuilder(start_pos, target_pos));
+  }
+  std::unique_ptr<RoadBuilder> rb = std::move(idle.back());
+  idle.pop_back();
+  rb->reset(start_pos, target_pos);
+  return rb;
+}
@@ -6,13 +6,16 @@
 #ifndef SRC_AI_ROADBUILDER_H_
 #define SRC_AI_ROADBUILDER_H_
 
-#include <map>
+#include <algorithm>
+#include <deque>
+#include <memory>
 #include <tuple>
 #include <utility>      // to satisfy cpplinter
 #include <vector>      // to satisfy cpplinter
 
 #include "src/map.h"
 #include "src/lookup.h"
+#include "src/memory-usage.h"
 
 typedef std::tuple<MapPos, Direction, MapPos, Direction> RoadEnds;
 
@@ -75,12 +78,145 @@ class FlagScore {
 
 
 
-class RoadBuilder {
+// a flat open-addressing hash from a 64-bit key to a T, for the few dozen
+//  roads and flag scores of one build_best_road attempt.  The Ts live in a
+//  deque that is never shrunk, so clear() only forgets them and the next
+//  attempt reuses the same storage, and pointers to them stay good until
+//  then.  Iterating visits the entries in key order, as std::map did
+template <typename T>
+class RoadBuilderTable {
+ public:
+  typedef std::pair<uint64_t, T*> Entry;
+  typedef std::vector<Entry> Entries;
+  typedef typename Entries::iterator iterator;
+
+ protected:
+  static const uint32_t empty_slot = 0;
+
+  std::deque<T> arena;
+  Entries entries;
+  std::vector<uint32_t> slots;   // index into entries + 1, or empty_slot
+  bool sorted = true;
+
+  static size_t hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+  }
+
+  // the slot holding key, or the empty slot where it would go
+  size_t find_slot(uint64_t key) const {
+    size_t mask = slots.size() - 1;
+    size_t i = hash(key) & mask;
+    while (slots[i] != empty_slot && entries[slots[i] - 1].first != key) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  void reslot(size_t capacity) {
+    slots.assign(capacity, empty_slot);
+    for (size_t e = 0; e < entries.size(); e++) {
+      slots[find_slot(entries[e].first)] = static_cast<uint32_t>(e + 1);
+    }
+  }
 
  public:
-  typedef std::map<RoadEnds, RoadBuilderRoad*> RoadBuilderRoads;
-  typedef std::map<MapPos, FlagScore> FlagScores;
+  size_t size() const { return entries.size(); }
+  size_t count(uint64_t key) const { return (find(key) != nullptr) ? 1 : 0; }
 
+  T *find(uint64_t key) const {
+    if (slots.empty()) {
+      return nullptr;
+    }
+    uint32_t slot = slots[find_slot(key)];
+    return (slot == empty_slot) ? nullptr : entries[slot - 1].second;
+  }
+
+  // the T for key, a default one if key is new
+  T *get(uint64_t key) {
+    if (2 * (entries.size() + 1) > slots.size()) {
+      reslot(std::max<size_t>(32, 2 * slots.size()));
+    }
+    size_t i = find_slot(key);
+    if (slots[i] != empty_slot) {
+      return entries[slots[i] - 1].second;
+    }
+    if (entries.size() == arena.size()) {
+      arena.emplace_back();
+    } else {
+      arena[entries.size()] = T();
+    }
+    T *value = &arena[entries.size()];
+    if (!entries.empty() && entries.back().first > key) {
+      sorted = false;
+    }
+    entries.push_back(Entry(key, value));
+    slots[i] = static_cast<uint32_t>(entries.size());
+    return value;
+  }
+
+  void clear() {
+    std::fill(slots.begin(), slots.end(), empty_slot);
+    entries.clear();
+    sorted = true;
+  }
+
+  iterator begin() {
+    if (!sorted) {
+      std::sort(entries.begin(), entries.end());
+      reslot(slots.size());
+      sorted = true;
+    }
+    return entries.begin();
+  }
+  iterator end() { return entries.end(); }
+  // a copy to iterate over while adding to the table
+  Entries get_entries() { return Entries(begin(), end()); }
+  size_t get_allocated_bytes() const {
+    return arena.size() * sizeof(T) + entries.capacity() * sizeof(Entry) +
+           slots.capacity() * sizeof(uint32_t); }
+};
+
+template <typename T>
+const uint32_t RoadBuilderTable<T>::empty_slot;
+
+class RoadBuilderRoads : public RoadBuilderTable<RoadBuilderRoad> {
+ public:
+  // the ends packed so their order is that of the RoadEnds tuple, 29 bits
+  //  for each pos (maps are far smaller) and 3 for each direction + 1
+  static uint64_t pack(const RoadEnds &ends) {
+    return (static_cast<uint64_t>(std::get<0>(ends)) << 35) |
+           (static_cast<uint64_t>(std::get<1>(ends) + 1) << 32) |
+           (static_cast<uint64_t>(std::get<2>(ends)) << 3) |
+           static_cast<uint64_t>(std::get<3>(ends) + 1);
+  }
+  static RoadEnds unpack(uint64_t key) {
+    return RoadEnds(static_cast<MapPos>(key >> 35),
+                    static_cast<Direction>(((key >> 32) & 7) - 1),
+                    static_cast<MapPos>((key >> 3) & 0x1fffffff),
+                    static_cast<Direction>((key & 7) - 1));
+  }
+
+  size_t count(const RoadEnds &ends) const {
+    return RoadBuilderTable::count(pack(ends)); }
+  RoadBuilderRoad *find(const RoadEnds &ends) const {
+    return RoadBuilderTable::find(pack(ends)); }
+  RoadBuilderRoad *get(const RoadEnds &ends) {
+    return RoadBuilderTable::get(pack(ends)); }
+};
+
+class FlagScores : public RoadBuilderTable<FlagScore> {
+ public:
+  size_t count(MapPos pos) const { return RoadBuilderTable::count(pos); }
+  FlagScore *find(MapPos pos) const { return RoadBuilderTable::find(pos); }
+  FlagScore *get(MapPos pos) { return RoadBuilderTable::get(pos); }
+};
+
+class RoadBuilder {
+
+ public:
  protected:
   RoadBuilderRoads eroads;
   RoadBuilderRoads proads;  // proad is same object type as eroad, but start_pos/end1 is always same/known/fixed because it is set by roadbuilder
@@ -92,6 +228,12 @@ class RoadBuilder {
  public:
   RoadBuilder();
   RoadBuilder(MapPos start_pos, MapPos target_pos);
+  // forget the last attempt but keep its storage, for the next one
+  void reset(MapPos start_pos, MapPos target_pos);
+  // what that storage is, not counting the directions of the roads in it
+  size_t get_allocated_bytes() const {
+    return sizeof(RoadBuilder) + eroads.get_allocated_bytes() +
+           proads.get_allocated_bytes() + scores.get_allocated_bytes(); }
   MapPos get_start_pos() { return start_pos; }
   MapPos get_target_pos() { return target_pos; }
   void set_start_pos(MapPos pos) { start_pos = pos; }
@@ -99,16 +241,14 @@ class RoadBuilder {
   //void set_score(MapPos pos, unsigned int flag_dist, unsigned int tile_dist) {
   void set_score(MapPos pos, unsigned int flag_dist, unsigned int tile_dist, bool contains_castle_flag) {
     Log::Debug["ai_roadbuilder"] << "inside RoadBuilder::set_score(" << pos << ", " << flag_dist << ", " << tile_dist << ", " << contains_castle_flag << ")";
-    FlagScore score;
-    if (scores.count(pos)) {
-      Log::Debug["ai_roadbuilder"] << "inside RoadBuilder::set_score, existing score of flag_dist " << scores.at(pos).get_flag_dist() << ", tile_dist "
-          << scores.at(pos).get_tile_dist() << " found for pos " << pos << ", removing it...";
-      scores.erase(pos);
+    FlagScore *existing = scores.find(pos);
+    if (existing != nullptr) {
+      Log::Debug["ai_roadbuilder"] << "inside RoadBuilder::set_score, existing score of flag_dist " << existing->get_flag_dist() << ", tile_dist "
+          << existing->get_tile_dist() << " found for pos " << pos << ", replacing it...";
     }
-    score.set_flag_dist(flag_dist);
-    score.set_tile_dist(tile_dist);
+    FlagScore score(flag_dist, tile_dist);
     if (contains_castle_flag) { score.set_contains_castle_flag(); }
-    scores.insert(std::make_pair(pos, score));
+    *scores.get(pos) = score;
     Log::Debug["ai_roadbuilder"] << "inside RoadBuilder::set_score, done set_score for pos " << pos;
   }
   bool has_score(MapPos pos) {
@@ -123,7 +263,8 @@ class RoadBuilder {
   }
   FlagScore get_score(MapPos pos) {
     Log::Debug["ai_roadbuilder"] << "called RoadBuilder::get_score() for MapPos " << pos;
-    if (scores.count(pos) == 0) {
+    FlagScore *score = scores.find(pos);
+    if (score == nullptr) {
       Log::Debug["ai_roadbuilder"] << "ERROR!  scores.at(" << pos << ") is nullptr!  this is a crash bug";
       Log::Debug["ai_roadbuilder"] << "ERROR!  unable to find score for pos " << pos << ".  It should be scored already.  FIND OUT WHY";
       //std::this_thread::sleep_for(std::chrono::milliseconds(10000));
@@ -136,11 +277,11 @@ class RoadBuilder {
       bogus_score.set_tile_dist(bad_score);
       return bogus_score;
     }
-    return scores.at(pos);
+    return *score;
   }
   //unsigned int get_roads_built() { return roads_built; }
   bool has_eroad(MapPos end1, Direction dir1, MapPos end2, Direction dir2) {
-    if (eroads.count(RoadEnds(end1, dir1, end2, dir2)) || eroads.count(RoadEnds(end1, dir1, end2, dir2))) { return true; }
+    if (eroads.count(RoadEnds(end1, dir1, end2, dir2)) || eroads.count(RoadEnds(end2, dir2, end1, dir1))) { return true; }
     return false;
   }
   /*
@@ -158,20 +299,20 @@ class RoadBuilder {
 
   // because the RoadEnds are never used directly (I think?), rather only xroad->get_ calls,
   //   I don't think this should return a std::pair including the RoadEnds, only the RoadBuilderRoad itself
-  RoadBuilderRoads get_eroads() { return eroads; }
-  RoadBuilderRoads get_proads() { return proads; }
+  // these are copies of the entries only, scoring a flag can add eroads while they are looked at
+  RoadBuilderRoads::Entries get_eroads() { return eroads.get_entries(); }
+  RoadBuilderRoads::Entries get_proads() { return proads.get_entries(); }
+  size_t get_proad_count() { return proads.size(); }
 
   // search all ERoads for any with specified end1/dir1, OR end2/dir, and return the list as vector
   std::vector<RoadBuilderRoad*> get_eroads(MapPos end, Direction dir) {
     std::vector<RoadBuilderRoad*> found_eroads;
-    for (std::pair<RoadEnds, RoadBuilderRoad *> eroad : eroads) {
-      RoadEnds ends = eroad.first;
-      MapPos end1 = std::get<0>(ends);
-      Direction dir1 = std::get<1>(ends);
+    for (RoadBuilderRoads::Entry eroad : eroads) {
+      RoadEnds ends = RoadBuilderRoads::unpack(eroad.first);
       MapPos end2 = std::get<2>(ends);
       Direction dir2 = std::get<3>(ends);
-      if (eroads.count(RoadEnds(end, dir, end2, dir2))) { found_eroads.push_back(eroads.at(RoadEnds(end, dir, end2, dir2))); }
-      if (eroads.count(RoadEnds(end2, dir2, end, dir))) { found_eroads.push_back(eroads.at(RoadEnds(end2, dir2, end, dir))); }
+      if (eroads.count(RoadEnds(end, dir, end2, dir2))) { found_eroads.push_back(eroads.find(RoadEnds(end, dir, end2, dir2))); }
+      if (eroads.count(RoadEnds(end2, dir2, end, dir))) { found_eroads.push_back(eroads.find(RoadEnds(end2, dir2, end, dir))); }
     }
     if (found_eroads.size() == 0) {
       Log::Debug["ai_roadbuilder"] << "ERROR could not find any eroad with one end:dir " << end << ":" << NameDirection[dir];
@@ -181,8 +322,8 @@ class RoadBuilder {
 
   // return a specific known ERoad by individual identifiers  (convenience)
   RoadBuilderRoad* get_eroad(MapPos end1, Direction dir1, MapPos end2, Direction dir2) {
-    if (eroads.count(RoadEnds(end1, dir1, end2, dir2))) { return eroads.at(RoadEnds(end1, dir1, end2, dir2)); }
-    if (eroads.count(RoadEnds(end2, dir2, end1, dir1))) { return eroads.at(RoadEnds(end2, dir2, end1, dir1)); }
+    if (eroads.count(RoadEnds(end1, dir1, end2, dir2))) { return eroads.find(RoadEnds(end1, dir1, end2, dir2)); }
+    if (eroads.count(RoadEnds(end2, dir2, end1, dir1))) { return eroads.find(RoadEnds(end2, dir2, end1, dir1)); }
     Log::Debug["ai_roadbuilder"] << "could not find eroad with ends:dirs " << end1 << ":" << NameDirection[dir1] << ", " << end2 << ":" << NameDirection[dir2] << " or inverse";
     return nullptr;
   }
@@ -193,15 +334,15 @@ class RoadBuilder {
     Direction dir1 = std::get<1>(ends);
     MapPos end2 = std::get<2>(ends);
     Direction dir2 = std::get<3>(ends);
-    if (eroads.count(RoadEnds(end1, dir1, end2, dir2))) { return eroads.at(RoadEnds(end1, dir1, end2, dir2)); }
-    if (eroads.count(RoadEnds(end2, dir2, end1, dir1))) { return eroads.at(RoadEnds(end2, dir2, end1, dir1)); }
+    if (eroads.count(RoadEnds(end1, dir1, end2, dir2))) { return eroads.find(RoadEnds(end1, dir1, end2, dir2)); }
+    if (eroads.count(RoadEnds(end2, dir2, end1, dir1))) { return eroads.find(RoadEnds(end2, dir2, end1, dir1)); }
     Log::Debug["ai_roadbuilder"] << "could not find eroad with ends:dirs " << end1 << ":" << NameDirection[dir1] << ", " << end2 << ":" << NameDirection[dir2] << " or inverse";
     return nullptr;
   }
 
   // find and return a specific PRoad by end_pos
   RoadBuilderRoad* get_proad(MapPos end_pos) {
-    for (std::pair<RoadEnds, RoadBuilderRoad *> proad_pair : proads) {
+    for (RoadBuilderRoads::Entry proad_pair : proads) {
       RoadBuilderRoad *rb_road = proad_pair.second;
       if (end_pos == rb_road->get_end2()) {
         return rb_road;
@@ -258,9 +399,8 @@ class RoadBuilder {
     Direction dir2 = std::get<3>(ends);
     Log::Debug["ai_roadbuilder"] << " inside new_eroad with end1 " << end1 << ", dir1 " << NameDirection[dir1] << ", end2 " << end2 << ", dir2 " << NameDirection[dir2];
     //RoadBuilderRoad *rb_road = new RoadBuilderRoad(end1, dir1, end2, dir2);
-    RoadBuilderRoad *rb_road = new RoadBuilderRoad(ends, road);
+    *eroads.get(ends) = RoadBuilderRoad(ends, road);
     //rb_road->set_road(road);
-    eroads[ends] = rb_road;
   }
 
   //void new_proad(MapPos end1, Direction dir1, MapPos end2, Direction dir2, Road road) {
@@ -272,14 +412,48 @@ class RoadBuilder {
     Direction end_dir = std::get<3>(ends);
     Log::Debug["ai_roadbuilder"] << " inside new_proad with start_pos " << start_pos << ", start_dir " << NameDirection[start_dir] << ", end_pos " << end_pos << ", end_dir " << NameDirection[end_dir];
     //RoadBuilderRoad *rb_road = new RoadBuilderRoad(end1, dir1, end2, dir2);
-    RoadBuilderRoad *rb_road = new RoadBuilderRoad(ends, road);
+    *proads.get(ends) = RoadBuilderRoad(ends, road);
     //rb_road->set_road(road);
-    proads[ends] = rb_road;
   }
 
  protected:
   //
 }; // class Roadbuilder
 
+// RoadBuilders handed back after each attempt, so their tables are reused
+//  rather than built up again.  build_best_road can call itself (for a land
+//  road instead of a water road), so there can be more than one out at once
+class RoadBuilderPool {
+ public:
+  class Lease {
+   protected:
+    RoadBuilderPool *pool;
+    std::unique_ptr<RoadBuilder> rb;
+
+   public:
+    Lease(RoadBuilderPool *_pool, MapPos start_pos, MapPos target_pos)
+      : pool(_pool), rb(pool->take(start_pos, target_pos)) {}
+    ~Lease() { pool->give(std::move(rb)); }
+    Lease(const Lease &) = delete;
+    Lease &operator = (const Lease &) = delete;
+    RoadBuilder &operator * () { return *rb; }
+  };
+
+ protected:
+  std::vector<std::unique_ptr<RoadBuilder>> idle;
+
+ public:
+  std::unique_ptr<RoadBuilder> take(MapPos start_pos, MapPos target_pos);
+  void give(std::unique_ptr<RoadBuilder> rb) { idle.push_back(std::move(rb)); }
+  size_t get_idle_count() const { return idle.size(); }
+  size_t get_allocated_bytes() const {
+    size_t bytes = MemoryUsage::vector_bytes(idle);
+    for (const std::unique_ptr<RoadBuilder> &rb : idle) {
+      bytes += rb->get_allocated_bytes();
+    }
+    return bytes;
+  }
+};
+
 
 #endif  // SRC_AI_ROADBUILDER_H_
@@ -0,0 +1,114 @@
+/*
+ * ai_stats.cc - where the time of an AI player's last loops went
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_stats.h"
+
+#include <algorithm>
+
+const unsigned int AIStats::loops_kept;
+const unsigned int AIStats::alloc_sites_kept;
+
+AIStats::AIStats()
+  : outer_tally(nullptr)
+  , step_ns(0)
+  , step_allocs{}
+  , loop_allocs{}
+  , kinds(Profiler::max_sections, KindUnknown)
+  , loops(std::make_shared<Loops>()) {
+  for (std::atomic<uint64_t> &counter : counters) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+}
+
+void
+AIStats::begin_step() {
+  outer_tally = Profiler::attach_tally(&tally);
+  if (AllocStats::enabled) {
+    AllocStats::get_thread_scopes(step_allocs);
+  }
+  step_start = Profiler::Clock::now();
+}
+
+void
+AIStats::end_step() {
+  step_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Profiler::Clock::now() - step_start).count();
+  if (AllocStats::enabled) {
+    AllocStats::Counts now[AllocStats::scope_count];
+    AllocStats::get_thread_scopes(now);
+    for (unsigned int s = 0; s < AllocStats::scope_count; s++) {
+      loop_allocs[s].count += now[s].count - step_allocs[s].count;
+      loop_allocs[s].bytes += now[s].bytes - step_allocs[s].bytes;
+    }
+  }
+  Profiler::attach_tally(outer_tally);
+  outer_tally = nullptr;
+}
+
+// section names are only looked up the first time a loop sees them
+AIStats::Kind
+AIStats::get_kind(unsigned int section) {
+  if (kinds[section] == KindUnknown) {
+    std::string name = Profiler::get_section_name(section);
+    if (name.compare(0, 3, "ai.") == 0) {
+      kinds[section] = KindStep;
+    } else if (name.compare(0, 10, "lock.game.") == 0) {
+      kinds[section] = KindLockWait;
+    } else {
+      kinds[section] = KindOther;
+    }
+  }
+  return kinds[section];
+}
+
+void
+AIStats::end_loop(unsigned int loop, unsigned int ticks) {
+  Loop done;
+  done.loop = loop;
+  done.ticks = ticks;
+  done.step_ns = step_ns;
+  done.lock_wait_ns = 0;
+  for (unsigned int s = 0; s < Profiler::max_sections; s++) {
+    if (tally.count[s] == 0) {
+      continue;
+    }
+    switch (get_kind(s)) {
+    case KindStep:
+      done.steps.push_back(Step{ Profiler::get_section_name(s).substr(3),
+                                 tally.total_ns[s], tally.count[s] });
+      break;
+    case KindLockWait:
+      done.lock_wait_ns += tally.total_ns[s];
+      break;
+    default:
+      break;
+    }
+  }
+  std::sort(done.steps.begin(), done.steps.end(),
+            [](const Step &a, const Step &b) { return a.ns > b.ns; });
+  for (unsigned int c = 0; c < CounterCount; c++) {
+    done.counters[c] = counters[c].exchange(0, std::memory_order_relaxed);
+  }
+  done.allocs = 0;
+  done.alloc_bytes = 0;
+  for (const AllocStats::Counts &scope : loop_allocs) {
+    done.allocs += scope.count;
+    done.alloc_bytes += scope.bytes;
+  }
+  if (done.allocs > 0) {
+    done.alloc_sites = AllocStats::get_sites(loop_allocs, alloc_sites_kept);
+  }
+  tally.clear();
+  step_ns = 0;
+  std::fill(std::begin(loop_allocs), std::end(loop_allocs),
+            AllocStats::Counts{});
+
+  std::shared_ptr<Loops> next = std::make_shared<Loops>(*std::atomic_load(&loops));
+  next->push_front(done);
+  if (next->size() > loops_kept) {
+    next->pop_back();
+  }
+  std::atomic_store(&loops, std::shared_ptr<const Loops>(next));
+}
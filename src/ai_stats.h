@@ -0,0 +1,108 @@
+/*
+ * ai_stats.h - where the time of an AI player's last loops went
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_STATS_H_
+#define SRC_AI_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/alloc-stats.h"
+#include "src/profiler.h"
+
+// the profiler sections an AI player's steps record, tallied per loop, and
+//  counters for the searches and caches the profiler doesn't see.  The AI
+//  thread attaches the tally for the length of each step, so the profiler
+//  adds to it as it goes and nothing is timed twice.  The counters can be
+//  bumped by the threads plot_roads starts.  In a build counting
+//  allocations, what the steps allocated is kept by scope the same way.
+//  Each finished loop is published
+//  whole, like the AI overlay, so the viewport reads it without locking
+class AIStats {
+ public:
+  static const unsigned int loops_kept = 8;
+  static const unsigned int alloc_sites_kept = 3;
+
+  typedef enum Counter {
+    PlotRoadCalls = 0,
+    PlotRoadNodes,        // tiles taken from the open set by plot_road searches
+    PlotRoadCorridors,    // plot_road searches kept to a corridor of road clusters
+    PlotRoadCorridorMisses,   // that found no road there and searched again
+    RoadPlotCacheHits,
+    RoadPlotCacheMisses,
+    RoadPlotsNotCached,   // the map changed while they were searched for
+    AreaScoreCacheHits,
+    AreaScoreCacheMisses,
+    FlagDistsHits,        // flag distances read from the table
+    FlagDistsMisses,      // searched for instead
+    GameEventsRead,       // from the game's events, see AI::read_game_events
+    GameEventsLost,       // times the events moved on past some not yet read
+    BuildingsBurnt,       // of this AI's player
+    CounterCount,
+  } Counter;
+
+  typedef struct Step {
+    std::string name;     // the profiler section, without "ai."
+    uint64_t ns;          // including the steps it called
+    uint32_t count;
+  } Step;
+
+  typedef struct Loop {
+    unsigned int loop;
+    unsigned int ticks;
+    uint64_t step_ns;       // in AI steps, all of it
+    uint64_t lock_wait_ns;  // waiting for a game lock
+    std::vector<Step> steps;  // slowest first
+    uint64_t counters[CounterCount];
+    uint64_t allocs;        // in AI steps, zero unless counted
+    uint64_t alloc_bytes;
+    std::vector<AllocStats::Site> alloc_sites;  // most allocations first
+  } Loop;
+  typedef std::deque<Loop> Loops;   // newest first
+
+ protected:
+  typedef enum Kind {
+    KindUnknown = 0,
+    KindStep,
+    KindLockWait,
+    KindOther,
+  } Kind;
+
+  Profiler::Tally tally;
+  Profiler::Tally *outer_tally;
+  Profiler::Clock::time_point step_start;
+  uint64_t step_ns;
+  AllocStats::Counts step_allocs[AllocStats::scope_count];  // at step start
+  AllocStats::Counts loop_allocs[AllocStats::scope_count];
+  std::vector<Kind> kinds;   // by profiler section
+  std::atomic<uint64_t> counters[CounterCount];
+  std::shared_ptr<const Loops> loops;
+
+  Kind get_kind(unsigned int section);
+
+ public:
+  AIStats();
+
+  // around each step of the AI, on the thread running it
+  void begin_step();
+  void end_step();
+  // publish what the loop took, and start tallying the next one
+  void end_loop(unsigned int loop, unsigned int ticks);
+
+  void count(Counter counter, uint64_t n = 1) {
+    counters[counter].fetch_add(n, std::memory_order_relaxed); }
+  // what counter has come to in the loop not yet published
+  uint64_t get_count(Counter counter) const {
+    return counters[counter].load(std::memory_order_relaxed); }
+
+  std::shared_ptr<const Loops> get_loops() const {
+    return std::atomic_load(&loops); }
+};
+
+#endif  // SRC_AI_STATS_H_
@@ -0,0 +1,139 @@
+/*
+ * ai_threat_map.cc - military strength of every player on a coarse grid
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#include "src/ai_threat_map.h"
+
+#include <algorithm>
+#include <utility>
+
+const unsigned int ThreatMap::cell_shift;
+const unsigned int ThreatMap::cell_size;
+const unsigned int ThreatMap::players;
+
+ThreatMap::ThreatMap()
+  : cols(0)
+  , rows(0)
+  , round(0)
+  , version(0) {
+}
+
+unsigned int
+ThreatMap::cell_of(const Map &map, MapPos pos) const {
+  return (map.pos_row(pos) >> cell_shift) * cols +
+         (map.pos_col(pos) >> cell_shift);
+}
+
+void
+ThreatMap::count(const Counted &entry, int sign) {
+  strength[entry.cell * players + entry.owner] +=
+    sign * static_cast<int>(entry.knights);
+}
+
+void
+ThreatMap::update(std::shared_ptr<const GameSnapshot> _snapshot,
+                  const Map &map) {
+  if (snapshot && _snapshot->get_version() == version) {
+    return;
+  }
+  unsigned int map_cols = std::max(1u, map.get_cols() >> cell_shift);
+  unsigned int map_rows = std::max(1u, map.get_rows() >> cell_shift);
+  if (map_cols != cols || map_rows != rows) {
+    // another map, start over
+    cols = map_cols;
+    rows = map_rows;
+    strength.assign(cols * rows * players, 0);
+    counted.clear();
+    round = 0;
+  }
+  snapshot = std::move(_snapshot);
+  version = snapshot->get_version();
+  round++;
+
+  std::fill(cell_start.begin(), cell_start.end(), 0);
+  cell_start.resize(cols * rows + 1, 0);
+  size_t total = 0;
+  for (unsigned int p = 0; p < players; p++) {
+    for (const GameSnapshot::BuildingView &building :
+         snapshot->get_player(p).buildings) {
+      if (!building.military) {
+        continue;
+      }
+      total++;
+      Counted entry = { cell_of(map, building.pos), p, building.knight_count,
+                        round };
+      cell_start[entry.cell + 1]++;
+      if (building.index >= counted.size()) {
+        counted.resize(building.index + 1, Counted{ 0, 0, 0, 0 });
+      }
+      Counted &before = counted[building.index];
+      if (before.round != 0 && before.cell == entry.cell &&
+          before.owner == entry.owner && before.knights == entry.knights) {
+        before.round = round;
+        continue;
+      }
+      if (before.round != 0) {
+        count(before, -1);
+      }
+      count(entry, 1);
+      before = entry;
+    }
+  }
+  // buildings that are gone, or no longer military
+  for (Counted &entry : counted) {
+    if (entry.round != 0 && entry.round != round) {
+      count(entry, -1);
+      entry.round = 0;
+    }
+  }
+
+  // group the military buildings by cell
+  for (unsigned int c = 0; c < cols * rows; c++) {
+    cell_start[c + 1] += cell_start[c];
+  }
+  military.resize(total);
+  std::vector<unsigned int> next(cell_start.begin(), cell_start.end() - 1);
+  for (unsigned int p = 0; p < players; p++) {
+    for (const GameSnapshot::BuildingView &building :
+         snapshot->get_player(p).buildings) {
+      if (building.military) {
+        military[next[cell_of(map, building.pos)]++] = Military{ p, &building };
+      }
+    }
+  }
+}
+
+int
+ThreatMap::get_strength(const Map &map, unsigned int player, MapPos pos,
+                        unsigned int radius) const {
+  if (cols == 0) {
+    return 0;
+  }
+  int col = map.pos_col(pos) >> cell_shift;
+  int row = map.pos_row(pos) >> cell_shift;
+  // on a small map the radius can wrap around, count each cell once
+  int span_cols = std::min<int>(2 * radius + 1, cols);
+  int span_rows = std::min<int>(2 * radius + 1, rows);
+  int sum = 0;
+  for (int dr = 0; dr < span_rows; dr++) {
+    for (int dc = 0; dc < span_cols; dc++) {
+      unsigned int c = (col - radius + dc + cols * (radius + 1)) % cols;
+      unsigned int r = (row - radius + dr + rows * (radius + 1)) % rows;
+      sum += strength[(r * cols + c) * players + player];
+    }
+  }
+  return sum;
+}
+
+int
+ThreatMap::get_enemy_strength(const Map &map, unsigned int player, MapPos pos,
+                              unsigned int radius) const {
+  int sum = 0;
+  for (unsigned int p = 0; p < players; p++) {
+    if (p != player) {
+      sum += get_strength(map, p, pos, radius);
+    }
+  }
+  return sum;
+}
@@ -0,0 +1,94 @@
+/*
+ * ai_threat_map.h - military strength of every player on a coarse grid
+ *   Copyright 2019-2021 tlongstretch
+ */
+
+#ifndef SRC_AI_THREAT_MAP_H_
+#define SRC_AI_THREAT_MAP_H_
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "src/game-snapshot.h"
+#include "src/map.h"
+
+// knights in military buildings, summed per player for each cell of a grid
+//  of cell_size x cell_size tiles, and the military buildings of each cell.
+//  update() only changes the cells of buildings whose knights, owner or
+//  place changed since the snapshot it last saw, so reading the strength
+//  near a position costs a few cells whatever the size of the war.  Two
+//  buildings an attack can reach between (13 tiles) are always in the same
+//  or neighbouring cells
+class ThreatMap {
+ public:
+  static const unsigned int cell_shift = 4;
+  static const unsigned int cell_size = 1 << cell_shift;
+  static const unsigned int players = GameSnapshot::max_players;
+
+  typedef struct Military {
+    unsigned int owner;
+    const GameSnapshot::BuildingView *view;
+  } Military;
+
+ protected:
+  typedef struct Counted {
+    unsigned int cell;
+    unsigned int owner;
+    unsigned int knights;
+    unsigned int round;   // update it was last seen in, 0 if never
+  } Counted;
+
+  unsigned int cols;   // in cells
+  unsigned int rows;
+  std::vector<int> strength;    // players per cell
+  std::vector<Counted> counted;   // by building index
+  unsigned int round;
+  uint64_t version;
+  std::shared_ptr<const GameSnapshot> snapshot;
+  // military buildings grouped by cell, those of cell c from
+  //  cell_start[c] up to cell_start[c + 1]
+  std::vector<Military> military;
+  std::vector<unsigned int> cell_start;
+
+  unsigned int cell_of(const Map &map, MapPos pos) const;
+  void count(const Counted &entry, int sign);
+
+ public:
+  ThreatMap();
+
+  void update(std::shared_ptr<const GameSnapshot> snapshot, const Map &map);
+
+  // knights of a player, or of everyone else, within radius cells of pos
+  int get_strength(const Map &map, unsigned int player, MapPos pos,
+                   unsigned int radius) const;
+  int get_enemy_strength(const Map &map, unsigned int player, MapPos pos,
+                         unsigned int radius) const;
+
+  // call f(military) for every military building in the cell of pos and
+  //  the eight cells around it, as of the last update
+  template <typename F>
+  void for_each_military_near(const Map &map, MapPos pos, F f) const {
+    if (cols == 0) {
+      return;
+    }
+    int col = map.pos_col(pos) >> cell_shift;
+    int row = map.pos_row(pos) >> cell_shift;
+    // a small map has fewer than three cells across, visit each once
+    int span_cols = std::min<int>(3, cols);
+    int span_rows = std::min<int>(3, rows);
+    for (int dr = 0; dr < span_rows; dr++) {
+      for (int dc = 0; dc < span_cols; dc++) {
+        unsigned int c = (col - 1 + dc + cols) % cols;
+        unsigned int r = (row - 1 + dr + rows) % rows;
+        unsigned int cell = r * cols + c;
+        for (unsigned int i = cell_start[cell]; i < cell_start[cell + 1];
+             i++) {
+          f(military[i]);
+        }
+      }
+    }
+  }
+};
+
+#endif  // SRC_AI_THREAT_MAP_H_
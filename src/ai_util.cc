@@ -52,78 +52,70 @@ AI::spiral_dist(int distance) {
   return _spiral_dist[distance];
 }
 
+// the number of rows around the center that 'distance' spiral positions reach, the reverse of spiral_dist
+int
+AI::spiral_radius(unsigned int distance) {
+  int radius = 0;
+  while (radius < 24 && static_cast<unsigned int>(_spiral_dist[radius]) < distance) {
+    radius++;
+  }
+  return radius;
+}
+
+bool
+AI::get_cached_area_score(const std::string &key, uint32_t changes, double *value) {
+  std::map<std::string, AreaScore>::iterator it = area_score_cache.find(key);
+  if (it == area_score_cache.end() || it->second.changes != changes) {
+    stats.count(AIStats::AreaScoreCacheMisses);
+    return false;
+  }
+  *value = it->second.value;
+  stats.count(AIStats::AreaScoreCacheHits);
+  return true;
+}
+
+void
+AI::cache_area_score(const std::string &key, uint32_t changes, double value) {
+  if (area_score_cache.size() >= area_score_cache_max) {
+    area_score_cache.clear();
+  }
+  area_score_cache[key] = { changes, value };
+}
+
 
 // return true if *any* of the four points contain the requested terrain type
 bool
 AI::has_terrain_type(PGame game, MapPos pos, Map::Terrain res_start_index, Map::Terrain res_end_index) {
-  Log::Debug["util_has_terrain_type"] << " inside AI::has_terrain_type";
-  PMap map = game->get_map();
-  Map::Object obj = map->get_obj(pos);
-  Map::Terrain t1 = map->type_down(pos);
-  Map::Terrain t2 = map->type_up(pos);
-  Map::Terrain t3 = map->type_down(map->move_up_left(pos));
-  Map::Terrain t4 = map->type_up(map->move_up_left(pos));
-  if ((t1 >= res_start_index && t1 <= res_end_index) ||
-    (t2 >= res_start_index && t2 <= res_end_index) ||
-    (t3 >= res_start_index && t3 <= res_end_index) ||
-    (t4 >= res_start_index && t4 <= res_end_index)) {
-    return true;
-  }
-  return false;
+  return has_terrain_type(*game->get_map(), pos, res_start_index, res_end_index);
 }
 
-// score specified area in terms of castle placement
-//   initially this is just ensuring enough wood, stones, and building sites
-//   long term it should also care about resources in the surrounding areas!  including mountains, fishable waters, etc.
+// as above, for the area counting loops that check every tile in a spiral
+//  this runs once per tile, so it must not log or copy shared pointers
 bool
-AI::place_castle(PGame game, MapPos center_pos, unsigned int distance) {
-  AILogDebug["util_place_castle"] << name << " inside AI::place_castle, center_pos " << center_pos << ", distance " << distance;
-  PMap map = game->get_map();
-  unsigned int trees = 0;
-  unsigned int stones = 0;
-  unsigned int building_sites = 0;
-  for (unsigned int i = 0; i < distance; i++) {
-    MapPos pos = map->pos_add_extended_spirally(center_pos, i);
-    Map::Object obj = map->get_obj(pos);
-    if (obj >= Map::ObjectTree0 && obj <= Map::ObjectPine7) {
-      trees += 1;
-      //AILogDebug["util_place_castle"] << name << " adding trees count 1";
-    }
-    if (obj >= Map::ObjectStone0 && obj <= Map::ObjectStone7) {
-      int stonepile_value = 1 + (-1 * (obj - Map::ObjectStone7));
-      stones += stonepile_value;
-      //AILogDebug["util_place_castle"] << name << " adding stones count " << stonepile_value;
-    }
-    if (game->can_build_large(pos)) {
-      building_sites += 3;
-      //AILogDebug["util_place_castle"] << name << " adding large building value 3";
-    }
-    else if (game->can_build_small(pos)) {
-      building_sites += 1;
-      //AILogDebug["util_place_castle"] << name << " adding small building value 1";
-    }
-  }
+AI::has_terrain_type(const Map &map, MapPos pos, Map::Terrain res_start_index, Map::Terrain res_end_index) {
+  return (map.terrain_up_left(pos) &
+          Map::terrain_bits(res_start_index, res_end_index)) != 0;
+}
 
-  AILogDebug["util_place_castle"] << name << " found trees: " << trees << ", stones: " << stones << ", building_sites: " << building_sites << " in area " << center_pos;
-  if (trees < (near_trees_min * 4)) {
-    AILogDebug["util_place_castle"] << name << " not enough trees, min is " << near_trees_min * 4 << ", returning false";
-    return false;
-  }
-  if (stones < near_stones_min) {
-    AILogDebug["util_place_castle"] << name << " not enough stones, min is " << near_stones_min << ", returning false";
-    return false;
-  }
-  if (building_sites < near_building_sites_min) {
-    AILogDebug["util_place_castle"] << name << " not enough building_sites, min is " << near_building_sites_min << ", returning false";
+// update current AI player's inventory of buildings of all types for lookup by various functions
+// true if the two lists hold the same buildings in the same state, as far as
+//  update_building_counts is concerned.  Construction progress and knight
+//  counts are left out, they change all the time without changing any count
+static bool
+same_counted_buildings(const std::vector<GameSnapshot::BuildingView> &a,
+                       const std::vector<GameSnapshot::BuildingView> &b) {
+  if (a.size() != b.size())
     return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].index != b[i].index || a[i].pos != b[i].pos || a[i].type != b[i].type
+      || a[i].done != b[i].done || a[i].burning != b[i].burning
+      || a[i].active != b[i].active || a[i].military != b[i].military
+      || a[i].has_serf != b[i].has_serf || a[i].flag_connected != b[i].flag_connected)
+      return false;
   }
-  AILogDebug["util_place_castle"] << name << " center_pos: " << center_pos << " is an acceptable building site for a castle";
-  AILogDebug["util_place_castle"] << name << " done AI::place_castle";
   return true;
 }
 
-
-// update current AI player's inventory of buildings of all types for lookup by various functions
 void
 AI::update_building_counts() {
   // time this function for debugging
@@ -132,13 +124,15 @@ AI::update_building_counts() {
   start = std::clock();
 
   AILogDebug["util_update_building_counts"] << name << " inside AI::update_building_counts";
-  AILogDebug["util_update_building_counts"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex inside AI::update_building_counts";
-  game->get_mutex()->lock();
-  AILogDebug["util_update_building_counts"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex inside AI::update_building_counts";
-  Game::ListBuildings buildings = game->get_player_buildings(player);
-  AILogDebug["util_update_building_counts"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex inside AI::update_building_counts";
-  game->get_mutex()->unlock();
-  AILogDebug["util_update_building_counts"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex inside AI::update_building_counts";
+  // buildings are read from the snapshot, so the game is not locked while counting
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  const std::vector<GameSnapshot::BuildingView> &buildings = snapshot->get_player(player_index).buildings;
+  // the counts only change when a building is founded, built, occupied, connected, burnt or demolished, or
+  //  when a stock is added.  Many callers ask again right after the last count, skip the recount if nothing changed
+  if (stocks_pos == counted_stocks_pos && same_counted_buildings(buildings, counted_buildings)) {
+    AILogDebug["util_update_building_counts"] << name << " no buildings changed since last count, keeping counts";
+    return;
+  }
   // reset all to zero
   memset(building_count, 0, sizeof(building_count));
   memset(completed_building_count, 0, sizeof(completed_building_count));
@@ -158,15 +152,12 @@ AI::update_building_counts() {
     AILogDebug["util_update_building_counts"] << name << " RESET unfinished_building_count, for stock_pos " << stock_pos << ", is now: " << stock_buildings.at(stock_pos).unfinished_count;
   }
 
-  for (Building *building : buildings) {
+  for (const GameSnapshot::BuildingView &building : buildings) {
     //AILogDebug["util_update_building_counts"] << name << " has a building";
-    if (building == nullptr)
-      continue;
-    //AILogDebug["util_update_building_counts"] << name << " has a building that is not nullptr";
-    if (building->is_burning())
+    if (building.burning)
       continue;
     //AILogDebug["util_update_building_counts"] << name << " has a building that is not on fire";
-    Building::Type type = building->get_type();
+    Building::Type type = building.type;
     AILogDebug["util_update_building_counts"] << name << " has a building of type " << NameBuilding[type];
     if (type == Building::TypeNone) {
       AILogDebug["util_update_building_counts"] << name << " has a building of TypeNone!  why does this happen??";
@@ -174,36 +165,42 @@ AI::update_building_counts() {
     }
     if (type == Building::TypeCastle) {
       //AILogDebug["util_update_building_counts"] << name << " has a castle";
-      if (!building->is_done()) {
+      if (!building.done) {
         AILogDebug["util_update_building_counts"] << name << "'s castle isn't finished building yet";
-        while (!building->is_done()) {
+        bool castle_done = false;
+        while (!castle_done) {
           AILogDebug["util_update_building_counts"] << name << "'s castle isn't finished building yet.  Sleeping a bit";
           std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+          std::shared_ptr<const GameSnapshot> latest = game->get_snapshot();
+          for (const GameSnapshot::BuildingView &view : latest->get_player(player_index).buildings) {
+            if (view.index == building.index)
+              castle_done = view.done;
+          }
         }
         AILogDebug["util_update_building_counts"] << name << "'s castle is now built, updating stocks";
         update_stocks_pos();
       }
-      //AILogDebug["util_update_building_counts"] << name << " has a completed castle at pos " << building->get_position() << " with flag pos " << map->move_down_right(building->get_position());
-      realm_occupied_military_pos.push_back(building->get_position());
-      stock_buildings.at(map->move_down_right(building->get_position())).occupied_military_pos.push_back(building->get_position());
+      //AILogDebug["util_update_building_counts"] << name << " has a completed castle at pos " << building.pos << " with flag pos " << map->move_down_right(building.pos);
+      realm_occupied_military_pos.push_back(building.pos);
+      stock_buildings.at(map->move_down_right(building.pos)).occupied_military_pos.push_back(building.pos);
       continue;
     }
-    if (type == Building::TypeStock && building->is_done())
+    if (type == Building::TypeStock && building.done)
       continue;
-    AILogDebug["util_update_building_counts"] << name << " about to call find_nearest_stock for building at pos " << building->get_position() << " with type " << NameBuilding[type];
-    MapPos nearest_stock = find_nearest_stock(building->get_position());
+    AILogDebug["util_update_building_counts"] << name << " about to call find_nearest_stock for building at pos " << building.pos << " with type " << NameBuilding[type];
+    MapPos nearest_stock = find_nearest_stock(building.pos);
     AILogDebug["util_update_building_counts"] << name << " nearest stock to this building is " << nearest_stock;
-    if (!building->is_done()) {
+    if (!building.done) {
       if (type == Building::TypeHut) {
         //unfinished_hut_count++;
         stock_buildings.at(nearest_stock).unfinished_hut_count++;
         //AILogDebug["util_update_building_counts"] << name << " incrementing unfinished_hut_count, is now: " << unfinished_hut_count;
         AILogDebug["util_update_building_counts"] << name << " incrementing unfinished_hut_count for stock_pos " << nearest_stock << ", is now: " << stock_buildings.at(nearest_stock).unfinished_hut_count;
       }
-      else if (building->get_type() == Building::TypeCoalMine
-        || building->get_type() == Building::TypeIronMine
-        || building->get_type() == Building::TypeGoldMine
-        || building->get_type() == Building::TypeStoneMine) {
+      else if (building.type == Building::TypeCoalMine
+        || building.type == Building::TypeIronMine
+        || building.type == Building::TypeGoldMine
+        || building.type == Building::TypeStoneMine) {
         AILogDebug["util_update_building_counts"] << name << " unfinished building is a Mine, not incrementing unfinished_building_count";
       }
       else {
@@ -215,23 +212,23 @@ AI::update_building_counts() {
     }
     building_count[type]++;
     stock_buildings.at(nearest_stock).count[type]++;
-    if (game->get_flag(building->get_flag_index())->is_connected()) {
+    if (building.flag_connected) {
       connected_building_count[type]++;
       stock_buildings.at(nearest_stock).connected_count[type]++;
     }
-    if (building->is_done()){
+    if (building.done){
       completed_building_count[type]++;
       stock_buildings.at(nearest_stock).completed_count[type]++;
       // has_serf is not a good enough test alone to see if occupied, as it seems to be true when a builder is constructing the building!
       //  so moved this check to inside building->is_done because if building is done the only serf there should be the professional (I think)
-      if (building->has_serf()) {
+      if (building.has_serf) {
         occupied_building_count[type]++;
         stock_buildings.at(nearest_stock).occupied_count[type]++;
       }
-      if (building->is_military() && building->is_active()) {
-        AILogDebug["util_update_building_counts"] << name << " adding occupied military building at " << building->get_position() << " to list for stock_pos " << nearest_stock;
-        realm_occupied_military_pos.push_back(building->get_position());
-        stock_buildings.at(nearest_stock).occupied_military_pos.push_back(building->get_position());
+      if (building.military && building.active) {
+        AILogDebug["util_update_building_counts"] << name << " adding occupied military building at " << building.pos << " to list for stock_pos " << nearest_stock;
+        realm_occupied_military_pos.push_back(building.pos);
+        stock_buildings.at(nearest_stock).occupied_military_pos.push_back(building.pos);
       }
     }
   }
@@ -245,6 +242,8 @@ AI::update_building_counts() {
       type++;
     }
   }
+  counted_buildings = buildings;
+  counted_stocks_pos = stocks_pos;
   AILogDebug["util_update_building_counts"] << name << " done AI::update_building_counts";
   duration = (std::clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
   AILogDebug["util_update_building_counts"] << name << " done AI::update_building_counts call took " << duration;
@@ -262,11 +261,11 @@ AI::update_stocks_pos() {
 
   AILogDebug["util_update_stocks_pos"] << name << " inside AI::update_stocks_pos";
   AILogDebug["util_update_stocks_pos"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex inside AI::update_stocks_pos";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["util_update_stocks_pos"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex inside AI::update_stocks_pos";
   Game::ListBuildings buildings = game->get_player_buildings(player);
   AILogDebug["util_update_stocks_pos"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex inside AI::update_stocks_pos";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["util_update_stocks_pos"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex inside AI::update_stocks_pos";
   stocks_pos = {};
   for (Building *building : buildings) {
@@ -293,6 +292,20 @@ AI::update_stocks_pos() {
 }
 
 
+// the game thread applies queued changes at the start of each update, even while paused.  Waits
+//  in slices so an AI told to stop is not left waiting on a game that no longer updates
+bool
+AI::wait_for_command(std::future<bool> result) {
+  while (result.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) {
+    if (game->should_ai_stop()) {
+      AILogDebug["util_wait_for_command"] << name << " AI is stopping, not waiting for queued game change";
+      return false;
+    }
+  }
+  return result.get();
+}
+
+
 // destroy all roads in realm, and all disconnected flags, then reconnect them in priority order
 //   attempt to optimize roads once economy is complete.  not working correctly yet
 //     this is a test/hack and NOT used normally (or ever right now)
@@ -302,7 +315,7 @@ AI::rebuild_all_roads() {
   MapPosVector flag_positions;
   AILogDebug["util_rebuild_all_roads"] << name << " destroying all paths";
   AILogDebug["util_rebuild_all_roads"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex for entire rebuild_all_roads function before destroying all roads";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock(LOCK_SITE());
   AILogDebug["util_rebuild_all_roads"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex for entire rebuild_all_roads function before destroying all roads";
   flags_static_copy = *(game->get_flags());
   flags = &flags_static_copy;
@@ -317,14 +330,14 @@ AI::rebuild_all_roads() {
       continue;
     for (Direction dir : cycle_directions_cw()) {
       if (map->has_path(flag->get_position(), dir))
-        game->demolish_road(map->move(flag->get_position(), dir), player);
+        game->get_commands()->demolish_road(map->move(flag->get_position(), dir), player_index);
     }
     flag_positions.push_back(flag->get_position());
   }
   AILogDebug["util_rebuild_all_roads"] << name << " destroying all unattached flags";
   for (MapPos flag_pos : flag_positions) {
     if (map->has_flag(flag_pos))
-      game->demolish_flag(flag_pos, player);
+      game->get_commands()->demolish_flag(flag_pos, player_index);
   }
 
   AILogDebug["util_rebuild_all_roads"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex for entire rebuild_all_roads function after destroying all roads";
@@ -372,7 +385,7 @@ AI::rebuild_all_roads() {
       // skip mines that aren't yet built
       if (!building->is_done() && building->get_type() >= Building::TypeStoneMine && building->get_type() <= Building::TypeGoldMine)
         continue;
-      ai_mark_pos.insert(ColorDot(building->get_position(), "blue"));
+      ai_mark_pos.insert(ColorDot(building->get_position(), MarkBlue));
       if (!AI::build_best_road(map->move_down_right(building->get_position()), road_options)) {
         AILogDebug["util_rebuild_all_roads"] << name << " failed to connect high priority building at pos " << building->get_position() << " to affinity building / road network!";
       }
@@ -396,7 +409,7 @@ AI::rebuild_all_roads() {
       continue;
     }
     AILogDebug["util_rebuild_all_roads"] << name << " found a baker at pos " << map->move_down_right(building->get_position());
-    ai_mark_pos.insert(ColorDot(building->get_position(), "orange"));
+    ai_mark_pos.insert(ColorDot(building->get_position(), MarkOrange));
     if (!AI::build_best_road(map->move_down_right(building->get_position()), road_options, Building::TypeCoalMine)) {
       AILogDebug["util_rebuild_all_roads"] << name << " failed to connect baker at pos " << building->get_position() << " to coal mine / road network!";
     }
@@ -443,7 +456,7 @@ AI::rebuild_all_roads() {
       // skip mines that aren't yet built
       if (!building->is_done() && building->get_type() >= Building::TypeStoneMine && building->get_type() <= Building::TypeGoldMine)
         continue;
-      ai_mark_pos.insert(ColorDot(building->get_position(), "purple"));
+      ai_mark_pos.insert(ColorDot(building->get_position(), MarkPurple));
       if (!AI::build_best_road(map->move_down_right(building->get_position()), road_options)) {
         AILogDebug["util_rebuild_all_roads"] << name << " failed to connect high priority building at pos " << building->get_position() << " to affinity building / road network!";
       }
@@ -480,7 +493,7 @@ AI::rebuild_all_roads() {
     // skip buildings that already have paths (from earlier high priority buildings connections)
     if (game->get_flag(building->get_flag_index())->is_connected())
       continue;
-    //ai_mark_pos.insert(ColorDot(building->get_position(), "green"));
+    //ai_mark_pos.insert(ColorDot(building->get_position(), MarkGreen));
     if (!AI::build_best_road(map->move_down_right(building->get_position()), road_options)) {
       AILogDebug["util_rebuild_all_roads"] << name << " failed to connect civilian building at pos " << building->get_position() << " to road network!";
     }
@@ -498,7 +511,7 @@ AI::rebuild_all_roads() {
         AILogDebug["util_rebuild_all_roads"] << name << " this military building is on fire!  skipping";
         continue;
       }
-      ai_mark_pos.insert(ColorDot(building->get_position(), "coral"));
+      ai_mark_pos.insert(ColorDot(building->get_position(), MarkCoral));
       if (!AI::build_best_road(map->move_down_right(building->get_position()), road_options)) {
         AILogDebug["util_rebuild_all_roads"] << name << " failed to connect military building at pos " << building->get_position() << " to road network!";
       }
@@ -588,11 +601,11 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
       AILogDebug["util_build_best_road"] << name << " couldn't find any completed optional_affinity building nearby, checking entire realm";
       bool found = false;
       AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for optional_affinity)";
-      game->get_mutex()->lock();
+      game->get_mutex()->lock_shared(LOCK_SITE());
       AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for optional_affinity)";
       Game::ListBuildings buildings = game->get_player_buildings(player);
       AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for optional_affinity)";
-      game->get_mutex()->unlock();
+      game->get_mutex()->unlock_shared();
       AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for optional_affinity)";
       for (Building *building : buildings) {
         if (building->get_type() != optional_affinity)
@@ -671,13 +684,8 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
       //split_roads list is not actually used for direct roads.  It is required/included but ignored
 
       Road proposed_direct_road = plot_road(map, player_index, start_pos, target_pos, &split_roads);
-      AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->build_road (direct road)";
-      game->get_mutex()->lock();
-      AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->build_road (direct road)";
-      bool was_built = game->build_road(proposed_direct_road, player);
-      AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->build_road (direct road)";
-      game->get_mutex()->unlock();
-      AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->build_road (direct road)";
+      AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply build_road (direct road)";
+      bool was_built = wait_for_command(game->get_commands()->build_road(proposed_direct_road, player_index));
       if (was_built) {
         AILogDebug["util_build_best_road"] << name << " successfully built direct road directly from flag at " << start_pos << " to flag at " << target_pos;
         //roads_built++;
@@ -694,9 +702,8 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
     // ## non-Direct ## roads terminate at best scoring acceptable end_pos flag, which could be a direct route to the target flag or join an existing road
     //
     AILogDebug["util_build_best_road"] << name << " non-direct road requested, trying to connect flag at pos " << start_pos << " to road network using scoring system";
-    RoadBuilder rb;
-    rb.set_start_pos(start_pos);
-    rb.set_target_pos(target_pos);
+    RoadBuilderPool::Lease rb_lease(&road_builders, start_pos, target_pos);
+    RoadBuilder &rb = *rb_lease;
     MapPosVector nearby_flags;
 
     // if RoadOption::Improve is set and any paths already exist from start_pos, trace these roads and save for later scoring
@@ -734,7 +741,7 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
     //   BUT will quit any time after 6 tiles that at least one flag is found
     for (unsigned int i = 0; i < AI::spiral_dist(15); i++) {
       MapPos pos = map->pos_add_extended_spirally(halfway_pos, i);
-      //ai_mark_pos.insert(std::make_pair(pos, "dk_brown"));
+      //ai_mark_pos.insert(ColorDot(pos, MarkDkBrown));
       //std::this_thread::sleep_for(std::chrono::milliseconds(5));
       // skip if no flag, or pos not owned by this player
       if (!map->has_flag(pos) || map->get_owner(pos) != player_index) {
@@ -766,7 +773,7 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
       }
       nearby_flags.push_back(pos);
       //ai_mark_pos.erase(pos);
-      //ai_mark_pos.insert(std::make_pair(pos, "orange"));
+      //ai_mark_pos.insert(ColorDot(pos, MarkOrange));
       //std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
       // quit search after spiral_dist(6) tiles if at least one flag found
@@ -812,10 +819,17 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
     //      flags & splitting existing roads, unless RoadOption::SplitRoads if set to false
     //   - sort the results by 'adjusted_score' ("adjusted length", or "overall length including existing, new length, and penalties"
     //   - build the best road (if better than best existing road)
-    for (MapPos end_pos : nearby_flags) {
-      AILogDebug["util_build_best_road"] << name << " preparing to plot road from start_pos " << start_pos << " to nearby_flag pos " << end_pos;
+    // the candidate roads are plotted side by side, then looked at in nearby_flags order.  Each
+    //  candidate's split roads are added to split_roads in that order too, as if plotted one by one
+    std::vector<Road> potential_roads;
+    std::vector<Roads> potential_split_roads;
+    plot_roads(map, player_index, start_pos, nearby_flags, &potential_roads, &potential_split_roads);
+    for (size_t candidate = 0; candidate < nearby_flags.size(); candidate++) {
+      MapPos end_pos = nearby_flags[candidate];
+      AILogDebug["util_build_best_road"] << name << " looking at plotted road from start_pos " << start_pos << " to nearby_flag pos " << end_pos;
       // it might be faster to have plot_road return the RoadEnds, but it seems messier
-      Road potential_road = plot_road(map, player_index, start_pos, end_pos, &split_roads);
+      Road potential_road = potential_roads[candidate];
+      split_roads.insert(split_roads.end(), potential_split_roads[candidate].begin(), potential_split_roads[candidate].end());
       if (potential_road.get_length() == 0) {
         AILogDebug["util_build_best_road"] << name << " unable to plot_road from start_pos " << start_pos << " to nearby_flag pos " << end_pos << ", skipping";
         continue;
@@ -830,7 +844,7 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
       AILogDebug["util_build_best_road"] << name << " this potential road solution is acceptable so far in terms of NEW length only, adding to RoadBuilder potential_roads";
       RoadEnds potential_road_ends = get_roadends(map, potential_road);
       rb.new_proad(potential_road_ends, potential_road);
-      AILogDebug["util_build_best_road"] << name << " there are currently " << rb.get_proads().size() << " potential_roads in the list";
+      AILogDebug["util_build_best_road"] << name << " there are currently " << rb.get_proad_count() << " potential_roads in the list";
       //
       // now do the same thing for any potential_roads found (flag-splitting), could make this a recursive function call instead...
       //
@@ -856,7 +870,7 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
         AILogDebug["util_build_best_road"] << name << " this split_road road solution is acceptable so far in terms of NEW length only, adding to RoadBuilder potential_roads";
         RoadEnds split_road_ends = get_roadends(map, split_road);
         rb.new_proad(split_road_ends, split_road);
-        AILogDebug["util_build_best_road"] << name << " there are currently " << rb.get_proads().size() << " potential_roads in the list";
+        AILogDebug["util_build_best_road"] << name << " there are currently " << rb.get_proad_count() << " potential_roads in the list";
       }
 
     }
@@ -876,15 +890,14 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
     unsigned int best_eroad_score = bad_score;
     if (game->get_flag_at_pos(start_pos)->is_connected() && road_options.test(RoadOption::Improve)) {
       AILogDebug["util_build_best_road"] << name << " checking eroads because start_pos already has paths and RoadOption::Improve is set";
-      for (std::pair<RoadEnds, RoadBuilderRoad*> er : rb.get_eroads()) {
-        RoadEnds ends = er.first;
+      for (RoadBuilderRoads::Entry er : rb.get_eroads()) {
         MapPos start_pos = er.second->get_end1();
         MapPos start_dir = er.second->get_dir1();
         MapPos nearby_eroad_flag_pos = er.second->get_end2();
         AILogDebug["util_build_best_road"] << name << " found an existing road from start_pos " << start_pos << " in dir " << NameDirection[start_dir] << " to nearby_flag_pos " << nearby_eroad_flag_pos << ", checking score to target_pos " << target_pos;
         AILogDebug["util_build_best_road"] << name << " debug - checking score for nearby_eroad_flag_pos " << nearby_eroad_flag_pos << " to target_pos " << target_pos << " BEFORE find_flag_and_tile_dist is called to see if there will be a collision";
         AILogDebug["util_build_best_road"] << name << " debug - BEFORE score: flag_dist " << rb.get_score(nearby_eroad_flag_pos).get_flag_dist() << ", tile dist " << rb.get_score(nearby_eroad_flag_pos).get_tile_dist();
-        if (!find_flag_and_tile_dist(map, player_index, &rb, nearby_eroad_flag_pos, target_pos, &ai_mark_pos)) {
+        if (!find_flag_and_tile_dist(map, &rb, nearby_eroad_flag_pos, target_pos)) {
           AILogDebug["util_build_best_road"] << name << " eroad: find_flag_and_tile_dist returned false for nearby_eroad_flag_pos " << nearby_eroad_flag_pos << "!";
           continue;
         }
@@ -929,26 +942,25 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
     // foreach potential new road (proad) to be built to a nearby flag
     //  score the existing road (eroad) that begins at the flag/pos where the proad ends
     AILogDebug["util_build_best_road"] << name << " preparing to score potential new roads from start_pos to nearby_flag positions";
-    MapPosSet scored_proads;
-    for (std::pair<RoadEnds, RoadBuilderRoad*> pr : rb.get_proads()) {
-      RoadEnds ends = pr.first;
+    MapPosRanking scored_proads;
+    for (RoadBuilderRoads::Entry pr : rb.get_proads()) {
       RoadBuilderRoad *rbroad = pr.second;
       MapPos start_pos = pr.second->get_end1();
       MapPos nearby_flag_pos = pr.second->get_end2();
       AILogDebug["util_build_best_road"] << name << " found an potential new road to nearby_flag_pos " << nearby_flag_pos;
       // why is this scoring route to castle_flag pos?  shouldn't it be to target_pos for affinity building??
-      //if (!score_flag(map, player_index, &rb, road_options, nearby_flag_pos, castle_flag_pos, &ai_mark_pos)) {
+      //if (!score_flag(map, player_index, &rb, road_options, nearby_flag_pos, castle_flag_pos)) {
       // trying this instead - may04 2020
       //  WAIT WAIT WAIT, i think castle_flag_pos is only used to pass the location of castle flag so the contains_castle_flag bool can be set!
       //     it isn't actually using it as the target!  setting it back
-      //if (!score_flag(map, player_index, &rb, road_options, nearby_flag_pos, target_pos, &ai_mark_pos)) {
-      if (!score_flag(map, player_index, &rb, road_options, nearby_flag_pos, castle_flag_pos, &ai_mark_pos)) {
+      //if (!score_flag(map, player_index, &rb, road_options, nearby_flag_pos, target_pos)) {
+      if (!score_flag(map, player_index, &rb, road_options, nearby_flag_pos, castle_flag_pos)) {
         AILogDebug["util_build_best_road"] << name << " proad: score_flag returned false for nearby_flag_pos " << nearby_flag_pos << "!";
         continue;
       }
       AILogDebug["util_build_best_road"] << name << " proad: score_flag returned true for nearby_flag_pos " << nearby_flag_pos;
       // then add the score of the new segment and apply any penalties
-      //    and insert adjusted_scores into MapPosSet for sorting later
+      //    and insert adjusted_scores into MapPosRanking for sorting later
       AILogDebug["util_build_best_road"] << name << " preparing to apply penalties to proad from start_pos " << start_pos << " to nearby_flag_pos " << nearby_flag_pos;
       FlagScore nearby_flag_score = rb.get_score(nearby_flag_pos);
       unsigned int tile_dist = nearby_flag_score.get_tile_dist();
@@ -1064,20 +1076,15 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
       bool created_new_flag = false;
       if (game->get_flag_at_pos(end_pos) == nullptr) {
         AILogDebug["util_build_best_road"] << name << " end_pos " << end_pos << " has no flag, must be fake flag/split road, trying to create a real flag";
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->build_flag (split road)";
-        game->get_mutex()->lock();
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->build_flag (split road)";
-        bool was_built = game->build_flag(end_pos, player);
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->build_flag (split road)";
-        game->get_mutex()->unlock();
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->build_flag (split road)";
+        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply build_flag (split road)";
+        bool was_built = wait_for_command(game->get_commands()->build_flag(end_pos, player_index));
         if (was_built) {
           AILogDebug["util_build_best_road"] << name << " successfully built new flag at end_pos " << end_pos << ", splitting the road";
           created_new_flag = true;
         }
         else {
           AILogDebug["util_build_best_road"] << name << " failed to build flag at end_pos " << end_pos << ", FIND OUT WHY!  not trying to build this road.  marking pos in blue";
-          ai_mark_pos.insert(ColorDot(end_pos, "blue"));
+          ai_mark_pos.insert(ColorDot(end_pos, MarkBlue));
           std::this_thread::sleep_for(std::chrono::milliseconds(5000));
           continue;
         }
@@ -1093,13 +1100,8 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
           AILogDebug["util_build_best_road"] << name << " TODO - check to see if this road is better than the first one built!";
         }
         AILogDebug["util_build_best_road"] << name << " about to build road, dumping some road stats.  source=" << road.get_source() << ", end=" << road.get_end(game->get_map().get());
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->build_road (non-direct road)";
-        game->get_mutex()->lock();
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->build_road (non-direct road)";
-        bool was_built = game->build_road(road, game->get_player(player_index));
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->build_road (non-direct road)";
-        game->get_mutex()->unlock();
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->build_road (non-direct road)";
+        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply build_road (non-direct road)";
+        bool was_built = wait_for_command(game->get_commands()->build_road(road, player_index));
         if (was_built) {
           AILogDebug["util_build_best_road"] << name << " successfully built road from " << start_pos << " to " << end_pos << " as specified in PotentialRoad";
           roads_built++;
@@ -1114,13 +1116,8 @@ AI::build_best_road(MapPos start_pos, RoadOptions road_options, Building::Type o
       }
       if (created_new_flag) {
         AILogDebug["util_build_best_road"] << name << " removing the newly created flag at end_pos so it doesn't screw up the rest of the road solutions";
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->demolish_flag (couldn't connect new flag)";
-        game->get_mutex()->lock();
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->demolish_flag (couldn't connect new flag)";
-        game->demolish_flag(end_pos, game->get_player(player_index));
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->demolish_flag (couldn't connect new flag)";
-        game->get_mutex()->unlock();
-        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->demolish_flag (couldn't connect new flag)";
+        AILogDebug["util_build_best_road"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply demolish_flag (couldn't connect new flag)";
+        wait_for_command(game->get_commands()->demolish_flag(end_pos, player_index));
       }
       AILogDebug["util_build_best_road"] << name << " done trying to build road from " << start_pos << " to " << end_pos;
     } // end foreach end_pos
@@ -1223,11 +1220,11 @@ AI::get_affinity(MapPos flag_pos) {
         AILogDebug["util_get_affinity"] << name << " couldn't find any first_affinity building nearby, checking entire realm";
         bool found = false;
         AILogDebug["util_get_affinity"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for get_affinity)";
-        game->get_mutex()->lock();
+        game->get_mutex()->lock_shared(LOCK_SITE());
         AILogDebug["util_get_affinity"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for get_affinity)";
         Game::ListBuildings buildings = game->get_player_buildings(player);
         AILogDebug["util_get_affinity"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for get_affinity)";
-        game->get_mutex()->unlock();
+        game->get_mutex()->unlock_shared();
         AILogDebug["util_get_affinity"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for get_affinity)";
         for (Building *building : buildings) {
           if (building->get_type() == first_affinity) {
@@ -1278,11 +1275,11 @@ AI::get_affinity(MapPos flag_pos) {
         AILogDebug["util_get_affinity"] << name << " couldn't find any second_affinity building nearby, checking entire realm";
         bool found = false;
         AILogDebug["util_get_affinity"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for get_affinity)";
-        game->get_mutex()->lock();
+        game->get_mutex()->lock_shared(LOCK_SITE());
         AILogDebug["util_get_affinity"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for get_affinity)";
         Game::ListBuildings buildings = game->get_player_buildings(player);
         AILogDebug["util_get_affinity"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for get_affinity)";
-        game->get_mutex()->unlock();
+        game->get_mutex()->unlock_shared();
         AILogDebug["util_get_affinity"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for get_affinity)";
         for (Building *building : buildings) {
           if (building->get_type() == second_affinity) {
@@ -1321,39 +1318,59 @@ AI::get_affinity(MapPos flag_pos) {
 }
 
 
-// return Building* for first building of the specified type exists within specified distance from pos
+// the live building for a snapshot BuildingView, or nullptr if it has gone or its index was reused since
+Building*
+AI::get_live_building(const GameSnapshot::BuildingView *view) {
+  if (view == nullptr)
+    return nullptr;
+  Building *building = game->get_building(view->index);
+  if (building == nullptr || building->get_type() != view->type || building->get_position() != view->pos)
+    return nullptr;
+  return building;
+}
+
+// return Building* for the nearest building of the specified type within specified distance from pos, of any player
+//  the buildings are looked up by type in the game snapshot rather than by walking the spiral
 Building*
 AI::find_nearest_building(MapPos center_pos, unsigned int distance, Building::Type building_type) {
   AILogDebug["util_find_nearest_building"] << name << " inside find_nearest_building " << NameBuilding[building_type] << ", distance " << distance << ", and target pos " << center_pos;
-  for (unsigned int i = 0; i < distance; i++) {
-    MapPos pos = map->pos_add_extended_spirally(center_pos, i);
-    if (!map->has_building(pos))
-      continue;
-    if (game->get_building_at_pos(pos)->get_type() == building_type) {
-      AILogDebug["util_find_nearest_building"] << name << " found a building of type " << NameBuilding[building_type] << " at pos " << pos;
-      return game->get_building_at_pos(pos);
-    }
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  int radius = spiral_radius(distance);
+  const GameSnapshot::BuildingView *nearest = nullptr;
+  for (unsigned int owner = 0; owner < GameSnapshot::max_players; owner++) {
+    const GameSnapshot::BuildingView *view = snapshot->nearest_building(owner, building_type, center_pos, radius,
+                                              [](const GameSnapshot::BuildingView &) { return true; });
+    if (view != nullptr && (nearest == nullptr || snapshot->tile_dist(center_pos, view->pos) < snapshot->tile_dist(center_pos, nearest->pos)))
+      nearest = view;
+  }
+  Building *building = get_live_building(nearest);
+  if (building != nullptr) {
+    AILogDebug["util_find_nearest_building"] << name << " found a building of type " << NameBuilding[building_type] << " at pos " << building->get_position();
+    return building;
   }
 
   AILogDebug["util_find_nearest_building"] << name << " no nearby building found of type " << NameBuilding[building_type] << ", returning nullptr";
   return nullptr;
 }
 
-// return Building* for first building of the specified type exists within specified distance from pos
+// return Building* for the nearest building of the specified type within specified distance from pos, of any player
 //   THAT IS FULLY BUILT
 Building*
 AI::find_nearest_completed_building(MapPos center_pos, unsigned int distance, Building::Type building_type) {
   AILogDebug["util_find_nearest_completed_building"] << name << " inside find_nearest_completed_building " << NameBuilding[building_type] << ", distance " << distance << ", and target pos " << center_pos;
-  for (unsigned int i = 0; i < distance; i++) {
-    MapPos pos = map->pos_add_extended_spirally(center_pos, i);
-    if (!map->has_building(pos))
-      continue;
-    if (game->get_building_at_pos(pos)->get_type() != building_type)
-      continue;
-    if (!game->get_building_at_pos(pos)->is_done())
-      continue;
-    AILogDebug["util_find_nearest_completed_building"] << name << " found a completed building of type " << NameBuilding[building_type] << " at pos " << pos;
-    return game->get_building_at_pos(pos);
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  int radius = spiral_radius(distance);
+  const GameSnapshot::BuildingView *nearest = nullptr;
+  for (unsigned int owner = 0; owner < GameSnapshot::max_players; owner++) {
+    const GameSnapshot::BuildingView *view = snapshot->nearest_building(owner, building_type, center_pos, radius,
+                                              [](const GameSnapshot::BuildingView &view) { return view.done; });
+    if (view != nullptr && (nearest == nullptr || snapshot->tile_dist(center_pos, view->pos) < snapshot->tile_dist(center_pos, nearest->pos)))
+      nearest = view;
+  }
+  Building *building = get_live_building(nearest);
+  if (building != nullptr) {
+    AILogDebug["util_find_nearest_completed_building"] << name << " found a completed building of type " << NameBuilding[building_type] << " at pos " << building->get_position();
+    return building;
   }
 
   AILogDebug["util_find_nearest_completed_building"] << name << " no nearby completed building found of type " << NameBuilding[building_type] << ", returning nullptr";
@@ -1365,16 +1382,11 @@ AI::find_nearest_completed_building(MapPos center_pos, unsigned int distance, Bu
 bool
 AI::building_exists_near_pos(MapPos center_pos, unsigned int distance, Building::Type building_type) {
   AILogDebug["util_building_exists_near_pos"] << name << " inside AI::building_exists_near_pos with type " << NameBuilding[building_type] << ", distance " << distance << ", and target pos " << center_pos;
-  for (unsigned int i = 0; i < distance; i++) {
-    //AILogDebug["util_building_exists_near_pos"] << name << " inside AI::building_exists_near_pos debug2, i=" << i;
-    MapPos pos = map->pos_add_extended_spirally(center_pos, i);
-    //AILogDebug["util_building_exists_near_pos"] << name << " inside AI::building_exists_near_pos debug3";
-    if (!map->has_building(pos) || map->get_owner(pos) != player_index)
-      continue;
-    if (game->get_building_at_pos(pos)->get_type() == building_type) {
-      AILogDebug["util_building_exists_near_pos"] << name << " found a building of type " << NameBuilding[building_type] << " at pos " << pos;
-      return true;
-    }
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  const GameSnapshot::BuildingView *found[1];
+  if (snapshot->nearest_buildings(player_index, building_type, center_pos, spiral_radius(distance), found, 1) > 0) {
+    AILogDebug["util_building_exists_near_pos"] << name << " found a building of type " << NameBuilding[building_type] << " at pos " << found[0]->pos;
+    return true;
   }
 
   AILogDebug["util_building_exists_near_pos"] << name << " no building found of type " << NameBuilding[building_type] << " near center_pos " << center_pos << ", returning false";
@@ -1395,83 +1407,36 @@ AI::find_halfway_pos_between_buildings(Building::Type first, Building::Type seco
   MapPos found_pos[2] = { bad_map_pos, bad_map_pos };
   for (int x = 0; x < 2; x++) {
     AILogDebug["util_find_halfway_pos_between_buildings"] << name << " searching this stock area for a building of type" << x << " " << NameBuilding[type[x]];
+    // prefer an occupied building, then a completed one, then any (which still needs a serf, as before)
+    const char *wanted = nullptr;
+    bool (*accept)(const GameSnapshot::BuildingView &) = nullptr;
     if (stock_buildings.at(stock_pos).occupied_count[type[x]] >= 1) {
-      AILogDebug["util_find_halfway_pos_between_buildings"] << name << " searching for an OCCUPIED building of type" << x << " " << NameBuilding[type[x]];
-      for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
-        for (unsigned int i = 0; i < spiral_dist(9); i++) {
-          MapPos pos = map->pos_add_extended_spirally(center_pos, i);
-          if (!map->has_building(pos))
-            continue;
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " found a building at pos " << pos;
-          Building *building = game->get_building_at_pos(pos);
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " is of type " << NameBuilding[building->get_type()];
-          if (building->get_type() != type[x]) {
-            AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " of type " << NameBuilding[building->get_type()] << " is not the right type, continuing";
-            continue;
-          }
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " of type " << NameBuilding[building->get_type()] << " is the right type, checking its status";
-          if (building->is_done() && building->has_serf()) {
-            found_pos[x] = building->get_position();
-            AILogDebug["util_find_halfway_pos_between_buildings"] << name << " found an acceptable OCCUPIED building of type" << x << " " << NameBuilding[type[x]] << " at pos " << found_pos[x];
-            break;
-          }
-        }
-
-      }
+      wanted = "OCCUPIED";
+      accept = [](const GameSnapshot::BuildingView &view) { return view.done && view.has_serf; };
     }
     else if (completed_building_count[type[x]] >= 1) {
-      AILogDebug["util_find_halfway_pos_between_buildings"] << name << " searching for a COMPLETED building of type" << x << " " << NameBuilding[type[x]];
-      for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
-        for (unsigned int i = 0; i < spiral_dist(9); i++) {
-          MapPos pos = map->pos_add_extended_spirally(center_pos, i);
-          if (!map->has_building(pos))
-            continue;
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " found a building at pos " << pos;
-          Building *building = game->get_building_at_pos(pos);
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " is of type " << NameBuilding[building->get_type()];
-          if (building->get_type() != type[x]) {
-            AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " of type " << NameBuilding[building->get_type()] << " is not the right type, continuing";
-            continue;
-          }
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " of type " << NameBuilding[building->get_type()] << " is the right type, checking its status";
-          if (building->is_done()) {
-            found_pos[x] = building->get_position();
-            AILogDebug["util_find_halfway_pos_between_buildings"] << name << " found an acceptable COMPLETED building of type" << x << " " << NameBuilding[type[x]] << " at pos " << found_pos[x];
-            break;
-          }
-        }
-
-      }
+      wanted = "COMPLETED";
+      accept = [](const GameSnapshot::BuildingView &view) { return view.done; };
     }
     else if (building_count[type[x]] >= 1) {
-      AILogDebug["util_find_halfway_pos_between_buildings"] << name << " searching for ANY building of type" << x << " " << NameBuilding[type[x]];
-      for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
-        AILogDebug["util_find_halfway_pos_between_buildings"] << name << " searching around center_pos " << center_pos;
-        for (unsigned int i = 0; i < spiral_dist(9); i++) {
-          MapPos pos = map->pos_add_extended_spirally(center_pos, i);
-          if (!map->has_building(pos))
-            continue;
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " found a building at pos " << pos;
-          Building *building = game->get_building_at_pos(pos);
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " is of type " << NameBuilding[building->get_type()];
-          if (building->get_type() != type[x]) {
-            AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " of type " << NameBuilding[building->get_type()] << " is not the right type, continuing";
-            continue;
-          }
-          AILogDebug["util_find_halfway_pos_between_buildings"] << name << " building at pos " << pos << " of type " << NameBuilding[building->get_type()] << " is the right type, checking its status";
-          if (building->has_serf()) {
-            found_pos[x] = building->get_position();
-            AILogDebug["util_find_halfway_pos_between_buildings"] << name << " found an acceptable ANY building of type" << x << " " << NameBuilding[type[x]] << " at pos " << found_pos[x];
-            break;
-          }
-        }
-
-      }
+      wanted = "ANY";
+      accept = [](const GameSnapshot::BuildingView &view) { return view.has_serf; };
     }
     else {
       AILogDebug["util_find_halfway_pos_between_buildings"] << name << " no buildings of type" << x << " " << NameBuilding[type[x]] << " known in realm, returning bad_map_pos";
       return bad_map_pos;
     }
+    AILogDebug["util_find_halfway_pos_between_buildings"] << name << " searching for an " << wanted << " building of type" << x << " " << NameBuilding[type[x]];
+    // as with the spiral search this replaced, the nearest acceptable building around the last
+    //  military building that has one wins
+    std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+    for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
+      const GameSnapshot::BuildingView *view = snapshot->nearest_building(player_index, type[x], center_pos, 9, accept);
+      if (view != nullptr) {
+        found_pos[x] = view->pos;
+        AILogDebug["util_find_halfway_pos_between_buildings"] << name << " found an acceptable " << wanted << " building of type" << x << " " << NameBuilding[type[x]] << " at pos " << found_pos[x];
+      }
+    }
     // this shouldn't happen if update_building_counts() is accurate unless building was destroyed while searching
     if (found_pos[x] == bad_map_pos) {
       AILogDebug["util_find_halfway_pos_between_buildings"] << name << " could not find expected building of type" << x << " " << NameBuilding[type[x]] << " in realm despite being known! returning bad_map_pos";
@@ -1499,13 +1464,23 @@ AI::trace_existing_road(PMap map, MapPos start_pos, Direction dir) {
     return road;
   }
   road.start(start_pos);
+  // a real flag already has the tiles of its paths
+  if (map->has_flag(start_pos)) {
+    Flag *flag = game->get_flag_at_pos(start_pos);
+    if (flag != nullptr && !flag->get_path_tiles(dir).empty()) {
+      for (const Flag::PathTile &tile : flag->get_path_tiles(dir)) {
+        road.extend(tile.dir);
+      }
+      return road;
+    }
+  }
   //ai_mark_road.start(start_pos);
   MapPos pos = start_pos;
   while (true) {
     road.extend(dir);
     //ai_mark_road->extend(dir);
     pos = map->move(pos, dir);
-    std::this_thread::sleep_for(std::chrono::milliseconds(0));
+    checkpoint();
     if (map->has_flag(pos) && pos != start_pos) {
       //AILogDebug["util_trace_existing_road"] << name << " flag found at pos " << pos << ", returning road (which has length " << road.get_length() << ")";
       //ai_mark_road->invalidate();
@@ -1563,7 +1538,7 @@ AI::get_corners(MapPos center, unsigned int distance) {
 
 // return count of terrain tiles of the specified type range, like hills (Tundra)
 unsigned int
-AI::count_terrain_near_pos(MapPos center_pos, unsigned int distance, Map::Terrain res_start_index, Map::Terrain res_end_index, std::string color) {
+AI::count_terrain_near_pos(MapPos center_pos, unsigned int distance, Map::Terrain res_start_index, Map::Terrain res_end_index, MarkColor color) {
   AILogDebug["util_count_terrain_near_pos"] << name << " inside count_terrain_near_pos";
   //AILogDebug["util_count_terrain_near_pos"] << name << " AI: inside AI::count_terrain_near_pos";
   //AILogDebug["util_count_terrain_near_pos"] << name << " AI: center_pos " << center_pos << ", distance " << distance << ", res_start_index " << NameTerrain[res_start_index] << ", res_end_index " << NameTerrain[res_end_index];
@@ -1571,7 +1546,7 @@ AI::count_terrain_near_pos(MapPos center_pos, unsigned int distance, Map::Terrai
   for (unsigned int i = 0; i < distance; i++) {
     MapPos pos = map->pos_add_extended_spirally(center_pos, i);
     //AILogDebug["util_count_terrain_near_pos"] << name << " AI: terrain at pos " << pos << " has type " << terrain;
-    if (AI::has_terrain_type(game, pos, res_start_index, res_end_index)) {
+    if (AI::has_terrain_type(*map, pos, res_start_index, res_end_index)) {
       //AILogDebug["util_count_terrain_near_pos"] << name << " AI: found matching terrain at pos " << pos;
       ++count;
     }
@@ -1586,7 +1561,7 @@ AI::count_terrain_near_pos(MapPos center_pos, unsigned int distance, Map::Terrai
 // this function is almost identical to count_farmable_land except it doesn't include existing wheat fiels
 //  maybe merge them?  Or make this one geologist/hill-specific
 unsigned int
-AI::count_empty_terrain_near_pos(MapPos center_pos, unsigned int distance, Map::Terrain res_start_index, Map::Terrain res_end_index, std::string color) {
+AI::count_empty_terrain_near_pos(MapPos center_pos, unsigned int distance, Map::Terrain res_start_index, Map::Terrain res_end_index, MarkColor color) {
   AILogDebug["util_count_empty_terrain_near_pos"] << name << " inside count_terrain_near_pos";
   //AILogDebug["util_count_empty_terrain_near_pos"] << name << " AI: inside AI::count_empty_terrain_near_pos";
   //AILogDebug["util_count_empty_terrain_near_pos"] << name << " AI: center_pos " << center_pos << ", distance " << distance << ", res_start_index " << NameTerrain[res_start_index] << ", res_end_index " << NameTerrain[res_end_index];
@@ -1594,7 +1569,7 @@ AI::count_empty_terrain_near_pos(MapPos center_pos, unsigned int distance, Map::
   for (unsigned int i = 0; i < distance; i++) {
     MapPos pos = map->pos_add_extended_spirally(center_pos, i);
     //AILogDebug["util_count_empty_terrain_near_pos"] << name << " AI: terrain at pos " << pos << " has type " << terrain;
-    if (AI::has_terrain_type(game, pos, res_start_index, res_end_index)) {
+    if (AI::has_terrain_type(*map, pos, res_start_index, res_end_index)) {
       Map::Object obj_type = map->get_obj(pos);
       // exclude tiles with blocking objects (anything not on this list)
       if (obj_type == Map::ObjectNone
@@ -1611,7 +1586,7 @@ AI::count_empty_terrain_near_pos(MapPos center_pos, unsigned int distance, Map::
 // count farmable land  - count the number of grass tiles, with no paths,
 //     and no obstacles (other than existing wheat fields)
 unsigned int
-AI::count_farmable_land(MapPos center_pos, unsigned int distance, std::string color) {
+AI::count_farmable_land(MapPos center_pos, unsigned int distance, MarkColor color) {
   Map::Terrain res_start_index = Map::TerrainGrass0;
   Map::Terrain res_end_index = Map::TerrainGrass3;
   AILogDebug["util_count_farmable_land"] << name << " inside AI::count_farmable_land";
@@ -1620,7 +1595,7 @@ AI::count_farmable_land(MapPos center_pos, unsigned int distance, std::string co
   for (unsigned int i = 0; i < distance; i++) {
     MapPos pos = map->pos_add_extended_spirally(center_pos, i);
     //AILogDebug["util_count_farmable_land"] << name << " AI: terrain at pos " << pos << " has type " << terrain;
-    if (AI::has_terrain_type(game, pos, res_start_index, res_end_index)) {
+    if (AI::has_terrain_type(*map, pos, res_start_index, res_end_index)) {
       Map::Object obj_type = map->get_obj(pos);
       // exclude tiles with blocking objects (anything not on this list)
       if (obj_type == Map::ObjectNone
@@ -1645,38 +1620,23 @@ AI::count_farmable_land(MapPos center_pos, unsigned int distance, std::string co
 }
 
 
-// sort a MapPosSet by value, ascending, and return as sorted vector of the keys (throwing the values away)
+// sort a MapPosRanking by value, ascending, and return as sorted vector of the keys (throwing the values away)
 MapPosVector
-AI::sort_by_val_asc(MapPosSet set) {
+AI::sort_by_val_asc(const MapPosRanking &ranking) {
   AILogDebug["util_sort_by_val_asc"] << name << " inside AI::sort_by_val_asc";
-  // this is C++14 only?  worked on visual studio 2017 on windows but not VC code w/gcc on linux
-  auto cmp = [](const auto &p1, const auto &p2) { return p2.second > p1.second || !(p1.second > p2.second) && p1.first > p2.first; };
-  std::set< std::pair<MapPos, unsigned int>, decltype(cmp)> sorted_set(set.begin(), set.end(), cmp);
-  MapPosVector sorted_vector;
-  for (auto pair : sorted_set) {
-    //AILogDebug["util_sort_by_val_asc"] << name << " sorted MapPosSet pos: " << pair.first << ", val: " << pair.second;
-    sorted_vector.push_back(pair.first);
-  }
-  return sorted_vector;
+  return ranking.lowest_first();
 }
 
-// sort a MapPosSet by value, descending, and return as sorted vector of the keys (throwing the values away)
+// sort a MapPosRanking by value, descending, and return as sorted vector of the keys (throwing the values away)
 MapPosVector
-AI::sort_by_val_desc(MapPosSet set) {
+AI::sort_by_val_desc(const MapPosRanking &ranking) {
   AILogDebug["util_sort_by_val_desc"] << name << " inside AI::sort_by_val_desc";
-  auto cmp = [](const auto &p1, const auto &p2) { return p2.second < p1.second || !(p1.second < p2.second) && p1.first < p2.first; };
-  std::set< std::pair<MapPos, unsigned int>, decltype(cmp)> sorted_set(set.begin(), set.end(), cmp);
-  MapPosVector sorted_vector;
-  for (auto pair : sorted_set) {
-    //AILogDebug["util_sort_by_val_desc"] << name << " sorted MapPosSet pos: " << pair.first << ", val: " << pair.second;
-    sorted_vector.push_back(pair.first);
-  }
-  return sorted_vector;
+  return ranking.best_first();
 }
 
 // return count of individual objects of the specified type range, such as trees or geologist signs
 unsigned int
-AI::count_objects_near_pos(MapPos center_pos, unsigned int distance, Map::Object res_start_index, Map::Object res_end_index, std::string color) {
+AI::count_objects_near_pos(MapPos center_pos, unsigned int distance, Map::Object res_start_index, Map::Object res_end_index, MarkColor color) {
   AILogDebug["util_count_objects_near_pos"] << name << " inside AI::count_objects_near_pos";
   //AILogDebug["util_count_objects_near_pos"] << name << " AI: center_pos " << center_pos << ", distance " << distance << ", res_start_index " << res_start_index << "(" << NameObject[res_start_index] << ")"
   //      << ", res_end_index " << res_end_index << "(" << NameObject[res_end_index] << ")";
@@ -1687,7 +1647,7 @@ AI::count_objects_near_pos(MapPos center_pos, unsigned int distance, Map::Object
       ++count;
       //AILogDebug["util_count_objects_near_pos"] << name << " AI: found matching object at pos " << pos << ", type " << map->get_obj(pos);
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(0));
+    checkpoint();
   }
   //AILogDebug["util_count_objects_near_pos"] << name << " AI: found count " << count << " matching objects of types " << NameObject[res_start_index] << " - " << NameObject[res_end_index];
   return count;
@@ -1769,17 +1729,12 @@ AI::build_near_pos(MapPos center_pos, unsigned int distance, Building::Type buil
       continue;
     }
     // try to build it
-    AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->build_building (build_near_pos) of type " << NameBuilding[building_type];
-    game->get_mutex()->lock();
-    AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->build_building (build_near_pos) of type " << NameBuilding[building_type];
-    bool was_built = game->build_building(pos, building_type, player);
-    AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->build_building (build_near_pos) of type " << NameBuilding[building_type];
-    game->get_mutex()->unlock();
-    AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->build_building (build_near_pos) of type " << NameBuilding[building_type];
+    AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI is waiting for the game to apply build_building (build_near_pos) of type " << NameBuilding[building_type];
+    bool was_built = wait_for_command(game->get_commands()->build_building(pos, building_type, player_index));
     if (!was_built) {
       AILogDebug["util_build_near_pos"] << name << " failed to build building of type " << NameBuilding[building_type] << " despite can_build being true!  WAITING 10sec - look at the pos in cyan!";
       ai_mark_pos.erase(pos);
-      ai_mark_pos.insert(std::make_pair(pos, "cyan"));
+      ai_mark_pos.insert(ColorDot(pos, MarkCyan));
       std::this_thread::sleep_for(std::chrono::milliseconds(10000));
       continue;
     }
@@ -1804,16 +1759,11 @@ AI::build_near_pos(MapPos center_pos, unsigned int distance, Building::Type buil
       AILogDebug["util_build_near_pos"] << name << " failed to connect building (of type " << NameBuilding[building_type] << ")'s flag to road network!  burning it down";
       AILogDebug["util_build_near_pos"] << name << " LOOK AT BUILDING AT POS " << pos << ", MARKED IN CYAN";
       ai_mark_pos.erase(pos);
-      ai_mark_pos.insert(std::make_pair(pos, "cyan"));
+      ai_mark_pos.insert(ColorDot(pos, MarkCyan));
       std::this_thread::sleep_for(std::chrono::milliseconds(5000));
-      AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->demolish_building/flag (build_near_pos failed to connect)";
-      game->get_mutex()->lock();
-      AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->demolish_building/flag (build_near_pos failed to connect)";
-      game->demolish_building(pos, player);
-      game->demolish_flag(flag_pos, player);
-      AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->demolish_building/flag (build_near_pos failed to connect)";
-      game->get_mutex()->unlock();
-      AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->demolish_building/flag (build_near_pos failed to connect)";
+      AILogDebug["util_build_near_pos"] << name << " thread #" << std::this_thread::get_id() << " AI is queueing demolish_building/flag (build_near_pos failed to connect)";
+      game->get_commands()->demolish_building(pos, player_index);
+      game->get_commands()->demolish_flag(flag_pos, player_index);
       // mark as bad pos, to avoid repeateadly rebuilding same building in same spot
       bad_building_pos.insert(std::make_pair(pos, building_type));
     }
@@ -1838,6 +1788,21 @@ AI::build_near_pos(MapPos center_pos, unsigned int distance, Building::Type buil
   return notplaced_pos;
 }
 
+// how much of a resource the realm holds now, or will hold economy_forecast_minutes
+//   ahead if the workers keep taking it, whichever is lower.  Only the change the
+//   forecast expects is used, the count itself comes from the player stats
+unsigned int
+AI::forecast_count(Resource::Type res) {
+  unsigned int count = realm_inv[res];
+  double change = economy.get_projected(res, economy_forecast_minutes) - economy.get_stock(res);
+  AILogDebug["util_forecast_count"] << name << " " << NameResource[res] << " stored " << count << ", forecast to change by " << change << " in " << economy_forecast_minutes << " minutes";
+  if (change >= 0) {
+    return count;
+  }
+  unsigned int drop = static_cast<unsigned int>(-change);
+  return (count > drop) ? count - drop : 0;
+}
+
 // return count of total stones in the area.  A stone pile can have 1-8 stones
 // ALSO, have to work around the original-game bug where a stonecutter cannot harvest stones if a building is directly down-right from a stone pile
 //   To avoid this, do not count stones that have a building down-right from the pile
@@ -1846,7 +1811,6 @@ AI::count_stones_near_pos(MapPos center_pos, unsigned int distance) {
   AILogDebug["util_count_stones_near_pos"] << name << " inside count_stones_near_pos";
   Map::Object res_start_index = Map::ObjectStone0;
   Map::Object res_end_index = Map::ObjectStone7;
-  std::string color = "gray";
   //AILogDebug["util_count_stones_near_pos"] << name << " AI: center_pos " << center_pos << ", distance " << distance << ", res_start_index " << NameObject[res_start_index] << ", res_end_index " << NameObject[res_end_index];
   unsigned int total = 0;
   for (unsigned int i = 0; i < distance; i++) {
@@ -1865,7 +1829,7 @@ AI::count_stones_near_pos(MapPos center_pos, unsigned int distance) {
       }
       total += value;
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(0));
+    checkpoint();
   }
   //AILogDebug["util_count_stones_near_pos"] << name << " AI: found total value " << total << " of objects types " << NameObject[res_start_index] << " - " << NameObject[res_end_index];
   return total;
@@ -1924,17 +1888,19 @@ AI::expand_borders(MapPos center_pos) {
     return stopbuilding_pos;
   }
   MapPos built_pos = bad_map_pos;
-  MapPosSet count_by_corner;
-  for (std::string goal : expand_towards) {
-    AILogDebug["util_expand_borders"] << name << " expand_towards goal list includes item: " << goal;
+  MapPosRanking count_by_corner;
+  for (unsigned int goal = 0; goal < ExpandGoalCount; goal++) {
+    if (expand_towards.test(goal)) {
+      AILogDebug["util_expand_borders"] << name << " expand_towards goal list includes item: " << NameExpandGoal[goal];
+    }
   }
   // get list of military buildings as centers to look around for borders
   AILogDebug["util_expand_borders"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for expand_borders)";
-  game->get_mutex()->lock();
+  game->get_mutex()->lock_shared(LOCK_SITE());
   AILogDebug["util_expand_borders"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for expand_borders)";
   Game::ListBuildings buildings = game->get_player_buildings(player);
   AILogDebug["util_expand_borders"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex after calling game->get_player_buildings(player) (for expand_borders)";
-  game->get_mutex()->unlock();
+  game->get_mutex()->unlock_shared();
   AILogDebug["util_expand_borders"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex after calling game->get_player_buildings(player) (for expand_borders)";
   for (MapPos center_pos : stock_buildings.at(stock_pos).occupied_military_pos) {
     duration = (std::clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
@@ -1995,89 +1961,56 @@ AI::score_area(MapPos center_pos, unsigned int distance) {
   double duration;
   start = std::clock();
   AILogDebug["util_score_area"] << name << " inside AI::score_area, center_pos " << center_pos << ", distance " << distance;
+  // the score depends on the goals and the kind of scoring as well as on the area.  One more row is
+  //  included for has_terrain_type, which looks at the triangles around each pos
+  std::string cache_key = "score_area " + std::to_string(center_pos) + " " + std::to_string(distance) + " "
+    + std::to_string(scoring_warehouse) + std::to_string(scoring_attack) + " "
+    + std::to_string(expand_towards.to_ulong());
+  uint32_t changes = map->get_changes_in(center_pos, spiral_radius(distance) + 1);
+  double cached_value;
+  if (get_cached_area_score(cache_key, changes, &cached_value)) {
+    AILogDebug["util_score_area"] << name << " area " << center_pos << " has not changed since it was scored, score_area value " << cached_value;
+    return static_cast<unsigned int>(cached_value);
+  }
+  // terrain and resources, from the map analysis all the AIs share
+  MapAnalysis::Counts counts = map_analysis->count_in(center_pos, distance, spiral_radius(distance) + 1);
   unsigned int total_value = 0;
-  for (unsigned int i = 0; i < distance; i++) {
+  total_value += expand_towards.test(GoalFoods) * foods_weight * counts.foods;
+  total_value += expand_towards.test(GoalTrees) * trees_weight * counts.trees;
+  total_value += expand_towards.test(GoalStones) * stones_weight * counts.stones;
+  total_value += expand_towards.test(GoalHills) * hills_weight * counts.hills;
+  total_value += expand_towards.test(GoalGoldOre) * gold_ore_weight * counts.gold_signs;
+  total_value += expand_towards.test(GoalIronOre) * iron_ore_weight * counts.iron_signs;
+  total_value += expand_towards.test(GoalCoal) * coal_weight * counts.coal_signs;
+  total_value += expand_towards.test(GoalStones) * stone_signs_weight * counts.stone_signs;
+  AILogDebug["util_score_area"] << name << " area " << center_pos << " has foods " << counts.foods << ", trees " << counts.trees
+    << ", stones " << counts.stones << ", hills " << counts.hills << ", gold_ore " << counts.gold_signs << ", iron_ore " << counts.iron_signs
+    << ", coal " << counts.coal_signs << ", stone signs " << counts.stone_signs << ", value " << total_value;
+  // the rest depends on who owns what, so is only looked at when it counts
+  bool scoring_buffer = !scoring_warehouse && expand_towards.test(GoalCreateBuffer);
+  for (unsigned int i = 0; (scoring_buffer || scoring_attack) && i < distance; i++) {
     MapPos pos = map->pos_add_extended_spirally(center_pos, i);
     Map::Object obj = map->get_obj(pos);
-    //AILogDebug["util_score_area"] << name << " at pos " << pos << " with object type " << NameObject[obj];
     size_t pos_value = 0;  // easier to make this size_t than static_cast all the .size values
-    //
-    // terrain and resources
-    //
-    unsigned int gold_signs = 0;
-    unsigned int iron_signs = 0;
-    unsigned int coal_signs = 0;
-    unsigned int stone_signs = 0;
-    // if grass or water with obstacles, or already having a field...
-    if (obj == Map::ObjectNone &&
-      (AI::has_terrain_type(game, pos, Map::TerrainGrass0, Map::TerrainGrass3) ||
-        AI::has_terrain_type(game, pos, Map::TerrainWater0, Map::TerrainWater3)) ||
-      obj >= Map::ObjectSeeds0 && obj <= Map::ObjectFieldExpired ||
-      obj >= Map::ObjectField0 && obj <= Map::ObjectField5) {
-      pos_value += expand_towards.count("foods") * foods_weight;
-      AILogDebug["util_score_area"] << name << " adding foods count 1 with value " << expand_towards.count("foods") * foods_weight;
-    }
-    if (obj >= Map::ObjectTree0 && obj <= Map::ObjectPine7) {
-      pos_value += expand_towards.count("trees") * trees_weight;
-      AILogDebug["util_score_area"] << name << " adding trees count 1 with value " << expand_towards.count("trees") * trees_weight;
-    }
-    if (obj >= Map::ObjectStone0 && obj <= Map::ObjectStone7) {
-      int stonepile_value = 1 + (-1 * (obj - Map::ObjectStone7));
-      pos_value += expand_towards.count("stones") * stones_weight * stonepile_value;
-      AILogDebug["util_score_area"] << name << " adding stones count " << stonepile_value << " with value " << expand_towards.count("stones") * stones_weight;
-    }
-    if (AI::has_terrain_type(game, pos, Map::TerrainTundra0, Map::TerrainSnow0)) {
-      if (obj >= Map::ObjectSignEmpty && obj <= Map::ObjectSignSmallStone) {
-        AILogDebug["util_score_area"] << name << " found a sign (of type " << NameObject[obj] << "), not counting this hill";
-      }
-      else {
-        pos_value += expand_towards.count("hills") * hills_weight;
-        AILogDebug["util_score_area"] << name << " adding hills count 1 with value " << expand_towards.count("hills") * hills_weight;
-      }
-    }
-    if (obj == Map::ObjectSignLargeGold) { gold_signs += 3; }
-    if (obj == Map::ObjectSignSmallGold) { gold_signs += 1; }
-    if (obj == Map::ObjectSignSmallGold || obj == Map::ObjectSignLargeGold) {
-      pos_value += expand_towards.count("gold_ore") * gold_ore_weight * gold_signs;
-      AILogDebug["util_score_area"] << name << " adding gold_ore count " << gold_signs << " with value " << expand_towards.count("gold_ore") * gold_ore_weight * gold_signs;
-    }
-    if (obj == Map::ObjectSignLargeIron) { iron_signs += 3; }
-    if (obj == Map::ObjectSignSmallIron) { iron_signs += 1; }
-    if (obj == Map::ObjectSignSmallIron || obj == Map::ObjectSignLargeIron) {
-      pos_value += expand_towards.count("iron_ore") * iron_ore_weight * iron_signs;
-      AILogDebug["util_score_area"] << name << " adding iron_ore count " << iron_signs << " with value " << expand_towards.count("iron_ore") * iron_ore_weight * iron_signs;
-    }
-    if (obj == Map::ObjectSignLargeCoal) { coal_signs += 3; }
-    if (obj == Map::ObjectSignSmallCoal) { coal_signs += 1; }
-    if (obj == Map::ObjectSignSmallCoal || obj == Map::ObjectSignLargeCoal) {
-      pos_value += expand_towards.count("coal")      * coal_weight * coal_signs;
-      AILogDebug["util_score_area"] << name << " adding coal count " << coal_signs << " with value " << expand_towards.count("coal_ore") * coal_weight * coal_signs;
-    }
-    if (obj == Map::ObjectSignLargeStone) { stone_signs += 3; }
-    if (obj == Map::ObjectSignSmallStone) { stone_signs += 1; }
-    if (obj == Map::ObjectSignSmallStone || obj == Map::ObjectSignLargeStone) {
-      pos_value += expand_towards.count("stones") * stone_signs_weight * stone_signs;
-      AILogDebug["util_score_area"] << name << " adding stones count " << stone_signs << " with value " << expand_towards.count("stones") * stone_signs_weight * stone_signs;
-    }
-    if (!scoring_warehouse) {
+    if (scoring_buffer) {
       //
       // defense - build knight huts to buffer borders
       //    prioritizing areas with own civ buildings, or any place that enemy territory found
       //
       if (map->get_owner(pos) == player_index) {
         if (obj == Map::ObjectLargeBuilding && !game->get_building_at_pos(pos)->is_military()) {
-          pos_value += expand_towards.count("create_buffer") * 3;
+          pos_value += expand_towards.test(GoalCreateBuffer) * 3;
           AILogDebug["util_score_area"] << name << " adding defensive_buffer building value x3 for large civilian building of type " << NameBuilding[game->get_building_at_pos(pos)->get_type()] << " at pos " << pos;
         }
         if (obj == Map::ObjectSmallBuilding && !game->get_building_at_pos(pos)->is_military()) {
-          pos_value += expand_towards.count("create_buffer") * 1;
+          pos_value += expand_towards.test(GoalCreateBuffer) * 1;
           AILogDebug["util_score_area"] << name << " adding defensive_buffer building value x1 for small civilian building of type " << NameBuilding[game->get_building_at_pos(pos)->get_type()] << " at pos " << pos;
         }
       }
       // does -1 mean unowned?   need to check
       //  this code does seem to work so that must be the case
       if (map->get_owner(pos) != player_index && map->get_owner(pos) != -1) {
-        pos_value += expand_towards.count("create_buffer") * 1;
+        pos_value += expand_towards.test(GoalCreateBuffer) * 1;
         AILogDebug["util_score_area"] << name << " adding defensive_buffer value for enemy territory";
       }
     }
@@ -2121,6 +2054,7 @@ AI::score_area(MapPos center_pos, unsigned int distance) {
   AILogDebug["util_score_area"] << name << " found total score_area value " << total_value << " of terrain & objects in area " << center_pos;
   duration = (std::clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
   AILogDebug["util_score_area"] << name << " done util_score_area call took " << duration;
+  cache_area_score(cache_key, changes, total_value);
   return total_value;
 }
 
@@ -2210,46 +2144,33 @@ AI::score_enemy_targets(MapPosSet *scored_targets) {
   // foreach my hut in range of attacking enemy
   //    foreach enemy hut within range of attack
   //      score
-  // on game load, castle_pos is unknown even though castle exists, need to find it
-  AILogDebug["util_score_enemy_targets"] << name << " thread #" << std::this_thread::get_id() << " AI is locking mutex before calling game->get_player_buildings(player) (for score_enemy_targets)";
-  game->get_mutex()->lock();
-  AILogDebug["util_score_enemy_targets"] << name << " thread #" << std::this_thread::get_id() << " AI has locked mutex before calling game->get_player_buildings(player) (for score_enemy_targets)";
-  Game::ListBuildings buildings = game->get_player_buildings(player);
-  AILogDebug["util_score_enemy_targets"] << name << " thread #" << std::this_thread::get_id() << " AI is unlocking mutex before calling game->get_player_buildings(player) (for score_enemy_targets)";
-  game->get_mutex()->unlock();
-  AILogDebug["util_score_enemy_targets"] << name << " thread #" << std::this_thread::get_id() << " AI has unlocked mutex before calling game->get_player_buildings(player) (for score_enemy_targets)";
+  //  the enemy buildings come from the threat map's cells around each of my huts, not a spiral scan
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  threat_map.update(snapshot, *map);
   std::set<MapPos> unique_enemy_targets;
-  for (Building *building : buildings) {
-    if (!building->is_done() ||
-      !building->is_military() ||
-      !building->is_active() ||
-      !(building->get_threat_level() == 3)) {
+  for (const GameSnapshot::BuildingView &building : snapshot->get_player(player_index).buildings) {
+    if (!building.done ||
+      !building.military ||
+      !building.active ||
+      !(building.threat_level == 3)) {
       continue;
     }
     ai_mark_pos.clear();
-    AILogDebug["util_score_enemy_targets"] << name << " looking for enemy buildings to attack near to my building of " << NameBuilding[building->get_type()] << " at pos " << building->get_position();
-    MapPos attacker_pos = building->get_position();
-    // score each enemy building in attackable radius (which is?? NEED TO FIND OUT)
-    //  at 14, seeing some unattackable targets, lowering to 13
-    //  13 seems right so far
-    for (unsigned int i = 0; i < AI::spiral_dist(13); i++) {
-      MapPos pos = map->pos_add_extended_spirally(attacker_pos, i);
-      if (!map->has_building(pos) ||
-        map->get_owner(pos) == player_index) {
-        continue;
-      }
-      Building *target_building = game->get_building_at_pos(pos);
-      if (target_building == nullptr) {
-        AILogDebug["util_score_enemy_targets"] << name << " target_building is nullptr!  at pos " << pos;
-        continue;
-      }
-      if (!target_building->is_military() || !target_building->is_active()) {
-        continue;
-      }
-      MapPos target_pos = pos;
-      Building::Type target_building_type = building->get_type();
-      size_t target_player_index = map->get_owner(pos);
-      const std::string target_player_face = NamePlayerFace[game->get_player(map->get_owner(pos))->get_face()];
+    AILogDebug["util_score_enemy_targets"] << name << " looking for enemy buildings to attack near to my building of " << NameBuilding[building.type] << " at pos " << building.pos;
+    MapPos attacker_pos = building.pos;
+    threat_map.for_each_military_near(*map, attacker_pos, [&](const ThreatMap::Military &target) {
+      // score each enemy building in attackable radius (which is?? NEED TO FIND OUT)
+      //  at 14, seeing some unattackable targets, lowering to 13
+      //  13 seems right so far
+      if (target.owner == player_index ||
+        !target.view->active ||
+        snapshot->tile_dist(attacker_pos, target.view->pos) > 13) {
+        return;
+      }
+      MapPos target_pos = target.view->pos;
+      Building::Type target_building_type = building.type;
+      size_t target_player_index = target.owner;
+      const std::string target_player_face = NamePlayerFace[game->get_player(target.owner)->get_face()];
       AILogDebug["util_score_enemy_targets"] << name << " found attackable building of type " << NameBuilding[target_building_type] << " at pos " << target_pos << " belonging to player " << target_player_index << " / " << target_player_face;
       // does this belong here?
       int max_knights = 0;
@@ -2268,23 +2189,26 @@ AI::score_enemy_targets(MapPosSet *scored_targets) {
         << " at pos " << target_pos << " belonging to player " << target_player_index << " / " << target_player_face;
       if (attacking_knights == 0) {
         AILogDebug["util_score_enemy_targets"] << name << " cannot send any knights, not marking target for scoring";
-        continue;
+        return;
       }
       AILogDebug["util_score_enemy_targets"] << name << " adding target_pos " << target_pos << " to unique_enemy_targets set to score";
       unique_enemy_targets.insert(target_pos);
-
-    }
+    });
   }
   scoring_attack = true;
   for (MapPos target_pos : unique_enemy_targets){
     AILogDebug["util_score_enemy_targets"] << name << " scoring attackable building at pos " << target_pos;
     // debug
     AILogDebug["util_score_enemy_targets"] << name << " dumping attackable debug expand_towards";
-    for (std::string goal : last_expand_towards) {
-      AILogDebug["util_score_enemy_targets"] << name << " attackable ATTACKING (last_) last_expand_towards goal list includes item: " << goal;
+    for (unsigned int goal = 0; goal < ExpandGoalCount; goal++) {
+      if (last_expand_towards.test(goal)) {
+        AILogDebug["util_score_enemy_targets"] << name << " attackable ATTACKING (last_) last_expand_towards goal list includes item: " << NameExpandGoal[goal];
+      }
     }
-    for (std::string goal : expand_towards) {
-      AILogDebug["util_score_enemy_targets"] << name << " attackable ATTACKING (last_) expand_towards goal list includes item: " << goal;
+    for (unsigned int goal = 0; goal < ExpandGoalCount; goal++) {
+      if (expand_towards.test(goal)) {
+        AILogDebug["util_score_enemy_targets"] << name << " attackable ATTACKING (last_) expand_towards goal list includes item: " << NameExpandGoal[goal];
+      }
     }
     unsigned int score = AI::score_area(target_pos, AI::spiral_dist(8));
     AILogDebug["util_score_enemy_targets"] << name << " attackable enemy target at pos " << target_pos << " has score " << score;
@@ -2292,7 +2216,7 @@ AI::score_enemy_targets(MapPosSet *scored_targets) {
   }
   scoring_attack = false;
   // second part of stupid hack to work-around it
-  expand_towards.clear();
+  expand_towards.reset();
   AILogDebug["util_score_enemy_targets"] << name << " done score_enemy_targets";
   duration = (std::clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
   AILogDebug["util_score_enemy_targets"] << name << " done score_enemy_targets call took " << duration;
@@ -2322,11 +2246,11 @@ AI::attack_nearest_target(MapPosSet *scored_targets) {
       AILogDebug["util_attack_nearest_target"] << name << " attacking_knights=" << attacking_knights << ", defending_knights=" << defending_knights << ", attack_ratio=" << attack_ratio;
       if (attack_ratio >= min_knight_ratio_attack) {
         AILogDebug["util_attack_nearest_target"] << name << " attack_ratio " << attack_ratio << " is >= to min_knight_ratio_attack " << min_knight_ratio_attack << ", PROCEEDING WITH THE ATTACK!";
-        player->building_attacked = game->get_building_at_pos(target_pos)->get_index();
-        player->attacking_building_count = attacking_knights;
-        AILogDebug["util_attack_nearest_target"] << name << " calling player->start_attack()";
-        player->start_attack();
-        AILogDebug["util_attack_nearest_target"] << name << " DONE calling player->start_attack()";
+        // the game thread picks the knights again when it applies the attack, and this waits so
+        //  the next knights_available_for_attack above does not run alongside it
+        AILogDebug["util_attack_nearest_target"] << name << " waiting for the game to apply attack";
+        bool attacked = wait_for_command(game->get_commands()->attack(target_pos, attacking_knights, player_index));
+        AILogDebug["util_attack_nearest_target"] << name << " DONE waiting for the game to apply attack, attacked: " << attacked;
       }
     }
   }
@@ -2339,9 +2263,20 @@ AI::attack_nearest_target(MapPosSet *scored_targets) {
 double
 AI::count_geologist_sign_density(MapPos pos, unsigned int distance) {
   AILogDebug["count_geologist_sign_density"] << name << " inside count_geologist_sign_density, around pos " << pos;
-  double signs_count = AI::count_objects_near_pos(pos, distance, Map::ObjectSignLargeGold, Map::ObjectSignSmallStone, "dk_orange");
-  double empty_hills_count = AI::count_empty_terrain_near_pos(pos, distance, Map::TerrainTundra0, Map::TerrainSnow1, "orange");
+  std::string cache_key = "sign_density " + std::to_string(pos) + " " + std::to_string(distance);
+  uint32_t changes = map->get_changes_in(pos, spiral_radius(distance) + 1);
+  double cached_density;
+  if (get_cached_area_score(cache_key, changes, &cached_density)) {
+    AILogDebug["count_geologist_sign_density"] << name << " area around pos " << pos << " has not changed since it was counted, sign_density: " << cached_density;
+    return cached_density;
+  }
+  // the map keeps totals of signs for whole spirals
+  int radius = spiral_radius(distance);
+  double signs_count = (spiral_dist(radius) == distance) ? map->get_signs_in(pos, radius) :
+    AI::count_objects_near_pos(pos, distance, Map::ObjectSignLargeGold, Map::ObjectSignSmallStone, MarkDkOrange);
+  double empty_hills_count = AI::count_empty_terrain_near_pos(pos, distance, Map::TerrainTundra0, Map::TerrainSnow1, MarkOrange);
   double sign_density = signs_count / empty_hills_count;
   AILogDebug["count_geologist_sign_density"] << name << " done, area around pos " << pos << " has signs_count: " << signs_count << ", empty_hills_count: " << empty_hills_count << ", sign_density: " << sign_density << ", deprioritize at " << geologist_sign_density_deprio;
+  cache_area_score(cache_key, changes, sign_density);
   return sign_density;
 }
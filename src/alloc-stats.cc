@@ -0,0 +1,293 @@
+/*
+ * alloc-stats.cc - Heap allocations counted by thread and profiler scope
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/alloc-stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <new>
+
+namespace {
+
+// Counts of one thread. Only the owning thread writes them, other threads
+// read them while merging, so plain relaxed loads and stores do. They are
+// made with calloc and kept in a list that only grows, so counting never
+// calls operator new and the counts of finished threads stay in the totals.
+typedef struct ThreadCounts {
+  std::atomic<uint64_t> count[AllocStats::scope_count];
+  std::atomic<uint64_t> bytes[AllocStats::scope_count];
+  ThreadCounts *next;
+} ThreadCounts;
+
+std::atomic<ThreadCounts*> all_counts(nullptr);
+thread_local ThreadCounts *local_counts = nullptr;
+
+std::atomic<uint64_t> live_bytes(0);
+std::atomic<uint64_t> peak_bytes(0);
+
+// What get_top_sites() leaves out, set by reset().
+std::mutex baseline_mutex;
+AllocStats::Counts baseline[AllocStats::scope_count] = {};
+
+void
+merge_counts(AllocStats::Counts *scopes) {
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  std::fill(scopes, scopes + AllocStats::scope_count, AllocStats::Counts{});
+  for (ThreadCounts *counts = all_counts.load(std::memory_order_acquire);
+       counts != nullptr; counts = counts->next) {
+    for (unsigned int s = 0; s < AllocStats::scope_count; s++) {
+      scopes[s].count += counts->count[s].load(relaxed);
+      scopes[s].bytes += counts->bytes[s].load(relaxed);
+    }
+  }
+}
+
+// Those since the last reset().
+void
+window_counts(AllocStats::Counts *scopes) {
+  merge_counts(scopes);
+  std::lock_guard<std::mutex> lock(baseline_mutex);
+  for (unsigned int s = 0; s < AllocStats::scope_count; s++) {
+    scopes[s].count -= baseline[s].count;
+    scopes[s].bytes -= baseline[s].bytes;
+  }
+}
+
+#if FREESERF_ALLOC_STATS
+
+ThreadCounts *
+get_local_counts() {
+  if (local_counts == nullptr) {
+    void *memory = std::calloc(1, sizeof(ThreadCounts));
+    if (memory == nullptr) {
+      return nullptr;
+    }
+    ThreadCounts *counts = new (memory) ThreadCounts();
+    counts->next = all_counts.load(std::memory_order_relaxed);
+    while (!all_counts.compare_exchange_weak(counts->next, counts,
+                                             std::memory_order_release)) {}
+    local_counts = counts;
+  }
+  return local_counts;
+}
+
+// Every block starts with its size, padded so what follows stays aligned
+// for any type.
+const size_t block_header = alignof(std::max_align_t);
+
+void *
+allocate(size_t size) {
+  char *block = static_cast<char*>(std::malloc(size + block_header));
+  if (block == nullptr) {
+    return nullptr;
+  }
+  *reinterpret_cast<size_t*>(block) = size;
+
+  ThreadCounts *counts = get_local_counts();
+  if (counts != nullptr) {
+    const std::memory_order relaxed = std::memory_order_relaxed;
+    unsigned int scope = Profiler::get_scope();
+    counts->count[scope].store(counts->count[scope].load(relaxed) + 1,
+                               relaxed);
+    counts->bytes[scope].store(counts->bytes[scope].load(relaxed) + size,
+                               relaxed);
+  }
+  uint64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_bytes.compare_exchange_weak(peak, live)) {
+  }
+  return block + block_header;
+}
+
+void
+deallocate(void *data) {
+  if (data == nullptr) {
+    return;
+  }
+  char *block = static_cast<char*>(data) - block_header;
+  live_bytes.fetch_sub(*reinterpret_cast<size_t*>(block),
+                       std::memory_order_relaxed);
+  std::free(block);
+}
+
+#endif  // FREESERF_ALLOC_STATS
+
+}  // namespace
+
+#if FREESERF_ALLOC_STATS
+
+void *
+operator new(size_t size) {
+  void *data = allocate(size);
+  if (data == nullptr) {
+    throw std::bad_alloc();
+  }
+  return data;
+}
+
+void *
+operator new[](size_t size) {
+  return operator new(size);
+}
+
+void *
+operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void *
+operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void *data) noexcept { deallocate(data); }
+void operator delete[](void *data) noexcept { deallocate(data); }
+void operator delete(void *data, size_t) noexcept { deallocate(data); }
+void operator delete[](void *data, size_t) noexcept { deallocate(data); }
+void operator delete(void *data, const std::nothrow_t&) noexcept {
+  deallocate(data); }
+void operator delete[](void *data, const std::nothrow_t&) noexcept {
+  deallocate(data); }
+
+#endif  // FREESERF_ALLOC_STATS
+
+const bool AllocStats::enabled;
+const unsigned int AllocStats::scope_count;
+
+AllocStats::Counts
+AllocStats::get_totals() {
+  Counts scopes[scope_count];
+  merge_counts(scopes);
+  Counts totals = {};
+  for (const Counts &scope : scopes) {
+    totals.count += scope.count;
+    totals.bytes += scope.bytes;
+  }
+  return totals;
+}
+
+AllocStats::Counts
+AllocStats::get_thread_totals() {
+  Counts totals = {};
+  if (local_counts == nullptr) {
+    return totals;
+  }
+  for (unsigned int s = 0; s < scope_count; s++) {
+    totals.count += local_counts->count[s].load(std::memory_order_relaxed);
+    totals.bytes += local_counts->bytes[s].load(std::memory_order_relaxed);
+  }
+  return totals;
+}
+
+void
+AllocStats::get_thread_scopes(Counts *scopes) {
+  for (unsigned int s = 0; s < scope_count; s++) {
+    if (local_counts == nullptr) {
+      scopes[s] = Counts{};
+    } else {
+      scopes[s].count = local_counts->count[s].load(std::memory_order_relaxed);
+      scopes[s].bytes = local_counts->bytes[s].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+uint64_t
+AllocStats::get_live_bytes() {
+  return live_bytes.load(std::memory_order_relaxed);
+}
+
+uint64_t
+AllocStats::get_peak_bytes() {
+  return peak_bytes.load(std::memory_order_relaxed);
+}
+
+void
+AllocStats::reset_peak_bytes() {
+  peak_bytes.store(live_bytes.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+}
+
+std::vector<AllocStats::Site>
+AllocStats::get_sites(const Counts *scopes, size_t top) {
+  std::vector<unsigned int> order;
+  for (unsigned int s = 0; s < scope_count; s++) {
+    if (scopes[s].count > 0) {
+      order.push_back(s);
+    }
+  }
+  std::sort(order.begin(), order.end(),
+            [scopes](unsigned int a, unsigned int b) {
+              return scopes[a].count > scopes[b].count; });
+  if (order.size() > top) {
+    order.resize(top);
+  }
+  std::vector<Site> sites;
+  for (unsigned int s : order) {
+    std::string name = (s == Profiler::max_sections) ? "(no scope)" :
+                                             Profiler::get_section_name(s);
+    sites.push_back(Site{ name, scopes[s].count, scopes[s].bytes });
+  }
+  return sites;
+}
+
+std::vector<AllocStats::Site>
+AllocStats::get_top_sites(size_t top) {
+  Counts scopes[scope_count];
+  window_counts(scopes);
+  return get_sites(scopes, top);
+}
+
+void
+AllocStats::reset() {
+  Counts scopes[scope_count];
+  merge_counts(scopes);
+  std::lock_guard<std::mutex> lock(baseline_mutex);
+  std::copy(scopes, scopes + scope_count, baseline);
+}
+
+void
+AllocStats::write_report(std::ostream *os, unsigned int ticks, size_t top) {
+  Counts scopes[scope_count];
+  window_counts(scopes);
+  Counts totals = {};
+  for (const Counts &scope : scopes) {
+    totals.count += scope.count;
+    totals.bytes += scope.bytes;
+  }
+  std::vector<Site> sites = get_sites(scopes, top);
+  double per_tick = (ticks > 0) ? 1. / ticks : 0.;
+  *os << std::fixed << std::setprecision(2);
+  *os << "allocations " << totals.count << ", " << totals.bytes
+      << " bytes, per tick " << totals.count * per_tick << ", "
+      << totals.bytes * per_tick << " bytes\n";
+  *os << std::left << std::setw(44) << "scope" << std::right
+      << std::setw(12) << "count" << std::setw(14) << "bytes"
+      << std::setw(12) << "per tick" << "\n";
+  for (const Site &site : sites) {
+    *os << std::left << std::setw(44) << site.name << std::right
+        << std::setw(12) << site.count << std::setw(14) << site.bytes
+        << std::setw(12) << site.count * per_tick << "\n";
+  }
+}
@@ -0,0 +1,85 @@
+/*
+ * alloc-stats.h - Heap allocations counted by thread and profiler scope
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_ALLOC_STATS_H_
+#define SRC_ALLOC_STATS_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "src/profiler.h"
+
+// Counts of what the program allocates with operator new, for finding the
+// code that allocates in every tick or every AI loop. Only compiled in when
+// FREESERF_ALLOC_STATS is set (the ENABLE_ALLOC_STATS build option): the
+// global operator new and delete are then replaced, and every allocation is
+// counted by the calling thread against the innermost profiler scope it is
+// in, so PROFILE_SCOPE sections double as allocation sites. Otherwise all
+// counts stay zero.
+class AllocStats {
+ public:
+  static const bool enabled = (FREESERF_ALLOC_STATS != 0);
+  // A scope for each profiler section, and one last for allocations made
+  // outside of any.
+  static const unsigned int scope_count = Profiler::max_sections + 1;
+
+  typedef struct Counts {
+    uint64_t count;
+    uint64_t bytes;
+  } Counts;
+
+  typedef struct Site {
+    std::string name;   // The profiler section
+    uint64_t count;
+    uint64_t bytes;
+  } Site;
+
+  // Allocations since the program started, on any thread.
+  static Counts get_totals();
+  // Allocations since the calling thread started.
+  static Counts get_thread_totals();
+  // Those of the calling thread by scope, scope_count of them.
+  static void get_thread_scopes(Counts *scopes);
+
+  // Bytes allocated and not freed, and the most there were at once since
+  // the last reset_peak_bytes().
+  static uint64_t get_live_bytes();
+  static uint64_t get_peak_bytes();
+  static void reset_peak_bytes();
+
+  // The scopes allocated in most often, of all threads since the last
+  // reset(), most first.
+  static std::vector<Site> get_top_sites(size_t top);
+  // Name and sort scopes counted by the caller, e.g. differences of
+  // get_thread_scopes().
+  static std::vector<Site> get_sites(const Counts *scopes, size_t top);
+  // Start a new window for get_top_sites().
+  static void reset();
+
+  // Allocations per tick and the top sites, over ticks game ticks since the
+  // last reset().
+  static void write_report(std::ostream *os, unsigned int ticks,
+                           size_t top = 10);
+};
+
+#endif  // SRC_ALLOC_STATS_H_
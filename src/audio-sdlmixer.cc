@@ -144,6 +144,65 @@ AudioSDL::volume_down() {
   set_volume(vol - 0.1f);
 }
 
+const AudioSDL::PlayerSFX::Clock::duration
+AudioSDL::PlayerSFX::min_interval = std::chrono::milliseconds(80);
+
+AudioSDL::PlayerSFX::PlayerSFX()
+  : stopping(false) {
+  worker = std::thread(&AudioSDL::PlayerSFX::run, this);
+}
+
+AudioSDL::PlayerSFX::~PlayerSFX() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    stopping = true;
+  }
+  queue_ready.notify_one();
+  worker.join();
+}
+
+Audio::PTrack
+AudioSDL::PlayerSFX::play_track(int track_id) {
+  if (!is_enabled()) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (std::find(queue.begin(), queue.end(), track_id) != queue.end()) {
+      return nullptr;
+    }
+    queue.push_back(track_id);
+  }
+  queue_ready.notify_one();
+  return nullptr;
+}
+
+void
+AudioSDL::PlayerSFX::run() {
+  std::unique_lock<std::mutex> lock(queue_mutex);
+  while (true) {
+    queue_ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+    if (stopping) {
+      return;
+    }
+    std::vector<int> tracks;
+    tracks.swap(queue);
+    lock.unlock();
+
+    Clock::time_point now = Clock::now();
+    for (int track_id : tracks) {
+      auto last = last_played.find(track_id);
+      if (last != last_played.end() && now - last->second < min_interval) {
+        continue;
+      }
+      last_played[track_id] = now;
+      Audio::Player::play_track(track_id);
+    }
+
+    lock.lock();
+  }
+}
+
 Audio::PTrack
 AudioSDL::PlayerSFX::create_track(int track_id) {
   Data &data = Data::get_instance();
@@ -175,6 +234,10 @@ AudioSDL::PlayerSFX::enable(bool enable) {
 
 void
 AudioSDL::PlayerSFX::stop() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    queue.clear();
+  }
   Mix_HaltChannel(-1);
 }
 
@@ -25,7 +25,13 @@
 
 #include "src/audio.h"
 
+#include <chrono>               //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <condition_variable>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <map>
+#include <mutex>                //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 #include <string>
+#include <thread>               //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
 
 #include <SDL_mixer.h>
 
@@ -56,10 +62,32 @@ class AudioSDL : public Audio, public Audio::VolumeController {
     virtual void play();
   };
 
+  /* Effects are played by a thread of their own, so that asking for one
+     never waits for converting it or for SDL_mixer.  An effect asked for
+     again less than min_interval after it last started is dropped, so
+     forty woodcutters chopping at once sound like a few. */
   class PlayerSFX : public Audio::Player,
                     public Audio::VolumeController,
                     public std::enable_shared_from_this<PlayerSFX> {
+   protected:
+    typedef std::chrono::steady_clock Clock;
+    static const Clock::duration min_interval;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    std::vector<int> queue;       /* Each effect once, first asked first */
+    std::map<int, Clock::time_point> last_played;
+    bool stopping;
+    std::thread worker;
+
+    void run();
+
    public:
+    PlayerSFX();
+    virtual ~PlayerSFX();
+
+    /* Queue the effect; there is no track to return yet. */
+    virtual Audio::PTrack play_track(int track_id);
     virtual void enable(bool enable);
     virtual Audio::PVolumeController get_volume_controller() {
       return shared_from_this();
@@ -21,6 +21,15 @@
 
 #include "src/buffer.h"
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <fstream>
 #include <string>
 #include <cstddef>
@@ -91,6 +100,83 @@ Buffer::~Buffer() {
   }
 }
 
+#ifdef _WIN32
+MappedBuffer::MappedBuffer(const std::string &path, EndianessMode _endianess)
+  : Buffer(_endianess)
+  , mapping(nullptr) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw ExceptionFreeserf("Failed to open file '" + path + "'");
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    throw ExceptionFreeserf("Failed to map file '" + path + "'");
+  }
+
+  // the view keeps the file mapped once both handles are closed
+  HANDLE file_mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0,
+                                           nullptr);
+  CloseHandle(file);
+  if (file_mapping == nullptr) {
+    throw ExceptionFreeserf("Failed to map file '" + path + "'");
+  }
+  mapping = MapViewOfFile(file_mapping, FILE_MAP_COPY, 0, 0, 0);
+  CloseHandle(file_mapping);
+  if (mapping == nullptr) {
+    throw ExceptionFreeserf("Failed to map file '" + path + "'");
+  }
+
+  size = static_cast<size_t>(file_size.QuadPart);
+  data = mapping;
+  owned = false;
+  read = reinterpret_cast<uint8_t*>(data);
+}
+
+MappedBuffer::~MappedBuffer() {
+  if (mapping != nullptr) {
+    UnmapViewOfFile(mapping);
+  }
+}
+#else
+MappedBuffer::MappedBuffer(const std::string &path, EndianessMode _endianess)
+  : Buffer(_endianess)
+  , mapping(nullptr) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw ExceptionFreeserf("Failed to open file '" + path + "'");
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    throw ExceptionFreeserf("Failed to map file '" + path + "'");
+  }
+
+  size = static_cast<size_t>(info.st_size);
+  mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    size = 0;
+    throw ExceptionFreeserf("Failed to map file '" + path + "'");
+  }
+
+  data = mapping;
+  owned = false;
+  read = reinterpret_cast<uint8_t*>(data);
+}
+
+MappedBuffer::~MappedBuffer() {
+  if (mapping != nullptr) {
+    munmap(mapping, size);
+  }
+}
+#endif  // _WIN32
+
 void *
 Buffer::unfix() {
   void *result = data;
@@ -87,6 +87,22 @@ class Buffer : public std::enable_shared_from_this<Buffer> {
   void *offset(size_t off) { return reinterpret_cast<char*>(data) + off; }
 };
 
+/* The contents of a file mapped into memory instead of read, so that the
+   processes mapping one file share its pages, and pages are only read
+   from the file when they are used. A page is only copied for this
+   process when it is written to. An empty file can't be mapped. */
+class MappedBuffer : public Buffer {
+ protected:
+  void *mapping;
+
+ public:
+  explicit MappedBuffer(const std::string &path,
+                        EndianessMode endianess = is_big_endian() ?
+                                                    EndianessBig :
+                                                    EndianessLittle);
+  virtual ~MappedBuffer();
+};
+
 class MutableBuffer : public Buffer {
  protected:
   size_t reserved;
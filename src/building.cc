@@ -40,6 +40,7 @@ Building::Building(Game *game, unsigned int index)
   burning = false;
   active = false;
   holder = false;
+  sleeping = false;
   pos = 0;
   progress = 0;
   u = { 0 };
@@ -57,6 +58,14 @@ Building::Building(Game *game, unsigned int index)
   burning_counter = 0;
 }
 
+void
+Building::set_owner(unsigned int new_owner) {
+  unsigned int old_owner = owner;
+  owner = new_owner;
+  game->owner_changed(this, old_owner);
+  game->publish_building_event(this, GameEvent::BuildingOwnerChanged);
+}
+
 typedef struct ConstructionInfo {
   Map::Object map_obj;
   int planks;
@@ -121,13 +130,27 @@ Building::start_building(Building::Type _type) {
 
 void
 Building::done_leveling() {
-  progress = 1;
+  end_leveling();
+  wake();
   holder = false;
   first_knight = 0;
 }
 
+/* Leveling is over once progress leaves zero. Buildability next to a
+   large building depends on its level while it levels, so let the map
+   count it as a change. */
+void
+Building::end_leveling() {
+  wake();
+  if (progress == 0) {
+    game->get_map()->count_change(pos);
+  }
+  progress = 1;
+}
+
 bool
 Building::build_progress() {
+  wake();
   int frame_finished = !!BIT_TEST(progress, 15);
   progress += (frame_finished == 0) ? const_info[type].phase_1
                                     : const_info[type].phase_2;
@@ -140,6 +163,7 @@ Building::build_progress() {
   progress = 0;
   constructing = false; /* Building finished */
   first_knight = 0;
+  game->publish_building_event(this, GameEvent::BuildingFinished);
 
   if (type == TypeCastle) {
     return true;
@@ -168,6 +192,7 @@ void
 Building::increase_mining(int res) {
   active = true;
 
+  wake();
   if (progress == 0x8000) {
     /* Handle empty mine. */
     Player *player = game->get_player(owner);
@@ -421,7 +446,9 @@ Building::burnup() {
     return true;
   }
 
+  wake();
   burning = true;
+  game->publish_building_event(this, GameEvent::BuildingBurning);
 
   /* Remove lost gold stock from total count. */
   if (!constructing &&
@@ -464,6 +491,8 @@ Building::burnup() {
   unsigned int _serf_index = first_knight;
   burning_counter = 2047;
   u.tick = game->get_tick();
+  /* The level of a leveling building is gone now. */
+  game->get_map()->count_change(pos);
 
   Player *player = game->get_player(owner);
   player->building_demolished(this);
@@ -557,6 +586,7 @@ Building::update(unsigned int tick) {
 
 void
 Building::requested_serf_lost() {
+  wake();
   if (serf_requested) {
     serf_requested = false;
   } else if (!has_inventory()) {
@@ -567,19 +597,77 @@ Building::requested_serf_lost() {
 void
 Building::requested_serf_reached(Serf *serf) {
   //got nullptr exception here for first time, dec09 2020
+  wake();
   holder = true;
   if (serf_requested) {
     first_knight = serf->get_index();
   }
   serf_requested = false;
+  game->publish_building_event(this, GameEvent::BuildingOccupied);
 }
 
 void
 Building::knight_request_granted() {
+  wake();
   stock[0].requested += 1;
   serf_requested = false;
 }
 
+bool
+Building::can_sleep() const {
+  if (burning || (!holder && !serf_requested)) {
+    return false;
+  }
+
+  if (!constructing) {
+    switch (type) {
+      case TypeFisher:
+      case TypeLumberjack:
+      case TypeStonecutter:
+      case TypeForester:
+      case TypeFarm:
+        /* Nothing to do once a serf is on the way or inside. */
+        return true;
+      case TypeNone:
+      case TypeStock:
+      case TypeHut:
+      case TypeTower:
+      case TypeFortress:
+      case TypeCastle:
+        return false;
+      default:
+        /* Stock priorities follow the player settings while the
+           building is held. */
+        return !holder;
+    }
+  }
+
+  /* Waiting for the digger, see update_unfinished_adv(). */
+  switch (type) {
+    case TypeStock:
+    case TypeFarm:
+    case TypeButcher:
+    case TypePigFarm:
+    case TypeBaker:
+    case TypeSawmill:
+    case TypeSteelSmelter:
+    case TypeToolMaker:
+    case TypeWeaponSmith:
+    case TypeTower:
+    case TypeFortress:
+    case TypeGoldSmelter:
+      return (progress == 0);
+    default:
+      return false;
+  }
+}
+
+void
+Building::wake_up() {
+  sleeping = false;
+  game->building_woken(this);
+}
+
 void
 Building::remove_stock() {
   stock[0].available = 0;
@@ -973,7 +1061,7 @@ Building::update_unfinished() {
 
   /* Request builder serf */
   if (!serf_request_failed && !holder && !serf_requested) {
-    progress = 1;
+    end_leveling();
     serf_request_failed = !send_serf_to_building(Serf::TypeBuilder,
                                                  Resource::TypeHammer,
                                                  Resource::TypeNone);
@@ -1024,7 +1112,7 @@ Building::update_unfinished_adv() {
 
   if (!need_leveling) {
     /* Already at the correct level, don't send digger */
-    progress = 1;
+    end_leveling();
     update_unfinished();
     return;
   }
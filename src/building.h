@@ -94,6 +94,7 @@ class Building : public GameObject {
   bool burning;
   bool active;
   bool holder;
+  bool sleeping;  // Left out of Game::update_buildings(), see can_sleep()
   /* Index of flag connected to this building */
   unsigned int flag;
   /* Stock of this building */
@@ -133,7 +134,7 @@ class Building : public GameObject {
                                     (type == TypeCastle); }
   /* Owning player of the building. */
   unsigned int get_owner() const { return owner; }
-  void set_owner(unsigned int new_owner) { owner = new_owner; }
+  void set_owner(unsigned int new_owner);
   /* Whether construction of the building is finished. */
   bool is_done() const { return !constructing; }
   bool is_leveling() const { return (!is_done() && progress == 0); }
@@ -142,7 +143,7 @@ class Building : public GameObject {
   int get_progress() const { return progress; }
   bool build_progress();
   void increase_mining(int res);
-  void set_under_attack() { progress |= BIT(0); }
+  void set_under_attack() { wake(); progress |= BIT(0); }
   bool is_under_attack() const { return BIT_TEST(progress, 0); }
 
   /* The threat level of the building. Higher values mean that
@@ -162,13 +163,20 @@ class Building : public GameObject {
   /* Building has an associated serf. */
   bool has_serf() const { return holder; }
   /* Building has succesfully requested a serf. */
-  void serf_request_granted() { serf_requested = true; }
+  void serf_request_granted() { wake(); serf_requested = true; }
   void requested_serf_lost();
   void requested_serf_reached(Serf *serf);
   /* Building has requested a serf but none was available. */
   void clear_serf_request_failure() { serf_request_failed = false; }
   void knight_request_granted();
 
+  /* Whether update() does nothing until holder, serf_requested, progress,
+     constructing or burning change. Each of those wakes it first. */
+  bool can_sleep() const;
+  bool is_sleeping() const { return sleeping; }
+  void start_sleeping() { sleeping = true; }
+  void wake() { if (sleeping) wake_up(); }
+
   /* Building has inventory and the inventory pointer is valid. */
   bool has_inventory() const { return (inventory != nullptr); }
   Inventory *get_inventory() { return inventory; }
@@ -251,6 +259,8 @@ class Building : public GameObject {
 
  private:
   void update();
+  void wake_up();
+  void end_leveling();
   void update_unfinished();
   void update_unfinished_adv();
   void update_castle();
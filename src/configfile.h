@@ -79,13 +79,16 @@ class ConfigFile {
     return val;
   }
 
+  void add_section(const std::string &section) {
+    if (data.find(section) == data.end()) {
+      data[section] = std::make_shared<Values>();
+    }
+  }
+
   template <typename T> void set_value(const std::string &section,
                                        const std::string &name,
                                        const T &value) {
-    if (data.find(section) == data.end()) {
-      PValues new_section = std::make_shared<Values>();
-      data[section] = new_section;
-    }
+    add_section(section);
 
     std::stringstream str;
     str << value;
@@ -93,8 +96,7 @@ class ConfigFile {
     (*data[section])[name] = str.str();
   }
 
- protected:
-  std::string trim(const std::string &str);
+  static std::string trim(const std::string &str);
 };
 
 typedef std::shared_ptr<ConfigFile> PConfigFile;
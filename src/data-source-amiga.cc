@@ -248,6 +248,17 @@ DataSourceAmiga::DataSourceAmiga(const std::string &_path)
 }
 
 DataSourceAmiga::~DataSourceAmiga() {
+  stop_prewarm();
+}
+
+/* The sprites are decoded from the graphics files and the pictures. */
+uint64_t
+DataSourceAmiga::get_sprite_checksum() const {
+  uint64_t sum = checksum(gfxchip, checksum(gfxfast));
+  for (const PBuffer &pic : pics) {
+    sum = checksum(pic, sum);
+  }
+  return sum;
 }
 
 bool
@@ -272,7 +283,8 @@ DataSourceAmiga::check() {
 bool
 DataSourceAmiga::load() {
   try {
-    gfxfast = std::make_shared<Buffer>(path + "/gfxfast", Buffer::EndianessBig);
+    gfxfast = std::make_shared<MappedBuffer>(path + "/gfxfast",
+                                             Buffer::EndianessBig);
     gfxfast = decode(gfxfast);
     gfxfast = unpack(gfxfast);
     Log::Debug["data"] << "Data file 'gfxfast' loaded (size = "
@@ -283,7 +295,8 @@ DataSourceAmiga::load() {
   }
 
   try {
-    gfxchip = std::make_shared<Buffer>(path + "/gfxchip", Buffer::EndianessBig);
+    gfxchip = std::make_shared<MappedBuffer>(path + "/gfxchip",
+                                             Buffer::EndianessBig);
     gfxchip = decode(gfxchip);
     gfxchip = unpack(gfxchip);
     Log::Debug["data"] << "Data file 'gfxchip' loaded (size = "
@@ -295,8 +308,8 @@ DataSourceAmiga::load() {
 
   PBuffer gfxheader;
   try {
-    gfxheader = std::make_shared<Buffer>(path + "/gfxheader",
-                                         Buffer::EndianessBig);
+    gfxheader = std::make_shared<MappedBuffer>(path + "/gfxheader",
+                                               Buffer::EndianessBig);
   } catch (...) {
     Log::Error["data"] << "Failed to load 'gfxheader'";
     return false;
@@ -344,7 +357,7 @@ DataSourceAmiga::load() {
   }
 
   try {
-    sound = std::make_shared<Buffer>(path + "/sounds");
+    sound = std::make_shared<MappedBuffer>(path + "/sounds");
     sound = decode(sound);
   } catch (...) {
     Log::Warn["data"] << "Failed to load 'sounds'";
@@ -352,8 +365,8 @@ DataSourceAmiga::load() {
   }
 
   try {
-    PBuffer gfxpics = std::make_shared<Buffer>(path + "/gfxpics",
-                                               Buffer::EndianessBig);
+    PBuffer gfxpics = std::make_shared<MappedBuffer>(path + "/gfxpics",
+                                                     Buffer::EndianessBig);
     for (size_t i = 0; i < 14; i++) {
       uint32_t offset = gfxpics->pop<uint32_t>();
       uint32_t size = gfxpics->pop<uint32_t>();
@@ -709,7 +722,7 @@ DataSourceAmiga::get_sound_data(size_t index) {
 }
 
 PBuffer
-DataSourceAmiga::get_sound(size_t index) {
+DataSourceAmiga::convert_sound(size_t index) {
   PBuffer data = get_sound_data(index);
   if (!data) {
     Log::Error["data"] << "Sound sample with index" << index << " not present.";
@@ -726,14 +739,14 @@ DataSourceAmiga::get_sound(size_t index) {
 }
 
 PBuffer
-DataSourceAmiga::get_music(size_t /*index*/) {
+DataSourceAmiga::convert_music(size_t /*index*/) {
   if (music) {
     return music;
   }
 
   PBuffer data;
   try {
-    data = std::make_shared<Buffer>(path + "/music");
+    data = std::make_shared<MappedBuffer>(path + "/music");
     data = decode(data);
     data = unpack(data);
   } catch (...) {
@@ -66,9 +66,11 @@ class DataSourceAmiga : public DataSourceLegacy {
 
   virtual Data::MaskImage get_sprite_parts(Data::Resource res, size_t index);
 
-  virtual PBuffer get_sound(size_t index);
   virtual Data::MusicFormat get_music_format() { return Data::MusicFormatMod; }
-  virtual PBuffer get_music(size_t index);
+
+ protected:
+  virtual PBuffer convert_sound(size_t index);
+  virtual PBuffer convert_music(size_t index);
 
  private:
   PBuffer gfxfast;
@@ -84,6 +86,8 @@ class DataSourceAmiga : public DataSourceLegacy {
   PBuffer decode(PBuffer data);
   PBuffer unpack(PBuffer data);
 
+  virtual uint64_t get_sprite_checksum() const;
+
   PBuffer get_data_from_catalog(size_t catalog, size_t index, PBuffer base);
 
   PSpriteAmiga get_menu_sprite(size_t index, PBuffer block,
@@ -21,7 +21,11 @@
 
 #include "src/data-source-custom.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #include <iomanip>
+#include <list>
 #include <memory>
 #include <vector>
 #include <utility>
@@ -32,10 +36,12 @@
 DataSourceCustom::DataSourceCustom(const std::string &_path)
   : DataSourceBase(_path)
   , scale(1)
-  , name("Unnamed") {
+  , name("Unnamed")
+  , sprite_checksum(0) {
 }
 
 DataSourceCustom::~DataSourceCustom() {
+  stop_prewarm();
 }
 
 bool
@@ -56,7 +62,10 @@ DataSourceCustom::load() {
   scale = meta_main->value("general", "scale", 1);
   name = meta_main->value("general", "name", "Unnamed");
 
-  loaded = load_animation_table();
+  loaded = load_infos() && load_animation_table();
+  if (loaded) {
+    sprite_checksum = get_files_checksum();
+  }
 
   return loaded;
 }
@@ -109,7 +118,7 @@ DataSourceCustom::get_sprite_parts(Data::Resource res, size_t index) {
 }
 
 PBuffer
-DataSourceCustom::get_sound(size_t index) {
+DataSourceCustom::convert_sound(size_t index) {
   ResInfo *info = get_info(Data::AssetSound);
   if (info == nullptr) {
     return nullptr;
@@ -129,7 +138,7 @@ DataSourceCustom::get_sound(size_t index) {
 }
 
 PBuffer
-DataSourceCustom::get_music(size_t index) {
+DataSourceCustom::convert_music(size_t index) {
   ResInfo *info = get_info(Data::AssetMusic);
   if (info == nullptr) {
     return nullptr;
@@ -150,15 +159,30 @@ DataSourceCustom::get_music(size_t index) {
 
 DataSourceCustom::ResInfo *
 DataSourceCustom::get_info(Data::Resource res) {
-  if (infos.find(res) == infos.end()) {
+  std::map<Data::Resource, ResInfo>::iterator it = infos.find(res);
+  if (it == infos.end()) {
+    return nullptr;
+  }
+
+  return &it->second;
+}
+
+bool
+DataSourceCustom::load_infos() {
+  infos.clear();
+  for (int r = Data::AssetNone + 1; r <= Data::AssetCursor; r++) {
+    Data::Resource res = static_cast<Data::Resource>(r);
     std::string dir_name = meta_main->value("resources",
                                             Data::get_resource_name(res),
                                             Data::get_resource_name(res));
     std::string dir_path = path + "/" + dir_name;
+    if (!check_file(dir_path + "/meta.ini")) {
+      continue;
+    }
 
     PConfigFile meta = std::make_shared<ConfigFile>();
     if (!meta->load(dir_path + "/meta.ini")) {
-      return nullptr;
+      return false;
     }
     ResInfo info;
     info.meta = std::move(meta);
@@ -166,7 +190,37 @@ DataSourceCustom::get_info(Data::Resource res) {
     infos[res] = info;
   }
 
-  return &infos[res];
+  return true;
+}
+
+uint64_t
+DataSourceCustom::get_files_checksum() const {
+  std::stringstream files;
+  meta_main->write(&files);
+  for (const std::pair<const Data::Resource, ResInfo> &info : infos) {
+    files << info.first << "\n";
+    info.second.meta->write(&files);
+    if (Data::get_resource_type(info.first) != Data::TypeSprite) {
+      continue;
+    }
+    for (const std::string &section : info.second.meta->get_sections()) {
+      for (const char *key : { "image_path", "mask_path" }) {
+        std::string file_name = info.second.meta->value(section, key,
+                                                        std::string());
+        struct stat file_info;
+        if (file_name.empty() ||
+            stat((info.second.path + "/" + file_name).c_str(),
+                 &file_info) != 0) {
+          continue;
+        }
+        files << file_name << " " << file_info.st_size << " "
+              << file_info.st_mtime << "\n";
+      }
+    }
+  }
+
+  std::string text = files.str();
+  return checksum(text.data(), text.size());
 }
 
 bool
@@ -194,7 +248,7 @@ DataSourceCustom::load_animation_table() {
       animation.y = meta.value(stream.str(), "y", 0);
       animations.push_back(animation);
     }
-    animation_table.push_back(animations);
+    add_animation(animations);
   }
 
   return true;
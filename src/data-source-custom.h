@@ -39,7 +39,10 @@ class DataSourceCustom : public DataSourceBase {
   PConfigFile meta_main;
   unsigned int scale;
   std::string name;
+  /* Read by load() for every resource that has a folder, and only read
+     after, so the prewarm workers can decode sprites at once. */
   std::map<Data::Resource, ResInfo> infos;
+  uint64_t sprite_checksum;
 
  public:
   explicit DataSourceCustom(const std::string &path);
@@ -54,12 +57,18 @@ class DataSourceCustom : public DataSourceBase {
 
   virtual Data::MaskImage get_sprite_parts(Data::Resource res, size_t index);
 
-  virtual PBuffer get_sound(size_t index);
-  virtual PBuffer get_music(size_t index);
-
  protected:
+  virtual PBuffer convert_sound(size_t index);
+  virtual PBuffer convert_music(size_t index);
+  virtual bool decodes_in_parallel() const { return true; }
+  virtual uint64_t get_sprite_checksum() const { return sprite_checksum; }
   ResInfo *get_info(Data::Resource res);
+  bool load_infos();
   bool load_animation_table();
+  /* Of the meta files and of the size and modification time of every
+     image file, so the sprite cache is read again until a file changes
+     without reading the images. */
+  uint64_t get_files_checksum() const;
 };
 
 #endif  // SRC_DATA_SOURCE_CUSTOM_H_
@@ -91,6 +91,7 @@ DataSourceDOS::DataSourceDOS(const std::string &_path)
 }
 
 DataSourceDOS::~DataSourceDOS() {
+  stop_prewarm();
 }
 
 bool
@@ -125,7 +126,7 @@ DataSourceDOS::load() {
   }
 
   try {
-    spae = std::make_shared<Buffer>(path);
+    spae = std::make_shared<MappedBuffer>(path);
   } catch (...) {
     return false;
   }
@@ -391,7 +392,7 @@ DataSourceDOS::SpriteBaseDOS::SpriteBaseDOS(PBuffer _data) {
 }
 
 PBuffer
-DataSourceDOS::get_sound(size_t index) {
+DataSourceDOS::convert_sound(size_t index) {
   PBuffer data = get_object(DATA_SFX_BASE + index);
   if (!data) {
     Log::Error["data"] << "Could not extract SFX clip: #" << index;
@@ -408,7 +409,7 @@ DataSourceDOS::get_sound(size_t index) {
 }
 
 PBuffer
-DataSourceDOS::get_music(size_t index) {
+DataSourceDOS::convert_music(size_t index) {
   PBuffer data = get_object(DATA_MUSIC_GAME + index);
   if (!data) {
     Log::Error["data"] << "Could not extract XMI clip: #" << index;
@@ -112,13 +112,14 @@ class DataSourceDOS : public DataSourceLegacy {
 
   virtual Data::MaskImage get_sprite_parts(Data::Resource res, size_t index);
 
-  virtual PBuffer get_sound(size_t index);
   virtual Data::MusicFormat get_music_format() { return Data::MusicFormatMidi; }
-  virtual PBuffer get_music(size_t index);
 
  protected:
+  virtual PBuffer convert_sound(size_t index);
+  virtual PBuffer convert_music(size_t index);
   PBuffer get_object(size_t index);
   void fixup();
+  virtual uint64_t get_sprite_checksum() const { return checksum(spae); }
   DataSourceDOS::ColorDOS *get_dos_palette(size_t index);
 };
 
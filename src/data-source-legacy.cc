@@ -85,7 +85,7 @@ DataSourceLegacy::load_animation_table(PBuffer data) {
       a.y = anims[j].y;
       animations.push_back(a);
     }
-    animation_table.push_back(animations);
+    add_animation(animations);
   }
 
   return true;
@@ -40,6 +40,7 @@ class DataSourceLegacy : public DataSourceBase {
 
  protected:
   bool load_animation_table(PBuffer data);
+  virtual bool decodes_in_parallel() const { return true; }
 };
 
 #endif  // SRC_DATA_SOURCE_LEGACY_H_
@@ -23,20 +23,42 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <sstream>
 
+#include "src/buffer.h"
 #include "src/freeserf_endian.h"
 #include "src/log.h"
+#include "src/memory-usage.h"
 #include "src/tpwm.h"
 #include "src/data.h"
 #include "src/sfx2wav.h"
+#include "src/sprite-kernels.h"
+#include "src/thread-policy.h"
 #include "src/xmi2mid.h"
 
+const uint64_t DataSourceBase::checksum_basis;
+
 DataSourceBase::DataSourceBase(const std::string &_path)
   : path(_path)
-  , loaded(false) {
+  , loaded(false)
+  , prewarm_next(0)
+  , prewarm_done(0)
+  , prewarm_stopping(false) {
+}
+
+DataSourceBase::~DataSourceBase() {
+  stop_prewarm();
 }
 
 bool
@@ -107,7 +129,7 @@ SpriteBase::create(size_t w, size_t h) {
 // mask and the sprite must be identical.
 Data::PSprite
 SpriteBase::get_masked(Data::PSprite mask) {
-  if (mask->get_width() > width) {
+  if ((mask->get_width() > width) || (height == 0)) {
     throw ExceptionFreeserf("Failed to apply mask to sprite");
   }
 
@@ -123,11 +145,18 @@ SpriteBase::get_masked(Data::PSprite mask) {
   uint32_t *m_pos = reinterpret_cast<uint32_t*>(mask->get_data());
 
   for (size_t y = 0; y < masked->get_height(); y++) {
-    for (size_t x = 0; x < masked->get_width(); x++) {
+    size_t x = 0;
+    while (x < masked->get_width()) {
       if (s_pos >= s_end) {
         s_pos = s_beg;
       }
-      *pos++ = *s_pos++ & *m_pos++;
+      size_t run = std::min(masked->get_width() - x,
+                            static_cast<size_t>(s_end - s_pos));
+      SpriteKernels::mask(pos, s_pos, m_pos, run);
+      pos += run;
+      s_pos += run;
+      m_pos += run;
+      x += run;
     }
     s_pos += s_delta;
   }
@@ -143,39 +172,28 @@ SpriteBase::create_mask(Data::PSprite other) {
 
   Data::PSprite result = std::make_shared<SpriteBase>(shared_from_this());
 
-  uint32_t *src1 = reinterpret_cast<uint32_t*>(data);
-  uint32_t *src2 = reinterpret_cast<uint32_t*>(other->get_data());
-  uint32_t *res = reinterpret_cast<uint32_t*>(result->get_data());
-
-  for (unsigned int i = 0; i < width * height; i++) {
-    if (*src1++ == *src2++) {
-      *res++ = 0x00000000;
-    } else {
-      *res++ = 0xFFFFFFFF;
-    }
-  }
+  SpriteKernels::compare(reinterpret_cast<uint32_t*>(result->get_data()),
+                         reinterpret_cast<uint32_t*>(data),
+                         reinterpret_cast<uint32_t*>(other->get_data()),
+                         width * height);
 
   return result;
 }
 
 void
 SpriteBase::fill(Data::Sprite::Color color) {
-  Data::Sprite::Color *c = reinterpret_cast<Data::Sprite::Color*>(data);
-  for (unsigned int i = 0; i < (width * height); i++) {
-    *c++ = color;
-  }
+  uint32_t pixel = 0;
+  std::memcpy(&pixel, &color, sizeof(pixel));
+  SpriteKernels::fill(reinterpret_cast<uint32_t*>(data), pixel,
+                      width * height);
 }
 
 void
 SpriteBase::fill_masked(Data::Sprite::Color color) {
-  Data::Sprite::Color *res = reinterpret_cast<Data::Sprite::Color*>(data);
-
-  for (unsigned int i = 0; i < width * height; i++) {
-    if ((res->alpha & 0xFF) != 0x00) {
-      *res = color;
-    }
-    res++;
-  }
+  uint32_t pixel = 0;
+  std::memcpy(&pixel, &color, sizeof(pixel));
+  SpriteKernels::fill_opaque(reinterpret_cast<uint32_t*>(data), pixel,
+                             width * height);
 }
 
 void
@@ -184,14 +202,9 @@ SpriteBase::add(Data::PSprite other) {
     return;
   }
 
-  uint32_t *src = reinterpret_cast<uint32_t*>(other->get_data());
-  uint32_t *res = reinterpret_cast<uint32_t*>(data);
-
-  for (unsigned int i = 0; i < width * height; i++) {
-    *res++ += *src++;
-  }
-
-  return;
+  SpriteKernels::add(reinterpret_cast<uint32_t*>(data),
+                     reinterpret_cast<uint32_t*>(other->get_data()),
+                     width * height);
 }
 
 void
@@ -200,17 +213,9 @@ SpriteBase::del(Data::PSprite other) {
     return;
   }
 
-  uint32_t *src = reinterpret_cast<uint32_t*>(other->get_data());
-  uint32_t *res = reinterpret_cast<uint32_t*>(data);
-
-  for (unsigned int i = 0; i < width * height; i++) {
-    if (*src++ == 0xFFFFFFFF) {
-      *res = 0x00000000;
-    }
-    res++;
-  }
-
-  return;
+  SpriteKernels::clear_masked(reinterpret_cast<uint32_t*>(data),
+                              reinterpret_cast<uint32_t*>(other->get_data()),
+                              width * height);
 }
 
 void
@@ -219,40 +224,9 @@ SpriteBase::blend(Data::PSprite other) {
     return;
   }
 
-#define UNMULTIPLY(color, a) ((0xFF * (color)) / (a))
-#define BLEND(back, front, a) (((front) * (a)) + ((back) * (0xFF - (a)))) / 0xFF
-
-  Color *c = reinterpret_cast<Color*>(data);
-  Color *o = reinterpret_cast<Color*>(other->get_data());
-  for (unsigned int i = 0; i < width * height; i++) {
-    const uint32_t alpha = o->alpha;
-
-    if (alpha == 0x00) {
-      c++;
-      o++;
-      continue;
-    }
-
-    if (alpha == 0xFF) {
-      *c++ = *o++;
-      continue;
-    }
-
-    const uint8_t backR = c->red;
-    const uint8_t backG = c->green;
-    const uint8_t backB = c->blue;
-
-    const uint8_t frontR = UNMULTIPLY(o->red, alpha);
-    const uint8_t frontG = UNMULTIPLY(o->green, alpha);
-    const uint8_t frontB = UNMULTIPLY(o->blue, alpha);
-
-    const uint32_t R = BLEND(backR, frontR, alpha);
-    const uint32_t G = BLEND(backG, frontG, alpha);
-    const uint32_t B = BLEND(backB, frontB, alpha);
-
-    *c++ = {(uint8_t)B, (uint8_t)G, (uint8_t)R, 0xFF};
-    o++;
-  }
+  SpriteKernels::blend(reinterpret_cast<uint32_t*>(data),
+                       reinterpret_cast<uint32_t*>(other->get_data()),
+                       width * height);
 
   delta_x = other->get_delta_x();
   delta_y = other->get_delta_y();
@@ -260,28 +234,8 @@ SpriteBase::blend(Data::PSprite other) {
 
 void
 SpriteBase::make_alpha_mask() {
-  Color *c = reinterpret_cast<Color*>(data);
-  uint8_t min = 0xFF;
-  for (unsigned int i = 0; i < width * height; i++) {
-    if (c->alpha != 0x00) {
-      c->alpha = 0xff - static_cast<uint8_t>((0.21 * c->red) +
-                                             (0.72 * c->green) +
-                                             (0.07 * c->blue));
-      c->red = 0;
-      c->green = 0;
-      c->blue = 0;
-      min = std::min(min, c->alpha);
-    }
-    c++;
-  }
-
-  c = reinterpret_cast<Color*>(data);
-  for (unsigned int i = 0; i < width * height; i++) {
-    if (c->alpha != 0x00) {
-      c->alpha = c->alpha - min;
-    }
-    c++;
-  }
+  SpriteKernels::alpha_mask(reinterpret_cast<uint32_t*>(data),
+                            width * height);
 }
 
 void
@@ -329,6 +283,20 @@ Data::Sprite::create_id(uint64_t resource, uint64_t index,
   return result;
 }
 
+/* get_sprite() colors the mask it hands out, so a cached mask is copied
+   first to keep it as it was decoded. */
+static Data::PSprite
+copy_sprite(Data::PSprite sprite) {
+  if (!sprite) {
+    return nullptr;
+  }
+  Data::PSprite copy = std::make_shared<SpriteBase>(sprite);
+  std::copy(sprite->get_data(),
+            sprite->get_data() + sprite->get_width()*sprite->get_height()*4,
+            copy->get_data());
+  return copy;
+}
+
 Data::PSprite
 DataSourceBase::get_sprite(Data::Resource res, size_t index,
                            const Data::Sprite::Color &color) {
@@ -336,9 +304,12 @@ DataSourceBase::get_sprite(Data::Resource res, size_t index,
     return nullptr;
   }
 
-  Data::MaskImage ms = get_sprite_parts(res, index);
+  Data::MaskImage ms = get_decoded_parts(res, index);
   Data::PSprite mask = std::get<0>(ms);
   Data::PSprite image = std::get<1>(ms);
+  if (mask && decodes_in_parallel()) {
+    mask = copy_sprite(mask);
+  }
 
   if (mask) {
     mask->fill_masked(color);
@@ -352,6 +323,481 @@ DataSourceBase::get_sprite(Data::Resource res, size_t index,
   return image;
 }
 
+/* The parts from the cache, decoding them now if the prewarm workers
+   haven't yet. Sources that don't prewarm decode every time, as they
+   always have. */
+Data::MaskImage
+DataSourceBase::get_decoded_parts(Data::Resource res, size_t index) {
+  if (!decodes_in_parallel()) {
+    return get_sprite_parts(res, index);
+  }
+
+  uint64_t id = Data::Sprite::create_id(res, index, 0, 0, {0, 0, 0, 0});
+  {
+    std::lock_guard<std::mutex> lock(parts_mutex);
+    PartsCache::iterator it = parts_cache.find(id);
+    if (it != parts_cache.end()) {
+      return it->second;
+    }
+  }
+
+  Data::MaskImage ms = get_sprite_parts(res, index);
+  std::lock_guard<std::mutex> lock(parts_mutex);
+  return parts_cache.insert(std::make_pair(id, ms)).first->second;
+}
+
+void
+DataSourceBase::prewarm_sprites() {
+  if (!decodes_in_parallel() || !prewarm_workers.empty()) {
+    return;
+  }
+  if (load_sprite_cache()) {
+    return;
+  }
+
+  /* What the game init box and the first frames of a game draw, then
+     everything else in the order of the resource table. */
+  static const Data::Resource first[] = {
+    Data::AssetCursor, Data::AssetFont, Data::AssetFontShadow,
+    Data::AssetFramePopup, Data::AssetIcon, Data::AssetArtBox,
+    Data::AssetFrameTop, Data::AssetFrameBottom, Data::AssetFrameSplit,
+    Data::AssetPanelButton, Data::AssetMapGround, Data::AssetMapMaskUp,
+    Data::AssetMapMaskDown, Data::AssetMapObject, Data::AssetMapShadow,
+    Data::AssetGameObject, Data::AssetSerfShadow, Data::AssetSerfTorso,
+    Data::AssetSerfHead, Data::AssetPathGround, Data::AssetPathMask,
+    Data::AssetMapBorder, Data::AssetMapWaves
+  };
+  std::vector<Data::Resource> order(std::begin(first), std::end(first));
+  for (int r = Data::AssetNone; r <= Data::AssetCursor; r++) {
+    Data::Resource res = static_cast<Data::Resource>(r);
+    if (std::find(order.begin(), order.end(), res) == order.end()) {
+      order.push_back(res);
+    }
+  }
+
+  for (Data::Resource res : order) {
+    if (Data::get_resource_type(res) != Data::TypeSprite) {
+      continue;
+    }
+    for (size_t i = 0; i < Data::get_resource_count(res); i++) {
+      prewarm_queue.push_back(SpriteRef(res, i));
+    }
+  }
+
+  unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, 4u);
+  Log::Info["data"] << "Decoding " << prewarm_queue.size() << " sprites on "
+                    << threads << " threads...";
+  for (unsigned int i = 0; i < threads; i++) {
+    prewarm_workers.push_back(
+      std::thread(&DataSourceBase::run_prewarm_worker, this));
+  }
+}
+
+void
+DataSourceBase::run_prewarm_worker() {
+  ThreadPolicy::apply(ThreadPolicy::RoleIO);
+  while (!prewarm_stopping) {
+    size_t next = prewarm_next.fetch_add(1);
+    if (next >= prewarm_queue.size()) {
+      break;
+    }
+    get_decoded_parts(prewarm_queue[next].first, prewarm_queue[next].second);
+    if (prewarm_done.fetch_add(1) + 1 == prewarm_queue.size()) {
+      Log::Info["data"] << "Decoded all " << prewarm_queue.size()
+                        << " sprites.";
+      save_sprite_cache();
+    }
+  }
+}
+
+void
+DataSourceBase::get_prewarm_progress(size_t *done, size_t *total) {
+  *done = prewarm_done;
+  *total = prewarm_queue.size();
+}
+
+static size_t
+sprite_bytes(const Data::PSprite &sprite) {
+  return sprite ? sprite->get_width() * sprite->get_height() * 4 : 0;
+}
+
+static size_t
+audio_bytes(const std::map<size_t, PBuffer> &cache) {
+  size_t bytes = MemoryUsage::tree_bytes(cache);
+  for (const std::pair<const size_t, PBuffer> &entry : cache) {
+    bytes += entry.second ? entry.second->get_size() : 0;
+  }
+  return bytes;
+}
+
+void
+DataSourceBase::add_memory_usage(MemoryUsage *usage) {
+  {
+    std::lock_guard<std::mutex> lock(parts_mutex);
+    size_t bytes = parts_cache.size() *
+                   (sizeof(PartsCache::value_type) +
+                    MemoryUsage::list_node_overhead);
+    for (const PartsCache::value_type &parts : parts_cache) {
+      bytes += sprite_bytes(std::get<0>(parts.second)) +
+               sprite_bytes(std::get<1>(parts.second));
+    }
+    usage->add("data.sprite_parts", parts_cache.size(), bytes);
+  }
+  std::lock_guard<std::mutex> lock(audio_mutex);
+  usage->add("data.sounds", sound_cache.size(), audio_bytes(sound_cache));
+  usage->add("data.music", music_cache.size(), audio_bytes(music_cache));
+}
+
+void
+DataSourceBase::stop_prewarm() {
+  prewarm_stopping = true;
+  for (std::thread &worker : prewarm_workers) {
+    worker.join();
+  }
+  prewarm_workers.clear();
+  if (audio_prewarm_worker.joinable()) {
+    audio_prewarm_worker.join();
+  }
+}
+
+PBuffer
+DataSourceBase::get_sound(size_t index) {
+  return get_converted_audio(&sound_cache, index, false);
+}
+
+PBuffer
+DataSourceBase::get_music(size_t index) {
+  return get_converted_audio(&music_cache, index, true);
+}
+
+/* From the cache, converting it now if the prewarm worker hasn't yet, or
+   waiting for the worker if it is converting it right now. */
+PBuffer
+DataSourceBase::get_converted_audio(AudioCache *cache, size_t index,
+                                    bool music) {
+  {
+    std::lock_guard<std::mutex> lock(audio_mutex);
+    AudioCache::iterator it = cache->find(index);
+    if (it != cache->end()) {
+      return it->second;
+    }
+  }
+
+  std::lock_guard<std::mutex> convert_lock(audio_convert_mutex);
+  {
+    std::lock_guard<std::mutex> lock(audio_mutex);
+    AudioCache::iterator it = cache->find(index);
+    if (it != cache->end()) {
+      return it->second;
+    }
+  }
+  PBuffer converted = music ? convert_music(index) : convert_sound(index);
+  std::lock_guard<std::mutex> lock(audio_mutex);
+  (*cache)[index] = converted;
+  return converted;
+}
+
+/* The conversions are quick next to decoding sprites, so one thread does
+   them all, sounds first as a battle plays many at once. */
+void
+DataSourceBase::prewarm_audio(const std::vector<size_t> &sounds,
+                              const std::vector<size_t> &tunes) {
+  if (audio_prewarm_worker.joinable()) {
+    return;
+  }
+  audio_prewarm_sounds = sounds;
+  audio_prewarm_tunes = tunes;
+  audio_prewarm_worker = std::thread(&DataSourceBase::run_audio_prewarm_worker,
+                                     this);
+}
+
+void
+DataSourceBase::run_audio_prewarm_worker() {
+  ThreadPolicy::apply(ThreadPolicy::RoleIO);
+  for (size_t index : audio_prewarm_sounds) {
+    if (prewarm_stopping) {
+      return;
+    }
+    get_sound(index);
+  }
+  for (size_t index : audio_prewarm_tunes) {
+    if (prewarm_stopping) {
+      return;
+    }
+    get_music(index);
+  }
+  Log::Info["data"] << "Converted " << audio_prewarm_sounds.size()
+                    << " sounds and " << audio_prewarm_tunes.size()
+                    << " tunes.";
+}
+
+/* The sprite cache file starts with a header, then an entry for every
+   sprite, then the pixels of all of them. It is only read on the host
+   that wrote it, so everything is in host byte order. Bump the version
+   with any change to the layout or to how sprites are decoded. */
+static const char sprite_cache_magic[8] = { 'F', 'S', 'S', 'P', 'R', 'I',
+                                            'T', 'E' };
+static const uint32_t sprite_cache_version = 1;
+
+typedef struct SpriteCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+  uint64_t checksum;
+} SpriteCacheHeader;
+
+typedef struct SpriteCachePart {
+  uint32_t width;
+  uint32_t height;
+  int32_t delta_x;
+  int32_t delta_y;
+  int32_t offset_x;
+  int32_t offset_y;
+  uint64_t pixels;   // Offset into the file, 0 if there is no such part
+} SpriteCachePart;
+
+typedef struct SpriteCacheEntry {
+  uint32_t res;
+  uint32_t index;
+  SpriteCachePart parts[2];   // Mask and image
+} SpriteCacheEntry;
+
+/* A sprite whose pixels are in a mapped cache file. */
+class SpriteMapped : public SpriteBase {
+ protected:
+  PBuffer file;
+
+ public:
+  SpriteMapped(PBuffer _file, const SpriteCachePart &part)
+    : file(_file) {
+    width = part.width;
+    height = part.height;
+    delta_x = part.delta_x;
+    delta_y = part.delta_y;
+    offset_x = part.offset_x;
+    offset_y = part.offset_y;
+    data = reinterpret_cast<uint8_t*>(file->get_data()) + part.pixels;
+  }
+  virtual ~SpriteMapped() { data = nullptr; }
+};
+
+uint64_t
+DataSourceBase::checksum(PBuffer data, uint64_t hash) {
+  if (!data) {
+    return hash;
+  }
+  return checksum(data->get_data(), data->get_size(), hash);
+}
+
+uint64_t
+DataSourceBase::checksum(const void *data, size_t size, uint64_t hash) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* The user's cache folder, made if it isn't there. Empty where there is
+   none. */
+std::string
+DataSourceBase::get_sprite_cache_path() const {
+#ifdef _WIN32
+  return std::string();
+#else
+  std::string folder;
+  const char *cache_home = std::getenv("XDG_CACHE_HOME");
+  const char *home = std::getenv("HOME");
+  if (cache_home != nullptr && cache_home[0] != '\0') {
+    folder = cache_home;
+  } else if (home != nullptr) {
+    folder = std::string(home) + "/.cache";
+    mkdir(folder.c_str(), S_IRWXU);
+  } else {
+    return std::string();
+  }
+  folder += "/freeserf";
+  mkdir(folder.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+
+  /* Custom data is named by whoever made it. */
+  std::string source = get_name();
+  for (char &c : source) {
+    if (!std::isalnum(static_cast<unsigned char>(c))) {
+      c = '_';
+    }
+  }
+  std::stringstream name;
+  name << folder << "/sprites-" << source << "-" << std::hex
+       << get_sprite_checksum() << ".cache";
+  return name.str();
+#endif  // _WIN32
+}
+
+/* Take every sprite from the cache file instead of decoding, false if
+   there is no file for this data or it doesn't look right. */
+bool
+DataSourceBase::load_sprite_cache() {
+  uint64_t sum = get_sprite_checksum();
+  std::string cache_path = (sum != 0) ? get_sprite_cache_path() :
+                                        std::string();
+  if (cache_path.empty() || !check_file(cache_path)) {
+    return false;
+  }
+
+  PBuffer file;
+  try {
+    file = std::make_shared<MappedBuffer>(cache_path);
+  } catch (...) {
+    return false;
+  }
+
+  const uint8_t *base = reinterpret_cast<const uint8_t*>(file->get_data());
+  size_t size = file->get_size();
+  const SpriteCacheHeader *header =
+                          reinterpret_cast<const SpriteCacheHeader*>(base);
+  if (size < sizeof(SpriteCacheHeader) ||
+      std::memcmp(header->magic, sprite_cache_magic,
+                  sizeof(sprite_cache_magic)) != 0 ||
+      header->version != sprite_cache_version || header->checksum != sum ||
+      size < sizeof(SpriteCacheHeader) +
+             header->count * sizeof(SpriteCacheEntry)) {
+    Log::Warn["data"] << "Ignoring sprite cache '" << cache_path << "'";
+    return false;
+  }
+
+  const SpriteCacheEntry *entries =
+     reinterpret_cast<const SpriteCacheEntry*>(base + sizeof(SpriteCacheHeader));
+  PartsCache loaded;
+  std::vector<SpriteRef> refs;
+  for (uint32_t i = 0; i < header->count; i++) {
+    const SpriteCacheEntry &entry = entries[i];
+    if (entry.res > Data::AssetCursor) {
+      Log::Warn["data"] << "Ignoring sprite cache '" << cache_path << "'";
+      return false;
+    }
+    Data::PSprite parts[2];
+    for (int p = 0; p < 2; p++) {
+      const SpriteCachePart &part = entry.parts[p];
+      if (part.pixels == 0) {
+        continue;
+      }
+      if (part.pixels + static_cast<uint64_t>(part.width) * part.height * 4 >
+          size) {
+        Log::Warn["data"] << "Ignoring sprite cache '" << cache_path << "'";
+        return false;
+      }
+      parts[p] = std::make_shared<SpriteMapped>(file, part);
+    }
+    Data::Resource res = static_cast<Data::Resource>(entry.res);
+    loaded[Data::Sprite::create_id(res, entry.index, 0, 0, {0, 0, 0, 0})] =
+                                         std::make_tuple(parts[0], parts[1]);
+    refs.push_back(SpriteRef(res, entry.index));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(parts_mutex);
+    parts_cache.swap(loaded);
+  }
+  prewarm_queue.swap(refs);
+  prewarm_next = prewarm_queue.size();
+  prewarm_done = prewarm_queue.size();
+  Log::Info["data"] << "Loaded " << prewarm_queue.size()
+                    << " sprites from '" << cache_path << "'";
+  return true;
+}
+
+/* Write every decoded sprite to the cache file. The file is written
+   under another name and then renamed, so another process starting at
+   the same time reads either all of it or none. */
+void
+DataSourceBase::save_sprite_cache() {
+  uint64_t sum = get_sprite_checksum();
+  std::string cache_path = (sum != 0) ? get_sprite_cache_path() :
+                                        std::string();
+  if (cache_path.empty()) {
+    return;
+  }
+
+  std::vector<std::pair<SpriteRef, Data::MaskImage>> sprites;
+  {
+    std::lock_guard<std::mutex> lock(parts_mutex);
+    for (const SpriteRef &ref : prewarm_queue) {
+      uint64_t id = Data::Sprite::create_id(ref.first, ref.second, 0, 0,
+                                            {0, 0, 0, 0});
+      PartsCache::iterator it = parts_cache.find(id);
+      if (it != parts_cache.end()) {
+        sprites.push_back(std::make_pair(ref, it->second));
+      }
+    }
+  }
+
+  SpriteCacheHeader header;
+  std::memcpy(header.magic, sprite_cache_magic, sizeof(header.magic));
+  header.version = sprite_cache_version;
+  header.count = static_cast<uint32_t>(sprites.size());
+  header.checksum = sum;
+
+  std::vector<SpriteCacheEntry> entries;
+  uint64_t pixels = sizeof(SpriteCacheHeader) +
+                    sprites.size() * sizeof(SpriteCacheEntry);
+  for (const std::pair<SpriteRef, Data::MaskImage> &sprite : sprites) {
+    SpriteCacheEntry entry;
+    std::memset(&entry, 0, sizeof(entry));
+    entry.res = sprite.first.first;
+    entry.index = static_cast<uint32_t>(sprite.first.second);
+    Data::PSprite parts[2] = { std::get<0>(sprite.second),
+                               std::get<1>(sprite.second) };
+    for (int p = 0; p < 2; p++) {
+      if (!parts[p]) {
+        continue;
+      }
+      SpriteCachePart &part = entry.parts[p];
+      part.width = static_cast<uint32_t>(parts[p]->get_width());
+      part.height = static_cast<uint32_t>(parts[p]->get_height());
+      part.delta_x = parts[p]->get_delta_x();
+      part.delta_y = parts[p]->get_delta_y();
+      part.offset_x = parts[p]->get_offset_x();
+      part.offset_y = parts[p]->get_offset_y();
+      part.pixels = pixels;
+      pixels += static_cast<uint64_t>(part.width) * part.height * 4;
+    }
+    entries.push_back(entry);
+  }
+
+  std::stringstream temp_path;
+  temp_path << cache_path << "." << getpid() << ".tmp";
+  std::ofstream file(temp_path.str().c_str(),
+                     std::ios::binary | std::ios::trunc);
+  if (!file.good()) {
+    Log::Warn["data"] << "Failed to write sprite cache '" << cache_path
+                      << "'";
+    return;
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(entries.data()),
+             entries.size() * sizeof(SpriteCacheEntry));
+  for (const std::pair<SpriteRef, Data::MaskImage> &sprite : sprites) {
+    for (const Data::PSprite &part : { std::get<0>(sprite.second),
+                                       std::get<1>(sprite.second) }) {
+      if (part) {
+        file.write(reinterpret_cast<const char*>(part->get_data()),
+                   part->get_width() * part->get_height() * 4);
+      }
+    }
+  }
+  file.close();
+  if (!file.good() ||
+      std::rename(temp_path.str().c_str(), cache_path.c_str()) != 0) {
+    std::remove(temp_path.str().c_str());
+    Log::Warn["data"] << "Failed to write sprite cache '" << cache_path
+                      << "'";
+    return;
+  }
+  Log::Info["data"] << "Wrote " << sprites.size() << " sprites to '"
+                    << cache_path << "'";
+}
+
 Data::MaskImage
 DataSourceBase::separate_sprites(Data::PSprite s1, Data::PSprite s2) {
   if (!s1 || !s2) {
@@ -367,30 +813,46 @@ DataSourceBase::separate_sprites(Data::PSprite s1, Data::PSprite s2) {
   return std::make_tuple(filled, s1);
 }
 
+void
+DataSourceBase::add_animation(const std::vector<Data::Animation> &phases) {
+  if (animation_first.empty()) {
+    animation_first.push_back(0);
+  }
+  animation_phases.insert(animation_phases.end(), phases.begin(),
+                          phases.end());
+  animation_first.push_back(animation_phases.size());
+}
+
 size_t
 DataSourceBase::get_animation_phase_count(size_t animation) {
-  if (animation >= animation_table.size()) {
+  if (animation + 1 >= animation_first.size()) {
     Log::Error["data"] << "Failed to get phase count for animation #"
     << animation
-    << " (got only " << animation_table.size()
+    << " (got only " << get_animation_count()
     << " animations)";
     return 0;
   }
 
-  return animation_table[animation].size();
+  return animation_first[animation + 1] - animation_first[animation];
 }
 
 Data::Animation
 DataSourceBase::get_animation(size_t animation, size_t phase) {
   phase >>= 3;
-  if ((animation >= animation_table.size()) ||
-      (phase >= animation_table[animation].size())) {
+  if (animation + 1 >= animation_first.size()) {
+    Log::Error["data"] << "Failed to get animation #" << animation
+    << " (got only " << get_animation_count()
+    << " animations)";
+    return {0, 0, 0};
+  }
+  size_t index = animation_first[animation] + phase;
+  if (index >= animation_first[animation + 1]) {
     Log::Error["data"] << "Failed to get animation #" << animation
     << " phase #" << phase
-    << " (got only " << animation_table[animation].size()
+    << " (got only " << get_animation_phase_count(animation)
     << " phases)";
     return {0, 0, 0};
   }
 
-  return animation_table[animation][phase];
+  return animation_phases[index];
 }
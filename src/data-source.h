@@ -22,9 +22,15 @@
 #ifndef SRC_DATA_SOURCE_H_
 #define SRC_DATA_SOURCE_H_
 
+#include <atomic>
+#include <map>
 #include <string>
 #include <memory>
+#include <mutex>    //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 #include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "src/data.h"
@@ -81,11 +87,40 @@ class DataSourceBase : public Data::Source {
  protected:
   std::string path;
   bool loaded;
-  std::vector<std::vector<Data::Animation>> animation_table;
+  /* The phases of all animations one after another. The phases of
+     animation a are from animation_first[a] up to animation_first[a + 1]. */
+  std::vector<Data::Animation> animation_phases;
+  std::vector<size_t> animation_first;
+
+  /* Sprite parts decoded so far, by resource and index, as get_sprite()
+     colors copies of them. Filled by the prewarm workers, and by
+     get_sprite() for whatever they haven't got to yet. */
+  typedef std::unordered_map<uint64_t, Data::MaskImage> PartsCache;
+  std::mutex parts_mutex;
+  PartsCache parts_cache;
+
+  typedef std::pair<Data::Resource, size_t> SpriteRef;
+  std::vector<SpriteRef> prewarm_queue;   /* First needed first */
+  std::atomic<size_t> prewarm_next;
+  std::atomic<size_t> prewarm_done;
+  std::atomic<bool> prewarm_stopping;
+  std::vector<std::thread> prewarm_workers;
+
+  /* Sounds and tunes converted for playing so far, by index, including
+     those that failed to convert. get_sound() and get_music() hand them
+     out again, and the audio prewarm thread fills them ahead. */
+  typedef std::map<size_t, PBuffer> AudioCache;
+  std::mutex audio_mutex;
+  std::mutex audio_convert_mutex;   /* One conversion at a time */
+  AudioCache sound_cache;
+  AudioCache music_cache;
+  std::vector<size_t> audio_prewarm_sounds;
+  std::vector<size_t> audio_prewarm_tunes;
+  std::thread audio_prewarm_worker;
 
  public:
   explicit DataSourceBase(const std::string &path);
-  virtual ~DataSourceBase() {}
+  virtual ~DataSourceBase();
 
   virtual std::string get_name() const = 0;
   virtual std::string get_path() const { return path; }
@@ -102,17 +137,57 @@ class DataSourceBase : public Data::Source {
   virtual Data::MaskImage get_sprite_parts(Data::Resource res,
                                            size_t index) = 0;
 
+  virtual void prewarm_sprites();
+  virtual void get_prewarm_progress(size_t *done, size_t *total);
+
   virtual size_t get_animation_phase_count(size_t animation);
   virtual Data::Animation get_animation(size_t animation, size_t phase);
 
-  virtual PBuffer get_sound(size_t index) = 0;
+  virtual PBuffer get_sound(size_t index);
   virtual Data::MusicFormat get_music_format() { return Data::MusicFormatNone; }
-  virtual PBuffer get_music(size_t index) = 0;
+  virtual PBuffer get_music(size_t index);
+  virtual void prewarm_audio(const std::vector<size_t> &sounds,
+                             const std::vector<size_t> &tunes);
 
   bool check_file(const std::string &path);
 
+  virtual void add_memory_usage(MemoryUsage *usage);
+
  protected:
   Data::MaskImage separate_sprites(Data::PSprite s1, Data::PSprite s2);
+  size_t get_animation_count() const {
+    return animation_first.empty() ? 0 : animation_first.size() - 1;
+  }
+  /* Append the next animation to the animation table */
+  void add_animation(const std::vector<Data::Animation> &phases);
+
+  /* Whether get_sprite_parts() only reads what load() set up, so that
+     several threads can call it at once. */
+  virtual bool decodes_in_parallel() const { return false; }
+  Data::MaskImage get_decoded_parts(Data::Resource res, size_t index);
+  void run_prewarm_worker();
+
+  /* A sound or tune as the audio players take it, converted from the
+     data each time it is called. */
+  virtual PBuffer convert_sound(size_t index) = 0;
+  virtual PBuffer convert_music(size_t index) = 0;
+  PBuffer get_converted_audio(AudioCache *cache, size_t index, bool music);
+  void run_audio_prewarm_worker();
+
+  /* Decoded sprites are also kept in a file, found again by a checksum
+     of the data they were decoded from. Sources that return 0 here are
+     decoded anew every run. */
+  virtual uint64_t get_sprite_checksum() const { return 0; }
+  static const uint64_t checksum_basis = 14695981039346656037ULL;
+  static uint64_t checksum(PBuffer data, uint64_t hash = checksum_basis);
+  static uint64_t checksum(const void *data, size_t size,
+                           uint64_t hash = checksum_basis);
+  std::string get_sprite_cache_path() const;
+  bool load_sprite_cache();
+  void save_sprite_cache();
+  /* Called first thing by the destructor of a source that prewarms, as
+     the workers read its members. */
+  void stop_prewarm();
 };
 
 #endif  // SRC_DATA_SOURCE_H_
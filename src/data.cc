@@ -26,6 +26,7 @@
 #include <utility>
 #include <string>
 #include <functional>
+#include <future>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 
 #include "src/log.h"
 #include "src/data-source-dos.h"
@@ -116,20 +117,30 @@ Data::load(const std::string &path) {
   }
 
   // Use each data source to try to find the data files in the search paths.
+  //  All of them are looked for at once, each on a thread of its own, and
+  //  the first one found, in the order above, is loaded as soon as it is
+  //  known to be there, while the ones after it are still being looked for.
+  //  Loading only reads the index tables, sprites and sounds are read from
+  //  the mapped files when they are first asked for.
+  std::vector<Data::PSource> candidates;
+  std::vector<std::future<bool>> found;
   for (const SourceFactory &factory : sources_factories) {
     for (const std::string &path : search_paths) {
       Data::PSource source = factory(path);
-      if (source->check()) {
-        Log::Info["data"] << "Game data found in '" << source->get_path()
-                          << "'...";
-        if (source->load()) {
-          data_source = std::move(source);
-          break;
-        }
-      }
+      candidates.push_back(source);
+      found.push_back(std::async(std::launch::async, [source]() {
+        return source->check(); }));
     }
-    if (data_source) {
-      break;
+  }
+
+  for (size_t i = 0; i < candidates.size(); i++) {
+    if (!found[i].get() || data_source) {
+      continue;
+    }
+    Log::Info["data"] << "Game data found in '" << candidates[i]->get_path()
+                      << "'...";
+    if (candidates[i]->load()) {
+      data_source = candidates[i];
     }
   }
 
@@ -26,9 +26,11 @@
 #include <list>
 #include <memory>
 #include <tuple>
+#include <vector>
 
 class Buffer;
 typedef std::shared_ptr<Buffer> PBuffer;
+class MemoryUsage;
 
 class Data {
  public:
@@ -144,6 +146,11 @@ class Data {
 
     virtual MaskImage get_sprite_parts(Resource res, size_t index) = 0;
 
+    // Start decoding every sprite in the background, those the first
+    // screens show first, so that drawing them later doesn't wait.
+    virtual void prewarm_sprites() = 0;
+    virtual void get_prewarm_progress(size_t *done, size_t *total) = 0;
+
     virtual size_t get_animation_phase_count(size_t animation) = 0;
     virtual Animation get_animation(size_t animation, size_t phase) = 0;
 
@@ -151,7 +158,15 @@ class Data {
     virtual MusicFormat get_music_format() = 0;
     virtual PBuffer get_music(size_t index) = 0;
 
+    // Start converting the given sounds and tunes for playing in the
+    // background, so that playing one the first time doesn't wait.
+    virtual void prewarm_audio(const std::vector<size_t> &sounds,
+                               const std::vector<size_t> &tunes) = 0;
+
     virtual bool check_file(const std::string &path) = 0;
+
+    // The decoded sprites and converted sounds kept for handing out again.
+    virtual void add_memory_usage(MemoryUsage *usage) = 0;
   };
 
   typedef std::shared_ptr<Source> PSource;
@@ -0,0 +1,82 @@
+/*
+ * event_loop-dummy.cc - User and system events handling without a window
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/event_loop-dummy.h"
+
+#include "src/gfx.h"
+#include "src/profiler.h"
+
+EventLoop &
+EventLoop::get_instance() {
+  static EventLoopDummy event_loop;
+  return event_loop;
+}
+
+void
+EventLoopDummy::run() {
+  Graphics &gfx = Graphics::get_instance();
+  Frame *screen = gfx.get_screen_frame();
+  quitting = false;
+  while (!quitting) {
+    while (!deferred_calls.empty()) {
+      deferred_calls.front()(nullptr);
+      deferred_calls.pop_front();
+    }
+
+    Profiler::Clock::time_point start = Profiler::Clock::now();
+    notify_update();
+    Profiler::Clock::time_point drawn = Profiler::Clock::now();
+    notify_draw(screen);
+    gfx.swap_buffers();
+    Profiler::Clock::time_point end = Profiler::Clock::now();
+
+    FrameTime frame_time;
+    frame_time.update_ms =
+      std::chrono::duration<float, std::milli>(drawn - start).count();
+    frame_time.draw_ms =
+      std::chrono::duration<float, std::milli>(end - drawn).count();
+    frame_time.frame_ms = frame_time.update_ms + frame_time.draw_ms;
+    frame_time.updates = 1;
+    record_frame(frame_time);
+  }
+  delete screen;
+}
+
+void
+EventLoopDummy::deferred_call(DeferredCall call, void * /*data*/) {
+  deferred_calls.push_back(call);
+}
+
+class TimerDummy : public Timer {
+ public:
+  TimerDummy(unsigned int _id, unsigned int _interval,
+             Timer::Handler *_handler)
+    : Timer(_id, _interval, _handler) {}
+
+  virtual void run() {}
+  virtual void stop() {}
+};
+
+Timer *
+Timer::create(unsigned int _id, unsigned int _interval,
+              Timer::Handler *_handler) {
+  return new TimerDummy(_id, _interval, _handler);
+}
@@ -0,0 +1,44 @@
+/*
+ * event_loop-dummy.h - User and system events handling without a window
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_EVENT_LOOP_DUMMY_H_
+#define SRC_EVENT_LOOP_DUMMY_H_
+
+#include <list>
+
+#include "src/event_loop.h"
+
+// Goes with VideoDummy. There is no input, so the loop only updates and
+//  draws, back to back, until it is told to quit; timers never fire.
+class EventLoopDummy : public EventLoop {
+ protected:
+  std::list<DeferredCall> deferred_calls;
+  bool quitting;
+
+ public:
+  EventLoopDummy() : quitting(false) {}
+
+  virtual void run();
+  virtual void quit() { quitting = true; }
+  virtual void deferred_call(DeferredCall call, void *data);
+};
+
+#endif  // SRC_EVENT_LOOP_DUMMY_H_
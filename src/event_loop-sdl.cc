@@ -23,9 +23,12 @@
 
 #include <SDL.h>
 
+#include <algorithm>
+
 #include "src/log.h"
 #include "src/gfx.h"
 #include "src/freeserf.h"
+#include "src/profiler.h"
 #include "src/video-sdl.h"
 
 EventLoop &
@@ -40,32 +43,34 @@ EventLoop::get_instance() {
 /* How much the mouse can move between events to be still
  considered as a double click. */
 #define MOUSE_MOVE_SENSITIVITY  8
+/* How many game steps one turn of the loop may run to catch up. */
+#define MAX_CATCH_UP_TICKS  5
+/* Milliseconds between frames if the display doesn't say. */
+#define DEFAULT_FRAME_LENGTH  16
+
+static const Profiler::Section profile_frame_update("frame.update");
+
+static float
+ms_between(Profiler::Clock::time_point start, Profiler::Clock::time_point end) {
+  return std::chrono::duration<float, std::milli>(end - start).count();
+}
 
 EventLoopSDL::EventLoopSDL()
   : zoom_factor(1.f)
   , screen_factor_x(1.f)
-  , screen_factor_y(1.f) {
+  , screen_factor_y(1.f)
+  , screen(nullptr)
+  , drag_button(0)
+  , drag_x(0)
+  , drag_y(0)
+  , drag_pending(false)
+  , drag_to_x(0)
+  , drag_to_y(0)
+  , exposed(false)
+  , last_click{0}
+  , last_click_x(0)
+  , last_click_y(0) {
   SDL_InitSubSystem(SDL_INIT_EVENTS | SDL_INIT_TIMER);
-
-  eventUserTypeStep = SDL_RegisterEvents(2);
-  if (eventUserTypeStep == (Uint32)-1) {
-    throw ExceptionFreeserf("Failed to register SDL event");
-  }
-  eventUserTypeStep++;
-}
-
-Uint32
-EventLoopSDL::timer_callback(Uint32 interval, void *param) {
-  EventLoopSDL *eventLoop = static_cast<EventLoopSDL*>(param);
-  SDL_Event event;
-  event.type = eventLoop->eventUserTypeStep;
-  event.user.type = eventLoop->eventUserTypeStep;
-  event.user.code = 0;
-  event.user.data1 = 0;
-  event.user.data2 = 0;
-  SDL_PushEvent(&event);
-
-  return interval;
 }
 
 void
@@ -90,219 +95,325 @@ EventLoopSDL::deferred_call(DeferredCall call, void *data) {
   SDL_PushEvent(&event);
 }
 
+// milliseconds between frames, as often as the display refreshes
+unsigned int
+EventLoopSDL::get_frame_length() const {
+  SDL_DisplayMode mode;
+  if (SDL_GetCurrentDisplayMode(0, &mode) != 0 || mode.refresh_rate <= 0) {
+    return DEFAULT_FRAME_LENGTH;
+  }
+  return std::max(1, 1000 / mode.refresh_rate);
+}
+
 // event_loop() has been turned into a SDL based loop.
-// The code for one iteration of the original game_loop is in game_loop_iter.
+// The game is updated in steps of TICK_LENGTH however long the frames take,
+//  and drawn once per frame in between, with tick_progress telling how far
+//  into the next step the frame is.  When updating falls so far behind that
+//  MAX_CATCH_UP_TICKS steps don't make up for it the rest is dropped, the
+//  game then runs slower than the clock instead of never getting to draw.
+// While fast forwarding the clock is not followed, updates run for
+//  fast_forward_slice_ms between looks at the events, and frames are only
+//  drawn every fast_forward_frame_ms
 void
 EventLoopSDL::run() {
-  SDL_TimerID timer_id = SDL_AddTimer(TICK_LENGTH, timer_callback, this);
-  if (timer_id == 0) {
-    return;
-  }
+  Graphics &gfx = Graphics::get_instance();
+  gfx.get_screen_factor(&screen_factor_x, &screen_factor_y);
 
-  int drag_button = 0;
-  int drag_x = 0;
-  int drag_y = 0;
+  const unsigned int tick_length = TICK_LENGTH;
+  unsigned int frame_length = get_frame_length();
+  unsigned int last_ticks = SDL_GetTicks();
+  unsigned int last_draw = last_ticks - frame_length;
+  unsigned int lag = 0;
 
-  unsigned int last_click[6] = {0};
-  int last_click_x = 0;
-  int last_click_y = 0;
+  Profiler::Clock::time_point last_frame = Profiler::Clock::now();
+  FrameTime frame_time = { 0.f, 0.f, 0.f, 0 };
 
   SDL_Event event;
+  bool running = true;
+  while (running) {
+    // sleep until something happens or the next step or frame is due
+    unsigned int now = SDL_GetTicks();
+    unsigned int step_due = tick_length -
+                            std::min(lag + (now - last_ticks), tick_length);
+    unsigned int frame_due = frame_length -
+                             std::min(now - last_draw, frame_length);
+    if (fast_forward) {
+      step_due = 0;
+    }
+    if (SDL_WaitEventTimeout(&event, std::min(step_due, frame_due))) {
+      PROFILE_SCOPE("frame.events");
+      do {
+        running = handle_event(event);
+      } while (running && SDL_PollEvent(&event));
+      if (running) {
+        send_pending_drag();
+      }
+    }
+    if (!running) {
+      break;
+    }
 
+    now = SDL_GetTicks();
+    lag += now - last_ticks;
+    last_ticks = now;
+    unsigned int steps = 0;
+    Profiler::Clock::time_point start = Profiler::Clock::now();
+    if (fast_forward) {
+      // an update may turn it off, once the target tick is reached
+      while (fast_forward && SDL_GetTicks() - now < fast_forward_slice_ms) {
+        notify_update();
+        steps++;
+      }
+      lag = 0;
+      last_ticks = SDL_GetTicks();
+    }
+    while (lag >= tick_length && steps < MAX_CATCH_UP_TICKS) {
+      notify_update();
+      lag -= tick_length;
+      steps++;
+    }
+    // what is still owed after that is dropped
+    lag %= tick_length;
+    if (steps > 0) {
+      Profiler::Clock::time_point end = Profiler::Clock::now();
+      Profiler::record(profile_frame_update, start, end);
+      Trace::counter("frame.updates", steps);
+      frame_time.update_ms += ms_between(start, end);
+      frame_time.updates += steps;
+    }
+
+    unsigned int draw_length = fast_forward ?
+                               fast_forward_frame_ms : frame_length;
+    if (now - last_draw >= draw_length) {
+      tick_progress = static_cast<float>(lag) / tick_length;
+      start = Profiler::Clock::now();
+      if (draw()) {
+        Profiler::Clock::time_point end = Profiler::Clock::now();
+        frame_time.frame_ms = ms_between(last_frame, end);
+        frame_time.draw_ms = ms_between(start, end);
+        record_frame(frame_time);
+        frame_time = { 0.f, 0.f, 0.f, 0 };
+        last_frame = end;
+      }
+      last_draw = now;
+    }
+  }
+
+  if (screen != nullptr) {
+    delete screen;
+    screen = nullptr;
+  }
+}
+
+// Handlers return false for a frame when nothing in it changed, then the
+//  screen frame is left as it is and not shown again, unless the window
+//  lost what it showed.
+bool
+EventLoopSDL::draw() {
+  PROFILE_SCOPE("frame.draw");
   Graphics &gfx = Graphics::get_instance();
-  Frame *screen = nullptr;
-  gfx.get_screen_factor(&screen_factor_x, &screen_factor_y);
+  if (screen == nullptr) {
+    screen = gfx.get_screen_frame();
+  }
+  bool drawn = notify_draw(screen);
+  if (!drawn && !exposed) {
+    return false;
+  }
+  exposed = false;
 
-  while (SDL_WaitEvent(&event)) {
-    unsigned int current_ticks = SDL_GetTicks();
+  // Swap video buffers
+  gfx.swap_buffers();
+  return drawn;
+}
 
-    switch (event.type) {
-      case SDL_MOUSEBUTTONUP:
-        if (drag_button == event.button.button) {
-          drag_button = 0;
-        }
+void
+EventLoopSDL::send_pending_drag() {
+  if (!drag_pending) {
+    return;
+  }
+  drag_pending = false;
 
-        if (event.button.button <= 3) {
-          int x = static_cast<int>(static_cast<float>(event.button.x) *
-                                   zoom_factor * screen_factor_x);
-          int y = static_cast<int>(static_cast<float>(event.button.y) *
-                                   zoom_factor * screen_factor_y);
-          notify_click(x, y, (Event::Button)event.button.button);
-
-          if (current_ticks - last_click[event.button.button] <
-                MOUSE_TIME_SENSITIVITY &&
-              event.button.x >= (last_click_x - MOUSE_MOVE_SENSITIVITY) &&
-              event.button.x <= (last_click_x + MOUSE_MOVE_SENSITIVITY) &&
-              event.button.y >= (last_click_y - MOUSE_MOVE_SENSITIVITY) &&
-              event.button.y <= (last_click_y + MOUSE_MOVE_SENSITIVITY)) {
-            notify_dbl_click(x, y, (Event::Button)event.button.button);
-          }
+  int x = static_cast<int>(static_cast<float>(drag_x) *
+                           zoom_factor * screen_factor_x);
+  int y = static_cast<int>(static_cast<float>(drag_y) *
+                           zoom_factor * screen_factor_y);
+
+  notify_drag(x, y, drag_to_x - drag_x, drag_to_y - drag_y,
+              (Event::Button)drag_button);
+
+  SDL_WarpMouseInWindow(nullptr, drag_x, drag_y);
+}
+
+bool
+EventLoopSDL::handle_event(const SDL_Event &event) {
+  Graphics &gfx = Graphics::get_instance();
+  unsigned int current_ticks = SDL_GetTicks();
+
+  switch (event.type) {
+    case SDL_MOUSEBUTTONUP:
+      if (drag_button == event.button.button) {
+        // the drag this release ends goes before its click
+        send_pending_drag();
+        drag_button = 0;
+      }
 
-          last_click[event.button.button] = current_ticks;
-          last_click_x = event.button.x;
-          last_click_y = event.button.y;
+      if (event.button.button <= 3) {
+        int x = static_cast<int>(static_cast<float>(event.button.x) *
+                                 zoom_factor * screen_factor_x);
+        int y = static_cast<int>(static_cast<float>(event.button.y) *
+                                 zoom_factor * screen_factor_y);
+        notify_click(x, y, (Event::Button)event.button.button);
+
+        if (current_ticks - last_click[event.button.button] <
+              MOUSE_TIME_SENSITIVITY &&
+            event.button.x >= (last_click_x - MOUSE_MOVE_SENSITIVITY) &&
+            event.button.x <= (last_click_x + MOUSE_MOVE_SENSITIVITY) &&
+            event.button.y >= (last_click_y - MOUSE_MOVE_SENSITIVITY) &&
+            event.button.y <= (last_click_y + MOUSE_MOVE_SENSITIVITY)) {
+          notify_dbl_click(x, y, (Event::Button)event.button.button);
         }
-        break;
-      case SDL_MOUSEBUTTONDOWN:
-        break;
-      case SDL_MOUSEMOTION:
-        for (int button = 1; button <= 3; button++) {
-          if (event.motion.state & SDL_BUTTON(button)) {
-            if (drag_button == 0) {
-              drag_button = button;
-              drag_x = event.motion.x;
-              drag_y = event.motion.y;
-            }
-
-            int x = static_cast<int>(static_cast<float>(drag_x) *
-                                     zoom_factor * screen_factor_x);
-            int y = static_cast<int>(static_cast<float>(drag_y) *
-                                     zoom_factor * screen_factor_y);
-
-            notify_drag(x, y,
-                        event.motion.x - drag_x, event.motion.y - drag_y,
-                        (Event::Button)drag_button);
-
-            SDL_WarpMouseInWindow(nullptr, drag_x, drag_y);
-
-            break;
+
+        last_click[event.button.button] = current_ticks;
+        last_click_x = event.button.x;
+        last_click_y = event.button.y;
+      }
+      break;
+    case SDL_MOUSEBUTTONDOWN:
+      break;
+    case SDL_MOUSEMOTION:
+      for (int button = 1; button <= 3; button++) {
+        if (event.motion.state & SDL_BUTTON(button)) {
+          if (drag_button == 0) {
+            drag_button = button;
+            drag_x = event.motion.x;
+            drag_y = event.motion.y;
           }
+
+          // the mouse is only put back after the drag is sent, so the
+          //  last position is where all the motions since then add up to
+          drag_pending = true;
+          drag_to_x = event.motion.x;
+          drag_to_y = event.motion.y;
+          break;
         }
+      }
+      break;
+    case SDL_MOUSEWHEEL: {
+      SDL_Keymod mod = SDL_GetModState();
+      if ((mod & KMOD_CTRL) != 0) {
+        zoom(0.2f * static_cast<float>(event.wheel.y));
+      }
+      break;
+    }
+    case SDL_KEYDOWN: {
+      if (event.key.keysym.sym == SDLK_q &&
+          (event.key.keysym.mod & KMOD_CTRL)) {
+        quit();
         break;
-      case SDL_MOUSEWHEEL: {
-        SDL_Keymod mod = SDL_GetModState();
-        if ((mod & KMOD_CTRL) != 0) {
-          zoom(0.2f * static_cast<float>(event.wheel.y));
-        }
-        break;
       }
-      case SDL_KEYDOWN: {
-        if (event.key.keysym.sym == SDLK_q &&
-            (event.key.keysym.mod & KMOD_CTRL)) {
-          quit();
+
+      unsigned char modifier = 0;
+      if (event.key.keysym.mod & KMOD_CTRL) {
+        modifier |= 1;
+      }
+      if (event.key.keysym.mod & KMOD_SHIFT) {
+        modifier |= 2;
+      }
+      if (event.key.keysym.mod & KMOD_ALT) {
+        modifier |= 4;
+      }
+
+      switch (event.key.keysym.sym) {
+        // Map scroll
+        case SDLK_UP: {
+          notify_drag(0, 0, 0, -32, Event::ButtonLeft);
           break;
         }
-
-        unsigned char modifier = 0;
-        if (event.key.keysym.mod & KMOD_CTRL) {
-          modifier |= 1;
+        case SDLK_DOWN: {
+          notify_drag(0, 0, 0, 32, Event::ButtonLeft);
+          break;
         }
-        if (event.key.keysym.mod & KMOD_SHIFT) {
-          modifier |= 2;
+        case SDLK_LEFT: {
+          notify_drag(0, 0, -32, 0, Event::ButtonLeft);
+          break;
         }
-        if (event.key.keysym.mod & KMOD_ALT) {
-          modifier |= 4;
+        case SDLK_RIGHT: {
+          notify_drag(0, 0, 32, 0, Event::ButtonLeft);
+          break;
         }
 
-        switch (event.key.keysym.sym) {
-          // Map scroll
-          case SDLK_UP: {
-            notify_drag(0, 0, 0, -32, Event::ButtonLeft);
-            break;
-          }
-          case SDLK_DOWN: {
-            notify_drag(0, 0, 0, 32, Event::ButtonLeft);
-            break;
-          }
-          case SDLK_LEFT: {
-            notify_drag(0, 0, -32, 0, Event::ButtonLeft);
-            break;
-          }
-          case SDLK_RIGHT: {
-            notify_drag(0, 0, 32, 0, Event::ButtonLeft);
-            break;
+        case SDLK_PLUS:
+        case SDLK_KP_PLUS:
+        case SDLK_EQUALS:
+          notify_key_pressed('+', 0);
+          break;
+        case SDLK_MINUS:
+        case SDLK_KP_MINUS:
+          notify_key_pressed('-', 0);
+          break;
+
+        // Video
+        case SDLK_f:
+          if (event.key.keysym.mod & KMOD_CTRL) {
+            gfx.set_fullscreen(!gfx.is_fullscreen());
+          } else {
+            notify_key_pressed('f', modifier);
           }
+          break;
+        case SDLK_RIGHTBRACKET:
+          zoom(-0.2f);
+          break;
+        case SDLK_LEFTBRACKET:
+          zoom(0.2f);
+          break;
 
-          case SDLK_PLUS:
-          case SDLK_KP_PLUS:
-          case SDLK_EQUALS:
-            notify_key_pressed('+', 0);
-            break;
-          case SDLK_MINUS:
-          case SDLK_KP_MINUS:
-            notify_key_pressed('-', 0);
-            break;
-
-          // Video
-          case SDLK_f:
-            if (event.key.keysym.mod & KMOD_CTRL) {
-              gfx.set_fullscreen(!gfx.is_fullscreen());
-            }
-            break;
-          case SDLK_RIGHTBRACKET:
-            zoom(-0.2f);
-            break;
-          case SDLK_LEFTBRACKET:
-            zoom(0.2f);
-            break;
-
-          // Misc
-          case SDLK_F10:
-            notify_key_pressed('n', 1);
-            break;
-
-          default:
-            notify_key_pressed(event.key.keysym.sym, modifier);
-            break;
-        }
+        // Misc
+        case SDLK_F10:
+          notify_key_pressed('n', 1);
+          break;
 
-        break;
+        default:
+          notify_key_pressed(event.key.keysym.sym, modifier);
+          break;
       }
-      case SDL_QUIT:
-        notify_key_pressed('c', 1);
-        break;
-      case SDL_WINDOWEVENT:
-        if (SDL_WINDOWEVENT_SIZE_CHANGED == event.window.event) {
-          unsigned int width = event.window.data1;
-          unsigned int height = event.window.data2;
-          gfx.set_resolution(width, height, gfx.is_fullscreen());
-          gfx.get_screen_factor(&screen_factor_x, &screen_factor_y);
-          notify_resize(width, height);
-        }
-        break;
-      case SDL_USEREVENT:
-        switch (event.user.code) {
-          case EventUserTypeQuit:
-            SDL_RemoveTimer(timer_id);
-            if (screen != nullptr) {
-              delete screen;
-              screen = nullptr;
-            }
-            return;
-          case EventUserTypeCall: {
-            while (!deferred_calls.empty()) {
-              deferred_calls.front()(nullptr);
-              deferred_calls.pop_front();
-            }
-            break;
-          }
-          default:
-            break;
-        }
-        break;
-      default:
-        if (event.type == eventUserTypeStep) {
-          // Update and draw interface
-          notify_update();
 
-          if (screen == nullptr) {
-            screen = gfx.get_screen_frame();
+      break;
+    }
+    case SDL_QUIT:
+      notify_key_pressed('c', 1);
+      break;
+    case SDL_WINDOWEVENT:
+      if (SDL_WINDOWEVENT_EXPOSED == event.window.event) {
+        exposed = true;
+      }
+      if (SDL_WINDOWEVENT_SIZE_CHANGED == event.window.event) {
+        unsigned int width = event.window.data1;
+        unsigned int height = event.window.data2;
+        gfx.set_resolution(width, height, gfx.is_fullscreen());
+        gfx.get_screen_factor(&screen_factor_x, &screen_factor_y);
+        notify_resize(width, height);
+      }
+      break;
+    case SDL_USEREVENT:
+      switch (event.user.code) {
+        case EventUserTypeQuit:
+          return false;
+        case EventUserTypeCall: {
+          while (!deferred_calls.empty()) {
+            deferred_calls.front()(nullptr);
+            deferred_calls.pop_front();
           }
-          notify_draw(screen);
-
-          // Swap video buffers
-          gfx.swap_buffers();
-
-          SDL_FlushEvent(eventUserTypeStep);
+          break;
         }
-    }
+        default:
+          break;
+      }
+      break;
+    default:
+      break;
   }
 
-  SDL_RemoveTimer(timer_id);
-  if (screen != nullptr) {
-    delete screen;
-    screen = nullptr;
-  }
+  return true;
 }
 
 void
@@ -30,7 +30,6 @@
 class EventLoopSDL : public EventLoop {
  public:
   typedef enum EventUserType {
-    EventUserTypeStep,
     EventUserTypeQuit,
     EventUserTypeCall,
   } EventUserType;
@@ -40,7 +39,22 @@ class EventLoopSDL : public EventLoop {
   float zoom_factor;
   float screen_factor_x;
   float screen_factor_y;
-  Uint32 eventUserTypeStep;
+  Frame *screen;
+
+  int drag_button;
+  int drag_x;
+  int drag_y;
+  /* Where the mouse last moved to while dragging, not yet handed to the
+     handlers. All motion events that come in one turn of the loop make
+     one drag, sent after the clicks and keys that came with them. */
+  bool drag_pending;
+  int drag_to_x;
+  int drag_to_y;
+  /* The window needs the last frame shown again, drawn or not. */
+  bool exposed;
+  unsigned int last_click[6];
+  int last_click_x;
+  int last_click_y;
 
  public:
   EventLoopSDL();
@@ -51,7 +65,12 @@ class EventLoopSDL : public EventLoop {
 
  protected:
   void zoom(float delta);
-  static Uint32 timer_callback(Uint32 interval, void *param);
+  unsigned int get_frame_length() const;
+  // false once the loop should stop
+  bool handle_event(const SDL_Event &event);
+  void send_pending_drag();
+  // false if nothing changed and the last frame was left on screen
+  bool draw();
 };
 
 #endif  // SRC_EVENT_LOOP_SDL_H_
@@ -26,7 +26,21 @@
 EventLoop *
 EventLoop::instance = nullptr;
 
-EventLoop::EventLoop() {
+const unsigned int EventLoop::frame_times_kept;
+const unsigned int EventLoop::fast_forward_slice_ms;
+const unsigned int EventLoop::fast_forward_frame_ms;
+
+EventLoop::EventLoop()
+  : tick_progress(0.f)
+  , frame_times{}
+  , frame_count(0)
+  , fast_forward(false) {
+}
+
+void
+EventLoop::record_frame(const FrameTime &frame_time) {
+  frame_times[frame_count % frame_times_kept] = frame_time;
+  frame_count++;
 }
 
 void
@@ -87,6 +87,19 @@ class EventLoop {
     virtual bool handle_event(const Event *event) = 0;
   };
 
+  // what one drawn frame took, in milliseconds
+  typedef struct FrameTime {
+    float frame_ms;    // since the frame before it
+    float update_ms;   // in the game updates run for it
+    float draw_ms;
+    unsigned int updates;
+  } FrameTime;
+  static const unsigned int frame_times_kept = 128;
+  // while fast forwarding, milliseconds of updates between looking at
+  //  events, and between the frames that are still drawn
+  static const unsigned int fast_forward_slice_ms = 20;
+  static const unsigned int fast_forward_frame_ms = 250;
+
  protected:
   typedef std::list<Handler*> Handlers;
   typedef std::function<void(void*)> DeferredCall;
@@ -94,6 +107,10 @@ class EventLoop {
  protected:
   Handlers event_handlers;
   Handlers removed;
+  float tick_progress;
+  FrameTime frame_times[frame_times_kept];
+  unsigned int frame_count;
+  bool fast_forward;
   static EventLoop *instance;
 
  public:
@@ -107,6 +124,21 @@ class EventLoop {
   void add_handler(Handler *handler);
   void del_handler(Handler *handler);
 
+  // how far the frame being drawn is from the last update towards the
+  //  next one, 0 up to 1
+  float get_tick_progress() const { return tick_progress; }
+
+  // frames drawn so far, and the times of the last frame_times_kept of
+  //  them, 0 being the last one
+  unsigned int get_frame_count() const { return frame_count; }
+  const FrameTime &get_frame_time(unsigned int back) const {
+    return frame_times[(frame_count - 1 - back) % frame_times_kept]; }
+
+  // run updates back to back instead of one per TICK_LENGTH, and draw
+  //  only every fast_forward_frame_ms, until it is turned off again
+  void set_fast_forward(bool on) { fast_forward = on; }
+  bool is_fast_forward() const { return fast_forward; }
+
  protected:
   EventLoop();
 
@@ -119,6 +151,8 @@ class EventLoop {
   bool notify_resize(unsigned int width, unsigned int height);
   bool notify_update();
   bool notify_draw(Frame *frame);
+
+  void record_frame(const FrameTime &frame_time);
 };
 
 #endif  // SRC_EVENT_LOOP_H_
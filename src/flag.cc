@@ -27,49 +27,148 @@
 #include "src/savegame.h"
 #include "src/log.h"
 #include "src/inventory.h"
+#include "src/pathfinder.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #define SEARCH_MAX_DEPTH  0x10000
 
+// The lowest slot of a mask of slots, which must not be empty.
+static unsigned int
+first_slot(unsigned int mask) {
+#if defined(_MSC_VER)
+  unsigned long slot;  // NOLINT(runtime/int) the type _BitScanForward takes
+  _BitScanForward(&slot, mask);
+  return slot;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// The slots in a mask of FLAG_MAX_RES_COUNT slots.
+static unsigned int
+slot_count(unsigned int mask) {
+  mask = (mask & 0x55) + ((mask >> 1) & 0x55);
+  mask = (mask & 0x33) + ((mask >> 2) & 0x33);
+  return (mask & 0x0f) + (mask >> 4);
+}
+
+static const unsigned int all_slots = BIT(FLAG_MAX_RES_COUNT) - 1;
+
+const unsigned int Flag::traffic_half_life;
+const unsigned int Flag::traffic_unit;
+const unsigned int Flag::traffic_congested_wait;
+
+void
+FlagSearch::Queue::grow() {
+  std::vector<Flag*> larger(ring.size() * 2);
+  for (size_t i = 0; i < count; i++) {
+    larger[i] = ring[(head + i) & (ring.size() - 1)];
+  }
+  ring.swap(larger);
+  head = 0;
+}
+
+FlagSearch::Queue *
+FlagSearch::Pool::acquire() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (free_queues.empty()) {
+    queues.emplace_back(new Queue());
+    return queues.back().get();
+  }
+  Queue *queue = free_queues.back();
+  free_queues.pop_back();
+  return queue;
+}
+
+void
+FlagSearch::Pool::release(Queue *queue) {
+  queue->clear();
+  std::lock_guard<std::mutex> lock(mutex);
+  free_queues.push_back(queue);
+}
+
 FlagSearch::FlagSearch(Game *game_) {
   game = game_;
   id = game->next_search_id();
+  queue = game->get_flag_search_pool()->acquire();
+}
+
+FlagSearch::~FlagSearch() {
+  game->get_flag_search_pool()->release(queue);
 }
 
 void
 FlagSearch::add_source(Flag *flag) {
-  queue.push_back(flag);
+  queue->push(flag);
   flag->search_num = id;
 }
 
+void
+FlagSearch::expand(Flag *flag, bool land, bool transporter) {
+  for (Direction i : cycle_directions_ccw()) {
+    if ((!land || !flag->is_water_path(i)) &&
+        (!transporter || flag->has_transporter(i)) &&
+        flag->other_endpoint.f[i]->search_num != id) {
+      flag->other_endpoint.f[i]->search_num = id;
+      flag->other_endpoint.f[i]->search_dir = flag->search_dir;
+      Flag *other_flag = flag->other_endpoint.f[i];
+      queue->push(other_flag);
+    }
+  }
+}
+
 bool
 FlagSearch::execute(flag_search_func *callback, bool land,
                     bool transporter, void *data) {
-  for (int i = 0; i < SEARCH_MAX_DEPTH && !queue.empty(); i++) {
-    Flag *flag = queue.front();
-    queue.erase(queue.begin());
+  for (int i = 0; i < SEARCH_MAX_DEPTH && !queue->empty(); i++) {
+    Flag *flag = queue->pop();
 
     if (callback(flag, data)) {
       /* Clean up */
-      queue.clear();
+      queue->clear();
       return true;
     }
 
-    for (Direction i : cycle_directions_ccw()) {
-      if ((!land || !flag->is_water_path(i)) &&
-          (!transporter || flag->has_transporter(i)) &&
-          flag->other_endpoint.f[i]->search_num != id) {
-        flag->other_endpoint.f[i]->search_num = id;
-        flag->other_endpoint.f[i]->search_dir = flag->search_dir;
-        Flag *other_flag = flag->other_endpoint.f[i];
-        queue.push_back(other_flag);
+    expand(flag, land, transporter);
+  }
+
+  /* Clean up */
+  queue->clear();
+
+  return false;
+}
+
+bool
+FlagSearch::execute_batch(Request *requests, size_t count, bool land,
+                          bool transporter) {
+  size_t pending = 0;
+  for (size_t r = 0; r < count; r++) {
+    if (!requests[r].done) pending++;
+  }
+
+  for (int i = 0; i < SEARCH_MAX_DEPTH && pending > 0 && !queue->empty();
+       i++) {
+    Flag *flag = queue->pop();
+
+    for (size_t r = 0; r < count; r++) {
+      if (!requests[r].done && requests[r].callback(flag, requests[r].data)) {
+        requests[r].done = true;
+        pending--;
       }
     }
+
+    if (pending > 0) {
+      expand(flag, land, transporter);
+    }
   }
 
   /* Clean up */
-  queue.clear();
+  queue->clear();
 
-  return false;
+  return (pending == 0);
 }
 
 bool
@@ -87,37 +186,54 @@ Flag::Flag(Game *game, unsigned int index)
   , path_con(0)
   , endpoint(0)
   , slot{}
+  , slots_used(0)
+  , slots_dir{}
   , search_num(0)
   , search_dir(DirectionRight)
   , transporter(0)
   , length{}
   , other_endpoint{}
   , other_end_dir{}
+  , traffic{}
+  , queued(0)
+  , arrived(0)
+  , traffic_tick(game->get_tick())
   , bld_flags(0)
-  , bld2_flags(0) {
+  , bld2_flags(0)
+  , sleeping(false)
+  , nearest_inventory_changes{}
+  , nearest_inventory{}
+  , inventories_in_reach_changes(0) {
   for (int j = 0; j < FLAG_MAX_RES_COUNT; j++) {
     slot[j].type = Resource::TypeNone;
     slot[j].dest = 0;
     slot[j].dir = DirectionNone;
+    slot[j].since = 0;
   }
 }
 
 void
 Flag::add_path(Direction dir, bool water) {
+  wake();
   path_con |= BIT(dir);
   if (water) {
     endpoint &= ~BIT(dir);
   } else {
     endpoint |= BIT(dir);
   }
-  transporter &= ~BIT(dir);
+  set_transporters(transporter & ~BIT(dir));
+  game->get_watchdog()->path_unserved(get_index(), dir, game->get_tick());
+  game->count_flag_graph_change();
 }
 
 void
 Flag::del_path(Direction dir) {
+  wake();
   path_con &= ~BIT(dir);
   endpoint &= ~BIT(dir);
-  transporter &= ~BIT(dir);
+  set_transporters(transporter & ~BIT(dir));
+  game->get_watchdog()->path_served(get_index(), dir);
+  game->count_flag_graph_change();
 
   if (serf_requested(dir)) {
     cancel_serf_request(dir);
@@ -129,6 +245,8 @@ Flag::del_path(Direction dir) {
 
   other_end_dir[dir] &= 0x78;
   other_endpoint.f[dir] = NULL;
+  PathTiles().swap(path_tiles[dir]);
+  traffic[dir] = Traffic{};
 
   /* Mark resource path for recalculation if they would
    have followed the removed path. */
@@ -142,14 +260,21 @@ Flag::pick_up_resource(unsigned int from_slot, Resource::Type *res,
     throw ExceptionFreeserf("Wrong flag slot index.");
   }
 
-  if (slot[from_slot].type == Resource::TypeNone) {
+  if (!BIT_TEST(slots_used, from_slot)) {
     return false;
   }
 
   *res = slot[from_slot].type;
   *dest = slot[from_slot].dest;
-  slot[from_slot].type = Resource::TypeNone;
-  slot[from_slot].dir = DirectionNone;
+  Direction dir = slot[from_slot].dir;
+  if (dir != DirectionNone) {
+    decay_traffic();
+    unsigned int waited = game->get_tick() - slot[from_slot].since;
+    traffic[dir].carried += traffic_unit;
+    traffic[dir].waited += std::min(waited, traffic_half_life);
+  }
+  set_slot_type(from_slot, Resource::TypeNone);
+  set_slot_dir(from_slot, DirectionNone);
 
   fix_scheduled();
 
@@ -162,40 +287,105 @@ Flag::drop_resource(Resource::Type res, unsigned int dest) {
     throw ExceptionFreeserf("Wrong resource type.");
   }
 
-  for (int i = 0; i < FLAG_MAX_RES_COUNT; i++) {
-    if (slot[i].type == Resource::TypeNone) {
-      slot[i].type = res;
-      slot[i].dest = dest;
-      slot[i].dir = DirectionNone;
-      endpoint |= BIT(7);
-      return true;
-    }
+  unsigned int empty = ~slots_used & all_slots;
+  if (empty == 0) {
+    return false;
   }
 
-  return false;
+  unsigned int i = first_slot(empty);
+  wake();
+  set_slot_type(i, res);
+  slot[i].dest = dest;
+  set_slot_dir(i, DirectionNone);
+  slot[i].since = game->get_tick();
+  endpoint |= BIT(7);
+
+  decay_traffic();
+  queued += slot_count(slots_used) * traffic_unit;
+  arrived += traffic_unit;
+  return true;
 }
 
-bool
-Flag::has_empty_slot() const {
-  int scheduled_slots = 0;
+static unsigned int
+halve(unsigned int value, unsigned int times) {
+  return (times < 32) ? (value >> times) : 0;
+}
+
+unsigned int
+Flag::get_traffic_halvings() const {
+  return (game->get_tick() - traffic_tick) / traffic_half_life;
+}
+
+void
+Flag::decay_traffic() {
+  unsigned int halvings = get_traffic_halvings();
+  if (halvings == 0) {
+    return;
+  }
+  traffic_tick += halvings * traffic_half_life;
+  for (Traffic &path : traffic) {
+    path.carried = halve(path.carried, halvings);
+    path.waited = halve(path.waited, halvings);
+  }
+  queued = halve(queued, halvings);
+  arrived = halve(arrived, halvings);
+}
+
+unsigned int
+Flag::get_traffic_carried(Direction dir) const {
+  return halve(traffic[dir].carried, get_traffic_halvings()) / traffic_unit;
+}
+
+unsigned int
+Flag::get_traffic_wait(Direction dir) const {
+  unsigned int halvings = get_traffic_halvings();
+  unsigned int carried = halve(traffic[dir].carried, halvings);
+  if (carried == 0) {
+    return 0;
+  }
+  uint64_t waited = halve(traffic[dir].waited, halvings);
+  return static_cast<unsigned int>(waited * traffic_unit / carried);
+}
+
+unsigned int
+Flag::get_traffic_queue() const {
+  unsigned int halvings = get_traffic_halvings();
+  unsigned int count = halve(arrived, halvings);
+  if (count == 0) {
+    return 0;
+  }
+  return halve(queued, halvings) / count;
+}
+
+void
+Flag::count_slots() {
+  slots_used = 0;
+  for (unsigned int &dir_slots : slots_dir) {
+    dir_slots = 0;
+  }
   for (int i = 0; i < FLAG_MAX_RES_COUNT; i++) {
     if (slot[i].type != Resource::TypeNone) {
-      scheduled_slots++;
+      slots_used |= BIT(i);
+    }
+    if (slot[i].dir >= DirectionRight && slot[i].dir <= DirectionUp) {
+      slots_dir[slot[i].dir] |= BIT(i);
     }
   }
+}
 
-  return (scheduled_slots != FLAG_MAX_RES_COUNT);
+bool
+Flag::has_empty_slot() const {
+  return (slots_used != all_slots);
 }
 
 void
 Flag::remove_all_resources() {
-  for (int i = 0; i < FLAG_MAX_RES_COUNT; i++) {
-    if (slot[i].type != Resource::TypeNone) {
-      int res = slot[i].type;
-      unsigned int dest = slot[i].dest;
-      game->cancel_transported_resource((Resource::Type)res, dest);
-      game->lose_resource((Resource::Type)res);
-    }
+  for (unsigned int used = slots_used; used != 0; used &= used - 1) {
+    unsigned int i = first_slot(used);
+    int res = slot[i].type;
+    unsigned int dest = slot[i].dest;
+    game->cancel_transported_resource((Resource::Type)res, dest);
+    game->lose_resource((Resource::Type)res);
   }
 }
 
@@ -206,14 +396,7 @@ Flag::get_resource_at_slot(int slot_) const {
 
 void
 Flag::fix_scheduled() {
-  int scheduled_slots = 0;
-  for (int i = 0; i < FLAG_MAX_RES_COUNT; i++) {
-    if (slot[i].type != Resource::TypeNone) {
-      scheduled_slots++;
-    }
-  }
-
-  if (scheduled_slots) {
+  if (slots_used != 0) {
     endpoint |= BIT(7);
   } else {
     endpoint &= ~BIT(7);
@@ -341,7 +524,7 @@ Flag::schedule_slot_to_unknown_dest(int slot_num) {
         other_end_dir[dir] = BIT(7) |
           (other_end_dir[dir] & 0x38) | slot_num;
       }
-      slot[slot_num].dir = dir;
+      set_slot_dir(slot_num, dir);
     }
   } else {
     this->slot[slot_num].dest = r;
@@ -362,12 +545,15 @@ find_nearest_inventory_search_cb(Flag *flag, void *data) {
 /* Return the flag index of the inventory nearest to flag. */
 int
 Flag::find_nearest_inventory_for_resource() {
+  unsigned int changes = game->get_flag_graph_changes();
+  if (nearest_inventory_changes[0] == changes) return nearest_inventory[0];
+
   Flag *dest = NULL;
   FlagSearch::single(this, find_nearest_inventory_search_cb, false, true,
                      &dest);
-  if (dest != NULL) return dest->get_index();
-
-  return -1;
+  nearest_inventory[0] = (dest != NULL) ? dest->get_index() : -1;
+  nearest_inventory_changes[0] = changes;
+  return nearest_inventory[0];
 }
 
 static bool
@@ -384,13 +570,39 @@ flag_search_inventory_search_cb(Flag *flag, void *data) {
 
 int
 Flag::find_nearest_inventory_for_serf() {
+  unsigned int changes = game->get_flag_graph_changes();
+  if (nearest_inventory_changes[1] == changes) return nearest_inventory[1];
+
   int dest_index = -1;
   FlagSearch::single(this, flag_search_inventory_search_cb, true, false,
                      &dest_index);
-
+  nearest_inventory[1] = dest_index;
+  nearest_inventory_changes[1] = changes;
   return dest_index;
 }
 
+static bool
+collect_inventories_search_cb(Flag *flag, void *data) {
+  if (flag->has_inventory()) {
+    std::vector<unsigned int> *inventories =
+      static_cast<std::vector<unsigned int>*>(data);
+    inventories->push_back(flag->get_index());
+  }
+  return false;
+}
+
+const std::vector<unsigned int> &
+Flag::get_inventories_in_reach() {
+  unsigned int changes = game->get_flag_graph_changes();
+  if (inventories_in_reach_changes != changes) {
+    inventories_in_reach.clear();
+    FlagSearch::single(this, collect_inventories_search_cb, true, false,
+                       &inventories_in_reach);
+    inventories_in_reach_changes = changes;
+  }
+  return inventories_in_reach;
+}
+
 typedef struct ScheduleKnownDestData {
   Flag *src;
   Flag *dest;
@@ -425,7 +637,7 @@ Flag::schedule_known_dest_cb_(Flag *src, Flag *dest, int _slot) {
           src->other_end_dir[this->search_dir] =
             (src->other_end_dir[this->search_dir] & 0xf8) | _slot;
         }
-        src->slot[_slot].dir = this->search_dir;
+        src->set_slot_dir(_slot, this->search_dir);
       }
     }
     return true;
@@ -517,15 +729,15 @@ Flag::prioritize_pickup(Direction dir, Player *player) {
   int res_next = -1;
   int res_prio = -1;
 
-  for (int i = 0; i < FLAG_MAX_RES_COUNT; i++) {
-    if (slot[i].type != Resource::TypeNone) {
-      /* Use flag_prio to prioritize resource pickup. */
-      Direction res_dir = slot[i].dir;
-      Resource::Type res_type = slot[i].type;
-      if (res_dir == dir && player->get_flag_prio(res_type) > res_prio) {
-        res_next = i;
-        res_prio = player->get_flag_prio(res_type);
-      }
+  /* Use flag_prio to prioritize resource pickup, the lowest slot of the
+     highest priority. Only the slots headed this way are looked at. */
+  const int *flag_prio = player->get_flag_prio();
+  for (unsigned int headed = slots_used & slots_dir[dir]; headed != 0;
+       headed &= headed - 1) {
+    unsigned int i = first_slot(headed);
+    if (flag_prio[slot[i].type] > res_prio) {
+      res_next = i;
+      res_prio = flag_prio[slot[i].type];
     }
   }
 
@@ -535,11 +747,12 @@ Flag::prioritize_pickup(Direction dir, Player *player) {
 
 void
 Flag::invalidate_resource_path(Direction dir) {
-  for (int i = 0; i < FLAG_MAX_RES_COUNT; i++) {
-    if (slot[i].type != Resource::TypeNone && slot[i].dir == dir) {
-      slot[i].dir = DirectionNone;
-      endpoint |= BIT(7);
-    }
+  unsigned int headed = slots_used & slots_dir[dir];
+  for (unsigned int left = headed; left != 0; left &= left - 1) {
+    set_slot_dir(first_slot(left), DirectionNone);
+  }
+  if (headed != 0) {
+    endpoint |= BIT(7);
   }
 }
 
@@ -574,6 +787,51 @@ Flag::link_with_flag(Flag *dest_flag, bool water_path, size_t length_,
 
   dest_flag->other_endpoint.f[in_dir] = this;
   other_endpoint.f[out_dir] = dest_flag;
+
+  trace_path(out_dir);
+}
+
+void
+Flag::trace_path(Direction dir, MapPos through) {
+  PMap map = game->get_map();
+  PathTiles &tiles = path_tiles[dir];
+  tiles.clear();
+
+  MapPos at = pos;
+  unsigned int cost = 0;
+  while (true) {
+    cost += actual_cost(map.get(), at, dir);
+    at = map->move(at, dir);
+    tiles.push_back(PathTile{ at, dir, cost });
+    if (map->has_flag(at) && at != through) break;
+
+    int paths = map->paths(at) & ~BIT(reverse_direction(dir));
+    if (paths == 0 || tiles.size() > map->geom().tile_count()) {
+      /* Not a path to another flag, the path to a building. */
+      tiles.clear();
+      return;
+    }
+    for (Direction d : cycle_directions_cw()) {
+      if (BIT_TEST(paths, d)) {
+        dir = d;
+        break;
+      }
+    }
+  }
+
+  /* The same tiles backwards, from the other end. */
+  Flag *other_flag = game->get_flag_at_pos(at);
+  if (other_flag == nullptr) return;
+  Direction back_dir = reverse_direction(tiles.back().dir);
+  PathTiles &back = other_flag->path_tiles[back_dir];
+  back.clear();
+  cost = 0;
+  for (size_t i = tiles.size(); i > 0; i--) {
+    MapPos next = (i > 1) ? tiles[i - 2].pos : pos;
+    Direction d = reverse_direction(tiles[i - 1].dir);
+    cost += actual_cost(map.get(), tiles[i - 1].pos, d);
+    back.push_back(PathTile{ next, d, cost });
+  }
 }
 
 void
@@ -585,7 +843,7 @@ Flag::restore_path_serf_info(Direction dir, SerfPathInfo *data) {
 
   add_path(dir, other_flag->is_water_path(other_dir));
 
-  other_flag->transporter &= ~BIT(other_dir);
+  other_flag->set_transporters(other_flag->transporter & ~BIT(other_dir));
 
   size_t len = Flag::get_road_length_value(data->path_len);
 
@@ -603,6 +861,7 @@ Flag::restore_path_serf_info(Direction dir, SerfPathInfo *data) {
 
   other_endpoint.f[dir] = other_flag;
   other_flag->other_endpoint.f[other_dir] = this;
+  trace_path(dir);
 
   int max_serfs = max_path_serfs[len];
   if (serf_requested(dir)) max_serfs -= 1;
@@ -616,8 +875,8 @@ Flag::restore_path_serf_info(Direction dir, SerfPathInfo *data) {
 
   if (std::min(data->serf_count, max_serfs) > 0) {
     /* There are still transporters on the paths. */
-    transporter |= BIT(dir);
-    other_flag->transporter |= BIT(other_dir);
+    set_transporters(transporter | BIT(dir));
+    other_flag->set_transporters(other_flag->transporter | BIT(other_dir));
 
     length[dir] |= std::min(data->serf_count, max_serfs);
     other_flag->length[other_dir] |= std::min(data->serf_count, max_serfs);
@@ -810,9 +1069,11 @@ Flag::merge_paths(MapPos pos_) {
 
   flag_1->other_endpoint.f[dir_1] = flag_2;
   flag_2->other_endpoint.f[dir_2] = flag_1;
+  flag_1->trace_path(dir_1, pos_);
 
-  flag_1->transporter &= ~BIT(dir_1);
-  flag_2->transporter &= ~BIT(dir_2);
+  flag_1->set_transporters(flag_1->transporter & ~BIT(dir_1));
+  flag_2->set_transporters(flag_2->transporter & ~BIT(dir_2));
+  game->count_flag_graph_change();
 
   size_t len = Flag::get_road_length_value((size_t)path_1_data.path_len +
                                            (size_t)path_2_data.path_len);
@@ -822,8 +1083,8 @@ Flag::merge_paths(MapPos pos_) {
   int max_serfs = max_transporters[flag_1->length_category(dir_1)];
   int serf_count = path_1_data.serf_count + path_2_data.serf_count;
   if (serf_count > 0) {
-    flag_1->transporter |= BIT(dir_1);
-    flag_2->transporter |= BIT(dir_2);
+    flag_1->set_transporters(flag_1->transporter | BIT(dir_1));
+    flag_2->set_transporters(flag_2->transporter | BIT(dir_2));
 
     if (serf_count > max_serfs) {
       /* TODO 59B8B */
@@ -852,15 +1113,10 @@ Flag::update() {
   /* Count and store in bitfield which directions
    have strictly more than 0,1,2,3 slots waiting. */
   unsigned int res_waiting[4] = {0};
-  for (int j = 0; j < FLAG_MAX_RES_COUNT; j++) {
-    if (slot[j].type != Resource::TypeNone && slot[j].dir != DirectionNone) {
-      Direction res_dir = slot[j].dir;
-      for (int k = 0; k < 4; k++) {
-        if (!BIT_TEST(res_waiting[k], res_dir)) {
-          res_waiting[k] |= BIT(res_dir);
-          break;
-        }
-      }
+  for (Direction dir : cycle_directions_cw()) {
+    unsigned int count = slot_count(slots_used & slots_dir[dir]);
+    for (unsigned int k = 0; k < count && k < 4; k++) {
+      res_waiting[k] |= BIT(dir);
     }
   }
 
@@ -870,21 +1126,20 @@ Flag::update() {
 
   if (has_resources()) {
     endpoint &= ~BIT(7);
-    for (int slot_ = 0; slot_ < FLAG_MAX_RES_COUNT; slot_++) {
-      if (slot[slot_].type != Resource::TypeNone) {
-        waiting_count += 1;
-
-        /* Only schedule the slot if it has not already
-         been scheduled for fetch. */
-        int res_dir = slot[slot_].dir;
-        if (res_dir < 0) {
-          if (slot[slot_].dest != 0) {
-            /* Destination is known */
-            schedule_slot_to_known_dest(slot_, res_waiting);
-          } else {
-            /* Destination is not known */
-            schedule_slot_to_unknown_dest(slot_);
-          }
+    waiting_count = slot_count(slots_used);
+    for (unsigned int used = slots_used; used != 0; used &= used - 1) {
+      int slot_ = first_slot(used);
+
+      /* Only schedule the slot if it has not already
+       been scheduled for fetch. */
+      int res_dir = slot[slot_].dir;
+      if (res_dir < 0) {
+        if (slot[slot_].dest != 0) {
+          /* Destination is known */
+          schedule_slot_to_known_dest(slot_, res_waiting);
+        } else {
+          /* Destination is not known */
+          schedule_slot_to_unknown_dest(slot_);
         }
       }
     }
@@ -897,10 +1152,10 @@ Flag::update() {
       if (serf_requested(j)) {
         if (BIT_TEST(res_waiting[2], j)) {
           if (waiting_count >= 7) {
-            transporter &= BIT(j);
+            set_transporters(transporter & BIT(j));
           }
         } else if (free_transporter_count(j) != 0) {
-          transporter |= BIT(j);
+          set_transporters(transporter | BIT(j));
         }
       } else if (free_transporter_count(j) == 0 ||
                  BIT_TEST(res_waiting[2], j)) {
@@ -911,16 +1166,42 @@ Flag::update() {
           if (!r) transporter |= BIT(7);
         }
         if (waiting_count >= 7) {
-          transporter &= BIT(j);
+          set_transporters(transporter & BIT(j));
         }
       } else {
-        transporter |= BIT(j);
+        set_transporters(transporter | BIT(j));
       }
     }
   }
   Log::Verbose["flag"] << "end of Flag::update()";
 }
 
+bool
+Flag::can_sleep() const {
+  if (has_resources() || slots_used != 0) {
+    return false;
+  }
+
+  /* With nothing waiting, update() only sets the transporter bit of paths
+     that have transporters, and calls one for paths that have none and
+     none requested, unless an earlier call failed. */
+  for (Direction j : cycle_directions_ccw()) {
+    if (!has_path(j)) continue;
+    if (free_transporter_count(j) != 0) {
+      if (!has_transporter(j)) return false;
+    } else if (!serf_requested(j) && !serf_request_fail()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+Flag::wake_up() {
+  sleeping = false;
+  game->flag_woken(this);
+}
+
 typedef struct SendSerfToRoadData {
   Inventory *inventory;
   int water;
@@ -992,9 +1273,15 @@ Flag::call_transporter(Direction dir, bool water) {
   }
 
   Serf *serf = data.inventory->call_transporter(water);
+  game->get_watchdog()->transporter_called(get_index(), dir,
+                                           game->get_tick());
+  game->get_watchdog()->transporter_called(src_2->get_index(), dir_2,
+                                           game->get_tick());
 
   Flag *dest_flag = game->get_flag(inventory->get_flag_index());
 
+  wake();
+  src_2->wake();
   length[dir] |= BIT(7);
   src_2->length[dir_2] |= BIT(7);
 
@@ -1011,9 +1298,9 @@ Flag::call_transporter(Direction dir, bool water) {
 
 void
 Flag::reset_transport(Flag *other) {
-  for (int slot_ = 0; slot_ < FLAG_MAX_RES_COUNT; slot_++) {
-    if (other->slot[slot_].type != Resource::TypeNone &&
-        other->slot[slot_].dest == index) {
+  for (unsigned int used = other->slots_used; used != 0; used &= used - 1) {
+    unsigned int slot_ = first_slot(used);
+    if (other->slot[slot_].dest == index) {
       other->slot[slot_].dest = 0;
       other->endpoint |= BIT(7);
 
@@ -1028,12 +1315,10 @@ Flag::reset_transport(Flag *other) {
 
 void
 Flag::reset_destination_of_stolen_resources() {
-  for (int i = 0; i < FLAG_MAX_RES_COUNT; i++) {
-    if (slot[i].type != Resource::TypeNone) {
-      Resource::Type res = slot[i].type;
-      game->cancel_transported_resource(res, slot[i].dest);
-      slot[i].dest = 0;
-    }
+  for (unsigned int used = slots_used; used != 0; used &= used - 1) {
+    unsigned int i = first_slot(used);
+    game->cancel_transported_resource(slot[i].type, slot[i].dest);
+    slot[i].dest = 0;
   }
 }
 
@@ -1041,6 +1326,7 @@ void
 Flag::link_building(Building *building) {
   other_endpoint.b[DirectionUpLeft] = building;
   endpoint |= BIT(6);
+  game->count_flag_graph_change();
 }
 
 void
@@ -1048,6 +1334,66 @@ Flag::unlink_building() {
   other_endpoint.b[DirectionUpLeft] = nullptr;
   endpoint &= ~BIT(6);
   clear_flags();
+  game->count_flag_graph_change();
+}
+
+void
+Flag::fork_endpoints() {
+  for (Direction d : cycle_directions_cw()) {
+    if (d == DirectionUpLeft && has_building()) {
+      Building *building = other_endpoint.b[d];
+      other_endpoint.b[d] = game->get_building(building->get_index());
+    } else if (has_path(d)) {
+      Flag *other_flag = other_endpoint.f[d];
+      other_endpoint.f[d] = game->get_flag(other_flag->get_index());
+    } else {
+      other_endpoint.f[d] = nullptr;
+    }
+  }
+}
+
+void
+Flag::set_has_inventory() {
+  if (!has_inventory()) game->count_flag_graph_change();
+  bld_flags |= BIT(6);
+}
+
+void
+Flag::set_accepts_resources(bool accepts) {
+  if (accepts != accepts_resources()) game->count_flag_graph_change();
+  accepts ? bld2_flags |= BIT(7) : bld2_flags &= ~BIT(7);
+}
+
+void
+Flag::set_accepts_serfs(bool accepts) {
+  if (accepts != accepts_serfs()) game->count_flag_graph_change();
+  accepts ? bld_flags |= BIT(7) : bld_flags &= ~BIT(7);
+}
+
+void
+Flag::clear_flags() {
+  if (has_inventory() || accepts_resources() || accepts_serfs()) {
+    game->count_flag_graph_change();
+  }
+  bld_flags = 0;
+  bld2_flags = 0;
+}
+
+void
+Flag::set_transporters(int bits) {
+  wake();
+  int changed = (bits ^ transporter) & 0x3f;
+  transporter = bits;
+  if (changed == 0) return;
+  game->count_flag_graph_change();
+  for (Direction d : cycle_directions_cw()) {
+    if (!BIT_TEST(changed, d)) continue;
+    if (has_transporter(d) || !has_path(d)) {
+      game->get_watchdog()->path_served(get_index(), d);
+    } else {
+      game->get_watchdog()->path_unserved(get_index(), d, game->get_tick());
+    }
+  }
 }
 
 SaveReaderBinary&
@@ -1080,11 +1426,13 @@ operator >> (SaveReaderBinary &reader, Flag &flag) {
     reader >> val8;  // 12+j
     flag.slot[j].type = (Resource::Type)((val8 & 0x1f)-1);
     flag.slot[j].dir = (Direction)(((val8 >> 5) & 7)-1);
+    flag.slot[j].since = flag.game->get_tick();
   }
   for (int j = 0; j < 8; j++) {
     reader >> val16;  // 20+j*2
     flag.slot[j].dest = val16;
   }
+  flag.count_slots();
 
   // base + 36
   for (Direction j : cycle_directions_cw()) {
@@ -1132,6 +1480,8 @@ operator >> (SaveReaderBinary &reader, Flag &flag) {
     flag.other_endpoint.b[DirectionUpLeft]->set_priority_in_stock(1, val8);
   }
 
+  flag.get_game()->count_flag_graph_change();
+
   return reader;
 }
 
@@ -1179,11 +1529,15 @@ operator >> (SaveReaderText &reader, Flag &flag) {
     reader.value("slot.type")[i] >> flag.slot[i].type;
     reader.value("slot.dir")[i] >> flag.slot[i].dir;
     reader.value("slot.dest")[i] >> flag.slot[i].dest;
+    flag.slot[i].since = flag.game->get_tick();
   }
+  flag.count_slots();
 
   reader.value("bld_flags") >> flag.bld_flags;
   reader.value("bld2_flags") >> flag.bld2_flags;
 
+  flag.get_game()->count_flag_graph_change();
+
   return reader;
 }
 
@@ -23,6 +23,8 @@
 #define SRC_FLAG_H_
 
 #include <vector>
+#include <memory>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for FlagSearch scratch pool
 
 #include "src/building.h"
 #include "src/objects.h"
@@ -45,20 +47,44 @@ class SaveReaderText;
 class SaveWriterText;
 
 class Flag : public GameObject {
+ public:
+  // A tile of the path from a flag to the flag at its other end, the
+  // direction walked to get there, and the walking cost from the flag up
+  // to and including it.
+  typedef struct PathTile {
+    MapPos pos;
+    Direction dir;
+    unsigned int cost;
+  } PathTile;
+  typedef std::vector<PathTile> PathTiles;
+
  protected:
   class ResourceSlot {
    public:
     Resource::Type type;
     Direction dir;
     unsigned int dest;
+    unsigned int since;  // Tick the resource was dropped here
   };
 
+  // Traffic leaving the flag on one path, see get_traffic_carried().
+  typedef struct Traffic {
+    unsigned int carried;  // Resources picked up for it, in traffic_units
+    unsigned int waited;   // Ticks they waited here for a transporter
+  } Traffic;
+
  protected:
   unsigned int owner;
   MapPos pos; /* ADDITION */
   int path_con;
   int endpoint;
   ResourceSlot slot[FLAG_MAX_RES_COUNT];
+  // Bit i set for each slot i that holds a resource, and for each slot i
+  // whose resource is headed along the path in a direction, kept with the
+  // slots by set_slot_type() and set_slot_dir() so the slots need not be
+  // looked through one by one.
+  unsigned int slots_used;
+  unsigned int slots_dir[6];
 
   int search_num;
   Direction search_dir;
@@ -70,11 +96,39 @@ class Flag : public GameObject {
     void *v[6];
   } other_endpoint;
   int other_end_dir[6];
+  // Tiles of the path in each direction, ending at the other flag. Traced
+  // when the path is linked and dropped when it is removed, so the paths
+  // need not be followed over the map tile by tile.
+  PathTiles path_tiles[6];
+
+  // Counts of the traffic through the flag, halved every traffic_half_life
+  // ticks since traffic_tick. Kept as resources are dropped and picked up,
+  // so a sleeping flag costs nothing, and only halved when next counted.
+  Traffic traffic[6];
+  unsigned int queued;    // Resources at the flag as each one arrived
+  unsigned int arrived;   // Resources dropped here, in traffic_units
+  unsigned int traffic_tick;
 
   int bld_flags;
   int bld2_flags;
+  bool sleeping;  // Left out of Game::update_flags(), see can_sleep()
+
+  // Results of find_nearest_inventory_for_resource() and _for_serf(), and
+  // the Game::get_flag_graph_changes() they were found at. They only depend
+  // on the roads, their transporters and which inventories take what.
+  unsigned int nearest_inventory_changes[2];
+  int nearest_inventory[2];
+  // Flag indexes of the inventories a land path search from this flag
+  // reaches, in the order it reaches them, see get_inventories_in_reach().
+  std::vector<unsigned int> inventories_in_reach;
+  unsigned int inventories_in_reach_changes;
 
  public:
+  static const unsigned int traffic_half_life = 1 << 15;  // ticks
+  static const unsigned int traffic_unit = 16;
+  // Resources waiting this many ticks on average make a path congested.
+  static const unsigned int traffic_congested_wait = 1500;
+
   Flag(Game *game, unsigned int index);
 
   MapPos get_position() const { return pos; }
@@ -120,19 +174,20 @@ class Flag : public GameObject {
     return ((transporter & (1 << (dir))) != 0); }
   /* Whether this flag has tried to request a transporter without success. */
   bool serf_request_fail() const { return (transporter >> 7) & 1; }
-  void serf_request_clear() { transporter &= ~BIT(7); }
+  void serf_request_clear() { wake(); transporter &= ~BIT(7); }
 
   /* Current number of transporters on path. */
   unsigned int free_transporter_count(Direction dir) const {
     return length[dir] & 0xf; }
-  void transporter_to_serve(Direction dir) { length[dir] -= 1; }
+  void transporter_to_serve(Direction dir) { wake(); length[dir] -= 1; }
   /* Length category of path determining max number of transporters. */
   unsigned int length_category(Direction dir) const {
     return (length[dir] >> 4) & 7; }
   /* Whether a transporter serf was successfully requested for this path. */
   bool serf_requested(Direction dir) const { return (length[dir] >> 7) & 1; }
-  void cancel_serf_request(Direction dir) { length[dir] &= ~BIT(7); }
+  void cancel_serf_request(Direction dir) { wake(); length[dir] &= ~BIT(7); }
   void complete_serf_request(Direction dir) {
+    wake();
     length[dir] &= ~BIT(7);
     length[dir] += 1;
   }
@@ -145,6 +200,13 @@ class Flag : public GameObject {
     return (Direction)((other_end_dir[dir] >> 3) & 7); }
   Flag *get_other_end_flag(Direction dir) const {
     return other_endpoint.f[dir]; }
+  /* The tiles of the path in the given direction, or none if there is no
+   path to another flag there. */
+  const PathTiles &get_path_tiles(Direction dir) const {
+    return path_tiles[dir]; }
+  /* Trace the path in the given direction over the map and keep its tiles
+   at both ends of it, walking on over the flag at through if there is one. */
+  void trace_path(Direction dir, MapPos through = bad_map_pos);
   /* Whether the given direction has a resource pickup scheduled. */
   bool is_scheduled(Direction dir) const {
     return (other_end_dir[dir] >> 7) & 1; }
@@ -153,6 +215,16 @@ class Flag : public GameObject {
   bool drop_resource(Resource::Type res, unsigned int dest);
   bool has_empty_slot() const;
   void remove_all_resources();
+
+  /* Recent traffic, weighted to halve every traffic_half_life ticks: the
+   resources carried away on the path in the given direction, how many
+   ticks each waited here on average for a transporter of the path, and
+   how many resources were at the flag on average as one arrived. */
+  unsigned int get_traffic_carried(Direction dir) const;
+  unsigned int get_traffic_wait(Direction dir) const;
+  unsigned int get_traffic_queue() const;
+  bool is_congested(Direction dir) const {
+    return get_traffic_wait(dir) >= traffic_congested_wait; }
   Resource::Type get_resource_at_slot(int slot) const;
 
   /* Whether this flag has an inventory building. */
@@ -162,12 +234,10 @@ class Flag : public GameObject {
   /* Whether this inventory accepts serfs. */
   bool accepts_serfs() const { return ((bld_flags >> 7) & 1); }
 
-  void set_has_inventory() { bld_flags |= BIT(6); }
-  void set_accepts_resources(bool accepts) { accepts ? bld2_flags |= BIT(7) :
-                                                       bld2_flags &= ~BIT(7); }
-  void set_accepts_serfs(bool accepts) { accepts ? bld_flags |= BIT(7) :
-                                                   bld_flags &= ~BIT(7); }
-  void clear_flags() { bld_flags = 0; bld2_flags = 0; }
+  void set_has_inventory();
+  void set_accepts_resources(bool accepts);
+  void set_accepts_serfs(bool accepts);
+  void clear_flags();
 
   friend SaveReaderBinary&
     operator >> (SaveReaderBinary &reader, Flag &flag);
@@ -184,18 +254,34 @@ class Flag : public GameObject {
 
   void link_building(Building *building);
   void unlink_building();
+  // Point the paths and the building at the objects of the same index in
+  // this flag's game, after Game::fork() copied the flag from another.
+  void fork_endpoints();
   Building *get_building() { return other_endpoint.b[DirectionUpLeft]; }
 
   void invalidate_resource_path(Direction dir);
 
   int find_nearest_inventory_for_resource();
   int find_nearest_inventory_for_serf();
+  /* Inventories reachable from this flag by land paths, nearest first, in
+   the order a FlagSearch from here would visit them. Kept until the roads
+   change, so a request that no inventory can serve does not search the
+   whole road network each time. */
+  const std::vector<unsigned int> &get_inventories_in_reach();
 
   void link_with_flag(Flag *dest_flag, bool water_path, size_t length,
                       Direction in_dir, Direction out_dir);
 
   void update();
 
+  /* Whether update() does nothing until a resource is dropped, a path is
+   added or removed, or its transporters or serf requests change. Each of
+   those wakes the flag first. */
+  bool can_sleep() const;
+  bool is_sleeping() const { return sleeping; }
+  void start_sleeping() { sleeping = true; }
+  void wake() { if (sleeping) wake_up(); }
+
   /* Get road length category value for real length.
    Determines number of serfs servicing the path segment.(?) */
   static size_t get_road_length_value(size_t length);
@@ -217,7 +303,34 @@ class Flag : public GameObject {
   bool call_transporter(Direction dir, bool water);
 
  protected:
+  void wake_up();
   void fix_scheduled();
+  // Halve the traffic counts for each half life passed since traffic_tick.
+  void decay_traffic();
+  unsigned int get_traffic_halvings() const;
+
+  // Change the transporter bits, telling the game if the roads searches
+  // can follow changed.
+  void set_transporters(int bits);
+
+  void set_slot_type(unsigned int i, Resource::Type type) {
+    slot[i].type = type;
+    if (type != Resource::TypeNone) {
+      slots_used |= BIT(i);
+    } else {
+      slots_used &= ~BIT(i);
+    }
+  }
+  void set_slot_dir(unsigned int i, Direction dir) {
+    // a loaded game may have left anything here
+    if (static_cast<unsigned int>(slot[i].dir) < 6) {
+      slots_dir[slot[i].dir] &= ~BIT(i);
+    }
+    slot[i].dir = dir;
+    if (dir != DirectionNone) slots_dir[dir] |= BIT(i);
+  }
+  // Set the masks again from the slots, after loading them.
+  void count_slots();
 
   void schedule_slot_to_unknown_dest(int slot);
   void schedule_slot_to_known_dest(int slot, unsigned int res_waiting[4]);
@@ -230,21 +343,90 @@ class Flag : public GameObject {
 typedef bool flag_search_func(Flag *flag, void *data);
 
 class FlagSearch {
+ public:
+  /* FIFO of flags backed by a power of two sized ring buffer. The
+   buffer only grows when a search has more flags in flight than ever
+   before and is otherwise reused, so searches do no heap allocation. */
+  class Queue {
+   protected:
+    std::vector<Flag*> ring;
+    size_t head;
+    size_t count;
+
+   public:
+    Queue() : ring(256), head(0), count(0) {}
+
+    bool empty() const { return (count == 0); }
+    size_t size() const { return count; }
+    size_t capacity() const { return ring.size(); }
+    void clear() { head = 0; count = 0; }
+
+    void push(Flag *flag) {
+      if (count == ring.size()) grow();
+      ring[(head + count) & (ring.size() - 1)] = flag;
+      count++;
+    }
+
+    Flag *pop() {
+      Flag *flag = ring[head];
+      head = (head + 1) & (ring.size() - 1);
+      count--;
+      return flag;
+    }
+
+   protected:
+    void grow();
+  };
+
+  /* Scratch queues owned by a game and shared by all searches in it.
+   Searches may run from the game and the AI threads, and nested
+   searches need queues of their own, hence the pool. */
+  class Pool {
+   protected:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<Queue*> free_queues;
+
+   public:
+    Queue *acquire();
+    void release(Queue *queue);
+  };
+
+  /* One of several searches answered by the same traversal. */
+  typedef struct Request {
+    flag_search_func *callback;
+    void *data;
+    bool done;
+  } Request;
+
  protected:
   Game *game;
-  std::vector<Flag*> queue;
+  Queue *queue;
   int id;
 
  public:
   explicit FlagSearch(Game *game);
+  FlagSearch(const FlagSearch&) = delete;
+  FlagSearch& operator = (const FlagSearch&) = delete;
+  virtual ~FlagSearch();
 
   int get_id() { return id; }
   void add_source(Flag *flag);
   bool execute(flag_search_func *callback,
                bool land, bool transporter, void *data);
+  /* Visit flags once for all requests. Each flag is handed to every
+   request that is not done yet, in request order, exactly as separate
+   searches from the same sources would see them as long as the
+   callbacks do not change the flag graph. Returns true when every
+   request was satisfied. */
+  bool execute_batch(Request *requests, size_t count,
+                     bool land, bool transporter);
 
   static bool single(Flag *src, flag_search_func *callback,
                      bool land, bool transporter, void *data);
+
+ protected:
+  void expand(Flag *flag, bool land, bool transporter);
 };
 
 #endif  // SRC_FLAG_H_
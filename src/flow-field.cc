@@ -0,0 +1,114 @@
+/*
+ * flow-field.cc - Steps to a target for free walking serfs
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/flow-field.h"
+
+#include <cstdlib>
+
+#include "src/memory-usage.h"
+
+const int FlowField::radius;
+const int FlowField::side;
+const uint8_t FlowField::unreachable;
+const size_t FlowFields::max_fields;
+
+FlowField::FlowField(const Map *map, MapPos target_)
+  : target(target_)
+  , changes(map->get_changes_in(target_, radius))
+  , distance(side * side, unreachable) {
+  // The target itself may be taken, by a tree to cut or a stone to hew,
+  //  it is only the way there that has to be clear.
+  std::vector<MapPos> queue;
+  queue.reserve(side * side);
+  distance[index_of(map, target)] = 0;
+  queue.push_back(target);
+  for (size_t next = 0; next < queue.size(); next++) {
+    MapPos pos = queue[next];
+    unsigned int steps = distance[index_of(map, pos)];
+    if (steps + 1 >= unreachable) {
+      continue;
+    }
+    for (Direction d : cycle_directions_cw()) {
+      MapPos other = map->move(pos, d);
+      int index = index_of(map, other);
+      if (index < 0 || distance[index] != unreachable ||
+          !can_pass(map, other)) {
+        continue;
+      }
+      distance[index] = steps + 1;
+      queue.push_back(other);
+    }
+  }
+}
+
+// Position of pos in distance, -1 when it is more than radius away from
+//  the target
+int
+FlowField::index_of(const Map *map, MapPos pos) const {
+  int col = map->dist_x(target, pos);
+  int row = map->dist_y(target, pos);
+  if (std::abs(col) > radius || std::abs(row) > radius) {
+    return -1;
+  }
+  return (row + radius) * side + (col + radius);
+}
+
+unsigned int
+FlowField::get_distance(const Map *map, MapPos pos) const {
+  int index = index_of(map, pos);
+  return (index < 0) ? unreachable : distance[index];
+}
+
+std::shared_ptr<const FlowField>
+FlowFields::get(const Map *map, MapPos target) {
+  uses++;
+  std::map<MapPos, Entry>::iterator it = fields.find(target);
+  if (it != fields.end()) {
+    if (it->second.field->get_changes() ==
+        map->get_changes_in(target, FlowField::radius)) {
+      it->second.used = uses;
+      return it->second.field;
+    }
+    fields.erase(it);
+  }
+
+  if (fields.size() >= max_fields) {
+    std::map<MapPos, Entry>::iterator oldest = fields.begin();
+    for (it = fields.begin(); it != fields.end(); ++it) {
+      if (it->second.used < oldest->second.used) {
+        oldest = it;
+      }
+    }
+    fields.erase(oldest);
+  }
+
+  std::shared_ptr<const FlowField> field =
+    std::make_shared<FlowField>(map, target);
+  fields[target] = Entry{ field, uses };
+  return field;
+}
+
+size_t
+FlowFields::get_allocated_bytes() const {
+  return MemoryUsage::tree_bytes(fields) +
+         fields.size() * (sizeof(FlowField) +
+                          FlowField::side * FlowField::side);
+}
@@ -0,0 +1,92 @@
+/*
+ * flow-field.h - Steps to a target for free walking serfs
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_FLOW_FIELD_H_
+#define SRC_FLOW_FIELD_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "src/map.h"
+
+// The number of steps from every tile within radius of a target to the
+// target, over the land a free walking serf can cross, found by one
+// breadth first search. Serfs heading to the same target share it and take
+// a step that brings them closer each time, instead of walking into
+// obstacles and following their edges. Serfs are not obstacles in it, they
+// are stepped around on the way. A field is good as long as
+// Map::get_changes_in() for its area is what it was when it was found.
+class FlowField {
+ public:
+  static const int radius = 24;
+  static const int side = 2 * radius + 1;
+  static const uint8_t unreachable = 0xFF;
+
+  FlowField(const Map *map, MapPos target);
+
+  MapPos get_target() const { return target; }
+  uint32_t get_changes() const { return changes; }
+  // Steps from pos to the target, unreachable when pos is too far away or
+  //  can't get there
+  unsigned int get_distance(const Map *map, MapPos pos) const;
+
+  // Whether a free walking serf on land can be at pos
+  static bool can_pass(const Map *map, MapPos pos) {
+    return !map->is_in_water(pos) &&
+           Map::map_space_from_obj[map->get_obj(pos)] <= Map::SpaceSemipassable;
+  }
+
+ protected:
+  MapPos target;
+  uint32_t changes;
+  std::vector<uint8_t> distance;   // side * side, row by row
+
+  int index_of(const Map *map, MapPos pos) const;
+};
+
+// The flow fields of the game, by target, found again when the map around
+// their target has changed since. The least recently used one is dropped
+// when there are more than max_fields. The game thread owns it.
+class FlowFields {
+ public:
+  static const size_t max_fields = 64;
+
+  FlowFields() : uses(0) {}
+
+  std::shared_ptr<const FlowField> get(const Map *map, MapPos target);
+  // For a new map
+  void clear() { fields.clear(); }
+
+  size_t size() const { return fields.size(); }
+  size_t get_allocated_bytes() const;
+
+ protected:
+  typedef struct Entry {
+    std::shared_ptr<const FlowField> field;
+    uint64_t used;
+  } Entry;
+  std::map<MapPos, Entry> fields;
+  uint64_t uses;
+};
+
+#endif  // SRC_FLOW_FIELD_H_
@@ -31,8 +31,12 @@
 #include "src/audio.h"
 #include "src/gfx.h"
 #include "src/interface.h"
+#include "src/viewport.h"
 #include "src/game-manager.h"
 #include "src/command_line.h"
+#include "src/configfile.h"
+#include "src/thread-policy.h"
+#include "src/trace.h"
 
 #ifdef WIN32
 # include <SDL.h>
@@ -53,6 +57,7 @@ main(int argc, char *argv[]) {
   unsigned int screen_width = 0;
   unsigned int screen_height = 0;
   bool fullscreen = false;
+  unsigned int fast_forward_ticks = 0;
 
   CommandLine command_line;
   command_line.add_option('d', "Set Debug output level")
@@ -75,11 +80,37 @@ main(int argc, char *argv[]) {
                   command_line.show_help();
                   exit(EXIT_SUCCESS);
                 });
+  command_line.add_option('i', "Read the thread settings in the [threads]"
+                               " section of the config FILE")
+                .add_parameter("FILE", [](std::istream& s) {
+                  std::string config_file;
+                  std::getline(s, config_file);
+                  ConfigFile config;
+                  return config.load(config_file) &&
+                         ThreadPolicy::load(config);
+                });
+  command_line.add_option('j', "Set the priority and cores of the threads of"
+                               " a role, e.g. ai=low@2-3. Roles: simulation,"
+                               " render, ai, io; priorities: lowest, low,"
+                               " normal, high")
+                .add_parameter("ROLE=PRIORITY[@CORES]", [](std::istream& s) {
+                  std::string spec;
+                  s >> spec;
+                  return ThreadPolicy::parse(spec);
+                });
   command_line.add_option('l', "Load saved game")
                 .add_parameter("FILE", [&save_file](std::istream& s) {
                   std::getline(s, save_file);
                   return true;
                 });
+  command_line.add_option('m', "Draw the landscape as textured triangles,"
+                               " where the video can",
+                          [](){ Viewport::set_landscape_triangles(true); });
+  command_line.add_option('n', "Fast forward a loaded game by TICKS updates")
+                .add_parameter("TICKS", [&fast_forward_ticks](std::istream& s) {
+                  s >> fast_forward_ticks;
+                  return (fast_forward_ticks > 0);
+                });
   command_line.add_option('r', "Set display resolution (e.g. 800x600)")
                 .add_parameter("RES",
                               [&screen_width, &screen_height](std::istream& s) {
@@ -88,12 +119,24 @@ main(int argc, char *argv[]) {
                   s >> screen_height;
                   return true;
                 });
+  command_line.add_option('t', "Record a trace of the threads, written to FILE"
+                               " on exit or with the t key")
+                .add_parameter("FILE", [](std::istream& s) {
+                  std::string trace_file;
+                  std::getline(s, trace_file);
+                  Trace::set_thread_name("main");
+                  Trace::start(trace_file);
+                  return true;
+                });
   command_line.set_comment("Please report bugs to <" PACKAGE_BUGREPORT ">");
   if (!command_line.process(argc, argv)) {
     return EXIT_FAILURE;
   }
 
   Log::Info["main"] << "freeserf " << FREESERF_VERSION;
+  // The game ticks on this thread too, between frames
+  ThreadPolicy::apply(ThreadPolicy::RoleRender);
+  ThreadPolicy::report();
 
   Data &data = Data::get_instance();
   if (!data.load(data_dir)) {
@@ -104,6 +147,27 @@ main(int argc, char *argv[]) {
     #endif
     return EXIT_FAILURE;
   }
+  data.get_data_source()->prewarm_sprites();
+  data.get_data_source()->prewarm_audio(
+    { Audio::TypeSfxMessage, Audio::TypeSfxAccepted, Audio::TypeSfxNotAccepted,
+      Audio::TypeSfxUndo, Audio::TypeSfxClick, Audio::TypeSfxFight01,
+      Audio::TypeSfxFight02, Audio::TypeSfxFight03, Audio::TypeSfxFight04,
+      Audio::TypeSfxSerfDying, Audio::TypeSfxAhhh, Audio::TypeSfxBurning,
+      Audio::TypeSfxResourceFound, Audio::TypeSfxPickBlow,
+      Audio::TypeSfxMetalHammering, Audio::TypeSfxAxBlow,
+      Audio::TypeSfxTreeFall, Audio::TypeSfxWoodHammering,
+      Audio::TypeSfxElevator, Audio::TypeSfxHammerBlow, Audio::TypeSfxSawing,
+      Audio::TypeSfxMillGrinding, Audio::TypeSfxBackswordBlow,
+      Audio::TypeSfxGeologistSampling, Audio::TypeSfxPlanting,
+      Audio::TypeSfxDigging, Audio::TypeSfxMowing,
+      Audio::TypeSfxFishingRodReel, Audio::TypeSfxUnknown21,
+      Audio::TypeSfxPigOink, Audio::TypeSfxGoldBoils, Audio::TypeSfxRowing,
+      Audio::TypeSfxUnknown25, Audio::TypeSfxBirdChirp0,
+      Audio::TypeSfxBirdChirp1, Audio::TypeSfxBirdChirp2,
+      Audio::TypeSfxBirdChirp3, Audio::TypeSfxUnknown28,
+      Audio::TypeSfxUnknown29 },
+    { Audio::TypeMidiTrack0, Audio::TypeMidiTrack1, Audio::TypeMidiTrack2,
+      Audio::TypeMidiTrack3 });
 
   Log::Info["main"] << "Initialize graphics...";
 
@@ -155,12 +219,27 @@ main(int argc, char *argv[]) {
   if (loaded_game_start_ai) {
     interface.initialize_AI();
   }
+  if (fast_forward_ticks > 0) {
+    if (loaded_game_start_ai) {
+      interface.fast_forward(fast_forward_ticks);
+    } else {
+      Log::Warn["main"] << "-n only fast forwards a game loaded with -l";
+    }
+  }
 
   /* Start game loop */
   event_loop.run();
 
   event_loop.del_handler(&interface);
 
+  if (Trace::is_active()) {
+    Trace::stop();
+    if (!Trace::write()) {
+      Log::Error["main"] << "Could not write trace to '" << Trace::get_path()
+                         << "'";
+    }
+  }
+
   Log::Info["main"] << "Cleaning up...";
 
   return EXIT_SUCCESS;
@@ -0,0 +1,180 @@
+/*
+ * game-autosave.cc - Saving the game on a thread of its own
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/game-autosave.h"
+
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+#include "src/game.h"
+#include "src/log.h"
+#include "src/profiler.h"
+#include "src/thread-policy.h"
+#include "src/trace.h"
+
+static const Profiler::Section profile_snapshot("game.autosave");
+static const Profiler::Section profile_write("autosave.write");
+
+GameAutosave::GameAutosave()
+  : requested(false)
+  , format(GameStore::FormatText)
+  , pending_format(GameStore::FormatText)
+  , writing(false)
+  , stopping(false)
+  , saves(0)
+  , last(Timing{ std::string(), 0., 0., false, false })
+  , full_every(0)
+  , deltas(0) {
+}
+
+GameAutosave::~GameAutosave() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void
+GameAutosave::request(const std::string &_prefix, GameStore::Format _format) {
+  std::unique_lock<std::mutex> lock(mutex);
+  prefix = _prefix;
+  format = _format;
+  requested = true;
+}
+
+void
+GameAutosave::set_full_every(unsigned int _saves) {
+  std::unique_lock<std::mutex> lock(mutex);
+  full_every = _saves;
+}
+
+void
+GameAutosave::take(Game *game) {
+  Profiler::Clock::time_point start = Profiler::Clock::now();
+  game->get_mutex()->lock(LOCK_SITE());
+  // saving wakes the sleeping serfs, so nobody else may look meanwhile
+  PSaveWriter writer = GameStore::get_instance().take_snapshot(game);
+  unsigned int tick = game->get_tick();
+  game->get_mutex()->unlock();
+  Profiler::Clock::time_point end = Profiler::Clock::now();
+  Profiler::record(profile_snapshot, start, end);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  requested = false;
+  if (pending) {
+    Log::Warn["autosave"] << "dropping the save for " << pending_timing.path
+                          << ", the one before it is still being written";
+  }
+  pending = writer;
+  pending_timing.path = prefix + std::to_string(tick) + ".save";
+  pending_timing.snapshot_ms =
+    std::chrono::duration<double, std::milli>(end - start).count();
+  pending_timing.write_ms = 0.;
+  pending_timing.saved = false;
+  pending_timing.delta = false;
+  pending_format = format;
+  if (!thread.joinable()) {
+    thread = std::thread(&GameAutosave::run, this);
+  }
+  changed.notify_all();
+}
+
+void
+GameAutosave::run() {
+  Trace::set_thread_name("autosave");
+  ThreadPolicy::apply(ThreadPolicy::RoleIO);
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    changed.wait(lock, [this]() { return pending || stopping; });
+    if (!pending) {
+      return;
+    }
+    PSaveWriter writer = std::move(pending);
+    pending.reset();
+    Timing timing = pending_timing;
+    GameStore::Format save_format = pending_format;
+    unsigned int save_full_every = full_every;
+    writing = true;
+    lock.unlock();
+
+    Profiler::Clock::time_point start = Profiler::Clock::now();
+    if (save_full_every == 0) {
+      timing.saved = GameStore::get_instance().save(timing.path, writer,
+                                                    save_format);
+      base_path.clear();
+    } else {
+      timing.delta = !base_path.empty() && deltas + 1 < save_full_every;
+      GameStore::Digests save_digests;
+      timing.saved = GameStore::get_instance().save_delta(
+                                timing.path, writer,
+                                timing.delta ? base_path : std::string(),
+                                digests, &save_digests);
+      if (timing.saved) {
+        deltas = timing.delta ? deltas + 1 : 0;
+        base_path = timing.path;
+        digests = std::move(save_digests);
+      } else {
+        // the next one starts over from a full save
+        base_path.clear();
+      }
+    }
+    writer.reset();
+    Profiler::Clock::time_point end = Profiler::Clock::now();
+    Profiler::record(profile_write, start, end);
+    timing.write_ms =
+      std::chrono::duration<double, std::milli>(end - start).count();
+    if (timing.saved) {
+      Log::Info["autosave"] << "saved " << timing.path
+                            << (timing.delta ? " as a delta, " : ", ")
+                            << timing.snapshot_ms << " ms in the game, "
+                            << timing.write_ms << " ms writing";
+    } else {
+      Log::Error["autosave"] << "failed to save " << timing.path;
+    }
+
+    lock.lock();
+    writing = false;
+    saves++;
+    last = timing;
+    changed.notify_all();
+  }
+}
+
+void
+GameAutosave::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this]() { return !pending && !writing; });
+}
+
+unsigned int
+GameAutosave::get_save_count() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return saves;
+}
+
+GameAutosave::Timing
+GameAutosave::get_last_timing() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return last;
+}
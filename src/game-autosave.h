@@ -0,0 +1,97 @@
+/*
+ * game-autosave.h - Saving the game on a thread of its own
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_GAME_AUTOSAVE_H_
+#define SRC_GAME_AUTOSAVE_H_
+
+#include <atomic>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <condition_variable>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <string>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+#include "src/savegame.h"
+
+class Game;
+
+// Saves the game without holding it up while the file is written. Any
+// thread asks for a save; the game thread takes the values of the game at
+// the end of its next update, with the game locked, and a thread of its own
+// turns them into the file and writes it while the game goes on. A save
+// asked for while another is written waits for it, only the newest waits.
+// With deltas on, saves are compact, and all but every full_every-th only
+// hold what changed since the save before.
+class GameAutosave {
+ public:
+  typedef struct Timing {
+    std::string path;
+    double snapshot_ms;   // on the game thread, with the game locked
+    double write_ms;      // on the autosave thread
+    bool saved;
+    bool delta;
+  } Timing;
+
+ protected:
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread thread;
+  std::atomic<bool> requested;
+  std::string prefix;
+  GameStore::Format format;
+  PSaveWriter pending;
+  Timing pending_timing;
+  GameStore::Format pending_format;
+  bool writing;
+  bool stopping;
+  unsigned int saves;
+  Timing last;
+  unsigned int full_every;
+  // only used by the autosave thread
+  unsigned int deltas;        // since the last full save
+  std::string base_path;      // of the last save
+  GameStore::Digests digests;
+
+  void run();
+
+ public:
+  GameAutosave();
+  // writes the save that is waiting, if any, first
+  virtual ~GameAutosave();
+
+  // Save at the end of the next update, to prefix + tick + ".save".
+  void request(const std::string &prefix,
+               GameStore::Format format = GameStore::FormatText);
+  bool is_requested() const { return requested; }
+
+  // Delta saves in between full ones, or only full saves with 0.
+  void set_full_every(unsigned int saves);
+
+  // On the game thread, between updates.
+  void take(Game *game);
+
+  // Until every save taken so far is written.
+  void wait();
+
+  unsigned int get_save_count();
+  Timing get_last_timing();
+};
+
+#endif  // SRC_GAME_AUTOSAVE_H_
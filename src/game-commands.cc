@@ -0,0 +1,162 @@
+/*
+ * game-commands.cc - Queue of game changes applied between updates
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/game-commands.h"
+
+#include <utility>
+
+std::future<bool>
+GameCommands::build_road(const Road &road, unsigned int player) {
+  Command command = { TypeBuildRoad, player, road.get_source(),
+                      Building::TypeNone, road };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::build_flag(MapPos pos, unsigned int player) {
+  Command command = { TypeBuildFlag, player, pos, Building::TypeNone, Road() };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::build_building(MapPos pos, Building::Type type,
+                             unsigned int player) {
+  Command command = { TypeBuildBuilding, player, pos, type, Road() };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::demolish_road(MapPos pos, unsigned int player) {
+  Command command = { TypeDemolishRoad, player, pos, Building::TypeNone,
+                      Road() };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::demolish_flag(MapPos pos, unsigned int player) {
+  Command command = { TypeDemolishFlag, player, pos, Building::TypeNone,
+                      Road() };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::demolish_building(MapPos pos, unsigned int player) {
+  Command command = { TypeDemolishBuilding, player, pos, Building::TypeNone,
+                      Road() };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::boot_serf(unsigned int serf, unsigned int player) {
+  Command command = { TypeBootSerf, player, 0, Building::TypeNone, Road(),
+                      serf, DirectionNone };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::call_transporter(unsigned int flag, Direction dir,
+                               unsigned int player) {
+  Command command = { TypeCallTransporter, player, 0, Building::TypeNone,
+                      Road(), flag, dir };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::build_castle(MapPos pos, unsigned int player) {
+  Command command = { TypeBuildCastle, player, pos, Building::TypeNone,
+                      Road() };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::send_geologist(MapPos pos, unsigned int player) {
+  Command command = { TypeSendGeologist, player, pos };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::attack(MapPos pos, unsigned int knights, unsigned int player) {
+  Command command = { TypeAttack, player, pos, Building::TypeNone, Road(),
+                      knights };
+  return push(command);
+}
+
+std::future<bool>
+GameCommands::push(const Command &command) {
+  Pending entry;
+  entry.command = command;
+  std::future<bool> result = entry.result.get_future();
+  std::lock_guard<std::mutex> lock(mutex);
+  pending.push_back(std::move(entry));
+  return result;
+}
+
+size_t
+GameCommands::size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pending.size();
+}
+
+void
+GameCommands::set_recorder(Recorder _recorder) {
+  std::lock_guard<std::mutex> lock(mutex);
+  recorder = _recorder;
+}
+
+bool
+GameCommands::is_recording() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return static_cast<bool>(recorder);
+}
+
+void
+GameCommands::record(unsigned int tick, const Command &command,
+                     bool result) {
+  Recorder record;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    record = recorder;
+  }
+  if (record) {
+    record(tick, command, result);
+  }
+}
+
+void
+GameCommands::apply(unsigned int tick,
+                    std::function<bool(const Command&)> fn) {
+  std::vector<Pending> batch;
+  Recorder record;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty()) return;
+    batch.swap(pending);
+    record = recorder;
+  }
+
+  for (Pending &entry : batch) {
+    bool result = fn(entry.command);
+    if (record) {
+      record(tick, entry.command, result);
+    }
+    entry.result.set_value(result);
+  }
+}
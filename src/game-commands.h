@@ -0,0 +1,126 @@
+/*
+ * game-commands.h - Queue of game changes applied between updates
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_GAME_COMMANDS_H_
+#define SRC_GAME_COMMANDS_H_
+
+#include <functional>
+#include <future>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/building.h"
+#include "src/map.h"
+
+// Changes to the game requested from other threads. Callers queue a command
+// and get a future for its result; the game thread applies every queued
+// command in one batch at the start of the next Game::update(), holding the
+// game lock once for the whole batch. Commands are applied in the order they
+// were queued, so the game only changes on the game thread and a recorded
+// command list replays the same way.
+class GameCommands {
+ public:
+  typedef enum Type {
+    TypeBuildRoad = 0,
+    TypeBuildFlag,
+    TypeBuildBuilding,
+    TypeDemolishRoad,
+    TypeDemolishFlag,
+    TypeDemolishBuilding,
+    TypeBootSerf,
+    TypeCallTransporter,
+    TypeBuildCastle,
+    TypeSendGeologist,
+    TypeAttack,
+  } Type;
+
+  typedef struct Command {
+    Type type;
+    unsigned int player;
+    MapPos pos;
+    Building::Type building;
+    Road road;
+    unsigned int index;  // Serf to boot, flag to call a transporter to,
+                         // knights to send to an attack
+    Direction dir;       // Path of that flag
+
+    Command()
+      : Command(TypeBuildRoad, 0, bad_map_pos) {}
+    Command(Type _type, unsigned int _player, MapPos _pos,
+            Building::Type _building = Building::TypeNone,
+            const Road &_road = Road(), unsigned int _index = 0,
+            Direction _dir = DirectionNone)
+      : type(_type), player(_player), pos(_pos), building(_building),
+        road(_road), index(_index), dir(_dir) {}
+  } Command;
+
+  // Called on the game thread for every applied command, with the game
+  // tick it was applied at and its result. Build and demolish calls made
+  // straight on the game between updates are reported too, see
+  // Game::apply_direct.
+  typedef std::function<void(unsigned int tick, const Command &command,
+                             bool result)> Recorder;
+
+ protected:
+  typedef struct Pending {
+    Command command;
+    std::promise<bool> result;
+  } Pending;
+
+  std::mutex mutex;
+  std::vector<Pending> pending;
+  Recorder recorder;
+
+ public:
+  std::future<bool> build_road(const Road &road, unsigned int player);
+  std::future<bool> build_flag(MapPos pos, unsigned int player);
+  std::future<bool> build_building(MapPos pos, Building::Type type,
+                                   unsigned int player);
+  std::future<bool> demolish_road(MapPos pos, unsigned int player);
+  std::future<bool> demolish_flag(MapPos pos, unsigned int player);
+  std::future<bool> demolish_building(MapPos pos, unsigned int player);
+  // Work-arounds for serfs stuck waiting on a road and for roads that never
+  // get a transporter; see AI::do_fix_stuck_serfs.
+  std::future<bool> boot_serf(unsigned int serf, unsigned int player);
+  std::future<bool> call_transporter(unsigned int flag, Direction dir,
+                                     unsigned int player);
+  std::future<bool> build_castle(MapPos pos, unsigned int player);
+  // Send a geologist to the flag at pos.
+  std::future<bool> send_geologist(MapPos pos, unsigned int player);
+  // Attack the enemy building at pos with up to knights of the knights
+  // that can reach it.
+  std::future<bool> attack(MapPos pos, unsigned int knights,
+                           unsigned int player);
+
+  std::future<bool> push(const Command &command);
+  size_t size();
+
+  void set_recorder(Recorder _recorder);
+  bool is_recording();
+  // Report a command applied some other way to the recorder, if any.
+  void record(unsigned int tick, const Command &command, bool result);
+
+  // Take everything queued so far and apply it with the given function, in
+  // order. Only the game thread does this.
+  void apply(unsigned int tick, std::function<bool(const Command&)> fn);
+};
+
+#endif  // SRC_GAME_COMMANDS_H_
@@ -0,0 +1,75 @@
+/*
+ * game-events.cc - Changes in a game for the threads that keep views of it
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/game-events.h"
+
+const unsigned int GameEvents::default_capacity_shift;
+
+GameEvents::GameEvents(unsigned int capacity_shift)
+  : slots(new Slot[1 << capacity_shift])
+  , mask((1 << capacity_shift) - 1)
+  , published(0)
+  , tick(0) {
+  for (uint64_t i = 0; i <= mask; i++) {
+    slots[i].seq.store(0, std::memory_order_relaxed);
+  }
+}
+
+void
+GameEvents::publish(GameEvent::Type type, MapPos pos, unsigned int player,
+                    unsigned int index, unsigned int data) {
+  uint64_t n = published.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[n & mask];
+  slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.type.store(type, std::memory_order_relaxed);
+  slot.tick.store(tick.load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+  slot.pos.store(pos, std::memory_order_relaxed);
+  slot.player.store(player, std::memory_order_relaxed);
+  slot.index.store(index, std::memory_order_relaxed);
+  slot.data.store(data, std::memory_order_relaxed);
+  slot.seq.store(2 * n + 2, std::memory_order_release);
+}
+
+GameEvents::Reader
+GameEvents::subscribe() const {
+  Reader reader;
+  reader.next = get_published();
+  return reader;
+}
+
+bool
+GameEvents::read(uint64_t n, GameEvent *event) const {
+  const Slot &slot = slots[n & mask];
+  if (slot.seq.load(std::memory_order_acquire) != 2 * n + 2) {
+    return false;
+  }
+  event->type = static_cast<GameEvent::Type>(
+                  slot.type.load(std::memory_order_relaxed));
+  event->tick = slot.tick.load(std::memory_order_relaxed);
+  event->pos = slot.pos.load(std::memory_order_relaxed);
+  event->player = slot.player.load(std::memory_order_relaxed);
+  event->index = slot.index.load(std::memory_order_relaxed);
+  event->data = slot.data.load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.seq.load(std::memory_order_relaxed) == 2 * n + 2;
+}
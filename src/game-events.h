@@ -0,0 +1,148 @@
+/*
+ * game-events.h - Changes in a game for the threads that keep views of it
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_GAME_EVENTS_H_
+#define SRC_GAME_EVENTS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "src/map-geometry.h"
+
+// A change in a game, as the game tells it to the threads that keep a view
+// of it, so they can follow it instead of looking the game over again.
+typedef struct GameEvent {
+  typedef enum Type {
+    TypeNone = 0,
+    TypeObjectChanged,    // index is the new Map::Object
+    TypeOwnerChanged,     // index is the new owner + 1, or 0 for none
+    TypeRoadBuilt,        // pos is the source flag, data the length
+    TypeRoadRemoved,      // pos is a tile the road went through
+    TypeBuildingChanged,  // index is the building, data a BuildingState
+    TypeSerfChanged,      // index is the serf, data the new Serf::State
+    TypeCount
+  } Type;
+
+  typedef enum BuildingState {
+    BuildingFounded = 0,
+    BuildingFinished,
+    BuildingOccupied,
+    BuildingOwnerChanged,
+    BuildingBurning,
+    BuildingRemoved,
+  } BuildingState;
+
+  Type type;
+  unsigned int tick;
+  MapPos pos;
+  unsigned int player;   // Of roads, buildings and serfs
+  unsigned int index;
+  unsigned int data;
+} GameEvent;
+
+// The events of a game in a ring of fixed size, written by whoever holds the
+// game lock and read by any number of readers on threads of their own,
+// neither side locking or allocating. Each reader keeps its own place. A
+// reader that falls behind by more than the ring holds loses the oldest
+// events it had not read, and is told so it can look the game over again.
+class GameEvents {
+ public:
+  static const unsigned int default_capacity_shift = 16;
+
+  // Where a reader is in the events.
+  class Reader {
+   public:
+    Reader() : next(0) {}
+    uint64_t get_next() const { return next; }
+
+   protected:
+    friend class GameEvents;
+    uint64_t next;
+  };
+
+ protected:
+  // Each field of a slot is atomic, so a reader copying a slot the writer
+  // is overwriting gets a mix rather than a data race, and throws it away
+  // when seq shows the slot changed under it. seq is 2n + 1 while event n is
+  // written and 2n + 2 once it is.
+  typedef struct Slot {
+    std::atomic<uint64_t> seq;
+    std::atomic<uint32_t> type;
+    std::atomic<uint32_t> tick;
+    std::atomic<uint32_t> pos;
+    std::atomic<uint32_t> player;
+    std::atomic<uint32_t> index;
+    std::atomic<uint32_t> data;
+  } Slot;
+
+  std::unique_ptr<Slot[]> slots;
+  uint64_t mask;
+  std::atomic<uint64_t> published;   // Events taken a slot for
+  std::atomic<unsigned int> tick;
+
+  // Copy event n into event, false if the ring has moved on past it.
+  bool read(uint64_t n, GameEvent *event) const;
+
+ public:
+  explicit GameEvents(unsigned int capacity_shift = default_capacity_shift);
+
+  uint64_t get_capacity() const { return mask + 1; }
+  uint64_t get_published() const {
+    return published.load(std::memory_order_acquire); }
+
+  // The tick events are published in from now on.
+  void set_tick(unsigned int tick_) {
+    tick.store(tick_, std::memory_order_relaxed); }
+  void publish(GameEvent::Type type, MapPos pos, unsigned int player,
+               unsigned int index, unsigned int data = 0);
+
+  // A reader from the next event published on.
+  Reader subscribe() const;
+  // Call handler(const GameEvent &) for each event published since reader
+  // last read, oldest first. False if some of them were lost; those still
+  // in the ring are read all the same.
+  template <typename Handler>
+  bool read(Reader *reader, Handler handler) const {
+    bool complete = true;
+    uint64_t end = get_published();
+    if (end - reader->next > get_capacity()) {
+      reader->next = end - get_capacity();
+      complete = false;
+    }
+    GameEvent event;
+    for (; reader->next < end; reader->next++) {
+      uint64_t seq = slots[reader->next & mask].seq.load(
+                                                    std::memory_order_acquire);
+      if (seq < 2 * reader->next + 2) {
+        break;   // Still being written, read it next time
+      }
+      if (!read(reader->next, &event)) {
+        complete = false;
+        continue;
+      }
+      handler(static_cast<const GameEvent &>(event));
+    }
+    return complete;
+  }
+};
+
+#endif  // SRC_GAME_EVENTS_H_
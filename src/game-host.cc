@@ -0,0 +1,154 @@
+/*
+ * game-host.cc - AI-only games hosted side by side in one process
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/game-host.h"
+
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+#include "src/ai.h"
+#include "src/ai_pool.h"
+#include "src/freeserf.h"
+#include "src/game.h"
+#include "src/log.h"
+#include "src/mission.h"
+
+// Faces 1-11 are AI characters, see Interface::initialize_AI.
+static bool
+is_ai_face(size_t face) {
+  return (face >= 1 && face <= 11);
+}
+
+unsigned int
+GameHost::attach_ai_players(PGame game, const AIPlusOptions &options,
+                            std::vector<AI*> *ais) {
+  unsigned int count = 0;
+  for (unsigned int index = 0; game->get_player(index) != nullptr; index++) {
+    Player *player = game->get_player(index);
+    if (!is_ai_face(player->get_face())) {
+      continue;
+    }
+    Log::Info["host"] << "Initializing AI for player #" << index;
+    AI *ai = new AI(game, index, options);
+    game->ai_thread_starting();
+    ai->start();
+    ais->push_back(ai);
+    count++;
+  }
+  game->unlock_ai();
+  return count;
+}
+
+bool
+GameHost::stop_ai_players(PGame game, std::vector<AI*> *ais,
+                          unsigned int timeout_ms) {
+  game->stop_ai_threads();
+  // AI players only check for the stop signal between steps
+  AIPool &pool = AIPool::get_instance();
+  for (unsigned int waited = 0; ; waited += 10) {
+    for (auto it = ais->begin(); it != ais->end(); ) {
+      if (pool.has(*it)) {
+        ++it;
+      } else {
+        delete *it;
+        it = ais->erase(it);
+      }
+    }
+    if (ais->empty() || waited >= timeout_ms) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return ais->empty();
+}
+
+bool
+GameHost::all_players_started(PGame game) {
+  for (unsigned int index = 0; game->get_player(index) != nullptr; index++) {
+    if (!game->get_player(index)->has_castle()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+GameHost::play(const Setup &setup, GameResult *result) {
+  PGameInfo game_info(new GameInfo(Random(setup.seed)));
+  game_info->set_map_size(setup.map_size);
+  if (setup.all_ai) {
+    // Replace the human player with the first AI character.
+    game_info->get_player(0)->set_character(1);
+  }
+  PGame game = game_info->instantiate();
+  if (!game) {
+    Log::Error["host"] << "failed to start game '" << setup.seed << "'";
+    return false;
+  }
+
+  std::vector<AI*> ais;
+  attach_ai_players(game, setup.options, &ais);
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  Clock::time_point next_tick = start;
+  unsigned int ran = 0;
+  int started_index = -1;  // Player history index when all had castles
+  auto winner = [&game, &started_index]() {
+    if (started_index < 0 ||
+        started_index == game->get_player_history_index(0)) {
+      return -1;
+    }
+    return game->get_clear_winner();
+  };
+  while (ran < setup.ticks) {
+    game->update();
+    ran++;
+    result->update(game.get());
+    if (started_index < 0 && all_players_started(game)) {
+      started_index = game->get_player_history_index(0);
+    }
+    if (setup.until_winner && winner() >= 0) {
+      break;
+    }
+    if (setup.real_time) {
+      next_tick += std::chrono::milliseconds(TICK_LENGTH);
+      std::this_thread::sleep_until(next_tick);
+    }
+  }
+
+  result->seed = setup.seed;
+  result->map_size = setup.map_size;
+  result->options = setup.options.to_string();
+  result->ticks = ran;
+  result->game_tick = game->get_tick();
+  result->seconds = std::chrono::duration<double>(Clock::now() -
+                                                  start).count();
+  result->winner = winner();
+
+  if (!stop_ai_players(game, &ais, 10000)) {
+    // Left running, with the game they hold on to
+    Log::Error["host"] << ais.size() << " AI players of game '" << setup.seed
+                       << "' did not stop";
+    return false;
+  }
+  return true;
+}
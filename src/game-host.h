@@ -0,0 +1,77 @@
+/*
+ * game-host.h - AI-only games hosted side by side in one process
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_GAME_HOST_H_
+#define SRC_GAME_HOST_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/game-result.h"
+#include "src/lookup.h"
+
+class AI;
+class Game;
+typedef std::shared_ptr<Game> PGame;
+
+// Plays AI-only random games, each on the thread that asks for it, so one
+// process can host many at once. Each game has a Game and AI players of its
+// own and never goes through GameManager, which only knows a single game.
+// What the games share is read-only or locked: the AI players of all of
+// them are stepped by the one AIPool, and the spiral tables, the map
+// generator cache, GameStore and the log are common to the process.
+class GameHost {
+ public:
+  typedef struct Setup {
+    std::string seed;
+    unsigned int map_size;
+    AIPlusOptions options;
+    unsigned int ticks;       // Tick limit
+    bool all_ai;              // Also make player 0 an AI
+    bool until_winner;        // Stop once a player is the clear winner
+    bool real_time;           // Pace ticks like the real game
+
+    Setup() : map_size(3), ticks(10000), all_ai(true), until_winner(false),
+              real_time(false) {}
+  } Setup;
+
+  // Start AI players for the players of game with AI faces, and return how
+  // many there are.
+  static unsigned int attach_ai_players(PGame game,
+                                        const AIPlusOptions &options,
+                                        std::vector<AI*> *ais);
+  // Signal the AI players of game to stop and wait up to timeout_ms for
+  // them to leave. The ones that did are deleted, and false is returned if
+  // any are still running.
+  static bool stop_ai_players(PGame game, std::vector<AI*> *ais,
+                              unsigned int timeout_ms);
+  // Until every player has placed a castle the first one to do so holds all
+  // the land, so a clear winner only counts from the first stats update
+  // after that.
+  static bool all_players_started(PGame game);
+
+  // Play the game of setup to its end and fill in result. False if the
+  // game could not be started or its AI players did not stop.
+  static bool play(const Setup &setup, GameResult *result);
+};
+
+#endif  // SRC_GAME_HOST_H_
@@ -310,7 +310,10 @@ GameInitBox::handle_action(int action) {
         }
       } else {
       Log::Debug["game-init"] << "starting game using start_game(mission)";
-        if (!GameManager::get_instance().start_game(mission)) {
+        MapPreparer::PLandscape landscape =
+          preparer.take(mission->get_map_size(), mission->get_random_base());
+        if (!GameManager::get_instance().start_game(mission,
+                                                    landscape.get())) {
           return;
         }
       }
@@ -581,19 +584,25 @@ GameInitBox::handle_player_click(unsigned int player_index, int cx, int cy) {
 
 void
 GameInitBox::generate_map_preview() {
-  map.reset(new Map(MapGeometry(mission->get_map_size())));
-  if (game_type == GameMission) {
-    ClassicMissionMapGenerator generator(*map, mission->get_random_base());
-    generator.init();
-    generator.generate();
-    map->init_tiles(generator);
-  } else {
-    ClassicMapGenerator generator(*map, mission->get_random_base());
-    generator.init(MapGenerator::HeightGeneratorMidpoints, true);
-    generator.generate();
-    map->init_tiles(generator);
+  preparer.prepare(mission->get_map_size(), mission->get_random_base());
+  preview_landscape = nullptr;
+  update_map_preview();
+}
+
+void
+GameInitBox::update_map_preview() {
+  if (game_type == GameLoad) {
+    return;
+  }
+  MapPreparer::PLandscape landscape =
+    preparer.get_ready(mission->get_map_size(), mission->get_random_base());
+  if (!landscape || landscape == preview_landscape) {
+    return;
   }
+  preview_landscape = landscape;
 
+  map.reset(new Map(MapGeometry(mission->get_map_size())));
+  map->init_tiles(*landscape);
   minimap->set_map(map);
 
   set_redraw();
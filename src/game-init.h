@@ -28,6 +28,7 @@
 #include "src/gui.h"
 #include "src/game.h"
 #include "src/mission.h"
+#include "src/map-generator.h"
 
 class Interface;
 class RandomInput;
@@ -64,6 +65,10 @@ class GameInitBox : public GuiObject {
 
   std::unique_ptr<RandomInput> random_input;
   PMap map;
+  // the preview map is generated in the background, and handed to the
+  //  game when it starts
+  MapPreparer preparer;
+  MapPreparer::PLandscape preview_landscape;
   std::unique_ptr<Minimap> minimap;
   std::unique_ptr<ListSavedFiles> file_list;
 
@@ -71,6 +76,9 @@ class GameInitBox : public GuiObject {
   explicit GameInitBox(Interface *interface);
   virtual ~GameInitBox();
 
+  // Show the preview map once it is generated
+  void update_map_preview();
+
  protected:
   void draw_box_icon(int x, int y, int sprite);
   void draw_box_string(int x, int y, const std::string &str);
@@ -74,8 +74,9 @@ GameManager::start_random_game() {
 }
 
 bool
-GameManager::start_game(PGameInfo game_info) {
-  PGame new_game = game_info->instantiate();
+GameManager::start_game(PGameInfo game_info,
+                        const std::vector<Map::LandscapeTile> *landscape) {
+  PGame new_game = game_info->instantiate(landscape);
   if (!new_game) {
     return false;
   }
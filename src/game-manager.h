@@ -55,7 +55,8 @@ class GameManager {
   PGame get_current_game() { return current_game; }
 
   bool start_random_game();
-  bool start_game(PGameInfo game_info);
+  bool start_game(PGameInfo game_info,
+               const std::vector<Map::LandscapeTile> *landscape = nullptr);
   bool load_game(const std::string &path);
 
  protected:
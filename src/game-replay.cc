@@ -0,0 +1,400 @@
+/*
+ * game-replay.cc - Commands of a game, recorded to replay it
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "src/game-replay.h"
+
+#include <cstring>
+
+#include "src/game.h"
+
+static const char replay_magic[] = "FSERFRP1";
+
+const unsigned int GameReplay::default_hash_interval;
+
+static void
+write_number(std::ostream *stream, uint64_t value) {
+  while (value >= 0x80) {
+    stream->put(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  stream->put(static_cast<char>(value));
+}
+
+static bool
+read_number(std::istream *stream, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = stream->get();
+    if (c == std::char_traits<char>::eof()) {
+      return false;
+    }
+    *value |= static_cast<uint64_t>(c & 0x7F) << shift;
+    if ((c & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename T>
+static bool
+read_number(std::istream *stream, T *value) {
+  uint64_t number = 0;
+  if (!read_number(stream, &number)) {
+    return false;
+  }
+  *value = static_cast<T>(number);
+  return true;
+}
+
+// FNV-1a, a byte at a time
+static void
+hash_bytes(uint64_t *hash, const void *data, size_t size) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    *hash = (*hash ^ bytes[i]) * 0x100000001B3ull;
+  }
+}
+
+static void
+hash_number(uint64_t *hash, uint64_t value) {
+  hash_bytes(hash, &value, sizeof(value));
+}
+
+GameReplay::GameReplay()
+  : map_size(0)
+  , hash_interval(default_hash_interval) {
+}
+
+void
+GameReplay::set_setup(const GameInfo &game_info) {
+  seed = std::string(game_info.get_random_base());
+  map_size = game_info.get_map_size();
+  players.clear();
+  for (size_t i = 0; i < game_info.get_player_count(); i++) {
+    PPlayerInfo info = game_info.get_player(i);
+    players.push_back({ info->get_face(), info->get_color(),
+                        info->get_intelligence(), info->get_supplies(),
+                        info->get_reproduction(), info->get_castle_pos() });
+  }
+}
+
+PGameInfo
+GameReplay::make_game_info() const {
+  PGameInfo game_info(new GameInfo(Random(seed)));
+  game_info->set_map_size(map_size);
+  game_info->remove_all_players();
+  for (const PlayerSetup &setup : players) {
+    PPlayerInfo info(new PlayerInfo(setup.face, setup.color,
+                                    setup.intelligence, setup.supplies,
+                                    setup.reproduction));
+    info->set_castle_pos(setup.castle);
+    game_info->add_player(info);
+  }
+  return game_info;
+}
+
+void
+GameReplay::add(const Entry &entry) {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.push_back(entry);
+}
+
+void
+GameReplay::start_recording(Game *game, unsigned int interval) {
+  hash_interval = (interval > 0) ? interval : default_hash_interval;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+  }
+  random = std::string(game->get_random());
+  game->get_commands()->set_recorder([this](unsigned int tick,
+                                            const GameCommands::Command &cmd,
+                                            bool result) {
+    add({ EntryCommand, tick, cmd, result, 0 }); });
+  game->set_update_observer([this, game]() {
+    if (game->get_const_tick() % hash_interval == 0) {
+      Entry entry = {};
+      entry.type = EntryHash;
+      entry.tick = game->get_tick();
+      entry.hash = hash_state(game);
+      add(entry);
+    } });
+}
+
+void
+GameReplay::stop_recording(Game *game) {
+  game->get_commands()->set_recorder(nullptr);
+  game->set_update_observer(nullptr);
+}
+
+GameReplay::Result
+GameReplay::replay(Game *game) const {
+  Result result = {};
+  size_t next = 0;
+  GameCommands *commands = game->get_commands();
+  if (!random.empty()) {
+    game->set_random(Random(random));
+  }
+  game->set_update_observer([this, game, &result, &next]() {
+    while (next < entries.size() && entries[next].type == EntryHash &&
+           entries[next].tick <= game->get_tick()) {
+      const Entry &entry = entries[next++];
+      result.hashes_checked++;
+      uint64_t hash = hash_state(game);
+      if (entry.tick != game->get_tick() || entry.hash != hash) {
+        result.diverged = true;
+        result.tick = entry.tick;
+        result.expected = entry.hash;
+        result.hash = hash;
+        return;
+      }
+    } });
+
+  while (next < entries.size() && !result.diverged) {
+    // Commands recorded while the game was in an update are a tick late.
+    std::vector<std::future<bool>> pending;
+    std::vector<bool> expected;
+    while (next < entries.size() && entries[next].type == EntryCommand &&
+           entries[next].tick <= game->get_tick()) {
+      pending.push_back(commands->push(entries[next].command));
+      expected.push_back(entries[next].result);
+      next++;
+    }
+    game->update();
+    result.updates++;
+    for (size_t i = 0; i < pending.size(); i++) {
+      result.commands++;
+      if (pending[i].get() != expected[i]) {
+        result.results_differ++;
+      }
+    }
+  }
+  game->set_update_observer(nullptr);
+  return result;
+}
+
+bool
+GameReplay::write(std::ostream *stream) {
+  std::lock_guard<std::mutex> lock(mutex);
+  stream->write(replay_magic, sizeof(replay_magic) - 1);
+  write_number(stream, hash_interval);
+  write_number(stream, seed.size());
+  stream->write(seed.data(), seed.size());
+  write_number(stream, random.size());
+  stream->write(random.data(), random.size());
+  write_number(stream, map_size);
+  write_number(stream, players.size());
+  for (const PlayerSetup &setup : players) {
+    write_number(stream, setup.face);
+    stream->put(static_cast<char>(setup.color.red));
+    stream->put(static_cast<char>(setup.color.green));
+    stream->put(static_cast<char>(setup.color.blue));
+    write_number(stream, setup.intelligence);
+    write_number(stream, setup.supplies);
+    write_number(stream, setup.reproduction);
+    // Castle positions not given are -1
+    write_number(stream, setup.castle.col + 1);
+    write_number(stream, setup.castle.row + 1);
+  }
+
+  unsigned int tick = 0;
+  for (const Entry &entry : entries) {
+    if (entry.tick < tick) {
+      return false;
+    }
+    write_number(stream, entry.type);
+    write_number(stream, entry.tick - tick);
+    tick = entry.tick;
+    if (entry.type == EntryHash) {
+      write_number(stream, entry.hash);
+      continue;
+    }
+    const GameCommands::Command &command = entry.command;
+    write_number(stream, command.type);
+    write_number(stream, command.player);
+    write_number(stream, command.pos);
+    write_number(stream, entry.result ? 1 : 0);
+    switch (command.type) {
+      case GameCommands::TypeBuildRoad:
+        write_number(stream, command.road.get_length());
+        for (Direction dir : command.road.get_dirs()) {
+          stream->put(static_cast<char>(dir));
+        }
+        break;
+      case GameCommands::TypeBuildBuilding:
+        write_number(stream, command.building);
+        break;
+      case GameCommands::TypeBootSerf:
+      case GameCommands::TypeAttack:
+        write_number(stream, command.index);
+        break;
+      case GameCommands::TypeCallTransporter:
+        write_number(stream, command.index);
+        write_number(stream, command.dir);
+        break;
+      default:
+        break;
+    }
+  }
+  write_number(stream, EntryEnd);
+  return stream->good();
+}
+
+bool
+GameReplay::read(std::istream *stream) {
+  char magic[sizeof(replay_magic) - 1];
+  if (!stream->read(magic, sizeof(magic)) ||
+      memcmp(magic, replay_magic, sizeof(magic)) != 0) {
+    return false;
+  }
+  size_t length = 0;
+  if (!read_number(stream, &hash_interval) || hash_interval == 0 ||
+      !read_number(stream, &length) || length > 64) {
+    return false;
+  }
+  seed.resize(length);
+  if (!stream->read(&seed[0], length) || !read_number(stream, &length) ||
+      length != 16) {
+    return false;
+  }
+  random.resize(length);
+  size_t count = 0;
+  if (!stream->read(&random[0], length) || !read_number(stream, &map_size) ||
+      !read_number(stream, &count) || count > GAME_MAX_PLAYER_COUNT) {
+    return false;
+  }
+  players.clear();
+  for (size_t i = 0; i < count; i++) {
+    PlayerSetup setup = {};
+    char color[3];
+    if (!read_number(stream, &setup.face) || !stream->read(color, 3) ||
+        !read_number(stream, &setup.intelligence) ||
+        !read_number(stream, &setup.supplies) ||
+        !read_number(stream, &setup.reproduction) ||
+        !read_number(stream, &setup.castle.col) ||
+        !read_number(stream, &setup.castle.row)) {
+      return false;
+    }
+    setup.color = { static_cast<unsigned char>(color[0]),
+                    static_cast<unsigned char>(color[1]),
+                    static_cast<unsigned char>(color[2]) };
+    setup.castle.col--;
+    setup.castle.row--;
+    players.push_back(setup);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  unsigned int tick = 0;
+  while (true) {
+    Entry entry = {};
+    unsigned int delta = 0;
+    if (!read_number(stream, &entry.type)) {
+      return false;
+    }
+    if (entry.type == EntryEnd) {
+      return true;
+    }
+    if (!read_number(stream, &delta)) {
+      return false;
+    }
+    tick += delta;
+    entry.tick = tick;
+    if (entry.type == EntryHash) {
+      if (!read_number(stream, &entry.hash)) {
+        return false;
+      }
+      entries.push_back(entry);
+      continue;
+    } else if (entry.type != EntryCommand) {
+      return false;
+    }
+
+    GameCommands::Command &command = entry.command;
+    unsigned int result = 0;
+    command.building = Building::TypeNone;
+    command.dir = DirectionNone;
+    if (!read_number(stream, &command.type) ||
+        command.type > GameCommands::TypeAttack ||
+        !read_number(stream, &command.player) ||
+        !read_number(stream, &command.pos) ||
+        !read_number(stream, &result)) {
+      return false;
+    }
+    entry.result = (result != 0);
+    bool good = true;
+    switch (command.type) {
+      case GameCommands::TypeBuildRoad: {
+        size_t road_length = 0;
+        good = read_number(stream, &road_length);
+        command.road.start(command.pos);
+        for (size_t i = 0; good && i < road_length; i++) {
+          int dir = stream->get();
+          good = (dir >= DirectionRight && dir <= DirectionUp &&
+                  command.road.extend(static_cast<Direction>(dir)));
+        }
+        break;
+      }
+      case GameCommands::TypeBuildBuilding:
+        good = read_number(stream, &command.building);
+        break;
+      case GameCommands::TypeBootSerf:
+      case GameCommands::TypeAttack:
+        good = read_number(stream, &command.index);
+        break;
+      case GameCommands::TypeCallTransporter:
+        good = (read_number(stream, &command.index) &&
+                read_number(stream, &command.dir));
+        break;
+      default:
+        break;
+    }
+    if (!good) {
+      return false;
+    }
+    entries.push_back(entry);
+  }
+}
+
+uint64_t
+GameReplay::hash_state(Game *game) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  hash_number(&hash, game->get_tick());
+  std::string random = std::string(game->get_random());
+  hash_bytes(&hash, random.data(), random.size());
+  hash_number(&hash, game->get_serf_count());
+  hash_number(&hash, game->get_flag_count());
+  hash_number(&hash, game->get_building_count());
+  hash_number(&hash, game->get_gold_total());
+  for (unsigned int i = 0; game->get_player(i) != nullptr; i++) {
+    Player *player = game->get_player(i);
+    hash_number(&hash, player->get_land_area());
+    hash_number(&hash, player->get_building_score());
+    hash_number(&hash, player->get_total_military_score());
+    // serf_count has no slot for TypeDead
+    for (int type = Serf::TypeTransporter; type < Serf::TypeDead; type++) {
+      hash_number(&hash, player->get_serf_count(type));
+    }
+  }
+  return hash;
+}
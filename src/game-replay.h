@@ -0,0 +1,131 @@
+/*
+ * game-replay.h - Commands of a game, recorded to replay it
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SRC_GAME_REPLAY_H_
+#define SRC_GAME_REPLAY_H_
+
+#include <cstdint>
+#include <istream>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "src/game-commands.h"
+#include "src/mission.h"
+
+// A log of everything that changed a game from outside: the setup it was
+// started from, the state of the random numbers of the game when recording
+// started, and every command applied to it with the tick it was
+// applied at and its result. Every few updates a hash of the game state is
+// added, so a replay of the log can tell the first tick it played out
+// differently instead of only that the end differs.
+//
+// Commands queued with GameCommands and build and demolish calls made
+// straight on the game are both recorded. Other changes the AI makes, like
+// transport and tool priorities, are not, nor is the order of changes an AI
+// thread makes in the middle of an update; games that depend on those show
+// up as a divergence at the first hash after them.
+//
+// The log is written in a compact binary form, numbers as variable length
+// integers and ticks as the difference to the previous entry.
+class GameReplay {
+ public:
+  static const unsigned int default_hash_interval = 100;  // In updates
+
+  typedef struct PlayerSetup {
+    unsigned int face;
+    Player::Color color;
+    unsigned int intelligence;
+    unsigned int supplies;
+    unsigned int reproduction;
+    PlayerInfo::Pos castle;
+  } PlayerSetup;
+
+  typedef enum EntryType {
+    EntryEnd = 0,
+    EntryCommand,
+    EntryHash,
+  } EntryType;
+
+  typedef struct Entry {
+    EntryType type;
+    unsigned int tick;
+    GameCommands::Command command;  // For EntryCommand
+    bool result;
+    uint64_t hash;                  // For EntryHash
+  } Entry;
+
+  typedef struct Result {
+    unsigned int updates;
+    unsigned int commands;
+    unsigned int results_differ;    // Commands that failed only one time
+    unsigned int hashes_checked;
+    bool diverged;
+    unsigned int tick;              // Of the first hash that differs
+    uint64_t expected;
+    uint64_t hash;
+  } Result;
+
+ protected:
+  std::string seed;
+  std::string random;  // Game::get_random() at the start
+  unsigned int map_size;
+  std::vector<PlayerSetup> players;
+  unsigned int hash_interval;
+  std::vector<Entry> entries;
+  std::mutex mutex;  // Commands are recorded on the AI threads too
+
+  void add(const Entry &entry);
+
+ public:
+  GameReplay();
+
+  void set_setup(const GameInfo &game_info);
+  PGameInfo make_game_info() const;
+  const std::string &get_seed() const { return seed; }
+  unsigned int get_hash_interval() const { return hash_interval; }
+  const std::vector<Entry> &get_entries() const { return entries; }
+
+  // Record the commands of the game, and its hash every interval updates,
+  // until stop_recording() is called. The game has to be started from the
+  // setup and not have been updated or changed by AI players yet.
+  void start_recording(Game *game,
+                       unsigned int interval = default_hash_interval);
+  void stop_recording(Game *game);
+
+  // Apply the recorded commands to the game, started from make_game_info()
+  // and without AI players, at the ticks they were recorded at, and update
+  // it as fast as it goes until the log ends or a hash differs.
+  Result replay(Game *game) const;
+
+  bool write(std::ostream *stream);
+  bool read(std::istream *stream);
+
+  // Cheap hash of the state of the game: its tick, the state of its random
+  // numbers, the objects it has and the scores and serfs of the players.
+  // Nearly every difference changes the random numbers the serfs draw soon
+  // after, so this finds a divergence within a few ticks of it.
+  static uint64_t hash_state(Game *game);
+};
+
+#endif  // SRC_GAME_REPLAY_H_
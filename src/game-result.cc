@@ -0,0 +1,159 @@
+/*
+ * game-result.cc - Outcome and score history of one headless game
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/game-result.h"
+
+#include <sstream>
+
+#include "src/game.h"
+
+static const char *aspect_names[GameResult::AspectCount] = {
+  "score", "land", "buildings", "military"
+};
+
+GameResult::GameResult()
+  : map_size(0)
+  , ticks(0)
+  , game_tick(0)
+  , seconds(0.)
+  , winner(-1)
+  , history_index(-1) {
+}
+
+void
+GameResult::update(Game *game) {
+  int index = game->get_player_history_index(0);
+  if (index == history_index) {
+    return;
+  }
+  history_index = index;
+  for (unsigned int i = 0; game->get_player(i) != nullptr; i++) {
+    Player *player = game->get_player(i);
+    Sample sample;
+    sample.tick = game->get_tick();
+    sample.player = i;
+    for (int aspect = 0; aspect < AspectCount; aspect++) {
+      sample.values[aspect] =
+        player->get_player_stat_history(aspect << 2)[index];
+    }
+    samples.push_back(sample);
+  }
+}
+
+double
+GameResult::get_ticks_per_second() const {
+  return (seconds > 0.) ? ticks / seconds : 0.;
+}
+
+// One "game" line followed by a "sample" line per sample. Seeds and
+// option bits never contain spaces.
+bool
+GameResult::write(std::ostream *stream) const {
+  *stream << "game " << seed << " " << map_size << " " << options << " "
+          << ticks << " " << game_tick << " " << seconds << " " << winner
+          << "\n";
+  for (const Sample &sample : samples) {
+    *stream << "sample " << sample.tick << " " << sample.player;
+    for (int value : sample.values) {
+      *stream << " " << value;
+    }
+    *stream << "\n";
+  }
+  return stream->good();
+}
+
+bool
+GameResult::read(std::istream *stream) {
+  std::string line;
+  std::string kind;
+  if (!std::getline(*stream, line)) {
+    return false;
+  }
+  std::istringstream game_line(line);
+  game_line >> kind >> seed >> map_size >> options >> ticks >> game_tick
+            >> seconds >> winner;
+  if (game_line.fail() || kind != "game") {
+    return false;
+  }
+
+  samples.clear();
+  while (std::getline(*stream, line)) {
+    std::istringstream sample_line(line);
+    Sample sample;
+    sample_line >> kind >> sample.tick >> sample.player;
+    for (int &value : sample.values) {
+      sample_line >> value;
+    }
+    if (sample_line.fail() || kind != "sample") {
+      return false;
+    }
+    samples.push_back(sample);
+  }
+  return true;
+}
+
+void
+GameResult::write_csv_header(std::ostream *stream) {
+  *stream << "seed,map_size,options,ticks,game_tick,seconds,ticks_per_second,"
+          << "winner,tick,player";
+  for (const char *name : aspect_names) {
+    *stream << "," << name;
+  }
+  *stream << "\n";
+}
+
+// A row per sample, each repeating the game columns so the file can be
+// filtered and grouped as it is.
+void
+GameResult::write_csv(std::ostream *stream) const {
+  std::ostringstream game_columns;
+  game_columns << seed << "," << map_size << "," << options << "," << ticks
+               << "," << game_tick << "," << seconds << ","
+               << get_ticks_per_second() << "," << winner;
+  for (const Sample &sample : samples) {
+    *stream << game_columns.str() << "," << sample.tick << ","
+            << sample.player;
+    for (int value : sample.values) {
+      *stream << "," << value;
+    }
+    *stream << "\n";
+  }
+}
+
+void
+GameResult::write_json(std::ostream *stream) const {
+  *stream << "{\"seed\": \"" << seed << "\", \"map_size\": " << map_size
+          << ", \"options\": \"" << options << "\", \"ticks\": " << ticks
+          << ", \"game_tick\": " << game_tick << ", \"seconds\": " << seconds
+          << ", \"ticks_per_second\": " << get_ticks_per_second()
+          << ", \"winner\": " << winner << ", \"history\": [";
+  for (size_t i = 0; i < samples.size(); i++) {
+    const Sample &sample = samples[i];
+    *stream << ((i > 0) ? ", " : "") << "{\"tick\": " << sample.tick
+            << ", \"player\": " << sample.player;
+    for (int aspect = 0; aspect < AspectCount; aspect++) {
+      *stream << ", \"" << aspect_names[aspect] << "\": "
+              << sample.values[aspect];
+    }
+    *stream << "}";
+  }
+  *stream << "]}";
+}
@@ -0,0 +1,85 @@
+/*
+ * game-result.h - Outcome and score history of one headless game
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_GAME_RESULT_H_
+#define SRC_GAME_RESULT_H_
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Game;
+
+// What freeserf-headless reports about a game it ran: how it was set up,
+// how fast it ran, who won, and the share of score, land, buildings and
+// military strength of every player each time the game stats were updated
+// (the values Game::record_player_history stores, in percent of the total
+// of all players). Written by the headless runner and read back by the
+// tournament runner, which merges many of them into one CSV or JSON report.
+class GameResult {
+ public:
+  // In the order of the aspects of Game::record_player_history.
+  typedef enum Aspect {
+    AspectScore = 0,
+    AspectLand,
+    AspectBuildings,
+    AspectMilitary,
+
+    AspectCount
+  } Aspect;
+
+  typedef struct Sample {
+    unsigned int tick;
+    unsigned int player;
+    int values[AspectCount];
+  } Sample;
+
+  std::string seed;
+  unsigned int map_size;
+  std::string options;  // AIPlusOptions bits, as written by std::bitset
+  unsigned int ticks;   // Game::update() calls made
+  unsigned int game_tick;
+  double seconds;
+  int winner;           // Game::get_clear_winner() at the end
+  std::vector<Sample> samples;
+
+ protected:
+  int history_index;
+
+ public:
+  GameResult();
+
+  // Add a sample per player if the game stats were updated since the
+  // last call. Cheap enough to call after every tick.
+  void update(Game *game);
+
+  double get_ticks_per_second() const;
+
+  bool write(std::ostream *stream) const;
+  bool read(std::istream *stream);
+
+  static void write_csv_header(std::ostream *stream);
+  void write_csv(std::ostream *stream) const;
+  void write_json(std::ostream *stream) const;
+};
+
+#endif  // SRC_GAME_RESULT_H_
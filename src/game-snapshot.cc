@@ -0,0 +1,179 @@
+/*
+ * game-snapshot.cc - Read-only copy of the game state for AI threads
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/game-snapshot.h"
+
+#include "src/game.h"
+#include "src/flag.h"
+#include "src/inventory.h"
+#include "src/misc.h"
+
+const unsigned int GameSnapshot::max_players;
+const unsigned int GameSnapshot::building_types;
+
+void
+GameSnapshot::capture(Game *game, uint64_t _version) {
+  version = _version;
+  tick = game->get_tick();
+  flag_graph_changes = game->get_flag_graph_changes();
+
+  for (PlayerView &player : players) {
+    player.flags.clear();
+    player.buildings.clear();
+    player.serfs.clear();
+    player.inventories.clear();
+    player.waiting_serfs.clear();
+    player.unserved_paths.clear();
+  }
+
+  for (Flag *flag : game->flags) {
+    // Index 0 is the unused placeholder object.
+    if (flag->get_index() == 0 || flag->get_owner() >= max_players) continue;
+    FlagView view;
+    view.index = flag->get_index();
+    view.pos = flag->get_position();
+    view.connected = flag->is_connected();
+    view.has_building = flag->has_building();
+    view.building_index = view.has_building ?
+                            flag->get_building()->get_index() : 0;
+    view.paths = flag->paths();
+    view.transporters = 0;
+    for (Direction d : cycle_directions_cw()) {
+      if (flag->has_transporter(d)) view.transporters |= BIT(d);
+    }
+    players[flag->get_owner()].flags.push_back(view);
+  }
+
+  for (Building *building : game->buildings) {
+    if (building->get_index() == 0 || building->get_owner() >= max_players) continue;
+    Flag *flag = game->get_flag(building->get_flag_index());
+    BuildingView view;
+    view.index = building->get_index();
+    view.pos = building->get_position();
+    view.type = building->get_type();
+    view.flag_index = building->get_flag_index();
+    view.done = building->is_done();
+    view.burning = building->is_burning();
+    view.active = building->is_active();
+    view.military = building->is_military();
+    view.has_serf = building->has_serf();
+    view.flag_connected = (flag != nullptr) && flag->is_connected();
+    view.progress = building->get_progress();
+    view.knight_count = (view.military && view.done) ?
+                          building->get_knight_count() : 0;
+    view.threat_level = static_cast<unsigned int>(building->get_threat_level());
+    players[building->get_owner()].buildings.push_back(view);
+  }
+
+  for (Serf *serf : game->serfs) {
+    if (serf->get_index() == 0 || serf->get_owner() >= max_players) continue;
+    SerfView view;
+    view.index = serf->get_index();
+    view.pos = serf->get_pos();
+    view.type = serf->get_type();
+    view.state = serf->get_state();
+    players[serf->get_owner()].serfs.push_back(view);
+  }
+
+  for (Inventory *inventory : game->inventories) {
+    if (inventory->get_owner() >= max_players) continue;
+    InventoryView view;
+    view.index = inventory->get_index();
+    view.flag_index = inventory->get_flag_index();
+    view.building_index = inventory->get_building_index();
+    view.free_serfs = inventory->free_serf_count();
+    view.resources = inventory->get_all_resources();
+    players[inventory->get_owner()].inventories.push_back(std::move(view));
+  }
+
+  for (PlayerView &player : players) {
+    index_buildings(&player);
+  }
+
+  const GameWatchdog *watchdog = game->get_watchdog();
+  for (const GameWatchdog::WaitingSerf &entry : watchdog->get_waiting_serfs()) {
+    Serf *serf = game->get_serf(entry.serf);
+    if (serf == nullptr || serf->get_owner() >= max_players ||
+        serf->get_state() != Serf::StateWaitIdleOnPath) continue;
+    players[serf->get_owner()].waiting_serfs.push_back({ entry.serf,
+                                                         entry.since });
+  }
+  for (const GameWatchdog::UnservedPath &entry :
+       watchdog->get_unserved_paths()) {
+    Flag *flag = game->get_flag(entry.flag);
+    if (flag == nullptr || flag->get_owner() >= max_players ||
+        !flag->has_path(entry.dir) || flag->has_transporter(entry.dir)) {
+      continue;
+    }
+    players[flag->get_owner()].unserved_paths.push_back({ entry.flag,
+                                                          entry.dir,
+                                                          entry.since });
+  }
+
+  PMap map = game->get_map();
+  owners = map->get_owner_tiles();
+  objects = map->get_obj_tiles();
+  if (geom.size() != map->get_size()) {
+    geom = map->geom();
+  }
+}
+
+// Counting sort of the buildings by type. Stays in building order within a
+// type, so ties in nearest_buildings() are broken the same way every time.
+void
+GameSnapshot::index_buildings(PlayerView *player) {
+  std::fill(player->type_start, player->type_start + building_types + 1, 0);
+  for (const BuildingView &building : player->buildings) {
+    player->type_start[building.type + 1]++;
+  }
+  for (unsigned int t = 0; t < building_types; t++) {
+    player->type_start[t + 1] += player->type_start[t];
+  }
+  player->buildings_by_type.resize(player->buildings.size());
+  unsigned int next[building_types];
+  std::copy(player->type_start, player->type_start + building_types, next);
+  for (unsigned int i = 0; i < player->buildings.size(); i++) {
+    player->buildings_by_type[next[player->buildings[i].type]++] = i;
+  }
+}
+
+size_t
+GameSnapshot::nearest_buildings(unsigned int player, Building::Type type,
+                                MapPos pos, int radius,
+                                const BuildingView *found[],
+                                size_t count) const {
+  const PlayerView &view = players[player];
+  size_t size = 0;
+  for (unsigned int i = view.type_start[type];
+       i < view.type_start[type + 1]; i++) {
+    const BuildingView *building = &view.buildings[view.buildings_by_type[i]];
+    int dist = tile_dist(pos, building->pos);
+    if (dist > radius) continue;
+    // Insert in place, dropping the farthest once full.
+    size_t at = size;
+    while (at > 0 && tile_dist(pos, found[at - 1]->pos) > dist) at--;
+    if (at >= count) continue;
+    if (size < count) size++;
+    for (size_t j = size - 1; j > at; j--) found[j] = found[j - 1];
+    found[at] = building;
+  }
+  return size;
+}
@@ -0,0 +1,188 @@
+/*
+ * game-snapshot.h - Read-only copy of the game state for AI threads
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_GAME_SNAPSHOT_H_
+#define SRC_GAME_SNAPSHOT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "src/building.h"
+#include "src/map.h"
+#include "src/map-geometry.h"
+#include "src/resource.h"
+#include "src/serf.h"
+
+class Game;
+
+// Copy of the parts of the game state the AI reads, taken by the game thread
+// between two updates. A snapshot never changes once published, so it can be
+// read without locking the game. Objects are referred to by index rather
+// than by pointer; an index may be stale by the time it is used for a live
+// lookup, so callers must check the result of Game::get_*() for nullptr.
+class GameSnapshot {
+ public:
+  typedef struct FlagView {
+    unsigned int index;
+    MapPos pos;
+    bool connected;
+    bool has_building;
+    unsigned int building_index;
+    int paths;
+    int transporters;  // bit per direction, as Flag::has_transporter()
+  } FlagView;
+
+  typedef struct BuildingView {
+    unsigned int index;
+    MapPos pos;
+    Building::Type type;
+    unsigned int flag_index;
+    bool done;
+    bool burning;
+    bool active;
+    bool military;
+    bool has_serf;
+    bool flag_connected;
+    int progress;
+    unsigned int knight_count;
+    unsigned int threat_level;   // as Building::get_threat_level(), 3 at the border
+  } BuildingView;
+
+  typedef struct SerfView {
+    unsigned int index;
+    MapPos pos;
+    Serf::Type type;
+    Serf::State state;
+  } SerfView;
+
+  typedef struct InventoryView {
+    unsigned int index;
+    unsigned int flag_index;
+    unsigned int building_index;
+    size_t free_serfs;
+    ResourceMap resources;
+  } InventoryView;
+
+  static const unsigned int max_players = 4;
+  static const unsigned int building_types = Building::TypeCastle + 1;
+
+  // From the GameWatchdog, with the stale entries dropped.
+  typedef struct WaitingSerfView {
+    unsigned int index;
+    unsigned int since;
+  } WaitingSerfView;
+
+  typedef struct UnservedPathView {
+    unsigned int flag_index;
+    Direction dir;
+    unsigned int since;
+  } UnservedPathView;
+
+  typedef struct PlayerView {
+    std::vector<FlagView> flags;
+    std::vector<BuildingView> buildings;
+    std::vector<SerfView> serfs;
+    std::vector<InventoryView> inventories;
+    std::vector<WaitingSerfView> waiting_serfs;
+    std::vector<UnservedPathView> unserved_paths;
+    // Indexes into buildings grouped by type: the buildings of type t are
+    // at buildings_by_type[type_start[t]] up to type_start[t + 1].
+    std::vector<unsigned int> buildings_by_type;
+    unsigned int type_start[building_types + 1];
+  } PlayerView;
+
+ protected:
+  uint64_t version;
+  unsigned int tick;
+  unsigned int flag_graph_changes;
+  PlayerView players[max_players];
+  // Per tile: owner + 1, or 0 if the tile has no owner, as in Map.
+  std::vector<uint8_t> owners;
+  std::vector<uint8_t> objects;
+  MapGeometry geom;
+
+  void index_buildings(PlayerView *player);
+
+ public:
+  GameSnapshot() : version(0), tick(0), flag_graph_changes(0), geom(1) {}
+
+  // Refill this snapshot from the game. The caller must hold the game lock,
+  // at least shared. Vector capacity is kept, so a recycled snapshot does
+  // not allocate once the game has stopped growing.
+  void capture(Game *game, uint64_t version);
+
+  uint64_t get_version() const { return version; }
+  unsigned int get_tick() const { return tick; }
+  // Game::get_flag_graph_changes() when captured.
+  unsigned int get_flag_graph_changes() const { return flag_graph_changes; }
+
+  const PlayerView &get_player(unsigned int index) const {
+    return players[index]; }
+
+  bool has_owner(MapPos pos) const { return (owners[pos] != 0); }
+  unsigned int get_owner(MapPos pos) const { return owners[pos] - 1; }
+  Map::Object get_obj(MapPos pos) const {
+    return static_cast<Map::Object>(objects[pos]); }
+
+  // Number of steps between two positions, ignoring terrain. Positions
+  // within distance d of a position are the first AI::spiral_dist(d)
+  // positions of its spiral.
+  int tile_dist(MapPos pos1, MapPos pos2) const {
+    int dist_col = geom.dist_x(pos1, pos2);
+    int dist_row = geom.dist_y(pos1, pos2);
+    if ((dist_col > 0 && dist_row > 0) || (dist_col < 0 && dist_row < 0)) {
+      return std::max(std::abs(dist_col), std::abs(dist_row));
+    }
+    return std::abs(dist_col) + std::abs(dist_row);
+  }
+
+  // Up to count buildings of a player and type within radius of pos, put in
+  // found nearest first; returns how many were found. Equally near
+  // buildings come in index order.
+  size_t nearest_buildings(unsigned int player, Building::Type type,
+                           MapPos pos, int radius,
+                           const BuildingView *found[], size_t count) const;
+
+  // The nearest building of a player and type within radius of pos for
+  // which accept(view) is true, or nullptr.
+  template <typename Accept>
+  const BuildingView *nearest_building(unsigned int player,
+                                       Building::Type type, MapPos pos,
+                                       int radius, Accept accept) const {
+    const PlayerView &view = players[player];
+    const BuildingView *best = nullptr;
+    int best_dist = radius + 1;
+    for (unsigned int i = view.type_start[type];
+         i < view.type_start[type + 1]; i++) {
+      const BuildingView &building = view.buildings[view.buildings_by_type[i]];
+      int dist = tile_dist(pos, building.pos);
+      if (dist < best_dist && accept(building)) {
+        best = &building;
+        best_dist = dist;
+      }
+    }
+    return best;
+  }
+};
+
+#endif  // SRC_GAME_SNAPSHOT_H_
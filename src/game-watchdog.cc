@@ -0,0 +1,93 @@
+/*
+ * game-watchdog.cc - Serfs and roads that have been waiting too long
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/game-watchdog.h"
+
+// Entries are removed by moving the last one into their place, so each
+// list stays packed and only the moved entry's slot needs fixing.
+template <typename Entries, typename Key>
+static void
+remove_entry(Entries *entries, std::vector<unsigned int> *slots,
+             unsigned int key, Key key_of) {
+  if (key >= slots->size() || (*slots)[key] == 0) return;
+  unsigned int at = (*slots)[key] - 1;
+  (*slots)[key] = 0;
+  if (at + 1 != entries->size()) {
+    (*entries)[at] = entries->back();
+    (*slots)[key_of((*entries)[at])] = at + 1;
+  }
+  entries->pop_back();
+}
+
+static unsigned int
+path_key(unsigned int flag, Direction dir) {
+  return flag * 6 + dir;
+}
+
+void
+GameWatchdog::serf_waiting(unsigned int serf, unsigned int tick) {
+  if (serf >= serf_slots.size()) serf_slots.resize(serf + 1, 0);
+  if (serf_slots[serf] != 0) return;
+  waiting_serfs.push_back({ serf, tick });
+  serf_slots[serf] = static_cast<unsigned int>(waiting_serfs.size());
+}
+
+void
+GameWatchdog::serf_moving(unsigned int serf) {
+  remove_entry(&waiting_serfs, &serf_slots, serf,
+               [](const WaitingSerf &entry) { return entry.serf; });
+}
+
+void
+GameWatchdog::path_unserved(unsigned int flag, Direction dir,
+                            unsigned int tick) {
+  unsigned int key = path_key(flag, dir);
+  if (key >= path_slots.size()) path_slots.resize(key + 1, 0);
+  if (path_slots[key] != 0) return;
+  unserved_paths.push_back({ flag, dir, tick });
+  path_slots[key] = static_cast<unsigned int>(unserved_paths.size());
+}
+
+void
+GameWatchdog::transporter_called(unsigned int flag, Direction dir,
+                                 unsigned int tick) {
+  unsigned int key = path_key(flag, dir);
+  if (key < path_slots.size() && path_slots[key] != 0) {
+    unserved_paths[path_slots[key] - 1].since = tick;
+  } else {
+    path_unserved(flag, dir, tick);
+  }
+}
+
+void
+GameWatchdog::path_served(unsigned int flag, Direction dir) {
+  remove_entry(&unserved_paths, &path_slots, path_key(flag, dir),
+               [](const UnservedPath &entry) {
+                 return path_key(entry.flag, entry.dir); });
+}
+
+void
+GameWatchdog::clear() {
+  waiting_serfs.clear();
+  unserved_paths.clear();
+  serf_slots.assign(serf_slots.size(), 0);
+  path_slots.assign(path_slots.size(), 0);
+}
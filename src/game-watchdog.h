@@ -0,0 +1,75 @@
+/*
+ * game-watchdog.h - Serfs and roads that have been waiting too long
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_GAME_WATCHDOG_H_
+#define SRC_GAME_WATCHDOG_H_
+
+#include <vector>
+
+#include "src/map-geometry.h"
+
+// Keeps the serfs that are waiting on a road (Serf::StateWaitIdleOnPath)
+// and the flag paths that have no transporter, each with the tick it
+// started, so the AI can find the ones that have lasted too long without
+// looking at every serf and flag. Serf state changes and Flag transporter
+// changes keep it current as they happen; every change is O(1) and
+// allocates nothing once the lists have grown. The game thread owns it,
+// GameSnapshot copies it for the AI.
+class GameWatchdog {
+ public:
+  typedef struct WaitingSerf {
+    unsigned int serf;
+    unsigned int since;
+  } WaitingSerf;
+
+  typedef struct UnservedPath {
+    unsigned int flag;
+    Direction dir;
+    unsigned int since;  // Path built, transporter lost or last called
+  } UnservedPath;
+
+ protected:
+  std::vector<WaitingSerf> waiting_serfs;
+  std::vector<UnservedPath> unserved_paths;
+  // Position + 1 in the lists above by serf index and by flag index * 6 +
+  // direction, 0 if not listed.
+  std::vector<unsigned int> serf_slots;
+  std::vector<unsigned int> path_slots;
+
+ public:
+  void serf_waiting(unsigned int serf, unsigned int tick);
+  void serf_moving(unsigned int serf);
+
+  // Start the wait for a path unless it is already waiting.
+  void path_unserved(unsigned int flag, Direction dir, unsigned int tick);
+  // Restart the wait, a transporter is on its way.
+  void transporter_called(unsigned int flag, Direction dir, unsigned int tick);
+  void path_served(unsigned int flag, Direction dir);
+
+  void clear();
+
+  const std::vector<WaitingSerf> &get_waiting_serfs() const {
+    return waiting_serfs; }
+  const std::vector<UnservedPath> &get_unserved_paths() const {
+    return unserved_paths; }
+};
+
+#endif  // SRC_GAME_WATCHDOG_H_
@@ -41,12 +41,65 @@
 #include "src/map.h"
 #include "src/map-generator.h"
 #include "src/map-geometry.h"
+#include "src/game-snapshot.h"
+#include "src/profiler.h"
 
 #define GROUND_ANALYSIS_RADIUS  25
 
 
+static const Profiler::Section profile_lock_exclusive(
+                                                "lock.game.wait_exclusive");
+static const Profiler::Section profile_lock_shared("lock.game.wait_shared");
+static const Profiler::Section profile_hold_exclusive("hold.game.exclusive");
+static const Profiler::Section profile_hold_shared("hold.game.shared");
+static const Profiler::Section profile_snapshot("game.snapshot");
+static const Profiler::Section profile_update_commands("game.update.commands");
+
+thread_local unsigned int GameLock::held = 0;
+thread_local Trace::Clock::time_point GameLock::hold_start;
+thread_local const LockStats::Site *GameLock::hold_site = nullptr;
+
+// Whether this thread is in Game::update(), and how deep it is in build and
+// demolish calls that are being reported to the command recorder.
+static thread_local bool updating_game = false;
+static thread_local unsigned int applying_direct = 0;
+
+void
+GameLock::lock_slow(const LockStats::Site *site) {
+  Profiler::Clock::time_point start = Profiler::Clock::now();
+  mutex.lock();
+  Profiler::Clock::time_point end = Profiler::Clock::now();
+  Profiler::record(profile_lock_exclusive, start, end);
+  begin_hold(site, LockStats::ns_between(start, end));
+}
+
+void
+GameLock::lock_shared_slow(const LockStats::Site *site) {
+  Profiler::Clock::time_point start = Profiler::Clock::now();
+  mutex.lock_shared();
+  Profiler::Clock::time_point end = Profiler::Clock::now();
+  Profiler::record(profile_lock_shared, start, end);
+  begin_hold(site, LockStats::ns_between(start, end));
+}
+
+void
+GameLock::finish_hold(bool exclusive) {
+  Trace::Clock::time_point end = Trace::Clock::now();
+  Trace::complete(exclusive ? profile_hold_exclusive.get_id() :
+                              profile_hold_shared.get_id(),
+                  hold_start, end);
+  if (hold_site != nullptr) {
+    LockStats::released(*hold_site, LockStats::ns_between(hold_start, end));
+    hold_site = nullptr;
+  }
+  hold_start = Trace::Clock::time_point();
+}
+
 Game::Game()
   : map_gold_morale_factor(0)
+  , owned_serfs(&serfs, GAME_MAX_PLAYER_COUNT)
+  , owned_buildings(&buildings, GAME_MAX_PLAYER_COUNT)
+  , owned_inventories(&inventories, GAME_MAX_PLAYER_COUNT)
   , game_speed_save(0)
   , last_tick(0)
   , field_340(0)
@@ -55,15 +108,20 @@ Game::Game()
   , tutorial_level(0)
   , mission_level(0)
   , map_preserve_bugs(0)
-  , player_score_leader(0) {
+  , player_score_leader(0)
+  , clear_winner(-1)
+  , serf_wake_wheel(serf_wheel_size)
+  , serf_wheel_tick(0)
+  , serf_update_tick(0)
+  , prev_serf_update_tick(0)
+  , serf_update_index(-1)
+  , building_sleep(true)
+  , flag_sleep(true) {
   players = Players(this);
   flags = Flags(this);
   inventories = Inventories(this);
   buildings = Buildings(this);
   serfs = Serfs(this);
-  std::mutex mutex;
-  std::mutex autosave_mutex;
-
   /* Create NULL-serf */
   serfs.allocate();
 
@@ -95,6 +153,8 @@ Game::Game()
   max_next_index = 0;
   game_type = 0;
   flag_search_counter = 0;
+  flag_graph_changes = 1;
+  history_changes = 1;
   game_stats_counter = 0;
   history_counter = 0;
 
@@ -106,6 +166,10 @@ Game::Game()
   ai_locked = true;
   signal_ai_exit = false;
   ai_threads_remaining = 0;
+
+  snapshot_version = 0;
+  snapshot_wanted = false;
+  snapshot_stale = false;
 }
 
 Game::~Game() {
@@ -122,7 +186,7 @@ Game::~Game() {
 void
 Game::clear_serf_request_failure() {
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::clear_serf_request_failure";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has locking mutex inside Game::clear_serf_request_failure";
   for (Building *building : buildings) {
     building->clear_serf_request_failure();
@@ -139,39 +203,76 @@ Game::clear_serf_request_failure() {
 void
 Game::update_knight_morale() {
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex for Game::update_knight_morale";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has locked mutex for Game::update_knight_morale";
+  /* Sum gold collected in inventories and deposited in military buildings,
+     for every player in one pass. */
+  std::vector<unsigned int> gold(players.get_index_limit(), 0);
+  for (Inventory *inventory : inventories) {
+    if (inventory->get_owner() < gold.size()) {
+      gold[inventory->get_owner()] +=
+                          inventory->get_count_of(Resource::TypeGoldBar);
+    }
+  }
+  for (Building *building : buildings) {
+    if (building->get_owner() < gold.size()) {
+      gold[building->get_owner()] += building->military_gold_count();
+    }
+  }
+
   for (Player *player : players) {
-    player->update_knight_morale();
+    player->update_knight_morale(gold[player->get_index()]);
   }
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is unlocking mutex for Game::update_knight_morale";
   mutex.unlock();
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has unlocked mutex for Game::update_knight_morale";
 }
 
-typedef struct UpdateInventoriesData {
-  Resource::Type resource;
-  int *max_prio;
-  Flag **flags;
-} UpdateInventoriesData;
-
 bool
-Game::update_inventories_cb(Flag *flag, void *d) {
-  UpdateInventoriesData *data = reinterpret_cast<UpdateInventoriesData*>(d);
-  int inv = flag->get_search_dir();
-  if (data->max_prio[inv] < 255 && flag->has_building()) {
-    Building *building = flag->get_building();
-
-    int bld_prio = building->get_max_priority_for_resource(data->resource, 16);
-    if (bld_prio > data->max_prio[inv]) {
-      data->max_prio[inv] = bld_prio;
-      data->flags[inv] = flag;
-    }
+Game::inventory_reach_cb(Flag *flag, void *d) {
+  InventoryReach *reach = reinterpret_cast<InventoryReach*>(d);
+  if (flag->has_building()) {
+    reach->flags.push_back(flag->get_index());
+    reach->flag_sources.push_back(flag->get_search_dir());
   }
 
   return false;
 }
 
+const Game::InventoryReach &
+Game::get_inventory_reach(const Player *player, Inventory *const *invs,
+                          int n) {
+  if (inventory_reach.size() <= player->get_index()) {
+    inventory_reach.resize(player->get_index() + 1);
+  }
+  InventoryReach &reach = inventory_reach[player->get_index()];
+
+  bool same = (reach.changes == flag_graph_changes &&
+               reach.sources.size() == static_cast<size_t>(n));
+  for (int i = 0; same && i < n; i++) {
+    same = (reach.sources[i] ==
+            static_cast<unsigned int>(invs[i]->get_flag_index()));
+  }
+  if (same) return reach;
+
+  reach.changes = flag_graph_changes;
+  reach.sources.clear();
+  reach.flags.clear();
+  reach.flag_sources.clear();
+
+  FlagSearch search(this);
+  for (int i = 0; i < n; i++) {
+    reach.sources.push_back(
+        static_cast<unsigned int>(invs[i]->get_flag_index()));
+    Flag *flag = flags[invs[i]->get_flag_index()];
+    flag->set_search_dir((Direction)i);
+    search.add_source(flag);
+  }
+  search.execute(inventory_reach_cb, false, true, &reach);
+
+  return reach;
+}
+
 /* Update inventories as part of the game progression. Moves the appropriate
    resources that are needed outside of the inventory into the out queue. */
 void
@@ -238,7 +339,7 @@ Game::update_inventories() {
       Inventory *invs[256];
       int n = 0;
     Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::update_inventories";
-    mutex.lock();
+    mutex.lock(LOCK_SITE());
     Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has locked mutex inside Game::update_inventories";
       for (Inventory *inventory : inventories) {
         if (inventory->get_owner() == player->get_index() &&
@@ -278,24 +379,29 @@ Game::update_inventories() {
 
       if (n == 0) continue;
 
-      FlagSearch search(this);
-
       int max_prio[256];
       Flag *flags_[256];
 
       for (int i = 0; i < n; i++) {
         max_prio[i] = 0;
         flags_[i] = NULL;
-        Flag *flag = flags[invs[i]->get_flag_index()];
-        flag->set_search_dir((Direction)i);
-        search.add_source(flag);
       }
 
-      UpdateInventoriesData data;
-      data.resource = arr[0];
-      data.max_prio = max_prio;
-      data.flags = flags_;
-      search.execute(update_inventories_cb, false, true, &data);
+      /* Find the building wanting the resource most in the part of the
+         road network nearest to each inventory. */
+      const InventoryReach &reach = get_inventory_reach(player, invs, n);
+      for (size_t j = 0; j < reach.flags.size(); j++) {
+        unsigned int inv = reach.flag_sources[j];
+        if (max_prio[inv] < 255) {
+          Flag *flag = flags[reach.flags[j]];
+          Building *building = flag->get_building();
+          int bld_prio = building->get_max_priority_for_resource(arr[0], 16);
+          if (bld_prio > max_prio[inv]) {
+            max_prio[inv] = bld_prio;
+            flags_[inv] = flag;
+          }
+        }
+      }
 
       for (int i = 0; i < n; i++) {
         if (max_prio[i] > 0) {
@@ -321,40 +427,21 @@ Game::update_inventories() {
 void
 Game::update_flags() {
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex for Game::update_flags";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has locked mutex for Game::update_flags";
-  // still getting vector iterators incompatible here sometimes   oct22 2020
-  // again   oct29 2020
-  // again   dec01 2020
-  // again   dec02 2020
-  // again   dec10 2020
-  /* this is the original function
-  for (Flag *flag : flags) {
-  Log::Verbose["game"] << "calling flag->update for flag with index " << flag->get_index();
-    flag->update();
-  Log::Verbose["game"] << "done flag->update for flag with index " << flag->get_index();
-  }
-  */
-  // trying replacement with p1plp1 way
-  Flags::Iterator i = flags.begin();
-  Flags::Iterator prev = flags.begin();
-  while (i != flags.end()) {
-    prev = i;
-    Flag *flag = *i;
-    if (flag != NULL) {
-      if (flag->get_index() != 0) {
-        flag->update();
-        if (flag == NULL)
-          Log::Debug["game"] << "Game::update_flags, flag is NULL after update";
-      }
-    }
-    if (flag == NULL) {
-      Log::Debug["game"] << "Game::update_flags, flag is NULL so set i=prev";
-      i = prev;
+  /* Sleeping flags are skipped without touching them. */
+  unsigned int limit = flags.get_index_limit();
+  for (unsigned int index = 1; index < limit; index++) {
+    if (index / 64 < sleeping_flags.size() &&
+        (sleeping_flags[index / 64] >> (index % 64) & 1) != 0) {
+      continue;
     }
-    else {
-      if (i != flags.end())
-        ++i;
+    Flag *flag = flags[index];
+    if (flag == nullptr) continue;
+
+    flag->update();
+    if (flag_sleep && flags[index] == flag && flag->can_sleep()) {
+      sleep_flag(flag);
     }
   }
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is unlocking mutex for Game::update_flags";
@@ -477,8 +564,13 @@ Game::send_serf_to_flag(Flag *dest, Serf::Type type, Resource::Type res1,
   data.res2 = res2;
 
   Log::Verbose["game"] << " inside Game::send_serf_to_flag, starting send_serf_to_flag_search";
-  bool r = FlagSearch::single(dest, send_serf_to_flag_search_cb, true, false,
-                              &data);
+  bool r = false;
+  for (unsigned int flag_index : dest->get_inventories_in_reach()) {
+    if (send_serf_to_flag_search_cb(flags[flag_index], &data)) {
+      r = true;
+      break;
+    }
+  }
   Log::Verbose["game"] << " inside Game::send_serf_to_flag, done send_serf_to_flag_search";
 
   if (!r) {
@@ -535,6 +627,7 @@ Game::send_serf_to_flag(Flag *dest, Serf::Type type, Resource::Type res1,
 /* Dispatch geologist to flag. */
 bool
 Game::send_geologist(Flag *dest) {
+  snapshot_stale = true;
   Log::Debug["game"] << " inside Game::send_geologist, calling send_serf_to_flag";
   return send_serf_to_flag(dest, Serf::TypeGeologist, Resource::TypeHammer,
                            Resource::TypeNone);
@@ -544,16 +637,24 @@ Game::send_geologist(Flag *dest) {
 void
 Game::update_buildings() {
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex for Game::update_buildings";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has locked mutex for Game::update_buildings";
-  Buildings blds(buildings);
-  Buildings::Iterator i = blds.begin();
-  while (i != blds.end()) {
-    Building *building = *i;
-    if (building != NULL) {
-      building->update(tick);
+  /* Buildings placed during the sweep wait for the next one. Sleeping
+     buildings are skipped without touching them. */
+  unsigned int limit = buildings.get_index_limit();
+  for (unsigned int index = 1; index < limit; index++) {
+    if (index / 64 < sleeping_buildings.size() &&
+        (sleeping_buildings[index / 64] >> (index % 64) & 1) != 0) {
+      continue;
+    }
+    Building *building = buildings[index];
+    if (building == nullptr) continue;
+
+    building->update(tick);
+    if (building_sleep && buildings[index] == building &&
+        building->can_sleep()) {
+      sleep_building(building);
     }
-    ++i;
   }
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is unlocking mutex for Game::update_buildings";
   mutex.unlock();
@@ -564,42 +665,181 @@ Game::update_buildings() {
 void
 Game::update_serfs() {
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex for Game::update_serfs";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has locked mutex for Game::update_serfs";
-  Serfs::Iterator i = serfs.begin();
-  Serfs::Iterator prev = serfs.begin();
-  while (i != serfs.end()) {
-    prev = i;
-    Serf *serf = *i;
-    if (serf != NULL) {
-      if (serf->get_index() != 0) {
-        //here it crashes? on dead on delete flag building etc
-        serf->update();
-    if (serf == NULL) {
-      Log::Debug["game"] << "Game::update_serfs, serf is NULL after update";
-    }
-    //tlongstretch
-    //else if (serf->get_type() == Serf::TypeDead) {
-    else if (serf->is_marked_for_deletion()) {
+  wake_due_serfs();
+
+  /* Serfs are updated in index order, including serfs created during
+     the sweep. Sleeping serfs are skipped without touching them. Serfs
+     marked for deletion are left in the table until the sweep is done. */
+  prev_serf_update_tick = serf_update_tick;
+  serf_update_tick = tick;
+  for (serf_update_index = 1; serf_update_index < serfs.get_index_limit();
+       serf_update_index++) {
+    unsigned int index = serf_update_index;
+    if (index / 64 < sleeping_serfs.size() &&
+        (sleeping_serfs[index / 64] >> (index % 64) & 1) != 0) {
+      continue;
+    }
+    Serf *serf = serfs[index];
+    if (serf == nullptr) continue;
+
+    serf->update();
+    if (serf->is_marked_for_deletion()) {
       // this is a test fix for https://github.com/tlongstretch/freeserf-with-AI-plus/issues/27
       //  this likely will cause serfs that are still playing their dying animation to disappear!
-      delete_serf(serf);
-    }
-      }
+      dead_serfs.push_back(index);
+      continue;
     }
-    if (serf == NULL) {
-      Log::Debug["game"] << "Game::update_serfs, serf is NULL so set i=prev";
-      i = prev;
-    } else {
-      if (i != serfs.end())
-         ++i;
+
+    unsigned int ticks = 0;
+    if (serf->can_sleep(&ticks)) {
+      sleep_serf(serf, ticks);
     }
   }
+  serf_update_index = -1;
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is unlocking mutex for Game::update_serfs";
   mutex.unlock();
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has unlocked mutex for Game::update_serfs";
 }
 
+/* Delete the serfs the sweep found marked for deletion, once it is done
+   with the serf table. */
+void
+Game::reclaim_dead_serfs() {
+  if (dead_serfs.empty()) return;
+
+  mutex.lock(LOCK_SITE());
+  for (unsigned int index : dead_serfs) {
+    Serf *serf = serfs[index];
+    if (serf != nullptr && serf->is_marked_for_deletion()) {
+      delete_serf(serf);
+    }
+  }
+  dead_serfs.clear();
+  mutex.unlock();
+}
+
+/* Leave serf out of the sweeps, until the given number of ticks from now
+   if that isn't 0. */
+void
+Game::sleep_serf(Serf *serf, unsigned int ticks) {
+  if (ticks >= serf_wheel_size) return;
+
+  unsigned int index = serf->get_index();
+  if (index / 64 >= sleeping_serfs.size()) {
+    sleeping_serfs.resize(index / 64 + 1, 0);
+  }
+  sleeping_serfs[index / 64] |= UINT64_C(1) << (index % 64);
+  serf->start_sleeping();
+  if (ticks != 0) {
+    serf_wake_wheel[(tick + ticks) % serf_wheel_size].push_back(index);
+  }
+}
+
+void
+Game::serf_woken(Serf *serf) {
+  unsigned int index = serf->get_index();
+  sleeping_serfs[index / 64] &= ~(UINT64_C(1) << (index % 64));
+}
+
+/* Wake the serfs whose counters run out by this tick. */
+void
+Game::wake_due_serfs() {
+  unsigned int slots = tick - serf_wheel_tick + 1;
+  if (tick < serf_wheel_tick || slots > serf_wheel_size) {
+    slots = serf_wheel_size;
+  }
+  for (unsigned int i = 0; i < slots; i++) {
+    std::vector<unsigned int> &slot =
+                          serf_wake_wheel[(tick - i) % serf_wheel_size];
+    for (unsigned int index : slot) {
+      Serf *serf = serfs[index];
+      if (serf != nullptr) serf->wake();
+    }
+    slot.clear();
+  }
+  serf_wheel_tick = tick + 1;
+}
+
+/* Wake every serf, for when the whole game state is read. */
+void
+Game::wake_serfs() {
+  for (unsigned int index = 0; index < sleeping_serfs.size() * 64; index++) {
+    if ((sleeping_serfs[index / 64] >> (index % 64) & 1) != 0 &&
+        serfs[index] != nullptr) {
+      serfs[index]->wake();
+    }
+  }
+}
+
+/* Leave building out of the sweeps until it is woken. */
+void
+Game::sleep_building(Building *building) {
+  unsigned int index = building->get_index();
+  if (index / 64 >= sleeping_buildings.size()) {
+    sleeping_buildings.resize(index / 64 + 1, 0);
+  }
+  sleeping_buildings[index / 64] |= UINT64_C(1) << (index % 64);
+  building->start_sleeping();
+}
+
+void
+Game::building_woken(Building *building) {
+  unsigned int index = building->get_index();
+  sleeping_buildings[index / 64] &= ~(UINT64_C(1) << (index % 64));
+}
+
+void
+Game::wake_buildings() {
+  for (unsigned int index = 0; index < sleeping_buildings.size() * 64;
+       index++) {
+    if ((sleeping_buildings[index / 64] >> (index % 64) & 1) != 0 &&
+        buildings[index] != nullptr) {
+      buildings[index]->wake();
+    }
+  }
+}
+
+void
+Game::set_building_sleep(bool sleep) {
+  building_sleep = sleep;
+  if (!sleep) wake_buildings();
+}
+
+/* Leave flag out of the sweeps until it is woken. */
+void
+Game::sleep_flag(Flag *flag) {
+  unsigned int index = flag->get_index();
+  if (index / 64 >= sleeping_flags.size()) {
+    sleeping_flags.resize(index / 64 + 1, 0);
+  }
+  sleeping_flags[index / 64] |= UINT64_C(1) << (index % 64);
+  flag->start_sleeping();
+}
+
+void
+Game::flag_woken(Flag *flag) {
+  unsigned int index = flag->get_index();
+  sleeping_flags[index / 64] &= ~(UINT64_C(1) << (index % 64));
+}
+
+void
+Game::wake_flags() {
+  for (unsigned int index = 0; index < sleeping_flags.size() * 64; index++) {
+    if ((sleeping_flags[index / 64] >> (index % 64) & 1) != 0 &&
+        flags[index] != nullptr) {
+      flags[index]->wake();
+    }
+  }
+}
+
+void
+Game::set_flag_sleep(bool sleep) {
+  flag_sleep = sleep;
+  if (!sleep) wake_flags();
+}
+
 /* Update historical player statistics for one measure. */
 void
 Game::record_player_history(int max_level, int aspect,
@@ -696,7 +936,8 @@ Game::update_game_stats() {
     }
     record_player_history(update_level, 1, player_history_index, values);
     // ToDo (Digger): What is this? BIT(-1)?
-    player_score_leader |= BIT(calculate_clear_winner(values));
+    int land_winner = calculate_clear_winner(values);
+    player_score_leader |= BIT(land_winner);
 
     /* Store building stats in history. */
     for (Player *player : players) {
@@ -709,7 +950,9 @@ Game::update_game_stats() {
       values[player->get_index()] = player->get_military_score();
     }
     record_player_history(update_level, 3, player_history_index, values);
-    player_score_leader |= BIT(calculate_clear_winner(values)) << 4;
+    int military_winner = calculate_clear_winner(values);
+    player_score_leader |= BIT(military_winner) << 4;
+    clear_winner = (land_winner == military_winner) ? land_winner : -1;
 
     /* Store condensed score of all aspects in history. */
     for (Player *player : players) {
@@ -718,6 +961,7 @@ Game::update_game_stats() {
     record_player_history(update_level, 0, player_history_index, values);
 
     /* TODO Determine winner based on game.player_score_leader */
+    history_changes++;
   }
 
   if (static_cast<int>(history_counter) > tick_diff) {
@@ -734,12 +978,48 @@ Game::update_game_stats() {
     }
 
     resource_history_index = index+1 < 120 ? index+1 : 0;
-  }
-}
+    history_changes++;
+  }
+}
+
+// Timed phases of Game::update.
+static const Profiler::Section profile_update_map("game.update.map");
+static const Profiler::Section profile_update_players("game.update.players");
+static const Profiler::Section profile_update_knight_morale(
+                                              "game.update.knight_morale");
+static const Profiler::Section profile_update_inventories(
+                                              "game.update.inventories");
+static const Profiler::Section profile_update_flags("game.update.flags");
+static const Profiler::Section profile_update_buildings(
+                                              "game.update.buildings");
+static const Profiler::Section profile_update_serfs("game.update.serfs");
+static const Profiler::Section profile_update_reclaim("game.update.reclaim");
+static const Profiler::Section profile_update_stats("game.update.stats");
+static const Profiler::Section profile_update_map_changes(
+                                              "game.update.map_changes");
 
 /* Update game state after tick increment. */
 void
 Game::update() {
+  PROFILE_SCOPE("game.update");
+  Profiler::Clock::time_point update_start = Profiler::Clock::now();
+  Profiler::PhaseTimer phases;
+  // Viewports get the map changes of the whole tick at once, at the end.
+  map->hold_changes();
+  updating_game = true;
+  phases.next(profile_update_commands);
+  if (commands.size() > 0) {
+    LOCK_SCOPE(mutex);
+    commands.apply(tick, [this](const GameCommands::Command &command) {
+      return apply_command(command); });
+  }
+  if (update_observer) {
+    LOCK_SCOPE(mutex);
+    update_observer();
+  }
+
+  phases.next(profile_update_map);
+
   /* Increment tick counters */
   const_tick += 1;
 
@@ -747,19 +1027,22 @@ Game::update() {
   last_tick = tick;
   tick += game_speed;
   tick_diff = tick - last_tick;
+  events.set_tick(tick);
 
   clear_serf_request_failure();
   map->update(tick, &init_map_rnd);
 
   /* Update players */
-  // this must be mutex locked because new serfs are born during this step, and allocating new serfs invalidates any other serf iterators
-  //  player->update calls spawn_serf which calls Game::create_serf which calls serfs.allocate()
-  //  the mutex lock is INSIDE player->update, go look there
+  // new serfs are born during this step, player->update calls spawn_serf which
+  //  calls Game::create_serf which calls serfs.allocate(). That changes the
+  //  serf table under the AI threads, so player->update locks the mutex for it
+  phases.next(profile_update_players);
   for (Player *player : players) {
     player->update();
   }
 
   /* Update knight morale */
+  phases.next(profile_update_knight_morale);
   knight_morale_counter -= tick_diff;
   if (knight_morale_counter < 0) {
     update_knight_morale();
@@ -767,6 +1050,7 @@ Game::update() {
   }
 
   /* Schedule resources to go out of inventories */
+  phases.next(profile_update_inventories);
   inventory_schedule_counter -= tick_diff;
   if (inventory_schedule_counter < 0) {
     update_inventories();
@@ -796,10 +1080,197 @@ Game::update() {
   }
 #endif
 
+  phases.next(profile_update_flags);
   update_flags();
+  phases.next(profile_update_buildings);
   update_buildings();
+  phases.next(profile_update_serfs);
   update_serfs();
+  phases.next(profile_update_reclaim);
+  reclaim_dead_serfs();
+  phases.next(profile_update_stats);
   update_game_stats();
+  phases.next(profile_update_map_changes);
+  map->release_changes();
+  phases.stop();
+  Trace::counter("game.serfs", serfs.size());
+  Trace::counter("game.flags", flags.size());
+  tick_watchdog.check_update(this, update_start, Profiler::Clock::now());
+
+  if (snapshot_wanted) {
+    publish_snapshot();
+  }
+  if (autosave.is_requested()) {
+    autosave.take(this);
+  }
+  updating_game = false;
+}
+
+bool
+Game::apply_command(const GameCommands::Command &command) {
+  Player *player = players[command.player];
+  if (player == nullptr) return false;
+
+  switch (command.type) {
+    case GameCommands::TypeBuildRoad:
+      return build_road(command.road, player);
+    case GameCommands::TypeBuildFlag:
+      return build_flag(command.pos, player);
+    case GameCommands::TypeBuildBuilding:
+      return build_building(command.pos, command.building, player);
+    case GameCommands::TypeDemolishRoad:
+      return demolish_road(command.pos, player);
+    case GameCommands::TypeDemolishFlag:
+      return demolish_flag(command.pos, player);
+    case GameCommands::TypeDemolishBuilding:
+      return demolish_building(command.pos, player);
+    case GameCommands::TypeBootSerf: {
+      Serf *serf = serfs[command.index];
+      if (serf == nullptr || serf->get_owner() != player->get_index() ||
+          serf->get_state() != Serf::StateWaitIdleOnPath) {
+        return false;
+      }
+      serf->set_lost_state();
+      return true;
+    }
+    case GameCommands::TypeBuildCastle:
+      return build_castle(command.pos, player);
+    case GameCommands::TypeCallTransporter: {
+      Flag *flag = flags[command.index];
+      if (flag == nullptr || flag->get_owner() != player->get_index() ||
+          !flag->has_path(command.dir)) {
+        return false;
+      }
+      // Water paths are left alone, calling a sailor has been seen to crash.
+      return flag->call_transporter(command.dir, false);
+    }
+    case GameCommands::TypeSendGeologist: {
+      Flag *flag = get_flag_at_pos(command.pos);
+      if (flag == nullptr || flag->get_owner() != player->get_index()) {
+        return false;
+      }
+      return send_geologist(flag);
+    }
+    case GameCommands::TypeAttack: {
+      Building *target = get_building_at_pos(command.pos);
+      if (target == nullptr || target->get_owner() == player->get_index()) {
+        return false;
+      }
+      int knights = player->knights_available_for_attack(command.pos);
+      if (knights <= 0 || command.index == 0) {
+        return false;
+      }
+      player->building_attacked = target->get_index();
+      player->knights_attacking = std::min(knights,
+                                           static_cast<int>(command.index));
+      player->start_attack();
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Build and demolish calls made straight on the game, by the interface or
+   the AI threads, are reported to the command recorder like queued ones, so
+   a recorded game replays them too. The calls the game makes itself while
+   updating, and those made by a reported call, are left out. */
+bool
+Game::records_direct_changes() {
+  return (!updating_game && applying_direct == 0 && commands.is_recording());
+}
+
+bool
+Game::apply_direct(const GameCommands::Command &command) {
+  applying_direct++;
+  bool result = apply_command(command);
+  applying_direct--;
+  commands.record(tick, command, result);
+  return result;
+}
+
+/* Capture the state at the end of this tick for the AI threads. */
+void
+Game::publish_snapshot() {
+  Profiler::ScopedTimer timer(profile_snapshot);
+  std::shared_ptr<GameSnapshot> next = std::move(spare_snapshot);
+  if (!next) {
+    next = std::make_shared<GameSnapshot>();
+  }
+  {
+    LOCK_SCOPE_SHARED(mutex);
+    snapshot_stale = false;
+    next->capture(this, ++snapshot_version);
+  }
+
+  std::shared_ptr<const GameSnapshot> previous =
+                                      std::atomic_load(&snapshot);
+  std::atomic_store(&snapshot, std::shared_ptr<const GameSnapshot>(next));
+  // Nobody can pick up the previous snapshot any more, so if this is the
+  // last reference it is safe to write into it next tick.
+  if (previous.use_count() == 1) {
+    spare_snapshot = std::const_pointer_cast<GameSnapshot>(previous);
+  }
+}
+
+void
+Game::add_memory_usage(MemoryUsage *usage) {
+  LOCK_SCOPE_SHARED(mutex);
+  usage->add("game.players", players.size(), players.get_allocated_bytes());
+  usage->add("game.flags", flags.size(), flags.get_allocated_bytes());
+  usage->add("game.inventories", inventories.size(),
+             inventories.get_allocated_bytes());
+  usage->add("game.buildings", buildings.size(),
+             buildings.get_allocated_bytes());
+  usage->add("game.serfs", serfs.size(), serfs.get_allocated_bytes());
+  usage->add("game.owned", owned_serfs.get_count() +
+             owned_buildings.get_count() + owned_inventories.get_count(),
+             owned_serfs.get_allocated_bytes() +
+             owned_buildings.get_allocated_bytes() +
+             owned_inventories.get_allocated_bytes());
+
+  size_t wheel_entries = 0;
+  size_t wheel_bytes = MemoryUsage::vector_bytes(serf_wake_wheel);
+  for (const std::vector<unsigned int> &slot : serf_wake_wheel) {
+    wheel_entries += slot.size();
+    wheel_bytes += MemoryUsage::vector_bytes(slot);
+  }
+  usage->add("game.sleep", wheel_entries,
+             wheel_bytes + MemoryUsage::vector_bytes(sleeping_serfs) +
+             MemoryUsage::vector_bytes(sleeping_buildings));
+  size_t reach_bytes = MemoryUsage::vector_bytes(inventory_reach);
+  for (const InventoryReach &reach : inventory_reach) {
+    reach_bytes += MemoryUsage::vector_bytes(reach.sources) +
+                   MemoryUsage::vector_bytes(reach.flags) +
+                   MemoryUsage::vector_bytes(reach.flag_sources);
+  }
+  usage->add("game.inventory_reach", inventory_reach.size(), reach_bytes);
+  usage->add("game.influence", influence_sources.size(),
+             MemoryUsage::vector_bytes(influence) +
+             MemoryUsage::vector_bytes(influence_claims) +
+             MemoryUsage::vector_bytes(influence_sources));
+  usage->add("game.buildable", buildable.size(),
+             MemoryUsage::vector_bytes(buildable));
+  usage->add("game.flow_fields", flow_fields.size(),
+             flow_fields.get_allocated_bytes());
+  map->add_memory_usage(usage);
+}
+
+std::shared_ptr<const GameSnapshot>
+Game::get_snapshot() {
+  snapshot_wanted = true;
+  std::shared_ptr<const GameSnapshot> current = std::atomic_load(&snapshot);
+  if (!current || snapshot_stale) {
+    // Nothing published yet, or a player has changed the game since the
+    // last tick. Callers expect to see their own changes, so take a private
+    // copy now rather than wait for the next tick.
+    std::shared_ptr<GameSnapshot> fresh = std::make_shared<GameSnapshot>();
+    {
+      LOCK_SCOPE_SHARED(mutex);
+      fresh->capture(this, current ? current->get_version() : 0);
+    }
+    current = fresh;
+  }
+  return current;
 }
 
 /* Pause or unpause the game. */
@@ -837,37 +1308,25 @@ Game::speed_reset() {
   Log::Info["game"] << "Game speed: " << game_speed;
 }
 
-/* Generate an estimate of the amount of resources in the ground at map pos.*/
-void
-Game::get_resource_estimate(MapPos pos, int weight, int estimates[5]) {
-  if ((map->get_obj(pos) == Map::ObjectNone ||
-       map->get_obj(pos) >= Map::ObjectTree0) &&
-       map->get_res_type(pos) != Map::MineralsNone) {
-    int value = weight * map->get_res_amount(pos);
-    estimates[map->get_res_type(pos)] += value;
-  }
-}
-
 /* Prepare a ground analysis at position. */
 void
 Game::prepare_ground_analysis(MapPos pos, int estimates[5]) {
   for (int i = 0; i < 5; i++) estimates[i] = 0;
 
-  /* Sample the cursor position with maximum weighting. */
-  get_resource_estimate(pos, GROUND_ANALYSIS_RADIUS, estimates);
-
-  /* Move outward in a spiral around the initial pos.
-     The weighting of the samples attenuates linearly
-     with the distance to the center. */
-  for (int i = 0; i < GROUND_ANALYSIS_RADIUS-1; i++) {
-    pos = map->move_right(pos);
-
-    for (Direction d : cycle_directions_cw(DirectionDown)) {
-      for (int j = 0; j < i+1; j++) {
-        get_resource_estimate(pos, GROUND_ANALYSIS_RADIUS-i, estimates);
-        pos = map->move(pos, d);
-      }
+  /* Sample the cursor position and the shells of a spiral around it,
+     weighted by GROUND_ANALYSIS_RADIUS at the centre and in the first
+     shell, attenuating linearly with the distance to 2 in the last shell.
+     Taken as totals over hexagons, a shell at distance d counts once in each
+     hexagon of radius d up to GROUND_ANALYSIS_RADIUS-2, and twice in the
+     hexagon of radius GROUND_ANALYSIS_RADIUS-1. */
+  for (int type = Map::MineralsGold; type <= Map::MineralsStone; type++) {
+    Map::Minerals mineral = static_cast<Map::Minerals>(type);
+    for (int radius = 1; radius < GROUND_ANALYSIS_RADIUS - 1; radius++) {
+      estimates[type] += map->get_minerals_in(pos, radius, mineral);
     }
+    estimates[type] += 2 * map->get_minerals_in(pos,
+                                              GROUND_ANALYSIS_RADIUS - 1,
+                                              mineral);
   }
 
   /* Process the samples. */
@@ -931,7 +1390,7 @@ Game::can_build_road(const Road &road, const Player *player, MapPos *dest,
     return 0;
   }
 
-  Road::Dirs dirs = road.get_dirs();
+  const Road::Dirs &dirs = road.get_dirs();
   Road::Dirs::const_iterator it = dirs.begin();
   for (; it != dirs.end(); ++it) {
     if (!map->is_road_segment_valid(pos, *it)) {
@@ -972,6 +1431,11 @@ Game::can_build_road(const Road &road, const Player *player, MapPos *dest,
 /* Construct a road spefified by a source and a list of directions. */
 bool
 Game::build_road(const Road &road, const Player *player) {
+  if (records_direct_changes()) {
+    return apply_direct({ GameCommands::TypeBuildRoad, player->get_index(),
+                          road.get_source(), Building::TypeNone, road });
+  }
+  snapshot_stale = true;
   if (road.get_length() == 0) return false;
 
   MapPos dest = 0;
@@ -981,7 +1445,7 @@ Game::build_road(const Road &road, const Player *player) {
   }
   if (!map->has_flag(dest)) return false;
 
-  Road::Dirs dirs = road.get_dirs();
+  const Road::Dirs &dirs = road.get_dirs();
   Direction out_dir = dirs.front();
   Direction in_dir = reverse_direction(dirs.back());
 
@@ -994,6 +1458,8 @@ Game::build_road(const Road &road, const Player *player) {
 
   src_flag->link_with_flag(dest_flag, water_path, road.get_length(),
                            in_dir, out_dir);
+  events.publish(GameEvent::TypeRoadBuilt, road.get_source(),
+                 player->get_index(), 0, road.get_length());
 
   return true;
 }
@@ -1113,8 +1579,10 @@ Game::demolish_road_(MapPos pos) {
     path_2_dir = DirectionUp;
   }
 
+  unsigned int owner = map->has_owner(pos) ? map->get_owner(pos) : 0;
   remove_road_forwards(pos, path_1_dir);
   remove_road_forwards(pos, path_2_dir);
+  events.publish(GameEvent::TypeRoadRemoved, pos, owner, 0);
 
   return true;
 }
@@ -1122,6 +1590,11 @@ Game::demolish_road_(MapPos pos) {
 /* Demolish road at position. */
 bool
 Game::demolish_road(MapPos pos, Player *player) {
+  if (records_direct_changes()) {
+    return apply_direct({ GameCommands::TypeDemolishRoad, player->get_index(),
+                          pos, Building::TypeNone, Road() });
+  }
+  snapshot_stale = true;
   if (!can_demolish_road(pos, player)) return false;
 
   return demolish_road_(pos);
@@ -1196,34 +1669,17 @@ Game::can_build_flag(MapPos pos, const Player *player) const {
     return false;
   }
 
-  /* Check that land is clear */
-  if (Map::map_space_from_obj[map->get_obj(pos)] != Map::SpaceOpen) {
-    return false;
-  }
-
-  /* Check whether cursor is in water */
-  if (map->type_up(pos) <= Map::TerrainWater3 &&
-      map->type_down(pos) <= Map::TerrainWater3 &&
-      map->type_down(map->move_left(pos)) <= Map::TerrainWater3 &&
-      map->type_up(map->move_up_left(pos)) <= Map::TerrainWater3 &&
-      map->type_down(map->move_up_left(pos)) <= Map::TerrainWater3 &&
-      map->type_up(map->move_up(pos)) <= Map::TerrainWater3) {
-    return false;
-  }
-
-  /* Check that no flags are nearby */
-  for (Direction d : cycle_directions_cw()) {
-    if (map->get_obj(map->move(pos, d)) == Map::ObjectFlag) {
-      return false;
-    }
-  }
-
-  return true;
+  return (get_buildable(pos) & BuildableFlag) != 0;
 }
 
 /* Build flag at pos. */
 bool
 Game::build_flag(MapPos pos, Player *player) {
+  if (records_direct_changes()) {
+    return apply_direct({ GameCommands::TypeBuildFlag, player->get_index(),
+                          pos, Building::TypeNone, Road() });
+  }
+  snapshot_stale = true;
   if (!can_build_flag(pos, player)) {
     return false;
   }
@@ -1245,19 +1701,7 @@ Game::build_flag(MapPos pos, Player *player) {
 /* Check whether military buildings are allowed at pos. */
 bool
 Game::can_build_military(MapPos pos) const {
-  /* Check that no military buildings are nearby */
-  for (int i = 0; i < 1+6+12; i++) {
-    MapPos p = map->pos_add_spirally(pos, i);
-    if (map->get_obj(p) >= Map::ObjectSmallBuilding &&
-        map->get_obj(p) <= Map::ObjectCastle) {
-      const Building *bld = buildings[map->get_obj_index(p)];
-      if (bld->is_military()) {
-        return false;
-      }
-    }
-  }
-
-  return true;
+  return (get_buildable(pos) & BuildableMilitary) != 0;
 }
 
 /* Return the height that is needed before a large building can be built.
@@ -1308,59 +1752,120 @@ Game::get_leveling_height(MapPos pos) const {
 
 bool
 Game::map_types_within(MapPos pos, Map::Terrain low, Map::Terrain high) const {
-  if ((map->type_up(pos) >= low &&
-       map->type_up(pos) <= high) &&
-      (map->type_down(pos) >= low &&
-       map->type_down(pos) <= high) &&
-      (map->type_down(map->move_left(pos)) >= low &&
-       map->type_down(map->move_left(pos)) <= high) &&
-      (map->type_up(map->move_up_left(pos)) >= low &&
-       map->type_up(map->move_up_left(pos)) <= high) &&
-      (map->type_down(map->move_up_left(pos)) >= low &&
-       map->type_down(map->move_up_left(pos)) <= high) &&
-      (map->type_up(map->move_up(pos)) >= low &&
-       map->type_up(map->move_up(pos)) <= high)) {
-    return true;
-  }
-
-  return false;
+  return map->types_within(pos, low, high);
 }
 
 /* Checks whether a small building is possible at position.*/
 bool
 Game::can_build_small(MapPos pos) const {
-  return map_types_within(pos, Map::TerrainGrass0, Map::TerrainGrass3);
+  return (get_buildable(pos) & BuildableSmall) != 0;
 }
 
 /* Checks whether a mine is possible at position. */
 bool
 Game::can_build_mine(MapPos pos) const {
-  bool can_build = false;
-
-  Map::Terrain types[] = {
-    map->type_down(pos),
-    map->type_up(pos),
-    map->type_down(map->move_left(pos)),
-    map->type_up(map->move_up_left(pos)),
-    map->type_down(map->move_up_left(pos)),
-    map->type_up(map->move_up(pos))
-  };
+  return (get_buildable(pos) & BuildableMine) != 0;
+}
 
-  for (int i = 0; i < 6; i++) {
-    if (types[i] >= Map::TerrainTundra0 && types[i] <= Map::TerrainSnow0) {
-      can_build = true;
-    } else if (!(types[i] >= Map::TerrainGrass0 &&
-                 types[i] <= Map::TerrainGrass3)) {
-      return false;
+/* Checks whether a large building is possible at position. */
+bool
+Game::can_build_large(MapPos pos) const {
+  return (get_buildable(pos) & BuildableLarge) != 0;
+}
+
+void
+Game::reset_buildable() {
+  buildable = std::vector<std::atomic<uint64_t>>(map->geom().tile_count());
+}
+
+/* Return the Buildable bits of pos. They only depend on the tiles within
+   three of pos, so they are cached with the change count of the map there
+   and only worked out again once it moved on. Several threads may do that
+   for the same tile at once; they come up with the same bits. */
+unsigned int
+Game::get_buildable(MapPos pos) const {
+  if (buildable.size() != map->geom().tile_count()) {
+    return compute_buildable(pos);
+  }
+
+  uint64_t changes = map->get_changes_near(pos);
+  uint64_t entry = buildable[pos].load(std::memory_order_relaxed);
+  if ((entry & BuildableKnown) != 0 && (entry >> 32) == changes) {
+    return static_cast<unsigned int>(entry & 0xff);
+  }
+
+  unsigned int bits = compute_buildable(pos);
+  buildable[pos].store((changes << 32) | bits, std::memory_order_relaxed);
+  return bits;
+}
+
+/* Work out the Buildable bits of pos from the map. */
+unsigned int
+Game::compute_buildable(MapPos pos) const {
+  unsigned int bits = BuildableKnown;
+  bool clear = (Map::map_space_from_obj[map->get_obj(pos)] == Map::SpaceOpen);
+  bool in_water = map->is_in_water(pos);
+
+  if (clear && !in_water) {
+    bits |= BuildableFlag;
+    for (Direction d : cycle_directions_cw()) {
+      if (map->get_obj(map->move(pos, d)) == Map::ObjectFlag) {
+        bits &= ~BuildableFlag;
+        break;
+      }
     }
   }
 
-  return can_build;
+  if (map_types_within(pos, Map::TerrainGrass0, Map::TerrainGrass3)) {
+    bits |= BuildableSmall;
+  }
+
+  /* Mines need at least one mountain triangle, the rest may be grass. */
+  unsigned int terrain = map->terrain_around(pos);
+  unsigned int mountain = Map::terrain_bits(Map::TerrainTundra0,
+                                            Map::TerrainSnow0);
+  unsigned int grass = Map::terrain_bits(Map::TerrainGrass0,
+                                         Map::TerrainGrass3);
+  bool mine = ((terrain & mountain) != 0 &&
+               (terrain & ~(mountain | grass)) == 0);
+  if (mine) bits |= BuildableMine;
+
+  /* Check that no military buildings are nearby */
+  bits |= BuildableMilitary;
+  for (int i = 0; i < 1+6+12; i++) {
+    MapPos p = map->pos_add_spirally(pos, i);
+    if (map->get_obj(p) >= Map::ObjectSmallBuilding &&
+        map->get_obj(p) <= Map::ObjectCastle) {
+      const Building *bld = buildings[map->get_obj_index(p)];
+      if (bld->is_military()) {
+        bits &= ~BuildableMilitary;
+        break;
+      }
+    }
+  }
+
+  if (is_large_site(pos)) {
+    bits |= BuildableLarge;
+
+    /* A castle also needs the land clear at position and at its flag. */
+    MapPos flag_pos = map->move_down_right(pos);
+    if (clear && map->paths(pos) == 0 &&
+        Map::map_space_from_obj[map->get_obj(flag_pos)] == Map::SpaceOpen &&
+        map->paths(flag_pos) == 0) {
+      bits |= BuildableCastle;
+    }
+  }
+
+  if (!in_water && map->paths(pos) == 0) {
+    bits |= BuildablePlayerSite;
+  }
+
+  return bits;
 }
 
 /* Checks whether a large building is possible at position. */
 bool
-Game::can_build_large(MapPos pos) const {
+Game::is_large_site(MapPos pos) const {
   /* Check that surroundings are passable by serfs. */
   for (int i = 0; i < 6; i++) {
     MapPos p = map->pos_add_spirally(pos, 1+i);
@@ -1378,12 +1883,7 @@ Game::can_build_large(MapPos pos) const {
   }
 
   /* Check if center hexagon is not type grass. */
-  if (map->type_up(pos) != Map::TerrainGrass1 ||
-      map->type_down(pos) != Map::TerrainGrass1 ||
-      map->type_down(map->move_left(pos)) != Map::TerrainGrass1 ||
-      map->type_up(map->move_up_left(pos)) != Map::TerrainGrass1 ||
-      map->type_down(map->move_up_left(pos)) != Map::TerrainGrass1 ||
-      map->type_up(map->move_up(pos)) != Map::TerrainGrass1) {
+  if (!map->types_within(pos, Map::TerrainGrass1, Map::TerrainGrass1)) {
     return false;
   }
 
@@ -1405,23 +1905,7 @@ Game::can_build_castle(MapPos pos, const Player *player) const {
     if (map->has_owner(p)) return false;
   }
 
-  /* Check that land is clear at position */
-  if (Map::map_space_from_obj[map->get_obj(pos)] != Map::SpaceOpen ||
-      map->paths(pos) != 0) {
-    return false;
-  }
-
-  MapPos flag_pos = map->move_down_right(pos);
-
-  /* Check that land is clear at position */
-  if (Map::map_space_from_obj[map->get_obj(flag_pos)] != Map::SpaceOpen ||
-      map->paths(flag_pos) != 0) {
-    return false;
-  }
-
-  if (!can_build_large(pos)) return false;
-
-  return true;
+  return (get_buildable(pos) & BuildableCastle) != 0;
 }
 
 /* Check whether player is allowed to build anything
@@ -1444,20 +1928,8 @@ Game::can_player_build(MapPos pos, const Player *player) const {
     }
   }
 
-  /* Check whether cursor is in water */
-  if (map->type_up(pos) <= Map::TerrainWater3 &&
-      map->type_down(pos) <= Map::TerrainWater3 &&
-      map->type_down(map->move_left(pos)) <= Map::TerrainWater3 &&
-      map->type_up(map->move_up_left(pos)) <= Map::TerrainWater3 &&
-      map->type_down(map->move_up_left(pos)) <= Map::TerrainWater3 &&
-      map->type_up(map->move_up(pos)) <= Map::TerrainWater3) {
-    return false;
-  }
-
-  /* Check that no paths are blocking. */
-  if (map->paths(pos) != 0) return false;
-
-  return true;
+  /* Check that position is not in water and no paths are blocking. */
+  return (get_buildable(pos) & BuildablePlayerSite) != 0;
 }
 
 /* Checks whether a building of the specified type is possible at
@@ -1529,6 +2001,11 @@ Game::can_build_building(MapPos pos, Building::Type type,
 /* Build building at position. */
 bool
 Game::build_building(MapPos pos, Building::Type type, Player *player) {
+  if (records_direct_changes()) {
+    return apply_direct({ GameCommands::TypeBuildBuilding,
+                          player->get_index(), pos, type, Road() });
+  }
+  snapshot_stale = true;
   if (!can_build_building(pos, type, player)) {
     return false;
   }
@@ -1556,6 +2033,7 @@ Game::build_building(MapPos pos, Building::Type type, Player *player) {
   bld->set_position(pos);
   Map::Object map_obj = bld->start_building(type);
   player->building_founded(bld);
+  publish_building_event(bld, GameEvent::BuildingFounded);
 
   bool split_path = false;
   if (map->get_obj(map->move_down_right(pos)) != Map::ObjectFlag) {
@@ -1591,6 +2069,11 @@ Game::build_building(MapPos pos, Building::Type type, Player *player) {
 /* Build castle at position. */
 bool
 Game::build_castle(MapPos pos, Player *player) {
+  if (records_direct_changes()) {
+    return apply_direct({ GameCommands::TypeBuildCastle, player->get_index(),
+                          pos, Building::TypeNone, Road() });
+  }
+  snapshot_stale = true;
   if (!can_build_castle(pos, player)) {
     return false;
   }
@@ -1629,6 +2112,7 @@ Game::build_castle(MapPos pos, Player *player) {
   flag->set_position(map->move_down_right(pos));
   castle->set_owner(player->get_index());
   castle->start_building(Building::TypeCastle);
+  publish_building_event(castle, GameEvent::BuildingFounded);
 
   flag->set_owner(player->get_index());
   flag->set_accepts_serfs(true);
@@ -1644,15 +2128,15 @@ Game::build_castle(MapPos pos, Player *player) {
                   flag->get_index());
   map->add_path(map->move_down_right(pos), DirectionUpLeft);
 
-  /* Level land in hexagon below castle */
+  /* Level land in hexagon below castle. The AI places castles from its
+     own thread, so the viewports hear of it with the next game update,
+     see https://github.com/tlongstretch/freeserf-with-AI-plus/issues/38 */
   int h = get_leveling_height(pos);
-  // tlongstretch - hack to work around crash on castle placement issue: https://github.com/tlongstretch/freeserf-with-AI-plus/issues/38
-  //map->set_height(pos, h);
-  map->set_height_no_refresh(pos, h);
+  std::vector<MapPos> hexagon = { pos };
   for (Direction d : cycle_directions_cw()) {
-    //map->set_height(map->move(pos, d), h);
-  map->set_height_no_refresh(map->move(pos, d), h);
+    hexagon.push_back(map->move(pos, d));
   }
+  map->set_heights(hexagon, h);
 
   update_land_ownership(pos);
 
@@ -1733,7 +2217,12 @@ Game::demolish_flag_(MapPos pos) {
   /* Remove resources from flag. */
   flag->remove_all_resources();
 
+  for (Direction d : cycle_directions_cw()) {
+    watchdog.path_served(flag->get_index(), d);
+  }
+  if (flag->is_sleeping()) flag_woken(flag);
   flags.erase(flag->get_index());
+  count_flag_graph_change();
 
   return true;
 }
@@ -1741,6 +2230,11 @@ Game::demolish_flag_(MapPos pos) {
 /* Demolish flag at pos. */
 bool
 Game::demolish_flag(MapPos pos, Player *player) {
+  if (records_direct_changes()) {
+    return apply_direct({ GameCommands::TypeDemolishFlag, player->get_index(),
+                          pos, Building::TypeNone, Road() });
+  }
+  snapshot_stale = true;
   if (!can_demolish_flag(pos, player)) return false;
 
   return demolish_flag_(pos);
@@ -1774,6 +2268,12 @@ Game::demolish_building_(MapPos pos) {
 /* Demolish building at pos. */
 bool
 Game::demolish_building(MapPos pos, Player *player) {
+  if (records_direct_changes()) {
+    return apply_direct({ GameCommands::TypeDemolishBuilding,
+                          player->get_index(), pos, Building::TypeNone,
+                          Road() });
+  }
+  snapshot_stale = true;
   Building *building = buildings[map->get_obj_index(pos)];
 
   if (building->get_owner() != player->get_index()) return false;
@@ -1822,7 +2322,7 @@ Game::surrender_land(MapPos pos) {
 void
 Game::init_land_ownership() {
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::init_land_ownership";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::init_land_ownership";
   for (Building *building : buildings) {
     if (building->is_military()) {
@@ -1835,119 +2335,152 @@ Game::init_land_ownership() {
 }
 
 /* Update land ownership around map position. */
+namespace {
+
+const int influence_radius = 8;
+const int influence_diameter = 1 + 2*influence_radius;
+
+/* Influence by closeness, -1 claims the tile outright. */
+const int military_influence[] = {
+  0, 1, 2, 4, 7, 12, 18, 29, -1, -1,  /* hut */
+  0, 3, 5, 8, 11, 15, 22, 30, -1, -1,  /* tower */
+  0, 6, 10, 14, 19, 23, 27, 31, -1, -1  /* fortress */
+};
+
+/* Closeness of each tile in the 17*17 square around a building. */
+const int map_closeness[] = {
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+  1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0,
+  1, 2, 3, 3, 3, 3, 3, 3, 3, 2, 1, 0, 0, 0, 0, 0, 0,
+  1, 2, 3, 4, 4, 4, 4, 4, 4, 3, 2, 1, 0, 0, 0, 0, 0,
+  1, 2, 3, 4, 5, 5, 5, 5, 5, 4, 3, 2, 1, 0, 0, 0, 0,
+  1, 2, 3, 4, 5, 6, 6, 6, 6, 5, 4, 3, 2, 1, 0, 0, 0,
+  1, 2, 3, 4, 5, 6, 7, 7, 7, 6, 5, 4, 3, 2, 1, 0, 0,
+  1, 2, 3, 4, 5, 6, 7, 8, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+  1, 2, 3, 4, 5, 6, 7, 8, 9, 8, 7, 6, 5, 4, 3, 2, 1,
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 7, 6, 5, 4, 3, 2, 1,
+  0, 0, 1, 2, 3, 4, 5, 6, 7, 7, 7, 6, 5, 4, 3, 2, 1,
+  0, 0, 0, 1, 2, 3, 4, 5, 6, 6, 6, 6, 5, 4, 3, 2, 1,
+  0, 0, 0, 0, 1, 2, 3, 4, 5, 5, 5, 5, 5, 4, 3, 2, 1,
+  0, 0, 0, 0, 0, 1, 2, 3, 4, 4, 4, 4, 4, 4, 3, 2, 1,
+  0, 0, 0, 0, 0, 0, 1, 2, 3, 3, 3, 3, 3, 3, 3, 2, 1,
+  0, 0, 0, 0, 0, 0, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1,
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+
+}  // namespace
+
+void
+Game::reset_land_influence() {
+  size_t tiles = map->geom().tile_count();
+  influence.assign(tiles * max_influence_players, 0);
+  influence_claims.assign(tiles * max_influence_players, 0);
+  influence_sources.assign(tiles, 0);
+}
+
+/* Influence the building at pos should have: 0 for none, otherwise
+   1 + military type + 3 * owner. */
+unsigned int
+Game::get_influence_source(MapPos pos) {
+  if (map->get_obj(pos) < Map::ObjectSmallBuilding ||
+      map->get_obj(pos) > Map::ObjectCastle ||
+      !map->has_path(pos, DirectionDownRight)) {  // TODO(_): Why wouldn't this be set?
+    return 0;
+  }
+
+  Building *building = get_building_at_pos(pos);
+  int mil_type = -1;
+  if (building->get_type() == Building::TypeCastle) {
+    /* Castle has military influence even when not done. */
+    mil_type = 2;
+  } else if (building->is_done() && building->is_active()) {
+    switch (building->get_type()) {
+      case Building::TypeHut: mil_type = 0; break;
+      case Building::TypeTower: mil_type = 1; break;
+      case Building::TypeFortress: mil_type = 2; break;
+      default: break;
+    }
+  }
+
+  if (mil_type < 0 || building->is_burning() ||
+      building->get_owner() >= max_influence_players) {
+    return 0;
+  }
+  return 1 + mil_type + 3 * building->get_owner();
+}
+
+/* Add (sign 1) or remove (sign -1) the influence of a building. */
+void
+Game::apply_influence(MapPos pos, unsigned int source, int sign) {
+  if (source == 0) return;
+  const int *influence_by_closeness = military_influence + 10*((source-1) % 3);
+  size_t offset = ((source-1) / 3) * map->geom().tile_count();
+  uint16_t *sum = &influence[offset];
+  uint8_t *claims = &influence_claims[offset];
+
+  const int *closeness = map_closeness;
+  for (int i = -influence_radius; i <= influence_radius; i++) {
+    for (int j = -influence_radius; j <= influence_radius; j++) {
+      int inf = influence_by_closeness[*closeness++];
+      MapPos tile = map->pos_add(pos, j, i);
+      if (inf < 0) {
+        claims[tile] += sign;
+      } else {
+        sum[tile] += sign * inf;
+      }
+    }
+  }
+}
+
+/* Recalculate land ownership around init_pos after a military building
+   there changed. Every player's influence on every tile is kept summed
+   up, so only buildings whose influence differs from what was last
+   applied are added or removed, instead of adding up all buildings in
+   range again. */
 void
 Game::update_land_ownership(MapPos init_pos) {
-  /* Currently the below algorithm will only work when
-     both influence_radius and calculate_radius are 8. */
-  const int influence_radius = 8;
-  const int influence_diameter = 1 + 2*influence_radius;
-
-  int calculate_radius = influence_radius;
-  int calculate_diameter = 1 + 2*calculate_radius;
-
-  size_t temp_arr_size = calculate_diameter * calculate_diameter *
-                         players.size();
-  std::unique_ptr<int[]> temp_arr =
-    std::unique_ptr<int[]>(new int[temp_arr_size]());
-
-  const int military_influence[] = {
-    0, 1, 2, 4, 7, 12, 18, 29, -1, -1,  /* hut */
-    0, 3, 5, 8, 11, 15, 22, 30, -1, -1,  /* tower */
-    0, 6, 10, 14, 19, 23, 27, 31, -1, -1  /* fortress */
-  };
+  const int calculate_radius = influence_radius;
 
-  const int map_closeness[] = {
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
-    1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0,
-    1, 2, 3, 3, 3, 3, 3, 3, 3, 2, 1, 0, 0, 0, 0, 0, 0,
-    1, 2, 3, 4, 4, 4, 4, 4, 4, 3, 2, 1, 0, 0, 0, 0, 0,
-    1, 2, 3, 4, 5, 5, 5, 5, 5, 4, 3, 2, 1, 0, 0, 0, 0,
-    1, 2, 3, 4, 5, 6, 6, 6, 6, 5, 4, 3, 2, 1, 0, 0, 0,
-    1, 2, 3, 4, 5, 6, 7, 7, 7, 6, 5, 4, 3, 2, 1, 0, 0,
-    1, 2, 3, 4, 5, 6, 7, 8, 8, 7, 6, 5, 4, 3, 2, 1, 0,
-    1, 2, 3, 4, 5, 6, 7, 8, 9, 8, 7, 6, 5, 4, 3, 2, 1,
-    0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 7, 6, 5, 4, 3, 2, 1,
-    0, 0, 1, 2, 3, 4, 5, 6, 7, 7, 7, 6, 5, 4, 3, 2, 1,
-    0, 0, 0, 1, 2, 3, 4, 5, 6, 6, 6, 6, 5, 4, 3, 2, 1,
-    0, 0, 0, 0, 1, 2, 3, 4, 5, 5, 5, 5, 5, 4, 3, 2, 1,
-    0, 0, 0, 0, 0, 1, 2, 3, 4, 4, 4, 4, 4, 4, 3, 2, 1,
-    0, 0, 0, 0, 0, 0, 1, 2, 3, 3, 3, 3, 3, 3, 3, 2, 1,
-    0, 0, 0, 0, 0, 0, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1,
-    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1
-  };
+  if (influence_sources.size() != map->geom().tile_count()) {
+    reset_land_influence();
+  }
 
-  /* Find influence from buildings in 33*33 square
-     around the center. */
+  /* Buildings in the 33*33 square around the center can influence the
+     17*17 square that is updated. Bring their influence up to date. */
   for (int i = -(influence_radius+calculate_radius);
        i <= influence_radius+calculate_radius; i++) {
     for (int j = -(influence_radius+calculate_radius);
          j <= influence_radius+calculate_radius; j++) {
       MapPos pos = map->pos_add(init_pos, j, i);
-
-      if (map->get_obj(pos) >= Map::ObjectSmallBuilding &&
-          map->get_obj(pos) <= Map::ObjectCastle &&
-          map->has_path(pos,
-                   DirectionDownRight)) {  // TODO(_): Why wouldn't this be set?
-        Building *building = get_building_at_pos(pos);
-        int mil_type = -1;
-
-        if (building->get_type() == Building::TypeCastle) {
-          /* Castle has military influence even when not done. */
-          mil_type = 2;
-        } else if (building->is_done() && building->is_active()) {
-          switch (building->get_type()) {
-            case Building::TypeHut: mil_type = 0; break;
-            case Building::TypeTower: mil_type = 1; break;
-            case Building::TypeFortress: mil_type = 2; break;
-            default: break;
-          }
-        }
-
-        if (mil_type >= 0 && !building->is_burning()) {
-          const int *influence = military_influence + 10*mil_type;
-          const int *closeness = map_closeness +
-                                 influence_diameter*std::max(-i, 0) +
-                                 std::max(-j, 0);
-          int *arr = temp_arr.get() +
-            (building->get_owner() * calculate_diameter*calculate_diameter) +
-            calculate_diameter * std::max(i, 0) + std::max(j, 0);
-
-          for (int k = 0; k < influence_diameter - abs(i); k++) {
-            for (int l = 0; l < influence_diameter - abs(j); l++) {
-              int inf = influence[*closeness];
-              if (inf < 0) {
-                *arr = 128;
-              } else if (*arr < 128) {
-                *arr = std::min(*arr + inf, 127);
-              }
-
-              closeness += 1;
-              arr += 1;
-            }
-            closeness += abs(j);
-            arr += abs(j);
-          }
-        }
+      unsigned int source = get_influence_source(pos);
+      if (source != influence_sources[pos]) {
+        apply_influence(pos, influence_sources[pos], -1);
+        apply_influence(pos, source, 1);
+        influence_sources[pos] = source;
       }
     }
   }
 
-  /* Update owner of 17*17 square. */
+  /* Update owner of 17*17 square. A claimed tile counts as 128, other
+     influence is capped at 127. */
+  size_t tiles = map->geom().tile_count();
   for (int i = -calculate_radius; i <= calculate_radius; i++) {
     for (int j = -calculate_radius; j <= calculate_radius; j++) {
+      MapPos pos = map->pos_add(init_pos, j, i);
+
       int max_val = 0;
       int player_index = -1;
       for (Player *player : players) {
-        const int *arr = temp_arr.get() +
-          player->get_index()*calculate_diameter*calculate_diameter +
-          calculate_diameter*(i+calculate_radius) + (j+calculate_radius);
-        if (*arr > max_val) {
-          max_val = *arr;
+        if (player->get_index() >= max_influence_players) continue;
+        size_t index = player->get_index() * tiles + pos;
+        int val = (influence_claims[index] > 0) ? 128 :
+                    std::min(static_cast<int>(influence[index]), 127);
+        if (val > max_val) {
+          max_val = val;
           player_index = player->get_index();
         }
       }
 
-      MapPos pos = map->pos_add(init_pos, j, i);
       int old_player = -1;
       if (map->has_owner(pos)) old_player = map->get_owner(pos);
 
@@ -2077,7 +2610,7 @@ Game::set_inventory_resource_mode(Inventory *inventory, int mode) {
        for this inventory. */
     int dest = flag->get_index();
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::set_inventory_resource_mode";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::set_inventory_resource_mode";
     for (Serf *serf : serfs) {
       serf->clear_destination2(dest);
@@ -2109,7 +2642,7 @@ Game::set_inventory_serf_mode(Inventory *inventory, int mode) {
     /* Clear destination of serfs destined for this inventory. */
     int dest = flag->get_index();
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::set_inventory_serf_mode";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::set_inventory_serf_mode";
     for (Serf *serf : serfs) {
       serf->clear_destination(dest);
@@ -2141,14 +2674,28 @@ Game::add_player(unsigned int intelligence, unsigned int supplies,
 }
 
 bool
-Game::init(unsigned int map_size, const Random &random) {
+Game::init(unsigned int map_size, const Random &random,
+           const std::vector<Map::LandscapeTile> *landscape) {
   init_map_rnd = random;
+  map_seed = random;
+  // Not left to the default, which is seeded from the clock, so that a game
+  //  only depends on its seed
+  rnd = random.split(Random::StreamGame);
 
   map.reset(new Map(MapGeometry(map_size)));
-  ClassicMissionMapGenerator generator(*map, init_map_rnd);
-  generator.init();
-  generator.generate();
-  map->init_tiles(generator);
+  map->set_events(&events);
+  serf_index.init(map->geom());
+  reset_land_influence();
+  reset_buildable();
+  flow_fields.clear();
+  if (landscape != nullptr) {
+    map->init_tiles(*landscape);
+  } else {
+    ClassicMissionMapGenerator generator(*map, init_map_rnd);
+    generator.init();
+    generator.generate();
+    map->init_tiles(generator);
+  }
   gold_total = map->get_gold_deposit();
 
   return true;
@@ -2209,6 +2756,15 @@ Game::create_serf(int index) {
 
 void
 Game::delete_serf(Serf *serf) {
+  if (serf->is_sleeping()) serf_woken(serf);
+  if (serf->get_state() == Serf::StateIdleInStock) {
+    Player *player = players[serf->get_owner()];
+    if (player != nullptr) player->count_idle_serf(serf->get_type(), -1);
+  }
+  serf->leave_idle_roster();
+  serf_index.remove(serf);
+  watchdog.serf_moving(serf->get_index());
+  owned_serfs.remove(serf->get_index(), serf->get_owner());
   serfs.erase(serf->get_index());
 }
 
@@ -2232,6 +2788,7 @@ Game::create_inventory(int index) {
 
 void
 Game::delete_inventory(Inventory *inventory) {
+  owned_inventories.remove(inventory->get_index(), inventory->get_owner());
   inventories.erase(inventory->get_index());
 }
 
@@ -2247,18 +2804,32 @@ Game::create_building(int index) {
 void
 Game::delete_building(Building *building) {
   Log::Debug["game"] << " inside Game::delete_building";
+  publish_building_event(building, GameEvent::BuildingRemoved);
   map->set_object(building->get_position(), Map::ObjectNone, 0);
+  if (building->is_sleeping()) building_woken(building);
+  owned_buildings.remove(building->get_index(), building->get_owner());
   buildings.erase(building->get_index());
   Log::Debug["game"] << "done Game::delete_building";
 }
 
+void
+Game::publish_building_event(const Building *building,
+                             GameEvent::BuildingState state) {
+  events.publish(GameEvent::TypeBuildingChanged, building->get_position(),
+                 building->get_owner(), building->get_index(), state);
+}
+
+void
+Game::publish_serf_event(const Serf *serf, Serf::State state) {
+  events.publish(GameEvent::TypeSerfChanged, serf->get_pos(),
+                 serf->get_owner(), serf->get_index(), state);
+}
+
 Game::ListSerfs
 Game::get_player_serfs(Player *player) {
   ListSerfs player_serfs;
-  for (Serf *serf : serfs) {
-    if (serf->get_owner() == player->get_index()) {
-      player_serfs.push_back(serf);
-    }
+  for (Serf *serf : get_owned_serfs(player)) {
+    player_serfs.push_back(serf);
   }
   return player_serfs;
 }
@@ -2266,10 +2837,8 @@ Game::get_player_serfs(Player *player) {
 Game::ListBuildings
 Game::get_player_buildings(Player *player) {
   ListBuildings player_buildings;
-  for (Building *building : buildings) {
-    if (building->get_owner() == player->get_index()) {
-      player_buildings.push_back(building);
-    }
+  for (Building *building : get_owned_buildings(player)) {
+    player_buildings.push_back(building);
   }
   return player_buildings;
 }
@@ -2277,35 +2846,193 @@ Game::get_player_buildings(Player *player) {
 Game::ListInventories
 Game::get_player_inventories(Player *player) {
   ListInventories player_inventories;
+  for (Inventory *inventory : get_owned_inventories(player)) {
+    player_inventories.push_back(inventory);
+  }
+  return player_inventories;
+}
+
+// The objects are copied slot for slot, so they keep their indexes, and the
+// pointers between them are moved over to the copies by index. What is only
+// a cache of the game is left to fill again.
+std::shared_ptr<Game>
+Game::fork() {
+  std::shared_ptr<Game> game = std::make_shared<Game>();
+
+  game->map = std::make_shared<Map>(*map);
+  game->map->set_events(&game->events);
+  game->events.set_tick(tick);
+  game->map_gold_morale_factor = map_gold_morale_factor;
+  game->gold_total = gold_total;
+
+  game->players.fork(players);
+  game->flags.fork(flags);
+  game->inventories.fork(inventories);
+  game->buildings.fork(buildings);
+  game->serfs.fork(serfs);
+  for (Flag *flag : game->flags) {
+    flag->fork_endpoints();
+  }
+  for (Building *building : game->buildings) {
+    Inventory *inventory = building->get_inventory();
+    if (inventory != nullptr) {
+      building->set_inventory(game->inventories[inventory->get_index()]);
+    }
+  }
+  game->serf_index.fork(serf_index, game.get());
+  game->rebuild_owned_objects();
+
+  game->init_map_rnd = init_map_rnd;
+  game->map_seed = map_seed;
+  game->game_speed_save = game_speed_save;
+  game->game_speed = game_speed;
+  game->tick = tick;
+  game->last_tick = last_tick;
+  game->const_tick = const_tick;
+  game->game_stats_counter = game_stats_counter;
+  game->history_counter = history_counter;
+  game->rnd = rnd;
+  game->next_index = next_index;
+  game->flag_search_counter = flag_search_counter;
+  game->flag_graph_changes = flag_graph_changes;
+  game->history_changes = history_changes;
+  game->inventory_reach = inventory_reach;
+
+  game->update_map_last_tick = update_map_last_tick;
+  game->update_map_counter = update_map_counter;
+  game->update_map_initial_pos = update_map_initial_pos;
+  game->tick_diff = tick_diff;
+  game->max_next_index = max_next_index;
+  game->update_map_16_loop = update_map_16_loop;
+  std::copy(std::begin(player_history_index), std::end(player_history_index),
+            std::begin(game->player_history_index));
+  std::copy(std::begin(player_history_counter),
+            std::end(player_history_counter),
+            std::begin(game->player_history_counter));
+  game->resource_history_index = resource_history_index;
+  game->field_340 = field_340;
+  game->field_342 = field_342;
+  if (field_344 != nullptr) {
+    game->field_344 = game->inventories[field_344->get_index()];
+  }
+  game->game_type = game_type;
+  game->tutorial_level = tutorial_level;
+  game->mission_level = mission_level;
+  game->map_preserve_bugs = map_preserve_bugs;
+  game->player_score_leader = player_score_leader;
+  game->clear_winner = clear_winner;
+  game->knight_morale_counter = knight_morale_counter;
+  game->inventory_schedule_counter = inventory_schedule_counter;
+
+  game->sleeping_serfs = sleeping_serfs;
+  game->serf_wake_wheel = serf_wake_wheel;
+  game->serf_wheel_tick = serf_wheel_tick;
+  game->serf_update_tick = serf_update_tick;
+  game->prev_serf_update_tick = prev_serf_update_tick;
+  game->serf_update_index = serf_update_index;
+  game->dead_serfs = dead_serfs;
+  game->sleeping_buildings = sleeping_buildings;
+  game->building_sleep = building_sleep;
+  game->sleeping_flags = sleeping_flags;
+  game->flag_sleep = flag_sleep;
+
+  game->influence = influence;
+  game->influence_claims = influence_claims;
+  game->influence_sources = influence_sources;
+  game->reset_buildable();
+  game->watchdog = watchdog;
+
+  game->ai_locked = ai_locked;
+
+  return game;
+}
+
+// The NULL serf and building at index 0 are nobody's.
+void
+Game::rebuild_owned_objects() {
+  owned_serfs.clear();
+  owned_buildings.clear();
+  owned_inventories.clear();
+  for (Serf *serf : serfs) {
+    if (serf->get_index() != 0) {
+      owned_serfs.add(serf->get_index(), serf->get_owner());
+    }
+  }
+  for (Building *building : buildings) {
+    if (building->get_index() != 0) {
+      owned_buildings.add(building->get_index(), building->get_owner());
+    }
+  }
+  for (Inventory *inventory : inventories) {
+    owned_inventories.add(inventory->get_index(), inventory->get_owner());
+  }
+}
+
+void
+Game::rebuild_serf_index() {
+  serf_index.clear();
+  for (Serf *serf : serfs) {
+    serf_index.insert(serf);
+  }
+}
+
+void
+Game::recount_idle_serfs() {
+  for (Player *player : players) {
+    player->clear_idle_serf_counts();
+  }
   for (Inventory *inventory : inventories) {
-    if (inventory->get_owner() == player->get_index()) {
-      player_inventories.push_back(inventory);
+    inventory->clear_idle_serfs();
+  }
+  for (Serf *serf : serfs) {
+    if (serf->get_state() != Serf::StateIdleInStock) {
+      continue;
     }
+    Player *player = players[serf->get_owner()];
+    if (player != nullptr) {
+      player->count_idle_serf(serf->get_type(), 1);
+    }
+    serf->join_idle_roster();
   }
-  return player_inventories;
 }
 
-Game::ListSerfs
-Game::get_serfs_at_pos(MapPos pos) {
-  ListSerfs result;
+void
+Game::rebuild_watchdog() {
+  watchdog.clear();
   for (Serf *serf : serfs) {
-    if (serf->get_pos() == pos) {
-      result.push_back(serf);
+    if (serf->get_state() == Serf::StateWaitIdleOnPath) {
+      watchdog.serf_waiting(serf->get_index(), tick);
+    }
+  }
+  for (Flag *flag : flags) {
+    for (Direction d : cycle_directions_cw()) {
+      if (flag->has_path(d) && !flag->has_transporter(d)) {
+        watchdog.path_unserved(flag->get_index(), d, tick);
+      }
+    }
+  }
+}
+
+void
+Game::rebuild_flag_paths() {
+  for (Flag *flag : flags) {
+    for (Direction d : cycle_directions_cw()) {
+      if (flag->has_path(d) && flag->get_path_tiles(d).empty()) {
+        flag->trace_path(d);
+      }
     }
   }
-  return result;
 }
 
 Game::ListSerfs
 Game::get_serfs_in_inventory(Inventory *inventory) {
   ListSerfs result;
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::get_serfs_in_inventory";
-  mutex.lock();
+  mutex.lock(LOCK_SITE());
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::get_serfs_in_inventory";
-  for (Serf *serf : serfs) {
-    if (serf->get_state() == Serf::StateIdleInStock &&
-        inventory->get_index() == serf->get_idle_in_stock_inv_index()) {
-      result.push_back(serf);
+  for (int type = 0; type <= Serf::TypeDead; type++) {
+    for (unsigned int index : inventory->get_idle_serfs((Serf::Type)type)) {
+      result.push_back(serfs[index]);
     }
   }
   Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex inside Game::get_serfs_in_inventory";
@@ -2462,6 +3189,12 @@ operator >> (SaveReaderBinary &reader, Game &game) {
   }
 
   game.map.reset(new Map(MapGeometry(map_size)));
+  game.map->set_events(&game.events);
+  game.serf_index.init(game.map->geom());
+  game.reset_land_influence();
+  game.reset_buildable();
+  game.flow_fields.clear();
+  game.history_changes++;
 
   reader.skip(8);
   reader >> v16;  // 200
@@ -2491,7 +3224,12 @@ operator >> (SaveReaderBinary &reader, Game &game) {
   map_reader >> *(game.map);
 
   game.load_serfs(&reader, max_serf_index);
+  game.rebuild_serf_index();
+  game.rebuild_owned_objects();
+  game.recount_idle_serfs();
   game.load_flags(&reader, max_flag_index);
+  game.rebuild_flag_paths();
+  game.rebuild_watchdog();
   game.load_buildings(&reader, max_building_index);
   game.load_inventories(&reader, max_inventory_index);
 
@@ -2649,9 +3387,16 @@ operator >> (SaveReaderText &reader, Game &game) {
 
   /* Initialize remaining map dimensions. */
   game.map.reset(new Map(MapGeometry(size)));
+  game.map->set_events(&game.events);
+  game.serf_index.init(game.map->geom());
+  game.reset_land_influence();
+  game.reset_buildable();
+  game.flow_fields.clear();
+  game.history_changes++;
   for (SaveReaderText* subreader : reader.get_sections("map")) {
     *subreader >> *game.map;
   }
+  game.map->init_terrain();
 
 //  std::string version;
 //  reader.value("version") >> version;
@@ -2727,6 +3472,10 @@ operator >> (SaveReaderText &reader, Game &game) {
     Serf *p = game.serfs.get_or_insert(subreader->get_number());
     *subreader >> *p;
   }
+  game.rebuild_serf_index();
+  game.rebuild_owned_objects();
+  game.recount_idle_serfs();
+  game.rebuild_watchdog();
 
   /* Restore idle serf flag */
   for (Serf *serf : game.serfs) {
@@ -2766,6 +3515,7 @@ operator >> (SaveReaderText &reader, Game &game) {
 
     game.map->set_obj_index(flag->get_position(), flag->get_index());
   }
+  game.rebuild_flag_paths();
 
   game.game_speed = 0;
   game.game_speed_save = DEFAULT_GAME_SPEED;
@@ -2777,6 +3527,9 @@ operator >> (SaveReaderText &reader, Game &game) {
 
 SaveWriterText&
 operator << (SaveWriterText &writer, Game &game) {
+  /* Sleeping serfs are saved as the updates would have left them. */
+  game.wake_serfs();
+
   writer.value("map.size") << game.map->get_size();
   writer.value("game_type") << game.game_type;
   writer.value("tick") << game.tick;
@@ -27,10 +27,20 @@
 #include <string>
 #include <list>
 #include <memory>
+#include <cstdint>
+#include <functional>
 
+#include <atomic>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for AI thread locking
 #include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for AI thread locking
+#include <shared_mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for AI thread locking
 
 #include "src/lookup.h"
+#include "src/game-autosave.h"
+#include "src/game-commands.h"
+#include "src/game-events.h"
+#include "src/game-watchdog.h"
+#include "src/tick-watchdog.h"
+#include "src/flow-field.h"
 
 #include "src/player.h"
 #include "src/flag.h"
@@ -39,6 +49,8 @@
 #include "src/map.h"
 #include "src/random.h"
 #include "src/objects.h"
+#include "src/lock-stats.h"
+#include "src/trace.h"
 
 
 
@@ -52,14 +64,103 @@ typedef Collection<Flag, 5000> Flags;
 class SaveReaderBinary;
 class SaveReaderText;
 class SaveWriterText;
+class GameSnapshot;
+
+// Reader/writer lock for the game state shared by the game thread and the
+// AI threads. The simulation and anything that changes the game takes it
+// exclusively with lock(), read-only queries share it with lock_shared()
+// and run concurrently with each other. Time spent waiting for the lock is
+// recorded in the profiler as lock.game.wait_exclusive/wait_shared, and
+// while a trace is recorded, how long each thread held it goes into the
+// trace as hold.game.exclusive/shared. Callers that pass LOCK_SITE(), or
+// use LOCK_SCOPE, get their waits and holds counted in LockStats.
+class GameLock {
+ protected:
+  std::shared_timed_mutex mutex;
+  static thread_local unsigned int held;   // by the calling thread, any kind
+  // of the outermost hold of the calling thread, while traced or counted
+  static thread_local Trace::Clock::time_point hold_start;
+  static thread_local const LockStats::Site *hold_site;
+
+  void lock_slow(const LockStats::Site *site);
+  void lock_shared_slow(const LockStats::Site *site);
+  void begin_hold(const LockStats::Site *site, uint64_t wait_ns) {
+    if (held++ == 0) {
+      hold_site = (site != nullptr && LockStats::is_enabled()) ? site : nullptr;
+      if (hold_site != nullptr) {
+        LockStats::acquired(*hold_site, wait_ns);
+      }
+      if (hold_site != nullptr || Trace::is_active()) {
+        hold_start = Trace::Clock::now();
+      }
+    }
+  }
+  void end_hold(bool exclusive) {
+    if (--held == 0 && hold_start != Trace::Clock::time_point()) {
+      finish_hold(exclusive);
+    }
+  }
+  void finish_hold(bool exclusive);
+
+ public:
+  void lock() {
+    if (mutex.try_lock()) {
+      begin_hold(nullptr, 0);
+    } else {
+      lock_slow(nullptr);
+    }
+  }
+  void lock(const LockStats::Site &site) {
+    if (mutex.try_lock()) {
+      begin_hold(&site, 0);
+    } else {
+      lock_slow(&site);
+    }
+  }
+  bool try_lock() {
+    if (!mutex.try_lock()) return false;
+    begin_hold(nullptr, 0);
+    return true;
+  }
+  void unlock() { end_hold(true); mutex.unlock(); }
+
+  void lock_shared() {
+    if (mutex.try_lock_shared()) {
+      begin_hold(nullptr, 0);
+    } else {
+      lock_shared_slow(nullptr);
+    }
+  }
+  void lock_shared(const LockStats::Site &site) {
+    if (mutex.try_lock_shared()) {
+      begin_hold(&site, 0);
+    } else {
+      lock_shared_slow(&site);
+    }
+  }
+  bool try_lock_shared() {
+    if (!mutex.try_lock_shared()) return false;
+    begin_hold(nullptr, 0);
+    return true;
+  }
+  void unlock_shared() { end_hold(false); mutex.unlock_shared(); }
+
+  // Whether the calling thread holds a game lock, so work that is about to
+  // pause for a while can tell it would hold up the game.
+  static bool held_by_this_thread() { return held != 0; }
+};
 
 class Game {
  public:
-  std::mutex mutex;
-  std::mutex autosave_mutex;
+  GameLock mutex;
+  LockStats::Mutex autosave_mutex;
   typedef std::list<Serf*> ListSerfs;
   typedef std::list<Building*> ListBuildings;
   typedef std::list<Inventory*> ListInventories;
+  // The objects of one player, listed in place, see get_owned_serfs().
+  typedef OwnedObjects<Serf, 5000>::Range PlayerSerfs;
+  typedef OwnedObjects<Building, 1000>::Range PlayerBuildings;
+  typedef OwnedObjects<Inventory, 100>::Range PlayerInventories;
 
  protected:
   // moved to outside of Game class so AI can use the Flags typedef
@@ -81,8 +182,14 @@ class Game {
   Inventories inventories;
   Buildings buildings;
   Serfs serfs;
+  // The serfs, buildings and inventories of each player, kept as their
+  // owners change, see owner_changed().
+  OwnedObjects<Serf, 5000> owned_serfs;
+  OwnedObjects<Building, 1000> owned_buildings;
+  OwnedObjects<Inventory, 100> owned_inventories;
 
   Random init_map_rnd;
+  Random map_seed;   // init_map_rnd as the map was made, it moves on since
   unsigned int game_speed_save;
   unsigned int game_speed;
   unsigned int tick;
@@ -93,6 +200,25 @@ class Game {
   Random rnd;
   uint16_t next_index;
   uint16_t flag_search_counter;
+  // Counts changes to the roads, their transporters and what inventories
+  // accept, for the searches Flag caches.
+  unsigned int flag_graph_changes;
+  // Counts the samples added to the player and resource histories, for the
+  // charts the stats popups keep drawn.
+  unsigned int history_changes;
+
+  // Per player: the flags with a building that the transporter search from
+  // the player's stocked inventories in update_inventories() reaches, in
+  // visit order, and for each the position in sources of the inventory
+  // that reached it first. Kept for the last set of sources until the
+  // roads change, as the search only depends on those.
+  typedef struct InventoryReach {
+    unsigned int changes;
+    std::vector<unsigned int> sources;
+    std::vector<unsigned int> flags;
+    std::vector<unsigned int> flag_sources;
+  } InventoryReach;
+  std::vector<InventoryReach> inventory_reach;
 
   uint16_t update_map_last_tick;
   int16_t update_map_counter;
@@ -111,10 +237,71 @@ class Game {
   int mission_level;
   int map_preserve_bugs;
   int player_score_leader;
+  // Player holding at least 75% of both the land and the military strength
+  // at the last stats update, or -1. Not saved, recomputed with the stats.
+  int clear_winner;
 
   int knight_morale_counter;
   int inventory_schedule_counter;
 
+  // Scratch queues reused by every FlagSearch in this game.
+  FlagSearch::Pool flag_search_pool;
+  SerfIndex serf_index;
+  // The ways to the targets of free walking serfs, see Serf::get_flow_step()
+  FlowFields flow_fields;
+
+  // Serfs update_serfs() leaves out until a tick or until something changes
+  // them, see Serf::can_sleep(). A bit per serf index, and the serfs to
+  // wake at each tick in a wheel indexed by tick modulo its size. Entries
+  // may be stale; waking a serf early is harmless.
+  static const unsigned int serf_wheel_size = 8192;
+  std::vector<uint64_t> sleeping_serfs;
+  std::vector<std::vector<unsigned int>> serf_wake_wheel;
+  unsigned int serf_wheel_tick;  // Ticks before this one are woken
+  unsigned int serf_update_tick;  // Tick of the latest sweep
+  unsigned int prev_serf_update_tick;
+  unsigned int serf_update_index;  // Serf being updated, or -1 between
+  // Serfs found marked for deletion in the sweep, deleted after it by
+  // reclaim_dead_serfs().
+  std::vector<unsigned int> dead_serfs;
+  // Buildings update_buildings() leaves out until something changes them,
+  // see Building::can_sleep(). A bit per building index.
+  std::vector<uint64_t> sleeping_buildings;
+  bool building_sleep;  // Off to update every building every tick
+  // Flags update_flags() leaves out until something changes them, see
+  // Flag::can_sleep(). A bit per flag index.
+  std::vector<uint64_t> sleeping_flags;
+  bool flag_sleep;  // Off to update every flag every tick
+
+  // Military influence on land, see update_land_ownership(). Per player and
+  // tile: summed influence, and the number of buildings claiming the tile
+  // outright. Per tile: the influence applied for a building there.
+  static const unsigned int max_influence_players = 4;
+  std::vector<uint16_t> influence;
+  std::vector<uint8_t> influence_claims;
+  std::vector<uint8_t> influence_sources;
+
+  // Per tile what could be built there by whoever owns the land, see
+  // get_buildable(). Holds Map::get_changes_near() for the tile when the
+  // bits were worked out, shifted up 32, and the bits with BuildableKnown.
+  // The can_build_*() functions are called from AI threads too.
+  mutable std::vector<std::atomic<uint64_t>> buildable;
+
+  // Published with std::atomic_store and read with std::atomic_load. The
+  // previous snapshot is reused for the next capture once no reader holds it.
+  std::shared_ptr<const GameSnapshot> snapshot;
+  std::shared_ptr<GameSnapshot> spare_snapshot;
+  uint64_t snapshot_version;
+  std::atomic<bool> snapshot_wanted;
+  // Set by the build/demolish calls, which change the game between ticks.
+  std::atomic<bool> snapshot_stale;
+  GameCommands commands;
+  std::function<void()> update_observer;
+  GameWatchdog watchdog;
+  GameAutosave autosave;
+  TickWatchdog tick_watchdog;
+  GameEvents events;
+
   // tlongstretch
   bool ai_locked;
   bool signal_ai_exit;
@@ -125,6 +312,12 @@ class Game {
   virtual ~Game();
 
   PMap get_map() { return map; }
+  // What changed in the game, for the threads that keep views of it to read
+  //  on their own.
+  const GameEvents *get_events() const { return &events; }
+  void publish_building_event(const Building *building,
+                              GameEvent::BuildingState state);
+  void publish_serf_event(const Serf *serf, Serf::State state);
 
   //
   // tlongstretch
@@ -144,9 +337,40 @@ class Game {
   void ai_thread_starting() { ai_threads_remaining++; Log::Debug["game"] << "ai_thread_starting, " << ai_threads_remaining << " started"; }
   unsigned int get_ai_thread_count() { return ai_threads_remaining; }
   // used by AI for many actions that risk vector invalidation and other non-threadsafe things
-  std::mutex * get_mutex() { return &mutex; }
+  //  read-only queries should use lock_shared() so they don't block each other
+  GameLock * get_mutex() { return &mutex; }
   // used by AI so only a single AI thread performs auto-saving, rather than all of theam each doing it
-  std::mutex * get_autosave_mutex() { return &autosave_mutex; }
+  LockStats::Mutex * get_autosave_mutex() { return &autosave_mutex; }
+  // read-only view of the game as of the end of the last update, does not
+  //  lock unless something was built or demolished since then. Once this has
+  //  been called, a new snapshot is published every tick
+  std::shared_ptr<const GameSnapshot> get_snapshot();
+  // a deep copy of the game that plays on by itself, for lookahead and
+  //  what-if runs, without a save and load. The game lock must be held.
+  //  Queued commands, the snapshot and the autosave are not taken along,
+  //  and the copy runs no AI
+  std::shared_ptr<Game> fork();
+  // queue changes to be made by the game thread at the start of the next
+  //  update, instead of locking the game for each one
+  GameCommands *get_commands() { return &commands; }
+  GameWatchdog *get_watchdog() { return &watchdog; }
+  // saves taken at the end of an update and written on a thread of their own
+  GameAutosave *get_autosave() { return &autosave; }
+  // captures of the updates and AI loops that take longer than they may
+  TickWatchdog *get_tick_watchdog() { return &tick_watchdog; }
+  const GameWatchdog *get_watchdog() const { return &watchdog; }
+  // apply a single queued or recorded command, game lock must be held
+  bool apply_command(const GameCommands::Command &command);
+  // called in every update once the commands of the tick are applied, on
+  //  the game thread and with the game lock held, see GameReplay
+  void set_update_observer(std::function<void()> observer) {
+    update_observer = observer; }
+  // state of the random numbers the simulation draws, new games start
+  //  from the time they were made
+  const Random &get_random() const { return rnd; }
+  // The seed the map of the game was made from.
+  const Random &get_map_seed() const { return map_seed; }
+  void set_random(const Random &random) { rnd = random; }
   // used by AI to check if game is paused
   unsigned int get_game_speed() const { return game_speed; }
 
@@ -163,7 +387,10 @@ class Game {
   /* External interface */
   unsigned int add_player(unsigned int intelligence, unsigned int supplies,
                           unsigned int reproduction);
-  bool init(unsigned int map_size, const Random &random);
+  // landscape, if given, is the map already generated for map_size and
+  //  random, e.g. by a MapPreparer, so it isn't generated again
+  bool init(unsigned int map_size, const Random &random,
+            const std::vector<Map::LandscapeTile> *landscape = nullptr);
 
   void update();
   void pause();
@@ -171,11 +398,28 @@ class Game {
   void speed_decrease();
   void speed_reset();
 
+
   void prepare_ground_analysis(MapPos pos, int estimates[5]);
   bool send_geologist(Flag *dest);
 
   int get_leveling_height(MapPos pos) const;
 
+  // What a tile allows regardless of who owns it.
+  typedef enum Buildable {
+    BuildableFlag = 1,        // Clear, not in water, no flag next to it
+    BuildableSmall = 2,
+    BuildableMine = 4,
+    BuildableLarge = 8,
+    BuildableMilitary = 16,
+    BuildableCastle = 32,     // Large, and clear of paths with the flag
+    BuildablePlayerSite = 64,  // Not in water and clear of paths
+    BuildableKnown = 128,
+  } Buildable;
+
+  // Buildable bits for pos, worked out again only when the map nearby has
+  // changed since last time.
+  unsigned int get_buildable(MapPos pos) const;
+
   bool can_build_military(MapPos pos) const;
   bool can_build_small(MapPos pos) const;
   bool can_build_mine(MapPos pos) const;
@@ -222,8 +466,36 @@ class Game {
   int get_player_history_index(size_t scale) const {
     return player_history_index[scale]; }
   int get_resource_history_index() const { return resource_history_index; }
+  unsigned int get_history_changes() const { return history_changes; }
+  int get_clear_winner() const { return clear_winner; }
 
   int next_search_id();
+  unsigned int get_flag_graph_changes() const { return flag_graph_changes; }
+  void count_flag_graph_change() { flag_graph_changes++; }
+  FlagSearch::Pool *get_flag_search_pool() { return &flag_search_pool; }
+  SerfIndex *get_serf_index() { return &serf_index; }
+  std::shared_ptr<const FlowField> get_flow_field(MapPos target) {
+    return flow_fields.get(map.get(), target); }
+
+  // Tick of the last update_serfs() sweep that would have updated the
+  // serf with this index, had it not been sleeping.
+  uint16_t get_serf_update_tick(unsigned int index) const {
+    return static_cast<uint16_t>((index < serf_update_index) ?
+                                 serf_update_tick : prev_serf_update_tick); }
+  void serf_woken(Serf *serf);
+  void wake_serfs();
+  void building_woken(Building *building);
+  void wake_buildings();
+  // Whether passive buildings are left out of the updates. Both ways play
+  // out the same; turning it off is for comparing the cost.
+  bool get_building_sleep() const { return building_sleep; }
+  void set_building_sleep(bool sleep);
+  void flag_woken(Flag *flag);
+  void wake_flags();
+  // Whether flags with nothing to do are left out of the updates, the same
+  // way.
+  bool get_flag_sleep() const { return flag_sleep; }
+  void set_flag_sleep(bool sleep);
 
   Serf *create_serf(int index = -1);
   void delete_serf(Serf *serf);
@@ -239,14 +511,50 @@ class Game {
   Inventory *get_inventory(unsigned int index) { return inventories[index]; }
   Building *get_building(unsigned int index) { return buildings[index]; }
   Player *get_player(unsigned int index) { return players[index]; }
-
+  size_t get_serf_count() const { return serfs.size(); }
+  size_t get_flag_count() const { return flags.size(); }
+  size_t get_building_count() const { return buildings.size(); }
+  // The object tables, the per tile tables and the map, under the shared
+  //  game lock
+  void add_memory_usage(MemoryUsage *usage);
+
+  // Copies, for using after the game lock is let go.
   ListSerfs get_player_serfs(Player *player);
   ListBuildings get_player_buildings(Player *player);
   ListSerfs get_serfs_in_inventory(Inventory *inventory);
   ListSerfs get_serfs_related_to(unsigned int dest, Direction dir);
   ListInventories get_player_inventories(Player *player);
-
-  ListSerfs get_serfs_at_pos(MapPos pos);
+  // The same in index order and without a copy, under the game lock or on
+  //  the game thread.
+  PlayerSerfs get_owned_serfs(const Player *player) {
+    return owned_serfs.get(player->get_index()); }
+  PlayerBuildings get_owned_buildings(const Player *player) {
+    return owned_buildings.get(player->get_index()); }
+  PlayerInventories get_owned_inventories(const Player *player) {
+    return owned_inventories.get(player->get_index()); }
+  // Move an object to the list of its new owner, after set_owner().
+  void owner_changed(Serf *serf, unsigned int old_owner) {
+    owned_serfs.set_owner(serf->get_index(), old_owner, serf->get_owner()); }
+  void owner_changed(Building *building, unsigned int old_owner) {
+    owned_buildings.set_owner(building->get_index(), old_owner,
+                              building->get_owner()); }
+  void owner_changed(Inventory *inventory, unsigned int old_owner) {
+    owned_inventories.set_owner(inventory->get_index(), old_owner,
+                                inventory->get_owner()); }
+  // Fill the lists of each player's objects, after loading.
+  void rebuild_owned_objects();
+
+  SerfIndex::Range get_serfs_at_pos(MapPos pos) const {
+    return serf_index.at(pos); }
+  // Re-link all serfs into the serf index, after loading.
+  void rebuild_serf_index();
+  // Count the serfs idle in stock for each player and fill the rosters of
+  // the inventories, after loading.
+  void recount_idle_serfs();
+  // Fill the watchdog from the serfs and flags, after loading.
+  void rebuild_watchdog();
+  // Trace the paths between the flags, after loading.
+  void rebuild_flag_paths();
 
   Player *get_next_player(const Player *player);
   unsigned int get_enemy_score(const Player *player) const;
@@ -256,17 +564,26 @@ class Game {
  protected:
   void clear_serf_request_failure();
   void update_knight_morale();
-  static bool update_inventories_cb(Flag *flag, void *data);
+  static bool inventory_reach_cb(Flag *flag, void *data);
+  const InventoryReach &get_inventory_reach(const Player *player,
+                                            Inventory *const *invs, int n);
   void update_inventories();
   void update_flags();
+  void sleep_flag(Flag *flag);
   static bool send_serf_to_flag_search_cb(Flag *flag, void *data);
   void update_buildings();
+  void sleep_building(Building *building);
   void update_serfs();
+  void reclaim_dead_serfs();
+  void sleep_serf(Serf *serf, unsigned int ticks);
+  void wake_due_serfs();
   void record_player_history(int max_level, int aspect,
                              const int history_index[], const Values &values);
   int calculate_clear_winner(const Values &values);
   void update_game_stats();
-  void get_resource_estimate(MapPos pos, int weight, int estimates[5]);
+  void publish_snapshot();
+  bool records_direct_changes();
+  bool apply_direct(const GameCommands::Command &command);
   bool road_segment_in_water(MapPos pos, Direction dir) const;
   void flag_reset_transport(Flag *flag);
   void building_remove_player_refs(Building *building);
@@ -279,6 +596,12 @@ class Game {
   bool demolish_flag_(MapPos pos);
   bool demolish_building_(MapPos pos);
   void surrender_land(MapPos pos);
+  void reset_land_influence();
+  void reset_buildable();
+  unsigned int compute_buildable(MapPos pos) const;
+  bool is_large_site(MapPos pos) const;
+  unsigned int get_influence_source(MapPos pos);
+  void apply_influence(MapPos pos, unsigned int source, int sign);
   void demolish_flag_and_roads(MapPos pos);
 
  public:
@@ -288,6 +611,7 @@ class Game {
     operator >> (SaveReaderText &reader, Game &game);
   friend SaveWriterText&
     operator << (SaveWriterText &writer, Game &game);
+  friend class GameSnapshot;
 
  protected:
   bool load_serfs(SaveReaderBinary *reader, int max_serf_index);
@@ -21,12 +21,15 @@
 
 #include "src/gfx.h"
 
+#include <cmath>
 #include <utility>
 #include <algorithm>
+#include <vector>
 
 #include "src/log.h"
 #include "src/data.h"
 #include "src/video.h"
+#include "src/data-source.h"
 
 const Color Color::black = Color(0x00, 0x00, 0x00);
 const Color Color::white = Color(0xff, 0xff, 0xff);
@@ -85,32 +88,143 @@ Image::~Image() {
 }
 
 /* Sprite cache hash table */
-Image::ImageCache Image::image_cache;
+Image::ImageCache Image::image_cache = {
+  {}, {}, {}, Image::no_entry, Image::no_entry, 0,
+  Image::default_cache_budget, 0, 0, 0
+};
+const unsigned int Image::no_entry;
+const size_t Image::default_cache_budget;
+
+void
+Image::unlink(unsigned int entry) {
+  CacheEntry &e = image_cache.entries[entry];
+  if (e.prev != no_entry) {
+    image_cache.entries[e.prev].next = e.next;
+  } else {
+    image_cache.head = e.next;
+  }
+  if (e.next != no_entry) {
+    image_cache.entries[e.next].prev = e.prev;
+  } else {
+    image_cache.tail = e.prev;
+  }
+  e.prev = no_entry;
+  e.next = no_entry;
+}
+
+void
+Image::link_front(unsigned int entry) {
+  CacheEntry &e = image_cache.entries[entry];
+  e.prev = no_entry;
+  e.next = image_cache.head;
+  if (image_cache.head != no_entry) {
+    image_cache.entries[image_cache.head].prev = entry;
+  }
+  image_cache.head = entry;
+  if (image_cache.tail == no_entry) {
+    image_cache.tail = entry;
+  }
+}
+
+void
+Image::evict(unsigned int entry) {
+  unlink(entry);
+  CacheEntry &e = image_cache.entries[entry];
+  image_cache.index.erase(e.id);
+  image_cache.bytes -= e.bytes;
+  delete e.image;
+  e.image = nullptr;
+  image_cache.free_entries.push_back(entry);
+}
 
 void
 Image::cache_image(uint64_t id, Image *image) {
-  image_cache[id] = image;
+  std::unordered_map<uint64_t, unsigned int>::iterator it =
+                                                  image_cache.index.find(id);
+  if (it != image_cache.index.end()) {
+    evict(it->second);
+  }
+  unsigned int entry;
+  if (!image_cache.free_entries.empty()) {
+    entry = image_cache.free_entries.back();
+    image_cache.free_entries.pop_back();
+  } else {
+    entry = static_cast<unsigned int>(image_cache.entries.size());
+    image_cache.entries.push_back(CacheEntry());
+  }
+  size_t bytes = 4 * static_cast<size_t>(image->get_width()) *
+                 image->get_height();
+  image_cache.entries[entry] = { id, image, bytes, no_entry, no_entry };
+  image_cache.index[id] = entry;
+  image_cache.bytes += bytes;
+  link_front(entry);
+
+  /* Never the image just added, the caller is about to draw it. */
+  while (image_cache.bytes > image_cache.budget &&
+         image_cache.tail != entry) {
+    evict(image_cache.tail);
+    image_cache.evictions++;
+  }
 }
 
 /* Return a pointer to the sprite pointer associated with id. */
 Image *
 Image::get_cached_image(uint64_t id) {
-  ImageCache::iterator result = image_cache.find(id);
-  if (result == image_cache.end()) {
+  std::unordered_map<uint64_t, unsigned int>::iterator it =
+                                                  image_cache.index.find(id);
+  if (it == image_cache.index.end()) {
+    image_cache.misses++;
     return nullptr;
   }
-  return result->second;
+  image_cache.hits++;
+  if (image_cache.head != it->second) {
+    unlink(it->second);
+    link_front(it->second);
+  }
+  return image_cache.entries[it->second].image;
 }
 
 void
 Image::clear_cache() {
-  while (!image_cache.empty()) {
-    Image *image = image_cache.begin()->second;
-    image_cache.erase(image_cache.begin());
-    delete image;
+  while (image_cache.head != no_entry) {
+    evict(image_cache.head);
+  }
+  image_cache.entries.clear();
+  image_cache.free_entries.clear();
+}
+
+void
+Image::set_cache_budget(size_t bytes) {
+  image_cache.budget = bytes;
+  while (image_cache.bytes > image_cache.budget &&
+         image_cache.tail != no_entry) {
+    evict(image_cache.tail);
+    image_cache.evictions++;
   }
 }
 
+Image::CacheStats
+Image::get_cache_stats() {
+  return { image_cache.index.size(), image_cache.bytes, image_cache.budget,
+           image_cache.hits, image_cache.misses, image_cache.evictions };
+}
+
+// The pixels, as the budget counts them, and the LRU bookkeeping
+void
+Image::add_memory_usage(MemoryUsage *usage) {
+  usage->add("image_cache", image_cache.index.size(),
+             image_cache.bytes +
+             MemoryUsage::vector_bytes(image_cache.entries) +
+             MemoryUsage::vector_bytes(image_cache.free_entries) +
+             image_cache.index.size() *
+             (sizeof(std::pair<uint64_t, unsigned int>) +
+              MemoryUsage::list_node_overhead));
+}
+
+Frame::TextCache Frame::text_cache;
+std::unordered_map<std::string, Frame::TextCache::iterator> Frame::text_index;
+const size_t Frame::text_cache_size;
+
 Graphics *Graphics::instance = nullptr;
 
 Graphics::Graphics() {
@@ -136,6 +250,7 @@ Graphics::Graphics() {
 }
 
 Graphics::~Graphics() {
+  Frame::clear_text_cache();
   Image::clear_cache();
 }
 
@@ -267,6 +382,96 @@ Frame::draw_masked_sprite(int x, int y, Data::Resource mask_res,
   video->draw_image(image->get_video_image(), x, y, 0, video_frame);
 }
 
+/* The plain sprite, from the cache or decoded into it. */
+Image *
+Frame::get_sprite_image(Data::Resource res, unsigned int index) {
+  uint64_t id = Data::Sprite::create_id(res, index, 0, 0, {0, 0, 0, 0});
+  Image *image = Image::get_cached_image(id);
+  if (image == nullptr) {
+    Data::PSprite s = data_source->get_sprite(res, index, {0, 0, 0, 0});
+    if (!s) {
+      Log::Warn["graphics"] << "Failed to decode sprite #"
+                            << Data::get_resource_name(res) << ":" << index;
+      return nullptr;
+    }
+    image = new Image(video, s);
+    Image::cache_image(id, image);
+  }
+  return image;
+}
+
+typedef std::vector<std::pair<float, float>> Polygon;
+
+/* Cut off the part of the polygon above (or below) the row y. */
+static void
+clip_polygon(Polygon *polygon, float y, bool keep_below) {
+  Polygon clipped;
+  for (size_t i = 0; i < polygon->size(); i++) {
+    const std::pair<float, float> &a = (*polygon)[i];
+    const std::pair<float, float> &b = (*polygon)[(i + 1) % polygon->size()];
+    bool a_in = keep_below ? (a.second >= y) : (a.second <= y);
+    bool b_in = keep_below ? (b.second >= y) : (b.second <= y);
+    if (a_in) clipped.push_back(a);
+    if (a_in != b_in) {
+      float t = (y - a.second) / (b.second - a.second);
+      clipped.push_back(std::make_pair(a.first + t * (b.first - a.first), y));
+    }
+  }
+  polygon->swap(clipped);
+}
+
+/* Masked sprites take the sprite from its top left pixel at the offset of
+   the mask, and start it again from the top past its last row. The
+   triangle is cut into the bands of rows each repeat covers. */
+bool
+Frame::draw_masked_triangle(int x, int y, Data::Resource mask_res,
+                            unsigned int mask_index, Data::Resource res,
+                            unsigned int index, const int corners[6]) {
+  Image *mask = get_sprite_image(mask_res, mask_index);
+  Image *image = get_sprite_image(res, index);
+  if (mask == nullptr || image == nullptr || image->get_height() == 0) {
+    return false;
+  }
+
+  float origin_x = static_cast<float>(x + mask->get_offset_x());
+  float origin_y = static_cast<float>(y + mask->get_offset_y());
+  float height = static_cast<float>(image->get_height());
+
+  Polygon triangle;
+  float top = static_cast<float>(y + corners[1]);
+  float bottom = top;
+  for (int i = 0; i < 3; i++) {
+    float cy = static_cast<float>(y + corners[2*i + 1]);
+    triangle.push_back(std::make_pair(static_cast<float>(x + corners[2*i]),
+                                      cy));
+    top = std::min(top, cy);
+    bottom = std::max(bottom, cy);
+  }
+
+  std::vector<Video::Vertex> vertices;
+  int first_band = static_cast<int>(std::floor((top - origin_y) / height));
+  int last_band = static_cast<int>(std::ceil((bottom - origin_y) / height));
+  for (int band = first_band; band < last_band; band++) {
+    float band_y = origin_y + band * height;
+    Polygon polygon = triangle;
+    clip_polygon(&polygon, band_y, true);
+    clip_polygon(&polygon, band_y + height, false);
+    for (size_t i = 1; i + 1 < polygon.size(); i++) {
+      for (size_t p : { static_cast<size_t>(0), i, i + 1 }) {
+        vertices.push_back(Video::Vertex{ polygon[p].first,
+                                          polygon[p].second,
+                                          polygon[p].first - origin_x,
+                                          polygon[p].second - band_y });
+      }
+    }
+  }
+  if (vertices.empty()) {
+    return true;
+  }
+  return video->draw_triangles(image->get_video_image(), vertices.data(),
+                               vertices.size(), video_frame);
+}
+
 /* Draw the waves sprite with given mask and sprite
    indices at x, y in dest frame. */
 void
@@ -316,46 +521,46 @@ Frame::draw_waves_sprite(int x, int y, Data::Resource mask_res,
   video->draw_image(image->get_video_image(), x, y, 0, video_frame);
 }
 
+static const int sprite_offset_from_ascii[] = {
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, 43, -1, -1,
+  -1, -1, -1, -1, -1, 40, 39, -1,
+  29, 30, 31, 32, 33, 34, 35, 36,
+  37, 38, 41, -1, -1, -1, -1, 42,
+  -1,  0,  1,  2,  3,  4,  5,  6,
+   7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22,
+  23, 24, 25, -1, -1, -1, -1, -1,
+  -1,  0,  1,  2,  3,  4,  5,  6,
+   7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22,
+  23, 24, 25, -1, -1, -1, -1, -1,
+
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
 /* Draw a character at x, y in the dest frame. */
 void
 Frame::draw_char_sprite(int x, int y, unsigned char c, const Color &color,
                         const Color &shadow) {
-  static const int sprite_offset_from_ascii[] = {
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, 43, -1, -1,
-    -1, -1, -1, -1, -1, 40, 39, -1,
-    29, 30, 31, 32, 33, 34, 35, 36,
-    37, 38, 41, -1, -1, -1, -1, 42,
-    -1,  0,  1,  2,  3,  4,  5,  6,
-     7,  8,  9, 10, 11, 12, 13, 14,
-    15, 16, 17, 18, 19, 20, 21, 22,
-    23, 24, 25, -1, -1, -1, -1, -1,
-    -1,  0,  1,  2,  3,  4,  5,  6,
-     7,  8,  9, 10, 11, 12, 13, 14,
-    15, 16, 17, 18, 19, 20, 21, 22,
-    23, 24, 25, -1, -1, -1, -1, -1,
-
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1,
-  };
-
   int s = sprite_offset_from_ascii[c];
   if (s < 0) return;
 
@@ -365,47 +570,153 @@ Frame::draw_char_sprite(int x, int y, unsigned char c, const Color &color,
   draw_sprite(x, y, Data::AssetFont, s, false, color);
 }
 
-/* Draw the string str at x, y in the dest frame. */
-void
-Frame::draw_string(int x, int y, const std::string &str, const Color &color,
-                   const Color &shadow) {
-  int cx = x;
+/* Calls draw(x, y, c) for each character of str that has a glyph, at
+   where it goes relative to the start of the string. */
+template<typename Draw>
+static void
+for_each_char(const std::string &str, Draw draw) {
+  int cx = 0;
+  int cy = 0;
 
   for (char c : str) {
     if (c == '\t') {
       cx += 8 * 2;
     } else if (c == '\n') {
-      y += 8;
-      cx = x;
+      cy += 8;
+      cx = 0;
     } else {
-      draw_char_sprite(cx, y, c, color, shadow);
+      if (sprite_offset_from_ascii[static_cast<unsigned char>(c)] >= 0) {
+        draw(cx, cy, static_cast<unsigned char>(c));
+      }
       cx += 8;
     }
   }
 }
 
-/* Draw the number n at x, y in the dest frame. */
 void
-Frame::draw_number(int x, int y, int value, const Color &color,
+Frame::draw_string_chars(int x, int y, const std::string &str,
+                         const Color &color, const Color &shadow) {
+  for_each_char(str, [&](int cx, int cy, unsigned char c) {
+    draw_char_sprite(x + cx, y + cy, c, color, shadow);
+  });
+}
+
+/* Copy the glyphs of str into one sprite, each shadow and then its glyph
+   in turn, as draw_char_sprite() draws them. */
+Image *
+Frame::render_string(const std::string &str, const Color &color,
+                     const Color &shadow) {
+  Data::Sprite::Color pc = {color.get_blue(), color.get_green(),
+                            color.get_red(), color.get_alpha()};
+  Data::Sprite::Color ps = {shadow.get_blue(), shadow.get_green(),
+                            shadow.get_red(), shadow.get_alpha()};
+  typedef struct Glyph {
+    int x;
+    int y;
+    Data::PSprite sprite;
+  } Glyph;
+  std::vector<Glyph> glyphs;
+  bool failed = false;
+  auto add_glyph = [&](int cx, int cy, Data::Resource res, unsigned char c,
+                       const Data::Sprite::Color &tint) {
+    Data::PSprite s = data_source->get_sprite(res,
+                                              sprite_offset_from_ascii[c],
+                                              tint);
+    if (!s) {
+      failed = true;
+      return;
+    }
+    glyphs.push_back(Glyph{cx, cy, s});
+  };
+  for_each_char(str, [&](int cx, int cy, unsigned char c) {
+    if (shadow != Color::transparent) {
+      add_glyph(cx, cy, Data::AssetFontShadow, c, ps);
+    }
+    add_glyph(cx, cy, Data::AssetFont, c, pc);
+  });
+  if (failed || glyphs.empty()) {
+    return nullptr;
+  }
+
+  size_t width = 0;
+  size_t height = 0;
+  for (const Glyph &glyph : glyphs) {
+    width = std::max(width, glyph.x + glyph.sprite->get_width());
+    height = std::max(height, glyph.y + glyph.sprite->get_height());
+  }
+  Data::PSprite canvas = std::make_shared<SpriteBase>(
+    static_cast<unsigned int>(width), static_cast<unsigned int>(height));
+  uint32_t *pixels = reinterpret_cast<uint32_t*>(canvas->get_data());
+  std::fill(pixels, pixels + width * height, 0);
+  for (const Glyph &glyph : glyphs) {
+    const uint32_t *src =
+      reinterpret_cast<const uint32_t*>(glyph.sprite->get_data());
+    size_t glyph_width = glyph.sprite->get_width();
+    for (size_t gy = 0; gy < glyph.sprite->get_height(); gy++) {
+      uint32_t *dst = pixels + (glyph.y + gy) * width + glyph.x;
+      for (size_t gx = 0; gx < glyph_width; gx++) {
+        uint32_t pixel = src[gy * glyph_width + gx];
+        if ((pixel & 0xFF000000) != 0) {
+          dst[gx] = pixel;
+        }
+      }
+    }
+  }
+
+  return new Image(video, canvas);
+}
+
+void
+Frame::clear_text_cache() {
+  for (TextEntry &entry : text_cache) {
+    delete entry.image;
+  }
+  text_cache.clear();
+  text_index.clear();
+}
+
+/* Draw the string str at x, y in the dest frame. */
+void
+Frame::draw_string(int x, int y, const std::string &str, const Color &color,
                    const Color &shadow) {
-  if (value < 0) {
-    draw_char_sprite(x, y, '-', color, shadow);
-    x += 8;
-    value *= -1;
+  std::string key = str;
+  for (const Color *c : { &color, &shadow }) {
+    key += static_cast<char>(c->get_red());
+    key += static_cast<char>(c->get_green());
+    key += static_cast<char>(c->get_blue());
+    key += static_cast<char>(c->get_alpha());
   }
 
-  if (value == 0) {
-    draw_char_sprite(x, y, '0', color, shadow);
+  auto found = text_index.find(key);
+  if (found == text_index.end()) {
+    text_cache.push_front(TextEntry{key, nullptr});
+    text_index[key] = text_cache.begin();
+    if (text_cache.size() > text_cache_size) {
+      delete text_cache.back().image;
+      text_index.erase(text_cache.back().key);
+      text_cache.pop_back();
+    }
+    draw_string_chars(x, y, str, color, shadow);
     return;
   }
 
-  int digits = 0;
-  for (int i = value; i > 0; i /= 10) digits += 1;
-
-  for (int i = digits-1; i >= 0; i--) {
-    draw_char_sprite(x+8*i, y, '0'+(value % 10), color, shadow);
-    value /= 10;
+  TextCache::iterator entry = found->second;
+  text_cache.splice(text_cache.begin(), text_cache, entry);
+  if (entry->image == nullptr) {
+    entry->image = render_string(str, color, shadow);
+    if (entry->image == nullptr) {
+      draw_string_chars(x, y, str, color, shadow);
+      return;
+    }
   }
+  video->draw_image(entry->image->get_video_image(), x, y, 0, video_frame);
+}
+
+/* Draw the number n at x, y in the dest frame. */
+void
+Frame::draw_number(int x, int y, int value, const Color &color,
+                   const Color &shadow) {
+  draw_string(x, y, std::to_string(value), color, shadow);
 }
 
 /* Draw a rectangle with color at x, y in the dest frame. */
@@ -460,6 +771,16 @@ Frame::draw_frame(int dx, int dy, int sx, int sy, Frame *src, int w, int h) {
   video->draw_frame(dx, dy, video_frame, sx, sy, src->video_frame, w, h);
 }
 
+/* Replace a rectangle of the frame with the given pixels in one upload,
+   instead of a draw call for each rectangle of a color. */
+void
+Frame::update_pixels(int x, int y, int w, int h, const uint32_t *pixels) {
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+  video->update_frame(x, y, w, h, pixels, video_frame);
+}
+
 void
 Frame::draw_line(int x, int y, int x1, int y1, const Color &color) {
   Video::Color c = {color.get_red(),
@@ -517,6 +838,11 @@ Graphics::set_zoom_factor(float factor) {
   return video->set_zoom_factor(factor);
 }
 
+unsigned int
+Graphics::get_draw_calls() {
+  return video->get_draw_calls();
+}
+
 void
 Graphics::get_screen_factor(float *fx, float *fy) {
   video->get_screen_factor(fx, fy);
@@ -22,12 +22,16 @@
 #ifndef SRC_GFX_H_
 #define SRC_GFX_H_
 
+#include <list>
 #include <map>
 #include <string>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "src/data.h"
 #include "src/debug.h"
+#include "src/memory-usage.h"
 #include "src/video.h"
 
 class ExceptionGFX : public ExceptionFreeserf {
@@ -89,10 +93,47 @@ class Image {
   Video *video;
   Video::Image *video_image;
 
-  typedef std::map<uint64_t, Image*> ImageCache;
+  /* Decoded images by sprite id, least recently drawn evicted first once
+     the pixels of all of them exceed the budget. Entries are kept in a
+     vector and linked into the LRU order by index. */
+  typedef struct CacheEntry {
+    uint64_t id;
+    Image *image;
+    size_t bytes;
+    unsigned int prev;
+    unsigned int next;
+  } CacheEntry;
+  typedef struct ImageCache {
+    std::unordered_map<uint64_t, unsigned int> index;
+    std::vector<CacheEntry> entries;
+    std::vector<unsigned int> free_entries;
+    unsigned int head;   /* Most recently drawn */
+    unsigned int tail;
+    size_t bytes;
+    size_t budget;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+  } ImageCache;
   static ImageCache image_cache;
+  static const unsigned int no_entry = static_cast<unsigned int>(-1);
+
+  static void unlink(unsigned int entry);
+  static void link_front(unsigned int entry);
+  static void evict(unsigned int entry);
 
  public:
+  typedef struct CacheStats {
+    size_t images;
+    size_t bytes;
+    size_t budget;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+  } CacheStats;
+
+  static const size_t default_cache_budget = 64 * 1024 * 1024;
+
   Image(Video *video, Data::PSprite sprite);
   virtual ~Image();
 
@@ -109,6 +150,10 @@ class Image {
   static void cache_image(uint64_t id, Image *image);
   static Image *get_cached_image(uint64_t id);
   static void clear_cache();
+  /* Pixel bytes the cache may hold, evicting down to it at once. */
+  static void set_cache_budget(size_t bytes);
+  static CacheStats get_cache_stats();
+  static void add_memory_usage(MemoryUsage *usage);
 
   Video::Image *get_video_image() const { return video_image; }
 };
@@ -122,6 +167,19 @@ class Frame {
   bool owner;
   Data::PSource data_source;
 
+  /* Strings drawn before, each rendered into one image, by text and
+     colors, least recently drawn dropped first. A string only gets an
+     image the second time it is drawn, text that changes every frame is
+     still drawn a character at a time. */
+  typedef struct TextEntry {
+    std::string key;
+    Image *image;
+  } TextEntry;
+  typedef std::list<TextEntry> TextCache;
+  static TextCache text_cache;   /* Most recently drawn first */
+  static std::unordered_map<std::string, TextCache::iterator> text_index;
+  static const size_t text_cache_size = 512;
+
  public:
   Frame(Video *video, unsigned int width, unsigned int height);
   Frame(Video *video, Video::Frame *video_frame);
@@ -145,6 +203,12 @@ class Frame {
   void draw_waves_sprite(int x, int y, Data::Resource mask_res,
                          unsigned int mask_index, Data::Resource res,
                          unsigned int index);
+  /* Draw what the masked sprite shows of the sprite as one triangle, with
+     corners given as x, y pairs relative to where the masked sprite would
+     be drawn. Returns false if the video can't draw triangles. */
+  bool draw_masked_triangle(int x, int y, Data::Resource mask_res,
+                            unsigned int mask_index, Data::Resource res,
+                            unsigned int index, const int corners[6]);
 
   /* Drawing functions */
   void draw_rect(int x, int y, int width, int height, const Color &color);
@@ -159,10 +223,19 @@ class Frame {
 
   /* Frame functions */
   void draw_frame(int dx, int dy, int sx, int sy, Frame *src, int w, int h);
+  /* Pixels are four bytes, blue, green, red and alpha, row by row. */
+  void update_pixels(int x, int y, int w, int h, const uint32_t *pixels);
+
+  static void clear_text_cache();
 
  protected:
   void draw_char_sprite(int x, int y, unsigned char c, const Color &color,
                         const Color &shadow);
+  void draw_string_chars(int x, int y, const std::string &str,
+                         const Color &color, const Color &shadow);
+  Image *render_string(const std::string &str, const Color &color,
+                       const Color &shadow);
+  Image *get_sprite_image(Data::Resource res, unsigned int index);
   void draw_sprite(int x, int y, Data::Resource res, unsigned int index,
                    bool use_off, const Color &color, float progress);
 };
@@ -194,6 +267,7 @@ class Graphics {
   float get_zoom_factor();
   bool set_zoom_factor(float factor);
   void get_screen_factor(float *fx, float *fy);
+  unsigned int get_draw_calls();
 };
 
 #endif  // SRC_GFX_H_
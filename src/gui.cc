@@ -37,6 +37,7 @@ GuiObject::layout() {
 }
 
 GuiObject *GuiObject::focused_object = nullptr;
+bool GuiObject::damaged = true;
 
 GuiObject::GuiObject() {
   x = 0;
@@ -46,6 +47,7 @@ GuiObject::GuiObject() {
   displayed = false;
   enabled = true;
   redraw = true;
+  damaged = true;
   parent = nullptr;
   frame = nullptr;
   focused = false;
@@ -68,24 +70,34 @@ GuiObject::delete_frame() {
 
 void
 GuiObject::draw(Frame *_frame) {
+  composite(_frame, 0, 0);
+}
+
+// Render the own frame again if its content changed, then blit it and the
+//  floats onto dest, with the parent's top left at dx, dy. Floats are not
+//  drawn into the parent's frame, so a float changing only costs its own
+//  render, and the parent is left as it is.
+void
+GuiObject::composite(Frame *dest, int dx, int dy) {
   if (!displayed) {
     return;
   }
 
-  if (frame == nullptr) {
-    frame = Graphics::get_instance().create_frame(width, height);
-  }
-
-  if (redraw) {
-    internal_draw();
-
-    for (GuiObject *float_window : floats) {
-      float_window->draw(frame);
+  if (draws_content()) {
+    if (frame == nullptr) {
+      frame = Graphics::get_instance().create_frame(width, height);
+      redraw = true;
+    }
+    if (redraw) {
+      internal_draw();
     }
+    dest->draw_frame(dx + x, dy + y, 0, 0, frame, width, height);
+  }
+  redraw = false;
 
-    redraw = false;
+  for (GuiObject *float_window : floats) {
+    float_window->composite(dest, dx + x, dy + y);
   }
-  _frame->draw_frame(x, y, 0, 0, frame, width, height);
 }
 
 bool
@@ -219,9 +231,7 @@ GuiObject::set_enabled(bool enabled) {
 void
 GuiObject::set_redraw() {
   redraw = true;
-  if (parent != nullptr) {
-    parent->set_redraw();
-  }
+  damaged = true;
 }
 
 bool
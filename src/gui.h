@@ -42,9 +42,14 @@ class GuiObject : public EventLoop::Handler {
   Frame *frame;
   static GuiObject *focused_object;
   bool focused;
+  /* Whether any object was asked to redraw since the last frame. */
+  static bool damaged;
 
   virtual void internal_draw() = 0;
   virtual void layout();
+  // Objects that only hold floats and draw nothing of their own return
+  //  false, so they get no frame and only their floats are blitted.
+  virtual bool draws_content() const { return true; }
 
   virtual bool handle_click_left(int x, int y) { return false; }
   virtual bool handle_dbl_click(int x, int y, Event::Button button) {
@@ -54,6 +59,7 @@ class GuiObject : public EventLoop::Handler {
   virtual bool handle_focus_loose() { return false; }
 
   void delete_frame();
+  void composite(Frame *dest, int dx, int dy);
 
  public:
   GuiObject();
@@ -67,6 +73,8 @@ class GuiObject : public EventLoop::Handler {
   void set_displayed(bool displayed);
   void set_enabled(bool enabled);
   void set_redraw();
+  static bool is_damaged() { return damaged; }
+  static void clear_damaged() { damaged = false; }
   bool is_displayed() { return displayed; }
   GuiObject *get_parent() { return parent; }
   void set_parent(GuiObject *parent) { this->parent = parent; }
@@ -0,0 +1,544 @@
+/*
+ * headless.cc - Headless simulation runner and tick benchmark.
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs a game without video, audio or event loop. The game is either
+// loaded from a save file or generated from a random seed, AI players are
+// attached as in Interface::initialize_AI, and Game::update() is called in
+// a tight loop for the requested number of ticks. At the end the tick
+// throughput and the profiler statistics for each update phase and AI
+// step are reported. With -o the outcome and score history of the game is
+// written as a GameResult, which is what freeserf-tournament collects.
+// With -e the commands the game gets are recorded as a GameReplay, and -y
+// replays such a log without AI players, checking that the game plays out
+// the same. With -t a trace of what the game and AI threads did is written
+// for chrome://tracing, and with -k how long each place that takes the game
+// lock waited for it and held it. With -b what the game, its map and the AI
+// players hold in memory is written at the end. With -v a SpectatorWriter
+// stream of the game is written, a frame every spectator_interval ticks.
+// With -g the metrics of the game are written to a file every -f seconds,
+// for whatever watches a fleet of headless games. With -W, an update or AI
+// loop that runs over its budget leaves the trace of the seconds before it
+// and a save of the game behind, see TickWatchdog.
+// Built with ENABLE_ALLOC_STATS, the allocations per tick and the profiler
+// scopes allocating most are reported too.
+
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <istream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "src/ai.h"
+#include "src/alloc-stats.h"
+#include "src/command_line.h"
+#include "src/configfile.h"
+#include "src/game-host.h"
+#include "src/game-manager.h"
+#include "src/game-replay.h"
+#include "src/game-result.h"
+#include "src/lock-stats.h"
+#include "src/log.h"
+#include "src/map-generator.h"
+#include "src/memory-usage.h"
+#include "src/metrics.h"
+#include "src/mission.h"
+#include "src/profiler.h"
+#include "src/savegame.h"
+#include "src/thread-policy.h"
+#include "src/trace.h"
+#include "src/version.h"
+
+static const unsigned int spectator_interval = 50;
+
+static int
+replay_game(const std::string &replay_file) {
+  GameReplay replay;
+  std::ifstream stream(replay_file, std::ios::binary);
+  if (!replay.read(&stream)) {
+    Log::Error["headless"] << "failed to read replay '" << replay_file << "'";
+    return EXIT_FAILURE;
+  }
+  GameManager &game_manager = GameManager::get_instance();
+  if (!game_manager.start_game(replay.make_game_info())) {
+    return EXIT_FAILURE;
+  }
+  PGame game = game_manager.get_current_game();
+  Log::Info["headless"] << "replaying '" << replay_file << "' of game '"
+                        << replay.get_seed() << "', "
+                        << replay.get_entries().size() << " entries";
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  GameReplay::Result result = replay.replay(game.get());
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  Log::Info["headless"] << "replayed " << result.updates << " ticks and "
+                        << result.commands << " commands in " << std::fixed
+                        << std::setprecision(3) << elapsed << " s, "
+                        << result.hashes_checked << " hashes checked, "
+                        << result.results_differ << " command results differ";
+  if (result.diverged) {
+    Log::Error["headless"] << "game diverged at tick " << result.tick
+                           << ", hash " << std::hex << result.hash
+                           << " instead of " << result.expected;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int
+main(int argc, char *argv[]) {
+  std::string save_file;
+  std::string profile_file;
+  std::string result_file;
+  std::string record_file;
+  std::string replay_file;
+  std::string trace_file;
+  std::string lock_stats_file;
+  std::string memory_file;
+  std::string spectator_file;
+  std::string metrics_file;
+  unsigned int metrics_interval = 10;
+  unsigned int watch_update_ms = 0;
+  unsigned int watch_ai_loop_ms = 0;
+  std::string seed;
+  unsigned int map_size = 3;
+  unsigned int ticks = 10000;
+  bool no_ai = false;
+  bool all_ai = false;
+  bool real_time = false;
+  bool sweep_buildings = false;
+  bool until_winner = false;
+  AIPlusOptions aiplus_options;
+
+  CommandLine command_line;
+  command_line.add_option('S', "Write the AI's debug saves to DIR instead of"
+                               " the save game folder")
+                .add_parameter("DIR", [](std::istream& s) {
+                  std::string debug_save_folder;
+                  std::getline(s, debug_save_folder);
+                  AI::set_debug_save_folder(debug_save_folder);
+                  return !debug_save_folder.empty();
+                });
+  command_line.add_option('W', "Write a trace and a save when an update takes"
+                               " over UPDATE_MS or an AI loop over AI_MS")
+                .add_parameter("UPDATE_MS[,AI_MS]",
+                               [&watch_update_ms, &watch_ai_loop_ms](
+                                                          std::istream& s) {
+                  s >> watch_update_ms;
+                  char comma;
+                  if (s >> comma && (comma != ',' || !(s >> watch_ai_loop_ms))) {
+                    return false;
+                  }
+                  return (watch_update_ms > 0 || watch_ai_loop_ms > 0);
+                });
+  command_line.add_option('a', "Make every player (including player 0) AI",
+                          [&all_ai](){ all_ai = true; });
+  command_line.add_option('b', "Write memory usage of the game and AI to FILE")
+                .add_parameter("FILE", [&memory_file](std::istream& s) {
+                  std::getline(s, memory_file);
+                  return true;
+                });
+  command_line.add_option('c', "Cache generated maps in DIR")
+                .add_parameter("DIR", [](std::istream& s) {
+                  std::string cache_folder;
+                  std::getline(s, cache_folder);
+                  ClassicMapGenerator::set_cache_folder(cache_folder);
+                  return !cache_folder.empty();
+                });
+  command_line.add_option('d', "Set Debug output level")
+                .add_parameter("NUM", [](std::istream& s) {
+                  int d;
+                  s >> d;
+                  if (d >= 0 && d < Log::LevelMax) {
+                    Log::set_level(static_cast<Log::Level>(d));
+                  }
+                  return true;
+                });
+  command_line.add_option('e', "Record the commands of the game to FILE")
+                .add_parameter("FILE", [&record_file](std::istream& s) {
+                  std::getline(s, record_file);
+                  return true;
+                });
+  command_line.add_option('f', "Write the metrics every SECONDS (default 10)")
+                .add_parameter("SECONDS", [&metrics_interval](std::istream& s) {
+                  s >> metrics_interval;
+                  return (metrics_interval > 0);
+                });
+  command_line.add_option('g', "Write metrics to FILE, as JSON lines when it"
+                               " ends in .json or .jsonl, in the Prometheus"
+                               " text format otherwise")
+                .add_parameter("FILE", [&metrics_file](std::istream& s) {
+                  std::getline(s, metrics_file);
+                  return true;
+                });
+  command_line.add_option('h', "Show this help text", [&command_line](){
+                  command_line.show_help();
+                  exit(EXIT_SUCCESS);
+                });
+  command_line.add_option('i', "Read the thread settings in the [threads]"
+                               " section of the config FILE")
+                .add_parameter("FILE", [](std::istream& s) {
+                  std::string config_file;
+                  std::getline(s, config_file);
+                  ConfigFile config;
+                  return config.load(config_file) &&
+                         ThreadPolicy::load(config);
+                });
+  command_line.add_option('j', "Set the priority and cores of the threads of"
+                               " a role, e.g. ai=low@2-3. Roles: simulation,"
+                               " render, ai, io; priorities: lowest, low,"
+                               " normal, high")
+                .add_parameter("ROLE=PRIORITY[@CORES]", [](std::istream& s) {
+                  std::string spec;
+                  s >> spec;
+                  return ThreadPolicy::parse(spec);
+                });
+  command_line.add_option('k', "Write game lock contention per call site to FILE")
+                .add_parameter("FILE", [&lock_stats_file](std::istream& s) {
+                  std::getline(s, lock_stats_file);
+                  return true;
+                });
+  command_line.add_option('l', "Load saved game")
+                .add_parameter("FILE", [&save_file](std::istream& s) {
+                  std::getline(s, save_file);
+                  return true;
+                });
+  command_line.add_option('m', "Map size for random games (default 3)")
+                .add_parameter("SIZE", [&map_size](std::istream& s) {
+                  s >> map_size;
+                  return (map_size >= 1 && map_size <= max_map_size);
+                });
+  command_line.add_option('n', "Number of ticks to run (default 10000)")
+                .add_parameter("TICKS", [&ticks](std::istream& s) {
+                  s >> ticks;
+                  return (ticks > 0);
+                });
+  command_line.add_option('o', "Write the game result and score history to FILE")
+                .add_parameter("FILE", [&result_file](std::istream& s) {
+                  std::getline(s, result_file);
+                  return true;
+                });
+  command_line.add_option('p', "Write profiler statistics to FILE")
+                .add_parameter("FILE", [&profile_file](std::istream& s) {
+                  std::getline(s, profile_file);
+                  return true;
+                });
+  command_line.add_option('q', "Do not attach AI players",
+                          [&no_ai](){ no_ai = true; });
+  command_line.add_option('r', "Pace ticks at TICK_LENGTH like the real game",
+                          [&real_time](){ real_time = true; });
+  command_line.add_option('s', "Random seed for random games")
+                .add_parameter("SEED", [&seed](std::istream& s) {
+                  s >> seed;
+                  return (seed.length() == 16);
+                });
+  command_line.add_option('t', "Write a trace of the game and AI threads to FILE")
+                .add_parameter("FILE", [&trace_file](std::istream& s) {
+                  std::getline(s, trace_file);
+                  return true;
+                });
+  command_line.add_option('u', "Update every building and flag every tick",
+                          [&sweep_buildings](){ sweep_buildings = true; });
+  command_line.add_option('v', "Write a spectator stream of the game to FILE")
+                .add_parameter("FILE", [&spectator_file](std::istream& s) {
+                  std::getline(s, spectator_file);
+                  return true;
+                });
+  command_line.add_option('w', "Stop early once a player is the clear winner",
+                          [&until_winner](){ until_winner = true; });
+  command_line.add_option('x', "AIPlus options as bits, e.g. 101")
+                .add_parameter("BITS", [&aiplus_options](std::istream& s) {
+                  std::string bits;
+                  s >> bits;
+                  if (bits.empty() || bits.length() > aiplus_options.size() ||
+                      bits.find_first_not_of("01") != std::string::npos) {
+                    return false;
+                  }
+                  aiplus_options = AIPlusOptions(bits);
+                  return true;
+                });
+  command_line.add_option('y', "Replay the commands recorded in FILE")
+                .add_parameter("FILE", [&replay_file](std::istream& s) {
+                  std::getline(s, replay_file);
+                  return true;
+                });
+  command_line.add_option('z', "Pack the save games the AI writes",
+                          [](){
+                            GameStore::get_instance().set_compressed(true);
+                          });
+  command_line.set_comment("Please report bugs to <" PACKAGE_BUGREPORT ">");
+  if (!command_line.process(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  Log::Info["headless"] << "freeserf-headless " << FREESERF_VERSION;
+  ThreadPolicy::apply(ThreadPolicy::RoleSimulation);
+  ThreadPolicy::report();
+  if (!replay_file.empty()) {
+    return replay_game(replay_file);
+  }
+
+  GameManager &game_manager = GameManager::get_instance();
+  std::string game_seed = "-";  // Not known for loaded games
+  GameReplay replay;
+
+  if (!save_file.empty()) {
+    if (!record_file.empty()) {
+      Log::Error["headless"] << "only random games can be recorded";
+      return EXIT_FAILURE;
+    }
+    if (!game_manager.load_game(save_file)) {
+      return EXIT_FAILURE;
+    }
+    Log::Info["headless"] << "loaded game '" << save_file << "'";
+  } else {
+    PGameInfo game_info(new GameInfo(seed.empty() ? Random() : Random(seed)));
+    game_info->set_map_size(map_size);
+    if (all_ai) {
+      // Replace the human player with the first AI character.
+      game_info->get_player(0)->set_character(1);
+    }
+    if (!game_manager.start_game(game_info)) {
+      return EXIT_FAILURE;
+    }
+    game_seed = std::string(game_info->get_random_base());
+    replay.set_setup(*game_info);
+    Log::Info["headless"] << "started random game '"
+                          << game_seed
+                          << "' of size " << map_size;
+  }
+
+  PGame game = game_manager.get_current_game();
+  if (game->get_game_speed() == 0) {
+    game->pause();  // Loaded games start paused, toggle back to running
+  }
+  if (sweep_buildings) {
+    game->set_building_sleep(false);
+    game->set_flag_sleep(false);
+  }
+
+  if (!record_file.empty()) {
+    // Before the AI players start, they place their castles right away.
+    replay.start_recording(game.get());
+  }
+  if (!trace_file.empty()) {
+    Trace::set_thread_name("game");
+    Trace::start(trace_file);
+  }
+  if (watch_update_ms > 0 || watch_ai_loop_ms > 0) {
+    game->get_tick_watchdog()->set_budgets(watch_update_ms, watch_ai_loop_ms);
+  }
+  LockStats::set_enabled(!lock_stats_file.empty());
+  std::vector<AI*> ais;
+  unsigned int ai_count =
+    no_ai ? 0 : GameHost::attach_ai_players(game, aiplus_options, &ais);
+  Log::Info["headless"] << "running " << ticks << " ticks with "
+                        << ai_count << " AI players";
+
+  std::ofstream spectator_stream;
+  std::unique_ptr<SpectatorWriter> spectator;
+  if (!spectator_file.empty()) {
+    spectator_stream.open(spectator_file, std::ios::binary | std::ios::trunc);
+    spectator.reset(new SpectatorWriter(&spectator_stream));
+  }
+  size_t spectator_bytes = 0;
+  unsigned int spectator_frames = 0;
+  auto write_spectator_frame = [&]() {
+    size_t size = 0;
+    if (!spectator->write_frame(game.get(), &size)) {
+      Log::Error["headless"] << "failed to write spectator stream to '"
+                             << spectator_file << "'";
+      spectator.reset();
+      return;
+    }
+    spectator_bytes += size;
+    spectator_frames++;
+  };
+  if (spectator) {
+    write_spectator_frame();
+  }
+  std::unique_ptr<MetricsExporter> metrics;
+  if (!metrics_file.empty()) {
+    metrics.reset(new MetricsExporter(metrics_file, metrics_interval * 1000));
+  }
+  auto write_metrics = [&](bool now) {
+    if (!(now ? metrics->write(game.get(), ais)
+              : metrics->update(game.get(), ais))) {
+      Log::Error["headless"] << "failed to write metrics to '"
+                             << metrics_file << "'";
+      metrics.reset();
+    }
+  };
+
+  typedef std::chrono::steady_clock Clock;
+  Profiler::reset();
+  AllocStats::reset();
+  uint64_t tick_allocs = 0;       // By the game thread only
+  uint64_t most_tick_allocs = 0;
+  Clock::time_point start = Clock::now();
+  Clock::time_point next_tick = start;
+  GameResult result;
+  unsigned int ran = 0;
+  int started_index = -1;  // Player history index when all had castles
+  auto winner = [&game, &started_index]() {
+    if (started_index < 0 ||
+        started_index == game->get_player_history_index(0)) {
+      return -1;
+    }
+    return game->get_clear_winner();
+  };
+  while (ran < ticks) {
+    uint64_t allocs = AllocStats::get_thread_totals().count;
+    game->update();
+    if (AllocStats::enabled) {
+      allocs = AllocStats::get_thread_totals().count - allocs;
+      tick_allocs += allocs;
+      most_tick_allocs = std::max(most_tick_allocs, allocs);
+    }
+    ran++;
+    result.update(game.get());
+    if (started_index < 0 && GameHost::all_players_started(game)) {
+      started_index = game->get_player_history_index(0);
+    }
+    if (spectator && ran % spectator_interval == 0) {
+      write_spectator_frame();
+    }
+    if (metrics) {
+      write_metrics(false);
+    }
+    if (until_winner && winner() >= 0) {
+      break;
+    }
+    if (real_time) {
+      // The AI threads pace themselves in wall time, so AI-only games only
+      // play out as in the real game when the ticks are paced too.
+      next_tick += std::chrono::milliseconds(TICK_LENGTH);
+      std::this_thread::sleep_until(next_tick);
+    }
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  if (metrics) {
+    write_metrics(true);
+  }
+  game->stop_ai_threads();
+  game->get_tick_watchdog()->wait();
+  if (spectator) {
+    Log::Info["headless"] << "wrote " << spectator_frames
+                          << " spectator frames, " << spectator_bytes
+                          << " bytes";
+  }
+  if (!trace_file.empty()) {
+    Trace::stop();
+    if (!Trace::write()) {
+      Log::Error["headless"] << "failed to write trace to '"
+                             << trace_file << "'";
+    }
+  }
+  if (!lock_stats_file.empty() &&
+      !LockStats::write_report(lock_stats_file)) {
+    Log::Error["headless"] << "failed to write lock statistics to '"
+                           << lock_stats_file << "'";
+  }
+  if (!memory_file.empty()) {
+    // As of the last loop each AI finished
+    MemoryUsage usage;
+    game->add_memory_usage(&usage);
+    for (AI *ai : ais) {
+      std::shared_ptr<const MemoryUsage> ai_usage = ai->get_memory_usage();
+      if (ai_usage) {
+        usage.add(*ai_usage);
+      }
+    }
+    if (!usage.write_report(memory_file)) {
+      Log::Error["headless"] << "failed to write memory usage to '"
+                             << memory_file << "'";
+    }
+  }
+  if (!record_file.empty()) {
+    replay.stop_recording(game.get());
+    std::ofstream stream(record_file, std::ios::binary);
+    if (!replay.write(&stream)) {
+      Log::Error["headless"] << "failed to write replay to '"
+                             << record_file << "'";
+    }
+  }
+
+  Log::Info["headless"] << "ran " << ran << " ticks in " << std::fixed
+                        << std::setprecision(3) << elapsed << " s ("
+                        << ((elapsed > 0.) ? ran / elapsed : 0.)
+                        << " ticks/s), game tick " << game->get_tick()
+                        << ", peak resident "
+                        << MemoryUsage::get_peak_resident_bytes() / 1048576.
+                        << " MB";
+  std::stringstream report;
+  Profiler::write_report(&report);
+  std::string line;
+  while (std::getline(report, line)) {
+    Log::Info["headless"] << line;
+  }
+  if (AllocStats::enabled) {
+    Log::Info["headless"] << "game thread allocations per tick "
+                          << std::fixed << std::setprecision(2)
+                          << ((ran > 0) ? static_cast<double>(tick_allocs) /
+                                          ran : 0.)
+                          << ", most " << most_tick_allocs;
+    std::stringstream allocs;
+    AllocStats::write_report(&allocs, ran);
+    while (std::getline(allocs, line)) {
+      Log::Info["headless"] << line;
+    }
+  }
+  if (!profile_file.empty() && !Profiler::write_report(profile_file)) {
+    Log::Error["headless"] << "failed to write profile to '"
+                           << profile_file << "'";
+  }
+  if (!result_file.empty()) {
+    result.seed = game_seed;
+    result.map_size = game->get_map()->get_size();
+    result.options = aiplus_options.to_string();
+    result.ticks = ran;
+    result.game_tick = game->get_tick();
+    result.seconds = elapsed;
+    result.winner = winner();
+    std::ofstream stream(result_file);
+    if (!result.write(&stream)) {
+      Log::Error["headless"] << "failed to write result to '"
+                             << result_file << "'";
+    }
+  }
+
+  // Give the AI players a moment to leave; anything still running is torn
+  // down with the process.
+  if (!GameHost::stop_ai_players(game, &ais, 10000)) {
+    Log::flush();
+    std::quick_exit(EXIT_SUCCESS);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -21,8 +21,12 @@
 
 #include "src/interface.h"
 
+#include <algorithm>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
+#include <sstream>
+#include <string>
 #include <utility>
 #include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for AI threads
 #include <vector>   //to satisfy cpplinter
@@ -41,6 +45,8 @@
 #include "src/savegame.h"
 #include "src/lookup.h"
 #include "src/ai.h"
+#include "src/event_loop.h"
+#include "src/trace.h"
 
 // Interval between automatic save games
 #define AUTOSAVE_INTERVAL  (10*60*TICKS_PER_SEC)
@@ -50,7 +56,10 @@ Interface::Interface()
   , sfx_queue{0}
   , water_in_view(false)
   , trees_in_view(false)
-  , return_pos(0) {
+  , return_pos(0)
+  , fast_forwarding(false)
+  , fast_forward_target(0)
+  , fast_forward_start_tick(0) {
   displayed = true;
 
   game = nullptr;
@@ -237,8 +246,8 @@ Interface::initialize_AI() {
       game->ai_thread_starting();
       // store AI pointer in game so it can be fetched by other functions (viewport, at least, for AI overlay)
       set_ai_ptr(index, ai);
-      std::thread ai_thread(&AI::start, ai);
-      ai_thread.detach();
+      // queue it on the shared AI worker pool
+      ai->start();
     }
     index++;
     player = game->get_player(index);
@@ -555,7 +564,7 @@ Interface::set_player(unsigned int player_index) {
     add_float(panel, 0, 0);
     layout();
 
-    for (Building *building : game->get_player_buildings(player)) {
+    for (Building *building : game->get_owned_buildings(player)) {
       if (building->get_type() == Building::TypeCastle) {
         init_pos = building->get_position();
       }
@@ -860,6 +869,10 @@ Interface::layout() {
 /* Called periodically when the game progresses. */
 void
 Interface::update() {
+  if (init_box != nullptr && init_box->is_displayed()) {
+    init_box->update_map_preview();
+  }
+
   if (!game) {
     return;
   }
@@ -911,8 +924,86 @@ Interface::update() {
     }
   }
 
+  /* Objects mark themselves damaged when the tick changed what they show,
+     a paused game or a still view then leaves the frame as it is. */
   viewport->update();
+  if (popup != nullptr) {
+    popup->update_chart();
+  }
+
+  if (fast_forwarding && fast_forward_target != 0 &&
+      game->get_const_tick() >= fast_forward_target) {
+    stop_fast_forward();
+  }
+}
+
+void
+Interface::fast_forward(unsigned int ticks) {
+  if (!game) {
+    return;
+  }
+  fast_forwarding = true;
+  fast_forward_start_tick = game->get_const_tick();
+  fast_forward_target = (ticks > 0) ? fast_forward_start_tick + ticks : 0;
+  fast_forward_start = std::chrono::steady_clock::now();
+  Log::Info["interface"] << "fast forwarding from tick "
+                         << fast_forward_start_tick;
+  EventLoop::get_instance().set_fast_forward(true);
+}
+
+void
+Interface::stop_fast_forward() {
+  if (!fast_forwarding) {
+    return;
+  }
+  fast_forwarding = false;
+  EventLoop::get_instance().set_fast_forward(false);
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - fast_forward_start).count();
+  unsigned int ticks = game->get_const_tick() - fast_forward_start_tick;
+  Log::Info["interface"] << "fast forwarded " << ticks << " ticks in "
+                         << seconds << " s, to game tick "
+                         << game->get_tick();
+  // nothing was drawn meanwhile, what is on screen is long gone
   set_redraw();
+  if (viewport != nullptr) {
+    viewport->set_redraw();
+  }
+}
+
+// Instead of the viewport, panel and popups, which are not drawn while
+//  fast forwarding
+void
+Interface::draw_fast_forward(Frame *frame) {
+  unsigned int now_tick = game->get_const_tick();
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - fast_forward_start).count();
+  unsigned int ticks = now_tick - fast_forward_start_tick;
+
+  std::vector<std::string> lines;
+  std::stringstream line;
+  line << std::fixed << std::setprecision(0);
+  line << "Fast forward, tick " << now_tick;
+  if (fast_forward_target != 0) {
+    line << " of " << fast_forward_target << " ("
+         << 100. * ticks / (fast_forward_target - fast_forward_start_tick)
+         << "%)";
+  }
+  lines.push_back(line.str());
+  line.str("");
+  line << ((seconds > 0.) ? ticks / seconds : 0.) << " ticks/s, "
+       << game->get_serf_count() << " serfs, " << game->get_flag_count()
+       << " flags, " << game->get_building_count() << " buildings";
+  lines.push_back(line.str());
+  lines.push_back("Press any key to stop");
+
+  frame->fill_rect(0, 0, width, height, mark_colors[MarkBlack]);
+  int y = height / 2 - 15;
+  for (const std::string &text : lines) {
+    int x = (width - 8 * static_cast<int>(text.length())) / 2;
+    frame->draw_string(std::max(0, x), y, text, mark_colors[MarkWhite]);
+    y += 10;
+  }
 }
 
 bool
@@ -991,6 +1082,34 @@ Interface::handle_key_pressed(char key, int modifier) {
     viewport->switch_layer(Viewport::LayerAI);
     break;
   }
+  /* AI timings - where each AI player's last loops spent their time */
+  case 'u': {
+    viewport->switch_layer(Viewport::LayerAIStats);
+    break;
+  }
+  /* Performance - frame and tick times, draw calls, caches and objects */
+  case 'h': {
+    viewport->switch_layer(Viewport::LayerPerf);
+    break;
+  }
+  /* Fast forward until the next key */
+  case 'f': {
+    fast_forward(0);
+    break;
+  }
+  /* Write the trace recorded so far, when freeserf was started with -t */
+  case 't': {
+    if (!Trace::is_active()) {
+      return false;
+    }
+    if (Trace::write()) {
+      Log::Info["interface"] << "wrote trace to '" << Trace::get_path() << "'";
+    } else {
+      Log::Error["interface"] << "could not write trace to '"
+                              << Trace::get_path() << "'";
+    }
+    break;
+  }
   /* Weather feature test.  */
   /* tlongstretch experimental 
   case 'w': {
@@ -1054,7 +1173,28 @@ Interface::handle_event(const Event *event) {
     case Event::TypeUpdate:
       update();
       break;
+    case Event::TypeKeyPressed:
+    case Event::TypeClick:
+      if (fast_forwarding) {
+        stop_fast_forward();
+        break;
+      }
+      return GuiObject::handle_event(event);
     case Event::TypeDraw:
+      if (fast_forwarding) {
+        draw_fast_forward(reinterpret_cast<Frame*>(event->object));
+        break;
+      }
+      /* Frames come more often than updates, keep serfs moving in them */
+      if (viewport != nullptr && viewport->is_sliding()) {
+        viewport->set_redraw();
+      }
+      /* The screen still shows the last frame; leave it if nothing in
+         it would come out different. */
+      if (!is_damaged()) {
+        return false;
+      }
+      clear_damaged();
       draw(reinterpret_cast<Frame*>(event->object));
       break;
 
@@ -1073,5 +1213,6 @@ Interface::on_new_game(PGame new_game) {
 
 void
 Interface::on_end_game(PGame /*game*/) {
+  stop_fast_forward();
   set_game(nullptr);
 }
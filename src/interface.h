@@ -22,6 +22,8 @@
 #ifndef SRC_INTERFACE_H_
 #define SRC_INTERFACE_H_
 
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
 #include "src/misc.h"
 #include "src/random.h"
 #include "src/map.h"
@@ -109,6 +111,13 @@ class Interface : public GuiObject, public GameManager::Handler {
   int return_timeout;
   int return_pos;
 
+  // while fast forwarding, the const tick to stop at, 0 to go on until a
+  //  key or a click, and where and when it started
+  bool fast_forwarding;
+  unsigned int fast_forward_target;
+  unsigned int fast_forward_start_tick;
+  std::chrono::steady_clock::time_point fast_forward_start;
+
   // tlongstretch
   AI *ai_ptrs[5] = { NULL, NULL, NULL, NULL, NULL };
   AIPlusOptions aiplus_options;
@@ -183,6 +192,13 @@ class Interface : public GuiObject, public GameManager::Handler {
 
   void update();
 
+  // Run the game as fast as it goes, drawing only a progress frame, for
+  //  ticks updates or, with 0, until a key is pressed.  The AI players keep
+  //  to their CPU budget, which is paid in game ticks.
+  void fast_forward(unsigned int ticks);
+  void stop_fast_forward();
+  bool is_fast_forwarding() const { return fast_forwarding; }
+
   virtual bool handle_event(const Event *event);
 
   // tlongstretch
@@ -204,6 +220,9 @@ class Interface : public GuiObject, public GameManager::Handler {
   static void update_map_height(MapPos pos, void *data);
 
   virtual void internal_draw();
+  // only the viewport, panel and boxes on top of it are drawn
+  virtual bool draws_content() const { return false; }
+  void draw_fast_forward(Frame *frame);
   virtual void layout();
   virtual bool handle_key_pressed(char key, int modifier);
 
@@ -56,6 +56,13 @@ Inventory::~Inventory() {
   game->add_gold_total(-static_cast<int>(resources[Resource::TypeGoldOre]));
 }
 
+void
+Inventory::set_owner(unsigned int new_owner) {
+  unsigned int old_owner = owner;
+  owner = new_owner;
+  game->owner_changed(this, old_owner);
+}
+
 void
 Inventory::push_resource(Resource::Type resource) {
   resources[resource] += (resources[resource] < 50000) ? 1 : 0;
@@ -398,6 +405,32 @@ Inventory::serf_idle_in_stock(Serf *serf) {
   serfs[serf->get_type()] = serf->get_index();
 }
 
+void
+Inventory::add_idle_serf(Serf *serf) {
+  if (serf->get_type() != Serf::TypeNone) {
+    idle_serfs[serf->get_type()].push_back(serf->get_index());
+  }
+}
+
+void
+Inventory::remove_idle_serf(Serf *serf) {
+  if (serf->get_type() == Serf::TypeNone) {
+    return;
+  }
+  std::vector<unsigned int> &roster = idle_serfs[serf->get_type()];
+  auto it = std::find(roster.begin(), roster.end(), serf->get_index());
+  if (it != roster.end()) {
+    roster.erase(it);
+  }
+}
+
+void
+Inventory::clear_idle_serfs() {
+  for (std::vector<unsigned int> &roster : idle_serfs) {
+    roster.clear();
+  }
+}
+
 void
 Inventory::knight_training(Serf *serf, int p) {
   Serf::Type old_type = serf->get_type();
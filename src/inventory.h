@@ -59,13 +59,15 @@ class Inventory : public GameObject {
   int res_dir;
   /* Indices to serfs of each type */
   Serf::SerfMap serfs;
+  // All the serfs idle here, by type, in the order they came. Kept by Serf.
+  std::vector<unsigned int> idle_serfs[Serf::TypeDead + 1];
 
  public:
   Inventory(Game *game, unsigned int index);
   virtual ~Inventory();
 
   unsigned int get_owner() { return owner; }
-  void set_owner(unsigned int owner) { this->owner = owner; }
+  void set_owner(unsigned int owner);
 
   int get_flag_index() { return flag; }
   void set_flag_index(int flag_index) { flag = flag_index; }
@@ -90,6 +92,11 @@ class Inventory : public GameObject {
   void serf_come_back() { generic_count++; }
   size_t free_serf_count() { return generic_count; }
   bool have_serf(Serf::Type type) { return (serfs[type] != 0); }
+  const std::vector<unsigned int> &get_idle_serfs(Serf::Type type) const {
+    return idle_serfs[type]; }
+  void add_idle_serf(Serf *serf);
+  void remove_idle_serf(Serf *serf);
+  void clear_idle_serfs();
 
   unsigned int get_count_of(Resource::Type resource) {
     return resources[resource]; }
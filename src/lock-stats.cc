@@ -0,0 +1,234 @@
+/*
+ * lock-stats.cc - Contention of locks by the place they are taken
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/lock-stats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+namespace {
+
+typedef struct SiteName {
+  std::string function;
+  std::string file;
+  int line;
+} SiteName;
+
+typedef struct SiteCounters {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> contended;
+  std::atomic<uint64_t> wait_total_ns;
+  std::atomic<uint64_t> wait_max_ns;
+  std::atomic<uint64_t> hold_total_ns;
+  std::atomic<uint64_t> hold_max_ns;
+} SiteCounters;
+
+// Sites are made from function statics all over, so the registry is
+// created on first use. Counters are shared by the threads taking a lock at
+// the same site, which already contend for the lock itself.
+typedef struct Registry {
+  std::mutex mutex;
+  std::vector<SiteName> names;
+  SiteCounters counters[LockStats::max_sites];
+} Registry;
+
+Registry &
+get_registry() {
+  static Registry registry;
+  return registry;
+}
+
+void
+store_max(std::atomic<uint64_t> *max, uint64_t value) {
+  uint64_t current = max->load(std::memory_order_relaxed);
+  while (value > current &&
+         !max->compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {}
+}
+
+// The build puts full paths into __FILE__
+std::string
+base_name(const char *path) {
+  const char *slash = std::strrchr(path, '/');
+  const char *backslash = std::strrchr(path, '\\');
+  const char *last = std::max(slash, backslash);
+  return (last != nullptr) ? last + 1 : path;
+}
+
+}  // namespace
+
+std::atomic<bool> LockStats::enabled(false);
+const unsigned int LockStats::max_sites;
+
+LockStats::Site::Site(const char *function, const char *file, int line) {
+  Registry &registry = get_registry();
+  std::vector<SiteName> &names = registry.names;
+  std::string file_name = base_name(file);
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (id = 0; id < names.size(); id++) {
+    if (names[id].line == line && names[id].file == file_name) return;
+  }
+  if (names.size() == max_sites - 1) {
+    names.push_back(SiteName{ "other", "", 0 });
+  }
+  if (names.size() >= max_sites) {
+    id = max_sites - 1;
+    return;
+  }
+  names.push_back(SiteName{ function, file_name, line });
+}
+
+void
+LockStats::Mutex::acquire(const Site *site_, uint64_t wait_ns) {
+  site = site_;
+  acquired_at = Clock::now();
+  acquired(*site, wait_ns);
+}
+
+void
+LockStats::Mutex::lock(const Site &site_) {
+  if (!is_enabled()) {
+    lock();
+    return;
+  }
+  if (mutex.try_lock()) {
+    acquire(&site_, 0);
+    return;
+  }
+  Clock::time_point start = Clock::now();
+  mutex.lock();
+  acquire(&site_, ns_between(start, Clock::now()));
+}
+
+bool
+LockStats::Mutex::try_lock(const Site &site_) {
+  if (!mutex.try_lock()) return false;
+  if (is_enabled()) {
+    acquire(&site_, 0);
+  } else {
+    site = nullptr;
+  }
+  return true;
+}
+
+void
+LockStats::Mutex::unlock() {
+  if (site != nullptr) {
+    released(*site, ns_between(acquired_at, Clock::now()));
+    site = nullptr;
+  }
+  mutex.unlock();
+}
+
+void
+LockStats::acquired(const Site &site, uint64_t wait_ns) {
+  SiteCounters &counters = get_registry().counters[site.get_id()];
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  counters.count.fetch_add(1, relaxed);
+  if (wait_ns > 0) {
+    counters.contended.fetch_add(1, relaxed);
+    counters.wait_total_ns.fetch_add(wait_ns, relaxed);
+    store_max(&counters.wait_max_ns, wait_ns);
+  }
+}
+
+void
+LockStats::released(const Site &site, uint64_t hold_ns) {
+  SiteCounters &counters = get_registry().counters[site.get_id()];
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  counters.hold_total_ns.fetch_add(hold_ns, relaxed);
+  store_max(&counters.hold_max_ns, hold_ns);
+}
+
+std::vector<LockStats::Stats>
+LockStats::get_stats() {
+  std::vector<Stats> result;
+  const std::memory_order relaxed = std::memory_order_relaxed;
+
+  Registry &registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (unsigned int s = 0; s < registry.names.size(); s++) {
+    const SiteCounters &counters = registry.counters[s];
+    uint64_t count = counters.count.load(relaxed);
+    if (count == 0) continue;
+    const SiteName &name = registry.names[s];
+    result.push_back(Stats{ name.function, name.file, name.line, count,
+                            counters.contended.load(relaxed),
+                            counters.wait_total_ns.load(relaxed),
+                            counters.wait_max_ns.load(relaxed),
+                            counters.hold_total_ns.load(relaxed),
+                            counters.hold_max_ns.load(relaxed) });
+  }
+  std::sort(result.begin(), result.end(), [](const Stats &a, const Stats &b) {
+    return (a.wait_total_ns != b.wait_total_ns) ?
+           (a.wait_total_ns > b.wait_total_ns) :
+           (a.hold_total_ns > b.hold_total_ns); });
+  return result;
+}
+
+// Locks taken while resetting may be counted in either window
+void
+LockStats::reset() {
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  for (SiteCounters &counters : get_registry().counters) {
+    counters.count.store(0, relaxed);
+    counters.contended.store(0, relaxed);
+    counters.wait_total_ns.store(0, relaxed);
+    counters.wait_max_ns.store(0, relaxed);
+    counters.hold_total_ns.store(0, relaxed);
+    counters.hold_max_ns.store(0, relaxed);
+  }
+}
+
+void
+LockStats::write_report(std::ostream *os) {
+  *os << std::left << std::setw(52) << "site" << std::right
+      << std::setw(10) << "count" << std::setw(10) << "waited"
+      << std::setw(12) << "wait ms" << std::setw(12) << "max wait us"
+      << std::setw(12) << "hold ms" << std::setw(12) << "max hold us"
+      << "\n";
+  *os << std::fixed << std::setprecision(3);
+  for (const Stats &stats : get_stats()) {
+    std::string site = stats.function;
+    if (!stats.file.empty()) {
+      site += " " + stats.file + ":" + std::to_string(stats.line);
+    }
+    *os << std::left << std::setw(52) << site << std::right
+        << std::setw(10) << stats.count
+        << std::setw(10) << stats.contended
+        << std::setw(12) << stats.wait_total_ns / 1000000.
+        << std::setw(12) << stats.wait_max_ns / 1000.
+        << std::setw(12) << stats.hold_total_ns / 1000000.
+        << std::setw(12) << stats.hold_max_ns / 1000. << "\n";
+  }
+}
+
+bool
+LockStats::write_report(const std::string &path) {
+  std::ofstream file(path.c_str());
+  if (!file.is_open()) {
+    return false;
+  }
+  write_report(&file);
+  return file.good();
+}
@@ -0,0 +1,158 @@
+/*
+ * lock-stats.h - Contention of locks by the place they are taken
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_LOCK_STATS_H_
+#define SRC_LOCK_STATS_H_
+
+#include <atomic>
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <cstdint>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// How often each place in the code took a lock, how long it waited for it
+// and how long it held it. Locks that take a Site, GameLock and
+// LockStats::Mutex, record into it while statistics are enabled; until then
+// taking them costs one load more than the plain lock.
+class LockStats {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  static const unsigned int max_sites = 256;
+
+  typedef struct Stats {
+    std::string function;
+    std::string file;
+    int line;
+    uint64_t count;
+    uint64_t contended;      // had to wait
+    uint64_t wait_total_ns;
+    uint64_t wait_max_ns;
+    uint64_t hold_total_ns;
+    uint64_t hold_max_ns;
+  } Stats;
+
+  // A place where a lock is taken, made once by LOCK_SITE.
+  class Site {
+   protected:
+    unsigned int id;
+
+   public:
+    Site(const char *function, const char *file, int line);
+    unsigned int get_id() const { return id; }
+  };
+
+  // A std::mutex that records like GameLock. Holds are tracked in the
+  // mutex, which only its holder writes.
+  class Mutex {
+   protected:
+    std::mutex mutex;
+    const Site *site;
+    Clock::time_point acquired_at;
+
+    void acquire(const Site *site, uint64_t wait_ns);
+
+   public:
+    Mutex() : site(nullptr) {}
+
+    void lock() { mutex.lock(); site = nullptr; }
+    bool try_lock() {
+      if (!mutex.try_lock()) return false;
+      site = nullptr;
+      return true;
+    }
+    void lock(const Site &site);
+    bool try_lock(const Site &site);
+    void unlock();
+  };
+
+  // Takes lockable at site for the enclosing scope, see LOCK_SCOPE.
+  template <class Lockable> class ScopedLock {
+   protected:
+    Lockable &lockable;
+
+   public:
+    ScopedLock(Lockable &lockable, const Site &site) : lockable(lockable) {
+      lockable.lock(site);
+    }
+    ~ScopedLock() { lockable.unlock(); }
+    ScopedLock(const ScopedLock&) = delete;
+    ScopedLock &operator=(const ScopedLock&) = delete;
+  };
+  template <class Lockable> class ScopedSharedLock {
+   protected:
+    Lockable &lockable;
+
+   public:
+    ScopedSharedLock(Lockable &lockable, const Site &site)
+      : lockable(lockable) {
+      lockable.lock_shared(site);
+    }
+    ~ScopedSharedLock() { lockable.unlock_shared(); }
+    ScopedSharedLock(const ScopedSharedLock&) = delete;
+    ScopedSharedLock &operator=(const ScopedSharedLock&) = delete;
+  };
+
+  static bool is_enabled() {
+    return enabled.load(std::memory_order_relaxed); }
+  static void set_enabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed); }
+
+  // Counted when taken, so locks that are never given back show too
+  static void acquired(const Site &site, uint64_t wait_ns);
+  static void released(const Site &site, uint64_t hold_ns);
+
+  // Sites that took their lock since the last reset, longest waits first.
+  static std::vector<Stats> get_stats();
+  static void reset();
+
+  static void write_report(std::ostream *os);
+  static bool write_report(const std::string &path);
+
+  static uint64_t ns_between(Clock::time_point start, Clock::time_point end) {
+    return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                  end - start).count());
+  }
+
+ protected:
+  static std::atomic<bool> enabled;
+};
+
+#define LOCK_STATS_CONCAT_(a, b) a##b
+#define LOCK_STATS_CONCAT(a, b) LOCK_STATS_CONCAT_(a, b)
+/* The Site of the calling line, made the first time it runs. */
+#define LOCK_SITE() \
+  ([](const char *function) -> const LockStats::Site & { \
+    static const LockStats::Site site(function, __FILE__, __LINE__); \
+    return site; }(__func__))
+/* Hold LOCKABLE, exclusively or shared, for the rest of the scope. */
+#define LOCK_SCOPE(LOCKABLE) \
+  LockStats::ScopedLock<std::remove_reference<decltype(LOCKABLE)>::type> \
+    LOCK_STATS_CONCAT(lock_scope_, __LINE__)(LOCKABLE, LOCK_SITE())
+#define LOCK_SCOPE_SHARED(LOCKABLE) \
+  LockStats::ScopedSharedLock<std::remove_reference<decltype(LOCKABLE)>::type> \
+    LOCK_STATS_CONCAT(lock_scope_, __LINE__)(LOCKABLE, LOCK_SITE())
+
+#endif  // SRC_LOCK_STATS_H_
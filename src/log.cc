@@ -21,7 +21,14 @@
 
 #include "src/log.h"
 
+#include <condition_variable>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <cstdint>
 #include <iostream>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <set>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <utility>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -58,6 +65,118 @@ Log::~Log() {
 #endif  // WIN32
 }
 
+static bool log_writer_stopped = false;
+
+// Writes queued log lines from its own thread, a batch at a time, flushing
+// each stream once per batch. Lines go out in the order they were queued.
+class LogWriter {
+ protected:
+  typedef std::pair<std::ostream*, std::string> Line;
+
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::condition_variable written;
+  std::vector<Line> pending;
+  std::vector<Line> batch;
+  uint64_t queued_count;
+  uint64_t written_count;
+  bool stopping;
+  std::thread thread;
+
+ public:
+  LogWriter() : queued_count(0), written_count(0), stopping(false) {
+    thread = std::thread(&LogWriter::run, this);
+  }
+
+  ~LogWriter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    queued.notify_one();
+    thread.join();
+    log_writer_stopped = true;
+  }
+
+  void push(std::ostream *stream, const std::string &line) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.push_back(std::make_pair(stream, line));
+      queued_count++;
+    }
+    queued.notify_one();
+  }
+
+  void flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t target = queued_count;
+    written.wait(lock, [&]() { return written_count >= target; });
+  }
+
+ protected:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      queued.wait(lock, [&]() { return stopping || !pending.empty(); });
+      if (pending.empty() && stopping) {
+        return;
+      }
+      batch.swap(pending);
+      lock.unlock();
+
+      std::set<std::ostream*> streams;
+      for (const Line &line : batch) {
+        *line.first << line.second;
+        streams.insert(line.first);
+      }
+      for (std::ostream *stream : streams) {
+        stream->flush();
+      }
+
+      lock.lock();
+      written_count += batch.size();
+      batch.clear();
+      written.notify_all();
+    }
+  }
+};
+
+// Started on first use, so that it outlives every logger that writes to it.
+static LogWriter &
+log_writer() {
+  static LogWriter writer;
+  return writer;
+}
+
+Log::Stream::~Stream() {
+  if (stream == nullptr) {
+    return;
+  }
+  *line << '\n';
+  Log::write(stream, line->str());
+  if (wait) {
+    Log::flush();
+  }
+}
+
+void
+Log::write(std::ostream *stream, const std::string &line) {
+  // Anything logged while the program exits goes straight to the stream.
+  if (log_writer_stopped) {
+    *stream << line;
+    stream->flush();
+    return;
+  }
+  log_writer().push(stream, line);
+}
+
+void
+Log::flush() {
+  if (!log_writer_stopped) {
+    log_writer().flush();
+  }
+}
+
 void
 Log::set_file(std::ostream *_stream) {
   stream = _stream;
@@ -35,7 +35,9 @@
 #ifndef SRC_LOG_H_
 #define SRC_LOG_H_
 
+#include <memory>
 #include <ostream>
+#include <sstream>
 #include <string>
 
 class Log {
@@ -51,26 +53,42 @@ class Log {
     LevelMax
   } Level;
 
+  // One log line. It is put together here and handed to the writer thread
+  // in one piece when the Stream goes away, so lines from several threads
+  // never mix and the caller doesn't wait on the file. A Stream for a level
+  // that is off has no stream and ignores everything given to it.
   class Stream {
    protected:
     std::ostream *stream;
+    std::unique_ptr<std::ostringstream> line;
+    bool wait;
 
    public:
-    explicit Stream(std::ostream *_stream) : stream(_stream) {}
-    ~Stream() {
-      *stream << std::endl;
-      stream->flush();
+    explicit Stream(std::ostream *_stream, bool _wait = false)
+      : stream(_stream), wait(_wait) {
+      if (stream != nullptr) {
+        line.reset(new std::ostringstream());
+      }
+    }
+    Stream(Stream &&other)
+      : stream(other.stream), line(std::move(other.line)), wait(other.wait) {
+      other.stream = nullptr;
     }
+    ~Stream();
 
     std::ostream *get_stream() { return stream; }
 
     template <class T> Stream & operator << (const T &val) {
-      *stream << val;
+      if (stream != nullptr) {
+        *line << val;
+      }
       return *this;
     }
 
     Stream & operator << (const char val[]) {
-      *stream << std::string(val);
+      if (stream != nullptr) {
+        *line << val;
+      }
       return *this;
     }
   };
@@ -82,16 +100,31 @@ class Log {
     std::ostream *stream;
     static std::ostream dummy;
 
+    Stream start_line(const char *subsystem) {
+      if (stream == &dummy) {
+        return Stream(nullptr);
+      }
+      // Errors and warnings are written out before the caller goes on, in
+      // case it is about to stop.
+      Stream line(stream, level >= LevelWarn);
+      line << prefix << ": [" << subsystem << "] ";
+      return line;
+    }
+
    public:
     explicit Logger(Level _level, std::string _prefix)
       : level(_level), prefix(_prefix), stream(nullptr) {
       apply_level();
     }
 
-    virtual Stream operator[](std::string subsystem) {
-      *stream << prefix << ": [" << subsystem << "] ";
-      return Stream(stream);
+    virtual Stream operator[](const char *subsystem) {
+      return start_line(subsystem);
     }
+    virtual Stream operator[](const std::string &subsystem) {
+      return start_line(subsystem.c_str());
+    }
+
+    bool is_enabled() const { return (stream != &dummy); }
 
     void apply_level() {
       if (level < Log::level) {
@@ -107,6 +140,10 @@ class Log {
 
   static void set_file(std::ostream *stream);
   static void set_level(Log::Level level);
+  // Queue a finished line for the writer thread.
+  static void write(std::ostream *stream, const std::string &line);
+  // Wait until every line queued so far is written and flushed.
+  static void flush();
 
   static Logger Verbose;
   static Logger Debug;
@@ -6,6 +6,7 @@
 #ifndef SRC_LOOKUP_H_
 #define SRC_LOOKUP_H_
 
+#include <algorithm>    // for ColorDotMap
 #include <bitset>      // used for RoadOptions bools
 #include <set>        // for MapPosSet typedef
 #include <vector>      // for MapPosVector typedef
@@ -423,23 +424,84 @@ const unsigned int slots_garrison[5] = { 1,3,6,9,12 };
 typedef std::set<std::pair<MapPos, unsigned int>> MapPosSet;
 typedef std::vector<MapPos> MapPosVector;
 
-// for AI overlay debugging markers
-typedef const std::map<std::string, Color> Colors;
-const Colors colors = {
-{ "black", Color(0x00,0x00,0x00)} ,  { "white", Color(0xFF,0xFF,0xFF)} ,  { "lt_brown", Color(0xD2, 0xB4, 0x8C)} ,  { "lt_red", Color(0xFF,0x99,0x99)} ,
-{ "lt_orange", Color(0xFF,0xCC,0x99)} ,  { "lt_yellow", Color(0xFF,0xFF,0x99)} ,  { "lt_lime", Color(0xCC,0xFF,0x99)} ,  { "lt_green", Color(0x99,0xFF,0x99)} ,
-{ "lt_seafoam", Color(0x99,0xFF,0xCC)} ,  { "lt_cyan", Color(0x99,0xFF,0xFF)} ,  { "lt_lavender", Color(0x99,0xCC,0xFF)} ,  { "lt_blue", Color(0x99,0x99,0xFF)} ,
-{ "lt_purple", Color(0xCC,0x99,0xFF)} ,  { "lt_magenta", Color(0xFF,0x99,0xFF)} ,  { "lt_coral", Color(0xFF,0x99,0xCC)} ,  { "lt_gray", Color(0xE0,0xE0,0xE0)} ,
-{ "brown", Color(0xA0, 0x52, 0x2D)} ,  { "red", Color(0xFF,0x00,0x00)} ,  { "orange", Color(0xFF,0x80,0x00)} ,  { "yellow", Color(0xFF,0xFF,0x00)} ,
-{ "lime", Color(0x80,0xFF,0x00)} ,  { "green", Color(0x00,0xFF,0x00)} ,  { "seafoam", Color(0x00,0xFF,0x80)} ,  { "cyan", Color(0x00,0xFF,0xFF)} ,
-{ "lavender", Color(0x00,0x80,0xFF)} ,  { "blue", Color(0x00,0x00,0xFF)} ,  { "purple", Color(0x7F,0x00,0xFF)} ,  { "magenta", Color(0xFF,0x00,0xFF)} ,
-{ "coral", Color(0xFF,0x00,0x7F)} ,  { "gray", Color(0x80,0x80,0x80)} ,  { "dk_brown", Color(0x8B, 0x45, 0x13)} ,  { "dk_red", Color(0xCC,0x00,0x00)} ,
-{ "dk_orange", Color(0xCC,0x66,0x00)} ,  { "dk_yellow", Color(0xCC,0xCC,0x00)} ,  { "dk_lime", Color(0x66,0xCC,0x00)} ,  { "dk_green", Color(0x00,0xCC,0x00)} ,
-{ "dk_seafoam", Color(0x00,0xCC,0x66)} ,  { "dk_cyan", Color(0x00,0xCC,0xCC)} ,  { "dk_lavender", Color(0x00,0x66,0xCC)} ,  { "dk_blue", Color(0x00,0x00,0xCC)} ,
-{ "dk_purple", Color(0x66,0x00,0xCC)} ,  { "dk_magenta", Color(0xCC,0x00,0xCC)} ,  { "dk_coral", Color(0xCC,0x00,0x66)} ,  { "dk_gray", Color(0x60,0x60,0x60)} ,
+// for AI overlay debugging markers.  Marks are by index, NameMarkColor is only
+//  for logging
+typedef enum MarkColor {
+  MarkBlack = 0, MarkWhite, MarkLtBrown, MarkLtRed,
+  MarkLtOrange, MarkLtYellow, MarkLtLime, MarkLtGreen,
+  MarkLtSeafoam, MarkLtCyan, MarkLtLavender, MarkLtBlue,
+  MarkLtPurple, MarkLtMagenta, MarkLtCoral, MarkLtGray,
+  MarkBrown, MarkRed, MarkOrange, MarkYellow,
+  MarkLime, MarkGreen, MarkSeafoam, MarkCyan,
+  MarkLavender, MarkBlue, MarkPurple, MarkMagenta,
+  MarkCoral, MarkGray, MarkDkBrown, MarkDkRed,
+  MarkDkOrange, MarkDkYellow, MarkDkLime, MarkDkGreen,
+  MarkDkSeafoam, MarkDkCyan, MarkDkLavender, MarkDkBlue,
+  MarkDkPurple, MarkDkMagenta, MarkDkCoral, MarkDkGray,
+  MarkColorCount
+} MarkColor;
+const std::string NameMarkColor[] = {
+  "black", "white", "lt_brown", "lt_red",
+  "lt_orange", "lt_yellow", "lt_lime", "lt_green",
+  "lt_seafoam", "lt_cyan", "lt_lavender", "lt_blue",
+  "lt_purple", "lt_magenta", "lt_coral", "lt_gray",
+  "brown", "red", "orange", "yellow",
+  "lime", "green", "seafoam", "cyan",
+  "lavender", "blue", "purple", "magenta",
+  "coral", "gray", "dk_brown", "dk_red",
+  "dk_orange", "dk_yellow", "dk_lime", "dk_green",
+  "dk_seafoam", "dk_cyan", "dk_lavender", "dk_blue",
+  "dk_purple", "dk_magenta", "dk_coral", "dk_gray",
+};
+const Color mark_colors[] = {
+  Color(0x00,0x00,0x00), Color(0xFF,0xFF,0xFF), Color(0xD2, 0xB4, 0x8C), Color(0xFF,0x99,0x99),
+  Color(0xFF,0xCC,0x99), Color(0xFF,0xFF,0x99), Color(0xCC,0xFF,0x99), Color(0x99,0xFF,0x99),
+  Color(0x99,0xFF,0xCC), Color(0x99,0xFF,0xFF), Color(0x99,0xCC,0xFF), Color(0x99,0x99,0xFF),
+  Color(0xCC,0x99,0xFF), Color(0xFF,0x99,0xFF), Color(0xFF,0x99,0xCC), Color(0xE0,0xE0,0xE0),
+  Color(0xA0, 0x52, 0x2D), Color(0xFF,0x00,0x00), Color(0xFF,0x80,0x00), Color(0xFF,0xFF,0x00),
+  Color(0x80,0xFF,0x00), Color(0x00,0xFF,0x00), Color(0x00,0xFF,0x80), Color(0x00,0xFF,0xFF),
+  Color(0x00,0x80,0xFF), Color(0x00,0x00,0xFF), Color(0x7F,0x00,0xFF), Color(0xFF,0x00,0xFF),
+  Color(0xFF,0x00,0x7F), Color(0x80,0x80,0x80), Color(0x8B, 0x45, 0x13), Color(0xCC,0x00,0x00),
+  Color(0xCC,0x66,0x00), Color(0xCC,0xCC,0x00), Color(0x66,0xCC,0x00), Color(0x00,0xCC,0x00),
+  Color(0x00,0xCC,0x66), Color(0x00,0xCC,0xCC), Color(0x00,0x66,0xCC), Color(0x00,0x00,0xCC),
+  Color(0x66,0x00,0xCC), Color(0xCC,0x00,0xCC), Color(0xCC,0x00,0x66), Color(0x60,0x60,0x60),
+};
+typedef std::pair<MapPos, MarkColor> ColorDot;
+
+// marked positions and their colors, sorted by pos in one vector.  There are
+//  only ever a few of them, and the overlay copies them out in order
+class ColorDotMap {
+ protected:
+  std::vector<ColorDot> dots;
+
+ public:
+  typedef std::vector<ColorDot>::const_iterator const_iterator;
+
+  // as std::map::insert, a pos already marked keeps its color
+  void insert(const ColorDot &dot) {
+    std::vector<ColorDot>::iterator it = find(dot.first);
+    if (it == dots.end() || it->first != dot.first) {
+      dots.insert(it, dot);
+    }
+  }
+  void erase(MapPos pos) {
+    std::vector<ColorDot>::iterator it = find(pos);
+    if (it != dots.end() && it->first == pos) {
+      dots.erase(it);
+    }
+  }
+  void clear() { dots.clear(); }
+  size_t size() const { return dots.size(); }
+  const_iterator begin() const { return dots.begin(); }
+  const_iterator end() const { return dots.end(); }
+  const std::vector<ColorDot> &get_dots() const { return dots; }
+
+ protected:
+  std::vector<ColorDot>::iterator find(MapPos pos) {
+    return std::lower_bound(dots.begin(), dots.end(), pos,
+      [](const ColorDot &dot, MapPos p) { return dot.first < p; });
+  }
 };
-typedef std::pair<MapPos, std::string> ColorDot;
-typedef std::map<MapPos, std::string> ColorDotMap;
 
 
 
@@ -605,6 +667,31 @@ typedef enum AIPlusOption {
 } AIPlusOption;
 typedef std::bitset<3> AIPlusOptions;
 
+// what expand_borders looks for in new land.  In the order the names sort in,
+//  the order they were listed in when they were a set of names
+typedef enum ExpandGoal {
+  GoalCoal = 0,
+  GoalCreateBuffer,
+  GoalFoods,
+  GoalGoldOre,
+  GoalHills,
+  GoalIronOre,
+  GoalStones,
+  GoalTrees,
+  ExpandGoalCount
+} ExpandGoal;
+typedef std::bitset<ExpandGoalCount> ExpandGoals;
+const std::string NameExpandGoal[] = {
+  "coal",
+  "create_buffer",
+  "foods",
+  "gold_ore",
+  "hills",
+  "iron_ore",
+  "stones",
+  "trees"
+};
+
 
 
 #endif  // SRC_LOOKUP_H_
@@ -0,0 +1,376 @@
+/*
+ * lz-stream.cc - Fast block compression of save games
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/lz-stream.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "src/debug.h"
+
+const size_t LZStream::block_size;
+const char LZStream::magic[8] = { 'F', 'S', 'E', 'R', 'F', 'L', 'Z', '1' };
+
+// Each sequence is a token, the count of literals in the high four bits and
+//  the match length less min_match in the low four, then the literals and
+//  the offset back to the match, two bytes.  A count of 15 goes on in the
+//  bytes after, each adding up to 255.  The last sequence is literals only.
+static const size_t min_match = 4;
+static const unsigned int hash_bits = 13;
+
+static uint32_t
+read_u32(const char *data) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+  return static_cast<uint32_t>(bytes[0]) |
+         (static_cast<uint32_t>(bytes[1]) << 8) |
+         (static_cast<uint32_t>(bytes[2]) << 16) |
+         (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+static void
+put_u32(std::string *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out->push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+  }
+}
+
+static void
+put_count(std::string *out, size_t count) {
+  while (count >= 255) {
+    out->push_back(static_cast<char>(255));
+    count -= 255;
+  }
+  out->push_back(static_cast<char>(count));
+}
+
+static void
+put_sequence(std::string *out, const char *literals, size_t literal_count,
+             size_t offset, size_t match_length) {
+  size_t match_count = (match_length == 0) ? 0 : match_length - min_match;
+  uint8_t token = static_cast<uint8_t>(
+    (std::min<size_t>(literal_count, 15) << 4) |
+     std::min<size_t>(match_count, 15));
+  out->push_back(static_cast<char>(token));
+  if (literal_count >= 15) {
+    put_count(out, literal_count - 15);
+  }
+  out->append(literals, literal_count);
+  if (match_length == 0) {
+    return;
+  }
+  out->push_back(static_cast<char>(offset & 0xFF));
+  out->push_back(static_cast<char>(offset >> 8));
+  if (match_count >= 15) {
+    put_count(out, match_count - 15);
+  }
+}
+
+bool
+LZStream::is_packed(const char *data, size_t size) {
+  return (size >= sizeof(magic)) && (memcmp(data, magic, sizeof(magic)) == 0);
+}
+
+std::string
+LZStream::pack_block(const char *data, size_t size) {
+  std::string out;
+  out.reserve(size / 2 + 16);
+  // where each hash of four bytes was last seen, plus one
+  std::vector<uint32_t> table(1 << hash_bits, 0);
+
+  size_t anchor = 0;
+  size_t i = 0;
+  while (i + min_match <= size) {
+    uint32_t sequence = read_u32(data + i);
+    uint32_t hash = (sequence * 2654435761u) >> (32 - hash_bits);
+    size_t candidate = table[hash];
+    table[hash] = static_cast<uint32_t>(i + 1);
+    if (candidate == 0 || i + 1 - candidate > 0xFFFF ||
+        read_u32(data + candidate - 1) != sequence) {
+      // step further the longer nothing matched, through data that
+      //  doesn't pack
+      i += 1 + ((i - anchor) >> 6);
+      continue;
+    }
+    candidate--;
+    size_t length = min_match;
+    while (i + length < size && data[candidate + length] == data[i + length]) {
+      length++;
+    }
+    put_sequence(&out, data + anchor, i - anchor, i - candidate, length);
+    i += length;
+    anchor = i;
+  }
+  put_sequence(&out, data + anchor, size - anchor, 0, 0);
+  return out;
+}
+
+// Read a count of 15 and the bytes that go on with it.
+static bool
+get_count(const uint8_t **in, const uint8_t *end, size_t *count) {
+  uint8_t byte;
+  do {
+    if (*in >= end) {
+      return false;
+    }
+    byte = *(*in)++;
+    *count += byte;
+  } while (byte == 255);
+  return true;
+}
+
+bool
+LZStream::unpack_block(const char *packed, size_t packed_size, char *raw,
+                       size_t size) {
+  const uint8_t *in = reinterpret_cast<const uint8_t*>(packed);
+  const uint8_t *end = in + packed_size;
+  size_t out = 0;
+  while (in < end) {
+    uint8_t token = *in++;
+    size_t literal_count = token >> 4;
+    if (literal_count == 15 && !get_count(&in, end, &literal_count)) {
+      return false;
+    }
+    if (literal_count > static_cast<size_t>(end - in) ||
+        literal_count > size - out) {
+      return false;
+    }
+    memcpy(raw + out, in, literal_count);
+    in += literal_count;
+    out += literal_count;
+    if (in == end) {
+      return ((token & 0x0F) == 0) && (out == size);
+    }
+
+    if (end - in < 2) {
+      return false;
+    }
+    size_t offset = in[0] | (in[1] << 8);
+    in += 2;
+    size_t length = token & 0x0F;
+    if (length == 15 && !get_count(&in, end, &length)) {
+      return false;
+    }
+    length += min_match;
+    if (offset == 0 || offset > out || length > size - out) {
+      return false;
+    }
+    // the match may run into the bytes it writes, so byte by byte unless
+    //  it is far enough back
+    char *dst = raw + out;
+    const char *src = dst - offset;
+    if (offset >= length) {
+      memcpy(dst, src, length);
+    } else {
+      for (size_t b = 0; b < length; b++) {
+        dst[b] = src[b];
+      }
+    }
+    out += length;
+  }
+  return false;
+}
+
+std::string
+LZStream::pack(const char *data, size_t size) {
+  std::string out(magic, sizeof(magic));
+  for (size_t pos = 0; pos < size; pos += block_size) {
+    size_t raw_size = std::min(block_size, size - pos);
+    std::string packed = pack_block(data + pos, raw_size);
+    put_u32(&out, static_cast<uint32_t>(raw_size));
+    if (packed.size() < raw_size) {
+      put_u32(&out, static_cast<uint32_t>(packed.size()));
+      out += packed;
+    } else {
+      put_u32(&out, static_cast<uint32_t>(raw_size));
+      out.append(data + pos, raw_size);
+    }
+  }
+  put_u32(&out, 0);
+  put_u32(&out, 0);
+  return out;
+}
+
+std::string
+LZStream::unpack(const char *data, size_t size) {
+  if (!is_packed(data, size)) {
+    throw ExceptionFreeserf("Not a packed save game.");
+  }
+  std::string out;
+  size_t pos = sizeof(magic);
+  while (true) {
+    if (size - pos < 8) {
+      throw ExceptionFreeserf("Packed save game ends early.");
+    }
+    size_t raw_size = read_u32(data + pos);
+    size_t packed_size = read_u32(data + pos + 4);
+    pos += 8;
+    if (raw_size == 0) {
+      return out;
+    }
+    if (raw_size > block_size || packed_size > raw_size ||
+        packed_size > size - pos) {
+      throw ExceptionFreeserf("Packed save game has a bad block.");
+    }
+    size_t out_size = out.size();
+    if (packed_size == raw_size) {
+      out.append(data + pos, raw_size);
+    } else {
+      out.resize(out_size + raw_size);
+      if (!unpack_block(data + pos, packed_size, &out[out_size], raw_size)) {
+        throw ExceptionFreeserf("Packed save game has a bad block.");
+      }
+    }
+    pos += packed_size;
+  }
+}
+
+LZOutBuf::LZOutBuf(std::ostream *_os)
+  : os(_os)
+  , finished(false) {
+  os->write(LZStream::magic, sizeof(LZStream::magic));
+  block.reserve(LZStream::block_size);
+}
+
+LZOutBuf::~LZOutBuf() {
+  finish();
+}
+
+bool
+LZOutBuf::write_block() {
+  std::string out;
+  std::string packed = LZStream::pack_block(block.data(), block.size());
+  put_u32(&out, static_cast<uint32_t>(block.size()));
+  if (packed.size() < block.size()) {
+    put_u32(&out, static_cast<uint32_t>(packed.size()));
+    out += packed;
+  } else {
+    put_u32(&out, static_cast<uint32_t>(block.size()));
+    out.append(block.data(), block.size());
+  }
+  block.clear();
+  os->write(out.data(), out.size());
+  return os->good();
+}
+
+LZOutBuf::int_type
+LZOutBuf::overflow(int_type c) {
+  if (finished) {
+    return traits_type::eof();
+  }
+  if (traits_type::eq_int_type(c, traits_type::eof())) {
+    return traits_type::not_eof(c);
+  }
+  block.push_back(traits_type::to_char_type(c));
+  if (block.size() == LZStream::block_size && !write_block()) {
+    return traits_type::eof();
+  }
+  return c;
+}
+
+std::streamsize
+LZOutBuf::xsputn(const char *s, std::streamsize count) {
+  if (finished) {
+    return 0;
+  }
+  std::streamsize done = 0;
+  while (done < count) {
+    size_t room = LZStream::block_size - block.size();
+    size_t part = std::min(room, static_cast<size_t>(count - done));
+    block.insert(block.end(), s + done, s + done + part);
+    done += part;
+    if (block.size() == LZStream::block_size && !write_block()) {
+      return done;
+    }
+  }
+  return done;
+}
+
+bool
+LZOutBuf::finish() {
+  if (finished) {
+    return os->good();
+  }
+  finished = true;
+  if (!block.empty() && !write_block()) {
+    return false;
+  }
+  std::string end;
+  put_u32(&end, 0);
+  put_u32(&end, 0);
+  os->write(end.data(), end.size());
+  os->flush();
+  return os->good();
+}
+
+LZInBuf::LZInBuf(std::istream *_is)
+  : is(_is)
+  , started(false)
+  , ended(false) {
+}
+
+LZInBuf::int_type
+LZInBuf::underflow() {
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+  if (ended) {
+    return traits_type::eof();
+  }
+  if (!started) {
+    char head[sizeof(LZStream::magic)];
+    if (!is->read(head, sizeof(head)) ||
+        !LZStream::is_packed(head, sizeof(head))) {
+      throw ExceptionFreeserf("Not a packed save game.");
+    }
+    started = true;
+  }
+
+  char sizes[8];
+  if (!is->read(sizes, sizeof(sizes))) {
+    throw ExceptionFreeserf("Packed save game ends early.");
+  }
+  size_t raw_size = read_u32(sizes);
+  size_t packed_size = read_u32(sizes + 4);
+  if (raw_size == 0) {
+    ended = true;
+    return traits_type::eof();
+  }
+  if (raw_size > LZStream::block_size || packed_size > raw_size) {
+    throw ExceptionFreeserf("Packed save game has a bad block.");
+  }
+  block.resize(raw_size);
+  if (packed_size == raw_size) {
+    if (!is->read(block.data(), raw_size)) {
+      throw ExceptionFreeserf("Packed save game ends early.");
+    }
+  } else {
+    packed.resize(packed_size);
+    if (!is->read(packed.data(), packed_size)) {
+      throw ExceptionFreeserf("Packed save game ends early.");
+    }
+    if (!LZStream::unpack_block(packed.data(), packed_size, block.data(),
+                                raw_size)) {
+      throw ExceptionFreeserf("Packed save game has a bad block.");
+    }
+  }
+  setg(block.data(), block.data(), block.data() + raw_size);
+  return traits_type::to_int_type(*gptr());
+}
@@ -0,0 +1,98 @@
+/*
+ * lz-stream.h - Fast block compression of save games
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_LZ_STREAM_H_
+#define SRC_LZ_STREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// A small LZ77 coder in the manner of LZ4, made to be fast rather than
+// tight, for save games, which repeat themselves a lot. The stream starts
+// with a magic, then blocks of at most block_size bytes, each its unpacked
+// and its packed size, four bytes each, and the packed bytes. A block that
+// would not get smaller is stored as it is, with both sizes the same, and a
+// block with unpacked size 0 ends the stream. Each block unpacks on its own,
+// so a reader only needs one of them in memory at a time.
+class LZStream {
+ public:
+  static const size_t block_size = 64 * 1024;
+  static const char magic[8];
+
+  static bool is_packed(const char *data, size_t size);
+
+  // Sequences of one block; size is at most block_size.
+  static std::string pack_block(const char *data, size_t size);
+  // False if packed is not size bytes once unpacked into raw.
+  static bool unpack_block(const char *packed, size_t packed_size,
+                           char *raw, size_t size);
+
+  // A whole stream, the one from "unpack" throws ExceptionFreeserf when the
+  //  data doesn't unpack.
+  static std::string pack(const char *data, size_t size);
+  static std::string unpack(const char *data, size_t size);
+};
+
+// Packs what is written into another stream, a block at a time.  Nothing
+//  can be written after finish, which the destructor calls if it was not.
+class LZOutBuf : public std::streambuf {
+ protected:
+  std::ostream *os;
+  std::vector<char> block;
+  bool finished;
+
+  bool write_block();
+
+  virtual int_type overflow(int_type c);
+  virtual std::streamsize xsputn(const char *s, std::streamsize count);
+
+ public:
+  explicit LZOutBuf(std::ostream *os);
+  virtual ~LZOutBuf();
+
+  // Write what is left and the end, false if os failed on the way.
+  bool finish();
+};
+
+// Unpacks a stream from another one, a block at a time.  A read that runs
+//  into a block that doesn't unpack, or a stream with no end, throws
+//  ExceptionFreeserf, which an istream reading through this turns into
+//  badbit, and istreambuf_iterator lets through.
+class LZInBuf : public std::streambuf {
+ protected:
+  std::istream *is;
+  std::vector<char> block;
+  std::vector<char> packed;
+  bool started;
+  bool ended;
+
+  virtual int_type underflow();
+
+ public:
+  explicit LZInBuf(std::istream *is);
+};
+
+#endif  // SRC_LZ_STREAM_H_
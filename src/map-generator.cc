@@ -23,16 +23,37 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 
 #include "src/debug.h"
+#include "src/log.h"
+#include "src/profiler.h"
 
 const int ClassicMapGenerator::default_max_lake_area = 14;
 const int ClassicMapGenerator::default_water_level = 20;
 const int ClassicMapGenerator::default_terrain_spikyness = 0x9999;
 
+std::string ClassicMapGenerator::cache_folder;
+
+// Timed passes of ClassicMapGenerator::generate.
+static const Profiler::Section profile_heights("mapgen.heights");
+static const Profiler::Section profile_clamp_heights("mapgen.clamp_heights");
+static const Profiler::Section profile_water_bodies("mapgen.water_bodies");
+static const Profiler::Section profile_types("mapgen.types");
+static const Profiler::Section profile_remove_islands("mapgen.remove_islands");
+static const Profiler::Section profile_shores("mapgen.shores");
+static const Profiler::Section profile_deserts("mapgen.deserts");
+static const Profiler::Section profile_objects("mapgen.objects");
+static const Profiler::Section profile_minerals("mapgen.minerals");
+static const Profiler::Section profile_clean_up("mapgen.clean_up");
+
 ClassicMapGenerator::ClassicMapGenerator(const Map& map, const Random& random)
   : map(map)
   , rnd(random)
+  , threads(0)
   , height_generator(HeightGeneratorMidpoints)
   , preserve_bugs(false)
   , water_level(default_water_level)
@@ -67,6 +88,13 @@ bool ClassicMapGenerator::is_in_water(MapPos pos) const {
 }
 
 void ClassicMapGenerator::generate() {
+  std::string cache_path = get_cache_path();
+  if (!cache_path.empty() && load_cached(cache_path)) {
+    return;
+  }
+
+  Profiler::PhaseTimer phases;
+  phases.next(profile_heights);
   rnd ^= Random(0x5a5a, 0xa5a5, 0xc3c3);
 
   random_int();
@@ -84,26 +112,173 @@ void ClassicMapGenerator::generate() {
       NOT_REACHED();
   }
 
+  phases.next(profile_clamp_heights);
   clamp_heights();
+  phases.next(profile_water_bodies);
   create_water_bodies();
+  phases.next(profile_types);
   heights_rebase();
   init_types();
+  phases.next(profile_remove_islands);
   remove_islands();
   heights_rescale();
 
   // Adjust terrain types on shores
+  phases.next(profile_shores);
   change_shore_water_type();
   change_shore_grass_type();
 
   // Create deserts
+  phases.next(profile_deserts);
   create_deserts();
 
   // Create map objects (trees, boulders, etc.)
+  phases.next(profile_objects);
   create_objects();
 
+  phases.next(profile_minerals);
   create_mineral_deposits();
 
+  phases.next(profile_clean_up);
   clean_up();
+  phases.stop();
+
+  if (!cache_path.empty()) {
+    save_cached(cache_path);
+  }
+}
+
+// Split the map into bands of whole rows and run fn on them in parallel.
+// Only for passes where every tile is computed from values that the pass
+// does not change, so the result is the same however the rows are split.
+void
+ClassicMapGenerator::for_each_row_stripe(
+               std::function<void(unsigned int, unsigned int)> fn) {
+  const unsigned int min_stripe_rows = 16;
+  unsigned int rows = map.get_rows();
+  unsigned int count = threads;
+  if (count == 0) {
+    count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  count = std::max(1u, std::min(count, rows / min_stripe_rows));
+
+  if (count == 1) {
+    fn(0, rows);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  unsigned int stripe_rows = (rows + count - 1) / count;
+  for (unsigned int first = stripe_rows; first < rows; first += stripe_rows) {
+    workers.emplace_back(fn, first, std::min(first + stripe_rows, rows));
+  }
+  fn(0, stripe_rows);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+/* Cached maps are keyed by everything that decides the outcome. The
+   random state is taken before generate() starts using it. */
+std::string
+ClassicMapGenerator::get_cache_path() const {
+  if (cache_folder.empty()) {
+    return std::string();
+  }
+
+  std::stringstream path;
+  path << cache_folder << "/map-" << static_cast<std::string>(rnd)
+       << "-" << map.geom().size() << "-" << height_generator
+       << "-" << (preserve_bugs ? 1 : 0) << "-" << max_lake_area
+       << "-" << water_level << "-" << terrain_spikyness << ".cache";
+  return path.str();
+}
+
+namespace {
+
+const char cache_magic[] = "FSMAPC1";
+const size_t cache_tile_size = 7;
+
+}  // namespace
+
+bool
+ClassicMapGenerator::load_cached(const std::string &path) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  char magic[sizeof(cache_magic)];
+  uint8_t count[4];
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(count), sizeof(count));
+  uint32_t tile_count = count[0] | (count[1] << 8) | (count[2] << 16) |
+                        (static_cast<uint32_t>(count[3]) << 24);
+  if (!file.good() || std::string(magic) != cache_magic ||
+      tile_count != map.geom().tile_count()) {
+    Log::Warn["map-generator"] << "ignoring invalid map cache " << path;
+    return false;
+  }
+
+  std::vector<uint8_t> data(tile_count * cache_tile_size);
+  file.read(reinterpret_cast<char*>(data.data()), data.size());
+  if (file.gcount() != static_cast<std::streamsize>(data.size())) {
+    Log::Warn["map-generator"] << "ignoring truncated map cache " << path;
+    return false;
+  }
+
+  const uint8_t *src = data.data();
+  for (Map::LandscapeTile &tile : tiles) {
+    tile.height = src[0];
+    tile.type_up = static_cast<Map::Terrain>(src[1]);
+    tile.type_down = static_cast<Map::Terrain>(src[2]);
+    tile.mineral = static_cast<Map::Minerals>(src[3]);
+    tile.resource_amount = static_cast<int16_t>(src[4] | (src[5] << 8));
+    tile.obj = static_cast<Map::Object>(src[6]);
+    src += cache_tile_size;
+  }
+  return true;
+}
+
+/* Write to a temporary file first so that a concurrent run never reads a
+   half written map. */
+void
+ClassicMapGenerator::save_cached(const std::string &path) const {
+  std::vector<uint8_t> data;
+  data.reserve(tiles.size() * cache_tile_size);
+  for (const Map::LandscapeTile &tile : tiles) {
+    data.push_back(static_cast<uint8_t>(tile.height));
+    data.push_back(static_cast<uint8_t>(tile.type_up));
+    data.push_back(static_cast<uint8_t>(tile.type_down));
+    data.push_back(static_cast<uint8_t>(tile.mineral));
+    data.push_back(static_cast<uint8_t>(tile.resource_amount & 0xff));
+    data.push_back(static_cast<uint8_t>((tile.resource_amount >> 8) & 0xff));
+    data.push_back(static_cast<uint8_t>(tile.obj));
+  }
+
+  std::stringstream temp_path;
+  temp_path << path << "." << std::this_thread::get_id() << ".tmp";
+  {
+    std::ofstream file(temp_path.str().c_str(), std::ios::binary);
+    uint32_t tile_count = static_cast<uint32_t>(tiles.size());
+    uint8_t count[4] = {
+      static_cast<uint8_t>(tile_count), static_cast<uint8_t>(tile_count >> 8),
+      static_cast<uint8_t>(tile_count >> 16),
+      static_cast<uint8_t>(tile_count >> 24)
+    };
+    file.write(cache_magic, sizeof(cache_magic));
+    file.write(reinterpret_cast<const char*>(count), sizeof(count));
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!file.good()) {
+      Log::Warn["map-generator"] << "failed to write map cache " << path;
+      file.close();
+      std::remove(temp_path.str().c_str());
+      return;
+    }
+  }
+  if (std::rename(temp_path.str().c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.str().c_str());
+  }
 }
 
 uint16_t
@@ -456,14 +631,19 @@ calc_map_type(int h_sum) {
 /* Set type of map fields based on the height value. */
 void
 ClassicMapGenerator::init_types() {
-  for (MapPos pos_ : map.geom()) {
-    int h1 = tiles[pos_].height;
-    int h2 = tiles[map.move_right(pos_)].height;
-    int h3 = tiles[map.move_down_right(pos_)].height;
-    int h4 = tiles[map.move_down(pos_)].height;
-    tiles[pos_].type_up = calc_map_type(h1 + h3 + h4);
-    tiles[pos_].type_down = calc_map_type(h1 + h2 + h3);
-  }
+  for_each_row_stripe([this](unsigned int first_row, unsigned int end_row) {
+    for (unsigned int y = first_row; y < end_row; y++) {
+      for (unsigned int x = 0; x < map.get_cols(); x++) {
+        MapPos pos_ = map.pos(x, y);
+        int h1 = tiles[pos_].height;
+        int h2 = tiles[map.move_right(pos_)].height;
+        int h3 = tiles[map.move_down_right(pos_)].height;
+        int h4 = tiles[map.move_down(pos_)].height;
+        tiles[pos_].type_up = calc_map_type(h1 + h3 + h4);
+        tiles[pos_].type_down = calc_map_type(h1 + h2 + h3);
+      }
+    }
+  });
 }
 
 void
@@ -493,52 +673,53 @@ ClassicMapGenerator::remove_islands() {
   // itself expanded the tag is changed to 2.
   clear_all_tags();
 
+  // The original sweeps the whole map over and over until no new position
+  // is tagged. The positions reached do not depend on the order they are
+  // expanded in, so a work list gives the same tags in one pass.
+  std::vector<MapPos> reached;
   for (MapPos pos_ : map.geom()) {
     if (tiles[pos_].height > 0 && tags[pos_] == 0) {
       tags[pos_] = 1;
+      reached.push_back(pos_);
 
       unsigned int num = 0;
-      bool changed = true;
-      while (changed) {
-        changed = false;
-        for (MapPos pos_ : map.geom()) {
-          if (tags[pos_] == 1) {
-            num += 1;
-            tags[pos_] = 2;
-
-            // The i'th flag will indicate whether a path on land from
-            // pos_in direction i is possible.
-            int flags = 0;
-            if (tiles[pos_].type_down >= Map::TerrainGrass0) {
-              flags |= 3;
-            }
-            if (tiles[pos_].type_up >= Map::TerrainGrass0) {
-              flags |= 6;
-            }
-            if (tiles[map.move_left(pos_)].type_down >=
-                Map::TerrainGrass0) {
-              flags |= 0xc;
-            }
-            if (tiles[map.move_up_left(pos_)].type_up >=
-                Map::TerrainGrass0) {
-              flags |= 0x18;
-            }
-            if (tiles[map.move_up_left(pos_)].type_down >=
-                Map::TerrainGrass0) {
-              flags |= 0x30;
-            }
-            if (tiles[map.move_up(pos_)].type_up >= Map::TerrainGrass0) {
-              flags |= 0x21;
-            }
+      while (!reached.empty()) {
+        MapPos pos_ = reached.back();
+        reached.pop_back();
+        num += 1;
+        tags[pos_] = 2;
+
+        // The i'th flag will indicate whether a path on land from
+        // pos_in direction i is possible.
+        int flags = 0;
+        if (tiles[pos_].type_down >= Map::TerrainGrass0) {
+          flags |= 3;
+        }
+        if (tiles[pos_].type_up >= Map::TerrainGrass0) {
+          flags |= 6;
+        }
+        if (tiles[map.move_left(pos_)].type_down >=
+            Map::TerrainGrass0) {
+          flags |= 0xc;
+        }
+        if (tiles[map.move_up_left(pos_)].type_up >=
+            Map::TerrainGrass0) {
+          flags |= 0x18;
+        }
+        if (tiles[map.move_up_left(pos_)].type_down >=
+            Map::TerrainGrass0) {
+          flags |= 0x30;
+        }
+        if (tiles[map.move_up(pos_)].type_up >= Map::TerrainGrass0) {
+          flags |= 0x21;
+        }
 
-            // Mark positions following any valid direction on land.
-            for (Direction d : cycle_directions_cw()) {
-              if (BIT_TEST(flags, d)) {
-                if (tags[map.move(pos_, d)] == 0) {
-                  tags[map.move(pos_, d)] = 1;
-                  changed = true;
-                }
-              }
+        // Mark positions following any valid direction on land.
+        for (Direction d : cycle_directions_cw()) {
+          if (BIT_TEST(flags, d)) {
+            if (tags[map.move(pos_, d)] == 0) {
+              tags[map.move(pos_, d)] = 1;
+              reached.push_back(map.move(pos_, d));
             }
           }
         }
@@ -579,58 +760,79 @@ ClassicMapGenerator::heights_rescale() {
 void
 ClassicMapGenerator::seed_terrain_type(Map::Terrain old, Map::Terrain seed,
                                        Map::Terrain new_) {
-  for (MapPos pos_ : map.geom()) {
-    // Check that the central triangle is of type old (*), and that any
-    // adjacent triangle is of type seed:
-    //     ____
-    //    /\  /\
-    //   /__\/__\
-    //  /\  /\  /\
-    // /__\/*_\/__\
-    // \  /\  /\  /
-    //  \/__\/__\/
-    //
-    if (tiles[pos_].type_up == old &&
-        (seed == tiles[map.move_up_left(pos_)].type_down ||
-         seed == tiles[map.move_up_left(pos_)].type_up ||
-         seed == tiles[map.move_up(pos_)].type_up ||
-         seed == tiles[map.move_left(pos_)].type_down ||
-         seed == tiles[map.move_left(pos_)].type_up ||
-         seed == tiles[pos_].type_down ||
-         seed == tiles[map.move_right(pos_)].type_up ||
-         seed == tiles[map.move_left(map.move_down(pos_))].type_down ||
-         seed == tiles[map.move_down(pos_)].type_down ||
-         seed == tiles[map.move_down(pos_)].type_up ||
-         seed == tiles[map.move_down_right(pos_)].type_down ||
-         seed == tiles[map.move_down_right(pos_)].type_up)) {
-      tiles[pos_].type_up = new_;
+  // In every call old and new_ differ from seed, so a triangle changed
+  // earlier in the pass cannot seed another one. That makes the order of the
+  // positions irrelevant: find all changes first, in parallel, then apply.
+  // Changes are collected per row, as position << 2 | triangle bits.
+  seed_changes.resize(map.get_rows());
+  for_each_row_stripe([&](unsigned int first_row, unsigned int end_row) {
+    for (unsigned int y = first_row; y < end_row; y++) {
+      for (unsigned int x = 0; x < map.get_cols(); x++) {
+        MapPos pos_ = map.pos(x, y);
+        unsigned int changes = 0;
+        // Check that the central triangle is of type old (*), and that any
+        // adjacent triangle is of type seed:
+        //     ____
+        //    /\  /\
+        //   /__\/__\
+        //  /\  /\  /\
+        // /__\/*_\/__\
+        // \  /\  /\  /
+        //  \/__\/__\/
+        //
+        if (tiles[pos_].type_up == old &&
+            (seed == tiles[map.move_up_left(pos_)].type_down ||
+             seed == tiles[map.move_up_left(pos_)].type_up ||
+             seed == tiles[map.move_up(pos_)].type_up ||
+             seed == tiles[map.move_left(pos_)].type_down ||
+             seed == tiles[map.move_left(pos_)].type_up ||
+             seed == tiles[pos_].type_down ||
+             seed == tiles[map.move_right(pos_)].type_up ||
+             seed == tiles[map.move_left(map.move_down(pos_))].type_down ||
+             seed == tiles[map.move_down(pos_)].type_down ||
+             seed == tiles[map.move_down(pos_)].type_up ||
+             seed == tiles[map.move_down_right(pos_)].type_down ||
+             seed == tiles[map.move_down_right(pos_)].type_up)) {
+          changes |= 1;
+        }
+
+        // Check that the central triangle is of type old (*), and that any
+        // adjacent triangle is of type seed:
+        //   ________
+        //  /\  /\  /\
+        // /__\/__\/__\
+        // \  /\* /\  /
+        //  \/__\/__\/
+        //   \  /\  /
+        //    \/__\/
+        //
+        if (tiles[pos_].type_down == old &&
+            (seed == tiles[map.move_up_left(pos_)].type_down ||
+             seed == tiles[map.move_up_left(pos_)].type_up ||
+             seed == tiles[map.move_up(pos_)].type_down ||
+             seed == tiles[map.move_up(pos_)].type_up ||
+             seed == tiles[map.move_right(map.move_up(pos_))].type_up ||
+             seed == tiles[map.move_left(pos_)].type_down ||
+             seed == tiles[pos_].type_up ||
+             seed == tiles[map.move_right(pos_)].type_down ||
+             seed == tiles[map.move_right(pos_)].type_up ||
+             seed == tiles[map.move_down(pos_)].type_down ||
+             seed == tiles[map.move_down_right(pos_)].type_down ||
+             seed == tiles[map.move_down_right(pos_)].type_up)) {
+          changes |= 2;
+        }
+        if (changes != 0) seed_changes[y].push_back(pos_ << 2 | changes);
+      }
     }
+  });
 
-    // Check that the central triangle is of type old (*), and that any
-    // adjacent triangle is of type seed:
-    //   ________
-    //  /\  /\  /\
-    // /__\/__\/__\
-    // \  /\* /\  /
-    //  \/__\/__\/
-    //   \  /\  /
-    //    \/__\/
-    //
-    if (tiles[pos_].type_down == old &&
-        (seed == tiles[map.move_up_left(pos_)].type_down ||
-         seed == tiles[map.move_up_left(pos_)].type_up ||
-         seed == tiles[map.move_up(pos_)].type_down ||
-         seed == tiles[map.move_up(pos_)].type_up ||
-         seed == tiles[map.move_right(map.move_up(pos_))].type_up ||
-         seed == tiles[map.move_left(pos_)].type_down ||
-         seed == tiles[pos_].type_up ||
-         seed == tiles[map.move_right(pos_)].type_down ||
-         seed == tiles[map.move_right(pos_)].type_up ||
-         seed == tiles[map.move_down(pos_)].type_down ||
-         seed == tiles[map.move_down_right(pos_)].type_down ||
-         seed == tiles[map.move_down_right(pos_)].type_up)) {
-      tiles[pos_].type_down = new_;
+  for (std::vector<MapPos> &row_changes : seed_changes) {
+    for (MapPos change : row_changes) {
+      MapPos pos_ = change >> 2;
+      if (change & 1) tiles[pos_].type_up = new_;
+      if (change & 2) tiles[pos_].type_down = new_;
     }
+    row_changes.clear();
   }
 }
 
@@ -1084,3 +1286,101 @@ ClassicMissionMapGenerator::ClassicMissionMapGenerator(
 void ClassicMissionMapGenerator::init() {
   ClassicMapGenerator::init(MapGenerator::HeightGeneratorMidpoints, true);
 }
+
+MapPreparer::MapPreparer()
+  : quit(false)
+  , wanted_size(0)
+  , wanted(false)
+  , started(false)
+  , ready_size(0) {
+}
+
+MapPreparer::~MapPreparer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  changed.notify_all();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void
+MapPreparer::prepare(unsigned int map_size, const Random &random) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string random_string = random;
+    if (is_ready(map_size, random_string)) {
+      wanted = false;
+      return;
+    }
+    if (wanted && wanted_size == map_size && wanted_random == random_string) {
+      return;
+    }
+    wanted_size = map_size;
+    wanted_random = random_string;
+    wanted = true;
+    started = false;
+    if (!worker.joinable()) {
+      worker = std::thread(&MapPreparer::run, this);
+    }
+  }
+  changed.notify_all();
+}
+
+MapPreparer::PLandscape
+MapPreparer::get_ready(unsigned int map_size, const Random &random) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return is_ready(map_size, random) ? ready : nullptr;
+}
+
+MapPreparer::PLandscape
+MapPreparer::take(unsigned int map_size, const Random &random) {
+  std::string random_string = random;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&] {
+      return is_ready(map_size, random_string) || !wanted ||
+             wanted_size != map_size || wanted_random != random_string;
+    });
+    if (is_ready(map_size, random_string)) {
+      return ready;
+    }
+  }
+  return generate(map_size, random);
+}
+
+MapPreparer::PLandscape
+MapPreparer::generate(unsigned int map_size, const Random &random) {
+  const MapGeometry geom(map_size);
+  Map map(geom);
+  ClassicMissionMapGenerator generator(map, random);
+  generator.init();
+  generator.generate();
+  return std::make_shared<Landscape>(generator.get_landscape());
+}
+
+void
+MapPreparer::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    changed.wait(lock, [this] { return quit || (wanted && !started); });
+    if (quit) {
+      return;
+    }
+    started = true;
+    unsigned int map_size = wanted_size;
+    std::string random_string = wanted_random;
+    lock.unlock();
+    PLandscape landscape = generate(map_size, Random(random_string));
+    lock.lock();
+    if (wanted && wanted_size == map_size && wanted_random == random_string) {
+      ready = landscape;
+      ready_size = map_size;
+      ready_random = random_string;
+      wanted = false;
+      changed.notify_all();
+    }
+  }
+}
@@ -22,7 +22,12 @@
 #ifndef SRC_MAP_GENERATOR_H_
 #define SRC_MAP_GENERATOR_H_
 
+#include <condition_variable>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <functional>
 #include <memory>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <string>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 #include <vector>
 
 #include "src/map.h"
@@ -63,6 +68,16 @@ class ClassicMapGenerator : public MapGenerator {
             int terrain_spikyness = default_terrain_spikyness);
   void generate();
 
+  // Number of threads for the passes that work on every tile
+  // independently, 0 picks one per core. The result does not depend on it.
+  void set_threads(unsigned int threads_) { threads = threads_; }
+
+  // Keep generated maps in this folder, keyed by random seed, map size and
+  // generator settings, and load them from there instead of generating
+  // again. An empty path, the default, turns the cache off.
+  static void set_cache_folder(const std::string &path) {
+    cache_folder = path; }
+
   int get_height(MapPos pos) const { return tiles[pos].height; }
   Map::Terrain get_type_up(MapPos pos) const {
     return tiles[pos].type_up; }
@@ -82,6 +97,8 @@ class ClassicMapGenerator : public MapGenerator {
 
   std::vector<Map::LandscapeTile> tiles;
   std::vector<int> tags;
+  std::vector<std::vector<MapPos>> seed_changes;
+  unsigned int threads;
   HeightGenerator height_generator;
   bool preserve_bugs;
 
@@ -89,9 +106,18 @@ class ClassicMapGenerator : public MapGenerator {
   unsigned int max_lake_area;
   int terrain_spikyness;
 
+  static std::string cache_folder;
+
   uint16_t random_int();
   MapPos pos_add_spirally_random(MapPos pos, int mask);
 
+  void for_each_row_stripe(std::function<void(unsigned int first_row,
+                                              unsigned int end_row)> fn);
+
+  std::string get_cache_path() const;
+  bool load_cached(const std::string &path);
+  void save_cached(const std::string &path) const;
+
   bool is_water_tile(MapPos pos) const;
   bool is_in_water(MapPos pos) const;
 
@@ -146,4 +172,52 @@ class ClassicMissionMapGenerator : public ClassicMapGenerator {
   void init();
 };
 
+// Generates the mission map of a size and seed on a thread of its own, for
+// the game init box to start on while the player is still picking options.
+// Only the last map asked for is kept: one still being generated when the
+// options change runs to its end, as the generator can't be stopped part
+// way, and is then dropped.
+class MapPreparer {
+ public:
+  typedef std::vector<Map::LandscapeTile> Landscape;
+  typedef std::shared_ptr<const Landscape> PLandscape;
+
+ protected:
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread worker;
+  bool quit;
+
+  // the map last asked for, and whether the worker has started it
+  unsigned int wanted_size;
+  std::string wanted_random;
+  bool wanted;
+  bool started;
+
+  unsigned int ready_size;
+  std::string ready_random;
+  PLandscape ready;
+
+ public:
+  MapPreparer();
+  virtual ~MapPreparer();
+
+  // Start on this map, instead of whatever was asked for before
+  void prepare(unsigned int map_size, const Random &random);
+  // The map if it is done, or nullptr
+  PLandscape get_ready(unsigned int map_size, const Random &random);
+  // The map, waiting for it if it is being generated, or generating it here
+  //  if it was never asked for
+  PLandscape take(unsigned int map_size, const Random &random);
+
+  // The same tiles Game::init() generates for map_size and random
+  static PLandscape generate(unsigned int map_size, const Random &random);
+
+ protected:
+  bool is_ready(unsigned int map_size, const std::string &random) const {
+    return ready && ready_size == map_size && ready_random == random;
+  }
+  void run();
+};
+
 #endif  // SRC_MAP_GENERATOR_H_
@@ -183,6 +183,8 @@ cycle_directions_rand_cw(Direction start = Direction(rand() % 7), unsigned int l
 // directly as index to map data arrays.
 typedef unsigned int MapPos;
 const MapPos bad_map_pos = std::numeric_limits<unsigned int>::max();
+// Largest map size the MapPos encoding has room for.
+const unsigned int max_map_size = 20;
 
 
 class MapGeometry {
@@ -191,11 +193,16 @@ class MapGeometry {
 
   // Derived members
   MapPos dirs[6];
+  // Column and row parts of each direction offset, kept apart so that a
+  // move is two adds and two masks on the packed position.
+  MapPos dir_cols_[6];
+  MapPos dir_rows_[6];
   unsigned int col_size_, row_size_;
 
   unsigned int cols_, rows_;
   unsigned int col_mask_, row_mask_;
   unsigned int row_shift_;
+  unsigned int row_bits_;  // row_mask_ in MapPos position
 
  public:
   class Iterator {
@@ -243,26 +250,32 @@ class MapGeometry {
   explicit MapGeometry(unsigned int size)
     : size_(size)
     , dirs{6}
+    , dir_cols_{0}
+    , dir_rows_{0}
     , col_size_(0)
     , row_size_(0)
     , cols_(0)
     , rows_(0)
     , col_mask_(0)
     , row_mask_(0)
-    , row_shift_(0) {
+    , row_shift_(0)
+    , row_bits_(0) {
     init();
   }
 
   MapGeometry(const MapGeometry& that)
     : size_(that.size_)
     , dirs{6}
+    , dir_cols_{0}
+    , dir_rows_{0}
     , col_size_(0)
     , row_size_(0)
     , cols_(0)
     , rows_(0)
     , col_mask_(0)
     , row_mask_(0)
-    , row_shift_(0) {
+    , row_shift_(0)
+    , row_bits_(0) {
     init();
   }
 
@@ -291,9 +304,12 @@ class MapGeometry {
   MapPos pos_add(MapPos pos_, int x, int y) const {
     return pos((pos_col(pos_) + x) & col_mask_,
                (pos_row(pos_) + y) & row_mask_); }
+  // Both dimensions are powers of two, so the fields can be added in place:
+  // a carry out of the column field is masked away, and the row field is
+  // the top of the position.
   MapPos pos_add(MapPos pos_, MapPos off) const {
-    return pos((pos_col(pos_) + pos_col(off)) & col_mask_,
-               (pos_row(pos_) + pos_row(off)) & row_mask_); }
+    return ((pos_ + (off & col_mask_)) & col_mask_) |
+           ((pos_ + (off & row_bits_)) & row_bits_); }
 
   // Shortest signed distance between map positions.
   int dist_x(MapPos pos1, MapPos pos2) const {
@@ -305,7 +321,8 @@ class MapGeometry {
 
   /* Movement of map position according to directions. */
   MapPos move(MapPos pos, Direction dir) const {
-    return pos_add(pos, dirs[dir]); }
+    return ((pos + dir_cols_[dir]) & col_mask_) |
+           ((pos + dir_rows_[dir]) & row_bits_); }
 
   MapPos move_right(MapPos pos) const { return move(pos, DirectionRight); }
   MapPos move_down_right(MapPos pos) const {
@@ -329,7 +346,7 @@ class MapGeometry {
 
  protected:
   void init() {
-    if (size_ > 20) {
+    if (size_ > max_map_size) {
       throw ExceptionFreeserf("Above size 20 the map positions can no longer "
                               "fit in a 32-bit integer.");
     }
@@ -351,6 +368,12 @@ class MapGeometry {
 
     dirs[DirectionDownRight] = dirs[DirectionRight] | dirs[DirectionDown];
     dirs[DirectionUpLeft] = dirs[DirectionLeft] | dirs[DirectionUp];
+
+    row_bits_ = row_mask_ << row_shift_;
+    for (int d = DirectionRight; d <= DirectionUp; d++) {
+      dir_cols_[d] = dirs[d] & col_mask_;
+      dir_rows_[d] = dirs[d] & row_bits_;
+    }
   }
 };
 
@@ -66,7 +66,10 @@
 #include "src/map.h"
 
 #include <algorithm>
+#include <cstdlib>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 #include <utility>
+#include <vector>
 
 #include "src/debug.h"
 #include "src/savegame.h"
@@ -455,6 +458,9 @@ Map::map_space_from_obj[] = {
 
 Map::Map(const MapGeometry& geom)
   : geom_(geom)
+  , changes_held(false)
+  , events(nullptr)
+  , total_changes(0)
   , spiral_pos_pattern(new MapPos[295])
   , extended_spiral_pos_pattern(new MapPos[3268]) {
   // Some code may still assume that map has at least size 3.
@@ -462,8 +468,10 @@ Map::Map(const MapGeometry& geom)
     throw ExceptionFreeserf("Failed to create map with size less than 3.");
   }
 
-  landscape_tiles.resize(geom_.tile_count());
-  game_tiles.resize(geom_.tile_count());
+  tiles.resize(geom_);
+  block_changes = std::vector<std::atomic<uint32_t>>(
+                          geom_.tile_count() >> (2 * change_block_shift));
+  block_sums.assign(block_changes.size(), BlockSums());
 
   update_state.last_tick = 0;
   update_state.counter = 0;
@@ -472,8 +480,35 @@ Map::Map(const MapGeometry& geom)
 
   regions = (geom.cols() >> 5) * (geom.rows() >> 5);
 
-  init_spiral_pattern();
-  init_extended_spiral_pattern();
+  // games on other threads may be making their maps at the same time
+  static std::once_flag spiral_patterns_initialized;
+  std::call_once(spiral_patterns_initialized, []() {
+    init_spiral_pattern();
+    init_extended_spiral_pattern();
+  });
+  init_spiral_pos_pattern();
+  init_extended_spiral_pos_pattern();
+}
+
+Map::Map(const Map &that)
+  : geom_(that.geom_)
+  , tiles(that.tiles)
+  , regions(that.regions)
+  , update_state(that.update_state)
+  , changes_held(that.changes_held)
+  , held_changes(that.held_changes)
+  , change_marks(that.change_marks)
+  , events(nullptr)
+  , block_changes(that.block_changes.size())
+  , total_changes(that.total_changes.load(std::memory_order_relaxed))
+  , block_sums(that.block_sums)
+  , spiral_pos_pattern(new MapPos[295])
+  , extended_spiral_pos_pattern(new MapPos[3268]) {
+  for (size_t i = 0; i < block_changes.size(); i++) {
+    block_changes[i].store(that.block_changes[i].load(
+                             std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+  }
   init_spiral_pos_pattern();
   init_extended_spiral_pos_pattern();
 }
@@ -540,29 +575,51 @@ Map::init_extended_spiral_pos_pattern() {
 /* Copy tile data from map generator into map tile data. */
 void
 Map::init_tiles(const MapGenerator &generator) {
-  landscape_tiles = generator.get_landscape();
+  init_tiles(generator.get_landscape());
+}
+
+void
+Map::init_tiles(const std::vector<LandscapeTile> &landscape) {
+  for (MapPos pos_ : geom_) {
+    const LandscapeTile &tile = landscape[pos_];
+    tiles.height[pos_] = tile.height;
+    tiles.type_up[pos_] = tile.type_up;
+    tiles.type_down[pos_] = tile.type_down;
+    tiles.mineral[pos_] = tile.mineral;
+    tiles.resource_amount[pos_] = tile.resource_amount;
+    tiles.obj[pos_] = tile.obj;
+  }
+  init_terrain();
 }
 
 /* Change the height of a map position. */
 void
 Map::set_height(MapPos pos, int height) {
-  landscape_tiles[pos].height = height;
+  tiles.height[pos] = height;
+  count_change(pos);
 
   /* Mark landscape dirty */
-  for (Direction d : cycle_directions_cw()) {
-    for (Handler *handler : change_handlers) {
-      handler->on_height_changed(move(pos, d));
-    }
-  }
+  notify_changed(pos, ChangeMarkHeight);
 }
 
-// tlongstretch - hack to work around crash bug during castle
-//   placement at game start, https://github.com/tlongstretch/freeserf-with-AI-plus/issues/38
 void
-Map::set_height_no_refresh(MapPos pos, int height) {
-  landscape_tiles[pos].height = height;
-  // don't Mark landscape dirty, I guess it will be updated on next refresh?
-  //  not sure, it might not even matter
+Map::set_heights(const std::vector<MapPos> &positions, int height) {
+  for (MapPos pos : positions) {
+    tiles.height[pos] = height;
+    count_change(pos);
+  }
+
+  if (change_handlers.empty()) return;
+  std::lock_guard<std::mutex> lock(changes_mutex);
+  if (!changes_held) {
+    if (change_marks.size() != geom_.tile_count()) {
+      change_marks.assign(geom_.tile_count(), 0);
+    }
+    changes_held = true;
+  }
+  for (MapPos pos : positions) {
+    hold_change(pos, ChangeMarkHeight);
+  }
 }
 
 
@@ -571,13 +628,58 @@ Map::set_height_no_refresh(MapPos pos, int height) {
    building is removed. */
 void
 Map::set_object(MapPos pos, Object obj, int index) {
-  landscape_tiles[pos].obj = obj;
-  if (index >= 0) game_tiles[pos].obj_index = index;
+  add_to_sums(pos, -1);
+  tiles.obj[pos] = obj;
+  add_to_sums(pos, 1);
+  if (index >= 0) tiles.obj_index.set(pos, index);
+  count_change(pos);
+  publish(GameEvent::TypeObjectChanged, pos, obj);
 
   /* Notify about object change */
+  notify_changed(pos, ChangeMarkObject);
+}
+
+void
+Map::notify_changed(MapPos pos, ChangeMark mark) {
+  if (change_handlers.empty()) return;
+
+  {
+    std::lock_guard<std::mutex> lock(changes_mutex);
+    /* Roads are built from the AI threads too, so they wait for the next
+       release, the way leveling does. */
+    if (!changes_held && mark == ChangeMarkBorders) {
+      if (change_marks.size() != geom_.tile_count()) {
+        change_marks.assign(geom_.tile_count(), 0);
+      }
+      changes_held = true;
+    }
+    if (changes_held) {
+      hold_change(pos, mark);
+      return;
+    }
+  }
+
   for (Direction d : cycle_directions_cw()) {
     for (Handler *handler : change_handlers) {
-      handler->on_object_changed(move(pos, d));
+      if (mark == ChangeMarkHeight) {
+        handler->on_height_changed(move(pos, d));
+      } else {
+        handler->on_object_changed(move(pos, d));
+      }
+    }
+  }
+}
+
+void
+Map::hold_change(MapPos pos, ChangeMark mark) {
+  std::vector<MapPos> &list =
+    (mark == ChangeMarkHeight) ? held_changes.heights :
+    (mark == ChangeMarkObject) ? held_changes.objects : held_changes.borders;
+  for (Direction d : cycle_directions_cw()) {
+    MapPos changed = move(pos, d);
+    if ((change_marks[changed] & mark) == 0) {
+      change_marks[changed] |= mark;
+      list.push_back(changed);
     }
   }
 }
@@ -585,24 +687,26 @@ Map::set_object(MapPos pos, Object obj, int index) {
 /* Remove resources from the ground at a map position. */
 void
 Map::remove_ground_deposit(MapPos pos, int amount) {
-  landscape_tiles[pos].resource_amount -= amount;
+  add_to_sums(pos, -1);
+  tiles.resource_amount[pos] -= amount;
 
-  if (landscape_tiles[pos].resource_amount <= 0) {
+  if (tiles.resource_amount[pos] <= 0) {
     /* Also sets the ground deposit type to none. */
-    landscape_tiles[pos].mineral = MineralsNone;
+    tiles.mineral[pos] = MineralsNone;
   }
+  add_to_sums(pos, 1);
 }
 
 /* Remove fish at a map position (must be water). */
 void
 Map::remove_fish(MapPos pos, int amount) {
-  landscape_tiles[pos].resource_amount -= amount;
+  tiles.resource_amount[pos] -= amount;
 }
 
 /* Set the index of the serf occupying map position. */
 void
 Map::set_serf_index(MapPos pos, int index) {
-  game_tiles[pos].serf = index;
+  tiles.serf.set(pos, index);
 
   /* TODO Mark dirty in viewport. */
 }
@@ -673,12 +777,12 @@ Map::update_public(MapPos pos, Random *rnd) {
 void
 Map::update_hidden(MapPos pos, Random *rnd) {
   /* Update fish resources in water */
-  if (is_in_water(pos) && landscape_tiles[pos].resource_amount > 0) {
+  if (is_in_water(pos) && tiles.resource_amount[pos] > 0) {
     int r = rnd->random();
 
-    if (landscape_tiles[pos].resource_amount < 10 && (r & 0x3f00)) {
+    if (tiles.resource_amount[pos] < 10 && (r & 0x3f00)) {
       /* Spawn more fish. */
-      landscape_tiles[pos].resource_amount += 1;
+      tiles.resource_amount[pos] += 1;
     }
 
     /* Move in a random direction of: right, down right, left, up left */
@@ -693,13 +797,21 @@ Map::update_hidden(MapPos pos, Random *rnd) {
 
     if (is_in_water(adj_pos)) {
       /* Migrate a fish to adjacent water space. */
-      landscape_tiles[pos].resource_amount -= 1;
-      landscape_tiles[adj_pos].resource_amount += 1;
+      tiles.resource_amount[pos] -= 1;
+      tiles.resource_amount[adj_pos] += 1;
     }
   }
 }
 
-/* Update map data as part of the game progression. */
+/* Update map data as part of the game progression.
+   This visits regions() positions every 20 ticks, about one position per
+   32x32 tiles, so even the largest map only touches a few hundred tiles
+   per update. It is kept serial on the game thread: the positions share
+   one random stream with the rest of the game, and their order decides
+   the results, which must match the original game for a given seed.
+   For the same reason trees, seeds, fields and signs are not kept in a
+   queue of their own: which of them grow or go away, and when, follows
+   from this walk and the random numbers drawn on the way. */
 void
 Map::update(unsigned int tick, Random *rnd) {
   uint16_t delta = tick - update_state.last_tick;
@@ -765,7 +877,7 @@ Map::is_road_segment_valid(MapPos pos, Direction dir) const {
 bool
 Map::place_road_segments(const Road &road) {
   MapPos pos_ = road.get_source();
-  Road::Dirs dirs = road.get_dirs();
+  const Road::Dirs &dirs = road.get_dirs();
   Road::Dirs::const_iterator it = dirs.begin();
   for (; it != dirs.end(); ++it) {
     Direction rev_dir = reverse_direction(*it);
@@ -779,8 +891,12 @@ Map::place_road_segments(const Road &road) {
         Direction rev_dir = *it;
         Direction dir = reverse_direction(rev_dir);
 
-        game_tiles[pos_].paths &= ~BIT(dir);
-        game_tiles[move(pos_, dir)].paths &= ~BIT(rev_dir);
+        tiles.paths[pos_] &= ~BIT(dir);
+        tiles.paths[move(pos_, dir)] &= ~BIT(rev_dir);
+        count_change(pos_);
+        notify_changed(pos_, ChangeMarkBorders);
+        count_change(move(pos_, dir));
+        notify_changed(move(pos_, dir), ChangeMarkBorders);
 
         pos_ = move(pos_, dir);
       }
@@ -788,8 +904,12 @@ Map::place_road_segments(const Road &road) {
       return false;
     }
 
-    game_tiles[pos_].paths |= BIT(*it);
-    game_tiles[move(pos_, *it)].paths |= BIT(rev_dir);
+    tiles.paths[pos_] |= BIT(*it);
+    tiles.paths[move(pos_, *it)] |= BIT(rev_dir);
+    count_change(pos_);
+    notify_changed(pos_, ChangeMarkBorders);
+    count_change(move(pos_, *it));
+    notify_changed(move(pos_, *it), ChangeMarkBorders);
 
     pos_ = move(pos_, *it);
   }
@@ -803,7 +923,9 @@ Map::remove_road_backref_until_flag(MapPos pos_, Direction dir) {
     pos_ = move(pos_, dir);
 
     /* Clear backreference */
-    game_tiles[pos_].paths &= ~BIT(reverse_direction(dir));
+    tiles.paths[pos_] &= ~BIT(reverse_direction(dir));
+    count_change(pos_);
+    notify_changed(pos_, ChangeMarkBorders);
 
     if (get_obj(pos_) == ObjectFlag) break;
 
@@ -857,11 +979,15 @@ Map::remove_road_backrefs(MapPos pos_) {
 Direction
 Map::remove_road_segment(MapPos *pos, Direction dir) {
   /* Clear forward reference. */
-  game_tiles[*pos].paths &= ~BIT(dir);
+  tiles.paths[*pos] &= ~BIT(dir);
+  count_change(*pos);
+  notify_changed(*pos, ChangeMarkBorders);
   *pos = move(*pos, dir);
 
   /* Clear backreference. */
-  game_tiles[*pos].paths &= ~BIT(reverse_direction(dir));
+  tiles.paths[*pos] &= ~BIT(reverse_direction(dir));
+  count_change(*pos);
+  notify_changed(*pos, ChangeMarkBorders);
 
   /* Find next direction of path. */
   dir = DirectionNone;
@@ -911,6 +1037,24 @@ Map::road_segment_in_water(MapPos pos_, Direction dir) {
   return water;
 }
 
+uint32_t
+Map::get_changes_in(MapPos pos, int radius) const {
+  // Sampling once per block width, and at the far edge, reaches every block
+  // the square overlaps. A block sampled twice is counted twice, which still
+  // leaves the sum unchanged only while every one of the blocks is.
+  const int step = 1 << change_block_shift;
+  uint32_t changes = 0;
+  for (int y = -radius; ; y = std::min(y + step, radius)) {
+    for (int x = -radius; ; x = std::min(x + step, radius)) {
+      changes += block_changes[change_block(geom_.pos_add(pos, x, y))].load(
+                                                   std::memory_order_acquire);
+      if (x == radius) break;
+    }
+    if (y == radius) break;
+  }
+  return changes;
+}
+
 void
 Map::add_change_handler(Handler *handler) {
   change_handlers.push_back(handler);
@@ -921,24 +1065,260 @@ Map::del_change_handler(Handler *handler) {
   change_handlers.remove(handler);
 }
 
-bool
-Map::types_within(MapPos pos, Terrain low, Terrain high) {
-  if ((type_up(pos) >= low &&
-       type_up(pos) <= high) &&
-      (type_down(pos) >= low &&
-       type_down(pos) <= high) &&
-      (type_down(move_left(pos)) >= low &&
-       type_down(move_left(pos)) <= high) &&
-      (type_up(move_up_left(pos)) >= low &&
-       type_up(move_up_left(pos)) <= high) &&
-      (type_down(move_up_left(pos)) >= low &&
-       type_down(move_up_left(pos)) <= high) &&
-      (type_up(move_up(pos)) >= low &&
-       type_up(move_up(pos)) <= high)) {
-    return true;
+void
+Map::hold_changes() {
+  std::lock_guard<std::mutex> lock(changes_mutex);
+  if (change_marks.size() != geom_.tile_count()) {
+    change_marks.assign(geom_.tile_count(), 0);
+  }
+  changes_held = true;
+}
+
+/* Hand everything that changed since hold_changes() to the handlers at
+   once, so a burst of changes to one area costs one invalidation. */
+void
+Map::release_changes() {
+  Changes &changes = released_changes;
+  changes.heights.clear();
+  changes.objects.clear();
+  changes.borders.clear();
+  {
+    std::lock_guard<std::mutex> lock(changes_mutex);
+    if (!changes_held) return;
+    changes_held = false;
+    std::swap(changes, held_changes);
+    for (MapPos pos : changes.heights) change_marks[pos] = 0;
+    for (MapPos pos : changes.objects) change_marks[pos] = 0;
+    for (MapPos pos : changes.borders) change_marks[pos] = 0;
+  }
+
+  if (changes.heights.empty() && changes.objects.empty() &&
+      changes.borders.empty()) return;
+  for (Handler *handler : change_handlers) {
+    handler->on_changes(changes);
+  }
+}
+
+void
+Map::init_terrain() {
+  for (MapPos pos : geom_) {
+    MapPos up_left = move_up_left(pos);
+    unsigned int near = BIT(type_up(pos)) | BIT(type_down(pos)) |
+                        BIT(type_up(up_left)) | BIT(type_down(up_left));
+    unsigned int around = near | BIT(type_down(move_left(pos))) |
+                          BIT(type_up(move_up(pos)));
+    tiles.terrain[pos] = (near << 16) | around;
+  }
+  init_sums();
+}
+
+void
+Map::init_sums() {
+  block_sums.assign(block_changes.size(), BlockSums());
+  for (MapPos pos : geom_) {
+    add_to_sums(pos, 1);
+  }
+}
+
+// Flags and buildings hide the minerals under them from ground analysis.
+// Each mineral type has a large and a small sign, from gold to stone.
+// Stone piles go from Stone0, the whole pile, to Stone7, the last of it.
+uint32_t
+Map::get_sum_value(MapPos pos, unsigned int layer) const {
+  Object obj = get_obj(pos);
+  if (layer < 4) {
+    return (tiles.mineral[pos] == layer + 1 &&
+            tiles.resource_amount[pos] > 0 &&
+            (obj == ObjectNone || obj >= ObjectTree0)) ?
+           static_cast<uint32_t>(tiles.resource_amount[pos]) : 0;
+  }
+  if (layer == 8) {
+    return (obj >= ObjectTree0 && obj <= ObjectPine7) ? 1 : 0;
   }
+  if (layer == 9) {
+    return (obj >= ObjectStone0 && obj <= ObjectStone7) ?
+           1 + ObjectStone7 - obj : 0;
+  }
+  return (obj >= ObjectSignLargeGold && obj <= ObjectSignSmallStone &&
+          static_cast<unsigned int>(obj - ObjectSignLargeGold) / 2 ==
+          layer - 4) ? 1 : 0;
+}
 
-  return false;
+void
+Map::add_to_sums(MapPos pos, int factor) {
+  Object obj = get_obj(pos);
+  int type = tiles.mineral[pos];
+  BlockSums &sums = block_sums[change_block(pos)];
+  if (type != MineralsNone && tiles.resource_amount[pos] > 0 &&
+      (obj == ObjectNone || obj >= ObjectTree0)) {
+    sums[type - 1] += factor * tiles.resource_amount[pos];
+  }
+  if (obj >= ObjectSignLargeGold && obj <= ObjectSignSmallStone) {
+    sums[4 + (obj - ObjectSignLargeGold) / 2] += factor;
+  } else if (obj >= ObjectTree0 && obj <= ObjectPine7) {
+    sums[8] += factor;
+  } else if (obj >= ObjectStone0 && obj <= ObjectStone7) {
+    sums[9] += factor * (1 + ObjectStone7 - obj);
+  }
+}
+
+// The tiles within radius of pos are those x columns and y rows away with
+// |x|, |y| and |x - y| all at most radius. Where the hexagon is wider or
+// taller than the map, a spiral would come across tiles more than once, and
+// so are they counted here.
+uint32_t
+Map::get_area_sum(MapPos pos, int radius, unsigned int first,
+                  unsigned int last) const {
+  auto tile_sum = [this, first, last](MapPos tile) {
+    uint32_t sum = 0;
+    for (unsigned int layer = first; layer <= last; layer++) {
+      sum += get_sum_value(tile, layer);
+    }
+    return sum;
+  };
+  auto inside = [radius](int x, int y) {
+    return std::abs(x) <= radius && std::abs(y) <= radius &&
+           std::abs(x - y) <= radius;
+  };
+
+  uint32_t total = 0;
+  int cols = static_cast<int>(geom_.cols());
+  int rows = static_cast<int>(geom_.rows());
+  if (2 * radius + 1 > cols || 2 * radius + 1 > rows) {
+    for (int y = -radius; y <= radius; y++) {
+      for (int x = std::max(-radius, y - radius);
+           x <= std::min(radius, y + radius); x++) {
+        total += tile_sum(geom_.pos_add(pos, x, y));
+      }
+    }
+    return total;
+  }
+
+  // Blocks are walked in coordinates moved a map away, which are never
+  // negative and wrap to the same blocks.
+  int side = 1 << change_block_shift;
+  int col = geom_.pos_col(pos) + cols;
+  int row = geom_.pos_row(pos) + rows;
+  for (int by = (row - radius) >> change_block_shift;
+       by <= (row + radius) >> change_block_shift; by++) {
+    for (int bx = (col - radius) >> change_block_shift;
+         bx <= (col + radius) >> change_block_shift; bx++) {
+      int x0 = bx * side - col;
+      int y0 = by * side - row;
+      int x1 = x0 + side - 1;
+      int y1 = y0 + side - 1;
+      const BlockSums &sums =
+        block_sums[change_block(geom_.pos_add(pos, x0, y0))];
+      uint32_t block_total = 0;
+      for (unsigned int layer = first; layer <= last; layer++) {
+        block_total += sums[layer];
+      }
+      if (block_total == 0) {
+        continue;
+      }
+      if (inside(x0, y0) && inside(x1, y0) && inside(x0, y1) &&
+          inside(x1, y1)) {
+        total += block_total;
+        continue;
+      }
+      for (int y = std::max(y0, -radius); y <= std::min(y1, radius); y++) {
+        int x_first = std::max(std::max(x0, -radius), y - radius);
+        int x_last = std::min(std::min(x1, radius), y + radius);
+        for (int x = x_first; x <= x_last; x++) {
+          total += tile_sum(geom_.pos_add(pos, x, y));
+        }
+      }
+    }
+  }
+  return total;
+}
+
+unsigned int
+Map::get_minerals_in(MapPos pos, int radius, Minerals type) const {
+  if (type == MineralsNone) {
+    return 0;
+  }
+  return get_area_sum(pos, radius, type - 1, type - 1);
+}
+
+unsigned int
+Map::get_signs_in(MapPos pos, int radius, Minerals type) const {
+  if (type == MineralsNone) {
+    return get_area_sum(pos, radius, 4, 7);
+  }
+  return get_area_sum(pos, radius, 4 + type - 1, 4 + type - 1);
+}
+
+unsigned int
+Map::get_trees_in(MapPos pos, int radius) const {
+  return get_area_sum(pos, radius, 8, 8);
+}
+
+unsigned int
+Map::get_stones_in(MapPos pos, int radius) const {
+  return get_area_sum(pos, radius, 9, 9);
+}
+
+void
+Map::Tiles::resize(const MapGeometry &geom) {
+  size_t count = geom.tile_count();
+  height.resize(count, 0);
+  type_up.resize(count, 0);
+  type_down.resize(count, 0);
+  mineral.resize(count, 0);
+  resource_amount.resize(count, 0);
+  obj.resize(count, 0);
+  paths.resize(count, 0);
+  owner.resize(count, 0);
+  idle_serf.resize(count, 0);
+  terrain.resize(count, 0);
+  serf.reset(geom);
+  obj_index.reset(geom);
+}
+
+void
+Map::add_memory_usage(MemoryUsage *usage) {
+  usage->add("map.tiles", geom_.tile_count(),
+             MemoryUsage::vector_bytes(tiles.height) +
+             MemoryUsage::vector_bytes(tiles.type_up) +
+             MemoryUsage::vector_bytes(tiles.type_down) +
+             MemoryUsage::vector_bytes(tiles.mineral) +
+             MemoryUsage::vector_bytes(tiles.resource_amount) +
+             MemoryUsage::vector_bytes(tiles.obj) +
+             MemoryUsage::vector_bytes(tiles.paths) +
+             MemoryUsage::vector_bytes(tiles.owner) +
+             MemoryUsage::vector_bytes(tiles.idle_serf) +
+             MemoryUsage::vector_bytes(tiles.terrain) +
+             tiles.serf.get_allocated_bytes() +
+             tiles.obj_index.get_allocated_bytes());
+  usage->add("map.sums", block_sums.size(),
+             MemoryUsage::vector_bytes(block_sums));
+  std::lock_guard<std::mutex> lock(changes_mutex);
+  usage->add("map.changes",
+             held_changes.heights.size() + held_changes.objects.size(),
+             MemoryUsage::vector_bytes(held_changes.heights) +
+             MemoryUsage::vector_bytes(held_changes.objects) +
+             MemoryUsage::vector_bytes(released_changes.heights) +
+             MemoryUsage::vector_bytes(released_changes.objects) +
+             MemoryUsage::vector_bytes(change_marks) +
+             MemoryUsage::vector_bytes(block_changes) +
+             MemoryUsage::list_bytes(change_handlers));
+  usage->add("map.spirals", 295 + 3268, (295 + 3268) * sizeof(MapPos));
+}
+
+bool
+Map::Tiles::operator == (const Tiles& rhs) const {
+  return height == rhs.height &&
+    type_up == rhs.type_up &&
+    type_down == rhs.type_down &&
+    mineral == rhs.mineral &&
+    resource_amount == rhs.resource_amount &&
+    obj == rhs.obj &&
+    paths == rhs.paths &&
+    owner == rhs.owner &&
+    idle_serf == rhs.idle_serf &&
+    serf == rhs.serf &&
+    obj_index == rhs.obj_index;
 }
 
 bool
@@ -951,16 +1331,7 @@ Map::operator == (const Map& rhs) const {
   }
 
   // Check all tiles
-  for (MapPos pos_ : geom_) {
-    if (this->landscape_tiles[pos_] != rhs.landscape_tiles[pos_]) {
-      return false;
-    }
-    if (this->game_tiles[pos_] != rhs.game_tiles[pos_]) {
-      return false;
-    }
-  }
-
-  return true;
+  return (this->tiles == rhs.tiles);
 }
 
 bool
@@ -974,47 +1345,45 @@ operator >> (SaveReaderBinary &reader, Map &map) {
   uint16_t v16;
 
   const MapGeometry &geom = map.geom();
+  Map::Tiles &tiles = map.tiles;
   for (unsigned int y = 0; y < geom.rows(); y++) {
     for (unsigned int x = 0; x < geom.cols(); x++) {
       MapPos pos = map.pos(x, y);
-      Map::GameTile &game_tile = map.game_tiles[pos];
-      Map::LandscapeTile &landscape_tile = map.landscape_tiles[pos];
       reader >> v8;
-      game_tile.paths = v8 & 0x3f;
+      tiles.paths[pos] = v8 & 0x3f;
       reader >> v8;
-      landscape_tile.height = v8 & 0x1f;
+      tiles.height[pos] = v8 & 0x1f;
       if ((v8 >> 7) == 0x01) {
-        game_tile.owner = ((v8 >> 5) & 0x03) + 1;
+        tiles.owner[pos] = ((v8 >> 5) & 0x03) + 1;
       }
       reader >> v8;
-      landscape_tile.type_up = (Map::Terrain)((v8 >> 4) & 0x0f);
-      landscape_tile.type_down = (Map::Terrain)(v8 & 0x0f);
+      tiles.type_up[pos] = (Map::Terrain)((v8 >> 4) & 0x0f);
+      tiles.type_down[pos] = (Map::Terrain)(v8 & 0x0f);
       reader >> v8;
-      landscape_tile.obj = (Map::Object)(v8 & 0x7f);
-      game_tile.idle_serf = 0;  // (BIT_TEST(v8, 7) != 0);
+      tiles.obj[pos] = (Map::Object)(v8 & 0x7f);
+      tiles.idle_serf[pos] = 0;  // (BIT_TEST(v8, 7) != 0);
     }
     for (unsigned int x = 0; x < geom.cols(); x++) {
       MapPos pos = map.pos(x, y);
-      Map::GameTile &game_tile = map.game_tiles[pos];
-      Map::LandscapeTile &landscape_tile = map.landscape_tiles[pos];
       if (map.get_obj(pos) >= Map::ObjectFlag &&
           map.get_obj(pos) <= Map::ObjectCastle) {
-        landscape_tile.mineral = Map::MineralsNone;
-        landscape_tile.resource_amount = 0;
+        tiles.mineral[pos] = Map::MineralsNone;
+        tiles.resource_amount[pos] = 0;
         reader >> v16;
-        game_tile.obj_index = v16;
+        tiles.obj_index.set(pos, v16);
       } else {
         reader >> v8;
-        landscape_tile.mineral = (Map::Minerals)((v8 >> 5) & 7);
-        landscape_tile.resource_amount = v8 & 0x1f;
+        tiles.mineral[pos] = (Map::Minerals)((v8 >> 5) & 7);
+        tiles.resource_amount[pos] = v8 & 0x1f;
         reader >> v8;
-        game_tile.obj_index = 0;
+        tiles.obj_index.set(pos, 0);
       }
 
       reader >> v16;
-      game_tile.serf = v16;
+      tiles.serf.set(pos, v16);
     }
   }
+  map.init_terrain();
 
   return reader;
 }
@@ -1037,45 +1406,66 @@ operator >> (SaveReaderText &reader, Map &map) {
   reader.value("pos")[0] >> x;
   reader.value("pos")[1] >> y;
   MapPos pos = map.pos(x, y);
+  Map::Tiles &tiles = map.tiles;
+
+  /* Read each value whole rather than part by part for every tile. */
+  std::vector<unsigned int> paths;
+  std::vector<unsigned int> height;
+  std::vector<unsigned int> type_up;
+  std::vector<unsigned int> type_down;
+  std::vector<unsigned int> object;
+  std::vector<unsigned int> serf;
+  std::vector<unsigned int> resource_type;
+  std::vector<unsigned int> resource_amount;
+  reader.value("paths") >> paths;
+  reader.value("height") >> height;
+  reader.value("type.up") >> type_up;
+  reader.value("type.down") >> type_down;
+  reader.value("object") >> object;
+  reader.value("serf") >> serf;
+  reader.value("resource.type") >> resource_type;
+  reader.value("resource.amount") >> resource_amount;
+  /* Older saves keep the idle serf in the top bit of the object. */
+  std::vector<unsigned int> idle_serf;
+  bool has_idle_serf = reader.has_value("idle_serf");
+  if (has_idle_serf) {
+    reader.value("idle_serf") >> idle_serf;
+  }
+
+  const size_t tiles_count = SAVE_MAP_TILE_SIZE * SAVE_MAP_TILE_SIZE;
+  for (const std::vector<unsigned int> *value : { &paths, &height, &type_up,
+                                                  &type_down, &object, &serf,
+                                                  &resource_type,
+                                                  &resource_amount }) {
+    if (value->size() < tiles_count) {
+      throw ExceptionFreeserf("Failed to read value");
+    }
+  }
+  if (has_idle_serf && idle_serf.size() < tiles_count) {
+    throw ExceptionFreeserf("Failed to read value");
+  }
 
   for (int y = 0; y < SAVE_MAP_TILE_SIZE; y++) {
     for (int x = 0; x < SAVE_MAP_TILE_SIZE; x++) {
       MapPos p = map.pos_add(pos, map.pos(x, y));
-      Map::GameTile &game_tile = map.game_tiles[p];
-      Map::LandscapeTile &landscape_tile = map.landscape_tiles[p];
-      unsigned int val;
-
-      reader.value("paths")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-      game_tile.paths = val & 0x3f;
-
-      reader.value("height")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-      landscape_tile.height = val & 0x1f;
-
-      reader.value("type.up")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-      landscape_tile.type_up = (Map::Terrain)val;
-
-      reader.value("type.down")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-      landscape_tile.type_down = (Map::Terrain)val;
-
-      try {
-        reader.value("idle_serf")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-        game_tile.idle_serf = (val != 0);
-        reader.value("object")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-        landscape_tile.obj = (Map::Object)val;
-      } catch (...) {
-        reader.value("object")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-        landscape_tile.obj = (Map::Object)(val & 0x7f);
-        game_tile.idle_serf = (BIT_TEST(val, 7) != 0);
-      }
+      int i = y*SAVE_MAP_TILE_SIZE+x;
 
-      reader.value("serf")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-      game_tile.serf = val;
+      tiles.paths[p] = paths[i] & 0x3f;
+      tiles.height[p] = height[i] & 0x1f;
+      tiles.type_up[p] = (Map::Terrain)type_up[i];
+      tiles.type_down[p] = (Map::Terrain)type_down[i];
 
-      reader.value("resource.type")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-      landscape_tile.mineral = (Map::Minerals)val;
+      if (has_idle_serf) {
+        tiles.idle_serf[p] = (idle_serf[i] != 0);
+        tiles.obj[p] = (Map::Object)object[i];
+      } else {
+        tiles.obj[p] = (Map::Object)(object[i] & 0x7f);
+        tiles.idle_serf[p] = (BIT_TEST(object[i], 7) != 0);
+      }
 
-      reader.value("resource.amount")[y*SAVE_MAP_TILE_SIZE+x] >> val;
-      landscape_tile.resource_amount = val;
+      tiles.serf.set(p, serf[i]);
+      tiles.mineral[p] = (Map::Minerals)resource_type[i];
+      tiles.resource_amount[p] = resource_amount[i];
     }
   }
 
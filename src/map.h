@@ -22,12 +22,20 @@
 #ifndef SRC_MAP_H_
 #define SRC_MAP_H_
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <list>
 #include <memory>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 #include <utility>
 #include <vector>
 
+#include "src/game-events.h"
 #include "src/map-geometry.h"
+#include "src/memory-usage.h"
 #include "src/misc.h"
 #include "src/random.h"
 
@@ -35,7 +43,112 @@ class Map;
 
 class Road {
  public:
-  typedef std::list<Direction> Dirs;
+  // Directions of a road, packed three bits each into words of 21. The
+  // first words are kept inline, so roads of typical length are copied
+  // and extended without allocating.
+  class Dirs {
+   public:
+    class const_iterator {
+     public:
+      typedef std::bidirectional_iterator_tag iterator_category;
+      typedef Direction value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef const Direction *pointer;
+      typedef Direction reference;
+
+     protected:
+      const Dirs *dirs;
+      size_t index;
+
+     public:
+      const_iterator() : dirs(nullptr), index(0) {}
+      const_iterator(const Dirs *_dirs, size_t _index)
+        : dirs(_dirs), index(_index) {}
+
+      Direction operator * () const { return dirs->at(index); }
+      const_iterator &operator ++ () { index++; return *this; }
+      const_iterator operator ++ (int) {
+        const_iterator it = *this; index++; return it; }
+      const_iterator &operator -- () { index--; return *this; }
+      const_iterator operator -- (int) {
+        const_iterator it = *this; index--; return it; }
+      bool operator == (const const_iterator &rhs) const {
+        return (index == rhs.index); }
+      bool operator != (const const_iterator &rhs) const {
+        return (index != rhs.index); }
+    };
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef Direction value_type;
+
+   protected:
+    static const size_t dirs_per_word = 21;
+    static const size_t local_words = 4;
+
+    size_t length;
+    uint64_t local[local_words];
+    std::vector<uint64_t> spill;  // Words after the local ones
+
+    uint64_t get_word(size_t index) const {
+      return (index < local_words) ? local[index] : spill[index-local_words];
+    }
+    uint64_t &get_word(size_t index) {
+      return (index < local_words) ? local[index] : spill[index-local_words];
+    }
+
+   public:
+    Dirs() : length(0), local() {}
+
+    size_t size() const { return length; }
+    bool empty() const { return (length == 0); }
+
+    Direction at(size_t index) const {
+      uint64_t word = get_word(index / dirs_per_word);
+      return static_cast<Direction>(
+                              (word >> (3 * (index % dirs_per_word))) & 7); }
+    Direction front() const { return at(0); }
+    Direction back() const { return at(length - 1); }
+
+    void push_back(Direction dir) {
+      size_t index = length / dirs_per_word;
+      if (index >= local_words && index - local_words == spill.size()) {
+        spill.push_back(0);
+      }
+      get_word(index) |= static_cast<uint64_t>(dir) <<
+                           (3 * (length % dirs_per_word));
+      length++;
+    }
+    void pop_back() {
+      length--;
+      size_t index = length / dirs_per_word;
+      get_word(index) &= ~(UINT64_C(7) << (3 * (length % dirs_per_word)));
+      if (index >= local_words && length % dirs_per_word == 0) {
+        spill.pop_back();
+      }
+    }
+    void clear() {
+      length = 0;
+      for (uint64_t &word : local) word = 0;
+      spill.clear();
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, length); }
+    const_reverse_iterator rbegin() const {
+      return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const {
+      return const_reverse_iterator(begin()); }
+
+    // Unused bits are kept clear, so whole words can be compared.
+    bool operator == (const Dirs &rhs) const {
+      if (length != rhs.length || spill != rhs.spill) return false;
+      for (size_t i = 0; i < local_words; i++) {
+        if (local[i] != rhs.local[i]) return false;
+      }
+      return true;
+    }
+    bool operator != (const Dirs &rhs) const { return !(*this == rhs); }
+  };
 
  protected:
   MapPos begin;
@@ -50,7 +163,7 @@ class Road {
   void invalidate() { begin = bad_map_pos; dirs.clear(); }
   void start(MapPos start) { begin = start; }
   MapPos get_source() const { return begin; }
-  Dirs get_dirs() const { return dirs; }
+  const Dirs &get_dirs() const { return dirs; }
   size_t get_length() const { return dirs.size(); }
   // tlongstretch convenience function
   Direction get_first() const { return dirs.front(); }
@@ -69,6 +182,120 @@ class SaveReaderText;
 class SaveWriterText;
 class MapGenerator;
 
+// A tile field that is zero on most of the map, kept in chunks of 8x8
+// tiles that are only allocated once a tile in them is set to something
+// else. The tiles of a chunk are together in memory, so a tile and its
+// neighbours mostly share one, and the memory taken grows with the area
+// that is in use rather than with the size of the map.
+// Only the game thread sets tiles, but the AI threads read them, so a new
+// chunk is filled before its pointer is stored with release, and get()
+// loads the pointer with acquire.
+template <typename T>
+class TileChunks {
+ protected:
+  static const unsigned int chunk_shift = 3;
+  static const unsigned int chunk_side = 1 << chunk_shift;
+  typedef std::array<T, chunk_side * chunk_side> Chunk;
+
+  std::vector<std::atomic<Chunk*>> chunks;
+  unsigned int col_mask;
+  unsigned int row_shift;
+  unsigned int chunk_row_shift;  // log2 of the chunks in a row
+
+  size_t chunk_index(MapPos pos) const {
+    return ((pos >> (row_shift + chunk_shift)) << chunk_row_shift) |
+           ((pos & col_mask) >> chunk_shift); }
+  size_t tile_index(MapPos pos) const {
+    return (((pos >> row_shift) & (chunk_side - 1)) << chunk_shift) |
+           (pos & (chunk_side - 1)); }
+  const Chunk *get_chunk(size_t index) const {
+    return chunks[index].load(std::memory_order_acquire); }
+
+  void clear() {
+    for (std::atomic<Chunk*> &chunk : chunks) {
+      delete chunk.exchange(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+ public:
+  TileChunks() : col_mask(0), row_shift(0), chunk_row_shift(0) {}
+  TileChunks(const TileChunks &that)
+    : chunks(that.chunks.size())
+    , col_mask(that.col_mask)
+    , row_shift(that.row_shift)
+    , chunk_row_shift(that.chunk_row_shift) {
+    for (size_t i = 0; i < chunks.size(); i++) {
+      const Chunk *chunk = that.get_chunk(i);
+      chunks[i].store((chunk != nullptr) ? new Chunk(*chunk) : nullptr,
+                      std::memory_order_relaxed);
+    }
+  }
+  TileChunks &operator = (const TileChunks &) = delete;
+  ~TileChunks() { clear(); }
+
+  // Drop all chunks, for the given geometry.
+  void reset(const MapGeometry &geom) {
+    clear();
+    col_mask = geom.col_mask();
+    row_shift = geom.row_shift();
+    chunk_row_shift = geom.row_shift() - chunk_shift;
+    chunks = std::vector<std::atomic<Chunk*>>(
+                             geom.tile_count() / (chunk_side * chunk_side));
+    for (std::atomic<Chunk*> &chunk : chunks) {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  T get(MapPos pos) const {
+    const Chunk *chunk = get_chunk(chunk_index(pos));
+    return (chunk != nullptr) ? (*chunk)[tile_index(pos)] : 0; }
+  void set(MapPos pos, T value) {
+    std::atomic<Chunk*> &slot = chunks[chunk_index(pos)];
+    Chunk *chunk = slot.load(std::memory_order_relaxed);
+    if (chunk == nullptr) {
+      if (value == 0) {
+        return;
+      }
+      chunk = new Chunk();
+      chunk->fill(0);
+      (*chunk)[tile_index(pos)] = value;
+      slot.store(chunk, std::memory_order_release);
+      return;
+    }
+    (*chunk)[tile_index(pos)] = value;
+  }
+
+  size_t get_chunk_count() const { return chunks.size(); }
+  size_t get_allocated_chunk_count() const {
+    size_t count = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+      count += (get_chunk(i) != nullptr) ? 1 : 0;
+    }
+    return count;
+  }
+  size_t get_allocated_bytes() const {
+    return MemoryUsage::vector_bytes(chunks) +
+           get_allocated_chunk_count() * sizeof(Chunk);
+  }
+
+  // Chunks that were never allocated hold zeros.
+  bool operator == (const TileChunks &rhs) const {
+    if (chunks.size() != rhs.chunks.size()) {
+      return false;
+    }
+    static const Chunk zeros = {};
+    for (size_t i = 0; i < chunks.size(); i++) {
+      const Chunk *a = get_chunk(i);
+      const Chunk *b = rhs.get_chunk(i);
+      if (*((a != nullptr) ? a : &zeros) != *((b != nullptr) ? b : &zeros)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool operator != (const TileChunks &rhs) const { return !(*this == rhs); }
+};
+
 // Map data.
 //
 // Initialization of a new Map takes a few steps:
@@ -229,11 +456,30 @@ class Map {
     TerrainSnow1
   } Terrain;
 
+  // Positions whose height, object, or paths and owner changed while
+  // changes were held, each listed once.
+  typedef struct Changes {
+    std::vector<MapPos> heights;
+    std::vector<MapPos> objects;
+    std::vector<MapPos> borders;
+  } Changes;
+
   class Handler {
    public:
     virtual ~Handler() {}
     virtual void on_height_changed(MapPos pos) = 0;
     virtual void on_object_changed(MapPos pos) = 0;
+    // The paths or the owner of the land changed, so roads and borders
+    // drawn there did.
+    virtual void on_borders_changed(MapPos /*pos*/) {}
+    // Called once per release_changes() with everything that changed while
+    // changes were held. Handlers that can do better than one position at
+    // a time should override this.
+    virtual void on_changes(const Changes &changes) {
+      for (MapPos pos : changes.heights) on_height_changed(pos);
+      for (MapPos pos : changes.objects) on_object_changed(pos);
+      for (MapPos pos : changes.borders) on_borders_changed(pos);
+    }
   };
 
   typedef struct LandscapeTile {
@@ -276,27 +522,32 @@ class Map {
   };
 
  protected:
-  typedef struct GameTile {
-    unsigned int serf;
-    unsigned int owner;
-    unsigned int obj_index;
-    uint8_t paths;
-    bool idle_serf;
-
-    bool operator == (const GameTile& rhs) const {
-      return this->paths == rhs.paths &&
-        this->serf == rhs.serf &&
-        this->owner == rhs.owner &&
-        this->idle_serf == rhs.idle_serf &&
-        this->obj_index == rhs.obj_index;
-    }
-    bool operator != (const GameTile& rhs) const {
-      return !(*this == rhs); }
-  } GameTile;
+  // Tile data as a structure of arrays, one packed array per field. Most
+  // scans only read one or two fields (height for path costs, paths for
+  // roads, owner and object for ownership, minimap and AI area counts), so
+  // keeping each field contiguous lets them touch far fewer cache lines.
+  typedef struct Tiles {
+    std::vector<uint8_t> height;
+    std::vector<uint8_t> type_up;
+    std::vector<uint8_t> type_down;
+    std::vector<uint8_t> mineral;
+    std::vector<int16_t> resource_amount;
+    std::vector<uint8_t> obj;
+    std::vector<uint8_t> paths;
+    std::vector<uint8_t> owner;  // owner + 1, or 0 if not owned
+    std::vector<uint8_t> idle_serf;
+    // A bit per terrain type found around the tile, see init_terrain().
+    std::vector<uint32_t> terrain;
+    // Only tiles with a serf or a flag or building on them have these.
+    TileChunks<uint32_t> serf;
+    TileChunks<uint32_t> obj_index;
+
+    void resize(const MapGeometry &geom);
+    bool operator == (const Tiles& rhs) const;
+  } Tiles;
 
   MapGeometry geom_;
-  std::vector<LandscapeTile> landscape_tiles;
-  std::vector<GameTile> game_tiles;
+  Tiles tiles;
 
   uint16_t regions;
 
@@ -306,6 +557,32 @@ class Map {
   typedef std::list<Handler*> ChangeHandlers;
   ChangeHandlers change_handlers;
 
+  // Changes collected between hold_changes() and release_changes(). Map
+  // changes come from the game thread and from players' threads holding
+  // the game lock, so the journal has its own lock.
+  std::mutex changes_mutex;
+  bool changes_held;
+  Changes held_changes;
+  std::vector<uint8_t> change_marks;  // ChangeMark bits per tile
+  Changes released_changes;  // Only used by release_changes()
+  GameEvents *events;   // Of the game the map is of, if any
+
+  // Count of changes to heights, objects, paths and owners per block of
+  // 8x8 tiles. Read by other threads to check cached results, so atomic.
+  static const unsigned int change_block_shift = 3;
+  std::vector<std::atomic<uint32_t>> block_changes;
+  std::atomic<uint32_t> total_changes;  // Of all blocks
+
+  // Totals for get_minerals_in(), get_signs_in(), get_trees_in() and
+  // get_stones_in() over the same blocks: the minerals a ground analysis
+  // finds by type, then the geologist signs by type, each from gold to
+  // stone, then the trees and the stone in piles. Areas skip the blocks that
+  // have none and take the blocks they cover whole without looking at the
+  // tiles.
+  static const unsigned int sum_layers = 10;
+  typedef std::array<uint32_t, sum_layers> BlockSums;
+  std::vector<BlockSums> block_sums;
+
   std::unique_ptr<MapPos[]> spiral_pos_pattern;
   std::unique_ptr<MapPos[]> extended_spiral_pos_pattern;
 
@@ -313,9 +590,15 @@ class Map {
  public:
 
   explicit Map(const MapGeometry& geom);
+  // A copy for Game::fork(), with none of the change handlers, as those
+  //  are the views of the original.
+  Map(const Map &that);
 
   const MapGeometry& geom() const { return geom_; }
 
+  // The tile arrays, the change journal and the spiral patterns.
+  void add_memory_usage(MemoryUsage *usage);
+
   unsigned int get_size() const { return geom_.size(); }
   unsigned int get_cols() const { return geom_.cols(); }
   unsigned int get_rows() const { return geom_.rows(); }
@@ -380,9 +663,9 @@ class Map {
 
   /* Extractors for map data. */
   unsigned int paths(MapPos pos) const {
-    return (game_tiles[pos].paths & 0x3f); }
+    return (tiles.paths[pos] & 0x3f); }
   bool has_path(MapPos pos, Direction dir) const {
-    return (BIT_TEST(game_tiles[pos].paths, dir) != 0); }
+    return (BIT_TEST(tiles.paths[pos], dir) != 0); }
   //tlongstretch - convenience function
   bool has_any_path(MapPos pos) {
     for (Direction d : cycle_directions_cw()) {
@@ -392,40 +675,76 @@ class Map {
     return false;
   }
   void add_path(MapPos pos, Direction dir) {
-    game_tiles[pos].paths |= BIT(dir); }
+    tiles.paths[pos] |= BIT(dir);
+    count_change(pos);
+    notify_changed(pos, ChangeMarkBorders); }
   void del_path(MapPos pos, Direction dir) {
-    game_tiles[pos].paths &= ~BIT(dir); }
+    tiles.paths[pos] &= ~BIT(dir);
+    count_change(pos);
+    notify_changed(pos, ChangeMarkBorders); }
 
-  bool has_owner(MapPos pos) const { return (game_tiles[pos].owner != 0); }
+  bool has_owner(MapPos pos) const { return (tiles.owner[pos] != 0); }
   unsigned int get_owner(MapPos pos) const {
-    return game_tiles[pos].owner - 1; }
+    return tiles.owner[pos] - 1; }
   void set_owner(MapPos pos, unsigned int _owner) {
-    game_tiles[pos].owner = _owner + 1; }
-  void del_owner(MapPos pos) { game_tiles[pos].owner = 0; }
+    tiles.owner[pos] = _owner + 1;
+    count_change(pos);
+    publish(GameEvent::TypeOwnerChanged, pos, _owner + 1);
+    notify_changed(pos, ChangeMarkBorders); }
+  void del_owner(MapPos pos) {
+    if (tiles.owner[pos] == 0) {
+      count_change(pos);
+      return;
+    }
+    tiles.owner[pos] = 0;
+    count_change(pos);
+    publish(GameEvent::TypeOwnerChanged, pos, 0);
+    notify_changed(pos, ChangeMarkBorders); }
   unsigned int get_height(MapPos pos) const {
-    return landscape_tiles[pos].height; }
-
-  Terrain type_up(MapPos pos) const { return landscape_tiles[pos].type_up; }
-  Terrain type_down(MapPos pos) const { return landscape_tiles[pos].type_down; }
-  bool types_within(MapPos pos, Terrain low, Terrain high);
-
-  Object get_obj(MapPos pos) const { return landscape_tiles[pos].obj; }
-  bool get_idle_serf(MapPos pos) const { return game_tiles[pos].idle_serf; }
-  void set_idle_serf(MapPos pos) { game_tiles[pos].idle_serf = true; }
-  void clear_idle_serf(MapPos pos) { game_tiles[pos].idle_serf = false; }
+    return tiles.height[pos]; }
+
+  Terrain type_up(MapPos pos) const {
+    return static_cast<Terrain>(tiles.type_up[pos]); }
+  Terrain type_down(MapPos pos) const {
+    return static_cast<Terrain>(tiles.type_down[pos]); }
+  // A bit for each of the terrain types from low to high.
+  static unsigned int terrain_bits(Terrain low, Terrain high) {
+    return ((2u << high) - 1) & ~((1u << low) - 1); }
+  // Bits of the terrain types of the six triangles around pos.
+  unsigned int terrain_around(MapPos pos) const {
+    return tiles.terrain[pos] & 0xffff; }
+  // Bits of the terrain types of the triangles of pos and of the tile up
+  // left of it.
+  unsigned int terrain_up_left(MapPos pos) const {
+    return tiles.terrain[pos] >> 16; }
+  // Whether all six triangles around pos are of types from low to high.
+  bool types_within(MapPos pos, Terrain low, Terrain high) const {
+    return (terrain_around(pos) & ~terrain_bits(low, high)) == 0; }
+
+  Object get_obj(MapPos pos) const {
+    return static_cast<Object>(tiles.obj[pos]); }
+  bool get_idle_serf(MapPos pos) const { return (tiles.idle_serf[pos] != 0); }
+  void set_idle_serf(MapPos pos) { tiles.idle_serf[pos] = 1; }
+  void clear_idle_serf(MapPos pos) { tiles.idle_serf[pos] = 0; }
 
   unsigned int get_obj_index(MapPos pos) const {
-    return game_tiles[pos].obj_index; }
+    return tiles.obj_index.get(pos); }
   void set_obj_index(MapPos pos, unsigned int index) {
-    game_tiles[pos].obj_index = index; }
+    tiles.obj_index.set(pos, index); }
   Minerals get_res_type(MapPos pos) const {
-    return landscape_tiles[pos].mineral; }
+    return static_cast<Minerals>(tiles.mineral[pos]); }
   unsigned int get_res_amount(MapPos pos) const {
-    return landscape_tiles[pos].resource_amount; }
+    return tiles.resource_amount[pos]; }
   unsigned int get_res_fish(MapPos pos) const { return get_res_amount(pos); }
-  unsigned int get_serf_index(MapPos pos) const { return game_tiles[pos].serf; }
+  unsigned int get_serf_index(MapPos pos) const {
+    return tiles.serf.get(pos); }
   unsigned int has_serf(MapPos pos) const {
-    return (game_tiles[pos].serf != 0); }
+    return (tiles.serf.get(pos) != 0); }
+
+  // Whole-map arrays for scans, indexed by MapPos. Owners are stored as
+  //  owner + 1 with 0 for no owner.
+  const std::vector<uint8_t> &get_owner_tiles() const { return tiles.owner; }
+  const std::vector<uint8_t> &get_obj_tiles() const { return tiles.obj; }
 
   bool has_flag(MapPos pos) const { return (get_obj(pos) == ObjectFlag); }
   bool has_building(MapPos pos) const { return (get_obj(pos) >=
@@ -440,16 +759,16 @@ class Map {
 
   /* Whether the position is completely surrounded by water. */
   bool is_in_water(MapPos pos) const {
-    return (is_water_tile(pos) &&
-            is_water_tile(move_up_left(pos)) &&
-            type_down(move_left(pos)) <= TerrainWater3 &&
-            type_up(move_up(pos)) <= TerrainWater3); }
+    return types_within(pos, TerrainWater0, TerrainWater3); }
 
   /* Mapping from Object to Space. */
   static const Space map_space_from_obj[128];
 
   void set_height(MapPos pos, int height);
-  void set_height_no_refresh(MapPos pos, int height);
+  // Level several positions to one height. Handlers are told with the next
+  // release_changes() even if changes are not held now, so leveling from
+  // another thread between game updates reaches them on the game thread.
+  void set_heights(const std::vector<MapPos> &positions, int height);
   void set_object(MapPos pos, Object obj, int index);
   void remove_ground_deposit(MapPos pos, int amount);
   void remove_fish(MapPos pos, int amount);
@@ -458,6 +777,24 @@ class Map {
   unsigned int get_gold_deposit() const;
 
   void init_tiles(const MapGenerator &generator);
+  void init_tiles(const std::vector<LandscapeTile> &landscape);
+  // Work out the terrain bits of every tile from the terrain types, once
+  // they are all set. The types do not change in a game. Also works out the
+  // mineral and sign totals, which are kept up to date from then on.
+  void init_terrain();
+
+  // Of the tiles within radius of pos (the hexagon a spiral of that many
+  // shells covers), the amount of minerals of type that a ground analysis
+  // finds, which leaves out tiles under flags and buildings, and the number
+  // of geologist signs for type, or for any mineral if it is MineralsNone.
+  // Empty signs are not counted.
+  unsigned int get_minerals_in(MapPos pos, int radius, Minerals type) const;
+  unsigned int get_signs_in(MapPos pos, int radius,
+                            Minerals type = MineralsNone) const;
+  // The trees within radius of pos, and the stone in the piles there, a
+  // pile counting for the stone a stonecutter can still take from it.
+  unsigned int get_trees_in(MapPos pos, int radius) const;
+  unsigned int get_stones_in(MapPos pos, int radius) const;
 
   void update(unsigned int tick, Random *rnd);
   const UpdateState& get_update_state() const { return update_state; }
@@ -465,9 +802,52 @@ class Map {
     update_state = update_state_;
   }
 
+  // Number of changes so far to the height, object, paths or owner of the
+  // tiles within three of pos (and some further away). It grows with every
+  // such change, so a result worked out from those tiles can be cached with
+  // it and is still good while the count is the same.
+  uint32_t get_changes_near(MapPos pos) const {
+    return block_changes[change_block(geom_.pos_add(pos, -3, -3))].load(
+                                                   std::memory_order_acquire) +
+           block_changes[change_block(geom_.pos_add(pos, 3, -3))].load(
+                                                   std::memory_order_acquire) +
+           block_changes[change_block(geom_.pos_add(pos, -3, 3))].load(
+                                                   std::memory_order_acquire) +
+           block_changes[change_block(geom_.pos_add(pos, 3, 3))].load(
+                                                   std::memory_order_acquire);
+  }
+  // The same for every tile within radius columns and rows of pos, for
+  // results worked out from a larger area.
+  uint32_t get_changes_in(MapPos pos, int radius) const;
+  // The counts behind those, one for each block of get_change_block_size()
+  // squared tiles. Blocks are numbered row by row.
+  static unsigned int get_change_block_size() {
+    return 1 << change_block_shift; }
+  unsigned int get_change_block_count() const {
+    return static_cast<unsigned int>(block_changes.size()); }
+  uint32_t get_block_changes(unsigned int block) const {
+    return block_changes[block].load(std::memory_order_acquire); }
+  // All of them together, to tell whether anything changed at all.
+  uint32_t get_changes() const {
+    return total_changes.load(std::memory_order_acquire); }
+  // Count a change at pos that matters to cached results but isn't made
+  // through the setters here, like a building that stops leveling.
+  void count_change(MapPos pos) {
+    block_changes[change_block(pos)].fetch_add(1, std::memory_order_release);
+    total_changes.fetch_add(1, std::memory_order_release);
+  }
+
+  // Where object and owner changes are published, the events of the game
+  //  the map is of. Copies of the map start without.
+  void set_events(GameEvents *events_) { events = events_; }
   void add_change_handler(Handler *handler);
   void del_change_handler(Handler *handler);
 
+  // Collect changes instead of notifying handlers for every position, until
+  // release_changes() hands them over in one batch.
+  void hold_changes();
+  void release_changes();
+
   static int *get_spiral_pattern();
   static int *get_extended_spiral_pattern();
 
@@ -495,8 +875,37 @@ class Map {
   void init_spiral_pos_pattern();
   void init_extended_spiral_pos_pattern();
 
+  unsigned int change_block(MapPos pos) const {
+    unsigned int block_shift = geom_.row_shift() - change_block_shift;
+    return ((pos >> (geom_.row_shift() + change_block_shift)) << block_shift) |
+           ((pos & geom_.col_mask()) >> change_block_shift);
+  }
+
   void update_public(MapPos pos, Random *rnd);
   void update_hidden(MapPos pos, Random *rnd);
+
+  void init_sums();
+  // Add what the tile at pos counts for in the sums times factor, -1 before
+  // it changes and 1 after.
+  void add_to_sums(MapPos pos, int factor);
+  uint32_t get_sum_value(MapPos pos, unsigned int layer) const;
+  // Total of the layers from first to last within radius of pos.
+  uint32_t get_area_sum(MapPos pos, int radius, unsigned int first,
+                        unsigned int last) const;
+
+  typedef enum ChangeMark {
+    ChangeMarkHeight = 1,
+    ChangeMarkObject = 2,
+    ChangeMarkBorders = 4,
+  } ChangeMark;
+
+  // Tell handlers that the neighbours of pos changed, or note them in the
+  // journal if changes are held.
+  void notify_changed(MapPos pos, ChangeMark mark);
+  void publish(GameEvent::Type type, MapPos pos, unsigned int index) {
+    if (events != nullptr) events->publish(type, pos, 0, index); }
+  // Add the neighbours of pos to the held changes, with changes_mutex held.
+  void hold_change(MapPos pos, ChangeMark mark);
 };
 
 typedef std::shared_ptr<Map> PMap;
@@ -0,0 +1,141 @@
+/*
+ * memory-usage.cc - What the game, caches and AI players keep in memory
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/memory-usage.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include <fstream>
+#include <iomanip>
+
+const size_t MemoryUsage::tree_node_overhead;
+const size_t MemoryUsage::list_node_overhead;
+
+void
+MemoryUsage::add(const std::string &name, size_t count, size_t bytes) {
+  for (Entry &entry : entries) {
+    if (entry.name == name) {
+      entry.count += count;
+      entry.bytes += bytes;
+      return;
+    }
+  }
+  entries.push_back(Entry{ name, count, bytes });
+}
+
+void
+MemoryUsage::add(const MemoryUsage &other) {
+  for (const Entry &entry : other.entries) {
+    add(entry.name, entry.count, entry.bytes);
+  }
+}
+
+size_t
+MemoryUsage::get_bytes(const std::string &prefix) const {
+  size_t bytes = 0;
+  for (const Entry &entry : entries) {
+    if (entry.name.compare(0, prefix.size(), prefix) == 0) {
+      bytes += entry.bytes;
+    }
+  }
+  return bytes;
+}
+
+#ifdef _WIN32
+size_t
+MemoryUsage::get_resident_bytes() {
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                            sizeof(counters))) {
+    return 0;
+  }
+  return counters.WorkingSetSize;
+}
+
+size_t
+MemoryUsage::get_peak_resident_bytes() {
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                            sizeof(counters))) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+}
+#else
+size_t
+MemoryUsage::get_resident_bytes() {
+  // The second number is the resident pages, where there is a /proc
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t resident = 0;
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+size_t
+MemoryUsage::get_peak_resident_bytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+#endif  // _WIN32
+
+void
+MemoryUsage::write_report(std::ostream *os) const {
+  *os << std::left << std::setw(36) << "owner" << std::right
+      << std::setw(12) << "count" << std::setw(12) << "MB" << "\n";
+  *os << std::fixed << std::setprecision(3);
+  for (const Entry &entry : entries) {
+    *os << std::left << std::setw(36) << entry.name << std::right
+        << std::setw(12) << entry.count
+        << std::setw(12) << entry.bytes / 1048576. << "\n";
+  }
+  *os << std::left << std::setw(48) << "total" << std::right
+      << std::setw(12) << get_bytes() / 1048576. << "\n";
+  *os << std::left << std::setw(48) << "resident" << std::right
+      << std::setw(12) << get_resident_bytes() / 1048576. << "\n";
+  *os << std::left << std::setw(48) << "peak resident" << std::right
+      << std::setw(12) << get_peak_resident_bytes() / 1048576. << "\n";
+}
+
+bool
+MemoryUsage::write_report(const std::string &path) const {
+  std::ofstream file(path.c_str());
+  if (!file.is_open()) {
+    return false;
+  }
+  write_report(&file);
+  return file.good();
+}
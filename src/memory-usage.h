@@ -0,0 +1,79 @@
+/*
+ * memory-usage.h - What the game, caches and AI players keep in memory
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_MEMORY_USAGE_H_
+#define SRC_MEMORY_USAGE_H_
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Live objects and bytes by owner, such as game.serfs or image_cache, that
+// the owners add themselves with their add_memory_usage(). Bytes are what
+// the containers have allocated, capacity included; node based containers
+// are estimated from the size of their elements plus the usual node
+// overhead, and the text in them is left out. With the resident and peak
+// size of the process next to it, a report shows where memory went and
+// what the caches may be allowed.
+class MemoryUsage {
+ public:
+  typedef struct Entry {
+    std::string name;
+    size_t count;
+    size_t bytes;
+  } Entry;
+
+  // The pointers of a std::map or std::set node, and its color
+  static const size_t tree_node_overhead = 4 * sizeof(void*);
+  // The pointers of a std::list node
+  static const size_t list_node_overhead = 2 * sizeof(void*);
+
+  // Add to the entry name, a new one if this is its first time.
+  void add(const std::string &name, size_t count, size_t bytes);
+  // Add each entry of other, such as what an AI published.
+  void add(const MemoryUsage &other);
+
+  template <class Vector> static size_t vector_bytes(const Vector &vector) {
+    return vector.capacity() * sizeof(typename Vector::value_type); }
+  template <class Tree> static size_t tree_bytes(const Tree &tree) {
+    return tree.size() *
+           (sizeof(typename Tree::value_type) + tree_node_overhead); }
+  template <class List> static size_t list_bytes(const List &list) {
+    return list.size() *
+           (sizeof(typename List::value_type) + list_node_overhead); }
+
+  const std::vector<Entry> &get_entries() const { return entries; }
+  // Of the entries whose name starts with prefix, all of them by default
+  size_t get_bytes(const std::string &prefix = "") const;
+
+  // Of the whole process as the system sees it, 0 where it can't tell
+  static size_t get_resident_bytes();
+  static size_t get_peak_resident_bytes();
+
+  void write_report(std::ostream *os) const;
+  bool write_report(const std::string &path) const;
+
+ protected:
+  std::vector<Entry> entries;
+};
+
+#endif  // SRC_MEMORY_USAGE_H_
@@ -0,0 +1,312 @@
+/*
+ * metrics.cc - What a running game is doing, for whatever watches it
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/metrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+#include "src/ai.h"
+#include "src/game.h"
+#include "src/memory-usage.h"
+#include "src/profiler.h"
+
+Metrics::Metrics()
+  : time(0.) {
+}
+
+void
+Metrics::add(const std::string &name, const std::string &help, Type type) {
+  families.push_back(Family{ name, help, type, std::vector<Sample>() });
+}
+
+void
+Metrics::set(double value, const Labels &labels, const std::string &suffix) {
+  if (families.empty()) {
+    return;
+  }
+  families.back().samples.push_back(Sample{ suffix, labels, value });
+}
+
+void
+Metrics::add_section(const std::string &name, const std::string &help,
+                     const std::string &section) {
+  for (const Profiler::Stats &stats : Profiler::get_stats(section)) {
+    if (stats.name != section) {
+      continue;
+    }
+    add(name, help, TypeSummary);
+    set(stats.p50_ns / 1e9, { { "quantile", "0.5" } });
+    set(stats.p90_ns / 1e9, { { "quantile", "0.9" } });
+    set(stats.p99_ns / 1e9, { { "quantile", "0.99" } });
+    set(stats.total_ns / 1e9, Labels(), "_sum");
+    set(static_cast<double>(stats.count), Labels(), "_count");
+  }
+}
+
+void
+Metrics::collect(Game *game, const std::vector<AI*> &ais) {
+  add("freeserf_game_tick", "Ticks the game has played", TypeCounter);
+  set(game->get_tick());
+
+  add_section("freeserf_tick_duration_seconds", "Wall time of game updates",
+              "game.update");
+
+  const std::string lock_prefix = "lock.game.wait_";
+  std::vector<Profiler::Stats> lock_stats = Profiler::get_stats(lock_prefix);
+  add("freeserf_lock_wait_seconds_total",
+      "Time spent waiting for the game lock", TypeCounter);
+  for (const Profiler::Stats &stats : lock_stats) {
+    set(stats.total_ns / 1e9,
+        { { "mode", stats.name.substr(lock_prefix.size()) } });
+  }
+  add("freeserf_lock_waits_total", "Times the game lock was waited for",
+      TypeCounter);
+  for (const Profiler::Stats &stats : lock_stats) {
+    set(static_cast<double>(stats.count),
+        { { "mode", stats.name.substr(lock_prefix.size()) } });
+  }
+
+  // as of the last loop each AI finished
+  add("freeserf_ai_loop_seconds", "Time the last AI loop spent in its steps",
+      TypeGauge);
+  for (AI *ai : ais) {
+    std::shared_ptr<const AIStats::Loops> loops = ai->get_loop_stats();
+    if (loops && !loops->empty()) {
+      set(loops->front().step_ns / 1e9,
+          { { "player", std::to_string(ai->get_player_index()) } });
+    }
+  }
+  add("freeserf_ai_loop_lock_wait_seconds",
+      "Time the last AI loop waited for the game lock", TypeGauge);
+  for (AI *ai : ais) {
+    std::shared_ptr<const AIStats::Loops> loops = ai->get_loop_stats();
+    if (loops && !loops->empty()) {
+      set(loops->front().lock_wait_ns / 1e9,
+          { { "player", std::to_string(ai->get_player_index()) } });
+    }
+  }
+  add("freeserf_ai_loops_total", "AI loops finished", TypeCounter);
+  for (AI *ai : ais) {
+    std::shared_ptr<const AIStats::Loops> loops = ai->get_loop_stats();
+    if (loops && !loops->empty()) {
+      set(loops->front().loop,
+          { { "player", std::to_string(ai->get_player_index()) } });
+    }
+  }
+
+  MemoryUsage usage;
+  game->add_memory_usage(&usage);
+  for (AI *ai : ais) {
+    std::shared_ptr<const MemoryUsage> ai_usage = ai->get_memory_usage();
+    if (ai_usage) {
+      usage.add(*ai_usage);
+    }
+  }
+  add("freeserf_memory_bytes", "Memory held, by owner", TypeGauge);
+  for (const MemoryUsage::Entry &entry : usage.get_entries()) {
+    set(static_cast<double>(entry.bytes), { { "owner", entry.name } });
+  }
+  add("freeserf_resident_bytes", "Resident size of the process", TypeGauge);
+  set(static_cast<double>(MemoryUsage::get_resident_bytes()));
+  add("freeserf_peak_resident_bytes", "Peak resident size of the process",
+      TypeGauge);
+  set(static_cast<double>(MemoryUsage::get_peak_resident_bytes()));
+
+  add("freeserf_objects", "Objects in the game, by kind", TypeGauge);
+  set(static_cast<double>(game->get_serf_count()), { { "kind", "serfs" } });
+  set(static_cast<double>(game->get_flag_count()), { { "kind", "flags" } });
+  set(static_cast<double>(game->get_building_count()),
+      { { "kind", "buildings" } });
+
+  add_section("freeserf_save_snapshot_seconds",
+              "Time autosaves held the game to take its values",
+              "game.autosave");
+  add_section("freeserf_save_write_seconds",
+              "Time autosaves took to write the file", "autosave.write");
+}
+
+static const char *
+type_name(Metrics::Type type) {
+  switch (type) {
+    case Metrics::TypeCounter: return "counter";
+    case Metrics::TypeSummary: return "summary";
+    default: return "gauge";
+  }
+}
+
+// Between quotes, in a label of the Prometheus text or a JSON string.
+static void
+write_quoted(std::ostream *os, const std::string &text) {
+  *os << '"';
+  for (char c : text) {
+    switch (c) {
+      case '"': *os << "\\\""; break;
+      case '\\': *os << "\\\\"; break;
+      case '\n': *os << "\\n"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          *os << ' ';
+        } else {
+          *os << c;
+        }
+    }
+  }
+  *os << '"';
+}
+
+void
+Metrics::write(std::ostream *os, Format format) const {
+  *os << std::setprecision(12);
+  if (format == FormatPrometheus) {
+    for (const Family &family : families) {
+      *os << "# HELP " << family.name << " " << family.help << "\n";
+      *os << "# TYPE " << family.name << " " << type_name(family.type) << "\n";
+      for (const Sample &sample : family.samples) {
+        *os << family.name << sample.suffix;
+        if (!sample.labels.empty()) {
+          *os << "{";
+          for (size_t i = 0; i < sample.labels.size(); i++) {
+            *os << ((i > 0) ? "," : "") << sample.labels[i].first << "=";
+            write_quoted(os, sample.labels[i].second);
+          }
+          *os << "}";
+        }
+        *os << " " << sample.value << "\n";
+      }
+    }
+    return;
+  }
+
+  *os << "{\"time\":" << std::fixed << std::setprecision(3) << time
+      << std::defaultfloat << std::setprecision(12) << ",\"metrics\":[";
+  bool first = true;
+  for (const Family &family : families) {
+    for (const Sample &sample : family.samples) {
+      *os << (first ? "" : ",") << "{\"name\":";
+      write_quoted(os, family.name + sample.suffix);
+      if (!sample.labels.empty()) {
+        *os << ",\"labels\":{";
+        for (size_t i = 0; i < sample.labels.size(); i++) {
+          *os << ((i > 0) ? "," : "");
+          write_quoted(os, sample.labels[i].first);
+          *os << ":";
+          write_quoted(os, sample.labels[i].second);
+        }
+        *os << "}";
+      }
+      *os << ",\"value\":" << sample.value << "}";
+      first = false;
+    }
+  }
+  *os << "]}\n";
+}
+
+MetricsExporter::MetricsExporter(const std::string &path_,
+                                 unsigned int interval_ms)
+  : MetricsExporter(path_, format_of(path_), interval_ms) {
+}
+
+MetricsExporter::MetricsExporter(const std::string &path_,
+                                 Metrics::Format format_,
+                                 unsigned int interval_ms)
+  : path(path_)
+  , format(format_)
+  , interval(std::chrono::milliseconds(interval_ms))
+  , last_tick(0)
+  , started(false) {
+}
+
+Metrics::Format
+MetricsExporter::format_of(const std::string &path) {
+  for (const std::string &ending : { std::string(".json"),
+                                     std::string(".jsonl") }) {
+    if (path.size() >= ending.size() &&
+        path.compare(path.size() - ending.size(), ending.size(),
+                     ending) == 0) {
+      return Metrics::FormatJsonLines;
+    }
+  }
+  return Metrics::FormatPrometheus;
+}
+
+bool
+MetricsExporter::update(Game *game, const std::vector<AI*> &ais) {
+  Clock::time_point now = Clock::now();
+  if (!started) {
+    started = true;
+    last_time = now;
+    last_tick = game->get_tick();
+    return true;
+  }
+  if (now - last_time < interval) {
+    return true;
+  }
+  return write(game, ais);
+}
+
+bool
+MetricsExporter::write(Game *game, const std::vector<AI*> &ais) {
+  Clock::time_point now = Clock::now();
+  Metrics metrics;
+  metrics.set_time(std::chrono::duration<double>(
+                   std::chrono::system_clock::now().time_since_epoch()).count());
+  metrics.collect(game, ais);
+
+  // since the last time written
+  double seconds = started ?
+    std::chrono::duration<double>(now - last_time).count() : 0.;
+  metrics.add("freeserf_ticks_per_second",
+              "Game ticks played per second of wall time", Metrics::TypeGauge);
+  metrics.set((seconds > 0.) ? (game->get_tick() - last_tick) / seconds : 0.);
+  started = true;
+  last_time = now;
+  last_tick = game->get_tick();
+
+  if (format == Metrics::FormatJsonLines) {
+    std::ofstream file(path, std::ios::app);
+    if (!file.is_open()) {
+      return false;
+    }
+    metrics.write(&file, format);
+    return file.good();
+  }
+
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::trunc);
+    if (!file.is_open()) {
+      return false;
+    }
+    metrics.write(&file, format);
+    if (!file.good()) {
+      return false;
+    }
+  }
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    // where renaming doesn't replace
+    std::remove(path.c_str());
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+  }
+  return true;
+}
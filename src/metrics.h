@@ -0,0 +1,124 @@
+/*
+ * metrics.h - What a running game is doing, for whatever watches it
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_METRICS_H_
+#define SRC_METRICS_H_
+
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class AI;
+class Game;
+
+// Numbers about a game at one moment, in families of samples as Prometheus
+// has them: a family has a name, a type and a line of help, each sample
+// of it a value and the labels that tell it from the others. Written as
+// the Prometheus text format, or as one line of JSON each time.
+class Metrics {
+ public:
+  typedef enum Type {
+    TypeGauge,
+    TypeCounter,
+    TypeSummary,
+  } Type;
+
+  typedef enum Format {
+    FormatPrometheus,
+    FormatJsonLines,
+  } Format;
+
+  typedef std::vector<std::pair<std::string, std::string>> Labels;
+
+  typedef struct Sample {
+    std::string suffix;   // after the family name, e.g. "_count"
+    Labels labels;
+    double value;
+  } Sample;
+
+  typedef struct Family {
+    std::string name;
+    std::string help;
+    Type type;
+    std::vector<Sample> samples;
+  } Family;
+
+ protected:
+  std::vector<Family> families;
+  double time;   // seconds since the epoch
+
+ public:
+  Metrics();
+
+  // Start a family, the samples set from now on go into it.
+  void add(const std::string &name, const std::string &help, Type type);
+  void set(double value, const Labels &labels = Labels(),
+           const std::string &suffix = std::string());
+  // A summary of a profiler section: its quantiles, total seconds and
+  // count, nothing when it was not hit.
+  void add_section(const std::string &name, const std::string &help,
+                   const std::string &section);
+
+  // What the game and its AI players are doing. On the game thread,
+  // between updates.
+  void collect(Game *game, const std::vector<AI*> &ais);
+
+  const std::vector<Family> &get_families() const { return families; }
+  void set_time(double time_) { time = time_; }
+
+  void write(std::ostream *os, Format format) const;
+};
+
+// Writes the metrics of a game to a file every interval. The Prometheus
+// text replaces the file each time, by way of a file next to it, so a
+// collector reading it never sees half of it. JSON lines are added to the
+// end of it.
+class MetricsExporter {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+ protected:
+  std::string path;
+  Metrics::Format format;
+  Clock::duration interval;
+  Clock::time_point last_time;
+  unsigned int last_tick;
+  bool started;
+
+ public:
+  // The format is JSON lines for paths ending in ".json" or ".jsonl",
+  // Prometheus otherwise, unless given.
+  MetricsExporter(const std::string &path, unsigned int interval_ms);
+  MetricsExporter(const std::string &path, Metrics::Format format,
+                  unsigned int interval_ms);
+
+  // On the game thread after each update. Writes when the interval has
+  // passed since the last time, false if that failed.
+  bool update(Game *game, const std::vector<AI*> &ais);
+  // Write now, like at the end of a game.
+  bool write(Game *game, const std::vector<AI*> &ais);
+
+  static Metrics::Format format_of(const std::string &path);
+};
+
+#endif  // SRC_METRICS_H_
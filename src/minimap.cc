@@ -38,72 +38,77 @@ Minimap::Minimap(PMap _map) {
 
   draw_grid = false;
 
+  full_redraw = true;
+  drawn_frame = nullptr;
+  draw_to_pixels = false;
+
   set_map(_map);
 }
 
 void
 Minimap::set_draw_grid(bool _draw_grid) {
   draw_grid = _draw_grid;
+  full_redraw = true;
   set_redraw();
 }
 
+static const int minimap_color_offset[] = {
+  0, 85, 102, 119, 17, 17, 17, 17,
+  34, 34, 34, 51, 51, 51, 68, 68
+};
+
+static const Color minimap_colors[] = {
+  Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
+  Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
+  Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
+  Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
+  Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
+  Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x73, 0xb3, 0x43),
+  Color(0x73, 0xb3, 0x43), Color(0x6b, 0xab, 0x3b), Color(0x63, 0xa3, 0x33),
+  Color(0x5f, 0x9b, 0x2f), Color(0x57, 0x93, 0x27), Color(0x53, 0x8b, 0x23),
+  Color(0x4f, 0x83, 0x1b), Color(0x47, 0x7f, 0x17), Color(0x3f, 0x73, 0x13),
+  Color(0x3b, 0x6b, 0x13), Color(0x33, 0x63, 0x0f), Color(0x2f, 0x57, 0x0b),
+  Color(0x2b, 0x4f, 0x0b), Color(0x23, 0x43, 0x0b), Color(0x1f, 0x3b, 0x07),
+  Color(0x1b, 0x33, 0x07), Color(0xef, 0xcf, 0xaf), Color(0xef, 0xcf, 0xaf),
+  Color(0xe3, 0xbf, 0x9f), Color(0xd7, 0xb3, 0x8f), Color(0xd7, 0xb3, 0x8f),
+  Color(0xcb, 0xa3, 0x7f), Color(0xbf, 0x97, 0x73), Color(0xbf, 0x97, 0x73),
+  Color(0xb3, 0x87, 0x67), Color(0xab, 0x7b, 0x5b), Color(0xab, 0x7b, 0x5b),
+  Color(0x9f, 0x6f, 0x4f), Color(0x93, 0x63, 0x43), Color(0x93, 0x63, 0x43),
+  Color(0x87, 0x57, 0x3b), Color(0x7b, 0x4f, 0x33), Color(0x7b, 0x4f, 0x33),
+  Color(0xd7, 0xb3, 0x8f), Color(0xd7, 0xb3, 0x8f), Color(0xcb, 0xa3, 0x7f),
+  Color(0xcb, 0xa3, 0x7f), Color(0xbf, 0x97, 0x73), Color(0xbf, 0x97, 0x73),
+  Color(0xb3, 0x87, 0x67), Color(0xab, 0x7b, 0x5b), Color(0x9f, 0x6f, 0x4f),
+  Color(0x93, 0x63, 0x43), Color(0x87, 0x57, 0x3b), Color(0x7b, 0x4f, 0x33),
+  Color(0x73, 0x43, 0x2b), Color(0x67, 0x3b, 0x23), Color(0x5b, 0x33, 0x1b),
+  Color(0x4f, 0x2b, 0x17), Color(0x43, 0x23, 0x13), Color(0xff, 0xff, 0xff),
+  Color(0xff, 0xff, 0xff), Color(0xef, 0xef, 0xef), Color(0xef, 0xef, 0xef),
+  Color(0xdf, 0xdf, 0xdf), Color(0xd3, 0xd3, 0xd3), Color(0xc3, 0xc3, 0xc3),
+  Color(0xb3, 0xb3, 0xb3), Color(0xa7, 0xa7, 0xa7), Color(0x97, 0x97, 0x97),
+  Color(0x87, 0x87, 0x87), Color(0x7b, 0x7b, 0x7b), Color(0x6b, 0x6b, 0x6b),
+  Color(0x5b, 0x5b, 0x5b), Color(0x4f, 0x4f, 0x4f), Color(0x3f, 0x3f, 0x3f),
+  Color(0x2f, 0x2f, 0x2f), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
+  Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
+  Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
+  Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
+  Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
+  Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
+  Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
+  Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
+  Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
+  Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
+  Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
+  Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x13, 0x13, 0xbb),
+  Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
+  Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
+  Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
+  Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
+  Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
+  Color(0x13, 0x13, 0xbb)
+};
+
 /* Initialize minimap data. */
 void
 Minimap::init_minimap() {
-  static const int color_offset[] = {
-    0, 85, 102, 119, 17, 17, 17, 17,
-    34, 34, 34, 51, 51, 51, 68, 68
-  };
-
-  static const Color colors[] = {
-    Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
-    Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
-    Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
-    Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
-    Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf),
-    Color(0x00, 0x00, 0xaf), Color(0x00, 0x00, 0xaf), Color(0x73, 0xb3, 0x43),
-    Color(0x73, 0xb3, 0x43), Color(0x6b, 0xab, 0x3b), Color(0x63, 0xa3, 0x33),
-    Color(0x5f, 0x9b, 0x2f), Color(0x57, 0x93, 0x27), Color(0x53, 0x8b, 0x23),
-    Color(0x4f, 0x83, 0x1b), Color(0x47, 0x7f, 0x17), Color(0x3f, 0x73, 0x13),
-    Color(0x3b, 0x6b, 0x13), Color(0x33, 0x63, 0x0f), Color(0x2f, 0x57, 0x0b),
-    Color(0x2b, 0x4f, 0x0b), Color(0x23, 0x43, 0x0b), Color(0x1f, 0x3b, 0x07),
-    Color(0x1b, 0x33, 0x07), Color(0xef, 0xcf, 0xaf), Color(0xef, 0xcf, 0xaf),
-    Color(0xe3, 0xbf, 0x9f), Color(0xd7, 0xb3, 0x8f), Color(0xd7, 0xb3, 0x8f),
-    Color(0xcb, 0xa3, 0x7f), Color(0xbf, 0x97, 0x73), Color(0xbf, 0x97, 0x73),
-    Color(0xb3, 0x87, 0x67), Color(0xab, 0x7b, 0x5b), Color(0xab, 0x7b, 0x5b),
-    Color(0x9f, 0x6f, 0x4f), Color(0x93, 0x63, 0x43), Color(0x93, 0x63, 0x43),
-    Color(0x87, 0x57, 0x3b), Color(0x7b, 0x4f, 0x33), Color(0x7b, 0x4f, 0x33),
-    Color(0xd7, 0xb3, 0x8f), Color(0xd7, 0xb3, 0x8f), Color(0xcb, 0xa3, 0x7f),
-    Color(0xcb, 0xa3, 0x7f), Color(0xbf, 0x97, 0x73), Color(0xbf, 0x97, 0x73),
-    Color(0xb3, 0x87, 0x67), Color(0xab, 0x7b, 0x5b), Color(0x9f, 0x6f, 0x4f),
-    Color(0x93, 0x63, 0x43), Color(0x87, 0x57, 0x3b), Color(0x7b, 0x4f, 0x33),
-    Color(0x73, 0x43, 0x2b), Color(0x67, 0x3b, 0x23), Color(0x5b, 0x33, 0x1b),
-    Color(0x4f, 0x2b, 0x17), Color(0x43, 0x23, 0x13), Color(0xff, 0xff, 0xff),
-    Color(0xff, 0xff, 0xff), Color(0xef, 0xef, 0xef), Color(0xef, 0xef, 0xef),
-    Color(0xdf, 0xdf, 0xdf), Color(0xd3, 0xd3, 0xd3), Color(0xc3, 0xc3, 0xc3),
-    Color(0xb3, 0xb3, 0xb3), Color(0xa7, 0xa7, 0xa7), Color(0x97, 0x97, 0x97),
-    Color(0x87, 0x87, 0x87), Color(0x7b, 0x7b, 0x7b), Color(0x6b, 0x6b, 0x6b),
-    Color(0x5b, 0x5b, 0x5b), Color(0x4f, 0x4f, 0x4f), Color(0x3f, 0x3f, 0x3f),
-    Color(0x2f, 0x2f, 0x2f), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
-    Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
-    Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
-    Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
-    Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
-    Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3), Color(0x07, 0x07, 0xb3),
-    Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
-    Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
-    Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
-    Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
-    Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7),
-    Color(0x0b, 0x0b, 0xb7), Color(0x0b, 0x0b, 0xb7), Color(0x13, 0x13, 0xbb),
-    Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
-    Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
-    Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
-    Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
-    Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb), Color(0x13, 0x13, 0xbb),
-    Color(0x13, 0x13, 0xbb)
-  };
-
   if (map == NULL) {
     return;
   }
@@ -111,17 +116,103 @@ Minimap::init_minimap() {
   minimap.clear();
 
   for (MapPos pos : map->geom()) {
-    int type_off = color_offset[map->type_up(pos)];
+    minimap.push_back(terrain_color(pos));
+  }
 
-    pos = map->move_right(pos);
-    int h1 = map->get_height(pos);
+  recompose();
+}
+
+Color
+Minimap::terrain_color(MapPos pos) const {
+  int type_off = minimap_color_offset[map->type_up(pos)];
+
+  pos = map->move_right(pos);
+  int h1 = map->get_height(pos);
+
+  pos = map->move_left(map->move_down(pos));
+  int h2 = map->get_height(pos);
 
-    pos = map->move_left(map->move_down(pos));
-    int h2 = map->get_height(pos);
+  int h_off = h2 - h1 + 8;
+  return minimap_colors[type_off + h_off];
+}
+
+/* Compose every position again, and draw all of them next time. */
+void
+Minimap::recompose() {
+  if (map == NULL) {
+    return;
+  }
+
+  composed.clear();
+  for (MapPos pos : map->geom()) {
+    composed.push_back(compose(pos));
+  }
+
+  composed_changes.resize(map->get_change_block_count());
+  for (unsigned int b = 0; b < composed_changes.size(); b++) {
+    composed_changes[b] = map->get_block_changes(b);
+  }
+
+  patched.clear();
+  full_redraw = true;
+  set_redraw();
+}
+
+/* Compose the blocks the map changed in since the last look, and one
+   position around them as the terrain color of a position depends on
+   the heights of its neighbours. */
+void
+Minimap::recompose_changed() {
+  int block_size = Map::get_change_block_size();
+  int block_cols = map->get_cols() / block_size;
+
+  for (unsigned int b = 0; b < composed_changes.size(); b++) {
+    uint32_t changes = map->get_block_changes(b);
+    if (changes == composed_changes[b]) {
+      continue;
+    }
+    composed_changes[b] = changes;
+
+    MapPos corner = map->pos((b % block_cols) * block_size,
+                             (b / block_cols) * block_size);
+    for (int y = -1; y <= block_size; y++) {
+      for (int x = -1; x <= block_size; x++) {
+        MapPos pos = map->pos_add(corner, x, y);
+        minimap[pos] = terrain_color(pos);
+        Color color = compose(pos);
+        if (color != composed[pos]) {
+          composed[pos] = color;
+          patched.push_back(pos);
+        }
+      }
+    }
+  }
+}
 
-    int h_off = h2 - h1 + 8;
-    minimap.push_back(colors[type_off + h_off]);
+void
+Minimap::draw_composed() {
+  recompose_changed();
+
+  if (full_redraw || frame != drawn_frame) {
+    pixels.assign(static_cast<size_t>(width) * height, 0xFF000000);
+    draw_to_pixels = true;
+    Color *color_data = &composed[0];
+    for (unsigned int row = 0; row < map->get_rows(); row++) {
+      for (unsigned int col = 0; col < map->get_cols(); col++) {
+        draw_minimap_point(col, row, *(color_data++), scale);
+      }
+    }
+    draw_to_pixels = false;
+    frame->update_pixels(0, 0, width, height, pixels.data());
+    full_redraw = false;
+    drawn_frame = frame;
+  } else {
+    for (MapPos pos : patched) {
+      draw_minimap_point(map->pos_col(pos), map->pos_row(pos), composed[pos],
+                         scale);
+    }
   }
+  patched.clear();
 }
 
 void
@@ -143,7 +234,11 @@ Minimap::draw_minimap_point(int col, int row, const Color &color, int density) {
       mm_x = mm_x % map_width;
       while (mm_x < width) {
         if (mm_x >= -density) {
-          frame->fill_rect(mm_x, mm_y, density, density, color);
+          if (draw_to_pixels) {
+            fill_pixels(mm_x, mm_y, density, color);
+          } else {
+            frame->fill_rect(mm_x, mm_y, density, density, color);
+          }
         }
         mm_x += map_width;
       }
@@ -154,44 +249,22 @@ Minimap::draw_minimap_point(int col, int row, const Color &color, int density) {
 }
 
 void
-Minimap::draw_minimap_map() {
-  Color *color_data = &minimap[0];
-  for (unsigned int row = 0; row < map->get_rows(); row++) {
-    for (unsigned int col = 0; col < map->get_cols(); col++) {
-      Color color = *(color_data++);
-      draw_minimap_point(col, row, color, scale);
-    }
+Minimap::fill_pixels(int x, int y, int density, const Color &color) {
+  uint32_t argb = (static_cast<uint32_t>(color.get_alpha()) << 24) |
+                  (color.get_red() << 16) | (color.get_green() << 8) |
+                  color.get_blue();
+  int x0 = std::max(x, 0);
+  int x1 = std::min(x + density, width);
+  int y0 = std::max(y, 0);
+  int y1 = std::min(y + density, height);
+  for (int py = y0; py < y1 && x0 < x1; py++) {
+    std::fill(&pixels[py * width + x0], &pixels[py * width] + x1, argb);
   }
 }
 
-void
-MinimapGame::draw_minimap_ownership(int density) {
-  for (unsigned int row = 0; row < map->get_rows(); row += density) {
-    for (unsigned int col = 0; col < map->get_cols(); col += density) {
-      MapPos pos = map->pos(col, row);
-      if (map->has_owner(pos)) {
-        Color color = interface->get_player_color(map->get_owner(pos));
-        draw_minimap_point(col, row, color, scale);
-      }
-    }
-  }
-}
-
-void
-MinimapGame::draw_minimap_roads() {
-  for (unsigned int row = 0; row < map->get_rows(); row++) {
-    for (unsigned int col = 0; col < map->get_cols(); col++) {
-      int pos = map->pos(col, row);
-      if (map->paths(pos)) {
-        draw_minimap_point(col, row, Color::black, scale);
-      }
-    }
-  }
-}
-
-void
-MinimapGame::draw_minimap_buildings() {
-  const int building_remap[] = {
+Color
+MinimapGame::compose(MapPos pos) const {
+  static const int building_remap[] = {
     Building::TypeCastle,
     Building::TypeStock, Building::TypeTower, Building::TypeHut,
     Building::TypeFortress, Building::TypeToolMaker, Building::TypeSawmill,
@@ -204,23 +277,46 @@ MinimapGame::draw_minimap_buildings() {
     Building::TypeGoldSmelter
   };
 
-  for (unsigned int row = 0; row < map->get_rows(); row++) {
-    for (unsigned int col = 0; col < map->get_cols(); col++) {
-      int pos = map->pos(col, row);
-      int obj = map->get_obj(pos);
-      if (obj > Map::ObjectFlag && obj <= Map::ObjectCastle) {
-        Color color = interface->get_player_color(map->get_owner(pos));
-        if (advanced > 0) {
-          Building *bld = interface->get_game()->get_building_at_pos(pos);
-          if (bld->get_type() == building_remap[advanced]) {
-            draw_minimap_point(col, row, color, scale);
-          }
-        } else {
-          draw_minimap_point(col, row, color, scale);
+  Color color;
+  switch (ownership_mode) {
+    case OwnershipModeNone:
+      color = minimap[pos];
+      break;
+    case OwnershipModeMixed:
+      /* Every other position of every other row shows the owner. */
+      color = minimap[pos];
+      if ((map->pos_col(pos) & 1) == 0 && (map->pos_row(pos) & 1) == 0 &&
+          map->has_owner(pos)) {
+        color = interface->get_player_color(map->get_owner(pos));
+      }
+      break;
+    case OwnershipModeSolid:
+      color = Color::black;
+      if (map->has_owner(pos)) {
+        color = interface->get_player_color(map->get_owner(pos));
+      }
+      break;
+  }
+
+  if (draw_roads && map->paths(pos)) {
+    color = Color::black;
+  }
+
+  if (draw_buildings) {
+    int obj = map->get_obj(pos);
+    if (obj > Map::ObjectFlag && obj <= Map::ObjectCastle) {
+      if (advanced > 0) {
+        Building *bld = interface->get_game()->get_building_at_pos(pos);
+        if (bld->get_type() == building_remap[advanced]) {
+          color = interface->get_player_color(map->get_owner(pos));
         }
+      } else {
+        color = interface->get_player_color(map->get_owner(pos));
       }
     }
   }
+
+  return color;
 }
 
 void
@@ -234,6 +330,21 @@ MinimapGame::draw_minimap_traffic() {
       }
     }
   }
+
+  /* Roads where resources wait long for a transporter, from the traffic
+     the flags count as they go. */
+  const Color congested(0xdf, 0x2f, 0x1f);
+  for (Flag *flag : *interface->get_game()->get_flags()) {
+    for (Direction d : cycle_directions_cw()) {
+      if (!flag->has_path(d) || !flag->is_congested(d)) {
+        continue;
+      }
+      for (const Flag::PathTile &tile : flag->get_path_tiles(d)) {
+        draw_minimap_point(map->pos_col(tile.pos), map->pos_row(tile.pos),
+                           congested, scale);
+      }
+    }
+  }
 }
 
 void
@@ -263,7 +374,7 @@ Minimap::internal_draw() {
     return;
   }
 
-  draw_minimap_map();
+  draw_composed();
 
   if (draw_grid) {
     draw_minimap_grid();
@@ -307,8 +418,6 @@ Minimap::set_scale(int scale) {
   MapPos pos = get_current_map_pos();
   this->scale = scale;
   move_to_map_pos(pos);
-
-  set_redraw();
 }
 
 void
@@ -389,6 +498,7 @@ Minimap::move_to_map_pos(MapPos pos) {
   offset_x = mx;
   offset_y = my;
 
+  full_redraw = true;
   set_redraw();
 }
 
@@ -411,6 +521,7 @@ Minimap::move_by_pixels(int dx, int dy) {
   if (offset_x >= pwidth) offset_x -= pwidth;
   else if (offset_x < 0) offset_x += pwidth;
 
+  full_redraw = true;
   set_redraw();
 }
 
@@ -422,49 +533,43 @@ MinimapGame::MinimapGame(Interface *_interface, PGame _game)
   , draw_roads(false)
   , draw_buildings(true)
   , ownership_mode(OwnershipModeNone) {
+  /* The base class composed the terrain only. */
+  recompose();
 }
 
 void
 MinimapGame::set_ownership_mode(OwnershipMode _ownership_mode) {
   ownership_mode = _ownership_mode;
-  set_redraw();
+  recompose();
 }
 
 void
 MinimapGame::set_draw_roads(bool _draw_roads) {
   draw_roads = _draw_roads;
-  set_redraw();
+  recompose();
 }
 
 void
 MinimapGame::set_draw_buildings(bool _draw_buildings) {
   draw_buildings = _draw_buildings;
-  set_redraw();
+  recompose();
 }
 
 void
-MinimapGame::internal_draw() {
-  switch (ownership_mode) {
-    case OwnershipModeNone:
-      draw_minimap_map();
-      break;
-    case OwnershipModeMixed:
-      draw_minimap_map();
-      draw_minimap_ownership(2);
-      break;
-    case OwnershipModeSolid:
-      frame->fill_rect(0, 0, 128, 128, Color::black);
-      draw_minimap_ownership(1);
-      break;
-  }
+MinimapGame::set_advanced(int _advanced) {
+  advanced = _advanced;
+  recompose();
+}
 
-  if (draw_roads) {
-    draw_minimap_roads();
+void
+MinimapGame::internal_draw() {
+  /* Traffic isn't counted as a map change, so the points it was drawn
+     at last time can't be told apart. */
+  if (advanced > 0) {
+    full_redraw = true;
   }
 
-  if (draw_buildings) {
-    draw_minimap_buildings();
-  }
+  draw_composed();
 
   if (draw_grid) {
     draw_minimap_grid();
@@ -41,6 +41,20 @@ class Minimap : public GuiObject {
 
   std::vector<Color> minimap;
 
+  /* What is drawn at each map position, all layers composed. It is kept
+     with the Map change counts of each block it was composed from, and
+     only blocks whose count moved are composed again. Points that came
+     out different are all that is painted over the frame from the last
+     draw, unless the view or the layers changed since. */
+  std::vector<Color> composed;
+  std::vector<uint32_t> composed_changes;   /* By change block */
+  std::vector<MapPos> patched;
+  bool full_redraw;
+  Frame *drawn_frame;
+  /* A full redraw is filled in here and uploaded to the frame at once. */
+  std::vector<uint32_t> pixels;
+  bool draw_to_pixels;
+
  public:
   explicit Minimap(PMap map);
 
@@ -62,8 +76,15 @@ class Minimap : public GuiObject {
   static const int max_scale;
 
   void init_minimap();
+  Color terrain_color(MapPos pos) const;
+
+  virtual Color compose(MapPos pos) const { return minimap[pos]; }
+  void recompose();
+  void recompose_changed();
+  void draw_composed();
 
   void draw_minimap_point(int col, int row, const Color &color, int density);
+  void fill_pixels(int x, int y, int density, const Color &color);
   void draw_minimap_map();
   void draw_minimap_grid();
   void draw_minimap_rect();
@@ -98,18 +119,16 @@ class MinimapGame : public Minimap {
   MinimapGame(Interface *interface, PGame game);
 
   int get_advanced() const { return advanced; }
-  void set_advanced(int advanced) { this->advanced = advanced; }
   bool get_draw_roads() const { return draw_roads; }
   void set_draw_roads(bool draw_roads);
   bool get_draw_buildings() const { return draw_buildings; }
   void set_draw_buildings(bool draw_buildings);
   OwnershipMode get_ownership_mode() { return ownership_mode; }
   void set_ownership_mode(OwnershipMode _ownership_mode);
+  void set_advanced(int advanced);
 
  protected:
-  void draw_minimap_ownership(int density);
-  void draw_minimap_roads();
-  void draw_minimap_buildings();
+  virtual Color compose(MapPos pos) const;
   void draw_minimap_traffic();
 
   virtual void internal_draw();
@@ -508,10 +508,10 @@ GameInfo::get_character_count() {
 }
 
 PGame
-GameInfo::instantiate() {
+GameInfo::instantiate(const std::vector<Map::LandscapeTile> *landscape) {
   PGame game = std::make_shared<Game>();
 
-  if (!game->init(map_size, random_base)) {
+  if (!game->init(map_size, random_base, landscape)) {
     return nullptr;
   }
 
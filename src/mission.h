@@ -135,7 +135,8 @@ class GameInfo {
   static const Character *get_character(size_t character);
   static size_t get_character_count();
 
-  PGame instantiate();
+  PGame instantiate(
+    const std::vector<Map::LandscapeTile> *landscape = nullptr);
 };
 
 #endif  // SRC_MISSION_H_
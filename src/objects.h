@@ -26,20 +26,26 @@
 #include <algorithm>
 #include <list>
 #include <memory>
+#include <new>
 #include <limits>
 #include <utility>
 
 class Game;
 
+template<class T, size_t growth> class Collection;
+
 class GameObject {
  protected:
   unsigned int index;
   Game *game;
 
+  // Only Collection::fork() copies objects, and gives the copy its game.
+  GameObject(const GameObject& that) = default;
+  template<class T, size_t growth> friend class Collection;
+
  public:
   GameObject() = delete;
   GameObject(Game *game, unsigned int index) : index(index), game(game) {}
-  GameObject(const GameObject& that) = delete;  // Copying prohibited
   GameObject(GameObject&& that) = delete;  // Moving prohibited
   virtual ~GameObject() {}
 
@@ -50,33 +56,101 @@ class GameObject {
   unsigned int get_index() const { return index; }
 };
 
+// Objects are constructed in place in slabs of `growth` slots, so their
+// addresses and indexes stay stable and neighbouring indexes are close in
+// memory. Unused slots are kept on a free list that is threaded through the
+// slots themselves and handed out oldest first. Copies share the slabs and
+// are only meant as snapshots for iteration.
 template<class T, size_t growth>
 class Collection {
  protected:
   typedef std::vector<T*> Objects;
-  typedef std::list<unsigned int> FObjects;
+
+  typedef union Slot {
+    struct {
+      unsigned int prev;
+      unsigned int next;
+    } free;
+    alignas(T) unsigned char object[sizeof(T)];
+  } Slot;
+
+  typedef std::vector<std::unique_ptr<Slot[]>> Slabs;
+
+  static const unsigned int no_index = std::numeric_limits<unsigned int>::max();
 
   Objects objects;
-  unsigned int last_object_index;
-  FObjects free_object_indexes;
+  std::shared_ptr<Slabs> slabs;
+  unsigned int free_head;
+  unsigned int free_tail;
+  size_t free_count;
   Game *game;
 
- public:
-  Collection() {
-    game = NULL;
-    last_object_index = 0;
+  Slot &
+  slot(unsigned int index) {
+    while (slabs->size() <= index / growth) {
+      slabs->emplace_back(new Slot[growth]);
+    }
+    return (*slabs)[index / growth][index % growth];
   }
 
-  Collection(const Collection& other) {
-    objects = other.objects;
-    last_object_index = other.last_object_index;
-    free_object_indexes = other.free_object_indexes;
-    game = other.game;
+  T *
+  construct(unsigned int index) {
+    T *object = new(slot(index).object) T(game, index);
+    objects[index] = object;
+    return object;
   }
 
-  explicit Collection(Game *_game) {
+  void
+  push_free(unsigned int index) {
+    Slot &s = slot(index);
+    s.free.prev = free_tail;
+    s.free.next = no_index;
+    if (free_tail != no_index) {
+      slot(free_tail).free.next = index;
+    } else {
+      free_head = index;
+    }
+    free_tail = index;
+    free_count++;
+  }
+
+  void
+  unlink_free(unsigned int index) {
+    Slot &s = slot(index);
+    if (s.free.prev != no_index) {
+      slot(s.free.prev).free.next = s.free.next;
+    } else {
+      free_head = s.free.next;
+    }
+    if (s.free.next != no_index) {
+      slot(s.free.next).free.prev = s.free.prev;
+    } else {
+      free_tail = s.free.prev;
+    }
+    free_count--;
+  }
+
+  void
+  reserve_for(size_t count) {
+    if (count > objects.capacity()) {
+      objects.reserve(objects.capacity() + growth);
+    }
+  }
+
+ public:
+  Collection()
+    : slabs(std::make_shared<Slabs>())
+    , free_head(no_index)
+    , free_tail(no_index)
+    , free_count(0)
+    , game(NULL) {
+  }
+
+  Collection(const Collection& other) = default;
+  Collection& operator = (const Collection& other) = default;
+
+  explicit Collection(Game *_game) : Collection() {
     game = _game;
-    last_object_index = 0;
   }
 
   virtual ~Collection() {
@@ -85,32 +159,55 @@ class Collection {
   void clear() {
     for (T *&obj : objects) {
       if (obj != nullptr) {
-        delete obj;
+        obj->~T();
       }
     }
     objects.clear();
+    free_head = no_index;
+    free_tail = no_index;
+    free_count = 0;
+  }
+
+  // Make this, the collection of a newly made game, a deep copy of that.
+  // Each object is copied into the slot of the same index, and the free
+  // slots are handed out in the same order as those of that. Pointers the
+  // copies hold to other objects still point into the game of that, the
+  // caller has to move them over.
+  void
+  fork(const Collection &that) {
+    clear();
+    objects.reserve(that.objects.capacity());
+    objects.assign(that.objects.size(), nullptr);
+    for (unsigned int i = 0; i < that.objects.size(); i++) {
+      const Slot &from = (*that.slabs)[i / growth][i % growth];
+      Slot &to = slot(i);
+      if (that.objects[i] == nullptr) {
+        to.free = from.free;
+        continue;
+      }
+      T *object = new(to.object) T(*that.objects[i]);
+      object->game = game;
+      objects[i] = object;
+    }
+    free_head = that.free_head;
+    free_tail = that.free_tail;
+    free_count = that.free_count;
   }
 
   T*
   allocate() {
     unsigned int new_index = 0;
-    T *new_object = nullptr;
 
-    if (!free_object_indexes.empty()) {
-      new_index = free_object_indexes.front();
-      free_object_indexes.pop_front();
-      new_object = new T(game, new_index);
-      objects[new_index] = new_object;
+    if (free_head != no_index) {
+      new_index = free_head;
+      unlink_free(new_index);
     } else {
       new_index = static_cast<unsigned int>(objects.size());
-      if (objects.size() == objects.capacity()) {
-        objects.reserve(objects.capacity() + growth);
-      }
-      new_object = new T(game, new_index);
-      objects.push_back(new_object);
+      reserve_for(objects.size() + 1);
+      objects.push_back(nullptr);
     }
 
-    return new_object;
+    return construct(new_index);
   }
 
   bool
@@ -123,29 +220,22 @@ class Collection {
 
   T*
   get_or_insert(unsigned int index) {
-    T *object = nullptr;
     if (index < objects.size()) {
-      object = objects[index];
+      T *object = objects[index];
       if (object == nullptr) {
-        FObjects::iterator i = std::find(free_object_indexes.begin(),
-                                         free_object_indexes.end(), index);
-        free_object_indexes.erase(i);
-        object = new T(game, index);
-        objects[index] = object;
-      }
-    } else {
-      if (objects.size() == objects.capacity()) {
-        objects.reserve(objects.capacity() + growth);
+        unlink_free(index);
+        object = construct(index);
       }
-      for (size_t i = objects.size(); i < index; ++i) {
-        free_object_indexes.push_back(static_cast<unsigned int>(i));
-        objects.push_back(nullptr);
-      }
-      object = new T(game, index);
-      objects.push_back(object);
+      return object;
     }
 
-    return object;
+    reserve_for(index + 1);
+    for (size_t i = objects.size(); i < index; ++i) {
+      objects.push_back(nullptr);
+      push_free(static_cast<unsigned int>(i));
+    }
+    objects.push_back(nullptr);
+    return construct(index);
   }
 
   T* operator[] (unsigned int index) {
@@ -244,20 +334,159 @@ class Collection {
 
   void
   erase(unsigned int index) {
-    if ((index <= objects.size()) && (objects[index] != nullptr)) {
+    if ((index < objects.size()) && (objects[index] != nullptr)) {
       T *object = objects[index];
       if (index + 1 == objects.size()) {
         objects.pop_back();
       } else {
-        free_object_indexes.push_back(index);
         objects[index] = nullptr;
       }
-      delete object;
+      object->~T();
+      if (index < objects.size()) {
+        push_free(index);
+      }
     }
   }
 
   size_t
-  size() const { return objects.size() - free_object_indexes.size(); }
+  size() const { return objects.size() - free_count; }
+
+  // One more than the highest index in use.
+  unsigned int get_index_limit() const {
+    return static_cast<unsigned int>(objects.size()); }
+
+  // The table of pointers and the slabs, live objects or not.
+  size_t get_allocated_bytes() const {
+    return objects.capacity() * sizeof(T*) +
+           slabs->size() * growth * sizeof(Slot); }
+};
+
+// The indices of the objects of a collection each player owns, in order, so
+// that the objects of one player are listed without going through all of
+// them. Owners are told with set_owner() and objects that go with remove().
+// A Range lists them in place, without a copy. Its iterator goes on from the
+// last index it gave, so objects may come and go while it is used, as long
+// as that is on the same thread.
+template<class T, size_t growth>
+class OwnedObjects {
+ public:
+  typedef std::vector<unsigned int> Indices;
+
+  class Iterator {
+   protected:
+    Collection<T, growth> *objects;
+    const Indices *indices;
+    size_t pos;
+    unsigned int current;
+
+    void fetch() {
+      current = (pos < indices->size()) ? (*indices)[pos] : no_index;
+    }
+
+   public:
+    Iterator(Collection<T, growth> *objects, const Indices *indices,
+             size_t pos)
+      : objects(objects), indices(indices), pos(pos) { fetch(); }
+
+    Iterator& operator++() {
+      if (pos < indices->size() && (*indices)[pos] == current) {
+        pos++;
+      } else {
+        pos = std::upper_bound(indices->begin(), indices->end(), current) -
+              indices->begin();
+      }
+      fetch();
+      return *this;
+    }
+    bool operator==(const Iterator& rhs) const {
+      return current == rhs.current; }
+    bool operator!=(const Iterator& rhs) const {
+      return current != rhs.current; }
+    T *operator*() const { return (*objects)[current]; }
+  };
+
+  class Range {
+   protected:
+    Collection<T, growth> *objects;
+    const Indices *indices;
+
+   public:
+    Range(Collection<T, growth> *objects, const Indices *indices)
+      : objects(objects), indices(indices) {}
+
+    Iterator begin() const { return Iterator(objects, indices, 0); }
+    Iterator end() const {
+      return Iterator(objects, indices, indices->size()); }
+    bool empty() const { return indices->empty(); }
+    size_t size() const { return indices->size(); }
+  };
+
+ protected:
+  static const unsigned int no_index = std::numeric_limits<unsigned int>::max();
+
+  Collection<T, growth> *objects;
+  std::vector<Indices> owned;
+  Indices none;
+
+ public:
+  OwnedObjects(Collection<T, growth> *objects, unsigned int owners)
+    : objects(objects), owned(owners) {}
+
+  void clear() {
+    for (Indices &indices : owned) {
+      indices.clear();
+    }
+  }
+
+  // Move the object from the list of old_owner to that of new_owner, or
+  //  into it, the first time. Owners past the players are left out.
+  void set_owner(unsigned int index, unsigned int old_owner,
+                 unsigned int new_owner) {
+    remove(index, old_owner);
+    add(index, new_owner);
+  }
+
+  void add(unsigned int index, unsigned int owner) {
+    if (owner >= owned.size()) {
+      return;
+    }
+    Indices &indices = owned[owner];
+    auto it = std::lower_bound(indices.begin(), indices.end(), index);
+    if (it == indices.end() || *it != index) {
+      indices.insert(it, index);
+    }
+  }
+
+  void remove(unsigned int index, unsigned int owner) {
+    if (owner >= owned.size()) {
+      return;
+    }
+    Indices &indices = owned[owner];
+    auto it = std::lower_bound(indices.begin(), indices.end(), index);
+    if (it != indices.end() && *it == index) {
+      indices.erase(it);
+    }
+  }
+
+  Range get(unsigned int owner) {
+    return Range(objects, (owner < owned.size()) ? &owned[owner] : &none); }
+
+  // Of all owners together.
+  size_t get_count() const {
+    size_t count = 0;
+    for (const Indices &indices : owned) {
+      count += indices.size();
+    }
+    return count;
+  }
+
+  size_t get_allocated_bytes() const {
+    size_t bytes = owned.capacity() * sizeof(Indices);
+    for (const Indices &indices : owned) {
+      bytes += indices.capacity() * sizeof(unsigned int);
+    }
+    return bytes;
+  }
 };
 
 #endif  // SRC_OBJECTS_H_
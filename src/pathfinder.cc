@@ -21,7 +21,6 @@
 
 #include "src/pathfinder.h"
 
-#include <list>
 #include <vector>
 #include <algorithm>
 #include <memory>
@@ -87,113 +86,186 @@ actual_cost(Map *map, MapPos pos, Direction dir) {
 }
 */
 
-/* Find the shortest path from start to end (using A*) considering that
-   the walking time for a serf walking in any direction of the path
-   should be minimized. Returns a malloc'ed array of directions and
-   the size of this array in length. */
-Road
-pathfinder_map(Map *map, MapPos start, MapPos end, const Road *building_road) {
-  // Unfortunately the STL priority_queue cannot be used since we
-  // would need access to the underlying sequence to determine if
-  // a node is already in the open list. We keep instead open as
-  // a vector and apply std::pop_heap and std::push_heap to keep
-  // it heapified.
-  std::vector<PSearchNode> open;
-  std::list<PSearchNode> closed;
-
-  /* Create start node */
-  PSearchNode node(new SearchNode);
-  node->pos = end;
-  node->g_score = 0;
-  node->f_score = heuristic_cost(map, start, end);
-
-  open.push_back(node);
-
-  while (!open.empty()) {
-    std::pop_heap(open.begin(), open.end(), search_node_less);
-    node = open.back();
-    open.pop_back();
-
-    if (node->pos == start) {
-      /* Construct solution */
-      Road solution;
-      solution.start(start);
-
-      while (node->parent) {
-        Direction dir = node->dir;
-        solution.extend(reverse_direction(dir));
-        node = node->parent;
-      }
+SearchArena &
+SearchArena::get_for(const Map *map) {
+  thread_local SearchArena arena;
+  arena.resize(map->geom().tile_count());
+  return arena;
+}
 
-      return solution;
+void
+SearchArena::resize(size_t tile_count) {
+  if (nodes.size() == tile_count) {
+    return;
+  }
+  nodes.assign(tile_count, Node{0, 0, bad_map_pos, DirectionNone,
+                                not_in_heap, 0, 0});
+  heap.clear();
+  heap.reserve(tile_count);
+  generation = 0;
+}
+
+void
+SearchArena::begin() {
+  heap.clear();
+  generation += 1;
+  if (generation == 0) {
+    // Stamps wrapped around, old stamps could look current again.
+    for (Node &n : nodes) {
+      n.open_gen = 0;
+      n.closed_gen = 0;
     }
+    generation = 1;
+  }
+}
 
-    /* Put current node on closed list. */
-    closed.push_front(node);
+bool
+SearchArena::open(MapPos pos, unsigned int g_score, unsigned int f_score,
+                  MapPos parent, Direction dir) {
+  Node &n = nodes[pos];
+  if (n.open_gen == generation) {
+    if (n.heap_index == not_in_heap || n.g_score < g_score) {
+      return false;
+    }
+  } else {
+    n.open_gen = generation;
+    n.heap_index = static_cast<unsigned int>(heap.size());
+    heap.push_back(pos);
+  }
 
-    for (Direction d : cycle_directions_cw()) {
-      MapPos new_pos = map->move(node->pos, d);
-      unsigned int cost = actual_cost(map, node->pos, d);
+  n.g_score = g_score;
+  n.f_score = f_score;
+  n.parent = parent;
+  n.dir = dir;
+  sift_up(n.heap_index);
+  return true;
+}
 
-      /* Check if neighbour is valid. */
-      if (!map->is_road_segment_valid(node->pos, d) ||
-          (map->get_obj(new_pos) == Map::ObjectFlag && new_pos != start)) {
-        continue;
-      }
+MapPos
+SearchArena::pop() {
+  MapPos top = heap.front();
+  MapPos last = heap.back();
+  heap.pop_back();
+  nodes[top].heap_index = not_in_heap;
+  if (!heap.empty()) {
+    place(0, last);
+    sift_down(0);
+  }
+  return top;
+}
 
-      if ((building_road != nullptr) && building_road->has_pos(map, new_pos) &&
-          (new_pos != end) && (new_pos != start)) {
-        continue;
-      }
+void
+SearchArena::sift_up(unsigned int index) {
+  MapPos pos = heap[index];
+  unsigned int f_score = nodes[pos].f_score;
+  while (index > 0) {
+    unsigned int parent = (index - 1) / 4;
+    if (nodes[heap[parent]].f_score <= f_score) {
+      break;
+    }
+    place(index, heap[parent]);
+    index = parent;
+  }
+  place(index, pos);
+}
 
-      /* Check if neighbour is in closed list. */
-      bool in_closed = false;
-      for (PSearchNode closed_node : closed) {
-        if (closed_node->pos == new_pos) {
-          in_closed = true;
-          break;
-        }
+void
+SearchArena::sift_down(unsigned int index) {
+  MapPos pos = heap[index];
+  unsigned int f_score = nodes[pos].f_score;
+  unsigned int count = static_cast<unsigned int>(heap.size());
+  while (true) {
+    unsigned int first = index * 4 + 1;
+    if (first >= count) {
+      break;
+    }
+    unsigned int best = first;
+    unsigned int last = std::min(first + 4, count);
+    for (unsigned int child = first + 1; child < last; child++) {
+      if (nodes[heap[child]].f_score < nodes[heap[best]].f_score) {
+        best = child;
       }
+    }
+    if (nodes[heap[best]].f_score >= f_score) {
+      break;
+    }
+    place(index, heap[best]);
+    index = best;
+  }
+  place(index, pos);
+}
 
-      if (in_closed) continue;
-
-      /* See if neighbour is already in open list. */
-      bool in_open = false;
-      for (std::vector<PSearchNode>::iterator it = open.begin();
-           it != open.end(); ++it) {
-        PSearchNode n = *it;
-        if (n->pos == new_pos) {
-          in_open = true;
-          if (n->g_score >= node->g_score + cost) {
-            n->g_score = node->g_score + cost;
-            n->f_score = n->g_score + heuristic_cost(map, new_pos, start);
-            n->parent = node;
-            n->dir = d;
-
-            // Move element to the back and heapify
-            iter_swap(it, open.rbegin());
-            std::make_heap(open.begin(), open.end(), search_node_less);
-          }
-          break;
-        }
-      }
+Road
+SearchArena::road_to(MapPos pos) const {
+  std::vector<Direction> dirs;
+  while (nodes[pos].parent != bad_map_pos) {
+    dirs.push_back(nodes[pos].dir);
+    pos = nodes[pos].parent;
+  }
 
-      /* If not found in the open set, create a new node. */
-      if (!in_open) {
-        PSearchNode new_node(new SearchNode);
+  Road road;
+  road.start(pos);
+  for (auto it = dirs.rbegin(); it != dirs.rend(); ++it) {
+    road.extend(*it);
+  }
+  return road;
+}
 
-        new_node->pos = new_pos;
-        new_node->g_score = node->g_score + cost;
-        new_node->f_score = new_node->g_score +
-                            heuristic_cost(map, new_pos, start);
-        new_node->parent = node;
-        new_node->dir = d;
+Road
+SearchArena::road_from(MapPos pos) const {
+  Road road;
+  road.start(pos);
+  while (nodes[pos].parent != bad_map_pos) {
+    road.extend(reverse_direction(nodes[pos].dir));
+    pos = nodes[pos].parent;
+  }
+  return road;
+}
 
-        open.push_back(new_node);
-        std::push_heap(open.begin(), open.end(), search_node_less);
-      }
+// Walking rules for roads planned by the player.
+class MapRoadPolicy {
+ protected:
+  Map *map;
+  MapPos start;
+  MapPos end;
+  const Road *building_road;
+
+ public:
+  MapRoadPolicy(Map *map, MapPos start, MapPos end, const Road *building_road)
+    : map(map), start(start), end(end), building_road(building_road) {}
+
+  DirectionCycle<Cycle::CW> directions() { return cycle_directions_cw(); }
+
+  bool passable(MapPos pos, Direction dir, MapPos new_pos) {
+    if (!map->is_road_segment_valid(pos, dir) ||
+        (map->get_obj(new_pos) == Map::ObjectFlag && new_pos != start)) {
+      return false;
+    }
+    if ((building_road != nullptr) && building_road->has_pos(map, new_pos) &&
+        (new_pos != end) && (new_pos != start)) {
+      return false;
     }
+    return true;
+  }
+
+  unsigned int cost(MapPos pos, Direction dir) {
+    return actual_cost(map, pos, dir);
+  }
+
+  unsigned int heuristic(MapPos pos) {
+    return heuristic_cost(map, pos, start);
   }
+};
 
-  return Road();
+/* Find the shortest path from start to end (using A*) considering that
+   the walking time for a serf walking in any direction of the path
+   should be minimized. The search runs from end towards start. */
+Road
+pathfinder_map(Map *map, MapPos start, MapPos end, const Road *building_road) {
+  SearchArena &arena = SearchArena::get_for(map);
+  MapRoadPolicy policy(map, start, end, building_road);
+  if (!search_map_tiles(map, &arena, end, start, &policy)) {
+    return Road();
+  }
+  return arena.road_from(start);
 }
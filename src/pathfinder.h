@@ -24,6 +24,8 @@
 
 #include <memory>       // to satisfy cpplint
 #include <algorithm>       // to satisfy cpplint
+#include <vector>
+#include <cstdint>
 
 #include "src/map.h"
 
@@ -47,17 +49,9 @@ class SearchNode {
   }
 };
 
-static bool
-search_node_less(const PSearchNode &left, const PSearchNode &right) {
-  // A search node is considered less than the other if
-  // it has a larger f-score. This means that in the max-heap
-  // the lower score will go to the top.
-  return left->f_score > right->f_score;
-}
-
 static const unsigned int walk_cost[] = { 255, 319, 383, 447, 511 };
 
-static unsigned int
+inline unsigned int
 heuristic_cost(Map *map, MapPos start, MapPos end) {
   // Calculate distance to target.
   int dist_col = map->dist_x(start, end);
@@ -77,7 +71,7 @@ heuristic_cost(Map *map, MapPos start, MapPos end) {
   return dist > 0 ? dist*walk_cost[h_diff/dist] : 0;
 }
 
-static unsigned int
+inline unsigned int
 actual_cost(Map *map, MapPos pos, Direction dir) {
   MapPos other_pos = map->move(pos, dir);
   int h_diff = abs(static_cast<int>(map->get_height(pos)) -
@@ -85,6 +79,116 @@ actual_cost(Map *map, MapPos pos, Direction dir) {
   return walk_cost[h_diff];
 }
 
+// Scratch state for A* searches over map tiles. Search nodes live in an
+// array indexed by MapPos and are validated with generation stamps, so a
+// new search starts in O(1) without clearing anything. The open set is an
+// indexed 4-ary min-heap on f-score that supports decrease-key. Each thread
+// keeps one arena which is only reallocated when the map size changes.
+class SearchArena {
+ public:
+  typedef struct Node {
+    unsigned int g_score;
+    unsigned int f_score;
+    MapPos parent;
+    Direction dir;
+    unsigned int heap_index;
+    uint32_t open_gen;
+    uint32_t closed_gen;
+  } Node;
+
+ protected:
+  static const unsigned int not_in_heap = static_cast<unsigned int>(-1);
+
+  std::vector<Node> nodes;
+  std::vector<MapPos> heap;
+  uint32_t generation;
+
+ public:
+  SearchArena() : generation(0) {}
+
+  // Arena of the calling thread, sized for map.
+  static SearchArena &get_for(const Map *map);
+
+  void resize(size_t tile_count);
+  size_t get_allocated_bytes() const {
+    return MemoryUsage::vector_bytes(nodes) + MemoryUsage::vector_bytes(heap); }
+  // Forget all nodes of the previous search.
+  void begin();
+
+  Node &node(MapPos pos) { return nodes[pos]; }
+  bool is_open(MapPos pos) const {
+    return (nodes[pos].open_gen == generation &&
+            nodes[pos].heap_index != not_in_heap); }
+  bool is_visited(MapPos pos) const {
+    return (nodes[pos].open_gen == generation); }
+  bool is_closed(MapPos pos) const {
+    return (nodes[pos].closed_gen == generation); }
+  void close(MapPos pos) { nodes[pos].closed_gen = generation; }
+
+  // Add pos to the open set, or lower its scores if it is already in it
+  // and the new g-score is not worse. Returns false if nothing changed.
+  bool open(MapPos pos, unsigned int g_score, unsigned int f_score,
+            MapPos parent, Direction dir);
+
+  bool empty() const { return heap.empty(); }
+  // Remove and return the open node with the lowest f-score.
+  MapPos pop();
+
+  // Road from the origin of the search to pos, following parents.
+  Road road_to(MapPos pos) const;
+  // Road from pos back to the origin of the search.
+  Road road_from(MapPos pos) const;
+
+ protected:
+  void sift_up(unsigned int index);
+  void sift_down(unsigned int index);
+  void place(unsigned int index, MapPos pos) {
+    heap[index] = pos;
+    nodes[pos].heap_index = index;
+  }
+};
+
+// A* search over map tiles from origin until goal is taken from the open
+// set. The policy decides where the search may go and what it costs:
+//
+//   DirectionCycle<Cycle::CW> directions();
+//   bool passable(MapPos pos, Direction dir, MapPos new_pos);
+//   unsigned int cost(MapPos pos, Direction dir);
+//   unsigned int heuristic(MapPos pos);
+//
+// Returns true if goal was reached, the path is then in the arena.
+template<class Policy>
+bool
+search_map_tiles(Map *map, SearchArena *arena, MapPos origin, MapPos goal,
+                 Policy *policy) {
+  arena->begin();
+  arena->open(origin, 0, policy->heuristic(origin), bad_map_pos,
+              DirectionNone);
+
+  while (!arena->empty()) {
+    MapPos pos = arena->pop();
+    if (pos == goal) {
+      return true;
+    }
+
+    arena->close(pos);
+    unsigned int g_score = arena->node(pos).g_score;
+
+    for (Direction d : policy->directions()) {
+      MapPos new_pos = map->move(pos, d);
+      if (!policy->passable(pos, d, new_pos) || arena->is_closed(new_pos)) {
+        continue;
+      }
+
+      unsigned int new_g_score = g_score + policy->cost(pos, d);
+      arena->open(new_pos, new_g_score,
+                  new_g_score + policy->heuristic(new_pos), pos, d);
+    }
+  }
+
+  return false;
+}
+
 Road pathfinder_map(Map *map, MapPos start, MapPos end,
                     const Road *building_road = nullptr);
 
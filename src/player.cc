@@ -22,6 +22,8 @@
 #include "src/player.h"
 
 #include <algorithm>
+#include <utility>
+#include <vector>
 #include <thread>        //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.  // for AI threads
 
 #include "src/game.h"
@@ -158,6 +160,7 @@ Player::Player(Game* game, unsigned int index)
   for (int i = 0; i < 27; i++) {
     serf_count[i] = 0;
   }
+  clear_idle_serf_counts();
 
   /* TODO AI: Set array field_402 of length 25 to -1. */
   /* TODO AI: Set array field_434 of length 280*2 to 0 */
@@ -402,7 +405,7 @@ int
 Player::promote_serfs_to_knights(int number) {
   int promoted = 0;
 
-  for (Serf *serf : game->get_player_serfs(this)) {
+  for (Serf *serf : game->get_owned_serfs(this)) {
     if (serf->get_state() == Serf::StateIdleInStock &&
         serf->get_type() == Serf::TypeGeneric) {
       Inventory *inv = game->get_inventory(serf->get_idle_in_stock_inv_index());
@@ -464,6 +467,74 @@ Player::available_knights_at_pos(MapPos pos, int index_, int dist) {
   return index_ + 1;
 }
 
+// The place of each offset from the target in the walk of 32 shells that
+//  knights_available_for_attack_by_scan() takes, or -1 for the target and
+//  offsets beyond.
+static const int attack_spiral_size = 32;
+static const int attack_spiral_side = 2 * attack_spiral_size + 1;
+
+static const std::vector<int> &
+get_attack_spiral() {
+  static const std::vector<int> spiral = []() {
+    std::vector<int> steps(attack_spiral_side * attack_spiral_side, -1);
+    const int moves[6][2] = { { 0, 1 }, { -1, 0 }, { -1, -1 },
+                              { 0, -1 }, { 1, 0 }, { 1, 1 } };
+    int x = 0;
+    int y = 0;
+    int step = 0;
+    for (int i = 0; i < attack_spiral_size; i++) {
+      x += 1;
+      for (int d = 0; d < 6; d++) {
+        for (int j = 0; j < i+1; j++) {
+          steps[(y + attack_spiral_size) * attack_spiral_side +
+                x + attack_spiral_size] = step++;
+          x += moves[d][0];
+          y += moves[d][1];
+        }
+      }
+    }
+    return steps;
+  }();
+  return spiral;
+}
+
+/* The shell of a step in the walk, shells i*(i+1)*3 steps in. */
+static int
+attack_spiral_shell(int step) {
+  int shell = 0;
+  while (3 * (shell + 1) * (shell + 2) <= step) {
+    shell++;
+  }
+  return shell;
+}
+
+/* The first step of the walk that lands on the offset, with the map
+   wrapping around, or -1 if it never does. */
+static int
+attack_spiral_step(int dx, int dy, int cols, int rows) {
+  const std::vector<int> &spiral = get_attack_spiral();
+  int first = -1;
+  for (int y = dy - rows * (attack_spiral_size / rows + 1);
+       y <= attack_spiral_size; y += rows) {
+    if (y < -attack_spiral_size) continue;
+    for (int x = dx - cols * (attack_spiral_size / cols + 1);
+         x <= attack_spiral_size; x += cols) {
+      if (x < -attack_spiral_size) continue;
+      int step = spiral[(y + attack_spiral_size) * attack_spiral_side +
+                        x + attack_spiral_size];
+      if (step >= 0 && (first < 0 || step < first)) {
+        first = step;
+      }
+    }
+  }
+  return first;
+}
+
+/* Count the knights that can be sent to attack pos, from the military
+   buildings within 32 shells of it. Only the lists of buildings of the
+   players are looked at, in the order the walk of the shells would come
+   across them, so the same buildings are picked as by
+   knights_available_for_attack_by_scan(). */
 int
 Player::knights_available_for_attack(MapPos pos) {
   /* Reset counters. */
@@ -471,6 +542,50 @@ Player::knights_available_for_attack(MapPos pos) {
     attacking_knights[i] = 0;
   }
 
+  PMap map = game->get_map();
+  int cols = map->get_cols();
+  int rows = map->get_rows();
+
+  std::vector<std::pair<int, MapPos>> found;
+  for (unsigned int p = 0; p < GAME_MAX_PLAYER_COUNT; p++) {
+    Player *owner = game->get_player(p);
+    if (owner == nullptr) continue;
+    for (Building *building : game->get_owned_buildings(owner)) {
+      if (!building->is_military()) continue;
+      MapPos building_pos = building->get_position();
+      int step = attack_spiral_step(map->dist_x(building_pos, pos),
+                                    map->dist_y(building_pos, pos),
+                                    cols, rows);
+      if (step >= 0) {
+        found.push_back(std::make_pair(step, building_pos));
+      }
+    }
+  }
+  std::sort(found.begin(), found.end());
+
+  int count = 0;
+  for (const std::pair<int, MapPos> &step : found) {
+    count = available_knights_at_pos(step.second, count,
+                                     attack_spiral_shell(step.first) >> 3);
+  }
+
+  attacking_building_count = count;
+
+  total_attacking_knights = 0;
+  for (int i = 0; i < 4; i++) {
+    total_attacking_knights += attacking_knights[i];
+  }
+
+  return total_attacking_knights;
+}
+
+int
+Player::knights_available_for_attack_by_scan(MapPos pos) {
+  /* Reset counters. */
+  for (int i = 0; i < 4; i++) {
+    attacking_knights[i] = 0;
+  }
+
   int count = 0;
   PMap map = game->get_map();
 
@@ -705,8 +820,8 @@ Player::spawn_serf(Serf **serf, Inventory **inventory, bool want_knight) {
     return false;
   }
 
-  Game::ListInventories inventories = game->get_player_inventories(this);
-  if (inventories.size() < 1) {
+  Game::PlayerInventories inventories = game->get_owned_inventories(this);
+  if (inventories.empty()) {
     return false;
   }
 
@@ -895,15 +1010,20 @@ Player::update() {
   if (has_castle()) {
     reproduction_counter -= delta;
 
+    // serfs.allocate() writes the serf table the AI threads read under the
+    //  shared lock, so the serfs born this tick are made under the mutex
+    bool spawning = (reproduction_counter < 0);
+    if (spawning) {
+      Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex for Player::update before spawn_serf";
+      game->get_mutex()->lock(LOCK_SITE());
+      Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has locked mutex for Player::update before spawn_serf";
+    }
     while (reproduction_counter < 0) {
       serf_to_knight_counter += serf_to_knight_rate;
       if (serf_to_knight_counter < serf_to_knight_rate) {
         knights_to_spawn += 1;
         if (knights_to_spawn > 2) knights_to_spawn = 2;
       }
-    Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is locking mutex for Player::update before spawn_serf";
-    game->get_mutex()->lock();
-    Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has locked mutex for Player::update before spawn_serf";
       if (knights_to_spawn == 0) {
         // Create unassigned serf
         spawn_serf(nullptr, nullptr, false);
@@ -919,12 +1039,14 @@ Player::update() {
           }
         }
       }
-    Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is unlocking mutex for Player::update before spawn_serf";
-    game->get_mutex()->unlock();
-    Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has unlocked mutex for Player::update before spawn_serf";
 
       reproduction_counter += static_cast<int>(reproduction_reset);
     }
+    if (spawning) {
+      Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " is unlocking mutex for Player::update after spawn_serf";
+      game->get_mutex()->unlock();
+      Log::Verbose["game"] << "thread #" << std::this_thread::get_id() << " has unlocked mutex for Player::update after spawn_serf";
+    }
   }
 
   /* Update timers */
@@ -949,22 +1071,10 @@ Player::update_stats(int res) {
 }
 
 void
-Player::update_knight_morale() {
-  unsigned int inventory_gold = 0;
-  unsigned int military_gold = 0;
-
-  /* Sum gold collected in inventories */
-  for (Inventory *inventory : game->get_player_inventories(this)) {
-    inventory_gold += inventory->get_count_of(Resource::TypeGoldBar);
-  }
-
-  /* Sum gold deposited in military buildings */
-  for (Building *building : game->get_player_buildings(this)) {
-    military_gold += building->military_gold_count();
-  }
-
-  unsigned int depot = inventory_gold + military_gold;
-  gold_deposited = inventory_gold + military_gold;
+Player::update_knight_morale(unsigned int depot) {
+  /* Gold collected in inventories and deposited in military buildings,
+     summed by Game::update_knight_morale(). */
+  gold_deposited = depot;
 
   /* Calculate according to gold collected. */
   unsigned int total_gold = game->get_gold_total();
@@ -1032,7 +1142,7 @@ Player::get_stats_resources() {
   ResourceMap resources;
 
   /* Sum up resources of all inventories. */
-  for (Inventory *inventory : game->get_player_inventories(this)) {
+  for (Inventory *inventory : game->get_owned_inventories(this)) {
     for (int j = 0; j < 26; j++) {
       resources[(Resource::Type)j] +=
                                      inventory->get_count_of((Resource::Type)j);
@@ -1042,29 +1152,33 @@ Player::get_stats_resources() {
   return resources;
 }
 
-Serf::SerfMap
-Player::get_stats_serfs_idle() {
-  Serf::SerfMap res;
+Serf::SerfCounts
+Player::get_stats_serfs_idle() const {
+  Serf::SerfCounts res;
 
-  /* Sum up all existing serfs. */
-  for (Serf *serf : game->get_player_serfs(this)) {
-    if (serf->get_state() == Serf::StateIdleInStock) {
-      res[serf->get_type()] += 1;
-    }
+  for (int i = 0; i <= Serf::TypeDead; i++) {
+    res[i] = idle_serf_count[i].load(std::memory_order_relaxed);
   }
 
   return res;
 }
 
-Serf::SerfMap
+void
+Player::clear_idle_serf_counts() {
+  for (std::atomic<unsigned int> &count : idle_serf_count) {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+Serf::SerfCounts
 Player::get_stats_serfs_potential() {
-  Serf::SerfMap res;
+  Serf::SerfCounts res = {};
 
   /* Sum up potential serfs of all inventories. */
-  for (Inventory *inventory : game->get_player_inventories(this)) {
+  for (Inventory *inventory : game->get_owned_inventories(this)) {
     if (inventory->free_serf_count() > 0) {
       for (int i = 0; i < 27; i++) {
-        res[(Serf::Type)i] += inventory->serf_potential_count((Serf::Type)i);
+        res[i] += inventory->serf_potential_count((Serf::Type)i);
       }
     }
   }
@@ -22,6 +22,7 @@
 #ifndef SRC_PLAYER_H_
 #define SRC_PLAYER_H_
 
+#include <atomic>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 #include <queue>
 #include <vector>
 
@@ -91,6 +92,16 @@ class Player : public GameObject {
   int resource_count[26];
   int flag_prio[26];
   int serf_count[27];
+  // An atomic count that is copied along when the game is forked.
+  class Count : public std::atomic<unsigned int> {
+   public:
+    Count() : std::atomic<unsigned int>(0) {}
+    Count(const Count &that)
+      : std::atomic<unsigned int>(that.load(std::memory_order_relaxed)) {}
+  };
+  // Serfs in StateIdleInStock by type, TypeDead included. Kept by Serf,
+  // and read by the AI threads without the game lock.
+  Count idle_serf_count[Serf::TypeDead + 1];
   int knight_occupation[4];
 
   Color color; /* ADDED */
@@ -244,6 +255,8 @@ class Player : public GameObject {
 
   int promote_serfs_to_knights(int number);
   int knights_available_for_attack(MapPos pos);
+  // The same, walking the tiles around pos one by one.
+  int knights_available_for_attack_by_scan(MapPos pos);
   void start_attack();
   void cycle_knights();
 
@@ -255,6 +268,13 @@ class Player : public GameObject {
   void increase_serf_count(Serf::Type type) { serf_count[type]++; }
   void decrease_serf_count(Serf::Type type);
   int *get_serfs() { return reinterpret_cast<int*>(serf_count); }
+  void count_idle_serf(Serf::Type type, int delta) {
+    if (type != Serf::TypeNone) {
+      idle_serf_count[type].fetch_add(static_cast<unsigned int>(delta),
+                                      std::memory_order_relaxed);
+    }
+  }
+  void clear_idle_serf_counts();
 
   void increase_res_count(Resource::Type type) { resource_count[type]++; }
   void decrease_res_count(Resource::Type type) { resource_count[type]--; }
@@ -281,7 +301,7 @@ class Player : public GameObject {
   void update_stats(int res);
 
   // Stats
-  void update_knight_morale();
+  void update_knight_morale(unsigned int depot);
   int get_land_area() const { return total_land_area; }
   void increase_land_area() { total_land_area++; }
   void decrease_land_area() { total_land_area--; }
@@ -299,8 +319,10 @@ class Player : public GameObject {
   int *get_player_stat_history(int mode) { return player_stat_history[mode]; }
 
   ResourceMap get_stats_resources();
-  Serf::SerfMap get_stats_serfs_idle();
-  Serf::SerfMap get_stats_serfs_potential();
+  // Without the game lock.
+  Serf::SerfCounts get_stats_serfs_idle() const;
+  // The serfs the inventories could still make, under the game lock.
+  Serf::SerfCounts get_stats_serfs_potential();
 
   // Settings
   int get_serf_to_knight_rate() const { return serf_to_knight_rate; }
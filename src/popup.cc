@@ -297,7 +297,10 @@ PopupBox::PopupBox(Interface *_interface)
   : minimap(new MinimapGame(_interface, _interface->get_game()))
   , file_list(new ListSavedFiles())
   , file_field(new TextInput())
-  , box(TypeNone) {
+  , box(TypeNone)
+  , chart_key(-1)
+  , chart_history_changes(0)
+  , chart_game(nullptr) {
   interface = _interface;
 
   current_sett_5_item = 8;
@@ -911,8 +914,40 @@ PopupBox::draw_stat_bld_4_box() {
   draw_popup_icon(14, 128, 60); /* exit */
 }
 
+// Whether the chart frame holds the chart for key, of the histories as
+//  they are now.
+bool
+PopupBox::is_chart_current(int key) const {
+  PGame game = interface->get_game();
+  return (chart && chart_key == key && chart_game == game.get() &&
+          chart_history_changes == game->get_history_changes());
+}
+
+// A clear chart frame for key, to draw the chart into. Frames can't be
+//  cleared back to transparent, so each chart gets a new one.
+Frame *
+PopupBox::start_chart(int key) {
+  PGame game = interface->get_game();
+  chart.reset(Graphics::get_instance().create_frame(width, height));
+  chart_key = key;
+  chart_game = game.get();
+  chart_history_changes = game->get_history_changes();
+  return chart.get();
+}
+
 void
-PopupBox::draw_player_stat_chart(const int *data, int index,
+PopupBox::update_chart() {
+  if (!displayed || (box != TypeStat7 && box != TypeStat8) || !chart) {
+    return;
+  }
+  PGame game = interface->get_game();
+  if (chart_history_changes != game->get_history_changes()) {
+    set_redraw();
+  }
+}
+
+void
+PopupBox::draw_player_stat_chart(Frame *dest, const int *data, int index,
                                  const Color &color) {
   int lx = 8;
   int ly = 9;
@@ -929,19 +964,19 @@ PopupBox::draw_player_stat_chart(const int *data, int index,
       if (value > prev_value) {
         int diff = value - prev_value;
         int h = diff/2;
-        frame->fill_rect(lx + lw - i, ly + lh - h - prev_value, 1, h,
-                         color);
+        dest->fill_rect(lx + lw - i, ly + lh - h - prev_value, 1, h,
+                        color);
         diff -= h;
-        frame->fill_rect(lx + lw - i - 1, ly + lh - value, 1, diff, color);
+        dest->fill_rect(lx + lw - i - 1, ly + lh - value, 1, diff, color);
       } else if (value == prev_value) {
-        frame->fill_rect(lx + lw - i - 1, ly + lh - value, 2, 1, color);
+        dest->fill_rect(lx + lw - i - 1, ly + lh - value, 2, 1, color);
       } else {
         int diff = prev_value - value;
         int h = diff/2;
-        frame->fill_rect(lx + lw - i, ly + lh - prev_value, 1, h, color);
+        dest->fill_rect(lx + lw - i, ly + lh - prev_value, 1, h, color);
         diff -= h;
-        frame->fill_rect(lx + lw - i - 1, ly + lh - value - diff, 1, diff,
-                         color);
+        dest->fill_rect(lx + lw - i - 1, ly + lh - value - diff, 1, diff,
+                        color);
       }
     }
 
@@ -1000,16 +1035,21 @@ PopupBox::draw_stat_8_box() {
   draw_popup_icon(10, 103, 94 + 3*scale + 2);
 
   /* Draw chart */
-  PGame game = interface->get_game();
-  int index = game->get_player_history_index(scale);
-  for (int i = 0; i < GAME_MAX_PLAYER_COUNT; i++) {
-    if (game->get_player(GAME_MAX_PLAYER_COUNT-i-1) != nullptr) {
-      Player *player = game->get_player(GAME_MAX_PLAYER_COUNT-i-1);
-      Color color = interface->get_player_color(GAME_MAX_PLAYER_COUNT-i-1);
-      draw_player_stat_chart(player->get_player_stat_history(mode), index,
-                             color);
+  int key = (TypeStat8 << 16) | mode;
+  if (!is_chart_current(key)) {
+    Frame *dest = start_chart(key);
+    PGame game = interface->get_game();
+    int index = game->get_player_history_index(scale);
+    for (int i = 0; i < GAME_MAX_PLAYER_COUNT; i++) {
+      if (game->get_player(GAME_MAX_PLAYER_COUNT-i-1) != nullptr) {
+        Player *player = game->get_player(GAME_MAX_PLAYER_COUNT-i-1);
+        Color color = interface->get_player_color(GAME_MAX_PLAYER_COUNT-i-1);
+        draw_player_stat_chart(dest, player->get_player_stat_history(mode),
+                               index, color);
+      }
     }
   }
+  frame->draw_frame(8, 9, 8, 9, chart.get(), 113, 101);
 }
 
 void
@@ -1069,81 +1109,89 @@ PopupBox::draw_stat_7_box() {
     }
   }
 
-  const int sample_weights[] = { 4, 6, 8, 9, 10, 9, 8, 6, 4 };
+  /* Chart and axis, which depends on the largest count */
+  Player *player = interface->get_player();
+  int key = (TypeStat7 << 16) | (player->get_index() << 8) | item;
+  if (!is_chart_current(key)) {
+    Frame *dest = start_chart(key);
+    const int sample_weights[] = { 4, 6, 8, 9, 10, 9, 8, 6, 4 };
+
+    /* Create array of historical counts */
+    int historical_data[112];
+    int max_val = 0;
+    int index = interface->get_game()->get_resource_history_index();
+    const int *history = player->get_resource_count_history(item);
+
+    for (int i = 0; i < 112; i++) {
+      historical_data[i] = 0;
+      int j = index;
+      for (int k = 0; k < 9; k++) {
+        historical_data[i] += sample_weights[k]*history[j];
+        j = j > 0 ? j-1 : 119;
+      }
 
-  /* Create array of historical counts */
-  int historical_data[112];
-  int max_val = 0;
-  int index = interface->get_game()->get_resource_history_index();
+      if (historical_data[i] > max_val) {
+        max_val = historical_data[i];
+      }
 
-  for (int i = 0; i < 112; i++) {
-    historical_data[i] = 0;
-    int j = index;
-    for (int k = 0; k < 9; k++) {
-      historical_data[i] += sample_weights[k]*interface->
-                              get_player()->get_resource_count_history(item)[j];
-      j = j > 0 ? j-1 : 119;
+      index = index > 0 ? index-1 : 119;
     }
 
-    if (historical_data[i] > max_val) {
-      max_val = historical_data[i];
+    const int axis_icons_1[] = { 110, 109, 108, 107 };
+    const int axis_icons_2[] = { 112, 111, 110, 108 };
+    const int axis_icons_3[] = { 114, 113, 112, 110 };
+    const int axis_icons_4[] = { 117, 116, 114, 112 };
+    const int axis_icons_5[] = { 120, 119, 118, 115 };
+    const int axis_icons_6[] = { 122, 121, 120, 118 };
+    const int axis_icons_7[] = { 125, 124, 122, 120 };
+    const int axis_icons_8[] = { 128, 127, 126, 123 };
+
+    const int *axis_icons = nullptr;
+    int multiplier = 0;
+
+    /* TODO chart background pattern */
+
+    if (max_val <= 64) {
+      axis_icons = axis_icons_1;
+      multiplier = 0x8000;
+    } else if (max_val <= 128) {
+      axis_icons = axis_icons_2;
+      multiplier = 0x4000;
+    } else if (max_val <= 256) {
+      axis_icons = axis_icons_3;
+      multiplier = 0x2000;
+    } else if (max_val <= 512) {
+      axis_icons = axis_icons_4;
+      multiplier = 0x1000;
+    } else if (max_val <= 1280) {
+      axis_icons = axis_icons_5;
+      multiplier = 0x666;
+    } else if (max_val <= 2560) {
+      axis_icons = axis_icons_6;
+      multiplier = 0x333;
+    } else if (max_val <= 5120) {
+      axis_icons = axis_icons_7;
+      multiplier = 0x199;
+    } else {
+      axis_icons = axis_icons_8;
+      multiplier = 0xa3;
     }
 
-    index = index > 0 ? index-1 : 119;
-  }
-
-  const int axis_icons_1[] = { 110, 109, 108, 107 };
-  const int axis_icons_2[] = { 112, 111, 110, 108 };
-  const int axis_icons_3[] = { 114, 113, 112, 110 };
-  const int axis_icons_4[] = { 117, 116, 114, 112 };
-  const int axis_icons_5[] = { 120, 119, 118, 115 };
-  const int axis_icons_6[] = { 122, 121, 120, 118 };
-  const int axis_icons_7[] = { 125, 124, 122, 120 };
-  const int axis_icons_8[] = { 128, 127, 126, 123 };
-
-  const int *axis_icons = nullptr;
-  int multiplier = 0;
-
-  /* TODO chart background pattern */
-
-  if (max_val <= 64) {
-    axis_icons = axis_icons_1;
-    multiplier = 0x8000;
-  } else if (max_val <= 128) {
-    axis_icons = axis_icons_2;
-    multiplier = 0x4000;
-  } else if (max_val <= 256) {
-    axis_icons = axis_icons_3;
-    multiplier = 0x2000;
-  } else if (max_val <= 512) {
-    axis_icons = axis_icons_4;
-    multiplier = 0x1000;
-  } else if (max_val <= 1280) {
-    axis_icons = axis_icons_5;
-    multiplier = 0x666;
-  } else if (max_val <= 2560) {
-    axis_icons = axis_icons_6;
-    multiplier = 0x333;
-  } else if (max_val <= 5120) {
-    axis_icons = axis_icons_7;
-    multiplier = 0x199;
-  } else {
-    axis_icons = axis_icons_8;
-    multiplier = 0xa3;
-  }
-
-  /* Draw axis icons */
-  for (int i = 0; i < 4; i++) {
-    draw_popup_icon(14, i*16, axis_icons[i]);
-  }
+    /* Draw axis icons */
+    for (int i = 0; i < 4; i++) {
+      dest->draw_sprite(8 * 14 + 8, i*16 + 9, Data::AssetIcon, axis_icons[i]);
+    }
 
-  /* Draw chart */
-  for (int i = 0; i < 112; i++) {
-    int value = std::min((historical_data[i]*multiplier) >> 16, 64);
-    if (value > 0) {
-      frame->fill_rect(119 - i, 73 - value, 1, value, Color(0xcf, 0x63, 0x63));
+    /* Draw chart */
+    for (int i = 0; i < 112; i++) {
+      int value = std::min((historical_data[i]*multiplier) >> 16, 64);
+      if (value > 0) {
+        dest->fill_rect(119 - i, 73 - value, 1, value,
+                        Color(0xcf, 0x63, 0x63));
+      }
     }
   }
+  frame->draw_frame(8, 9, 8, 9, chart.get(), 128, 64);
 }
 
 void
@@ -1217,7 +1265,7 @@ PopupBox::draw_gauge_full(int lx, int ly, unsigned int value,
 static void
 calculate_gauge_values(Player *player,
                        unsigned int values[24][Building::kMaxStock][2]) {
-  for (Building *building : player->get_game()->get_player_buildings(player)) {
+  for (Building *building : player->get_game()->get_owned_buildings(player)) {
     if (building->is_burning() || !building->has_serf()) {
       continue;
     }
@@ -1454,11 +1502,11 @@ void
 PopupBox::draw_stat_3_box() {
   draw_box_background(PatternStripedGreen);
 
-  Serf::SerfMap serfs = interface->get_player()->get_stats_serfs_idle();
-  Serf::SerfMap serfs_potential =
+  Serf::SerfCounts serfs = interface->get_player()->get_stats_serfs_idle();
+  Serf::SerfCounts serfs_potential =
                            interface->get_player()->get_stats_serfs_potential();
   for (int i = 0; i < 27; ++i) {
-    serfs[(Serf::Type)i] += serfs_potential[(Serf::Type)i];
+    serfs[i] += serfs_potential[i];
   }
 
   const int layout[] = {
@@ -2468,7 +2516,7 @@ PopupBox::draw_sett_8_box() {
   }
 
   size_t convertible_to_knights = 0;
-  for (Inventory *inv : interface->get_game()->get_player_inventories(player)) {
+  for (Inventory *inv : interface->get_game()->get_owned_inventories(player)) {
     size_t c = std::min(inv->get_count_of(Resource::TypeSword),
                         inv->get_count_of(Resource::TypeShield));
     convertible_to_knights += std::max((size_t)0,
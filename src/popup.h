@@ -29,6 +29,7 @@
 #include "src/gui.h"
 #include "src/resource.h"
 
+class Game;
 class Interface;
 class MinimapGame;
 class ListSavedFiles;
@@ -154,6 +155,13 @@ class PopupBox : public GuiObject {
   int current_stat_7_item;
   int current_stat_8_mode;
 
+  // The chart last drawn by the stat 7 or 8 box, which is blitted until the
+  // histories get new samples or the box shows another chart.
+  std::unique_ptr<Frame> chart;
+  int chart_key;
+  unsigned int chart_history_changes;
+  const Game *chart_game;
+
  public:
   explicit PopupBox(Interface *interface);
   virtual ~PopupBox();
@@ -163,6 +171,8 @@ class PopupBox : public GuiObject {
 
   void show(Type box);
   void hide();
+  // Redraw an open stats chart when the histories it shows have changed.
+  void update_chart();
 
  protected:
   void draw_popup_box_frame();
@@ -195,7 +205,10 @@ class PopupBox : public GuiObject {
   void draw_stat_bld_2_box();
   void draw_stat_bld_3_box();
   void draw_stat_bld_4_box();
-  void draw_player_stat_chart(const int *data, int index, const Color &color);
+  void draw_player_stat_chart(Frame *dest, const int *data, int index,
+                              const Color &color);
+  bool is_chart_current(int key) const;
+  Frame *start_chart(int key);
   void draw_stat_8_box();
   void draw_stat_7_box();
   void draw_gauge_balance(int x, int y, unsigned int value, unsigned int count);
@@ -0,0 +1,285 @@
+/*
+ * profiler-stats.cc - Scoped timer counters and statistics
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+namespace {
+
+// Counters of one thread. Only the owning thread writes them, other
+// threads read them while merging, so plain relaxed loads and stores do.
+typedef struct ThreadCounters {
+  std::atomic<uint32_t> epoch;
+  std::atomic<uint64_t> count[Profiler::max_sections];
+  std::atomic<uint64_t> total_ns[Profiler::max_sections];
+  std::atomic<uint64_t> min_ns[Profiler::max_sections];
+  std::atomic<uint64_t> max_ns[Profiler::max_sections];
+  std::atomic<uint32_t> buckets[Profiler::max_sections][Profiler::bucket_count];
+
+  void clear() {
+    for (unsigned int s = 0; s < Profiler::max_sections; s++) {
+      count[s].store(0, std::memory_order_relaxed);
+      total_ns[s].store(0, std::memory_order_relaxed);
+      min_ns[s].store(0, std::memory_order_relaxed);
+      max_ns[s].store(0, std::memory_order_relaxed);
+      for (unsigned int b = 0; b < Profiler::bucket_count; b++) {
+        buckets[s][b].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+} ThreadCounters;
+
+// Sections are registered from static initializers in other files, so
+// the registry is created on first use.
+typedef struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadCounters>> thread_counters;
+  std::vector<std::string> section_names;
+} Registry;
+
+Registry &
+get_registry() {
+  static Registry registry;
+  return registry;
+}
+
+std::atomic<uint32_t> current_epoch(1);
+
+thread_local ThreadCounters *local_counters = nullptr;
+thread_local Profiler::Tally *local_tally = nullptr;
+
+ThreadCounters *
+get_local_counters() {
+  if (local_counters == nullptr) {
+    std::unique_ptr<ThreadCounters> counters(new ThreadCounters());
+    counters->clear();
+    counters->epoch.store(current_epoch.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    local_counters = counters.get();
+    Registry &registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.thread_counters.push_back(std::move(counters));
+  }
+  return local_counters;
+}
+
+unsigned int
+highest_bit(uint64_t value) {
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(value);
+#else
+  unsigned int bit = 0;
+  while (value >>= 1) bit++;
+  return bit;
+#endif
+}
+
+}  // namespace
+
+const bool Profiler::enabled;
+const bool Profiler::track_scope;
+const unsigned int Profiler::max_sections;
+const unsigned int Profiler::bucket_count;
+thread_local unsigned int Profiler::current_scope = Profiler::max_sections;
+
+Profiler::Section::Section(const char *name) {
+  Registry &registry = get_registry();
+  std::vector<std::string> &section_names = registry.section_names;
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (id = 0; id < section_names.size(); id++) {
+    if (section_names[id] == name) return;
+  }
+  if (section_names.size() == max_sections - 1) {
+    section_names.push_back("other");
+  }
+  if (section_names.size() >= max_sections) {
+    id = max_sections - 1;
+    return;
+  }
+  section_names.push_back(name);
+}
+
+void
+Profiler::record(unsigned int section, uint64_t ns) {
+  if (!enabled) return;
+
+  if (local_tally != nullptr) {
+    local_tally->total_ns[section] += ns;
+    local_tally->count[section]++;
+  }
+
+  ThreadCounters *counters = get_local_counters();
+  uint32_t epoch = current_epoch.load(std::memory_order_relaxed);
+  if (counters->epoch.load(std::memory_order_relaxed) != epoch) {
+    counters->clear();
+    counters->epoch.store(epoch, std::memory_order_release);
+  }
+
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  uint64_t count = counters->count[section].load(relaxed);
+  if (count == 0 || ns < counters->min_ns[section].load(relaxed)) {
+    counters->min_ns[section].store(ns, relaxed);
+  }
+  if (ns > counters->max_ns[section].load(relaxed)) {
+    counters->max_ns[section].store(ns, relaxed);
+  }
+  counters->total_ns[section].store(
+                         counters->total_ns[section].load(relaxed) + ns, relaxed);
+  std::atomic<uint32_t> &bucket = counters->buckets[section][bucket_of(ns)];
+  bucket.store(bucket.load(relaxed) + 1, relaxed);
+  counters->count[section].store(count + 1, std::memory_order_release);
+}
+
+void
+Profiler::Tally::clear() {
+  std::fill(total_ns, total_ns + max_sections, 0);
+  std::fill(count, count + max_sections, 0);
+}
+
+Profiler::Tally *
+Profiler::attach_tally(Tally *tally) {
+  Tally *previous = local_tally;
+  local_tally = tally;
+  return previous;
+}
+
+std::string
+Profiler::get_section_name(unsigned int section) {
+  Registry &registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  if (section >= registry.section_names.size()) return std::string();
+  return registry.section_names[section];
+}
+
+std::vector<Profiler::Stats>
+Profiler::get_stats(const std::string &prefix) {
+  std::vector<Stats> result;
+  const std::memory_order relaxed = std::memory_order_relaxed;
+
+  Registry &registry = get_registry();
+  const std::vector<std::string> &section_names = registry.section_names;
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  uint32_t epoch = current_epoch.load(relaxed);
+  for (unsigned int s = 0; s < section_names.size(); s++) {
+    if (section_names[s].compare(0, prefix.size(), prefix) != 0) continue;
+
+    Stats stats = { section_names[s], 0, 0, 0, 0, 0, 0, 0 };
+    uint64_t buckets[bucket_count] = { 0 };
+    for (const std::unique_ptr<ThreadCounters> &counters :
+                                                  registry.thread_counters) {
+      if (counters->epoch.load(std::memory_order_acquire) != epoch) continue;
+      uint64_t count = counters->count[s].load(std::memory_order_acquire);
+      if (count == 0) continue;
+      uint64_t min_ns = counters->min_ns[s].load(relaxed);
+      if (stats.count == 0 || min_ns < stats.min_ns) stats.min_ns = min_ns;
+      stats.max_ns = std::max(stats.max_ns, counters->max_ns[s].load(relaxed));
+      stats.count += count;
+      stats.total_ns += counters->total_ns[s].load(relaxed);
+      for (unsigned int b = 0; b < bucket_count; b++) {
+        buckets[b] += counters->buckets[s][b].load(relaxed);
+      }
+    }
+    if (stats.count == 0) continue;
+
+    // The bucket the given part of the durations are in or below
+    auto percentile = [&stats, &buckets](uint64_t percent) {
+      uint64_t target = stats.count - stats.count * (100 - percent) / 100;
+      uint64_t seen = 0;
+      for (unsigned int b = 0; b < bucket_count; b++) {
+        seen += buckets[b];
+        if (seen >= target) {
+          return std::min(bucket_upper_bound(b), stats.max_ns);
+        }
+      }
+      return stats.max_ns;
+    };
+    stats.p50_ns = percentile(50);
+    stats.p90_ns = percentile(90);
+    stats.p99_ns = percentile(99);
+    result.push_back(stats);
+  }
+
+  return result;
+}
+
+void
+Profiler::reset() {
+  current_epoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+Profiler::write_report(std::ostream *os, const std::string &prefix) {
+  *os << std::left << std::setw(44) << "section" << std::right
+      << std::setw(10) << "count" << std::setw(12) << "total ms"
+      << std::setw(11) << "min us" << std::setw(11) << "avg us"
+      << std::setw(11) << "p99 us" << std::setw(11) << "max us" << "\n";
+  *os << std::fixed << std::setprecision(3);
+  for (const Stats &stats : get_stats(prefix)) {
+    *os << std::left << std::setw(44) << stats.name << std::right
+        << std::setw(10) << stats.count
+        << std::setw(12) << stats.total_ns / 1000000.
+        << std::setw(11) << stats.min_ns / 1000.
+        << std::setw(11) << stats.avg_ns() / 1000.
+        << std::setw(11) << stats.p99_ns / 1000.
+        << std::setw(11) << stats.max_ns / 1000. << "\n";
+  }
+}
+
+bool
+Profiler::write_report(const std::string &path) {
+  std::ofstream file(path.c_str());
+  if (!file.is_open()) {
+    return false;
+  }
+  write_report(&file);
+  return file.good();
+}
+
+// Values below 4 ns get a bucket each, above that every power of two is
+// split into four buckets. Everything from 2^42 ns up lands in the last.
+unsigned int
+Profiler::bucket_of(uint64_t ns) {
+  if (ns < 4) {
+    return static_cast<unsigned int>(ns);
+  }
+  unsigned int bit = highest_bit(ns);
+  if (bit > 41) {
+    return bucket_count - 1;
+  }
+  return 4 + (bit - 2) * 4 + static_cast<unsigned int>((ns >> (bit - 2)) & 3);
+}
+
+uint64_t
+Profiler::bucket_upper_bound(unsigned int bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  unsigned int bit = (bucket - 4) / 4 + 2;
+  uint64_t sub = (bucket - 4) % 4;
+  return ((5 + sub) << (bit - 2)) - 1;
+}
@@ -22,9 +22,181 @@
 #ifndef SRC_PROFILER_H_
 #define SRC_PROFILER_H_
 
+#include <cstdint>
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "src/trace.h"
+
 /* The length between game updates in miliseconds. */
 #define TICK_LENGTH  20
 #define TICKS_PER_SEC  (1000/TICK_LENGTH)
 
+/* Scoped timers are compiled in unless FREESERF_PROFILER is set to 0. */
+#ifndef FREESERF_PROFILER
+#define FREESERF_PROFILER 1
+#endif
+
+/* Allocations are counted by scope only if FREESERF_ALLOC_STATS is set to 1,
+   see src/alloc-stats.h. */
+#ifndef FREESERF_ALLOC_STATS
+#define FREESERF_ALLOC_STATS 0
+#endif
+
+// Wall time spent in named sections of hot code. Every thread records into
+// its own block of counters, so timing a section never takes a lock; the
+// blocks are only merged when statistics are read. Durations are kept in a
+// log-linear histogram (four buckets per power of two nanoseconds) from
+// which percentiles are estimated.
+class Profiler {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  static const bool enabled = (FREESERF_PROFILER != 0);
+  // Whether each thread keeps track of the section it is in.
+  static const bool track_scope = (FREESERF_PROFILER != 0 &&
+                                   FREESERF_ALLOC_STATS != 0);
+  static const unsigned int max_sections = 128;
+  static const unsigned int bucket_count = 164;
+
+  typedef struct Stats {
+    std::string name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+
+    double avg_ns() const {
+      return (count > 0) ? static_cast<double>(total_ns) / count : 0.; }
+  } Stats;
+
+  // Handle of a named section. Sections with the same name share counters.
+  class Section {
+   protected:
+    unsigned int id;
+
+   public:
+    explicit Section(const char *name);
+    unsigned int get_id() const { return id; }
+  };
+
+  // Times the enclosing scope.
+  class ScopedTimer {
+   protected:
+    const Section &section;
+    Clock::time_point start;
+    unsigned int outer_scope;
+
+   public:
+    explicit ScopedTimer(const Section &section)
+      : section(section), start(Clock::now())
+      , outer_scope(track_scope ? enter_scope(section.get_id()) : 0) {}
+    ~ScopedTimer() {
+      Profiler::record(section, start, Clock::now());
+      if (track_scope) leave_scope(outer_scope);
+    }
+  };
+
+  // Times consecutive phases of one function, each phase ending where the
+  // next one begins.
+  class PhaseTimer {
+   protected:
+    const Section *section;
+    Clock::time_point start;
+    unsigned int outer_scope;
+
+   public:
+    PhaseTimer() : section(nullptr), outer_scope(0) {}
+    ~PhaseTimer() { stop(); }
+
+    void next(const Section &next_section) {
+      if (!enabled) return;
+      Clock::time_point now = Clock::now();
+      if (section != nullptr) {
+        Profiler::record(*section, start, now);
+        if (track_scope) leave_scope(outer_scope);
+      }
+      section = &next_section;
+      if (track_scope) outer_scope = enter_scope(section->get_id());
+      start = now;
+    }
+    void stop() {
+      if (!enabled || section == nullptr) return;
+      Profiler::record(*section, start, Clock::now());
+      if (track_scope) leave_scope(outer_scope);
+      section = nullptr;
+    }
+  };
+
+  // Also goes into the trace, while one is recorded.
+  static void record(const Section &section, Clock::time_point start,
+                     Clock::time_point end) {
+    Trace::complete(section.get_id(), start, end);
+    record(section.get_id(), static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                  end - start).count()));
+  }
+  static void record(unsigned int section, uint64_t ns);
+
+  // Plain totals of one stretch of work of one thread, e.g. one step of an
+  // AI player. While a tally is attached to a thread, everything the thread
+  // records is also added to it.
+  class Tally {
+   public:
+    uint64_t total_ns[max_sections];
+    uint32_t count[max_sections];
+
+    Tally() { clear(); }
+    void clear();
+  };
+  // Attach tally (or nullptr) to the calling thread, returns the one that
+  // was attached before.
+  static Tally *attach_tally(Tally *tally);
+  static std::string get_section_name(unsigned int section);
+
+  // Statistics since the last reset, merged over all threads, for all
+  // sections that were hit. Names starting with prefix only, if given.
+  static std::vector<Stats> get_stats(const std::string &prefix = "");
+  // Start a new measuring window. Threads drop their counters the next
+  // time they record.
+  static void reset();
+
+  static void write_report(std::ostream *os, const std::string &prefix = "");
+  static bool write_report(const std::string &path);
+
+  static unsigned int bucket_of(uint64_t ns);
+  static uint64_t bucket_upper_bound(unsigned int bucket);
+
+  // The innermost section the calling thread is timing, max_sections when
+  // none. Only kept up to date if track_scope is set.
+  static unsigned int get_scope() { return current_scope; }
+  // Returns the scope to go back to when leaving section.
+  static unsigned int enter_scope(unsigned int section) {
+    unsigned int outer = current_scope;
+    current_scope = section;
+    return outer;
+  }
+  static void leave_scope(unsigned int outer) { current_scope = outer; }
+
+ protected:
+  static thread_local unsigned int current_scope;
+};
+
+#if FREESERF_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+/* Time the rest of the enclosing scope as section NAME. */
+#define PROFILE_SCOPE(NAME) \
+  static const Profiler::Section PROFILE_CONCAT(profile_section_, __LINE__)(NAME); \
+  Profiler::ScopedTimer PROFILE_CONCAT(profile_timer_, __LINE__)( \
+                                  PROFILE_CONCAT(profile_section_, __LINE__))
+#else
+#define PROFILE_SCOPE(NAME)
+#endif
 
 #endif  // SRC_PROFILER_H_
@@ -79,6 +79,20 @@ Random::random() {
   return r;
 }
 
+RandomStream
+Random::get_stream(uint64_t stream) const {
+  uint64_t seed = static_cast<uint64_t>(state[0]) |
+                  (static_cast<uint64_t>(state[1]) << 16) |
+                  (static_cast<uint64_t>(state[2]) << 32);
+  return RandomStream(seed).split(stream);
+}
+
+Random
+Random::split(uint64_t stream) const {
+  uint64_t seed = get_stream(stream).get64(0);
+  return Random(seed & 0xFFFF, (seed >> 16) & 0xFFFF, (seed >> 32) & 0xFFFF);
+}
+
 Random::operator std::string() const {
   uint64_t tmp0 = state[0];
   uint64_t tmp1 = state[1];
@@ -108,3 +122,45 @@ operator^=(Random& left, const Random& right) {  // NOLINT
 
   return left;
 }
+
+// The finalizer of SplitMix64. Counter i of a stream is the i-th number
+//  SplitMix64 would give from the key, which is what makes it counter based.
+static uint64_t
+mix64(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+  value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+  return value ^ (value >> 31);
+}
+
+static const uint64_t golden_gamma = 0x9E3779B97F4A7C15ull;
+
+RandomStream
+RandomStream::split(uint64_t id) const {
+  // Hashed twice so that streams of neighbouring ids are not counters of
+  //  each other
+  return RandomStream(mix64(key ^ mix64(id + golden_gamma)));
+}
+
+uint64_t
+RandomStream::get64(uint64_t counter) const {
+  return mix64(key + (counter + 1) * golden_gamma);
+}
+
+void
+RandomStream::fill(uint16_t *values, size_t count, uint64_t first) const {
+  size_t i = 0;
+  // up to the first whole group of four
+  for (; i < count && ((first + i) & 3) != 0; i++) {
+    values[i] = get(first + i);
+  }
+  for (; i + 4 <= count; i += 4) {
+    uint64_t value = get64((first + i) >> 2);
+    values[i] = static_cast<uint16_t>(value);
+    values[i + 1] = static_cast<uint16_t>(value >> 16);
+    values[i + 2] = static_cast<uint16_t>(value >> 32);
+    values[i + 3] = static_cast<uint16_t>(value >> 48);
+  }
+  for (; i < count; i++) {
+    values[i] = get(first + i);
+  }
+}
@@ -22,8 +22,37 @@
 #ifndef SRC_RANDOM_H_
 #define SRC_RANDOM_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+// Random numbers by position rather than in sequence: the value at a
+// counter is a hash of the key and the counter, so any index can be drawn
+// in any order, from any thread, and always gives the same value. Streams
+// are split off by mixing an id into the key, one per subsystem, then per
+// region or object index, so that parallel work draws from streams of its
+// own instead of taking turns on one generator.
+class RandomStream {
+ protected:
+  uint64_t key;
+
+ public:
+  explicit RandomStream(uint64_t key) : key(key) {}
+
+  // The stream for id within this one, e.g. a region of a subsystem
+  RandomStream split(uint64_t id) const;
+
+  uint64_t get64(uint64_t counter) const;
+  // Four of these for each get64(), counter / 4 is the one they come from
+  uint16_t get(uint64_t counter) const {
+    return static_cast<uint16_t>(get64(counter >> 2) >> (16 * (counter & 3)));
+  }
+  // values[i] = get(first + i)
+  void fill(uint16_t *values, size_t count, uint64_t first) const;
+
+  uint64_t get_key() const { return key; }
+};
+
 class Random {
  protected:
   uint16_t state[3];
@@ -44,6 +73,21 @@ class Random {
 
   uint16_t random();
 
+  // The subsystems that draw from streams of the game seed, rather than
+  //  from a Random of their own in a fixed order.
+  typedef enum Stream {
+    StreamMapUpdate = 1,
+    StreamMapGenerator,
+    StreamGame,
+    StreamAI,
+  } Stream;
+
+  // A counter based stream for stream, from the current state, which is
+  //  not advanced
+  RandomStream get_stream(uint64_t stream) const;
+  // A sequential generator of its own for stream, seeded from get_stream()
+  Random split(uint64_t stream) const;
+
   operator std::string() const;
   friend Random& operator^=(Random& left, const Random& right);
 };
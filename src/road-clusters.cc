@@ -0,0 +1,547 @@
+/*
+ * road-clusters.cc - Clusters of map tiles for planning long roads
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/road-clusters.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+#include "src/memory-usage.h"
+#include "src/pathfinder.h"
+
+const unsigned int RoadClusters::cluster_shift;
+const unsigned int RoadClusters::cluster_size;
+const int RoadClusters::min_dist;
+const int RoadClusters::corridor_margin;
+const unsigned int RoadClusters::max_nodes;
+const unsigned int RoadClusters::no_cost;
+const unsigned int RoadClusters::local_tiles;
+
+namespace {
+
+// A road step from pos into a tile that is not a flag, unless the road
+//  ends there.
+bool
+can_step(const Map *map, MapPos pos, Direction dir, MapPos end) {
+  MapPos other = map->move(pos, dir);
+  return (map->is_road_segment_valid(pos, dir) &&
+          (map->get_obj(other) != Map::ObjectFlag || other == end));
+}
+
+// A road step between two clusters, which searches over the clusters take
+//  either way.
+bool
+can_cross(const Map *map, MapPos pos, Direction dir) {
+  return (can_step(map, pos, dir, bad_map_pos) &&
+          can_step(map, map->move(pos, dir), reverse_direction(dir),
+                   bad_map_pos));
+}
+
+// Where the clusters leading into a cluster over each kind of border are.
+const int border_into[3][2] = { { -1, 0 }, { 0, -1 }, { -1, -1 } };
+
+}  // namespace
+
+bool
+RoadClusters::later(const Open &a, const Open &b) {
+  return a.f_score > b.f_score;
+}
+
+unsigned int
+RoadClusters::Corridor::get_cluster_count() const {
+  return static_cast<unsigned int>(std::count(clusters.begin(),
+                                              clusters.end(), 1));
+}
+
+RoadClusters::RoadClusters()
+  : map(nullptr)
+  , cluster_cols(0)
+  , cluster_rows(0)
+  , generation(0) {
+}
+
+void
+RoadClusters::clear() {
+  map = nullptr;
+  clusters.clear();
+}
+
+unsigned int
+RoadClusters::cluster_of(MapPos pos) const {
+  return (map->pos_row(pos) >> cluster_shift) * cluster_cols +
+         (map->pos_col(pos) >> cluster_shift);
+}
+
+unsigned int
+RoadClusters::neighbour(unsigned int cluster, int dx, int dy) const {
+  int cols = static_cast<int>(cluster_cols);
+  int rows = static_cast<int>(cluster_rows);
+  int col = (static_cast<int>(cluster % cluster_cols) + dx + cols) % cols;
+  int row = (static_cast<int>(cluster / cluster_cols) + dy + rows) % rows;
+  return row * cluster_cols + col;
+}
+
+unsigned int
+RoadClusters::local_index(MapPos pos) const {
+  return ((map->pos_row(pos) & (cluster_size - 1)) << cluster_shift) |
+         (map->pos_col(pos) & (cluster_size - 1));
+}
+
+MapPos
+RoadClusters::local_pos(unsigned int cluster, unsigned int index) const {
+  return map->pos(((cluster % cluster_cols) << cluster_shift) +
+                  (index & (cluster_size - 1)),
+                  ((cluster / cluster_cols) << cluster_shift) +
+                  (index >> cluster_shift));
+}
+
+int
+RoadClusters::find_node(unsigned int cluster, MapPos pos) const {
+  const std::vector<MapPos> &nodes = clusters[cluster].nodes;
+  std::vector<MapPos>::const_iterator it = std::find(nodes.begin(),
+                                                     nodes.end(), pos);
+  return (it == nodes.end()) ? -1 : static_cast<int>(it - nodes.begin());
+}
+
+MapPos
+RoadClusters::node_pos(unsigned int node, MapPos start, MapPos end) const {
+  unsigned int start_node = static_cast<unsigned int>(clusters.size()) *
+                            max_nodes;
+  if (node == start_node) {
+    return start;
+  } else if (node == start_node + 1) {
+    return end;
+  }
+  return clusters[node / max_nodes].nodes[node % max_nodes];
+}
+
+void
+RoadClusters::refresh(Map *new_map) {
+  unsigned int cols = new_map->get_cols() >> cluster_shift;
+  unsigned int rows = new_map->get_rows() >> cluster_shift;
+  if (new_map != map || cols != cluster_cols || rows != cluster_rows) {
+    map = new_map;
+    cluster_cols = cols;
+    cluster_rows = rows;
+    clusters.assign(cols * rows, Cluster());
+    for (Cluster &cluster : clusters) {
+      cluster.built = false;
+      cluster.changes = 0;
+    }
+  }
+
+  unsigned int count = static_cast<unsigned int>(clusters.size());
+  unsigned int blocks = cluster_size / Map::get_change_block_size();
+  unsigned int block_cols = map->get_cols() / Map::get_change_block_size();
+  dirty.assign(count, 0);
+  bool any_dirty = false;
+  for (unsigned int c = 0; c < count; c++) {
+    unsigned int first = (c / cluster_cols) * blocks * block_cols +
+                         (c % cluster_cols) * blocks;
+    uint32_t changes = 0;
+    for (unsigned int y = 0; y < blocks; y++) {
+      for (unsigned int x = 0; x < blocks; x++) {
+        changes += map->get_block_changes(first + y * block_cols + x);
+      }
+    }
+    if (!clusters[c].built || changes != clusters[c].changes) {
+      clusters[c].built = true;
+      clusters[c].changes = changes;
+      dirty[c] = 1;
+      any_dirty = true;
+    }
+  }
+  if (!any_dirty) {
+    return;
+  }
+
+  // Borders of a changed cluster and those leading into it, then the
+  //  portals of every cluster on one of those borders.
+  const uint8_t new_borders = 1;
+  const uint8_t new_nodes = 2;
+  affected.assign(count, 0);
+  for (unsigned int c = 0; c < count; c++) {
+    if (!dirty[c]) {
+      continue;
+    }
+    affected[c] |= new_borders | new_nodes;
+    affected[neighbour(c, -1, 0)] |= new_borders | new_nodes;
+    affected[neighbour(c, 0, -1)] |= new_borders | new_nodes;
+    affected[neighbour(c, -1, -1)] |= new_borders | new_nodes;
+    affected[neighbour(c, 1, 0)] |= new_nodes;
+    affected[neighbour(c, 0, 1)] |= new_nodes;
+    affected[neighbour(c, 1, 1)] |= new_nodes;
+  }
+  for (unsigned int c = 0; c < count; c++) {
+    if (affected[c] & new_borders) {
+      build_borders(c);
+    }
+  }
+  for (unsigned int c = 0; c < count; c++) {
+    if (affected[c] & new_nodes) {
+      build_nodes(c);
+    }
+  }
+  // Node indices moved, so all links are found again, that is quick.
+  for (unsigned int c = 0; c < count; c++) {
+    build_links(c);
+  }
+}
+
+// One portal for each run of tiles along a border that a road can cross
+//  from, in the middle of the run. tiles are the cluster_size tiles along
+//  the border, in order. They cross the straight way if they can, else
+//  diagonally, except the last which leaves diagonally into the corner.
+void
+RoadClusters::add_portals(const MapPos *tiles, Direction straight,
+                          Direction diagonal,
+                          std::vector<Crossing> *border) const {
+  Crossing crossings[cluster_size];
+  int run = -1;
+  for (int k = 0; k <= static_cast<int>(cluster_size); k++) {
+    bool open = false;
+    if (k < static_cast<int>(cluster_size)) {
+      MapPos pos = tiles[k];
+      if (can_cross(map, pos, straight)) {
+        crossings[k] = Crossing{ pos, map->move(pos, straight), straight };
+        open = true;
+      } else if (k < static_cast<int>(cluster_size) - 1 &&
+                 can_cross(map, pos, diagonal)) {
+        crossings[k] = Crossing{ pos, map->move(pos, diagonal), diagonal };
+        open = true;
+      }
+    }
+    if (open && run < 0) {
+      run = k;
+    } else if (!open && run >= 0) {
+      border->push_back(crossings[(run + k - 1) / 2]);
+      run = -1;
+    }
+  }
+}
+
+void
+RoadClusters::build_borders(unsigned int c) {
+  Cluster &cluster = clusters[c];
+  const int last = cluster_size - 1;
+  int x0 = (c % cluster_cols) << cluster_shift;
+  int y0 = (c / cluster_cols) << cluster_shift;
+  MapPos tiles[cluster_size];
+
+  cluster.borders[BorderRight].clear();
+  for (int k = 0; k <= last; k++) {
+    tiles[k] = map->pos(x0 + last, y0 + k);
+  }
+  add_portals(tiles, DirectionRight, DirectionDownRight,
+              &cluster.borders[BorderRight]);
+
+  cluster.borders[BorderDown].clear();
+  for (int k = 0; k <= last; k++) {
+    tiles[k] = map->pos(x0 + k, y0 + last);
+  }
+  add_portals(tiles, DirectionDown, DirectionDownRight,
+              &cluster.borders[BorderDown]);
+
+  cluster.borders[BorderDownRight].clear();
+  MapPos corner = map->pos(x0 + last, y0 + last);
+  if (can_cross(map, corner, DirectionDownRight)) {
+    cluster.borders[BorderDownRight].push_back(
+      Crossing{ corner, map->move(corner, DirectionDownRight),
+                DirectionDownRight });
+  }
+}
+
+// The portal tiles of a cluster are on its own borders and those of the
+//  clusters up and left of it that lead into it. The costs between them
+//  are those of the cheapest roads that stay in the cluster.
+void
+RoadClusters::build_nodes(unsigned int c) {
+  Cluster &cluster = clusters[c];
+  cluster.nodes.clear();
+  auto add_node = [this, c, &cluster](MapPos pos) {
+    if (cluster.nodes.size() < max_nodes && cluster_of(pos) == c &&
+        std::find(cluster.nodes.begin(), cluster.nodes.end(), pos) ==
+          cluster.nodes.end()) {
+      cluster.nodes.push_back(pos);
+    }
+  };
+  for (const std::vector<Crossing> &border : cluster.borders) {
+    for (const Crossing &crossing : border) {
+      add_node(crossing.from);
+    }
+  }
+  for (int b = 0; b < BorderCount; b++) {
+    unsigned int other = neighbour(c, border_into[b][0], border_into[b][1]);
+    for (const Crossing &crossing : clusters[other].borders[b]) {
+      add_node(crossing.to);
+    }
+  }
+
+  size_t count = cluster.nodes.size();
+  cluster.costs.assign(count * count, no_cost);
+  for (size_t i = 0; i < count; i++) {
+    search_cluster(cluster.nodes[i], false);
+    for (size_t j = 0; j < count; j++) {
+      cluster.costs[i * count + j] =
+                               local_costs[local_index(cluster.nodes[j])];
+    }
+  }
+}
+
+void
+RoadClusters::build_links(unsigned int c) {
+  Cluster &cluster = clusters[c];
+  for (std::vector<Link> &links : cluster.links) {
+    links.clear();
+  }
+  cluster.links.resize(cluster.nodes.size());
+
+  // Out over its own borders, and back over those leading into it.
+  for (const std::vector<Crossing> &border : cluster.borders) {
+    for (const Crossing &crossing : border) {
+      unsigned int other = cluster_of(crossing.to);
+      int i = find_node(c, crossing.from);
+      int j = find_node(other, crossing.to);
+      if (i >= 0 && j >= 0) {
+        cluster.links[i].push_back(Link{ other * max_nodes + j,
+                                         actual_cost(map, crossing.from,
+                                                     crossing.dir) });
+      }
+    }
+  }
+  for (int b = 0; b < BorderCount; b++) {
+    unsigned int other = neighbour(c, border_into[b][0], border_into[b][1]);
+    for (const Crossing &crossing : clusters[other].borders[b]) {
+      int i = find_node(c, crossing.to);
+      int j = find_node(other, crossing.from);
+      if (i >= 0 && j >= 0) {
+        Direction back = reverse_direction(crossing.dir);
+        cluster.links[i].push_back(Link{ other * max_nodes + j,
+                                         actual_cost(map, crossing.to, back) });
+      }
+    }
+  }
+}
+
+void
+RoadClusters::search_cluster(MapPos origin, bool backwards) {
+  unsigned int cluster = cluster_of(origin);
+  local_costs.assign(local_tiles, no_cost);
+  local_heap.clear();
+  std::greater<uint64_t> later;
+  unsigned int index = local_index(origin);
+  local_costs[index] = 0;
+  local_heap.push_back(index);
+
+  while (!local_heap.empty()) {
+    std::pop_heap(local_heap.begin(), local_heap.end(), later);
+    uint64_t top = local_heap.back();
+    local_heap.pop_back();
+    unsigned int cost = static_cast<unsigned int>(top >> 32);
+    index = static_cast<unsigned int>(top & 0xffffffff);
+    if (cost > local_costs[index]) {
+      continue;
+    }
+
+    MapPos pos = local_pos(cluster, index);
+    for (Direction d : cycle_directions_cw()) {
+      MapPos other = map->move(pos, d);
+      if (cluster_of(other) != cluster) {
+        continue;
+      }
+      unsigned int step;
+      if (!backwards) {
+        if (!can_step(map, pos, d, bad_map_pos)) {
+          continue;
+        }
+        step = actual_cost(map, pos, d);
+      } else {
+        // The step from other into pos, which may be a flag where it ends.
+        Direction back = reverse_direction(d);
+        if (!can_step(map, other, back, origin)) {
+          continue;
+        }
+        step = actual_cost(map, other, back);
+      }
+      unsigned int other_index = local_index(other);
+      if (cost + step < local_costs[other_index]) {
+        local_costs[other_index] = cost + step;
+        local_heap.push_back((static_cast<uint64_t>(cost + step) << 32) |
+                             other_index);
+        std::push_heap(local_heap.begin(), local_heap.end(), later);
+      }
+    }
+  }
+}
+
+void
+RoadClusters::open(unsigned int node, unsigned int g_score,
+                   unsigned int parent, MapPos start, MapPos end) {
+  if (seen[node] == generation && g_scores[node] <= g_score) {
+    return;
+  }
+  seen[node] = generation;
+  g_scores[node] = g_score;
+  parents[node] = parent;
+  unsigned int f_score = g_score +
+                         heuristic_cost(map, node_pos(node, start, end), end);
+  heap.push_back(Open{ f_score, g_score, node });
+  std::push_heap(heap.begin(), heap.end(), later);
+}
+
+bool
+RoadClusters::find_corridor(Map *new_map, MapPos start, MapPos end,
+                            Corridor *corridor) {
+  if (std::abs(new_map->dist_x(start, end)) < min_dist &&
+      std::abs(new_map->dist_y(start, end)) < min_dist) {
+    return false;
+  }
+  refresh(new_map);
+
+  unsigned int start_node = static_cast<unsigned int>(clusters.size()) *
+                            max_nodes;
+  unsigned int end_node = start_node + 1;
+  unsigned int start_cluster = cluster_of(start);
+  unsigned int end_cluster = cluster_of(end);
+
+  // Start and end join the portals of their clusters for this search.
+  search_cluster(start, false);
+  start_links.clear();
+  const std::vector<MapPos> &start_nodes = clusters[start_cluster].nodes;
+  for (size_t j = 0; j < start_nodes.size(); j++) {
+    unsigned int cost = local_costs[local_index(start_nodes[j])];
+    if (cost != no_cost) {
+      start_links.push_back(Link{ static_cast<unsigned int>(
+                                    start_cluster * max_nodes + j), cost });
+    }
+  }
+  search_cluster(end, true);
+  end_costs.clear();
+  for (MapPos pos : clusters[end_cluster].nodes) {
+    end_costs.push_back(local_costs[local_index(pos)]);
+  }
+
+  g_scores.resize(end_node + 1);
+  parents.resize(end_node + 1);
+  seen.resize(end_node + 1, 0);
+  generation++;
+  if (generation == 0) {
+    std::fill(seen.begin(), seen.end(), 0);
+    generation = 1;
+  }
+  heap.clear();
+
+  open(start_node, 0, start_node, start, end);
+  bool found = false;
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    Open top = heap.back();
+    heap.pop_back();
+    if (top.g_score != g_scores[top.node]) {
+      continue;
+    }
+    if (top.node == end_node) {
+      found = true;
+      break;
+    }
+
+    if (top.node == start_node) {
+      for (const Link &link : start_links) {
+        open(link.node, top.g_score + link.cost, top.node, start, end);
+      }
+      continue;
+    }
+    unsigned int c = top.node / max_nodes;
+    unsigned int i = top.node % max_nodes;
+    const Cluster &cluster = clusters[c];
+    size_t count = cluster.nodes.size();
+    for (size_t j = 0; j < count; j++) {
+      unsigned int cost = cluster.costs[i * count + j];
+      if (j != i && cost != no_cost) {
+        open(static_cast<unsigned int>(c * max_nodes + j),
+             top.g_score + cost, top.node, start, end);
+      }
+    }
+    for (const Link &link : cluster.links[i]) {
+      open(link.node, top.g_score + link.cost, top.node, start, end);
+    }
+    if (c == end_cluster && end_costs[i] != no_cost) {
+      open(end_node, top.g_score + end_costs[i], top.node, start, end);
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  corridor->cluster_cols = cluster_cols;
+  corridor->row_shift = map->geom().row_shift();
+  corridor->col_mask = map->geom().col_mask();
+  corridor->clusters.assign(clusters.size(), 0);
+  for (unsigned int node = end_node; ; node = parents[node]) {
+    unsigned int c = cluster_of(node_pos(node, start, end));
+    for (int dy = -corridor_margin; dy <= corridor_margin; dy++) {
+      for (int dx = -corridor_margin; dx <= corridor_margin; dx++) {
+        corridor->clusters[neighbour(c, dx, dy)] = 1;
+      }
+    }
+    if (node == start_node) {
+      break;
+    }
+  }
+  return true;
+}
+
+unsigned int
+RoadClusters::get_node_count() const {
+  size_t count = 0;
+  for (const Cluster &cluster : clusters) {
+    count += cluster.nodes.size();
+  }
+  return static_cast<unsigned int>(count);
+}
+
+size_t
+RoadClusters::get_allocated_bytes() const {
+  size_t bytes = MemoryUsage::vector_bytes(clusters) +
+                 MemoryUsage::vector_bytes(dirty) +
+                 MemoryUsage::vector_bytes(affected) +
+                 MemoryUsage::vector_bytes(local_costs) +
+                 MemoryUsage::vector_bytes(local_heap) +
+                 MemoryUsage::vector_bytes(start_links) +
+                 MemoryUsage::vector_bytes(end_costs) +
+                 MemoryUsage::vector_bytes(g_scores) +
+                 MemoryUsage::vector_bytes(parents) +
+                 MemoryUsage::vector_bytes(seen) +
+                 MemoryUsage::vector_bytes(heap);
+  for (const Cluster &cluster : clusters) {
+    for (const std::vector<Crossing> &border : cluster.borders) {
+      bytes += MemoryUsage::vector_bytes(border);
+    }
+    bytes += MemoryUsage::vector_bytes(cluster.nodes) +
+             MemoryUsage::vector_bytes(cluster.costs) +
+             MemoryUsage::vector_bytes(cluster.links);
+    for (const std::vector<Link> &links : cluster.links) {
+      bytes += MemoryUsage::vector_bytes(links);
+    }
+  }
+  return bytes;
+}
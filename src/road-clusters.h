@@ -0,0 +1,167 @@
+/*
+ * road-clusters.h - Clusters of map tiles for planning long roads
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_ROAD_CLUSTERS_H_
+#define SRC_ROAD_CLUSTERS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "src/map.h"
+
+// Map tiles in square clusters, with the places where a road can cross
+// from one cluster into the next (portals) and the road costs between the
+// portals of each cluster, for planning long roads hierarchically (HPA*).
+// A search over the portals finds the clusters a long road goes through,
+// so the tile search only has to look at those and the ones around them
+// rather than at everything between start and end. Roads go where
+// Map::is_road_segment_valid() allows, through tiles that are not flags.
+// A cluster is worked out again when Map::get_block_changes() of one of
+// the blocks it covers has moved, and its neighbours' portals with it.
+// Not thread safe, callers lock around it.
+class RoadClusters {
+ public:
+  static const unsigned int cluster_shift = 4;   // 16 by 16 tiles
+  static const unsigned int cluster_size = 1 << cluster_shift;
+  // Start and end fewer columns and rows apart than this are left to the
+  //  tile search.
+  static const int min_dist = 2 * cluster_size;
+  // Clusters around the route the tile search may use too.
+  static const int corridor_margin = 1;
+  // Portal tiles a cluster can have: 8 on each side and 1 in each corner
+  //  that leads across.
+  static const unsigned int max_nodes = 40;
+
+  // The clusters a tile search may go through.
+  class Corridor {
+   public:
+    Corridor() : cluster_cols(0), row_shift(0), col_mask(0) {}
+
+    bool contains(MapPos pos) const {
+      return clusters[((pos >> row_shift) >> cluster_shift) * cluster_cols +
+                      ((pos & col_mask) >> cluster_shift)] != 0;
+    }
+    unsigned int get_cluster_count() const;
+
+   protected:
+    friend class RoadClusters;
+
+    std::vector<uint8_t> clusters;   // Row by row
+    unsigned int cluster_cols;
+    unsigned int row_shift;
+    unsigned int col_mask;
+  };
+
+  RoadClusters();
+
+  // The corridor for a road from start to end. False when they are close
+  //  enough for a plain tile search, or when no road gets from one to the
+  //  other through the clusters, which the tile search may still want to
+  //  find out about for itself.
+  bool find_corridor(Map *map, MapPos start, MapPos end, Corridor *corridor);
+
+  // Portal tiles over all clusters, as of the last find_corridor().
+  unsigned int get_node_count() const;
+  size_t get_allocated_bytes() const;
+  // For a new map
+  void clear();
+
+ protected:
+  static const unsigned int no_cost = static_cast<unsigned int>(-1);
+  static const unsigned int local_tiles = cluster_size * cluster_size;
+
+  // A step of a road from one cluster into the next, allowed both ways.
+  typedef struct Crossing {
+    MapPos from;
+    MapPos to;
+    Direction dir;
+  } Crossing;
+
+  typedef struct Link {
+    unsigned int node;   // Cluster index * max_nodes + node index
+    unsigned int cost;
+  } Link;
+
+  typedef enum Border {
+    BorderRight = 0,
+    BorderDown,
+    BorderDownRight,
+    BorderCount,
+  } Border;
+
+  typedef struct Cluster {
+    bool built;
+    uint32_t changes;   // Of the blocks it covers, when built
+    std::vector<Crossing> borders[BorderCount];   // Portals of the border
+                                                  // to each next cluster
+    std::vector<MapPos> nodes;   // Portal tiles in the cluster
+    std::vector<unsigned int> costs;   // From each node to each, row by row
+    std::vector<std::vector<Link>> links;   // Of each node, across borders
+  } Cluster;
+
+  typedef struct Open {
+    unsigned int f_score;
+    unsigned int g_score;
+    unsigned int node;
+  } Open;
+  // Order of the open heap, lowest f-score on top
+  static bool later(const Open &a, const Open &b);
+
+  Map *map;   // The clusters are of
+  unsigned int cluster_cols;
+  unsigned int cluster_rows;
+  std::vector<Cluster> clusters;
+
+  // Scratch of refresh() and find_corridor(), kept for their capacity
+  std::vector<uint8_t> dirty;
+  std::vector<uint8_t> affected;
+  std::vector<unsigned int> local_costs;
+  std::vector<uint64_t> local_heap;   // Cost above the local index
+  std::vector<Link> start_links;
+  std::vector<unsigned int> end_costs;
+  std::vector<unsigned int> g_scores;
+  std::vector<unsigned int> parents;
+  std::vector<uint32_t> seen;
+  uint32_t generation;
+  std::vector<Open> heap;
+
+  unsigned int cluster_of(MapPos pos) const;
+  unsigned int neighbour(unsigned int cluster, int dx, int dy) const;
+  MapPos node_pos(unsigned int node, MapPos start, MapPos end) const;
+
+  // Take map on, and work out again what changed on it.
+  void refresh(Map *new_map);
+  void build_borders(unsigned int cluster);
+  void build_nodes(unsigned int cluster);
+  void build_links(unsigned int cluster);
+  // Road costs from origin to the tiles of its cluster, or from them to
+  //  origin backwards, into local_costs.
+  void search_cluster(MapPos origin, bool backwards);
+  unsigned int local_index(MapPos pos) const;
+  MapPos local_pos(unsigned int cluster, unsigned int index) const;
+  int find_node(unsigned int cluster, MapPos pos) const;
+  void open(unsigned int node, unsigned int g_score, unsigned int parent,
+            MapPos start, MapPos end);
+  void add_portals(const MapPos *tiles, Direction straight,
+                   Direction diagonal, std::vector<Crossing> *border) const;
+};
+
+#endif  // SRC_ROAD_CLUSTERS_H_
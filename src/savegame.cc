@@ -30,11 +30,17 @@
 #include <ctime>
 #include <utility>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 
 #include "src/game.h"
 #include "src/log.h"
 #include "src/debug.h"
 #include "src/configfile.h"
+#include "src/buffer.h"
+#include "src/lz-stream.h"
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -49,6 +55,36 @@
 #include <sys/stat.h>
 #endif
 
+// The digits of number after text, as std::to_string would put them.
+static void
+append_number(std::string *text, uint64_t number, bool negative = false) {
+  char digits[24];
+  char *first = digits + sizeof(digits);
+  do {
+    *--first = static_cast<char>('0' + number % 10);
+    number /= 10;
+  } while (number != 0);
+  if (negative) {
+    *--first = '-';
+  }
+  text->append(first, digits + sizeof(digits) - first);
+}
+
+// The lines of the text format, as ConfigFile::write puts them.
+static void
+put_text_section(std::string *text, const std::string &name) {
+  text->append("[").append(name).append("]\n");
+}
+
+static void
+put_text_value(std::string *text, const std::string &name,
+               const std::string &value) {
+  text->append("  ").append(name).append(" = ").append(value).append("\n");
+}
+
+// Text is handed to the stream in pieces of about this size.
+static const size_t text_chunk_size = 1 << 16;
+
 class SaveWriterTextSection : public SaveWriterText {
  protected:
   typedef std::map<std::string, SaveWriterTextValue> Values;
@@ -83,17 +119,57 @@ class SaveWriterTextSection : public SaveWriterText {
   }
 
   bool save(const std::string &path) {
-    ConfigFile file;
-    save(&file);
-    return file.save(path);
+    std::ofstream file(path, std::ios_base::trunc);
+    if (!file.is_open()) {
+      Log::Error["savegame"] << "Unable to open save game file: '" << path
+                             << "'";
+      return false;
+    }
+    return write(&file);
   }
 
+  // The same text save(ConfigFile*) and ConfigFile::write would make,
+  //  without copying every value into a ConfigFile first: the sections
+  //  with values by their full names, their values by name.
   bool write(std::ostream *os) {
-    ConfigFile file;
-    save(&file);
-    return file.write(os);
+    std::vector<std::pair<std::string, const SaveWriterTextSection*>> all;
+    add_named(&all);
+    std::stable_sort(all.begin(), all.end(),
+      [](const std::pair<std::string, const SaveWriterTextSection*> &a,
+         const std::pair<std::string, const SaveWriterTextSection*> &b) {
+        return a.first < b.first; });
+
+    std::string text;
+    for (const auto &section : all) {
+      if (section.second->values.empty()) {
+        continue;
+      }
+      put_text_section(&text, section.first);
+      for (const auto &value : section.second->values) {
+        put_text_value(&text, value.first, value.second.get_value());
+      }
+      if (text.size() >= text_chunk_size) {
+        os->write(text.data(), text.size());
+        text.clear();
+      }
+    }
+    os->write(text.data(), text.size());
+    return !os->fail();
+  }
+
+
+  // The text of a value, empty if there is none.
+  std::string get_value(const std::string &val_name) const {
+    Values::const_iterator i = values.find(val_name);
+    return (i == values.end()) ? std::string() : i->second.get_value();
   }
 
+  unsigned int count_sections(const std::string &sub_name) const {
+    return static_cast<unsigned int>(std::count_if(
+      sections.begin(), sections.end(),
+      [&sub_name](const SaveWriterTextSection *section) {
+        return section->name == sub_name; }));
+  }
 
   SaveWriterText &add_section(const std::string &sub_name,
                               unsigned int sub_number) {
@@ -103,7 +179,18 @@ class SaveWriterTextSection : public SaveWriterText {
     return *section;
   }
 
- protected:
+  // This section and those under it, each with its full name.
+  void add_named(std::vector<std::pair<std::string,
+                                       const SaveWriterTextSection*>> *all)
+                                                                       const {
+    std::string full_name = name + " ";
+    append_number(&full_name, number);
+    all->emplace_back(std::move(full_name), this);
+    for (const SaveWriterTextSection *section : sections) {
+      section->add_named(all);
+    }
+  }
+
   bool save(ConfigFile *file) {
     std::stringstream str;
     str << name << " " << number;
@@ -120,8 +207,165 @@ class SaveWriterTextSection : public SaveWriterText {
   }
 };
 
+// Writes the text format straight from a game, without keeping the values
+//  of the whole game.  Each section is put into one text buffer as soon as
+//  the next one is added, and the buffer goes out in the order of the
+//  section names, the same bytes SaveWriterTextSection writes.  So a
+//  section can't be written to after the next one is added; the game
+//  writes them one after the other anyway.  Only the top section stays
+//  open until the end.
+class SaveWriterTextStream : public SaveWriterText {
+ protected:
+  // Where the text of a section went in the buffer.
+  typedef struct Written {
+    size_t name;       // in names
+    size_t name_size;
+    size_t text;       // in text
+    size_t text_size;
+  } Written;
+
+  // The values of a section while it is written.  They are kept from one
+  //  section to the next, so their strings keep the room they took.
+  class Section : public SaveWriterText {
+   public:
+    SaveWriterTextStream *stream;
+    std::string name;
+    std::vector<std::pair<std::string, SaveWriterTextValue>> values;
+    size_t count;   // of the values in use
+    size_t last;    // the one asked for last
+
+    explicit Section(SaveWriterTextStream *stream_)
+      : stream(stream_)
+      , count(0)
+      , last(0) {
+    }
+
+    void start(const std::string &name_, unsigned int number) {
+      name = name_;
+      name += ' ';
+      append_number(&name, number);
+      count = 0;
+      last = 0;
+    }
+
+    virtual SaveWriterTextValue &value(const std::string &val_name) {
+      // A section asks for the same few names over and over, mostly in the
+      //  same order, so look from the one after the last.
+      for (size_t i = 1; i <= count; i++) {
+        size_t at = (last + i) % count;
+        if (values[at].first == val_name) {
+          last = at;
+          return values[at].second;
+        }
+      }
+      if (count == values.size()) {
+        values.emplace_back();
+      }
+      values[count].first = val_name;
+      values[count].second.get_value().clear();
+      last = count;
+      return values[count++].second;
+    }
+
+    virtual SaveWriterText &add_section(const std::string &sub_name,
+                                        unsigned int sub_number) {
+      return stream->add_section(sub_name, sub_number);
+    }
+  };
+
+  Section top;
+  Section current;
+  std::string *text;
+  std::string names;
+  std::vector<Written> written;
+  std::vector<size_t> order;
+
+  void put(Section *section) {
+    if (section->count == 0) {
+      return;
+    }
+    Written where = { names.size(), section->name.size(), text->size(), 0 };
+    names += section->name;
+
+    order.resize(section->count);
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [section](size_t a, size_t b) {
+      return section->values[a].first < section->values[b].first; });
+    put_text_section(text, section->name);
+    for (size_t i : order) {
+      put_text_value(text, section->values[i].first,
+                     section->values[i].second.get_value());
+    }
+    where.text_size = text->size() - where.text;
+    written.push_back(where);
+    section->count = 0;
+  }
+
+ public:
+  // The text goes into text_, which is cleared first but keeps its room.
+  SaveWriterTextStream(const std::string &name, unsigned int number,
+                       std::string *text_)
+    : top(this)
+    , current(this)
+    , text(text_) {
+    top.start(name, number);
+    text->clear();
+  }
+
+  virtual SaveWriterTextValue &value(const std::string &val_name) {
+    return top.value(val_name);
+  }
+
+  virtual SaveWriterText &add_section(const std::string &sub_name,
+                                      unsigned int sub_number) {
+    put(&current);
+    current.start(sub_name, sub_number);
+    return current;
+  }
+
+  unsigned int count_sections(const std::string &sub_name) const {
+    unsigned int sections = 0;
+    for (const Written &where : written) {
+      if (where.name_size > sub_name.size() &&
+          names.compare(where.name, sub_name.size(), sub_name) == 0 &&
+          names[where.name + sub_name.size()] == ' ') {
+        sections++;
+      }
+    }
+    return sections;
+  }
+
+  bool write(std::ostream *os) {
+    put(&current);
+    put(&top);
+    std::stable_sort(written.begin(), written.end(),
+                     [this](const Written &a, const Written &b) {
+      return names.compare(a.name, a.name_size,
+                           names, b.name, b.name_size) < 0; });
+    for (const Written &where : written) {
+      os->write(text->data() + where.text, where.text_size);
+    }
+    return !os->fail();
+  }
+};
+
 typedef std::map<std::string, SaveReaderTextValue> Values;
 
+// Names are looked up lowercase, and most are asked for that way already.
+static Values::const_iterator
+find_value(const Values &values, const std::string &name) {
+  if (std::none_of(name.begin(), name.end(),
+                   [](char c) { return c >= 'A' && c <= 'Z'; })) {
+    return values.find(name);
+  }
+  std::string lower_name = name;
+  std::transform(lower_name.begin(), lower_name.end(), lower_name.begin(),
+                 ::tolower);
+  return values.find(lower_name);
+}
+
 class SaveReaderTextSection : public SaveReaderText {
  protected:
   std::string name;
@@ -130,23 +374,11 @@ class SaveReaderTextSection : public SaveReaderText {
   Readers readers_stub;
 
  public:
-  SaveReaderTextSection(ConfigFile *file, const std::string &_name)
+  SaveReaderTextSection(const std::string &_name, int _number,
+                        Values &&_values)
     : name(_name)
-    , number(0) {
-    size_t pos = name.find(' ');
-    if (pos != std::string::npos) {
-      std::string value = name.substr(pos + 1, name.length() - pos - 1);
-      name = name.substr(0, pos);
-      std::stringstream ss;
-      ss << value;
-      ss >> number;
-    }
-
-    auto vals = file->get_values(_name);
-    for (std::string vname : vals) {
-      values.emplace(std::make_pair(vname,
-                           SaveReaderTextValue(file->value(_name, vname, ""))));
-    }
+    , number(_number)
+    , values(std::move(_values)) {
   }
 
   virtual std::string get_name() const {
@@ -159,9 +391,7 @@ class SaveReaderTextSection : public SaveReaderText {
 
   virtual const SaveReaderTextValue &
   value(const std::string &val_name) const {
-    std::string v_name = val_name;
-    std::transform(v_name.begin(), v_name.end(), v_name.begin(), ::tolower);
-    Values::const_iterator it = values.find(v_name);
+    Values::const_iterator it = find_value(values, val_name);
     if (it == values.end()) {
       std::ostringstream str;
       str << "Failed to load value: " << val_name;
@@ -177,42 +407,36 @@ class SaveReaderTextSection : public SaveReaderText {
   }
 
   virtual bool has_value(const std::string &name) {
-    std::string v_name = name;
-    std::transform(v_name.begin(), v_name.end(), v_name.begin(), ::tolower);
-    Values::const_iterator it = values.find(v_name);
-    return (it != values.end());
+    return (find_value(values, name) != values.end());
   }
 };
 
+// A section as read from either format, kept by the name it has in the text
+//  so that the sections are in the order of the text file.
+typedef struct ParsedSection {
+  std::string name;
+  int number;
+  bool has_number;
+  Values values;
+} ParsedSection;
+
+typedef std::map<std::string, ParsedSection> ParsedSections;
+
 typedef std::list<SaveReaderTextSection*> ReaderSections;
 
 class SaveReaderTextFile : public SaveReaderText {
  protected:
   ReaderSections sections;
+  std::map<std::string, Readers> sections_by_name;
   Values values;
 
- public:
-  explicit SaveReaderTextFile(std::istream *is) {
-    ConfigFile file;
-
-    try {
-      file.read(is);
-    } catch (...) {
-      throw ExceptionFreeserf("Wrong config file format.");
-    }
+  SaveReaderTextFile() {}
 
-    auto sects = file.get_sections();
-    for (std::string name : sects) {
-      SaveReaderTextSection *section = new SaveReaderTextSection(&file, name);
-      sections.push_back(section);
-    }
+  void add_sections(ParsedSections *parsed);
 
-    auto vals = file.get_values("main");
-    for (std::string vname : vals) {
-      values.emplace(std::make_pair(vname,
-                           SaveReaderTextValue(file.value("main", vname, ""))));
-    }
-  }
+ public:
+  SaveReaderTextFile(const char *data, size_t size);
+  explicit SaveReaderTextFile(std::istream *is);
 
   virtual ~SaveReaderTextFile() {
     for (auto section : sections) {
@@ -230,9 +454,7 @@ class SaveReaderTextFile : public SaveReaderText {
 
   virtual const SaveReaderTextValue &
   value(const std::string &name) const {
-    std::string v_name = name;
-    std::transform(v_name.begin(), v_name.end(), v_name.begin(), ::tolower);
-    Values::const_iterator it = values.find(v_name);
+    Values::const_iterator it = find_value(values, name);
     if (it == values.end()) {
       std::ostringstream str;
       str << "Failed to load value: " << name;
@@ -243,22 +465,605 @@ class SaveReaderTextFile : public SaveReaderText {
   }
 
   virtual Readers get_sections(const std::string &name) {
-    Readers result;
+    auto it = sections_by_name.find(name);
+    if (it == sections_by_name.end()) {
+      return Readers();
+    }
+    return it->second;
+  }
+
+  virtual bool has_value(const std::string &name) {
+    return (find_value(values, name) != values.end());
+  }
+};
+
+// The values of a section called "main" are also those of the file.
+void
+SaveReaderTextFile::add_sections(ParsedSections *parsed) {
+  for (auto &parsed_section : *parsed) {
+    ParsedSection &section = parsed_section.second;
+    if (section.name == "main") {
+      values = section.values;
+    }
+    SaveReaderTextSection *reader = new SaveReaderTextSection(
+                      section.name, section.number, std::move(section.values));
+    sections.push_back(reader);
+    sections_by_name[reader->get_name()].push_back(reader);
+  }
+}
+
+// Section names are "name number" in text, or just the name.
+static void
+split_section_name(const std::string &full_name, std::string *name,
+                   int *number, bool *has_number) {
+  size_t pos = full_name.find(' ');
+  *name = full_name.substr(0, pos);
+  *number = 0;
+  *has_number = (pos != std::string::npos);
+  if (*has_number) {
+    *number = static_cast<int>(strtol(full_name.c_str() + pos + 1, nullptr,
+                                      10));
+  }
+}
+
+// Whether the text is a number that reads back as the same text, so no
+//  leading zeros or plus and not "-0".
+static bool
+parse_number(const char *begin, const char *end, int64_t *number) {
+  bool negative = (begin < end && *begin == '-');
+  const char *digits = begin + (negative ? 1 : 0);
+  if (digits == end || end - digits > 18 ||
+      (*digits == '0' && (end - digits > 1 || negative))) {
+    return false;
+  }
+  int64_t n = 0;
+  for (const char *c = digits; c < end; c++) {
+    if (*c < '0' || *c > '9') {
+      return false;
+    }
+    n = n * 10 + (*c - '0');
+  }
+  *number = negative ? -n : n;
+  return true;
+}
+
+static std::string
+lowercase(const char *begin, const char *end) {
+  std::string text(begin, end);
+  for (char &c : text) {
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+  }
+  return text;
+}
+
+// Collects the parts of a value, the numbers apart for as long as there are
+//  only numbers, which is nearly always.
+class ValueParts {
+ protected:
+  std::vector<int64_t> numbers;
+  std::vector<SaveReaderTextValue> parts;
+
+ public:
+  void reserve(size_t count) { numbers.reserve(count); }
+
+  void add(int64_t number) {
+    if (parts.empty()) {
+      numbers.push_back(number);
+    } else {
+      parts.emplace_back(number);
+    }
+  }
+
+  void add(std::string &&text) {
+    if (parts.empty()) {
+      for (int64_t number : numbers) {
+        parts.emplace_back(number);
+      }
+    }
+    parts.emplace_back(std::move(text));
+  }
 
-    for (SaveReaderTextSection *reader : sections) {
-      if (reader->get_name() == name) {
-        result.push_back(reader);
+  SaveReaderTextValue get_value() {
+    if (parts.empty()) {
+      if (numbers.size() == 1) {
+        return SaveReaderTextValue(numbers[0]);
+      } else if (!numbers.empty()) {
+        return SaveReaderTextValue(std::move(numbers));
       }
+      return SaveReaderTextValue(std::string());
+    } else if (parts.size() == 1) {
+      return parts[0];
     }
+    return SaveReaderTextValue(std::move(parts));
+  }
+};
 
-    return result;
+// As ConfigFile reads values, lowercase, and split at the commas as the
+//  text reader does, but with the numbers read once and for all.
+static SaveReaderTextValue
+parse_text_value(const char *begin, const char *end) {
+  if (begin < end && end[-1] == ',') {
+    // the text reader drops an empty last part, leave that to it
+    return SaveReaderTextValue(lowercase(begin, end));
   }
 
-  virtual bool has_value(const std::string &name) {
-    std::string v_name = name;
-    std::transform(v_name.begin(), v_name.end(), v_name.begin(), ::tolower);
-    Values::const_iterator it = values.find(v_name);
-    return (it != values.end());
+  ValueParts parts;
+  const char *item = begin;
+  while (true) {
+    const char *comma = std::find(item, end, ',');
+    int64_t number = 0;
+    if (parse_number(item, comma, &number)) {
+      parts.add(number);
+    } else {
+      parts.add(lowercase(item, comma));
+    }
+    if (comma == end) {
+      break;
+    }
+    item = comma + 1;
+  }
+  return parts.get_value();
+}
+
+static bool
+is_space(char c) {
+  return (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+          c == '\r');
+}
+
+static void
+trim(const char **begin, const char **end) {
+  while (*begin < *end && is_space(**begin)) (*begin)++;
+  while (*begin < *end && is_space((*end)[-1])) (*end)--;
+}
+
+// The text format in one pass over the file, as ConfigFile reads it: the
+//  names are lowercase, a section given twice holds only what comes after
+//  the second, and what comes before the first section is in "global".
+static bool
+read_text(const char *data, size_t size, ParsedSections *sections) {
+  const char *end = data + size;
+  ParsedSection *section = &(*sections)["global"];
+  section->name = "global";
+  section->number = 0;
+  section->has_number = false;
+
+  for (const char *line = data; line < end; ) {
+    const char *line_end = std::find(line, end, '\n');
+    const char *next = (line_end < end) ? line_end + 1 : end;
+    trim(&line, &line_end);
+    if (line == line_end) {
+      line = next;
+      continue;
+    }
+
+    if (*line == '[') {
+      const char *close = line_end;
+      while (close > line && close[-1] != ']') close--;
+      if (close == line || close - line < 3) {
+        Log::Error["savegame"] << "Failed to parse save game section";
+        return false;
+      }
+      std::string full_name = lowercase(line + 1, close - 1);
+      section = &(*sections)[full_name];
+      split_section_name(full_name, &section->name, &section->number,
+                         &section->has_number);
+      section->values.clear();
+    } else if (*line != ';' && *line != '#') {
+      const char *equals = std::find(line, line_end, '=');
+      const char *name_end = equals;
+      const char *value = (equals < line_end) ? equals + 1 : line;
+      trim(&line, &name_end);
+      trim(&value, &line_end);
+      std::string name = lowercase(line, name_end);
+      auto it = section->values.find(name);
+      if (it != section->values.end()) {
+        it->second = parse_text_value(value, line_end);
+      } else {
+        section->values.emplace(std::move(name),
+                                parse_text_value(value, line_end));
+      }
+    }
+    line = next;
+  }
+  return true;
+}
+
+// Like the text reader always has, what comes before a broken line is kept.
+SaveReaderTextFile::SaveReaderTextFile(const char *data, size_t size) {
+  ParsedSections parsed;
+  read_text(data, size, &parsed);
+  add_sections(&parsed);
+}
+
+static std::string read_all(std::istream *is);
+
+SaveReaderTextFile::SaveReaderTextFile(std::istream *is) {
+  std::string data = read_all(is);
+  ParsedSections parsed;
+  read_text(data.data(), data.size(), &parsed);
+  add_sections(&parsed);
+}
+
+// Compact save games hold the sections and values of the text ones, so
+//  every object saves and loads itself the same way in both.  After the
+//  magic and the version the file is a list of chunks, each a four letter
+//  tag and a length, so readers skip the chunks they don't know.  The "NAME"
+//  chunk holds all the section and value names once, and each "SECT" chunk
+//  a section: its name and number, then its values as lists of numbers and
+//  strings.  Everything is in varints, so loading parses no text at all.
+//  From version 2 a save can be a delta: a "BASE" chunk names the save in
+//  the same folder it changes, a "GONE" chunk the sections it no longer has,
+//  and the "SECT" chunks are only the sections that are new or changed.
+static const char compact_magic[] = { 'F', 'S', 'E', 'R', 'F', 'C', 'S', 'V' };
+static const uint32_t compact_version = 2;
+static const unsigned int compact_max_bases = 256;
+
+static bool
+is_compact(const char *data, size_t size) {
+  return size >= sizeof(compact_magic) &&
+         memcmp(data, compact_magic, sizeof(compact_magic)) == 0;
+}
+
+class CompactOutput {
+ protected:
+  std::string data;
+
+ public:
+  void put_varint(uint64_t val) {
+    while (val >= 0x80) {
+      data += static_cast<char>((val & 0x7f) | 0x80);
+      val >>= 7;
+    }
+    data += static_cast<char>(val);
+  }
+
+  void put_uint32(uint32_t val) {
+    for (int i = 0; i < 4; i++) {
+      data += static_cast<char>((val >> (i * 8)) & 0xff);
+    }
+  }
+
+  void put_bytes(const std::string &bytes) { data += bytes; }
+  const std::string &get_data() const { return data; }
+
+  void put_chunk(const char *tag, const CompactOutput &chunk) {
+    data.append(tag, 4);
+    put_uint32(static_cast<uint32_t>(chunk.data.size()));
+    data += chunk.data;
+  }
+
+  bool write(std::ostream *os) const {
+    os->write(data.data(), data.size());
+    return os->good();
+  }
+};
+
+class CompactInput {
+ protected:
+  const uint8_t *current;
+  const uint8_t *end;
+
+ public:
+  CompactInput(const void *data, size_t size)
+    : current(reinterpret_cast<const uint8_t*>(data))
+    , end(reinterpret_cast<const uint8_t*>(data) + size) {}
+
+  bool has_data_left() const { return current < end; }
+  size_t get_size_left() const { return end - current; }
+
+  uint64_t get_varint() {
+    uint64_t val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (current >= end) {
+        throw ExceptionFreeserf("Invalid read past end.");
+      }
+      uint8_t byte = *current++;
+      val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return val;
+      }
+    }
+    throw ExceptionFreeserf("Invalid number in compact save game.");
+  }
+
+  uint32_t get_uint32() {
+    const uint8_t *bytes = get_bytes(4);
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+           (static_cast<uint32_t>(bytes[3]) << 24);
+  }
+
+  const uint8_t *get_bytes(size_t size) {
+    if (static_cast<size_t>(end - current) < size) {
+      throw ExceptionFreeserf("Invalid read past end.");
+    }
+    const uint8_t *bytes = current;
+    current += size;
+    return bytes;
+  }
+
+  std::string get_string(size_t size) {
+    return std::string(reinterpret_cast<const char*>(get_bytes(size)), size);
+  }
+};
+
+// Values are the comma separated items of the text, each either a number
+//  that reads back as the same text, or a string.  A number n is written as
+//  varint (zigzag(n) << 1), a string as varint (length << 1 | 1) and its bytes.
+static void
+put_compact_item(CompactOutput *out, const std::string &item) {
+  int64_t n = 0;
+  if (parse_number(item.data(), item.data() + item.size(), &n)) {
+    uint64_t zigzag = (static_cast<uint64_t>(n) << 1) ^
+                      static_cast<uint64_t>(n >> 63);
+    out->put_varint(zigzag << 1);
+  } else {
+    out->put_varint((static_cast<uint64_t>(item.size()) << 1) | 1);
+    out->put_bytes(item);
+  }
+}
+
+static SaveReaderTextValue
+get_compact_value(CompactInput *in, uint64_t items) {
+  ValueParts parts;
+  // each item takes at least a byte
+  parts.reserve(std::min<uint64_t>(items, in->get_size_left()));
+  for (uint64_t i = 0; i < items; i++) {
+    uint64_t head = in->get_varint();
+    if (head & 1) {
+      parts.add(in->get_string(head >> 1));
+    } else {
+      uint64_t zigzag = head >> 1;
+      parts.add(static_cast<int64_t>(zigzag >> 1) ^
+                -static_cast<int64_t>(zigzag & 1));
+    }
+  }
+  return parts.get_value();
+}
+
+// The names of sections and values, in the order they were first used.
+class CompactNames {
+ protected:
+  std::map<std::string, uint64_t> ids;
+  CompactOutput chunk;
+
+ public:
+  uint64_t get_id(const std::string &name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+      return it->second;
+    }
+    uint64_t id = ids.size();
+    ids[name] = id;
+    chunk.put_varint(name.size());
+    chunk.put_bytes(name);
+    return id;
+  }
+
+  const CompactOutput &get_chunk() const { return chunk; }
+};
+
+// The save a delta is made against, and the digests of its sections.
+typedef struct CompactBase {
+  std::string name;
+  const GameStore::Digests *digests;
+} CompactBase;
+
+// FNV-1a
+static uint64_t
+digest_add(uint64_t digest, const std::string &text) {
+  for (char c : text) {
+    digest = (digest ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+  }
+  return (digest ^ 0xff) * 0x100000001b3ull;
+}
+
+// The comma separated items of a value, none when it is empty.
+static std::vector<std::string>
+split_items(const std::string &text) {
+  std::vector<std::string> items;
+  size_t begin = 0;
+  size_t comma = text.find(',');
+  if (!text.empty()) {
+    while (comma != std::string::npos) {
+      items.push_back(text.substr(begin, comma - begin));
+      begin = comma + 1;
+      comma = text.find(',', begin);
+    }
+    items.push_back(text.substr(begin));
+  }
+  return items;
+}
+
+// The values are trimmed and turned lowercase, like ConfigFile reads the text.
+//  With a base only the sections that differ from it are written.
+static bool
+write_compact(const ConfigFile &file, std::ostream *os,
+              const CompactBase *base = nullptr,
+              GameStore::Digests *digests = nullptr) {
+  CompactNames names;
+  CompactOutput sections;
+  GameStore::Digests file_digests;
+  for (const std::string &full_name : file.get_sections()) {
+    std::string name;
+    int number = 0;
+    bool has_number = false;
+    split_section_name(full_name, &name, &number, &has_number);
+
+    CompactOutput section;
+    section.put_varint(names.get_id(name));
+    section.put_varint(has_number ? static_cast<uint64_t>(number) + 1 : 0);
+    std::list<std::string> value_names = file.get_values(full_name);
+    section.put_varint(value_names.size());
+    uint64_t digest = 0xcbf29ce484222325ull;
+    for (std::string value_name : value_names) {
+      std::string text = ConfigFile::trim(file.value(full_name, value_name,
+                                                     ""));
+      std::transform(value_name.begin(), value_name.end(), value_name.begin(),
+                     ::tolower);
+      std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+      digest = digest_add(digest_add(digest, value_name), text);
+
+      std::vector<std::string> items = split_items(text);
+      section.put_varint(names.get_id(value_name));
+      section.put_varint(items.size());
+      for (const std::string &item : items) {
+        put_compact_item(&section, item);
+      }
+    }
+    file_digests[full_name] = digest;
+
+    if (base != nullptr) {
+      auto it = base->digests->find(full_name);
+      if (it != base->digests->end() && it->second == digest) {
+        continue;
+      }
+    }
+    sections.put_chunk("SECT", section);
+  }
+
+  CompactOutput out;
+  out.put_bytes(std::string(compact_magic, sizeof(compact_magic)));
+  out.put_uint32(compact_version);
+  out.put_chunk("NAME", names.get_chunk());
+  if (base != nullptr) {
+    CompactOutput base_chunk;
+    base_chunk.put_bytes(base->name);
+    out.put_chunk("BASE", base_chunk);
+    CompactOutput gone;
+    for (const auto &base_digest : *base->digests) {
+      if (file_digests.find(base_digest.first) == file_digests.end()) {
+        gone.put_varint(base_digest.first.size());
+        gone.put_bytes(base_digest.first);
+      }
+    }
+    out.put_chunk("GONE", gone);
+  }
+
+  if (digests != nullptr) {
+    *digests = std::move(file_digests);
+  }
+  return out.write(os) && sections.write(os);
+}
+
+// The bytes of a save game file, mapped, or unpacked when it was packed.
+//  A packed file is read a block at a time, so only what it unpacks to has
+//  to be in memory whole.
+class SaveFileData {
+ protected:
+  std::unique_ptr<MappedBuffer> file;
+  std::string unpacked;
+  const char *data;
+  size_t size;
+
+ public:
+  explicit SaveFileData(const std::string &path) {
+    std::ifstream is(path, std::ios::binary);
+    char head[sizeof(LZStream::magic)];
+    if (is.read(head, sizeof(head)) &&
+        LZStream::is_packed(head, sizeof(head))) {
+      is.seekg(0);
+      LZInBuf buf(&is);
+      std::vector<char> block(LZStream::block_size);
+      std::streamsize count;
+      while ((count = buf.sgetn(block.data(), block.size())) > 0) {
+        unpacked.append(block.data(), count);
+      }
+      data = unpacked.data();
+      size = unpacked.size();
+      return;
+    }
+    file.reset(new MappedBuffer(path));
+    data = reinterpret_cast<char*>(file->get_data());
+    size = file->get_size();
+  }
+
+  const char *get_data() const { return data; }
+  size_t get_size() const { return size; }
+};
+
+// Read into sections, after the save a delta is made against.  The bases
+//  of a delta are looked for in folder.
+static void
+read_compact(const char *data, size_t data_size, const std::string &folder,
+             ParsedSections *sections, unsigned int bases = 0) {
+  CompactInput in(data, data_size);
+  in.get_bytes(sizeof(compact_magic));
+  uint32_t version = in.get_uint32();
+  if (version > compact_version) {
+    std::ostringstream str;
+    str << "Unknown compact save game version " << version;
+    throw ExceptionFreeserf(str.str());
+  }
+
+  std::vector<std::string> names;
+  while (in.has_data_left()) {
+    std::string tag = in.get_string(4);
+    uint32_t size = in.get_uint32();
+    CompactInput chunk(in.get_bytes(size), size);
+    if (tag == "NAME") {
+      while (chunk.has_data_left()) {
+        names.push_back(chunk.get_string(chunk.get_varint()));
+      }
+    } else if (tag == "BASE") {
+      std::string base = chunk.get_string(size);
+      if (bases >= compact_max_bases) {
+        throw ExceptionFreeserf("Too many deltas in compact save game.");
+      }
+      std::string path = folder.empty() ? base : folder + "/" + base;
+      SaveFileData base_data(path);
+      if (!is_compact(base_data.get_data(), base_data.get_size())) {
+        throw ExceptionFreeserf("The base of save game is not compact: " +
+                                path);
+      }
+      read_compact(base_data.get_data(), base_data.get_size(), folder,
+                   sections, bases + 1);
+    } else if (tag == "GONE") {
+      while (chunk.has_data_left()) {
+        sections->erase(chunk.get_string(chunk.get_varint()));
+      }
+    } else if (tag == "SECT") {
+      auto get_name = [&names](uint64_t id) -> const std::string& {
+        if (id >= names.size()) {
+          throw ExceptionFreeserf("Unknown name in compact save game.");
+        }
+        return names[id];
+      };
+      ParsedSection section;
+      section.name = get_name(chunk.get_varint());
+      uint64_t number = chunk.get_varint();
+      section.number = static_cast<int>(number == 0 ? 0 : number - 1);
+      section.has_number = (number != 0);
+      for (uint64_t count = chunk.get_varint(); count > 0; count--) {
+        const std::string &value_name = get_name(chunk.get_varint());
+        uint64_t items = chunk.get_varint();
+        section.values.emplace(value_name, get_compact_value(&chunk, items));
+      }
+      std::string full_name = section.name;
+      if (section.has_number) {
+        full_name += " " + std::to_string(section.number);
+      }
+      (*sections)[full_name] = std::move(section);
+    }
+  }
+}
+
+class SaveReaderParsedFile : public SaveReaderTextFile {
+ public:
+  explicit SaveReaderParsedFile(ParsedSections *parsed) {
+    add_sections(parsed);
+  }
+};
+
+class SaveReaderCompactFile : public SaveReaderTextFile {
+ public:
+  SaveReaderCompactFile(const char *data, size_t size,
+                        const std::string &folder) {
+    ParsedSections parsed;
+    read_compact(data, size, folder, &parsed);
+    add_sections(&parsed);
   }
 };
 
@@ -325,7 +1130,9 @@ SaveReaderBinary::read(size_t size) {
 }
 
 SaveReaderTextValue::SaveReaderTextValue(const std::string &_value)
-  : value(_value) {
+  : kind(KindText)
+  , value(_value)
+  , number(0) {
   if (value.find(',') != std::string::npos) {
     std::istringstream iss(value);
     std::string item;
@@ -335,33 +1142,93 @@ SaveReaderTextValue::SaveReaderTextValue(const std::string &_value)
   }
 }
 
-const SaveReaderTextValue&
-SaveReaderTextValue::operator >> (int &val) const {
-  int result = atoi(value.c_str());
-  val = result;
-
-  return *this;
+SaveReaderTextValue::SaveReaderTextValue(int64_t _number)
+  : kind(KindNumber)
+  , number(_number) {
 }
 
-const SaveReaderTextValue&
-SaveReaderTextValue::operator >> (unsigned int &val) const {
-  int result = atoi(value.c_str());
-  val = result;
-
-  return *this;
+SaveReaderTextValue::SaveReaderTextValue(std::vector<int64_t> &&_numbers)
+  : kind(KindNumbers)
+  , number(0)
+  , numbers(std::move(_numbers)) {
 }
 
-const SaveReaderTextValue&
-SaveReaderTextValue::operator >> (Direction &val) const {
-  int result = atoi(value.c_str());
-  val = (Direction)result;
+SaveReaderTextValue::SaveReaderTextValue(
+                                   std::vector<SaveReaderTextValue> &&_parts)
+  : kind(KindList)
+  , number(0)
+  , parts(std::move(_parts)) {
+}
 
-  return *this;
+// as atoi() would read the text, which stops at the first comma
+int
+SaveReaderTextValue::get_int() const {
+  switch (kind) {
+    case KindNumber:
+      return static_cast<int>(number);
+    case KindNumbers:
+      return numbers.empty() ? 0 : static_cast<int>(numbers[0]);
+    case KindList:
+      return parts.empty() ? 0 : parts[0].get_int();
+    default:
+      return atoi(value.c_str());
+  }
 }
 
-const SaveReaderTextValue&
+std::string
+SaveReaderTextValue::get_text() const {
+  switch (kind) {
+    case KindNumber:
+      return std::to_string(number);
+    case KindNumbers: {
+      std::string text;
+      for (size_t i = 0; i < numbers.size(); i++) {
+        text += (i == 0 ? "" : ",") + std::to_string(numbers[i]);
+      }
+      return text;
+    }
+    case KindList: {
+      std::string text;
+      for (const SaveReaderTextValue &part : parts) {
+        if (&part != &parts[0]) {
+          text += ",";
+        }
+        text += part.get_text();
+      }
+      return text;
+    }
+    default:
+      return value;
+  }
+}
+
+const SaveReaderTextValue&
+SaveReaderTextValue::operator >> (int &val) const {
+  int result = get_int();
+  val = result;
+
+  return *this;
+}
+
+const SaveReaderTextValue&
+SaveReaderTextValue::operator >> (unsigned int &val) const {
+  int result = get_int();
+  val = result;
+
+  return *this;
+}
+
+const SaveReaderTextValue&
+SaveReaderTextValue::operator >> (Direction &val) const {
+  int result = get_int();
+  val = (Direction)result;
+
+  return *this;
+}
+
+const SaveReaderTextValue&
 SaveReaderTextValue::operator >> (Resource::Type &val) const {
-  int result = atoi(value.c_str());
+  int result = get_int();
   val = (Resource::Type)result;
 
   return *this;
@@ -369,7 +1236,7 @@ SaveReaderTextValue::operator >> (Resource::Type &val) const {
 
 const SaveReaderTextValue&
 SaveReaderTextValue::operator >> (Building::Type &val) const {
-  int result = atoi(value.c_str());
+  int result = get_int();
   val = (Building::Type)result;
 
   return *this;
@@ -377,7 +1244,7 @@ SaveReaderTextValue::operator >> (Building::Type &val) const {
 
 const SaveReaderTextValue&
 SaveReaderTextValue::operator >> (Serf::State &val) const {
-  int result = atoi(value.c_str());
+  int result = get_int();
   val = (Serf::State)result;
 
   return *this;
@@ -385,7 +1252,7 @@ SaveReaderTextValue::operator >> (Serf::State &val) const {
 
 const SaveReaderTextValue&
 SaveReaderTextValue::operator >> (uint16_t &val) const {
-  int result = atoi(value.c_str());
+  int result = get_int();
   val = (uint16_t)result;
 
   return *this;
@@ -393,12 +1260,31 @@ SaveReaderTextValue::operator >> (uint16_t &val) const {
 
 const SaveReaderTextValue&
 SaveReaderTextValue::operator >> (std::string &val) const {
-  val = value;
+  val = get_text();
   return *this;
 }
 
 const SaveReaderTextValue&
+SaveReaderTextValue::operator >> (std::vector<unsigned int> &val) const {
+  val.clear();
+  if (kind == KindNumbers) {
+    val.assign(numbers.begin(), numbers.end());
+  } else if (!parts.empty()) {
+    for (const SaveReaderTextValue &part : parts) {
+      val.push_back(part.get_int());
+    }
+  } else if (kind == KindNumber || !value.empty()) {
+    val.push_back(get_int());
+  }
+
+  return *this;
+}
+
+SaveReaderTextValue
 SaveReaderTextValue::operator[] (size_t pos) const {
+  if (kind == KindNumbers && pos < numbers.size()) {
+    return SaveReaderTextValue(numbers[pos]);
+  }
   if (pos >= parts.size()) {
     throw ExceptionFreeserf("Failed to read value");
   }
@@ -406,55 +1292,35 @@ SaveReaderTextValue::operator[] (size_t pos) const {
   return parts[pos];
 }
 
-SaveWriterTextValue&
-SaveWriterTextValue::operator << (int val) {
+void
+SaveWriterTextValue::append(uint64_t val, bool negative) {
   if (!value.empty()) {
     value += ",";
   }
+  append_number(&value, val, negative);
+}
 
-  std::ostringstream ss;
-  ss << val;
-  value += ss.str();
-
+SaveWriterTextValue&
+SaveWriterTextValue::operator << (int val) {
+  append((val < 0) ? 0 - static_cast<uint64_t>(val) : val, val < 0);
   return *this;
 }
 
 SaveWriterTextValue&
 SaveWriterTextValue::operator << (unsigned int val) {
-  if (!value.empty()) {
-    value += ",";
-  }
-
-  std::ostringstream ss;
-  ss << val;
-  value += ss.str();
-
+  append(val);
   return *this;
 }
 
 SaveWriterTextValue&
 SaveWriterTextValue::operator << (Direction val) {
-  if (!value.empty()) {
-    value += ",";
-  }
-
-  std::ostringstream ss;
-  ss << static_cast<int>(val);
-  value += ss.str();
-
+  *this << static_cast<int>(val);
   return *this;
 }
 
 SaveWriterTextValue&
 SaveWriterTextValue::operator << (Resource::Type val) {
-  if (!value.empty()) {
-    value += ",";
-  }
-
-  std::ostringstream ss;
-  ss << static_cast<int>(val);
-  value += ss.str();
-
+  *this << static_cast<int>(val);
   return *this;
 }
 
@@ -473,6 +1339,9 @@ SaveWriterTextValue::operator << (const std::string &val) {
 
 GameStore::GameStore() {
   folder_path = ".";
+  compressed = false;
+  index_loaded = false;
+  index_changed = false;
 
 #ifdef _WIN32
   PWSTR saved_games_path;
@@ -513,6 +1382,10 @@ GameStore::GameStore() {
 }
 
 GameStore::~GameStore() {
+  std::lock_guard<std::mutex> lock(index_mutex);
+  if (index_changed) {
+    save_index();
+  }
 }
 
 GameStore &
@@ -549,6 +1422,16 @@ GameStore::get_saved_games() {
   return saved_games;
 }
 
+std::vector<GameStore::SaveInfo>
+GameStore::get_saved_games(size_t first, size_t count) const {
+  if (first >= saved_games.size()) {
+    return std::vector<SaveInfo>();
+  }
+  size_t last = first + std::min(count, saved_games.size() - first);
+  return std::vector<SaveInfo>(saved_games.begin() + first,
+                               saved_games.begin() + last);
+}
+
 std::string
 GameStore::name_from_file(const std::string &file_name) {
   size_t pos = file_name.find_last_of('.');
@@ -562,55 +1445,7 @@ GameStore::name_from_file(const std::string &file_name) {
 void
 GameStore::update() {
   find_legacy();
-#ifdef _WIN32
-  std::string find_mask = folder_path + "\\*.save";
-  WIN32_FIND_DATAA ffd;
-  HANDLE hFind = FindFirstFileA(find_mask.c_str(), &ffd);
-  if (hFind != INVALID_HANDLE_VALUE) {
-    do {
-      if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
-        SaveInfo info;
-        info.name = name_from_file(ffd.cFileName);
-        info.path = folder_path + "\\" + ffd.cFileName;
-        info.type = SaveInfo::Regular;
-        saved_games.push_back(info);
-      }
-    } while (FindNextFileA(hFind, &ffd) != FALSE);
-  }
-
-  FindClose(hFind);
-#else
-  DIR *dir = opendir(folder_path.c_str());
-  if (dir == nullptr) {
-    return;
-  }
-
-  struct dirent *ent = nullptr;
-  while ((ent = readdir(dir)) != nullptr) {
-    std::string file_name(ent->d_name);
-    size_t pos = file_name.find_last_of(".");
-    if (pos == std::string::npos) {
-      continue;
-    }
-    std::string ext = file_name.substr(pos+1, file_name.size());
-    if (ext != "save") {
-      continue;
-    }
-    std::string file_path = folder_path + "/" + file_name;
-    struct stat info;
-    if (stat(file_path.c_str(), &info) == 0) {
-      if ((info.st_mode & S_IFDIR) != S_IFDIR) {
-        SaveInfo info;
-        info.name = name_from_file(file_name);
-        info.path = file_path;
-        info.type = SaveInfo::Regular;
-        saved_games.push_back(info);
-      }
-    }
-  }
-
-  closedir(dir);
-#endif  // _WIN32
+  find_regular();
 }
 
 bool
@@ -715,31 +1550,295 @@ GameStore::find_legacy() {
 #endif  // _WIN32
 }
 
+static const char index_file_name[] = "saves.index";
+static const char index_header[] = "freeserf save index 1";
+
+static std::string
+path_in_folder(const std::string &folder, const std::string &file_name) {
+#ifdef _WIN32
+  return folder + "\\" + file_name;
+#else
+  return folder + "/" + file_name;
+#endif  // _WIN32
+}
+
+static bool
+stat_save_file(const std::string &path, GameStore::SaveInfo *info) {
+  struct stat file_info;
+  if (stat(path.c_str(), &file_info) != 0 ||
+      (file_info.st_mode & S_IFDIR) == S_IFDIR) {
+    return false;
+  }
+  info->mtime = static_cast<int64_t>(file_info.st_mtime);
+  info->size = static_cast<int64_t>(file_info.st_size);
+  return true;
+}
+
+// The tick and the number of players of a save game, read from the file.
+static void
+read_save_summary(const std::string &path, GameStore::SaveInfo *info) {
+  ParsedSections sections;
+  try {
+    SaveFileData data(path);
+    if (is_compact(data.get_data(), data.get_size())) {
+      size_t slash = path.find_last_of("/\\");
+      read_compact(data.get_data(), data.get_size(),
+                   (slash == std::string::npos) ? std::string()
+                                                : path.substr(0, slash),
+                   &sections);
+    } else if (!read_text(data.get_data(), data.get_size(), &sections)) {
+      return;
+    }
+  } catch (ExceptionFreeserf& e) {
+    Log::Warn["savegame"] << "Unable to read save game '" << path << "': "
+                          << e.what();
+    return;
+  }
+  for (const auto &section : sections) {
+    if (section.second.name == "game") {
+      Values::const_iterator tick = section.second.values.find("tick");
+      if (tick != section.second.values.end()) {
+        tick->second >> info->tick;
+      }
+    } else if (section.second.name == "player") {
+      info->players++;
+    }
+  }
+}
+
 void
 GameStore::find_regular() {
+  std::vector<std::string> file_names;
+#ifdef _WIN32
+  std::string find_mask = folder_path + "\\*.save";
+  WIN32_FIND_DATAA ffd;
+  HANDLE hFind = FindFirstFileA(find_mask.c_str(), &ffd);
+  if (hFind != INVALID_HANDLE_VALUE) {
+    do {
+      if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+        file_names.push_back(ffd.cFileName);
+      }
+    } while (FindNextFileA(hFind, &ffd) != FALSE);
+  }
+
+  FindClose(hFind);
+#else
+  DIR *dir = opendir(folder_path.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+
+  struct dirent *ent = nullptr;
+  while ((ent = readdir(dir)) != nullptr) {
+    std::string file_name(ent->d_name);
+    size_t pos = file_name.find_last_of(".");
+    if (pos == std::string::npos) {
+      continue;
+    }
+    std::string ext = file_name.substr(pos+1, file_name.size());
+    if (ext != "save") {
+      continue;
+    }
+    file_names.push_back(file_name);
+  }
+
+  closedir(dir);
+#endif  // _WIN32
+
+  std::lock_guard<std::mutex> lock(index_mutex);
+  load_index();
+  std::map<std::string, SaveInfo> found;
+  for (const std::string &file_name : file_names) {
+    SaveInfo info;
+    info.name = name_from_file(file_name);
+    info.path = path_in_folder(folder_path, file_name);
+    info.type = SaveInfo::Regular;
+    if (!stat_save_file(info.path, &info)) {
+      continue;
+    }
+    auto known = index.find(file_name);
+    if (known != index.end() && known->second.mtime == info.mtime &&
+        known->second.size == info.size) {
+      info.tick = known->second.tick;
+      info.players = known->second.players;
+    } else {
+      read_save_summary(info.path, &info);
+      index_changed = true;
+    }
+    found[file_name] = info;
+  }
+  if (found.size() != index.size()) {
+    index_changed = true;
+  }
+  index = std::move(found);
+
+  size_t regular = saved_games.size();
+  for (const auto &entry : index) {
+    saved_games.push_back(entry.second);
+  }
+  std::sort(saved_games.begin() + regular, saved_games.end(),
+            [](const SaveInfo &a, const SaveInfo &b) {
+              return (a.mtime != b.mtime) ? (a.mtime > b.mtime)
+                                          : (a.name < b.name); });
+
+  if (index_changed) {
+    save_index();
+  }
 }
 
+// Read the index the folder had, once; what was already put in the index
+//  since is newer and stays.
+void
+GameStore::load_index() {
+  if (index_loaded) {
+    return;
+  }
+  index_loaded = true;
+
+  std::ifstream is(path_in_folder(folder_path, index_file_name));
+  std::string line;
+  if (!std::getline(is, line) || line != index_header) {
+    return;
+  }
+  while (std::getline(is, line)) {
+    std::istringstream fields(line);
+    std::string file_name;
+    SaveInfo info;
+    if (!std::getline(fields, file_name, '\t') ||
+        !(fields >> info.mtime >> info.size >> info.tick >> info.players)) {
+      continue;
+    }
+    info.name = name_from_file(file_name);
+    info.path = path_in_folder(folder_path, file_name);
+    info.type = SaveInfo::Regular;
+    index.emplace(file_name, info);
+  }
+}
+
+// Written beside and then moved over the old one, so a reader never sees
+//  half of it.
 bool
-GameStore::load(const std::string &path, Game *game) {
-  std::ifstream file;
-  file.open(path.c_str());
+GameStore::save_index() {
+  std::string path = path_in_folder(folder_path, index_file_name);
+  std::string temp_path = path + ".new";
+  {
+    std::ofstream os(temp_path, std::ios::trunc);
+    if (!os.is_open()) {
+      return false;
+    }
+    os << index_header << "\n";
+    for (const auto &entry : index) {
+      if (entry.first.find_first_of("\t\n") != std::string::npos) {
+        continue;
+      }
+      const SaveInfo &info = entry.second;
+      os << entry.first << "\t" << info.mtime << "\t" << info.size << "\t"
+         << info.tick << "\t" << info.players << "\n";
+    }
+    if (!os.good()) {
+      return false;
+    }
+  }
+  std::remove(path.c_str());
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    return false;
+  }
+  index_changed = false;
+  return true;
+}
 
-  if (!file.is_open()) {
-    Log::Error["savegame"] << "Unable to open save game file: '" << path << "'";
+// A save written into the folder goes into the index as it is, so listing
+//  the folder doesn't read it back.  It is written out with the next list.
+void
+GameStore::index_saved(const std::string &path, PSaveWriter writer) {
+  index_saved(path, static_cast<unsigned int>(
+                std::strtoul(writer->get_value("tick").c_str(), nullptr, 10)),
+              writer->count_sections("player"));
+}
+
+void
+GameStore::index_saved(const std::string &path, unsigned int tick,
+                       unsigned int players) {
+  size_t slash = path.find_last_of("/\\");
+  std::string folder = (slash == std::string::npos) ? std::string(".")
+                                                    : path.substr(0, slash);
+  if (folder != folder_path) {
+    return;
+  }
+  std::string file_name = path.substr(slash + 1);
+  SaveInfo info;
+  info.name = name_from_file(file_name);
+  info.path = path_in_folder(folder_path, file_name);
+  info.type = SaveInfo::Regular;
+  if (!stat_save_file(path, &info)) {
+    return;
+  }
+  info.tick = tick;
+  info.players = players;
+
+  std::lock_guard<std::mutex> lock(index_mutex);
+  index[file_name] = info;
+  index_changed = true;
+}
+
+// All of the stream, unpacked if it was packed.
+static std::string
+read_all(std::istream *is) {
+  std::string data((std::istreambuf_iterator<char>(*is)),
+                   std::istreambuf_iterator<char>());
+  if (LZStream::is_packed(data.data(), data.size())) {
+    return LZStream::unpack(data.data(), data.size());
+  }
+  return data;
+}
+
+// Write to os, through the packer when compressed.
+static bool
+write_file(std::ostream *os, bool compressed,
+           std::function<bool(std::ostream*)> write) {
+  if (!compressed) {
+    return write(os);
+  }
+  LZOutBuf buf(os);
+  std::ostream packed(&buf);
+  bool written = write(&packed);
+  return buf.finish() && written;
+}
+
+bool
+GameStore::load(const std::string &path, Game *game) {
+  std::unique_ptr<SaveFileData> file;
+  try {
+    file.reset(new SaveFileData(path));
+  } catch (ExceptionFreeserf& e) {
+    Log::Error["savegame"] << "Unable to open save game file: '" << path
+                           << "': " << e.what();
     return false;
   }
+  const char *data = file->get_data();
+  size_t size = file->get_size();
+
+  if (is_compact(data, size)) {
+    size_t slash = path.find_last_of("/\\");
+    std::string folder = (slash == std::string::npos) ? std::string()
+                                                      : path.substr(0, slash);
+    try {
+      SaveReaderCompactFile reader_compact(data, size, folder);
+      reader_compact >> *game;
+    } catch (ExceptionFreeserf& e) {
+      Log::Error["savegame"] << "Failed to load save game: " << e.what();
+      return false;
+    }
+    return true;
+  }
 
   try {
-    SaveReaderTextFile reader_text(&file);
+    SaveReaderTextFile reader_text(data, size);
     reader_text >> *game;
   } catch (ExceptionFreeserf& e) {
-    file.close();
     Log::Warn["savegame"] << "Unable to load save game: " << e.what();
     Log::Warn["savegame"] << "Trying compatability mode...";
-    std::ifstream input(path.c_str(), std::ios::binary);
-    std::vector<char> buffer((std::istreambuf_iterator<char>(input)),
-                             (std::istreambuf_iterator<char>()));
-    SaveReaderBinary reader(&buffer[0], buffer.size());
+    SaveReaderBinary reader(const_cast<char*>(data), size);
     try {
       reader >> *game;
     } catch (ExceptionFreeserf& e) {
@@ -771,7 +1870,7 @@ GameStore::quick_save(const std::string &prefix, Game *game) {
   std::string path = save_game.get_folder_path();
   path += "/" + prefix + "-" + name + ".save";
 
-  return save(path, game);
+  return save(path, game, FormatCompact);
 }
 
 // In target, replace any character from needle with replacement character.
@@ -793,23 +1892,122 @@ strreplace(const std::string &src, const std::string &needle, char replace) {
 }
 
 bool
-GameStore::save(const std::string &path, Game *game) {
+GameStore::save(const std::string &path, Game *game, Format format) {
+  if (format != FormatText) {
+    return save(path, take_snapshot(game), format);
+  }
+
+  // text is written as the game is gone through, without a snapshot
+  std::string file_path = strreplace(path, "*?\"<>|", '_');
+  unsigned int tick = 0;
+  unsigned int players = 0;
+  bool saved = false;
+  {
+    std::ofstream out(file_path, compressed ? std::ios::binary | std::ios::trunc
+                                            : std::ios::trunc);
+    if (!out.is_open()) {
+      Log::Error["savegame"] << "Unable to open save game file: '" << path
+                             << "'";
+      return false;
+    }
+    saved = write_file(&out, compressed, [&](std::ostream *os) {
+      return write_text(os, game, &tick, &players); });
+  }
+  if (saved) {
+    index_saved(file_path, tick, players);
+  }
+  return saved;
+}
+
+PSaveWriter
+GameStore::take_snapshot(Game *game) {
+  PSaveWriter writer = std::make_shared<SaveWriterTextSection>("game", 0);
+  *writer << *game;
+  return writer;
+}
+
+bool
+GameStore::save(const std::string &path, PSaveWriter writer, Format format) {
   /* Substitute problematic characters. These are problematic
    particularly on windows platforms, but also in general on FAT
    filesystems through any platform. */
   /* TODO Possibly use PathCleanupSpec() when building for windows platform. */
   std::string file_path = strreplace(path, "*?\"<>|", '_');
 
-  SaveWriterTextSection writer("game", 0);
-  writer << *game;
-  return writer.save(file_path);
+  bool saved = false;
+  if (format == FormatText && !compressed) {
+    saved = writer->save(file_path);
+  } else {
+    std::ofstream out(file_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      Log::Error["savegame"] << "Unable to open save game file: '" << path
+                             << "'";
+      return false;
+    }
+    if (format == FormatText) {
+      saved = write_file(&out, compressed, [&writer](std::ostream *os) {
+        return writer->write(os); });
+    } else {
+      ConfigFile file;
+      writer->save(&file);
+      saved = write_file(&out, compressed, [&file](std::ostream *os) {
+        return write_compact(file, os); });
+    }
+  }
+  if (saved) {
+    index_saved(file_path, writer);
+  }
+  return saved;
+}
+
+bool
+GameStore::save_delta(const std::string &path, PSaveWriter writer,
+                      const std::string &base_path,
+                      const Digests &base_digests, Digests *digests) {
+  std::string file_path = strreplace(path, "*?\"<>|", '_');
+
+  ConfigFile file;
+  writer->save(&file);
+  bool saved = false;
+  {
+    std::ofstream out(file_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      Log::Error["savegame"] << "Unable to open save game file: '" << path
+                             << "'";
+      return false;
+    }
+    if (base_path.empty()) {
+      saved = write_file(&out, compressed, [&](std::ostream *os) {
+        return write_compact(file, os, nullptr, digests); });
+    } else {
+      std::string base_name = strreplace(base_path, "*?\"<>|", '_');
+      size_t slash = base_name.find_last_of("/\\");
+      if (slash != std::string::npos) {
+        base_name = base_name.substr(slash + 1);
+      }
+      CompactBase base = { base_name, &base_digests };
+      saved = write_file(&out, compressed, [&](std::ostream *os) {
+        return write_compact(file, os, &base, digests); });
+    }
+  }
+  if (saved) {
+    index_saved(file_path, writer);
+  }
+  return saved;
 }
 
 bool
 GameStore::read(std::istream *is, Game *game) {
   try {
-    SaveReaderTextFile reader_text(is);
-    reader_text >> *game;
+    std::string data = read_all(is);
+    if (is_compact(data.data(), data.size())) {
+      SaveReaderCompactFile reader_compact(data.data(), data.size(),
+                                           std::string());
+      reader_compact >> *game;
+    } else {
+      SaveReaderTextFile reader_text(data.data(), data.size());
+      reader_text >> *game;
+    }
   } catch (...) {
     return false;
   }
@@ -817,9 +2015,347 @@ GameStore::read(std::istream *is, Game *game) {
 }
 
 bool
-GameStore::write(std::ostream *os, Game *game) {
+GameStore::write(std::ostream *os, Game *game, Format format) {
+  if (format == FormatText) {
+    return write_text(os, game);
+  }
+
   SaveWriterTextSection writer("game", 0);
   writer << *game;
+  ConfigFile file;
+  writer.save(&file);
+  return write_compact(file, os);
+}
+
+bool
+GameStore::write_text(std::ostream *os, Game *game, unsigned int *tick,
+                      unsigned int *players) {
+  // the buffer of the last save, unless another thread is writing into it
+  std::unique_lock<std::mutex> lock(text_mutex, std::try_to_lock);
+  std::string own_text;
+  SaveWriterTextStream writer("game", 0,
+                              lock.owns_lock() ? &text_buffer : &own_text);
+  writer << *game;
+  if (tick != nullptr) {
+    *tick = game->get_tick();
+  }
+  if (players != nullptr) {
+    *players = writer.count_sections("player");
+  }
   return writer.write(os);
 }
 
+bool
+GameStore::convert(std::istream *is, std::ostream *os, Format format) {
+  ConfigFile file;
+  try {
+    std::string data = read_all(is);
+    ParsedSections sections;
+    if (is_compact(data.data(), data.size())) {
+      read_compact(data.data(), data.size(), std::string(), &sections);
+    } else if (!read_text(data.data(), data.size(), &sections)) {
+      return false;
+    }
+    for (const auto &section : sections) {
+      file.add_section(section.first);
+      for (const auto &value : section.second.values) {
+        std::string text;
+        value.second >> text;
+        file.set_value(section.first, value.first, text);
+      }
+    }
+  } catch (ExceptionFreeserf& e) {
+    Log::Error["savegame"] << "Failed to convert save game: " << e.what();
+    return false;
+  }
+
+  if (format == FormatText) {
+    return file.write(os);
+  }
+  return write_compact(file, os);
+}
+
+
+// The stream starts with the magic and version, then each frame is a "FRAM"
+//  chunk.  In a frame the "NAME" chunk holds the names first used in it,
+//  each "DIFF" chunk a section that is new or changed: its name and number,
+//  then the values that changed, each either all of its items, only the
+//  items that changed with the count of items skipped before each, or gone.
+//  The "GONE" chunk holds the sections that are no longer there.
+static const char spectator_magic[] = { 'F', 'S', 'E', 'R', 'F', 'S', 'P',
+                                        'C' };
+static const uint32_t spectator_version = 1;
+
+typedef enum SpectatorChange {
+  SpectatorChangeAll = 0,
+  SpectatorChangeItems,
+  SpectatorChangeGone,
+} SpectatorChange;
+
+SpectatorWriter::SpectatorWriter(std::ostream *_os)
+  : os(_os)
+  , started(false) {
+}
+
+bool
+SpectatorWriter::write_frame(Game *game, size_t *size) {
+  game->get_mutex()->lock(LOCK_SITE());
+  // saving wakes the sleeping serfs, so nobody else may look meanwhile
+  PSaveWriter writer = GameStore::get_instance().take_snapshot(game);
+  game->get_mutex()->unlock();
+  ConfigFile file;
+  writer->save(&file);
+
+  CompactOutput new_names;
+  auto get_id = [this, &new_names](const std::string &name) {
+    auto it = name_ids.find(name);
+    if (it != name_ids.end()) {
+      return it->second;
+    }
+    uint64_t id = name_ids.size();
+    name_ids[name] = id;
+    new_names.put_varint(name.size());
+    new_names.put_bytes(name);
+    return id;
+  };
+
+  CompactOutput diffs;
+  Sections next;
+  for (const std::string &full_name : file.get_sections()) {
+    Values &values = next[full_name];
+    for (std::string value_name : file.get_values(full_name)) {
+      std::string text = ConfigFile::trim(file.value(full_name, value_name,
+                                                     ""));
+      std::transform(value_name.begin(), value_name.end(), value_name.begin(),
+                     ::tolower);
+      std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+      values[value_name] = split_items(text);
+    }
+
+    auto last = sections.find(full_name);
+    static const Values no_values;
+    const Values &last_values = (last == sections.end()) ? no_values
+                                                         : last->second;
+    CompactOutput changes;
+    uint64_t change_count = 0;
+    for (const auto &value : values) {
+      auto last_value = last_values.find(value.first);
+      const std::vector<std::string> &items = value.second;
+      std::vector<size_t> changed;
+      if (last_value != last_values.end()) {
+        if (last_value->second == items) {
+          continue;
+        }
+        if (last_value->second.size() == items.size()) {
+          for (size_t i = 0; i < items.size(); i++) {
+            if (items[i] != last_value->second[i]) {
+              changed.push_back(i);
+            }
+          }
+        }
+      }
+      change_count++;
+      changes.put_varint(get_id(value.first));
+      if (!changed.empty() && changed.size() * 2 <= items.size()) {
+        changes.put_varint(SpectatorChangeItems);
+        changes.put_varint(changed.size());
+        size_t next_item = 0;
+        for (size_t i : changed) {
+          changes.put_varint(i - next_item);
+          put_compact_item(&changes, items[i]);
+          next_item = i + 1;
+        }
+      } else {
+        changes.put_varint(SpectatorChangeAll);
+        changes.put_varint(items.size());
+        for (const std::string &item : items) {
+          put_compact_item(&changes, item);
+        }
+      }
+    }
+    for (const auto &last_value : last_values) {
+      if (values.find(last_value.first) == values.end()) {
+        change_count++;
+        changes.put_varint(get_id(last_value.first));
+        changes.put_varint(SpectatorChangeGone);
+      }
+    }
+    if (change_count == 0 && last != sections.end()) {
+      continue;
+    }
+
+    std::string name;
+    int number = 0;
+    bool has_number = false;
+    split_section_name(full_name, &name, &number, &has_number);
+    CompactOutput diff;
+    diff.put_varint(get_id(name));
+    diff.put_varint(has_number ? static_cast<uint64_t>(number) + 1 : 0);
+    diff.put_varint(change_count);
+    diff.put_bytes(changes.get_data());
+    diffs.put_chunk("DIFF", diff);
+  }
+
+  CompactOutput gone;
+  for (const auto &last : sections) {
+    if (next.find(last.first) == next.end()) {
+      gone.put_varint(last.first.size());
+      gone.put_bytes(last.first);
+    }
+  }
+  sections = std::move(next);
+
+  CompactOutput frame;
+  frame.put_chunk("NAME", new_names);
+  frame.put_bytes(diffs.get_data());
+  frame.put_chunk("GONE", gone);
+  CompactOutput out;
+  if (!started) {
+    out.put_bytes(std::string(spectator_magic, sizeof(spectator_magic)));
+    out.put_uint32(spectator_version);
+    started = true;
+  }
+  out.put_chunk("FRAM", frame);
+  if (size != nullptr) {
+    *size = out.get_data().size();
+  }
+  return out.write(os);
+}
+
+SpectatorReader::SpectatorReader()
+  : started(false) {
+}
+
+bool
+SpectatorReader::read_frame(std::istream *is) {
+  try {
+    if (!started) {
+      char head[sizeof(spectator_magic) + 4];
+      if (!is->read(head, sizeof(head)) ||
+          memcmp(head, spectator_magic, sizeof(spectator_magic)) != 0) {
+        return false;
+      }
+      CompactInput version(head + sizeof(spectator_magic), 4);
+      if (version.get_uint32() > spectator_version) {
+        Log::Error["savegame"] << "Unknown spectator stream version";
+        return false;
+      }
+      started = true;
+    }
+
+    char head[8];
+    if (!is->read(head, sizeof(head)) || memcmp(head, "FRAM", 4) != 0) {
+      return false;
+    }
+    CompactInput size_in(head + 4, 4);
+    std::string data(size_in.get_uint32(), '\0');
+    if (!is->read(&data[0], data.size())) {
+      return false;
+    }
+
+    auto get_name = [this](uint64_t id) -> const std::string& {
+      if (id >= names.size()) {
+        throw ExceptionFreeserf("Unknown name in spectator stream.");
+      }
+      return names[id];
+    };
+    auto get_item = [](CompactInput *in) {
+      uint64_t head = in->get_varint();
+      if (head & 1) {
+        return in->get_string(head >> 1);
+      }
+      uint64_t zigzag = head >> 1;
+      return std::to_string(static_cast<int64_t>(zigzag >> 1) ^
+                            -static_cast<int64_t>(zigzag & 1));
+    };
+
+    CompactInput in(data.data(), data.size());
+    while (in.has_data_left()) {
+      std::string tag = in.get_string(4);
+      uint32_t size = in.get_uint32();
+      CompactInput chunk(in.get_bytes(size), size);
+      if (tag == "NAME") {
+        while (chunk.has_data_left()) {
+          names.push_back(chunk.get_string(chunk.get_varint()));
+        }
+      } else if (tag == "GONE") {
+        while (chunk.has_data_left()) {
+          sections.erase(chunk.get_string(chunk.get_varint()));
+        }
+      } else if (tag == "DIFF") {
+        std::string full_name = get_name(chunk.get_varint());
+        uint64_t number = chunk.get_varint();
+        if (number != 0) {
+          full_name += " " + std::to_string(number - 1);
+        }
+        SpectatorWriter::Values &values = sections[full_name];
+        for (uint64_t count = chunk.get_varint(); count > 0; count--) {
+          const std::string &value_name = get_name(chunk.get_varint());
+          std::vector<std::string> &items = values[value_name];
+          switch (chunk.get_varint()) {
+            case SpectatorChangeAll: {
+              uint64_t item_count = chunk.get_varint();
+              items.clear();
+              items.reserve(std::min<uint64_t>(item_count,
+                                               chunk.get_size_left()));
+              for (uint64_t i = 0; i < item_count; i++) {
+                items.push_back(get_item(&chunk));
+              }
+              break;
+            }
+            case SpectatorChangeItems: {
+              size_t i = 0;
+              for (uint64_t c = chunk.get_varint(); c > 0; c--) {
+                i += chunk.get_varint();
+                if (i >= items.size()) {
+                  throw ExceptionFreeserf("Invalid item in spectator stream.");
+                }
+                items[i++] = get_item(&chunk);
+              }
+              break;
+            }
+            case SpectatorChangeGone:
+              values.erase(value_name);
+              break;
+            default:
+              throw ExceptionFreeserf("Invalid change in spectator stream.");
+          }
+        }
+      }
+    }
+  } catch (ExceptionFreeserf& e) {
+    Log::Error["savegame"] << e.what();
+    return false;
+  }
+  return true;
+}
+
+bool
+SpectatorReader::load(Game *game) const {
+  ParsedSections parsed;
+  for (const auto &section : sections) {
+    ParsedSection &parsed_section = parsed[section.first];
+    split_section_name(section.first, &parsed_section.name,
+                       &parsed_section.number, &parsed_section.has_number);
+    for (const auto &value : section.second) {
+      std::string text;
+      for (const std::string &item : value.second) {
+        if (&item != &value.second.front()) {
+          text += ',';
+        }
+        text += item;
+      }
+      parsed_section.values.emplace(value.first,
+                                    parse_text_value(text.data(),
+                                                     text.data() +
+                                                     text.size()));
+    }
+  }
+  try {
+    SaveReaderParsedFile reader(&parsed);
+    reader >> *game;
+  } catch (...) {
+    return false;
+  }
+  return true;
+}
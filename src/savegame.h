@@ -25,9 +25,11 @@
 #include <iostream>
 #include <string>
 #include <list>
+#include <map>
 #include <vector>
 #include <memory>
 #include <sstream>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
 
 #include "src/map.h"
 #include "src/resource.h"
@@ -59,18 +61,34 @@ class SaveReaderBinary {
 
 class SaveReaderTextValue {
  protected:
+  typedef enum Kind {
+    KindText = 0,
+    KindNumber,   // from a compact save, not turned into text
+    KindNumbers,  // from a compact save, the numbers with commas between
+    KindList,     // from a compact save, the parts with commas between
+  } Kind;
+
+  Kind kind;
   std::string value;
+  int64_t number;
+  std::vector<int64_t> numbers;
   std::vector<SaveReaderTextValue> parts;
 
+  int get_int() const;
+  std::string get_text() const;
+
  public:
   explicit SaveReaderTextValue(const std::string &value);
+  explicit SaveReaderTextValue(int64_t number);
+  explicit SaveReaderTextValue(std::vector<int64_t> &&numbers);
+  explicit SaveReaderTextValue(std::vector<SaveReaderTextValue> &&parts);
 
   const SaveReaderTextValue& operator >> (int &val) const;
   const SaveReaderTextValue& operator >> (unsigned int &val) const;
   template <typename = std::enable_if<
                                     !std::is_same<size_t, unsigned int>::value>>
     const SaveReaderTextValue& operator >> (size_t &val) const {
-      int result = atoi(value.c_str());
+      int result = get_int();
       val = result;
       return *this;
     }
@@ -80,13 +98,18 @@ class SaveReaderTextValue {
   const SaveReaderTextValue& operator >> (Serf::State &val) const;
   const SaveReaderTextValue& operator >> (uint16_t &val) const;
   const SaveReaderTextValue& operator >> (std::string &val) const;
-  const SaveReaderTextValue& operator[] (size_t pos) const;
+  // every part, or the value when there is only one
+  const SaveReaderTextValue& operator >> (std::vector<unsigned int> &val) const;
+  SaveReaderTextValue operator[] (size_t pos) const;
 };
 
 class SaveWriterTextValue {
  protected:
   std::string value;
 
+  // The digits of val after a comma, straight into value.
+  void append(uint64_t val, bool negative = false);
+
  public:
   SaveWriterTextValue() {}
 
@@ -95,13 +118,7 @@ class SaveWriterTextValue {
   template <typename = std::enable_if<
                                     !std::is_same<size_t, unsigned int>::value>>
     SaveWriterTextValue& operator << (size_t val) {
-      if (!value.empty()) {
-        value += ",";
-      }
-      std::ostringstream ss;
-      ss << val;
-      value += ss.str();
-
+      append(val);
       return *this;
     }
 
@@ -111,11 +128,14 @@ class SaveWriterTextValue {
   SaveWriterTextValue& operator << (const std::string &val);
 
   std::string &get_value() { return value; }
+  const std::string &get_value() const { return value; }
 };
 
 class SaveReaderText;
+class SaveWriterTextSection;
 
 typedef std::list<SaveReaderText*> Readers;
+typedef std::shared_ptr<SaveWriterTextSection> PSaveWriter;
 
 class SaveReaderText {
  public:
@@ -135,6 +155,46 @@ class SaveWriterText {
                                       unsigned int number) = 0;
 };
 
+/* A stream of the state of a game for spectators: the whole game once,
+ then for each frame only what changed since the one before.  The state is
+ that of the save game, as in the compact format; a value that kept its
+ length gets only the items that changed. */
+class SpectatorWriter {
+ public:
+  // The items of each value of each section, by the name of the section.
+  typedef std::map<std::string, std::vector<std::string>> Values;
+  typedef std::map<std::string, Values> Sections;
+
+ protected:
+  std::ostream *os;
+  Sections sections;
+  std::map<std::string, uint64_t> name_ids;
+  bool started;
+
+ public:
+  explicit SpectatorWriter(std::ostream *os);
+
+  /* Write what changed in game since the last frame, or all of it the
+   first time. The bytes the frame took are put in size. */
+  bool write_frame(Game *game, size_t *size = nullptr);
+};
+
+class SpectatorReader {
+ protected:
+  SpectatorWriter::Sections sections;
+  std::vector<std::string> names;
+  bool started;
+
+ public:
+  SpectatorReader();
+
+  /* Apply the next frame of the stream, false at its end or when it is
+   not a spectator stream. */
+  bool read_frame(std::istream *is);
+  /* Load the state as of the last frame into a new game. */
+  bool load(Game *game) const;
+};
+
 class GameStore {
  public:
   class SaveInfo {
@@ -146,14 +206,42 @@ class GameStore {
 
     std::string name;
     std::string path;
-    Type type;
+    Type type = Regular;
+    int64_t mtime = 0;          // of the file, in seconds since the epoch
+    int64_t size = 0;
+    unsigned int tick = 0;      // 0 for legacy saves, or when unreadable
+    unsigned int players = 0;
   };
 
+  // Both hold the same sections and values and load the same game.  Text
+  //  can be read and edited, compact is smaller and loads many times faster.
+  typedef enum Format {
+    FormatText,
+    FormatCompact
+  } Format;
+
+  // Hash of the values of each section of a save, by section name.
+  typedef std::map<std::string, uint64_t> Digests;
+
  protected:
   GameStore();
 
   std::string folder_path;
   std::vector<SaveInfo> saved_games;
+  bool compressed;
+
+  // What was last seen of each save game in the folder, by file name.  It
+  //  is kept in the folder between runs, so a file is only read again when
+  //  its time or size changes.
+  std::map<std::string, SaveInfo> index;
+  bool index_loaded;
+  bool index_changed;
+  std::mutex index_mutex;
+
+  // The text of the last save written straight from a game, kept so the
+  //  next one has the room already.
+  std::string text_buffer;
+  std::mutex text_mutex;
 
  public:
   virtual ~GameStore();
@@ -163,16 +251,44 @@ class GameStore {
   std::string get_folder_path() const { return folder_path; }
   bool create_folder(const std::string &path);
   bool is_folder_exists(const std::string &path);
+  /* The legacy save games, then the others newest first. The folder is
+   listed again each time, but only new and changed files are read. */
   const std::vector<SaveInfo> &get_saved_games();
+  /* Part of the list the last get_saved_games made, without listing the
+   folder again. */
+  std::vector<SaveInfo> get_saved_games(size_t first, size_t count) const;
+  size_t get_saved_game_count() const { return saved_games.size(); }
+
+  /* Pack the files save, quick_save and save_delta write from now on,
+   in either format. Loading finds out by itself. */
+  void set_compressed(bool _compressed) { compressed = _compressed; }
+  bool is_compressed() const { return compressed; }
 
   /* Generic save/load function that will try to detect the right
    format on load and save to the best format on write. */
-  bool save(const std::string &path, Game *game);
+  bool save(const std::string &path, Game *game,
+            Format format = FormatText);
   bool load(const std::string &path, Game *game);
   bool quick_save(const std::string &prefix, Game *game);
 
+  /* The values of a game as they are now, which can be saved later and
+   from any thread, while the game goes on. */
+  PSaveWriter take_snapshot(Game *game);
+  bool save(const std::string &path, PSaveWriter writer, Format format);
+  /* Save compact, but only the sections that changed since the save at
+   base_path, which is in the same folder and had base_digests. Loading
+   reads the chain of bases first. With no base_path the whole game is
+   saved. Either way the digests of this save are put in digests. */
+  bool save_delta(const std::string &path, PSaveWriter writer,
+                  const std::string &base_path, const Digests &base_digests,
+                  Digests *digests);
+
   bool read(std::istream *is, Game *game);
-  bool write(std::ostream *os, Game *game);
+  bool write(std::ostream *os, Game *game, Format format = FormatText);
+
+  /* Rewrite a text or compact save game in format, without loading it.
+   Read, like load, takes packed save games too. The bases of a compact delta are looked for in the current folder. */
+  bool convert(std::istream *is, std::ostream *os, Format format);
 
  protected:
   void update();
@@ -181,6 +297,15 @@ class GameStore {
   void find_regular();
   std::string name_from_file(const std::string &file_name);
   bool is_file_exists(const std::string &path);
+  void load_index();
+  bool save_index();
+  /* Write the text format as the game is gone through, into a buffer
+   kept from one save to the next. */
+  bool write_text(std::ostream *os, Game *game, unsigned int *tick = nullptr,
+                  unsigned int *players = nullptr);
+  void index_saved(const std::string &path, PSaveWriter writer);
+  void index_saved(const std::string &path, unsigned int tick,
+                   unsigned int players);
 };
 
 #endif  // SRC_SAVEGAME_H_
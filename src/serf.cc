@@ -26,6 +26,7 @@
 #include <sstream>
 #include <string>
 
+#include "src/flow-field.h"
 #include "src/game.h"
 #include "src/log.h"
 #include "src/debug.h"
@@ -34,20 +35,28 @@
 #include "src/savegame.h"
 
 #define set_state(new_state)  \
+  wake();  \
   Log::Verbose["serf"] << "serf " << index  \
                        << " (" << Serf::get_type_name(get_type()) << "): " \
-                       << "state " << Serf::get_state_name(state) \
+                       << "state " << Serf::get_state_name(get_state()) \
                        << " -> " << Serf::get_state_name((new_state)) \
                        << " (" << __FUNCTION__ << ":" << __LINE__ << ")"; \
+  count_idle_state(new_state);  \
+  watch_wait_state(new_state);  \
+  publish_state(new_state);  \
   state = new_state;
 
 #define set_other_state(other_serf, new_state)  \
+  other_serf->wake();  \
   Log::Verbose["serf"] << "serf " << other_serf->index \
                        << " (" << Serf::get_type_name(other_serf->get_type()) \
                        << "): state " \
-                       << Serf::get_state_name(other_serf->state) \
+                       << Serf::get_state_name(other_serf->get_state()) \
                        << " -> " << Serf::get_state_name((new_state)) \
                        << "(" << __FUNCTION__ << ":" << __LINE__ << ")"; \
+  other_serf->count_idle_state(new_state);  \
+  other_serf->watch_wait_state(new_state);  \
+  other_serf->publish_state(new_state);  \
   other_serf->state = new_state;
 
 
@@ -299,9 +308,182 @@ Serf::Serf(Game *game, unsigned int index) : GameObject(game, index) {
   pos = -1;
   tick = 0;
   deleteme = false;
+  sleeping = false;
+  next_at_pos = nullptr;
+  idle_roster = -1;
+  prev_at_pos = nullptr;
+  indexed_pos = bad_map_pos;
   s = { { 0 } };
 }
 
+void
+Serf::set_pos(MapPos new_pos) {
+  pos = new_pos;
+  game->get_serf_index()->move(this);
+}
+
+void
+SerfIndex::init(const MapGeometry &geom) {
+  heads.assign(geom.tile_count(), nullptr);
+  region_cols = std::max(geom.cols() >> region_shift, 1u);
+  unsigned int region_rows = std::max(geom.rows() >> region_shift, 1u);
+  region_counts.assign(region_cols * region_rows, 0);
+  row_shift = geom.row_shift();
+  col_mask = geom.col_mask();
+  row_mask = geom.row_mask();
+}
+
+void
+SerfIndex::clear() {
+  for (Serf *&head : heads) {
+    for (Serf *serf = head; serf != nullptr;) {
+      Serf *next = serf->next_at_pos;
+      serf->next_at_pos = nullptr;
+      serf->prev_at_pos = nullptr;
+      serf->indexed_pos = bad_map_pos;
+      serf = next;
+    }
+    head = nullptr;
+  }
+  std::fill(region_counts.begin(), region_counts.end(), 0);
+}
+
+void
+SerfIndex::fork(const SerfIndex &that, Game *game) {
+  heads.assign(that.heads.size(), nullptr);
+  region_counts = that.region_counts;
+  region_cols = that.region_cols;
+  row_shift = that.row_shift;
+  col_mask = that.col_mask;
+  row_mask = that.row_mask;
+  for (size_t pos = 0; pos < that.heads.size(); pos++) {
+    Serf *prev = nullptr;
+    for (Serf *from = that.heads[pos]; from != nullptr;
+         from = from->next_at_pos) {
+      Serf *serf = game->get_serf(from->get_index());
+      serf->prev_at_pos = prev;
+      serf->next_at_pos = nullptr;
+      if (prev != nullptr) {
+        prev->next_at_pos = serf;
+      } else {
+        heads[pos] = serf;
+      }
+      prev = serf;
+    }
+  }
+}
+
+void
+SerfIndex::insert(Serf *serf) {
+  MapPos pos = serf->pos;
+  if (pos >= heads.size()) {
+    return;
+  }
+  serf->indexed_pos = pos;
+  serf->prev_at_pos = nullptr;
+  serf->next_at_pos = heads[pos];
+  if (heads[pos] != nullptr) {
+    heads[pos]->prev_at_pos = serf;
+  }
+  heads[pos] = serf;
+  region_counts[get_region(pos)]++;
+}
+
+void
+SerfIndex::remove(Serf *serf) {
+  MapPos pos = serf->indexed_pos;
+  if (pos == bad_map_pos) {
+    return;
+  }
+  if (serf->prev_at_pos != nullptr) {
+    serf->prev_at_pos->next_at_pos = serf->next_at_pos;
+  } else {
+    heads[pos] = serf->next_at_pos;
+  }
+  if (serf->next_at_pos != nullptr) {
+    serf->next_at_pos->prev_at_pos = serf->prev_at_pos;
+  }
+  serf->next_at_pos = nullptr;
+  serf->prev_at_pos = nullptr;
+  serf->indexed_pos = bad_map_pos;
+  region_counts[get_region(pos)]--;
+}
+
+void
+SerfIndex::move(Serf *serf) {
+  if (serf->indexed_pos == serf->pos) {
+    return;
+  }
+  remove(serf);
+  insert(serf);
+}
+
+void
+Serf::set_owner(unsigned int player_num) {
+  bool idle = (state == StateIdleInStock);
+  if (idle) count_idle(-1);
+  unsigned int old_owner = get_owner();
+  owner = player_num;
+  game->owner_changed(this, old_owner);
+  if (idle) count_idle(1);
+}
+
+// Tell the watchdog when a serf starts or stops waiting on a road.
+void
+Serf::watch_wait_state(State new_state) {
+  if (state == new_state) return;
+  if (new_state == StateWaitIdleOnPath) {
+    game->get_watchdog()->serf_waiting(index, game->get_tick());
+  } else if (state == StateWaitIdleOnPath) {
+    game->get_watchdog()->serf_moving(index);
+  }
+}
+
+void
+Serf::publish_state(State new_state) {
+  if (state != new_state) {
+    game->publish_serf_event(this, new_state);
+  }
+}
+
+void
+Serf::count_idle_state(State new_state) {
+  if (state != new_state && (state == StateIdleInStock ||
+                             new_state == StateIdleInStock)) {
+    count_idle((new_state == StateIdleInStock) ? 1 : -1);
+    if (state == StateIdleInStock) leave_idle_roster();
+  }
+}
+
+// Serfs join once s.idle_in_stock is set, after the change of state.
+void
+Serf::join_idle_roster() {
+  leave_idle_roster();
+  Inventory *inventory = game->get_inventory(s.idle_in_stock.inv_index);
+  if (inventory != nullptr) {
+    inventory->add_idle_serf(this);
+    idle_roster = inventory->get_index();
+  }
+}
+
+void
+Serf::leave_idle_roster() {
+  if (idle_roster < 0) return;
+  Inventory *inventory = game->get_inventory(idle_roster);
+  if (inventory != nullptr) {
+    inventory->remove_idle_serf(this);
+  }
+  idle_roster = -1;
+}
+
+void
+Serf::count_idle(int delta) {
+  Player *player = game->get_player(get_owner());
+  if (player != nullptr) {
+    player->count_idle_serf(get_type(), delta);
+  }
+}
+
 /* Change type of serf and update all global tables
    tracking serf types. */
 void
@@ -310,8 +492,16 @@ Serf::set_type(Serf::Type new_type) {
     return;
   }
 
-  Serf::Type old_type = type;
+  wake();
+
+  Serf::Type old_type = get_type();
+  bool idle = (state == StateIdleInStock);
+  bool in_roster = (idle_roster >= 0);
+  if (idle) count_idle(-1);
+  if (in_roster) leave_idle_roster();
   type = new_type;
+  if (idle) count_idle(1);
+  if (in_roster) join_idle_roster();
 
   /* Register this type as transporter */
   if (new_type == TypeTransporterInventory) new_type = TypeTransporter;
@@ -354,10 +544,12 @@ Serf::init_generic(Inventory *inventory) {
   set_type(TypeGeneric);
   set_owner(inventory->get_owner());
   Building *building = game->get_building(inventory->get_building_index());
-  pos = building->get_position();
+  set_pos(building->get_position());
   tick = game->get_tick();
+  count_idle_state(StateIdleInStock);
   state = StateIdleInStock;
   s.idle_in_stock.inv_index = inventory->get_index();
+  join_idle_roster();
 }
 
 void
@@ -570,6 +762,7 @@ Serf::building_deleted(MapPos building_pos, bool escape) {
       (state == StateIdleInStock || state == StateReadyToLeaveInventory)) {
     if (escape) {
       /* Serf is escaping. */
+      count_idle_state(StateEscapeBuilding);
       state = StateEscapeBuilding;
     } else {
       /* Kill this serf. */
@@ -585,6 +778,7 @@ Serf::building_deleted(MapPos building_pos, bool escape) {
 
 void
 Serf::castle_deleted(MapPos castle_pos, bool transporter) {
+  wake();
   if ((!transporter || (get_type() == TypeTransporterInventory)) &&
       pos == castle_pos) {
     if (transporter) {
@@ -773,6 +967,7 @@ void
 Serf::stay_idle_in_stock(unsigned int inventory) {
   set_state(StateIdleInStock);
   s.idle_in_stock.inv_index = inventory;
+  join_idle_roster();
 }
 
 void
@@ -985,7 +1180,7 @@ Serf::change_direction(Direction dir, int alt_end) {
         (other_dir == reverse_direction(dir) || other_dir == DirectionNone) &&
         other_serf->switch_waiting(reverse_direction(dir))) {
       /* Do the switch */
-      other_serf->pos = pos;
+      other_serf->set_pos(pos);
       map->set_serf_index(other_serf->pos, other_serf->get_index());
       other_serf->animation =
            get_walking_animation(map->get_height(other_serf->pos) -
@@ -1007,7 +1202,7 @@ Serf::change_direction(Direction dir, int alt_end) {
   }
 
   if (!alt_end) s.walking.wait_counter = 0;
-  pos = new_pos;
+  set_pos(new_pos);
   map->set_serf_index(pos, get_index());
   counter += counter_from_animation[animation];
   if (alt_end && counter < 0) {
@@ -1082,7 +1277,7 @@ Serf::start_walking(Direction dir, int slope, int change_pos) {
     map->set_serf_index(new_pos, get_index());
   }
 
-  pos = new_pos;
+  set_pos(new_pos);
 }
 
 static const int road_building_slope[] = {
@@ -1425,6 +1620,7 @@ Serf::enter_inventory() {
   /*serf->s.idle_in_stock.field_B = 0;
     serf->s.idle_in_stock.field_C = 0;*/
   s.idle_in_stock.inv_index = building->get_inventory()->get_index();
+  join_idle_roster();
 }
 
 void
@@ -1768,6 +1964,7 @@ Serf::handle_serf_entering_building_state() {
 
         set_state(StateIdleInStock);
         s.idle_in_stock.inv_index = inventory->get_index();
+        join_idle_roster();
         break;
       }
       case TypeKnight0:
@@ -1936,7 +2133,7 @@ Serf::handle_serf_digging_state() {
             other_dir == reverse_direction(dir) &&
             other_serf->switch_waiting(other_dir)) {
           /* Do the switch */
-          other_serf->pos = pos;
+          other_serf->set_pos(pos);
           map->set_serf_index(other_serf->pos,
                                           other_serf->get_index());
           other_serf->animation =
@@ -1969,7 +2166,7 @@ Serf::handle_serf_digging_state() {
       }
 
       map->set_serf_index(new_pos, get_index());
-      pos = new_pos;
+      set_pos(new_pos);
       s.digging.substate = 3;
       counter += counter_from_animation[animation];
     } else if (s.digging.substate == 1) {
@@ -2655,8 +2852,8 @@ Serf::handle_serf_free_walking_switch_with_other() {
     other_serf->counter = counter_from_animation[other_serf->animation];
     counter = counter_from_animation[animation];
 
-    other_serf->pos = pos;
-    pos = new_pos;
+    other_serf->set_pos(pos);
+    set_pos(new_pos);
   } else {
     animation = 82;
     counter = counter_from_animation[animation];
@@ -2796,6 +2993,36 @@ Serf::handle_free_walking_follow_edge() {
   return -1;
 }
 
+/* The first of the six preferred directions that takes the serf a step
+   closer to its destination on the flow field there, or DirectionNone.
+   That is none when the destination is out of reach of a field, can't be
+   got to over land, or every step closer is taken by another serf; the
+   serf then finds its own way as before. */
+Direction
+Serf::get_flow_step(const Direction *preferred) {
+  int d1 = s.free_walking.dist_col;
+  int d2 = s.free_walking.dist_row;
+  if (abs(d1) > FlowField::radius || abs(d2) > FlowField::radius) {
+    return DirectionNone;
+  }
+
+  PMap map = game->get_map();
+  std::shared_ptr<const FlowField> field =
+    game->get_flow_field(map->pos_add(pos, d1, d2));
+  unsigned int here = field->get_distance(map.get(), pos);
+  if (here == FlowField::unreachable) {
+    return DirectionNone;
+  }
+  for (int i = 0; i < 6; i++) {
+    MapPos new_pos = map->move(pos, preferred[i]);
+    if (field->get_distance(map.get(), new_pos) < here &&
+        !map->has_serf(new_pos)) {
+      return preferred[i];
+    }
+  }
+  return DirectionNone;
+}
+
 void
 Serf::handle_free_walking_common() {
   const Direction dir_from_offset[] = {
@@ -2908,8 +3135,18 @@ Serf::handle_free_walking_common() {
     }
   }
 
-  /* Try to move directly in the preferred direction */
+  /* Follow the flow field to the destination, which takes the shortest
+     way around obstacles. The last step is left to the checks below. */
   const Direction *a0 = &dir_forward[6*dir_index];
+  if (!water && (abs(d1) > 1 || abs(d2) > 1)) {
+    Direction flow = get_flow_step(a0);
+    if (flow != DirectionNone) {
+      handle_serf_free_walking_switch_on_dir(flow);
+      return;
+    }
+  }
+
+  /* Try to move directly in the preferred direction */
   Direction dir = (Direction)a0[0];
   PMap map = game->get_map();
   MapPos new_pos = map->move(pos, dir);
@@ -2953,7 +3190,7 @@ Serf::handle_free_walking_common() {
           (other_dir == reverse_direction(d) || other_dir == DirectionNone) &&
           other_serf->switch_waiting(reverse_direction(d))) {
         /* Do the switch */
-        other_serf->pos = pos;
+        other_serf->set_pos(pos);
         map->set_serf_index(other_serf->pos,
                                         other_serf->get_index());
         other_serf->animation =
@@ -2966,7 +3203,7 @@ Serf::handle_free_walking_common() {
                                           map->get_height(pos), d, 1);
         counter = counter_from_animation[animation];
 
-        pos = new_pos;
+        set_pos(new_pos);
         map->set_serf_index(pos, index);
         return;
       }
@@ -4310,6 +4547,7 @@ Serf::handle_serf_knight_engaging_building_state() {
 
         /* Change state of attacking knight */
         counter = 0;
+        count_idle_state(StateKnightPrepareAttacking);
         state = StateKnightPrepareAttacking;
         animation = 168;
 
@@ -4575,7 +4813,7 @@ Serf::handle_knight_occupy_enemy_building() {
                   game->get_building_at_pos(game->get_map()->move_up_left(pos));
   if (building != NULL) {
     if (!building->is_burning() && building->is_military()) {
-      if (building->get_owner() == owner) {
+      if (building->get_owner() == get_owner()) {
         /* Enter building if there is space. */
         if (building->get_type() == Building::TypeCastle) {
           enter_building(-2, 0);
@@ -4639,7 +4877,7 @@ Serf::handle_state_knight_free_walking() {
     }
         if (get_owner() != other->get_owner()) {
           if (other->state == StateKnightFreeWalking) {
-            pos = map->move_left(pos_);
+            set_pos(map->move_left(pos_));
             if (can_pass_map_pos(pos_)) {
               int dist_col = s.free_walking.dist_col;
               int dist_row = s.free_walking.dist_row;
@@ -5123,6 +5361,56 @@ Serf::handle_serf_defending_castle_state() {
   handle_serf_defending_state(training_params);
 }
 
+/* Knights in military buildings only count down until they train. */
+bool
+Serf::is_training_knight() const {
+  return (state == StateDefendingHut || state == StateDefendingTower ||
+          state == StateDefendingFortress || state == StateDefendingCastle) &&
+         get_type() >= TypeKnight0 && get_type() <= TypeKnight3;
+}
+
+bool
+Serf::can_sleep(unsigned int *ticks) const {
+  switch (state) {
+  case StateNull:
+  case StateKnightDefending:
+  case StateKnightDefendingFree:
+  case StateKnightPrepareDefendingFreeWait:
+    *ticks = 0;
+    return true;
+  case StateDefendingHut:
+  case StateDefendingTower:
+  case StateDefendingFortress:
+  case StateDefendingCastle:
+    if (get_type() == TypeKnight4) {
+      /* Cannot train anymore. */
+      *ticks = 0;
+      return true;
+    }
+    if (!is_training_knight() || counter < 0 || counter >= 0x7fff) {
+      return false;
+    }
+    /* train_knight() rolls for training once counter drops below zero. */
+    *ticks = counter + 1;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* The sweeps that left this serf out would each have taken the ticks
+   since the previous one off the counter. */
+void
+Serf::wake_up() {
+  sleeping = false;
+  game->serf_woken(this);
+  if (is_training_knight()) {
+    uint16_t last_tick = game->get_serf_update_tick(index);
+    counter -= static_cast<uint16_t>(last_tick - tick);
+    tick = last_tick;
+  }
+}
+
 void
 Serf::update() {
   switch (state) {
@@ -5353,7 +5641,8 @@ Serf::update() {
     handle_serf_defending_castle_state();
     break;
   default:
-    Log::Debug["serf"] << "Serf state " << state << " isn't processed";
+    Log::Debug["serf"] << "Serf state " << get_state() << " isn't processed";
+    count_idle_state(StateNull);
     state = StateNull;
   }
 }
@@ -5361,6 +5650,7 @@ Serf::update() {
 //p1plp1 fix
 void
 Serf::fix_bad_animation() {
+  wake();
 //Serf::fix_bad_animation(Serf &serf,  MapPos pos, int x_base, int y_base) {
   /* Transporting (turning?) (110-115) */
   //animation = 110 + s.walking.dir;
@@ -5404,7 +5694,7 @@ operator >> (SaveReaderBinary &reader, Serf &serf) {
   serf.state = (Serf::State)v8;
 
   Log::Verbose["savegame"] << "load serf " << serf.index << ": "
-                           << Serf::get_state_name(serf.state);
+                           << Serf::get_state_name(serf.get_state());
 
   switch (serf.state) {
     case Serf::StateIdleInStock:
@@ -5674,21 +5964,27 @@ operator >> (SaveReaderText &reader, Serf &serf) {
   int type;
   reader.value("type") >> type;
   try {
-    reader.value("owner") >> serf.owner;
+    unsigned int owner;
+    reader.value("owner") >> owner;
+    serf.owner = owner;
     serf.type = (Serf::Type)type;
   } catch(...) {
     serf.type = (Serf::Type)((type >> 2) & 0x1f);
     serf.owner = type & 3;
   }
 
-  reader.value("animation") >> serf.animation;
+  int animation;
+  reader.value("animation") >> animation;
+  serf.animation = animation;
   reader.value("counter") >> serf.counter;
   int x, y;
   reader.value("pos")[0] >> x;
   reader.value("pos")[1] >> y;
   serf.pos = serf.get_game()->get_map()->pos(x, y);
   reader.value("tick") >> serf.tick;
-  reader.value("state") >> serf.state;
+  Serf::State state;
+  reader.value("state") >> state;
+  serf.state = state;
 
   switch (serf.state) {
     case Serf::StateIdleInStock:
@@ -6135,7 +6431,7 @@ std::string
 Serf::print_state() {
   std::stringstream res;
 
-  res << get_state_name(state) << "\n";
+  res << get_state_name(get_state()) << "\n";
 
   switch (state) {
     case Serf::StateIdleInStock:
@@ -22,8 +22,10 @@
 #ifndef SRC_SERF_H_
 #define SRC_SERF_H_
 
+#include <array>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "src/map.h"
 #include "src/resource.h"
@@ -34,6 +36,7 @@ class Inventory;
 class SaveReaderBinary;
 class SaveReaderText;
 class SaveWriterText;
+class SerfIndex;
 
 class Serf : public GameObject {
  public:
@@ -70,6 +73,8 @@ class Serf : public GameObject {
   } Type;
 
   typedef std::map<Type, unsigned int> SerfMap;
+  // By type, TypeDead included.
+  typedef std::array<unsigned int, TypeDead + 1> SerfCounts;
 
   /* The term FREE is used loosely in the following
    names to denote a state where the serf is not
@@ -158,15 +163,27 @@ class Serf : public GameObject {
   } State;
 
  protected:
-  unsigned int owner;
-  Type type;
-  bool sound;
-  int animation; /* Index to animation table in data file. */
-  int counter;
+  // Fields every update and every drawn frame reads come first and in small
+  // types, so that they share the cache line with the object header. The
+  // per-state data in the union below is only read by the state handlers.
   MapPos pos;
+  int counter;
+  int16_t animation; /* Index to animation table in data file. */
   uint16_t tick;
-  State state;
+  uint8_t state;  // State
+  int8_t type;  // Type
+  int8_t owner;  // Sign extends, so no owner is still -1
+  bool sound;
   bool deleteme; // tlongstretch, used to only delete serfs during update loop instead of immediately
+  bool sleeping;  // Left out of Game::update_serfs(), see can_sleep()
+
+  // Links to the other serfs at the same position, see SerfIndex.
+  Serf *next_at_pos;
+  Serf *prev_at_pos;
+  MapPos indexed_pos;
+  // Inventory whose roster of idle serfs this serf is in, or -1. Kept apart
+  // from s.idle_in_stock, which the next state overwrites.
+  int idle_roster;
 
   union s {
     struct {
@@ -379,17 +396,17 @@ class Serf : public GameObject {
  public:
   Serf(Game *game, unsigned int index);
 
-  unsigned int get_owner() const { return owner; }
-  void set_owner(unsigned int player_num) { owner = player_num; }
+  unsigned int get_owner() const { return static_cast<int>(owner); }
+  void set_owner(unsigned int player_num);
 
-  Type get_type() const { return type; }
+  Type get_type() const { return static_cast<Type>(type); }
   void set_type(Type type);
 
   bool playing_sfx() const { return sound; }
   void start_playing_sfx() { sound = true; }
   void stop_playing_sfx() { sound = false; }
 
-  State get_state() const { return state; }
+  State get_state() const { return static_cast<State>(state); }
   int get_animation() const { return animation; }
   int get_counter() const { return counter; }
 
@@ -450,6 +467,10 @@ class Serf : public GameObject {
   void go_out_from_inventory(unsigned int inventory, MapPos dest, int mode);
   void send_off_to_fight(int dist_col, int dist_row);
   void stay_idle_in_stock(unsigned int inventory);
+  // Take the serf out of the roster of its inventory, see
+  // Inventory::get_idle_serfs().
+  void leave_idle_roster();
+  void join_idle_roster();
   void go_out_from_building(MapPos dest, int dir, int field_B);
   void fix_bad_animation();
   void mark_for_deletion();
@@ -457,6 +478,17 @@ class Serf : public GameObject {
 
   void update();
 
+  // Whether update() would do nothing in the current state but count down
+  // the counter, or nothing at all. Sets ticks to the number of ticks
+  // until it would do something, or to 0 if only a change wakes it.
+  bool can_sleep(unsigned int *ticks) const;
+  bool is_sleeping() const { return sleeping; }
+  void start_sleeping() { sleeping = true; }
+  // Take a sleeping serf back into the updates, with its counter and tick
+  // as if it had been updated all along. Anything that changes a serf
+  // wakes it first.
+  void wake() { if (sleeping) wake_up(); }
+
   static const char *get_state_name(State state);
   static const char *get_type_name(Type type);
 
@@ -466,6 +498,7 @@ class Serf : public GameObject {
     operator >> (SaveReaderText &reader, Serf &serf);
   friend SaveWriterText&
     operator << (SaveWriterText &writer, Serf &serf);
+  friend class SerfIndex;
 
   std::string print_state();
   // moved from protected
@@ -510,6 +543,7 @@ class Serf : public GameObject {
   void handle_serf_free_walking_switch_on_dir(Direction dir);
   void handle_serf_free_walking_switch_with_other();
   int handle_free_walking_follow_edge();
+  Direction get_flow_step(const Direction *preferred);
   void handle_free_walking_common();
   void handle_serf_free_walking_state();
   void handle_serf_logging_state();
@@ -569,6 +603,97 @@ class Serf : public GameObject {
   void handle_serf_defending_tower_state();
   void handle_serf_defending_fortress_state();
   void handle_serf_defending_castle_state();
+
+  bool is_training_knight() const;
+  void wake_up();
+  // Keep the owner's count of serfs idle in stock, see
+  // Player::get_stats_serfs_idle(), across a change of state.
+  void count_idle_state(State new_state);
+  void watch_wait_state(State new_state);
+  // Tell the game's events of a change of state.
+  void publish_state(State new_state);
+  void count_idle(int delta);
+
+  // Change position and keep the game's SerfIndex up to date.
+  void set_pos(MapPos new_pos);
+};
+
+// Serfs by map position. Each tile holds the head of an intrusive list
+// running through the serfs standing on it, so finding the serfs at a
+// position does not scan every serf. Serfs are also counted per square
+// region of region_size tiles for coarse density queries.
+class SerfIndex {
+ public:
+  // The next serf is fetched ahead, so the current one may move away.
+  class Iterator {
+   protected:
+    Serf *serf;
+    Serf *next;
+
+   public:
+    explicit Iterator(Serf *serf)
+      : serf(serf), next((serf != nullptr) ? serf->next_at_pos : nullptr) {}
+
+    Iterator& operator++() {
+      serf = next;
+      next = (serf != nullptr) ? serf->next_at_pos : nullptr;
+      return *this;
+    }
+    bool operator==(const Iterator& rhs) const { return serf == rhs.serf; }
+    bool operator!=(const Iterator& rhs) const { return serf != rhs.serf; }
+    Serf *operator*() const { return serf; }
+  };
+
+  // Serfs at one position.
+  class Range {
+   protected:
+    Serf *first;
+
+   public:
+    explicit Range(Serf *first) : first(first) {}
+
+    Iterator begin() const { return Iterator(first); }
+    Iterator end() const { return Iterator(nullptr); }
+    bool empty() const { return (first == nullptr); }
+  };
+
+  static const unsigned int region_shift = 3;
+  static const unsigned int region_size = 1 << region_shift;
+
+ protected:
+  std::vector<Serf*> heads;
+  std::vector<unsigned int> region_counts;
+  unsigned int region_cols;
+  unsigned int row_shift;
+  unsigned int col_mask;
+  unsigned int row_mask;
+
+ public:
+  SerfIndex() : region_cols(0), row_shift(0), col_mask(0), row_mask(0) {}
+
+  // Size the index for a map, dropping all entries.
+  void init(const MapGeometry &geom);
+  void clear();
+  // Make this a copy of that, over the serfs of the same index in game,
+  // which Game::fork() copied from the serfs that indexes. The serfs at a
+  // position keep their order.
+  void fork(const SerfIndex &that, Game *game);
+
+  void insert(Serf *serf);
+  void remove(Serf *serf);
+  void move(Serf *serf);
+
+  Range at(MapPos pos) const {
+    return Range((pos < heads.size()) ? heads[pos] : nullptr); }
+
+  unsigned int get_region(MapPos pos) const {
+    return ((((pos >> row_shift) & row_mask) >> region_shift) * region_cols) +
+            ((pos & col_mask) >> region_shift); }
+  unsigned int get_region_count() const {
+    return static_cast<unsigned int>(region_counts.size()); }
+  // Number of serfs in the region containing pos.
+  unsigned int count_in_region(MapPos pos) const {
+    return region_counts[get_region(pos)]; }
 };
 
 #endif  // SRC_SERF_H_
@@ -23,8 +23,13 @@
 
 #include <SDL_image.h>
 
+/* Sprites are loaded on the prewarm workers, and IMG_Init() is not safe
+   to call from several threads at once, so it is called once by the
+   first. */
 SpriteFile::SpriteFile() {
-  IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF);
+  static const int formats = IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG |
+                                      IMG_INIT_TIF);
+  (void)formats;
 }
 
 bool
@@ -0,0 +1,556 @@
+/*
+ * sprite-kernels.cc - Per pixel loops of the sprite operations
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/sprite-kernels.h"
+
+#include <algorithm>
+
+/* The vector versions read pixels as 32 bit numbers with blue in the low
+   byte, so they are only built for little endian targets. SSE2 is part of
+   every x86-64 CPU and NEON of every AArch64 one. */
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SPRITE_KERNELS_SSE2  1
+#include <emmintrin.h>
+#elif defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN)
+#define SPRITE_KERNELS_NEON  1
+#include <arm_neon.h>
+#endif
+
+SpriteKernels::Level
+SpriteKernels::level = SpriteKernels::get_best_level();
+
+/* Plain versions, byte by byte where the channels matter. */
+
+static void
+scalar_mask(uint32_t *dst, const uint32_t *src, const uint32_t *mask,
+            size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = src[i] & mask[i];
+  }
+}
+
+static void
+scalar_compare(uint32_t *dst, const uint32_t *a, const uint32_t *b,
+               size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = (a[i] == b[i]) ? 0x00000000 : 0xFFFFFFFF;
+  }
+}
+
+static void
+scalar_fill(uint32_t *dst, uint32_t color, size_t count) {
+  std::fill(dst, dst + count, color);
+}
+
+static void
+scalar_fill_opaque(uint32_t *dst, uint32_t color, size_t count) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(dst);
+  for (size_t i = 0; i < count; i++) {
+    if (bytes[4 * i + 3] != 0x00) {
+      dst[i] = color;
+    }
+  }
+}
+
+static void
+scalar_add(uint32_t *dst, const uint32_t *src, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    dst[i] += src[i];
+  }
+}
+
+static void
+scalar_clear_masked(uint32_t *dst, const uint32_t *src, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (src[i] == 0xFFFFFFFF) {
+      dst[i] = 0x00000000;
+    }
+  }
+}
+
+#define UNMULTIPLY(color, a) ((0xFF * (color)) / (a))
+#define BLEND(back, front, a) (((front) * (a)) + ((back) * (0xFF - (a)))) / 0xFF
+
+static void
+scalar_blend(uint32_t *back, const uint32_t *front, size_t count) {
+  uint8_t *c = reinterpret_cast<uint8_t*>(back);
+  const uint8_t *o = reinterpret_cast<const uint8_t*>(front);
+  for (size_t i = 0; i < count; i++, c += 4, o += 4) {
+    const uint32_t alpha = o[3];
+
+    if (alpha == 0x00) {
+      continue;
+    }
+
+    if (alpha == 0xFF) {
+      back[i] = front[i];
+      continue;
+    }
+
+    const uint8_t frontB = UNMULTIPLY(o[0], alpha);
+    const uint8_t frontG = UNMULTIPLY(o[1], alpha);
+    const uint8_t frontR = UNMULTIPLY(o[2], alpha);
+
+    c[0] = (uint8_t)(BLEND(c[0], frontB, alpha));
+    c[1] = (uint8_t)(BLEND(c[1], frontG, alpha));
+    c[2] = (uint8_t)(BLEND(c[2], frontR, alpha));
+    c[3] = 0xFF;
+  }
+}
+
+/* The first half of alpha_mask, returns the least alpha it left. */
+static uint8_t
+scalar_alpha_from_brightness(uint32_t *pixels, size_t count) {
+  uint8_t *c = reinterpret_cast<uint8_t*>(pixels);
+  uint8_t min = 0xFF;
+  for (size_t i = 0; i < count; i++, c += 4) {
+    if (c[3] != 0x00) {
+      c[3] = 0xff - static_cast<uint8_t>((0.21 * c[2]) +
+                                         (0.72 * c[1]) +
+                                         (0.07 * c[0]));
+      c[2] = 0;
+      c[1] = 0;
+      c[0] = 0;
+      min = std::min(min, c[3]);
+    }
+  }
+  return min;
+}
+
+static void
+scalar_lower_alpha(uint32_t *pixels, size_t count, uint8_t min) {
+  uint8_t *c = reinterpret_cast<uint8_t*>(pixels);
+  for (size_t i = 0; i < count; i++, c += 4) {
+    if (c[3] != 0x00) {
+      c[3] = c[3] - min;
+    }
+  }
+}
+
+static void
+scalar_alpha_mask(uint32_t *pixels, size_t count) {
+  uint8_t min = scalar_alpha_from_brightness(pixels, count);
+  scalar_lower_alpha(pixels, count, min);
+}
+
+#if SPRITE_KERNELS_SSE2
+
+static inline __m128i
+sse2_load(const uint32_t *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline void
+sse2_store(uint32_t *p, __m128i v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+
+static void
+sse2_mask(uint32_t *dst, const uint32_t *src, const uint32_t *mask,
+          size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    sse2_store(dst + i, _mm_and_si128(sse2_load(src + i),
+                                      sse2_load(mask + i)));
+  }
+  scalar_mask(dst + i, src + i, mask + i, count - i);
+}
+
+static void
+sse2_compare(uint32_t *dst, const uint32_t *a, const uint32_t *b,
+             size_t count) {
+  const __m128i ones = _mm_set1_epi32(-1);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i same = _mm_cmpeq_epi32(sse2_load(a + i), sse2_load(b + i));
+    sse2_store(dst + i, _mm_xor_si128(same, ones));
+  }
+  scalar_compare(dst + i, a + i, b + i, count - i);
+}
+
+static void
+sse2_fill(uint32_t *dst, uint32_t color, size_t count) {
+  const __m128i colors = _mm_set1_epi32(static_cast<int>(color));
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    sse2_store(dst + i, colors);
+  }
+  scalar_fill(dst + i, color, count - i);
+}
+
+static void
+sse2_fill_opaque(uint32_t *dst, uint32_t color, size_t count) {
+  const __m128i colors = _mm_set1_epi32(static_cast<int>(color));
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i pixels = sse2_load(dst + i);
+    __m128i hidden = _mm_cmpeq_epi32(_mm_srli_epi32(pixels, 24), zero);
+    sse2_store(dst + i, _mm_or_si128(_mm_and_si128(hidden, pixels),
+                                     _mm_andnot_si128(hidden, colors)));
+  }
+  scalar_fill_opaque(dst + i, color, count - i);
+}
+
+static void
+sse2_add(uint32_t *dst, const uint32_t *src, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    sse2_store(dst + i, _mm_add_epi32(sse2_load(dst + i),
+                                      sse2_load(src + i)));
+  }
+  scalar_add(dst + i, src + i, count - i);
+}
+
+static void
+sse2_clear_masked(uint32_t *dst, const uint32_t *src, size_t count) {
+  const __m128i ones = _mm_set1_epi32(-1);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i set = _mm_cmpeq_epi32(sse2_load(src + i), ones);
+    sse2_store(dst + i, _mm_andnot_si128(set, sse2_load(dst + i)));
+  }
+  scalar_clear_masked(dst + i, src + i, count - i);
+}
+
+/* One channel of BLEND(back, UNMULTIPLY(front, a), a), in 32 bit lanes.
+   The quotient of the unmultiply is never close enough below a whole
+   number for the float division to round up to it, so truncating it gives
+   what the integer division does. Everything after fits 16 bits. */
+template <int shift>
+static inline __m128i
+sse2_blend_channel(__m128i back, __m128i front, __m128i alpha, __m128i rest,
+                   __m128 divisor) {
+  const __m128i m8 = _mm_set1_epi32(0xFF);
+  const __m128i one = _mm_set1_epi32(1);
+  __m128i b = _mm_and_si128(_mm_srli_epi32(back, shift), m8);
+  __m128i f = _mm_and_si128(_mm_srli_epi32(front, shift), m8);
+  __m128 q = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(f), _mm_set1_ps(255.f)),
+                        divisor);
+  f = _mm_and_si128(_mm_cvttps_epi32(q), m8);
+  __m128i x = _mm_add_epi32(_mm_mullo_epi16(f, alpha),
+                            _mm_mullo_epi16(b, rest));
+  /* x / 0xFF for x up to 0xFF * 0xFF */
+  x = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, one),
+                                   _mm_srli_epi32(x, 8)), 8);
+  return _mm_slli_epi32(x, shift);
+}
+
+static void
+sse2_blend(uint32_t *back, const uint32_t *front, size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i m8 = _mm_set1_epi32(0xFF);
+  const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i c = sse2_load(back + i);
+    __m128i o = sse2_load(front + i);
+    __m128i alpha = _mm_srli_epi32(o, 24);
+    __m128i clear = _mm_cmpeq_epi32(alpha, zero);
+    __m128i full = _mm_cmpeq_epi32(alpha, m8);
+    __m128 divisor = _mm_cvtepi32_ps(_mm_or_si128(alpha,
+                                                  _mm_and_si128(clear, one)));
+    __m128i rest = _mm_sub_epi32(m8, alpha);
+
+    __m128i blended = opaque;
+    blended = _mm_or_si128(blended,
+                      sse2_blend_channel<0>(c, o, alpha, rest, divisor));
+    blended = _mm_or_si128(blended,
+                      sse2_blend_channel<8>(c, o, alpha, rest, divisor));
+    blended = _mm_or_si128(blended,
+                      sse2_blend_channel<16>(c, o, alpha, rest, divisor));
+
+    __m128i result = _mm_or_si128(_mm_and_si128(full, o),
+                                  _mm_andnot_si128(full, blended));
+    result = _mm_or_si128(_mm_and_si128(clear, c),
+                          _mm_andnot_si128(clear, result));
+    sse2_store(back + i, result);
+  }
+  scalar_blend(back + i, front + i, count - i);
+}
+
+/* The brightness is worked out in doubles, in the same order as the plain
+   version does, so it rounds the same. */
+static inline __m128i
+sse2_brightness(__m128i r, __m128i g, __m128i b) {
+  const __m128d kr = _mm_set1_pd(0.21);
+  const __m128d kg = _mm_set1_pd(0.72);
+  const __m128d kb = _mm_set1_pd(0.07);
+  __m128d lo = _mm_add_pd(_mm_add_pd(_mm_mul_pd(kr, _mm_cvtepi32_pd(r)),
+                                     _mm_mul_pd(kg, _mm_cvtepi32_pd(g))),
+                          _mm_mul_pd(kb, _mm_cvtepi32_pd(b)));
+  r = _mm_shuffle_epi32(r, _MM_SHUFFLE(3, 2, 3, 2));
+  g = _mm_shuffle_epi32(g, _MM_SHUFFLE(3, 2, 3, 2));
+  b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 2, 3, 2));
+  __m128d hi = _mm_add_pd(_mm_add_pd(_mm_mul_pd(kr, _mm_cvtepi32_pd(r)),
+                                     _mm_mul_pd(kg, _mm_cvtepi32_pd(g))),
+                          _mm_mul_pd(kb, _mm_cvtepi32_pd(b)));
+  return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+static void
+sse2_alpha_mask(uint32_t *pixels, size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi32(-1);
+  const __m128i m8 = _mm_set1_epi32(0xFF);
+  __m128i least = m8;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i p = sse2_load(pixels + i);
+    __m128i shown = _mm_xor_si128(_mm_cmpeq_epi32(_mm_srli_epi32(p, 24),
+                                                  zero), ones);
+    __m128i alpha = _mm_sub_epi32(m8, sse2_brightness(
+                        _mm_and_si128(_mm_srli_epi32(p, 16), m8),
+                        _mm_and_si128(_mm_srli_epi32(p, 8), m8),
+                        _mm_and_si128(p, m8)));
+    sse2_store(pixels + i,
+               _mm_or_si128(_mm_and_si128(shown, _mm_slli_epi32(alpha, 24)),
+                            _mm_andnot_si128(shown, p)));
+    /* The lanes hold bytes, their upper halves are 0 */
+    least = _mm_min_epi16(least,
+                          _mm_or_si128(_mm_and_si128(shown, alpha),
+                                       _mm_andnot_si128(shown, m8)));
+  }
+  uint32_t lanes[4];
+  sse2_store(lanes, least);
+  uint8_t min = scalar_alpha_from_brightness(pixels + i, count - i);
+  for (uint32_t lane : lanes) {
+    min = std::min(min, static_cast<uint8_t>(lane));
+  }
+
+  const __m128i lower = _mm_set1_epi32(static_cast<int>(
+                                       static_cast<uint32_t>(min) << 24));
+  size_t j = 0;
+  for (; j + 4 <= count; j += 4) {
+    __m128i p = sse2_load(pixels + j);
+    __m128i shown = _mm_xor_si128(_mm_cmpeq_epi32(_mm_srli_epi32(p, 24),
+                                                  zero), ones);
+    sse2_store(pixels + j, _mm_sub_epi32(p, _mm_and_si128(shown, lower)));
+  }
+  scalar_lower_alpha(pixels + j, count - j, min);
+}
+
+#endif  // SPRITE_KERNELS_SSE2
+
+#if SPRITE_KERNELS_NEON
+
+static void
+neon_mask(uint32_t *dst, const uint32_t *src, const uint32_t *mask,
+          size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    vst1q_u32(dst + i, vandq_u32(vld1q_u32(src + i), vld1q_u32(mask + i)));
+  }
+  scalar_mask(dst + i, src + i, mask + i, count - i);
+}
+
+static void
+neon_compare(uint32_t *dst, const uint32_t *a, const uint32_t *b,
+             size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    vst1q_u32(dst + i, vmvnq_u32(vceqq_u32(vld1q_u32(a + i),
+                                           vld1q_u32(b + i))));
+  }
+  scalar_compare(dst + i, a + i, b + i, count - i);
+}
+
+static void
+neon_fill(uint32_t *dst, uint32_t color, size_t count) {
+  const uint32x4_t colors = vdupq_n_u32(color);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    vst1q_u32(dst + i, colors);
+  }
+  scalar_fill(dst + i, color, count - i);
+}
+
+static void
+neon_fill_opaque(uint32_t *dst, uint32_t color, size_t count) {
+  const uint32x4_t colors = vdupq_n_u32(color);
+  const uint32x4_t zero = vdupq_n_u32(0);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint32x4_t pixels = vld1q_u32(dst + i);
+    uint32x4_t hidden = vceqq_u32(vshrq_n_u32(pixels, 24), zero);
+    vst1q_u32(dst + i, vbslq_u32(hidden, pixels, colors));
+  }
+  scalar_fill_opaque(dst + i, color, count - i);
+}
+
+static void
+neon_add(uint32_t *dst, const uint32_t *src, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    vst1q_u32(dst + i, vaddq_u32(vld1q_u32(dst + i), vld1q_u32(src + i)));
+  }
+  scalar_add(dst + i, src + i, count - i);
+}
+
+static void
+neon_clear_masked(uint32_t *dst, const uint32_t *src, size_t count) {
+  const uint32x4_t ones = vdupq_n_u32(0xFFFFFFFF);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint32x4_t set = vceqq_u32(vld1q_u32(src + i), ones);
+    vst1q_u32(dst + i, vbicq_u32(vld1q_u32(dst + i), set));
+  }
+  scalar_clear_masked(dst + i, src + i, count - i);
+}
+
+/* As sse2_blend_channel. */
+template <int shift>
+static inline uint32x4_t
+neon_blend_channel(uint32x4_t back, uint32x4_t front, uint32x4_t alpha,
+                   uint32x4_t rest, float32x4_t divisor) {
+  const uint32x4_t m8 = vdupq_n_u32(0xFF);
+  const int32x4_t down = vdupq_n_s32(-shift);
+  uint32x4_t b = vandq_u32(vshlq_u32(back, down), m8);
+  uint32x4_t f = vandq_u32(vshlq_u32(front, down), m8);
+  float32x4_t q = vdivq_f32(vmulq_f32(vcvtq_f32_u32(f), vdupq_n_f32(255.f)),
+                            divisor);
+  f = vandq_u32(vcvtq_u32_f32(q), m8);
+  uint32x4_t x = vaddq_u32(vmulq_u32(f, alpha), vmulq_u32(b, rest));
+  x = vshrq_n_u32(vaddq_u32(vaddq_u32(x, vdupq_n_u32(1)),
+                            vshrq_n_u32(x, 8)), 8);
+  return vshlq_u32(x, vdupq_n_s32(shift));
+}
+
+static void
+neon_blend(uint32_t *back, const uint32_t *front, size_t count) {
+  const uint32x4_t zero = vdupq_n_u32(0);
+  const uint32x4_t one = vdupq_n_u32(1);
+  const uint32x4_t m8 = vdupq_n_u32(0xFF);
+  const uint32x4_t opaque = vdupq_n_u32(0xFF000000);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint32x4_t c = vld1q_u32(back + i);
+    uint32x4_t o = vld1q_u32(front + i);
+    uint32x4_t alpha = vshrq_n_u32(o, 24);
+    uint32x4_t clear = vceqq_u32(alpha, zero);
+    uint32x4_t full = vceqq_u32(alpha, m8);
+    float32x4_t divisor = vcvtq_f32_u32(vorrq_u32(alpha,
+                                                  vandq_u32(clear, one)));
+    uint32x4_t rest = vsubq_u32(m8, alpha);
+
+    uint32x4_t blended = opaque;
+    blended = vorrq_u32(blended,
+                        neon_blend_channel<0>(c, o, alpha, rest, divisor));
+    blended = vorrq_u32(blended,
+                        neon_blend_channel<8>(c, o, alpha, rest, divisor));
+    blended = vorrq_u32(blended,
+                        neon_blend_channel<16>(c, o, alpha, rest, divisor));
+
+    uint32x4_t result = vbslq_u32(full, o, blended);
+    vst1q_u32(back + i, vbslq_u32(clear, c, result));
+  }
+  scalar_blend(back + i, front + i, count - i);
+}
+
+/* Rarely run, left to the plain version. */
+static void
+neon_alpha_mask(uint32_t *pixels, size_t count) {
+  scalar_alpha_mask(pixels, count);
+}
+
+#endif  // SPRITE_KERNELS_NEON
+
+#if SPRITE_KERNELS_SSE2
+#define RUN_KERNEL(name, ...) \
+  if (level == LevelSSE2) { sse2_##name(__VA_ARGS__); return; } \
+  scalar_##name(__VA_ARGS__)
+#elif SPRITE_KERNELS_NEON
+#define RUN_KERNEL(name, ...) \
+  if (level == LevelNEON) { neon_##name(__VA_ARGS__); return; } \
+  scalar_##name(__VA_ARGS__)
+#else
+#define RUN_KERNEL(name, ...) scalar_##name(__VA_ARGS__)
+#endif
+
+SpriteKernels::Level
+SpriteKernels::get_best_level() {
+#if SPRITE_KERNELS_SSE2
+  return LevelSSE2;
+#elif SPRITE_KERNELS_NEON
+  return LevelNEON;
+#else
+  return LevelScalar;
+#endif
+}
+
+void
+SpriteKernels::set_level(Level _level) {
+  level = (_level == LevelScalar) ? LevelScalar : get_best_level();
+}
+
+const char *
+SpriteKernels::get_level_name(Level _level) {
+  switch (_level) {
+    case LevelSSE2: return "SSE2";
+    case LevelNEON: return "NEON";
+    default: return "scalar";
+  }
+}
+
+void
+SpriteKernels::mask(uint32_t *dst, const uint32_t *src, const uint32_t *mask,
+                    size_t count) {
+  RUN_KERNEL(mask, dst, src, mask, count);
+}
+
+void
+SpriteKernels::compare(uint32_t *dst, const uint32_t *a, const uint32_t *b,
+                       size_t count) {
+  RUN_KERNEL(compare, dst, a, b, count);
+}
+
+void
+SpriteKernels::fill(uint32_t *dst, uint32_t color, size_t count) {
+  RUN_KERNEL(fill, dst, color, count);
+}
+
+void
+SpriteKernels::fill_opaque(uint32_t *dst, uint32_t color, size_t count) {
+  RUN_KERNEL(fill_opaque, dst, color, count);
+}
+
+void
+SpriteKernels::add(uint32_t *dst, const uint32_t *src, size_t count) {
+  RUN_KERNEL(add, dst, src, count);
+}
+
+void
+SpriteKernels::clear_masked(uint32_t *dst, const uint32_t *src,
+                            size_t count) {
+  RUN_KERNEL(clear_masked, dst, src, count);
+}
+
+void
+SpriteKernels::blend(uint32_t *back, const uint32_t *front, size_t count) {
+  RUN_KERNEL(blend, back, front, count);
+}
+
+void
+SpriteKernels::alpha_mask(uint32_t *pixels, size_t count) {
+  RUN_KERNEL(alpha_mask, pixels, count);
+}
@@ -0,0 +1,72 @@
+/*
+ * sprite-kernels.h - Per pixel loops of the sprite operations
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_SPRITE_KERNELS_H_
+#define SRC_SPRITE_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// The loops over the pixels of a sprite that SpriteBase runs to mask, tint
+// and blend sprites. Pixels are four bytes, blue, green, red and alpha.
+// Each loop has a plain version, which is what the others are checked
+// against, and vector versions for the instruction sets the build targets,
+// one of which is picked at run time, four pixels at a time. All versions
+// give the same bytes.
+class SpriteKernels {
+ public:
+  typedef enum Level {
+    LevelScalar = 0,
+    LevelSSE2,
+    LevelNEON,
+  } Level;
+
+  // The fastest version this build can run on this machine.
+  static Level get_best_level();
+  static Level get_level() { return level; }
+  // Run the given version from now on, or the best one if it is not there.
+  static void set_level(Level level);
+  static const char *get_level_name(Level level);
+
+  // dst = src & mask
+  static void mask(uint32_t *dst, const uint32_t *src, const uint32_t *mask,
+                   size_t count);
+  // dst = 0 where a and b are the same pixel, 0xFFFFFFFF where not
+  static void compare(uint32_t *dst, const uint32_t *a, const uint32_t *b,
+                      size_t count);
+  static void fill(uint32_t *dst, uint32_t color, size_t count);
+  // set the pixels that are not fully transparent to color
+  static void fill_opaque(uint32_t *dst, uint32_t color, size_t count);
+  // dst += src, as 32 bit numbers
+  static void add(uint32_t *dst, const uint32_t *src, size_t count);
+  // dst = 0 where src is 0xFFFFFFFF
+  static void clear_masked(uint32_t *dst, const uint32_t *src, size_t count);
+  // draw front, with alpha premultiplied, over back
+  static void blend(uint32_t *back, const uint32_t *front, size_t count);
+  // turn the brightness of the visible pixels into black of the opposite
+  //  alpha, as little of it as the palest pixel allows
+  static void alpha_mask(uint32_t *pixels, size_t count);
+
+ protected:
+  static Level level;
+};
+
+#endif  // SRC_SPRITE_KERNELS_H_
@@ -0,0 +1,856 @@
+/*
+ * sprite-tables.cc - Sprites of serfs and buildings by type and state
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/sprite-tables.h"
+
+#include "src/debug.h"
+#include "src/resource.h"
+
+namespace {
+
+typedef SpriteTables::SerfLook SerfLook;
+typedef SpriteTables::SerfSounds SerfSounds;
+
+/* Serf bodies. Animation sprites below 0x80 are walking, the others are
+   work, and each serf type has its sprites from an offset on. */
+
+const int transporter_type[] = {
+  0, 0x3000, 0x3500, 0x3b00, 0x4100, 0x4600, 0x4b00, 0x1400,
+  0x700, 0x5100, 0x800, 0x1c00, 0x1d00, 0x1e00, 0x1a00, 0x1b00,
+  0x6800, 0x6d00, 0x6500, 0x6700, 0x6b00, 0x6a00, 0x6600, 0x6900,
+  0x6c00, 0x5700, 0x5600, 0, 0, 0, 0, 0
+};
+
+const int sailor_type[] = {
+  0, 0x3100, 0x3600, 0x3c00, 0x4200, 0x4700, 0x4c00, 0x1500,
+  0x900, 0x7700, 0xa00, 0x2100, 0x2200, 0x2300, 0x1f00, 0x2000,
+  0x6e00, 0x6f00, 0x7000, 0x7100, 0x7200, 0x7300, 0x7400, 0x7500,
+  0x7600, 0x5f00, 0x6000, 0, 0, 0, 0, 0
+};
+
+// Walking sprites of a serf carrying out what it made, by resource. The
+// last entry, TypeNone, is for any other resource, with an offset of 0 for
+// none other expected.
+typedef struct CarriedSprite {
+  Resource::Type res;
+  int offset;
+} CarriedSprite;
+
+constexpr CarriedSprite sawmiller_carried[] = {
+  { Resource::TypeNone, 0x1700 } };
+constexpr CarriedSprite pig_farmer_carried[] = {
+  { Resource::TypeNone, 0x3400 } };
+constexpr CarriedSprite butcher_carried[] = { { Resource::TypeNone, 0x3a00 } };
+constexpr CarriedSprite miller_carried[] = { { Resource::TypeNone, 0x4500 } };
+constexpr CarriedSprite baker_carried[] = { { Resource::TypeNone, 0x4a00 } };
+constexpr CarriedSprite boatbuilder_carried[] = {
+  { Resource::TypeNone, 0x5000 } };
+
+constexpr CarriedSprite smelter_carried[] = {
+  { Resource::TypeSteel, 0x2900 }, { Resource::TypeNone, 0x2800 }
+};
+
+constexpr CarriedSprite miner_carried[] = {
+  { Resource::TypeStone, 0x2700 }, { Resource::TypeIronOre, 0x2500 },
+  { Resource::TypeCoal, 0x2600 }, { Resource::TypeGoldOre, 0x2400 },
+  { Resource::TypeNone, 0 }
+};
+
+constexpr CarriedSprite toolmaker_carried[] = {
+  { Resource::TypeShovel, 0x5a00 }, { Resource::TypeHammer, 0x5b00 },
+  { Resource::TypeRod, 0x5c00 }, { Resource::TypeCleaver, 0x5d00 },
+  { Resource::TypeScythe, 0x5e00 }, { Resource::TypeAxe, 0x6100 },
+  { Resource::TypeSaw, 0x6200 }, { Resource::TypePick, 0x6300 },
+  { Resource::TypePincer, 0x6400 }, { Resource::TypeNone, 0 }
+};
+
+constexpr CarriedSprite weaponsmith_carried[] = {
+  { Resource::TypeSword, 0x5500 }, { Resource::TypeNone, 0x5400 }
+};
+
+typedef int SerfBodyHook(const SerfLook &look);
+typedef void SerfSoundHook(const SerfLook &look, SerfSounds *sounds);
+
+typedef struct SerfBodyRule {
+  int walking;     // Added to walking sprites
+  int outdoors;    // Instead, walking out to work in the open, if not 0
+  const CarriedSprite *carried;  // Instead, leaving to drop what it made
+  int working;     // Added to work sprites
+  int held;        // Work sprite left as it is while its sound plays, if
+                   // not 0, as the original does
+  SerfBodyHook *hook;     // Instead of all of the above, if set
+  SerfSoundHook *sounds;
+} SerfBodyRule;
+
+bool
+is_carrying_out(const SerfLook &look) {
+  return (look.state == Serf::StateLeavingBuilding &&
+          look.leaving_next_state == Serf::StateDropResourceOut);
+}
+
+bool
+is_walking_out(const SerfLook &look) {
+  return ((look.state == Serf::StateFreeWalking && look.free_dist1 == -128 &&
+           look.free_dist2 == 1) ||
+          (look.type == Serf::TypeStonecutter &&
+           look.state == Serf::StateStoneCutting && look.free_dist1 == 2));
+}
+
+int
+get_carried_offset(const CarriedSprite *carried, int res) {
+  for (; carried->res != Resource::TypeNone; carried++) {
+    if (carried->res == res) {
+      return carried->offset;
+    }
+  }
+  if (carried->offset == 0) {
+    NOT_REACHED();
+  }
+  return carried->offset;
+}
+
+int
+transporter_body(const SerfLook &look) {
+  if (look.state == Serf::StateIdleOnPath) {
+    return -1;
+  }
+  if ((look.state == Serf::StateTransporting ||
+       look.state == Serf::StateDelivering) && look.delivery != 0) {
+    return look.sprite + transporter_type[look.delivery];
+  }
+  return look.sprite;
+}
+
+int
+inventory_transporter_body(const SerfLook &look) {
+  if (look.state == Serf::StateBuildingCastle) {
+    return -1;
+  }
+  return look.sprite + transporter_type[look.delivery];
+}
+
+int
+sailor_body(const SerfLook &look) {
+  if ((look.state == Serf::StateTransporting && look.delivery == 0) ||
+      look.state == Serf::StateLostSailor ||
+      look.state == Serf::StateFreeSailing) {
+    return look.sprite + 0x200;
+  } else if (look.state == Serf::StateTransporting) {
+    return look.sprite + sailor_type[look.delivery];
+  }
+  return look.sprite + 0x100;
+}
+
+int
+miner_body(const SerfLook &look) {
+  if (look.sprite >= 0x80) {
+    return look.sprite + 0x2a80;
+  }
+  if (look.state == Serf::StateMining && look.mining_res != 0) {
+    return look.sprite + get_carried_offset(miner_carried,
+                                            look.mining_res - 1);
+  }
+  if (is_carrying_out(look)) {
+    return look.sprite + get_carried_offset(miner_carried,
+                                            look.leaving_res - 1);
+  }
+  return look.sprite + 0x1800;
+}
+
+int
+fisher_body(const SerfLook &look) {
+  if (look.sprite < 0x80) {
+    return look.sprite + (is_walking_out(look) ? 0x2f00 : 0x2c00);
+  }
+  /* TODO no check for state */
+  return look.sprite + ((look.free_dist2 == 1) ? 0x2d80 : 0x2c80);
+}
+
+int
+farmer_body(const SerfLook &look) {
+  int t = look.sprite;
+  if (t < 0x80) {
+    return t + (is_walking_out(look) ? 0x4000 : 0x3d00);
+  }
+  /* TODO access to state without state check */
+  if (look.free_dist1 == 0) {
+    return t + 0x3d80;
+  }
+  if (t == 0x84 && look.playing_sfx) {
+    return t;
+  }
+  return t + 0x3e80;
+}
+
+int
+knight_body(const SerfLook &look) {
+  int k = look.type - Serf::TypeKnight0;
+  if (look.sprite < 0x80) {
+    return look.sprite + 0x7800 + 0x100*k;
+  } else if (look.sprite < 0xc0) {
+    return look.sprite + 0x7cd0 + 0x200*k;
+  }
+  return look.sprite + 0x7d90 + 0x200*k;
+}
+
+/* Sound effects of the serf bodies. */
+
+void
+play(SerfSounds *sounds, Audio::TypeSfx sound) {
+  sounds->sound[sounds->count++] = sound;
+}
+
+void
+start(SerfSounds *sounds, Audio::TypeSfx sound) {
+  sounds->playing = SpriteTables::PlayingStart;
+  play(sounds, sound);
+}
+
+void
+stop(SerfSounds *sounds) {
+  sounds->playing = SpriteTables::PlayingStop;
+}
+
+// The common pattern: a step starts its sound at its first sprite, or at
+// its next one if it isn't playing yet, and any other work sprite stops it.
+void
+step_sound(const SerfLook &look, bool first, bool next, Audio::TypeSfx sound,
+           SerfSounds *sounds) {
+  if (first || (next && !look.playing_sfx)) {
+    start(sounds, sound);
+  } else if (!next) {
+    stop(sounds);
+  }
+}
+
+void
+sailor_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  bool playing = look.playing_sfx;
+  auto row = [t, &playing, sounds]() {
+    if (((t & 7) == 4 && !playing) || (t & 7) == 3) {
+      playing = true;
+      start(sounds, Audio::TypeSfxRowing);
+    } else {
+      playing = false;
+      stop(sounds);
+    }
+  };
+  /* A sailor rowing without cargo goes through this twice. */
+  if (look.state == Serf::StateTransporting && t < 0x80) {
+    row();
+  }
+  if (((look.state == Serf::StateTransporting && look.delivery == 0) ||
+       look.state == Serf::StateLostSailor ||
+       look.state == Serf::StateFreeSailing) && t < 0x80) {
+    row();
+  }
+}
+
+void
+digger_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80) {
+    step_sound(look, t == 0x83, t == 0x84, Audio::TypeSfxDigging, sounds);
+  }
+}
+
+void
+builder_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80) {
+    step_sound(look, (t & 7) == 4, (t & 7) == 5, Audio::TypeSfxHammerBlow,
+               sounds);
+  }
+}
+
+void
+lumberjack_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t < 0x80) {
+    return;
+  }
+  step_sound(look, t == 0x85, t == 0x86, Audio::TypeSfxAxBlow, sounds);
+  if (sounds->count > 0) {
+    /* TODO Dangerous reference to unknown state vars.
+       It is probably free walking. */
+    if (look.free_dist2 == 0 && look.counter < 64) {
+      play(sounds, Audio::TypeSfxTreeFall);
+    }
+  }
+}
+
+void
+sawmiller_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80) {
+    step_sound(look, t == 0xb3 || t == 0xbb || t == 0xc3 || t == 0xcb,
+               t == 0xb7 || t == 0xbf || t == 0xc7 || t == 0xcf,
+               Audio::TypeSfxSawing, sounds);
+  }
+}
+
+void
+stonecutter_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80) {
+    step_sound(look, t == 0x85, t == 0x86, Audio::TypeSfxPickBlow, sounds);
+  }
+}
+
+void
+forester_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80) {
+    step_sound(look, t == 0x86, t == 0x87, Audio::TypeSfxPlanting, sounds);
+  }
+}
+
+void
+fisher_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80 && t != 0x80 && t != 0x87 && t != 0x88 && t != 0x8f) {
+    play(sounds, Audio::TypeSfxFishingRodReel);
+  }
+}
+
+void
+butcher_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80) {
+    step_sound(look, false, t == 0xb2 || t == 0xba || t == 0xc2 || t == 0xca,
+               Audio::TypeSfxBackswordBlow, sounds);
+  }
+}
+
+void
+farmer_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80 && look.free_dist1 != 0) {
+    step_sound(look, t == 0x83, t == 0x84, Audio::TypeSfxMowing, sounds);
+  }
+}
+
+void
+boatbuilder_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80) {
+    step_sound(look, t == 0x84, t == 0x85, Audio::TypeSfxWoodHammering,
+               sounds);
+  }
+}
+
+void
+toolmaker_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t < 0x80) {
+    return;
+  }
+  if (t == 0x83 || (t == 0xb2 && !look.playing_sfx)) {
+    start(sounds, Audio::TypeSfxSawing);
+  } else if (t == 0x87 || (t == 0xb6 && !look.playing_sfx)) {
+    start(sounds, Audio::TypeSfxWoodHammering);
+  } else if (t != 0xb2 && t != 0xb6) {
+    stop(sounds);
+  }
+}
+
+void
+weaponsmith_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t >= 0x80) {
+    step_sound(look, t == 0x83, t == 0x84, Audio::TypeSfxMetalHammering,
+               sounds);
+  }
+}
+
+void
+geologist_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if (t < 0x80) {
+    return;
+  }
+  if (t == 0x83 || t == 0x84 || t == 0x86) {
+    if (t == 0x83 || !look.playing_sfx) {
+      start(sounds, Audio::TypeSfxGeologistSampling);
+    }
+  } else if (t == 0x8c || t == 0x8d) {
+    if (t == 0x8c || !look.playing_sfx) {
+      start(sounds, Audio::TypeSfxResourceFound);
+    }
+  } else {
+    stop(sounds);
+  }
+}
+
+void
+knight_sounds(const SerfLook &look, SerfSounds *sounds) {
+  if (look.sprite < 0x80 || look.sprite >= 0xc0 ||
+      (look.state != Serf::StateKnightAttacking &&
+       look.state != Serf::StateKnightAttackingFree)) {
+    return;
+  }
+  if (look.counter >= 24 || look.counter < 8) {
+    stop(sounds);
+  } else if (!look.playing_sfx) {
+    if (look.attacking_field_d == 0 || look.attacking_field_d == 4) {
+      start(sounds, Audio::TypeSfxFight01);
+    } else if (look.attacking_field_d == 2) {
+      /* TODO when is TypeSfxFight02 played? */
+      start(sounds, Audio::TypeSfxFight03);
+    } else {
+      start(sounds, Audio::TypeSfxFight04);
+    }
+  }
+}
+
+void
+dead_sounds(const SerfLook &look, SerfSounds *sounds) {
+  int t = look.sprite;
+  if ((!look.playing_sfx && (t == 2 || t == 5)) || t == 1 || t == 4) {
+    start(sounds, Audio::TypeSfxSerfDying);
+  } else {
+    stop(sounds);
+  }
+}
+
+constexpr SerfBodyRule serf_body_rules[] = {
+  /* Transporter */
+  { 0, 0, nullptr, 0, 0, transporter_body, nullptr },
+  /* Sailor */
+  { 0, 0, nullptr, 0, 0, sailor_body, sailor_sounds },
+  /* Digger */
+  { 0x300, 0, nullptr, 0x380, 0, nullptr, digger_sounds },
+  /* Builder */
+  { 0x500, 0, nullptr, 0x580, 0, nullptr, builder_sounds },
+  /* Transporter in inventory */
+  { 0, 0, nullptr, 0, 0, inventory_transporter_body, nullptr },
+  /* Lumberjack */
+  { 0xb00, 0x1000, nullptr, 0xe80, 0x86, nullptr, lumberjack_sounds },
+  /* Sawmiller */
+  { 0xc00, 0, sawmiller_carried, 0x1580, 0, nullptr, sawmiller_sounds },
+  /* Stonecutter */
+  { 0xd00, 0x1200, nullptr, 0x1280, 0x86, nullptr, stonecutter_sounds },
+  /* Forester */
+  { 0xe00, 0, nullptr, 0x1080, 0x87, nullptr, forester_sounds },
+  /* Miner */
+  { 0, 0, nullptr, 0, 0, miner_body, nullptr },
+  /* Smelter */
+  { 0x1900, 0, smelter_carried, 0x2980, 0, nullptr, nullptr },
+  /* Fisher */
+  { 0, 0, nullptr, 0, 0, fisher_body, fisher_sounds },
+  /* Pig farmer */
+  { 0x3200, 0, pig_farmer_carried, 0x3280, 0, nullptr, nullptr },
+  /* Butcher */
+  { 0x3700, 0, butcher_carried, 0x3780, 0, nullptr, butcher_sounds },
+  /* Farmer */
+  { 0, 0, nullptr, 0, 0, farmer_body, farmer_sounds },
+  /* Miller */
+  { 0x4300, 0, miller_carried, 0x4380, 0, nullptr, nullptr },
+  /* Baker */
+  { 0x4800, 0, baker_carried, 0x4880, 0, nullptr, nullptr },
+  /* Boat builder */
+  { 0x4e00, 0, boatbuilder_carried, 0x4e80, 0, nullptr, boatbuilder_sounds },
+  /* Toolmaker */
+  { 0x5800, 0, toolmaker_carried, 0x5880, 0, nullptr, toolmaker_sounds },
+  /* Weapon smith */
+  { 0x5200, 0, weaponsmith_carried, 0x5280, 0, nullptr, weaponsmith_sounds },
+  /* Geologist */
+  { 0x3900, 0, nullptr, 0x4c80, 0, nullptr, geologist_sounds },
+  /* Generic */
+  { 0, 0, nullptr, 0, 0, transporter_body, nullptr },
+  /* Knights */
+  { 0, 0, nullptr, 0, 0, knight_body, knight_sounds },
+  { 0, 0, nullptr, 0, 0, knight_body, knight_sounds },
+  { 0, 0, nullptr, 0, 0, knight_body, knight_sounds },
+  { 0, 0, nullptr, 0, 0, knight_body, knight_sounds },
+  { 0, 0, nullptr, 0, 0, knight_body, knight_sounds },
+  /* Dead */
+  { 0x8700, 0, nullptr, 0x8700, 0, nullptr, dead_sounds },
+};
+
+static_assert(sizeof(serf_body_rules) / sizeof(serf_body_rules[0]) ==
+              Serf::TypeDead + 1, "a body rule for each serf type");
+
+/* Buildings. */
+
+typedef SpriteTables::BuildingLook BuildingLook;
+
+constexpr BuildingLook building_looks[] = {
+  /* None */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Fisher */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Lumberjack */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Boat builder */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraBoat },
+  /* Stonecutter */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Stone mine, coal mine, iron mine, gold mine */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraElevator },
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraElevator },
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraElevator },
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraElevator },
+  /* Forester */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Stock */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Hut */
+  { -14, 2, 2.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Farm */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Butcher */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Pig farm */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraPigs },
+  /* Mill */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraMillSails },
+  /* Baker */
+  { 0, 0, 0.f, 5, -21, 154, false, SpriteTables::ExtraNone },
+  /* Sawmill */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Steel smelter */
+  { 0, 0, 0.f, 6, -32, 128, true, SpriteTables::ExtraNone },
+  /* Tool maker */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Weapon smith */
+  { 0, 0, 0.f, -16, -21, 128, false, SpriteTables::ExtraNone },
+  /* Tower */
+  { 13, -18, 1.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+  /* Fortress */
+  { -12, -21, 0.5f, 0, 0, 0, false, SpriteTables::ExtraSecondFlag },
+  /* Gold smelter */
+  { 0, 0, 0.f, -7, -33, 128, true, SpriteTables::ExtraNone },
+  /* Castle */
+  { 0, 0, 0.f, 0, 0, 0, false, SpriteTables::ExtraNone },
+};
+
+static_assert(sizeof(building_looks) / sizeof(building_looks[0]) ==
+              Building::TypeCastle + 1, "a look for each building type");
+
+/* Flames of burning buildings, a list for each type, see
+   get_burn_animation(). */
+constexpr int building_burn_animation[] = {
+  /* Unfinished */
+  0, -8, 2,
+  8, 0, 4,
+  0, 8, 2, -1,
+
+  /* Fisher */
+  0, -8, -10,
+  0, 4, -12,
+  8, -8, 4,
+  8, 7, 4,
+  0, -2, 8, -1,
+
+  /* Lumberjack */
+  0, 3, -13,
+  0, -8, -10,
+  8, 9, 3,
+  8, -6, 3, -1,
+
+  /* Boat builder */
+  0, -1, -12,
+  8, -8, 11,
+  8, 7, 5, -1,
+
+  /* Stone cutter */
+  0, 6, -14,
+  0, -9, -11,
+  8, -8, 5,
+  8, 6, 5, -1,
+
+  /* Stone mine */
+  8, -4, -40,
+  8, -8, -15,
+  8, 3, -14,
+  8, -9, 4,
+  8, 6, 5, -1,
+
+  /* Coal mine */
+  8, -4, -40,
+  8, -1, -18,
+  8, -8, -15,
+  8, 6, 2,
+  8, 0, 8,
+  8, -8, 9, -1,
+
+  /* Iron mine, gold mine */
+  8, -4, -40,
+  8, -2, -19,
+  8, -9, -14,
+  8, -8, 2,
+  8, 6, 2,
+  0, -4, 8, -1,
+
+  /* Forester */
+  0, 8, -11,
+  0, -6, -8,
+  8, -8, 4,
+  8, 6, 4, -1,
+
+  /* Stock */
+  0, -2, -25,
+  0, 6, -17,
+  0, -9, -16,
+  8, -21, 1,
+  8, 21, 2,
+  0, 15, 18,
+  0, -16, 10,
+  8, -8, 15,
+  8, 5, 15, -1,
+
+  /* Hut */
+  0, 0, -11,
+  8, -8, 5,
+  8, 8, 5, -1,
+
+  /* Farm */
+  8, 22, -2,
+  8, 7, -5,
+  8, -3, -1,
+  8, -23, 0,
+  8, -12, 4,
+  0, 25, 5,
+  0, 21, 13,
+  0, -17, 8,
+  0, -10, 15,
+  0, -2, 15, -1,
+
+  /* Butcher */
+  8, -15, 3,
+  8, 20, 3,
+  8, 7, 3,
+  8, -4, 3, -1,
+
+  /* Pig farm */
+  8, 0, -2,
+  8, 22, 1,
+  8, 15, 5,
+  8, -20, -1,
+  8, -11, 3,
+  0, 20, 12,
+  0, -16, 7,
+  0, -12, 14, -1,
+
+  /* Mill */
+  0, 7, -33,
+  0, 5, -20,
+  8, -2, -24,
+  8, -6, 1,
+  8, 4, 2,
+  0, -3, 6, -1,
+
+  /* Baker */
+  0, -15, -16,
+  0, -4, -19,
+  0, 3, -16,
+  8, -13, 2,
+  8, -9, 7,
+  8, 6, 7,
+  0, 17, 1, -1,
+
+  /* Saw mill */
+  0, 7, -19,
+  0, -1, -14,
+  0, 16, -13,
+  0, 5, -8,
+  8, 14, 4,
+  0, 10, 9,
+  0, -17, 8,
+  8, -11, 10,
+  8, -1, 12, -1,
+
+  /* Steel smelter */
+  0, 5, -19,
+  0, 16, -16,
+  8, -14, 2,
+  8, -10, 5,
+  8, 15, 5,
+  8, 2, 5, -1,
+
+  /* Tool maker */
+  8, 7, -19,
+  0, -11, -17,
+  0, -4, -11,
+  0, 12, -10,
+  8, -20, 0,
+  8, -15, 7,
+  8, 1, 7,
+  8, 15, 7, -1,
+
+  /* Weapon smith */
+  8, -15, 1,
+  8, -10, 3,
+  8, 20, 3,
+  8, 5, 3, -1,
+
+  /* Tower */
+  0, -6, -30,
+  0, 7, -14,
+  8, -11, -3,
+  0, -8, 4,
+  8, 9, 5,
+  8, -4, 5, -1,
+
+  /* Fortress */
+  0, -3, -30,
+  0, -15, -26,
+  0, 21, -29,
+  0, -13, -17,
+  8, 4, -11,
+  8, -2, -6,
+  8, -22, 0,
+  8, -17, 8,
+  8, 20, 1,
+  8, 10, 8,
+  8, 4, 13,
+  8, -11, 15, -1,
+
+  /* Gold smelter */
+  0, -15, -20,
+  0, 10, -22,
+  0, -3, -25,
+  0, -8, -10,
+  0, 7, -10,
+  0, -13, 2,
+  8, -8, 5,
+  8, 6, 5,
+  0, 16, 6, -1,
+
+  /* Castle */
+  0, 11, -46,
+  0, -19, -42,
+  8, 1, -27,
+  8, 10, -13,
+  0, -7, -24,
+  8, -16, -6,
+  0, -23, 4,
+  8, -2, 0,
+  8, 12, 12,
+  8, -14, 17,
+  8, -4, 19,
+  0, 13, 19, -1
+};
+
+/* The list of each building type, unfinished buildings first. Iron and
+   gold mines burn alike. */
+constexpr int burn_list_of_type[] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+  20, 21, 22, 23
+};
+const int burn_list_count = 24;
+
+typedef struct BurnOffsets {
+  int list[burn_list_count];
+} BurnOffsets;
+
+constexpr BurnOffsets
+find_burn_offsets() {
+  BurnOffsets offsets = {};
+  int i = 0;
+  for (int list = 0; list < burn_list_count; list++) {
+    offsets.list[list] = i;
+    while (building_burn_animation[i] >= 0) {
+      i += 3;
+    }
+    i++;
+  }
+  return offsets;
+}
+
+constexpr BurnOffsets burn_offsets = find_burn_offsets();
+
+static_assert(burn_offsets.list[14] == 236 && burn_offsets.list[23] == 446,
+              "flame lists where they always were");
+static_assert(sizeof(burn_list_of_type) / sizeof(burn_list_of_type[0]) ==
+              Building::TypeCastle + 1, "flames for each building type");
+
+}  // namespace
+
+SpriteTables::SerfLook
+SpriteTables::get_serf_look(const Serf *serf, int sprite) {
+  SerfLook look;
+  look.type = serf->get_type();
+  look.state = serf->get_state();
+  look.sprite = sprite;
+  look.counter = serf->get_counter();
+  look.delivery = serf->get_delivery();
+  look.playing_sfx = serf->playing_sfx();
+  look.free_dist1 = serf->get_free_walking_neg_dist1();
+  look.free_dist2 = serf->get_free_walking_neg_dist2();
+  look.mining_res = serf->get_mining_res();
+  look.leaving_next_state = serf->get_leaving_building_next_state();
+  look.leaving_res = serf->get_leaving_building_field_B();
+  look.attacking_field_d = serf->get_attacking_field_D();
+  return look;
+}
+
+int
+SpriteTables::get_serf_body(const SerfLook &look) {
+  if (look.type < Serf::TypeTransporter || look.type > Serf::TypeDead) {
+    NOT_REACHED();
+    return look.sprite;
+  }
+  const SerfBodyRule &rule = serf_body_rules[look.type];
+  if (rule.hook != nullptr) {
+    return rule.hook(look);
+  }
+
+  int t = look.sprite;
+  if (t < 0x80) {
+    if (rule.carried != nullptr && is_carrying_out(look)) {
+      return t + get_carried_offset(rule.carried, look.leaving_res - 1);
+    }
+    if (rule.outdoors != 0 && is_walking_out(look)) {
+      return t + rule.outdoors;
+    }
+    return t + rule.walking;
+  }
+  if (rule.held != 0 && t == rule.held && look.playing_sfx) {
+    return t;
+  }
+  return t + rule.working;
+}
+
+SpriteTables::SerfSounds
+SpriteTables::get_serf_sounds(const SerfLook &look) {
+  SerfSounds sounds = { 0, {}, PlayingKeep };
+  if (look.type < Serf::TypeTransporter || look.type > Serf::TypeDead) {
+    return sounds;
+  }
+  const SerfBodyRule &rule = serf_body_rules[look.type];
+  if (rule.sounds != nullptr) {
+    rule.sounds(look, &sounds);
+  }
+  return sounds;
+}
+
+const SpriteTables::BuildingLook &
+SpriteTables::get_building_look(Building::Type type) {
+  return building_looks[type];
+}
+
+const int *
+SpriteTables::get_burn_animation(Building::Type type) {
+  return building_burn_animation + burn_offsets.list[burn_list_of_type[type]];
+}
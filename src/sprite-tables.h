@@ -0,0 +1,93 @@
+/*
+ * sprite-tables.h - Sprites of serfs and buildings by type and state
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_SPRITE_TABLES_H_
+#define SRC_SPRITE_TABLES_H_
+
+#include "src/audio.h"
+#include "src/building.h"
+#include "src/serf.h"
+
+// Which sprites the viewport draws for a serf or a building, looked up in
+// tables made at compile time by type, with the few special cases as small
+// hooks. Nothing here draws, so the lookups work without a viewport.
+class SpriteTables {
+ public:
+  // What the body of a serf depends on, read off the serf.
+  typedef struct SerfLook {
+    Serf::Type type;
+    Serf::State state;
+    int sprite;        // Of the animation frame
+    int counter;
+    int delivery;
+    bool playing_sfx;
+    int free_dist1;    // get_free_walking_neg_dist1() and 2
+    int free_dist2;
+    int mining_res;
+    int leaving_next_state;
+    int leaving_res;   // get_leaving_building_field_B()
+    int attacking_field_d;
+  } SerfLook;
+
+  // Sound effects a body step plays, and whether the serf starts or stops
+  // playing them.
+  typedef enum Playing {
+    PlayingKeep = -1,
+    PlayingStop = 0,
+    PlayingStart = 1,
+  } Playing;
+  typedef struct SerfSounds {
+    int count;
+    Audio::TypeSfx sound[2];
+    Playing playing;
+  } SerfSounds;
+
+  static SerfLook get_serf_look(const Serf *serf, int sprite);
+  // The serf torso sprite, or -1 for a serf not drawn.
+  static int get_serf_body(const SerfLook &look);
+  static SerfSounds get_serf_sounds(const SerfLook &look);
+
+  // Drawn on top of a finished building, besides its sprite.
+  typedef enum BuildingExtra {
+    ExtraNone = 0,
+    ExtraBoat,         // The boat being built
+    ExtraElevator,     // Mine elevator, drawn before the building
+    ExtraPigs,
+    ExtraMillSails,    // Turns the building sprite while working
+    ExtraSecondFlag,   // A second occupation flag
+  } BuildingExtra;
+  typedef struct BuildingLook {
+    int flag_x, flag_y;   // Occupation flag, if flag_mul isn't 0
+    float flag_mul;       // Flag height per knight
+    int work_x, work_y;   // Eight frames drawn while working, if work_sprite
+    int work_sprite;      // isn't 0
+    bool work_boils;      // The frames play a boiling sound
+    BuildingExtra extra;
+  } BuildingLook;
+
+  static const BuildingLook &get_building_look(Building::Type type);
+
+  // Flames of a burning building, unfinished ones as TypeNone: the frame
+  // offset and the position of each flame, ending with -1.
+  static const int *get_burn_animation(Building::Type type);
+};
+
+#endif  // SRC_SPRITE_TABLES_H_
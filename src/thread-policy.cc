@@ -0,0 +1,315 @@
+/*
+ * thread-policy.cc - Priorities and cores of the threads by what they do
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/thread-policy.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <sstream>
+
+#include "src/configfile.h"
+#include "src/log.h"
+
+namespace {
+
+typedef enum Outcome {
+  OutcomeNone = 0,   // No thread of the role applied it yet
+  OutcomeApplied,
+  OutcomeFailed,
+} Outcome;
+
+std::mutex policy_mutex;
+ThreadPolicy::Setting settings[ThreadPolicy::RoleCount] = {
+  { ThreadPolicy::PriorityNormal, {} },
+  { ThreadPolicy::PriorityNormal, {} },
+  { ThreadPolicy::PriorityLow, {} },
+  { ThreadPolicy::PriorityLowest, {} },
+};
+Outcome outcomes[ThreadPolicy::RoleCount] = {};
+std::string failures[ThreadPolicy::RoleCount];
+
+const char *role_names[ThreadPolicy::RoleCount] = {
+  "simulation", "render", "ai", "io" };
+const char *priority_names[] = { "lowest", "low", "normal", "high" };
+
+#ifdef _WIN32
+
+bool
+set_priority(ThreadPolicy::Priority priority, std::string *error) {
+  const int levels[] = { THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL,
+                         THREAD_PRIORITY_NORMAL,
+                         THREAD_PRIORITY_ABOVE_NORMAL };
+  if (!SetThreadPriority(GetCurrentThread(), levels[priority])) {
+    *error = "SetThreadPriority failed with " +
+             std::to_string(GetLastError());
+    return false;
+  }
+  return true;
+}
+
+bool
+set_cores(const std::vector<unsigned int> &cores, std::string *error) {
+  DWORD_PTR mask = 0;
+  for (unsigned int core : cores) {
+    if (core >= sizeof(mask) * 8) {
+      *error = "core " + std::to_string(core) + " is out of range";
+      return false;
+    }
+    mask |= static_cast<DWORD_PTR>(1) << core;
+  }
+  if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+    *error = "SetThreadAffinityMask failed with " +
+             std::to_string(GetLastError());
+    return false;
+  }
+  return true;
+}
+
+#elif defined(__linux__)
+
+// Each thread is a task with a nice value of its own.
+bool
+set_priority(ThreadPolicy::Priority priority, std::string *error) {
+  const int nice_values[] = { 10, 5, 0, -5 };
+  pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+  if (setpriority(PRIO_PROCESS, tid, nice_values[priority]) != 0) {
+    *error = std::string("setpriority: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool
+set_cores(const std::vector<unsigned int> &cores, std::string *error) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned int core : cores) {
+    if (core >= CPU_SETSIZE) {
+      *error = "core " + std::to_string(core) + " is out of range";
+      return false;
+    }
+    CPU_SET(core, &set);
+  }
+  int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (result != 0) {
+    *error = std::string("pthread_setaffinity_np: ") + std::strerror(result);
+    return false;
+  }
+  return true;
+}
+
+#else
+
+// Elsewhere the nice value is the process's, so the priority is set within
+// the normal scheduling policy instead, normal in the middle of its range.
+bool
+set_priority(ThreadPolicy::Priority priority, std::string *error) {
+  int low = sched_get_priority_min(SCHED_OTHER);
+  int high = sched_get_priority_max(SCHED_OTHER);
+  int middle = (low + high) / 2;
+  const int levels[] = { low, (low + middle) / 2, middle,
+                         (middle + high) / 2 };
+  sched_param param = {};
+  param.sched_priority = levels[priority];
+  int result = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+  if (result != 0) {
+    *error = std::string("pthread_setschedparam: ") + std::strerror(result);
+    return false;
+  }
+  return true;
+}
+
+bool
+set_cores(const std::vector<unsigned int> & /*cores*/, std::string *error) {
+  *error = "cores cannot be chosen on this system";
+  return false;
+}
+
+#endif  // _WIN32
+
+}  // namespace
+
+const char *
+ThreadPolicy::get_role_name(Role role) {
+  return role_names[role];
+}
+
+ThreadPolicy::Setting
+ThreadPolicy::get(Role role) {
+  std::lock_guard<std::mutex> lock(policy_mutex);
+  return settings[role];
+}
+
+void
+ThreadPolicy::set(Role role, const Setting &setting) {
+  std::lock_guard<std::mutex> lock(policy_mutex);
+  settings[role] = setting;
+}
+
+// PRIORITY[@CORES], the cores a list of numbers and ranges like 0-3,6.
+bool
+ThreadPolicy::parse_setting(const std::string &text, Setting *setting) {
+  std::string priority = text;
+  std::string cores;
+  size_t at = text.find('@');
+  if (at != std::string::npos) {
+    priority = text.substr(0, at);
+    cores = text.substr(at + 1);
+  }
+  priority = ConfigFile::trim(priority);
+  bool known = false;
+  for (int i = 0; i <= PriorityHigh; i++) {
+    if (priority == priority_names[i]) {
+      setting->priority = static_cast<Priority>(i);
+      known = true;
+    }
+  }
+  if (!known) {
+    return false;
+  }
+
+  setting->cores.clear();
+  std::stringstream list(cores);
+  std::string range;
+  while (std::getline(list, range, ',')) {
+    unsigned int first = 0;
+    unsigned int last = 0;
+    char dash = 0;
+    std::stringstream s(ConfigFile::trim(range));
+    if (!(s >> first)) {
+      return false;
+    }
+    last = first;
+    if (s >> dash) {
+      if (dash != '-' || !(s >> last) || last < first) {
+        return false;
+      }
+    }
+    for (unsigned int core = first; core <= last; core++) {
+      setting->cores.push_back(core);
+    }
+  }
+  return true;
+}
+
+bool
+ThreadPolicy::parse(const std::string &spec) {
+  size_t equals = spec.find('=');
+  if (equals == std::string::npos) {
+    return false;
+  }
+  std::string name = ConfigFile::trim(spec.substr(0, equals));
+  for (int i = 0; i < RoleCount; i++) {
+    if (name == role_names[i]) {
+      Setting setting;
+      if (!parse_setting(spec.substr(equals + 1), &setting)) {
+        return false;
+      }
+      set(static_cast<Role>(i), setting);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+ThreadPolicy::load(const ConfigFile &file) {
+  bool ok = true;
+  for (int i = 0; i < RoleCount; i++) {
+    if (!file.contains("threads", role_names[i])) {
+      continue;
+    }
+    Setting setting;
+    if (parse_setting(file.value("threads", role_names[i], ""), &setting)) {
+      set(static_cast<Role>(i), setting);
+    } else {
+      Log::Warn["threads"] << "could not read the setting of "
+                           << role_names[i] << " threads";
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool
+ThreadPolicy::apply(Role role) {
+  Setting setting = get(role);
+  std::string error;
+  bool ok = set_priority(setting.priority, &error);
+  if (ok && !setting.cores.empty()) {
+    ok = set_cores(setting.cores, &error);
+  }
+
+  std::lock_guard<std::mutex> lock(policy_mutex);
+  if (ok) {
+    if (outcomes[role] == OutcomeNone) {
+      outcomes[role] = OutcomeApplied;
+    }
+    return true;
+  }
+  if (outcomes[role] != OutcomeFailed) {
+    outcomes[role] = OutcomeFailed;
+    failures[role] = error;
+    Log::Warn["threads"] << "could not give a " << role_names[role]
+                         << " thread " << describe(setting) << ": " << error;
+  }
+  return false;
+}
+
+std::string
+ThreadPolicy::describe(const Setting &setting) {
+  std::stringstream s;
+  s << priority_names[setting.priority] << " priority";
+  if (setting.cores.empty()) {
+    s << " on any core";
+  } else {
+    s << " on cores ";
+    for (size_t i = 0; i < setting.cores.size(); i++) {
+      s << ((i > 0) ? "," : "") << setting.cores[i];
+    }
+  }
+  return s.str();
+}
+
+void
+ThreadPolicy::report() {
+  for (int i = 0; i < RoleCount; i++) {
+    Setting setting = get(static_cast<Role>(i));
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    Log::Info["threads"] << role_names[i] << ": " << describe(setting)
+                         << ((outcomes[i] == OutcomeApplied) ? ", applied" :
+                             (outcomes[i] == OutcomeFailed) ?
+                             ", not applied (" + failures[i] + ")" : "");
+  }
+}
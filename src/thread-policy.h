@@ -0,0 +1,83 @@
+/*
+ * thread-policy.h - Priorities and cores of the threads by what they do
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_THREAD_POLICY_H_
+#define SRC_THREAD_POLICY_H_
+
+#include <string>
+#include <vector>
+
+class ConfigFile;
+
+// The OS priority, and optionally the cores, each thread gets for its role,
+// so that busy AI players do not take the CPU from the ticks and the
+// frames. Each thread applies the setting of its role to itself when it
+// starts. By default the AI runs a step below normal and loading and saving
+// two steps below, while the game and the drawing stay normal; raising a
+// thread above normal usually takes privileges the game does not have, in
+// which case the thread runs on as it was and the failure is logged.
+class ThreadPolicy {
+ public:
+  typedef enum Role {
+    RoleSimulation = 0,  // Game ticks, where they have a thread of their own
+    RoleRender,          // The window: events, drawing and, between frames,
+                         // the game ticks
+    RoleAI,              // AIPool workers
+    RoleIO,              // Autosave, sprite and sound decoding
+    RoleCount
+  } Role;
+
+  typedef enum Priority {
+    PriorityLowest = 0,
+    PriorityLow,
+    PriorityNormal,
+    PriorityHigh,
+  } Priority;
+
+  typedef struct Setting {
+    Priority priority;
+    std::vector<unsigned int> cores;  // Any core if empty
+  } Setting;
+
+  static const char *get_role_name(Role role);
+  static Setting get(Role role);
+  static void set(Role role, const Setting &setting);
+
+  // A setting as ROLE=PRIORITY[@CORES], e.g. "ai=low@2-3,6". False if it
+  // could not be read, and nothing is changed.
+  static bool parse(const std::string &spec);
+  // The roles set in the [threads] section of file, as ROLE = PRIORITY[@CORES].
+  static bool load(const ConfigFile &file);
+
+  // Give the calling thread the priority and cores of role. False if the
+  // OS refused either; that is logged the first time for each role.
+  static bool apply(Role role);
+
+  // Log the setting of each role, and how applying it went for the roles
+  // a thread has applied so far.
+  static void report();
+
+ protected:
+  static bool parse_setting(const std::string &text, Setting *setting);
+  static std::string describe(const Setting &setting);
+};
+
+#endif  // SRC_THREAD_POLICY_H_
@@ -0,0 +1,224 @@
+/*
+ * tick-watchdog.cc - Capture what happened when an update runs long
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/tick-watchdog.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "src/game.h"
+#include "src/log.h"
+#include "src/thread-policy.h"
+#include "src/trace.h"
+
+const size_t TickWatchdog::trace_events_per_thread;
+
+TickWatchdog::TickWatchdog()
+  : update_budget_ns(0)
+  , ai_loop_budget_ns(0)
+  , ai_overrun(false)
+  , overruns(0)
+  , prefix("overrun-")
+  , window(std::chrono::seconds(5))
+  , min_interval(std::chrono::seconds(60))
+  , captured(false)
+  , writing(false)
+  , stopping(false)
+  , captures(0) {
+  last.tick = 0;
+  last.saved = false;
+}
+
+TickWatchdog::~TickWatchdog() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void
+TickWatchdog::set_budgets(unsigned int update_ms, unsigned int ai_loop_ms) {
+  update_budget_ns = static_cast<uint64_t>(update_ms) * 1000000;
+  ai_loop_budget_ns = static_cast<uint64_t>(ai_loop_ms) * 1000000;
+  if ((update_ms != 0 || ai_loop_ms != 0) && !Trace::is_active()) {
+    // a trace started for its own sake is left as it is
+    Trace::start(std::string(), trace_events_per_thread);
+  }
+}
+
+void
+TickWatchdog::set_prefix(const std::string &_prefix) {
+  std::unique_lock<std::mutex> lock(mutex);
+  prefix = _prefix;
+}
+
+void
+TickWatchdog::set_window(unsigned int seconds) {
+  std::unique_lock<std::mutex> lock(mutex);
+  window = std::chrono::seconds(seconds);
+}
+
+void
+TickWatchdog::set_min_interval(unsigned int seconds) {
+  std::unique_lock<std::mutex> lock(mutex);
+  min_interval = std::chrono::seconds(seconds);
+}
+
+void
+TickWatchdog::check_ai_loop(unsigned int player, uint64_t step_ns) {
+  uint64_t budget = ai_loop_budget_ns.load(std::memory_order_relaxed);
+  if (budget == 0 || step_ns <= budget) {
+    return;
+  }
+  std::ostringstream reason;
+  reason << "AI loop of player " << player << " took " << std::fixed
+         << std::setprecision(1) << step_ns / 1e6 << " ms";
+  std::unique_lock<std::mutex> lock(mutex);
+  ai_reason = reason.str();
+  ai_overrun = true;
+}
+
+void
+TickWatchdog::overrun(Game *game, Clock::duration took) {
+  std::string reason;
+  if (ai_overrun.exchange(false)) {
+    std::unique_lock<std::mutex> lock(mutex);
+    reason = ai_reason;
+  } else {
+    std::ostringstream update_reason;
+    update_reason << "update of tick " << game->get_tick() << " took "
+                  << std::fixed << std::setprecision(1)
+                  << std::chrono::duration<double, std::milli>(took).count()
+                  << " ms";
+    reason = update_reason.str();
+  }
+  overruns++;
+  capture(game, reason);
+}
+
+void
+TickWatchdog::capture(Game *game, const std::string &reason) {
+  Clock::time_point now = Clock::now();
+  std::string path;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (captured && now - last_capture < min_interval) {
+      return;
+    }
+    path = prefix + std::to_string(game->get_tick());
+  }
+  captured = true;
+  last_capture = now;
+
+  // as the autosave does, saving wakes the sleeping serfs
+  game->get_mutex()->lock(LOCK_SITE());
+  PSaveWriter writer = GameStore::get_instance().take_snapshot(game);
+  game->get_mutex()->unlock();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  if (pending) {
+    Log::Warn["watchdog"] << "dropping the capture for "
+                          << pending_capture.save_path
+                          << ", the one before it is still being written";
+  }
+  pending = writer;
+  pending_capture.reason = reason;
+  pending_capture.trace_path = path + ".trace.json";
+  pending_capture.save_path = path + ".save";
+  pending_capture.tick = game->get_tick();
+  pending_capture.saved = false;
+  pending_time = now;
+  if (!thread.joinable()) {
+    thread = std::thread(&TickWatchdog::run, this);
+  }
+  changed.notify_all();
+}
+
+void
+TickWatchdog::run() {
+  Trace::set_thread_name("watchdog");
+  ThreadPolicy::apply(ThreadPolicy::RoleIO);
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    changed.wait(lock, [this]() { return pending || stopping; });
+    if (!pending) {
+      return;
+    }
+    PSaveWriter writer = std::move(pending);
+    pending.reset();
+    Capture capture = pending_capture;
+    // up to the overrun, and what came since
+    Clock::duration trace_window = window + (Clock::now() - pending_time);
+    writing = true;
+    lock.unlock();
+
+    bool traced = false;
+    {
+      std::ofstream trace(capture.trace_path);
+      if (trace.is_open()) {
+        Trace::write_json(&trace, trace_window);
+        traced = trace.good();
+      }
+    }
+    capture.saved = GameStore::get_instance().save(capture.save_path, writer,
+                                                   GameStore::FormatCompact) &&
+                    traced;
+    writer.reset();
+    if (capture.saved) {
+      Log::Warn["watchdog"] << capture.reason << ", wrote "
+                            << capture.trace_path << " and "
+                            << capture.save_path;
+    } else {
+      Log::Error["watchdog"] << capture.reason << ", failed to write "
+                             << capture.trace_path << " or "
+                             << capture.save_path;
+    }
+
+    lock.lock();
+    writing = false;
+    captures++;
+    last = capture;
+    changed.notify_all();
+  }
+}
+
+void
+TickWatchdog::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this]() { return !pending && !writing; });
+}
+
+unsigned int
+TickWatchdog::get_capture_count() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return captures;
+}
+
+TickWatchdog::Capture
+TickWatchdog::get_last_capture() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return last;
+}
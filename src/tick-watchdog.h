@@ -0,0 +1,122 @@
+/*
+ * tick-watchdog.h - Capture what happened when an update runs long
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_TICK_WATCHDOG_H_
+#define SRC_TICK_WATCHDOG_H_
+
+#include <atomic>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <condition_variable>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <string>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+#include "src/profiler.h"
+#include "src/savegame.h"
+
+class Game;
+
+// Turns an update or AI loop that took longer than its budget into files
+// to look at: the trace of the last seconds before it and a save of the
+// game right after it. Once a budget is set, tracing is kept running so
+// there is something to write. The game thread takes the save at the end
+// of the slow update, or of the next one for a slow AI loop, and a thread
+// of its own writes both files while the game goes on. Captures are at
+// least min_interval apart, the overruns in between are only counted.
+class TickWatchdog {
+ public:
+  typedef Profiler::Clock Clock;
+
+  // Per thread, enough for some seconds of a busy game
+  static const size_t trace_events_per_thread = 1 << 16;
+
+  typedef struct Capture {
+    std::string reason;
+    std::string trace_path;
+    std::string save_path;
+    unsigned int tick;
+    bool saved;
+  } Capture;
+
+ protected:
+  std::atomic<uint64_t> update_budget_ns;   // 0 for none
+  std::atomic<uint64_t> ai_loop_budget_ns;
+  std::atomic<bool> ai_overrun;   // for the end of the next update
+  std::atomic<unsigned int> overruns;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread thread;
+  std::string prefix;
+  Clock::duration window;
+  Clock::duration min_interval;
+  std::string ai_reason;
+  // only used by the game thread
+  Clock::time_point last_capture;
+  bool captured;
+  // to be written
+  PSaveWriter pending;
+  Capture pending_capture;
+  Clock::time_point pending_time;
+  bool writing;
+  bool stopping;
+  unsigned int captures;
+  Capture last;
+
+  void capture(Game *game, const std::string &reason);
+  void run();
+
+ public:
+  TickWatchdog();
+  // writes the capture that is waiting, if any, first
+  virtual ~TickWatchdog();
+
+  // Budgets in milliseconds, 0 to not watch. Files go to prefix + tick +
+  // ".trace.json" and ".save".
+  void set_budgets(unsigned int update_ms, unsigned int ai_loop_ms);
+  void set_prefix(const std::string &prefix);
+  void set_window(unsigned int seconds);
+  void set_min_interval(unsigned int seconds);
+
+  // On the game thread, at the end of each update.
+  void check_update(Game *game, Clock::time_point start, Clock::time_point end) {
+    if ((update_budget_ns.load(std::memory_order_relaxed) != 0 &&
+         static_cast<uint64_t>(std::chrono::duration_cast<
+           std::chrono::nanoseconds>(end - start).count()) >
+         update_budget_ns.load(std::memory_order_relaxed)) ||
+        ai_overrun.load(std::memory_order_relaxed)) {
+      overrun(game, end - start);
+    }
+  }
+  // On an AI thread, at the end of each loop, with the time its steps took.
+  void check_ai_loop(unsigned int player, uint64_t step_ns);
+
+  // Until every capture taken so far is written.
+  void wait();
+
+  unsigned int get_overrun_count() const { return overruns; }
+  unsigned int get_capture_count();
+  Capture get_last_capture();
+
+ protected:
+  void overrun(Game *game, Clock::duration took);
+};
+
+#endif  // SRC_TICK_WATCHDOG_H_
@@ -0,0 +1,311 @@
+/*
+ * tournament.cc - Runs batches of headless AI games and merges the results
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Plays one AI-only game for every combination of seed, map size and
+// AIPlus options asked for. Each game is a freeserf-headless process run
+// with -a -w, so it stops at the tick limit or as soon as a player is the
+// clear winner, and games run side by side, one per core by default. Every
+// game leaves game-N.txt (its GameResult) and game-N.log (its output) in
+// the output folder. With -i the games are hosted on threads of this
+// process instead, sharing its AI workers, and log to its output. Once all
+// are done the results are merged into
+// tournament.csv and tournament.json there, and the wins and ticks/s for
+// each option set are logged.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/command_line.h"
+#include "src/game-host.h"
+#include "src/game-result.h"
+#include "src/log.h"
+#include "src/random.h"
+#include "src/version.h"
+
+typedef struct Match {
+  std::string seed;
+  unsigned int map_size;
+  std::string options;
+  std::string result_file;
+  std::string log_file;
+} Match;
+
+// Split a comma separated list, dropping empty parts.
+static std::vector<std::string>
+split_list(const std::string &list) {
+  std::vector<std::string> parts;
+  std::istringstream stream(list);
+  std::string part;
+  while (std::getline(stream, part, ',')) {
+    if (!part.empty()) {
+      parts.push_back(part);
+    }
+  }
+  return parts;
+}
+
+static std::string
+quote(const std::string &path) {
+  return "\"" + path + "\"";
+}
+
+int
+main(int argc, char *argv[]) {
+  std::string headless;
+  std::string folder = ".";
+  unsigned int first_seed = 1;
+  unsigned int seed_count = 10;
+  std::vector<unsigned int> map_sizes = { 3 };
+  std::vector<std::string> option_sets = { "000" };
+  unsigned int ticks = 10000;
+  unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+  unsigned int game_log_level = Log::LevelInfo;
+  bool real_time = false;
+  bool in_process = false;
+
+  CommandLine command_line;
+  command_line.add_option('b', "Path of freeserf-headless (default: next to "
+                               "this program)")
+                .add_parameter("FILE", [&headless](std::istream& s) {
+                  std::getline(s, headless);
+                  return !headless.empty();
+                });
+  command_line.add_option('c', "Number of seeds to play (default 10)")
+                .add_parameter("NUM", [&seed_count](std::istream& s) {
+                  s >> seed_count;
+                  return (seed_count > 0);
+                });
+  command_line.add_option('d', "Set Debug output level")
+                .add_parameter("NUM", [](std::istream& s) {
+                  int d;
+                  s >> d;
+                  if (d >= 0 && d < Log::LevelMax) {
+                    Log::set_level(static_cast<Log::Level>(d));
+                  }
+                  return true;
+                });
+  command_line.add_option('g', "Debug output level of the games (default 2)")
+                .add_parameter("NUM", [&game_log_level](std::istream& s) {
+                  s >> game_log_level;
+                  return (game_log_level < Log::LevelMax);
+                });
+  command_line.add_option('h', "Show this help text", [&command_line](){
+                  command_line.show_help();
+                  exit(EXIT_SUCCESS);
+                });
+  command_line.add_option('i', "Host the games in this process instead of "
+                               "running freeserf-headless for each",
+                          [&in_process](){ in_process = true; });
+  command_line.add_option('j', "Games to run at once (default: one per core)")
+                .add_parameter("NUM", [&jobs](std::istream& s) {
+                  s >> jobs;
+                  return (jobs > 0);
+                });
+  command_line.add_option('m', "Comma separated map sizes (default 3)")
+                .add_parameter("SIZES", [&map_sizes](std::istream& s) {
+                  std::string list;
+                  s >> list;
+                  map_sizes.clear();
+                  for (const std::string &part : split_list(list)) {
+                    unsigned int size = std::atoi(part.c_str());
+                    if (size < 1 || size > max_map_size) {
+                      return false;
+                    }
+                    map_sizes.push_back(size);
+                  }
+                  return !map_sizes.empty();
+                });
+  command_line.add_option('n', "Tick limit of each game (default 10000)")
+                .add_parameter("TICKS", [&ticks](std::istream& s) {
+                  s >> ticks;
+                  return (ticks > 0);
+                });
+  command_line.add_option('o', "Write results to the existing folder DIR "
+                               "(default .)")
+                .add_parameter("DIR", [&folder](std::istream& s) {
+                  std::getline(s, folder);
+                  return !folder.empty();
+                });
+  command_line.add_option('r', "Pace ticks like the real game",
+                          [&real_time](){ real_time = true; });
+  command_line.add_option('s', "First seed number (default 1)")
+                .add_parameter("NUM", [&first_seed](std::istream& s) {
+                  s >> first_seed;
+                  return true;
+                });
+  command_line.add_option('x', "Comma separated AIPlus option bits "
+                               "(default 000)")
+                .add_parameter("LIST", [&option_sets](std::istream& s) {
+                  std::string list;
+                  s >> list;
+                  option_sets = split_list(list);
+                  for (const std::string &bits : option_sets) {
+                    if (bits.find_first_not_of("01") != std::string::npos) {
+                      return false;
+                    }
+                  }
+                  return !option_sets.empty();
+                });
+  command_line.set_comment("Please report bugs to <" PACKAGE_BUGREPORT ">");
+  if (!command_line.process(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  Log::Info["tournament"] << "freeserf-tournament " << FREESERF_VERSION;
+
+  if (headless.empty()) {
+    std::string path = command_line.get_path();
+    size_t pos = path.find_last_of("\\/");
+    headless = ((pos == std::string::npos) ? std::string() :
+                path.substr(0, pos + 1)) + "freeserf-headless";
+  }
+
+  std::vector<Match> matches;
+  for (const std::string &options : option_sets) {
+    for (unsigned int map_size : map_sizes) {
+      for (unsigned int i = 0; i < seed_count; i++) {
+        Match match;
+        match.seed = std::string(Random(
+                       static_cast<uint16_t>(first_seed + i)));
+        match.map_size = map_size;
+        match.options = options;
+        std::string name = folder + "/game-" + std::to_string(matches.size());
+        match.result_file = name + ".txt";
+        match.log_file = name + ".log";
+        matches.push_back(match);
+      }
+    }
+  }
+
+  Log::Info["tournament"] << "playing " << matches.size() << " games, "
+                          << jobs << " at a time";
+
+  std::atomic<size_t> next_match(0);
+  auto play = [&]() {
+    for (size_t i = next_match++; i < matches.size(); i = next_match++) {
+      const Match &match = matches[i];
+      Log::Info["tournament"] << "game " << i << ": seed " << match.seed
+                              << ", size " << match.map_size
+                              << ", options " << match.options;
+      if (in_process) {
+        GameHost::Setup setup;
+        setup.seed = match.seed;
+        setup.map_size = match.map_size;
+        setup.options = AIPlusOptions(match.options);
+        setup.ticks = ticks;
+        setup.until_winner = true;
+        setup.real_time = real_time;
+        GameResult result;
+        std::ofstream stream(match.result_file);
+        if (!GameHost::play(setup, &result) || !result.write(&stream)) {
+          Log::Warn["tournament"] << "game " << i << " failed";
+        }
+        continue;
+      }
+      std::ostringstream command;
+      command << quote(headless) << " -a -w -d " << game_log_level
+              << " -s " << match.seed << " -m " << match.map_size
+              << " -x " << match.options << " -n " << ticks
+              << (real_time ? " -r" : "")
+              << " -o " << quote(match.result_file)
+              << " > " << quote(match.log_file) << " 2>&1";
+      int status = std::system(command.str().c_str());
+      if (status != 0) {
+        Log::Warn["tournament"] << "game " << i << " exited with status "
+                                << status << ", see " << match.log_file;
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < std::min<size_t>(jobs, matches.size()); i++) {
+    workers.push_back(std::thread(play));
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  typedef struct Summary {
+    unsigned int games = 0;
+    unsigned int undecided = 0;
+    double ticks_per_second = 0.;
+    std::map<int, unsigned int> wins;
+  } Summary;
+  std::map<std::string, Summary> summaries;
+
+  std::ofstream csv(folder + "/tournament.csv");
+  std::ofstream json(folder + "/tournament.json");
+  GameResult::write_csv_header(&csv);
+  json << "[";
+  unsigned int reported = 0;
+  for (const Match &match : matches) {
+    std::ifstream stream(match.result_file);
+    GameResult result;
+    if (!result.read(&stream)) {
+      Log::Warn["tournament"] << "no result in " << match.result_file;
+      continue;
+    }
+    result.write_csv(&csv);
+    json << ((reported > 0) ? ",\n " : "\n ");
+    result.write_json(&json);
+    reported++;
+
+    Summary &summary = summaries[result.options];
+    summary.games++;
+    summary.ticks_per_second += result.get_ticks_per_second();
+    if (result.winner < 0) {
+      summary.undecided++;
+    } else {
+      summary.wins[result.winner]++;
+    }
+  }
+  json << "\n]\n";
+  if (!csv.good() || !json.good()) {
+    Log::Error["tournament"] << "failed to write the reports to " << folder;
+    return EXIT_FAILURE;
+  }
+
+  for (const std::pair<const std::string, Summary> &entry : summaries) {
+    const Summary &summary = entry.second;
+    std::ostringstream wins;
+    for (const std::pair<const int, unsigned int> &win : summary.wins) {
+      wins << " player" << win.first << "=" << win.second;
+    }
+    Log::Info["tournament"] << "options " << entry.first << ": "
+                            << summary.games << " games, "
+                            << summary.undecided << " undecided, wins"
+                            << wins.str() << ", " << std::fixed
+                            << std::setprecision(1)
+                            << summary.ticks_per_second / summary.games
+                            << " ticks/s";
+  }
+  Log::Info["tournament"] << reported << " of " << matches.size()
+                          << " results written to " << folder;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+/*
+ * trace.cc - Timeline of what each thread did, for chrome://tracing
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/profiler.h"
+
+namespace {
+
+typedef struct Event {
+  const char *counter;    // nullptr for a section
+  unsigned int section;
+  int64_t start_ns;       // since the trace started
+  int64_t value;          // length of a section, value of a counter
+} Event;
+
+// Events of one thread. The owning thread takes the mutex for each event,
+// it only waits while the trace is started or written.
+typedef struct ThreadEvents {
+  std::mutex mutex;
+  unsigned int id;
+  std::string name;
+  std::vector<Event> ring;
+  size_t next;            // where the next event goes
+  bool wrapped;           // the oldest events were overwritten
+  unsigned int generation;
+  Trace::Clock::time_point origin;
+} ThreadEvents;
+
+typedef struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadEvents>> threads;
+  std::string path;
+  size_t events_per_thread = Trace::default_events_per_thread;
+  Trace::Clock::time_point origin;
+  std::atomic<unsigned int> generation{0};
+} Registry;
+
+Registry &
+get_registry() {
+  static Registry registry;
+  return registry;
+}
+
+thread_local ThreadEvents *local_events = nullptr;
+
+ThreadEvents *
+get_local_events() {
+  if (local_events == nullptr) {
+    std::unique_ptr<ThreadEvents> events(new ThreadEvents());
+    events->next = 0;
+    events->wrapped = false;
+    events->generation = 0;
+    local_events = events.get();
+    Registry &registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    events->id = static_cast<unsigned int>(registry.threads.size()) + 1;
+    registry.threads.push_back(std::move(events));
+  }
+  return local_events;
+}
+
+// Section names and thread names are plain, but be safe
+void
+write_string(std::ostream *os, const std::string &str) {
+  *os << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      *os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) >= 0x20) {
+      *os << c;
+    }
+  }
+  *os << '"';
+}
+
+}  // namespace
+
+std::atomic<bool> Trace::active(false);
+const size_t Trace::default_events_per_thread;
+
+void
+Trace::start(const std::string &path, size_t events_per_thread) {
+  Registry &registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.path = path;
+  registry.events_per_thread = std::max<size_t>(events_per_thread, 1);
+  registry.origin = Clock::now();
+  // Threads clear their rings when they next record
+  registry.generation.fetch_add(1, std::memory_order_release);
+  active.store(true, std::memory_order_release);
+}
+
+void
+Trace::stop() {
+  active.store(false, std::memory_order_release);
+}
+
+std::string
+Trace::get_path() {
+  Registry &registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  return registry.path;
+}
+
+void
+Trace::set_thread_name(const std::string &name) {
+  ThreadEvents *events = get_local_events();
+  std::lock_guard<std::mutex> lock(events->mutex);
+  events->name = name;
+}
+
+void
+Trace::record(unsigned int section, const char *counter,
+              Clock::time_point start, Clock::time_point end,
+              int64_t value) {
+  ThreadEvents *events = get_local_events();
+  Registry &registry = get_registry();
+  std::lock_guard<std::mutex> lock(events->mutex);
+  if (events->generation !=
+      registry.generation.load(std::memory_order_acquire)) {
+    // The writer takes the registry lock first and then each thread's, but
+    //  never both at once, so this can't deadlock
+    std::lock_guard<std::mutex> registry_lock(registry.mutex);
+    events->generation = registry.generation.load(std::memory_order_relaxed);
+    events->origin = registry.origin;
+    events->ring.clear();
+    events->ring.shrink_to_fit();
+    events->ring.reserve(registry.events_per_thread);
+    events->next = 0;
+    events->wrapped = false;
+  }
+
+  Event event;
+  event.counter = counter;
+  event.section = section;
+  event.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     start - events->origin).count();
+  event.value = (counter != nullptr) ? value :
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  end - start).count();
+  if (events->ring.size() < events->ring.capacity()) {
+    events->ring.push_back(event);
+  } else {
+    events->ring[events->next] = event;
+    events->wrapped = true;
+  }
+  events->next = (events->next + 1) % events->ring.capacity();
+}
+
+void
+Trace::write_json(std::ostream *os, Clock::duration last) {
+  Clock::time_point now = Clock::now();
+  Registry &registry = get_registry();
+  std::vector<ThreadEvents*> threads;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const std::unique_ptr<ThreadEvents> &events : registry.threads) {
+      threads.push_back(events.get());
+    }
+  }
+  unsigned int generation = registry.generation.load(std::memory_order_acquire);
+  std::vector<std::string> section_names;
+
+  *os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+  *os << std::fixed << std::setprecision(3);
+  bool first = true;
+  for (ThreadEvents *events : threads) {
+    std::lock_guard<std::mutex> events_lock(events->mutex);
+    std::string name = events->name.empty() ?
+                       "thread " + std::to_string(events->id) : events->name;
+    *os << (first ? "" : ",\n")
+        << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+        << events->id << ",\"args\":{\"name\":";
+    write_string(os, name);
+    *os << "}}";
+    first = false;
+    if (events->generation != generation) {
+      continue;
+    }
+
+    // Sections that ended in the stretch are left in whole
+    int64_t from_ns = std::numeric_limits<int64_t>::min();
+    if (last != Clock::duration::max()) {
+      from_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  now - last - events->origin).count();
+    }
+    size_t count = events->ring.size();
+    size_t oldest = events->wrapped ? events->next : 0;
+    for (size_t i = 0; i < count; i++) {
+      const Event &event = events->ring[(oldest + i) % count];
+      int64_t end_ns = event.start_ns +
+                       ((event.counter != nullptr) ? 0 : event.value);
+      if (end_ns < from_ns) {
+        continue;
+      }
+      *os << ",\n{\"pid\":1,\"tid\":" << events->id
+          << ",\"ts\":" << event.start_ns / 1000. << ",";
+      if (event.counter != nullptr) {
+        *os << "\"ph\":\"C\",\"name\":";
+        write_string(os, event.counter);
+        *os << ",\"args\":{\"value\":" << event.value << "}}";
+      } else {
+        while (section_names.size() <= event.section) {
+          section_names.push_back(Profiler::get_section_name(
+                         static_cast<unsigned int>(section_names.size())));
+        }
+        *os << "\"ph\":\"X\",\"dur\":" << event.value / 1000.
+            << ",\"name\":";
+        write_string(os, section_names[event.section]);
+        *os << "}";
+      }
+    }
+  }
+  *os << "\n]}\n";
+}
+
+bool
+Trace::write() {
+  std::string path = get_path();
+  std::ofstream file(path.c_str());
+  if (!file.is_open()) {
+    return false;
+  }
+  write_json(&file);
+  return file.good();
+}
@@ -0,0 +1,84 @@
+/*
+ * trace.h - Timeline of what each thread did, for chrome://tracing
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_TRACE_H_
+#define SRC_TRACE_H_
+
+#include <atomic>
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// When each thread was in which profiler section, how long it held the game
+// lock, and counters over time, written as Chrome trace event JSON that
+// chrome://tracing and Perfetto open. Every thread records into a ring
+// buffer of its own, which keeps only its newest events, so the trace can be
+// written at any point of a long game. Nothing is recorded, and the
+// profiler's timers pay only for one load, until tracing is started.
+class Trace {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  static const size_t default_events_per_thread = 1 << 18;
+
+  static bool is_active() {
+    return active.load(std::memory_order_relaxed); }
+
+  // Start recording from scratch, into rings of events_per_thread events.
+  // write() writes to path.
+  static void start(const std::string &path,
+                    size_t events_per_thread = default_events_per_thread);
+  static void stop();
+  static std::string get_path();
+
+  // Name the calling thread in the trace.
+  static void set_thread_name(const std::string &name);
+
+  // The calling thread spent start to end in profiler section.
+  static void complete(unsigned int section, Clock::time_point start,
+                       Clock::time_point end) {
+    if (is_active()) record(section, nullptr, start, end, 0);
+  }
+  // The value of a counter changed. Name must live as long as the program.
+  static void counter(const char *name, int64_t value) {
+    if (is_active()) {
+      Clock::time_point now = Clock::now();
+      record(0, name, now, now, value);
+    }
+  }
+
+  // What the threads recorded so far, they go on recording. Only what
+  // happened in the last stretch of it, if one is given.
+  static void write_json(std::ostream *os,
+                         Clock::duration last = Clock::duration::max());
+  static bool write();
+
+ protected:
+  static std::atomic<bool> active;
+
+  static void record(unsigned int section, const char *counter,
+                     Clock::time_point start, Clock::time_point end,
+                     int64_t value);
+};
+
+#endif  // SRC_TRACE_H_
@@ -0,0 +1,301 @@
+/*
+ * video-dummy.cc - Graphics rendering into memory, without a window
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "src/video-dummy.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "src/log.h"
+
+static uint32_t
+color_pixel(const Video::Color &color) {
+  return 0xff000000 | (static_cast<uint32_t>(color.r) << 16) |
+         (static_cast<uint32_t>(color.g) << 8) | color.b;
+}
+
+VideoDummy::VideoDummy()
+  : screen(nullptr)
+  , fullscreen(false)
+  , zoom_factor(1.f)
+  , width(800)
+  , height(600)
+  , draw_calls(0)
+  , last_draw_calls(0) {
+  Log::Info["video"] << "Initializing \"dummy\".";
+  set_resolution(width, height, fullscreen);
+}
+
+VideoDummy::~VideoDummy() {
+  delete screen;
+}
+
+Video &
+Video::get_instance() {
+  static VideoDummy instance;
+  return instance;
+}
+
+/* There is no window, it is taken to be as large as the screen frame,
+   which is zoomed out of it later. */
+void
+VideoDummy::set_resolution(unsigned int _width, unsigned int _height,
+                           bool fs) {
+  resize_screen(_width, _height);
+  width = _width;
+  height = _height;
+  fullscreen = fs;
+}
+
+/* The screen frame stays the same object, as Graphics holds on to it. */
+void
+VideoDummy::resize_screen(unsigned int _width, unsigned int _height) {
+  if (screen == nullptr) {
+    screen = new Video::Frame(_width, _height);
+    return;
+  }
+  screen->w = _width;
+  screen->h = _height;
+  screen->pixels.assign(static_cast<size_t>(_width) * _height, 0);
+}
+
+void
+VideoDummy::get_resolution(unsigned int *_width, unsigned int *_height) {
+  if (_width != nullptr) {
+    *_width = width;
+  }
+  if (_height != nullptr) {
+    *_height = height;
+  }
+}
+
+void
+VideoDummy::set_fullscreen(bool enable) {
+  fullscreen = enable;
+}
+
+Video::Frame *
+VideoDummy::create_frame(unsigned int _width, unsigned int _height) {
+  return new Video::Frame(_width, _height);
+}
+
+void
+VideoDummy::destroy_frame(Video::Frame *frame) {
+  delete frame;
+}
+
+Video::Image *
+VideoDummy::create_image(void *data, unsigned int _width,
+                         unsigned int _height) {
+  Video::Image *image = new Video::Image();
+  image->w = _width;
+  image->h = _height;
+  image->pixels.resize(static_cast<size_t>(_width) * _height);
+  std::memcpy(image->pixels.data(), data, image->pixels.size() * 4);
+  return image;
+}
+
+void
+VideoDummy::destroy_image(Video::Image *image) {
+  delete image;
+}
+
+void
+VideoDummy::blend(const uint32_t *src, unsigned int pitch, int x, int y,
+                  int w, int h, Video::Frame *dest) {
+  int x0 = std::max(x, 0);
+  int y0 = std::max(y, 0);
+  int x1 = std::min(x + w, static_cast<int>(dest->w));
+  int y1 = std::min(y + h, static_cast<int>(dest->h));
+  for (int row = y0; row < y1; row++) {
+    const uint32_t *s = src + static_cast<size_t>(row - y) * pitch + (x0 - x);
+    uint32_t *d = dest->pixels.data() + static_cast<size_t>(row) * dest->w;
+    for (int col = x0; col < x1; col++, s++) {
+      uint32_t a = *s >> 24;
+      if (a == 0) {
+        continue;
+      }
+      if (a == 0xff) {
+        d[col] = *s;
+        continue;
+      }
+      uint32_t out = 0;
+      for (int shift = 0; shift < 24; shift += 8) {
+        uint32_t sc = (*s >> shift) & 0xff;
+        uint32_t dc = (d[col] >> shift) & 0xff;
+        out |= ((sc * a + dc * (255 - a)) / 255) << shift;
+      }
+      uint32_t da = d[col] >> 24;
+      out |= (a + da * (255 - a) / 255) << 24;
+      d[col] = out;
+    }
+  }
+}
+
+void
+VideoDummy::put_pixel(int x, int y, uint32_t pixel, Video::Frame *dest) {
+  if (x >= 0 && y >= 0 && x < static_cast<int>(dest->w) &&
+      y < static_cast<int>(dest->h)) {
+    dest->pixels[static_cast<size_t>(y) * dest->w + x] = pixel;
+  }
+}
+
+void
+VideoDummy::draw_image(const Video::Image *image, int x, int y, int y_offset,
+                       Video::Frame *dest) {
+  int w = static_cast<int>(image->w);
+  int h = static_cast<int>(image->h) - y_offset;
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+  draw_calls++;
+  blend(image->pixels.data() + static_cast<size_t>(y_offset) * image->w,
+        image->w, x, y + y_offset, w, h, dest);
+}
+
+void
+VideoDummy::draw_frame(int dx, int dy, Video::Frame *dest, int sx, int sy,
+                       Video::Frame *src, int w, int h) {
+  /* Clip to the source first, then blend clips to dest */
+  if (sx < 0) {
+    dx -= sx;
+    w += sx;
+    sx = 0;
+  }
+  if (sy < 0) {
+    dy -= sy;
+    h += sy;
+    sy = 0;
+  }
+  w = std::min(w, static_cast<int>(src->w) - sx);
+  h = std::min(h, static_cast<int>(src->h) - sy);
+  draw_calls++;
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+  blend(src->pixels.data() + static_cast<size_t>(sy) * src->w + sx, src->w,
+        dx, dy, w, h, dest);
+}
+
+void
+VideoDummy::draw_rect(int x, int y, unsigned int _width, unsigned int _height,
+                      const Video::Color color, Video::Frame *dest) {
+  fill_rect(x, y, _width, 1, color, dest);
+  fill_rect(x, y + _height - 1, _width, 1, color, dest);
+  fill_rect(x, y, 1, _height, color, dest);
+  fill_rect(x + _width - 1, y, 1, _height, color, dest);
+}
+
+void
+VideoDummy::fill_rect(int x, int y, unsigned int _width, unsigned int _height,
+                      const Video::Color color, Video::Frame *dest) {
+  draw_calls++;
+  uint32_t pixel = color_pixel(color);
+  int x0 = std::max(x, 0);
+  int y0 = std::max(y, 0);
+  int x1 = std::min(x + static_cast<int>(_width), static_cast<int>(dest->w));
+  int y1 = std::min(y + static_cast<int>(_height), static_cast<int>(dest->h));
+  for (int row = y0; row < y1; row++) {
+    uint32_t *d = dest->pixels.data() + static_cast<size_t>(row) * dest->w;
+    std::fill(d + x0, d + std::max(x0, x1), pixel);
+  }
+}
+
+void
+VideoDummy::draw_line(int x, int y, int x1, int y1, const Video::Color color,
+                      Video::Frame *dest) {
+  draw_calls++;
+  uint32_t pixel = color_pixel(color);
+  int dx = std::abs(x1 - x);
+  int dy = -std::abs(y1 - y);
+  int step_x = (x < x1) ? 1 : -1;
+  int step_y = (y < y1) ? 1 : -1;
+  int error = dx + dy;
+  while (true) {
+    put_pixel(x, y, pixel, dest);
+    if (x == x1 && y == y1) {
+      break;
+    }
+    int e2 = 2 * error;
+    if (e2 >= dy) {
+      error += dy;
+      x += step_x;
+    }
+    if (e2 <= dx) {
+      error += dx;
+      y += step_y;
+    }
+  }
+}
+
+/* Like VideoSDL without geometry support, the viewport then draws the
+   landscape from sprites. */
+bool
+VideoDummy::draw_triangles(const Video::Image * /*image*/,
+                           const Video::Vertex * /*vertices*/,
+                           size_t /*count*/, Video::Frame * /*dest*/) {
+  return false;
+}
+
+void
+VideoDummy::update_frame(int x, int y, unsigned int _width,
+                         unsigned int _height, const void *pixels,
+                         Video::Frame *dest) {
+  draw_calls++;
+  const uint32_t *src = reinterpret_cast<const uint32_t*>(pixels);
+  int x0 = std::max(x, 0);
+  int y0 = std::max(y, 0);
+  int x1 = std::min(x + static_cast<int>(_width), static_cast<int>(dest->w));
+  int y1 = std::min(y + static_cast<int>(_height), static_cast<int>(dest->h));
+  for (int row = y0; row < y1 && x0 < x1; row++) {
+    std::memcpy(dest->pixels.data() + static_cast<size_t>(row) * dest->w + x0,
+                src + static_cast<size_t>(row - y) * _width + (x0 - x),
+                static_cast<size_t>(x1 - x0) * 4);
+  }
+}
+
+void
+VideoDummy::swap_buffers() {
+  last_draw_calls = draw_calls;
+  draw_calls = 0;
+}
+
+bool
+VideoDummy::set_zoom_factor(float factor) {
+  if ((factor < 0.2f) || (factor > 1.f)) {
+    return false;
+  }
+  zoom_factor = factor;
+  resize_screen(static_cast<unsigned int>(width * zoom_factor),
+                static_cast<unsigned int>(height * zoom_factor));
+  return true;
+}
+
+void
+VideoDummy::get_screen_factor(float *fx, float *fy) {
+  if (fx != nullptr) {
+    *fx = 1.f;
+  }
+  if (fy != nullptr) {
+    *fy = 1.f;
+  }
+}
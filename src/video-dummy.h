@@ -0,0 +1,122 @@
+/*
+ * video-dummy.h - Graphics rendering into memory, without a window
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_VIDEO_DUMMY_H_
+#define SRC_VIDEO_DUMMY_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "src/video.h"
+
+/* Frames and images are plain pixel buffers, four bytes a pixel in the
+   byte order of sprites, and all drawing is done on the CPU. */
+class Video::Frame {
+ public:
+  unsigned int w;
+  unsigned int h;
+  std::vector<uint32_t> pixels;
+
+  Frame(unsigned int width, unsigned int height)
+    : w(width), h(height), pixels(static_cast<size_t>(width) * height, 0) {}
+};
+
+class Video::Image {
+ public:
+  unsigned int w;
+  unsigned int h;
+  std::vector<uint32_t> pixels;
+
+  Image() : w(0), h(0) {}
+};
+
+/* Does all that VideoSDL does, up to the last pixel of a frame, but never
+   shows it; for benchmarks and tests of the drawing code on machines
+   without a display. Every call that draws is one draw call, as nothing is
+   batched. */
+class VideoDummy : public Video {
+ protected:
+  Video::Frame *screen;
+  bool fullscreen;
+  float zoom_factor;
+  unsigned int width;
+  unsigned int height;
+
+  unsigned int draw_calls;
+  unsigned int last_draw_calls;
+
+ public:
+  VideoDummy();
+  virtual ~VideoDummy();
+
+  virtual void set_resolution(unsigned int width, unsigned int height,
+                              bool fullscreen);
+  virtual void get_resolution(unsigned int *width, unsigned int *height);
+  virtual void set_fullscreen(bool enable);
+  virtual bool is_fullscreen() { return fullscreen; }
+
+  virtual Video::Frame *get_screen_frame() { return screen; }
+  virtual Video::Frame *create_frame(unsigned int width, unsigned int height);
+  virtual void destroy_frame(Video::Frame *frame);
+
+  virtual Video::Image *create_image(void *data, unsigned int width,
+                                     unsigned int height);
+  virtual void destroy_image(Video::Image *image);
+
+  virtual void warp_mouse(int /*x*/, int /*y*/) {}
+
+  virtual void draw_image(const Video::Image *image, int x, int y,
+                          int y_offset, Video::Frame *dest);
+  virtual void draw_frame(int dx, int dy, Video::Frame *dest, int sx, int sy,
+                          Video::Frame *src, int w, int h);
+  virtual void draw_rect(int x, int y, unsigned int width, unsigned int height,
+                         const Video::Color color, Video::Frame *dest);
+  virtual void fill_rect(int x, int y, unsigned int width, unsigned int height,
+                         const Video::Color color, Video::Frame *dest);
+  virtual void draw_line(int x, int y, int x1, int y1,
+                         const Video::Color color, Video::Frame *dest);
+  virtual bool draw_triangles(const Video::Image *image,
+                              const Video::Vertex *vertices, size_t count,
+                              Video::Frame *dest);
+  virtual void update_frame(int x, int y, unsigned int width,
+                            unsigned int height, const void *pixels,
+                            Video::Frame *dest);
+
+  virtual void swap_buffers();
+
+  virtual void set_cursor(void * /*data*/, unsigned int /*width*/,
+                          unsigned int /*height*/) {}
+
+  virtual float get_zoom_factor() { return zoom_factor; }
+  virtual bool set_zoom_factor(float factor);
+  virtual void get_screen_factor(float *fx, float *fy);
+  virtual unsigned int get_draw_calls() { return last_draw_calls; }
+
+ protected:
+  void resize_screen(unsigned int width, unsigned int height);
+  /* Blend the w by h pixels at src, pitch pixels a row, over dest at x, y,
+     clipped to dest. */
+  static void blend(const uint32_t *src, unsigned int pitch, int x, int y,
+                    int w, int h, Video::Frame *dest);
+  static void put_pixel(int x, int y, uint32_t pixel, Video::Frame *dest);
+};
+
+#endif  // SRC_VIDEO_DUMMY_H_
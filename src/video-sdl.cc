@@ -21,6 +21,7 @@
 
 #include "src/video-sdl.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include <SDL.h>
@@ -43,6 +44,15 @@ VideoSDL::VideoSDL() {
   cursor = nullptr;
   fullscreen = false;
   zoom_factor = 1.f;
+  max_texture_size = 0;
+  prescaled = nullptr;
+  prescale = 1;
+  draw_calls = 0;
+  last_draw_calls = 0;
+  atlas_page_size = atlas_size;
+  batch_texture = nullptr;
+  batch_target = nullptr;
+  frame_pool_bytes = 0;
 
   Log::Info["video"] << "Initializing \"sdl\".";
   Log::Info["video"] << "Available drivers:";
@@ -94,6 +104,19 @@ VideoSDL::VideoSDL() {
   }
   SDL_PixelFormatEnumToMasks(pixel_format, &bpp,
                              &Rmask, &Gmask, &Bmask, &Amask);
+  if (render_info.max_texture_width > 0) {
+    atlas_page_size = std::min(atlas_page_size,
+                               render_info.max_texture_width);
+    max_texture_size = render_info.max_texture_width;
+  }
+  if (render_info.max_texture_height > 0) {
+    atlas_page_size = std::min(atlas_page_size,
+                               render_info.max_texture_height);
+    max_texture_size = (max_texture_size > 0) ?
+                       std::min(max_texture_size,
+                                render_info.max_texture_height) :
+                       render_info.max_texture_height;
+  }
 
   /* Set scaling mode */
   SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
@@ -105,6 +128,20 @@ VideoSDL::VideoSDL() {
 }
 
 VideoSDL::~VideoSDL() {
+  flush_batch();
+  for (AtlasPage &page : atlas_pages) {
+    if (page.texture != nullptr) {
+      SDL_DestroyTexture(page.texture);
+    }
+  }
+  if (prescaled != nullptr) {
+    SDL_DestroyTexture(prescaled);
+  }
+  for (FramePool::value_type &size : frame_pool) {
+    for (SDL_Texture *texture : size.second) {
+      SDL_DestroyTexture(texture);
+    }
+  }
   if (screen != nullptr) {
     delete screen;
     screen = nullptr;
@@ -132,6 +169,7 @@ VideoSDL::create_surface(int width, int height) {
 
 void
 VideoSDL::set_resolution(unsigned int width, unsigned int height, bool fs) {
+  flush_batch();
   /* Set fullscreen mode */
   int r = SDL_SetWindowFullscreen(window,
                                   fs ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0);
@@ -147,7 +185,9 @@ VideoSDL::set_resolution(unsigned int width, unsigned int height, bool fs) {
   if (screen->texture != nullptr) {
     SDL_DestroyTexture(screen->texture);
   }
+  SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
   screen->texture = create_texture(width, height);
+  SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
 
   /* Set logical size of screen */
   r = SDL_RenderSetLogicalSize(renderer, width, height);
@@ -155,9 +195,47 @@ VideoSDL::set_resolution(unsigned int width, unsigned int height, bool fs) {
     throw ExceptionSDL("Unable to set logical size");
   }
 
+  update_prescaled(width, height);
+
   fullscreen = fs;
 }
 
+void
+VideoSDL::update_prescaled(int width, int height) {
+  int out_width = 0;
+  int out_height = 0;
+  SDL_GetRendererOutputSize(renderer, &out_width, &out_height);
+
+  /* The smallest whole factor that covers the window */
+  int factor = 1;
+  while (width * factor < out_width || height * factor < out_height) {
+    factor++;
+  }
+  if (max_texture_size > 0) {
+    while (factor > 1 && (width * factor > max_texture_size ||
+                          height * factor > max_texture_size)) {
+      factor--;
+    }
+  }
+
+  if (prescaled != nullptr && factor == prescale) {
+    int w = 0;
+    int h = 0;
+    SDL_QueryTexture(prescaled, nullptr, nullptr, &w, &h);
+    if (w == width * factor && h == height * factor) {
+      return;
+    }
+  }
+  if (prescaled != nullptr) {
+    SDL_DestroyTexture(prescaled);
+    prescaled = nullptr;
+  }
+  prescale = factor;
+  if (prescale > 1) {
+    prescaled = create_texture(width * prescale, height * prescale);
+  }
+}
+
 void
 VideoSDL::get_resolution(unsigned int *width, unsigned int *height) {
   int w = 0;
@@ -189,34 +267,135 @@ VideoSDL::get_screen_frame() {
   return screen;
 }
 
+/* A texture of the same size from the pool is cleared instead of
+   creating a new one. */
 Video::Frame *
 VideoSDL::create_frame(unsigned int width, unsigned int height) {
+  flush_batch();
   Video::Frame *frame = new Video::Frame;
+  FramePool::iterator it = frame_pool.find((uint64_t)width << 32 | height);
+  if (it != frame_pool.end() && !it->second.empty()) {
+    frame->texture = it->second.back();
+    it->second.pop_back();
+    frame_pool_bytes -= static_cast<size_t>(width) * height * 4;
+    SDL_SetRenderTarget(renderer, frame->texture);
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0x00);
+    draw_calls++;
+    SDL_RenderClear(renderer);
+    return frame;
+  }
   frame->texture = create_texture(width, height);
   return frame;
 }
 
 void
 VideoSDL::destroy_frame(Video::Frame *frame) {
-  SDL_DestroyTexture(frame->texture);
+  flush_batch();
+  Uint32 format = 0;
+  int access = 0;
+  int w = 0;
+  int h = 0;
+  SDL_QueryTexture(frame->texture, &format, &access, &w, &h);
+  size_t bytes = static_cast<size_t>(w) * h * 4;
+  if (frame_pool_bytes + bytes <= frame_pool_budget) {
+    frame_pool[(uint64_t)w << 32 | h].push_back(frame->texture);
+    frame_pool_bytes += bytes;
+  } else {
+    SDL_DestroyTexture(frame->texture);
+  }
   delete frame;
 }
 
 Video::Image *
 VideoSDL::create_image(void *data, unsigned int width, unsigned int height) {
+  flush_batch();
   Video::Image *image = new Video::Image();
   image->w = width;
   image->h = height;
-  image->texture = create_texture_from_data(data, width, height);
+  if (!pack_image(image, data)) {
+    image->texture = create_texture_from_data(data, width, height);
+  }
   return image;
 }
 
 void
 VideoSDL::destroy_image(Video::Image *image) {
-  SDL_DestroyTexture(image->texture);
+  flush_batch();
+  if (image->atlas_page < 0) {
+    SDL_DestroyTexture(image->texture);
+  } else {
+    /* Space in a page is not reused, the page goes once it is empty. */
+    AtlasPage &page = atlas_pages[image->atlas_page];
+    page.images--;
+    if (page.images == 0 && image->atlas_page + 1 !=
+                            static_cast<int>(atlas_pages.size())) {
+      SDL_DestroyTexture(page.texture);
+      page.texture = nullptr;
+    }
+  }
   delete image;
 }
 
+/* Copy the sprite into the last atlas page, or a new one once that is full.
+   Returns false for sprites too large to share a page. */
+bool
+VideoSDL::pack_image(Video::Image *image, void *data) {
+  int w = static_cast<int>(image->w);
+  int h = static_cast<int>(image->h);
+  if (w == 0 || h == 0 || w > atlas_max_image || h > atlas_max_image ||
+      w + 1 > atlas_page_size || h + 1 > atlas_page_size) {
+    return false;
+  }
+
+  AtlasPage *page = atlas_pages.empty() ? nullptr : &atlas_pages.back();
+  if (page != nullptr && page->shelf_x + w + 1 > atlas_page_size) {
+    /* Next shelf */
+    page->shelf_x = 0;
+    page->shelf_y += page->shelf_h;
+    page->shelf_h = 0;
+  }
+  if (page == nullptr || page->texture == nullptr ||
+      page->shelf_y + h + 1 > atlas_page_size) {
+    SDL_Texture *texture = SDL_CreateTexture(renderer, pixel_format,
+                                             SDL_TEXTUREACCESS_STATIC,
+                                             atlas_page_size,
+                                             atlas_page_size);
+    if (texture == nullptr) {
+      return false;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    /* Sprites are drawn one to one, but keep the gaps between them clear
+       in case they are ever scaled. */
+    std::vector<Uint32> clear(static_cast<size_t>(atlas_page_size) *
+                              atlas_page_size, 0);
+    SDL_UpdateTexture(texture, nullptr, clear.data(),
+                      atlas_page_size * static_cast<int>(sizeof(Uint32)));
+    if (page != nullptr && page->images == 0) {
+      SDL_DestroyTexture(page->texture);
+      atlas_pages.pop_back();
+    }
+    atlas_pages.push_back(AtlasPage{ texture, 0, 0, 0, 0 });
+    page = &atlas_pages.back();
+  }
+
+  SDL_Surface *surf = create_surface_from_data(data, w, h);
+  SDL_Rect rect = { page->shelf_x, page->shelf_y, w, h };
+  int r = SDL_UpdateTexture(page->texture, &rect, surf->pixels, surf->pitch);
+  SDL_FreeSurface(surf);
+  if (r < 0) {
+    throw ExceptionSDL("Unable to copy sprite to atlas");
+  }
+
+  image->texture = page->texture;
+  image->atlas_page = static_cast<int>(atlas_pages.size()) - 1;
+  image->atlas_x = page->shelf_x;
+  image->atlas_y = page->shelf_y;
+  page->images++;
+  page->shelf_x += w + 1;
+  page->shelf_h = std::max(page->shelf_h, h + 1);
+  return true;
+}
+
 void
 VideoSDL::warp_mouse(int x, int y) {
   SDL_WarpMouseInWindow(nullptr, x, y);
@@ -278,30 +457,92 @@ VideoSDL::create_texture_from_data(void *data, int width, int height) {
 void
 VideoSDL::draw_image(const Video::Image *image, int x, int y, int y_offset,
                         Video::Frame *dest) {
-  SDL_Rect dest_rect = { x, y + y_offset,
-                         static_cast<int>(image->w),
-                         static_cast<int>(image->h - y_offset) };
-  SDL_Rect src_rect = { 0, y_offset,
-                        static_cast<int>(image->w),
-                        static_cast<int>(image->h - y_offset) };
-
-  /* Blit sprite */
+  int w = static_cast<int>(image->w);
+  int h = static_cast<int>(image->h) - y_offset;
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  /* Sprites from the same atlas page to the same frame are sent as one
+     piece of geometry. Anything else that draws flushes them first, so
+     the order of drawing stays the same. */
+  if (batch_texture != image->texture || batch_target != dest->texture) {
+    flush_batch();
+    batch_texture = image->texture;
+    batch_target = dest->texture;
+  }
+  float tex_w = static_cast<float>(w);
+  float tex_h = static_cast<float>(image->h);
+  if (image->atlas_page >= 0) {
+    tex_w = tex_h = static_cast<float>(atlas_page_size);
+  }
+  float u0 = image->atlas_x / tex_w;
+  float u1 = (image->atlas_x + w) / tex_w;
+  float v0 = (image->atlas_y + y_offset) / tex_h;
+  float v1 = (image->atlas_y + y_offset + h) / tex_h;
+  float x0 = static_cast<float>(x);
+  float x1 = static_cast<float>(x + w);
+  float y0 = static_cast<float>(y + y_offset);
+  float y1 = static_cast<float>(y + y_offset + h);
+  SDL_Color white = { 0xff, 0xff, 0xff, 0xff };
+  int first = static_cast<int>(batch_vertices.size());
+  batch_vertices.push_back(SDL_Vertex{ { x0, y0 }, white, { u0, v0 } });
+  batch_vertices.push_back(SDL_Vertex{ { x1, y0 }, white, { u1, v0 } });
+  batch_vertices.push_back(SDL_Vertex{ { x1, y1 }, white, { u1, v1 } });
+  batch_vertices.push_back(SDL_Vertex{ { x0, y1 }, white, { u0, v1 } });
+  for (int i : { 0, 1, 2, 0, 2, 3 }) {
+    batch_indices.push_back(first + i);
+  }
+#else
+  SDL_Rect dest_rect = { x, y + y_offset, w, h };
+  SDL_Rect src_rect = { image->atlas_x, image->atlas_y + y_offset, w, h };
+
+  /* Blit sprite, the renderer batches copies from the same texture */
   SDL_SetRenderTarget(renderer, dest->texture);
   SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+  draw_calls++;
   int r = SDL_RenderCopy(renderer, image->texture, &src_rect, &dest_rect);
   if (r < 0) {
     throw ExceptionSDL("RenderCopy error");
   }
+#endif
+}
+
+void
+VideoSDL::flush_batch() {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  if (batch_indices.empty()) {
+    return;
+  }
+  SDL_SetRenderTarget(renderer, batch_target);
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+  draw_calls++;
+  int r = SDL_RenderGeometry(renderer, batch_texture,
+                             batch_vertices.data(),
+                             static_cast<int>(batch_vertices.size()),
+                             batch_indices.data(),
+                             static_cast<int>(batch_indices.size()));
+  batch_vertices.clear();
+  batch_indices.clear();
+  batch_texture = nullptr;
+  batch_target = nullptr;
+  if (r < 0) {
+    throw ExceptionSDL("RenderGeometry error");
+  }
+#endif
 }
 
 void
 VideoSDL::draw_frame(int dx, int dy, Video::Frame *dest, int sx, int sy,
                         Video::Frame *src, int w, int h) {
+  flush_batch();
   SDL_Rect dest_rect = { dx, dy, w, h };
   SDL_Rect src_rect = { sx, sy, w, h };
 
   SDL_SetRenderTarget(renderer, dest->texture);
   SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+  draw_calls++;
   int r = SDL_RenderCopy(renderer, src->texture, &src_rect, &dest_rect);
   if (r < 0) {
     throw ExceptionSDL("RenderCopy error");
@@ -321,11 +562,13 @@ VideoSDL::draw_rect(int x, int y, unsigned int width, unsigned int height,
 void
 VideoSDL::fill_rect(int x, int y, unsigned int width, unsigned int height,
                        const Video::Color color, Video::Frame *dest) {
+  flush_batch();
   SDL_Rect rect = { x, y, static_cast<int>(width), static_cast<int>(height) };
 
   /* Fill rectangle */
   SDL_SetRenderTarget(renderer, dest->texture);
   SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0xff);
+  draw_calls++;
   int r = SDL_RenderFillRect(renderer, &rect);
   if (r < 0) {
     throw ExceptionSDL("RenderFillRect error");
@@ -335,16 +578,83 @@ VideoSDL::fill_rect(int x, int y, unsigned int width, unsigned int height,
 void
 VideoSDL::draw_line(int x, int y, int x1, int y1, const Video::Color color,
                     Video::Frame *dest) {
+  flush_batch();
   SDL_SetRenderTarget(renderer, dest->texture);
   SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0xff);
+  draw_calls++;
   SDL_RenderDrawLine(renderer, x, y, x1, y1);
 }
 
+/* Triangles go into the same batch as the sprites, so a landscape tile
+   drawn from one atlas page is sent in one piece. */
+bool
+VideoSDL::draw_triangles(const Video::Image *image,
+                         const Video::Vertex *vertices, size_t count,
+                         Video::Frame *dest) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  if (batch_texture != image->texture || batch_target != dest->texture) {
+    flush_batch();
+    batch_texture = image->texture;
+    batch_target = dest->texture;
+  }
+  float tex_w = static_cast<float>(image->w);
+  float tex_h = static_cast<float>(image->h);
+  if (image->atlas_page >= 0) {
+    tex_w = tex_h = static_cast<float>(atlas_page_size);
+  }
+  SDL_Color white = { 0xff, 0xff, 0xff, 0xff };
+  int first = static_cast<int>(batch_vertices.size());
+  for (size_t i = 0; i < count; i++) {
+    const Video::Vertex &vertex = vertices[i];
+    batch_vertices.push_back(SDL_Vertex{ { vertex.x, vertex.y }, white,
+                                         { (image->atlas_x + vertex.u) / tex_w,
+                                           (image->atlas_y + vertex.v) / tex_h }
+                                       });
+    batch_indices.push_back(first + static_cast<int>(i));
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+VideoSDL::update_frame(int x, int y, unsigned int width, unsigned int height,
+                       const void *pixels, Video::Frame *dest) {
+  flush_batch();
+  const void *data = pixels;
+  int pitch = static_cast<int>(width) * 4;
+  if (pixel_format != SDL_PIXELFORMAT_ARGB8888) {
+    converted_pixels.resize(static_cast<size_t>(width) * height);
+    if (SDL_ConvertPixels(width, height, SDL_PIXELFORMAT_ARGB8888, pixels,
+                          pitch, pixel_format, converted_pixels.data(),
+                          pitch) < 0) {
+      throw ExceptionSDL("Unable to convert frame pixels");
+    }
+    data = converted_pixels.data();
+  }
+  SDL_Rect rect = { x, y, static_cast<int>(width), static_cast<int>(height) };
+  draw_calls++;
+  if (SDL_UpdateTexture(dest->texture, &rect, data, pitch) < 0) {
+    throw ExceptionSDL("Unable to update frame");
+  }
+}
+
 void
 VideoSDL::swap_buffers() {
-  SDL_SetRenderTarget(renderer, nullptr);
-  SDL_RenderCopy(renderer, screen->texture, nullptr, nullptr);
+  flush_batch();
+  if (prescaled != nullptr) {
+    SDL_SetRenderTarget(renderer, prescaled);
+    SDL_RenderCopy(renderer, screen->texture, nullptr, nullptr);
+    SDL_SetRenderTarget(renderer, nullptr);
+    SDL_RenderCopy(renderer, prescaled, nullptr, nullptr);
+  } else {
+    SDL_SetRenderTarget(renderer, nullptr);
+    SDL_RenderCopy(renderer, screen->texture, nullptr, nullptr);
+  }
   SDL_RenderPresent(renderer);
+  last_draw_calls = draw_calls;
+  draw_calls = 0;
 }
 
 void
@@ -23,7 +23,9 @@
 #define SRC_VIDEO_SDL_H_
 
 #include <exception>
+#include <map>
 #include <string>
+#include <vector>
 
 #include <SDL.h>
 
@@ -40,9 +42,13 @@ class Video::Image {
  public:
   unsigned int w;
   unsigned int h;
-  SDL_Texture *texture;
+  SDL_Texture *texture;   // Own texture, or the atlas page it is packed in
+  int atlas_page;         // -1 if not in an atlas
+  int atlas_x;
+  int atlas_y;
 
-  Image() : w(0), h(0), texture(NULL) {}
+  Image() : w(0), h(0), texture(NULL), atlas_page(-1), atlas_x(0),
+            atlas_y(0) {}
 };
 
 class ExceptionSDL : public ExceptionVideo {
@@ -71,6 +77,50 @@ class VideoSDL : public Video {
   bool fullscreen;
   SDL_Cursor *cursor;
   float zoom_factor;
+  int max_texture_size;
+
+  /* When the window is larger than the screen frame, the frame is first
+     scaled up by a whole factor without filtering, and only what is left
+     of the zoom is filtered on the way to the window, so that zoomed in
+     sprites stay sharp and only their last pixel edges are smoothed. */
+  SDL_Texture *prescaled;
+  int prescale;
+
+  /* Sprites are packed into a few large textures, shelf by shelf, so that
+     consecutive sprite draws mostly use the same texture and can be sent
+     to the renderer together. */
+  static const int atlas_size = 2048;
+  static const int atlas_max_image = 256;
+  typedef struct AtlasPage {
+    SDL_Texture *texture;
+    int shelf_x;
+    int shelf_y;
+    int shelf_h;
+    unsigned int images;
+  } AtlasPage;
+  std::vector<AtlasPage> atlas_pages;
+  int atlas_page_size;
+
+  /* Sprite draws not yet sent, all from one texture to one target. */
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  std::vector<SDL_Vertex> batch_vertices;
+  std::vector<int> batch_indices;
+#endif
+  SDL_Texture *batch_texture;
+  SDL_Texture *batch_target;
+
+  /* Textures of destroyed frames by size, kept up to frame_pool_budget
+     bytes for the next frame of the same size. Landscape tiles, charts
+     and popups come and go in a few sizes. */
+  static const size_t frame_pool_budget = 32*1024*1024;
+  typedef std::map<uint64_t, std::vector<SDL_Texture*>> FramePool;
+  FramePool frame_pool;
+  size_t frame_pool_bytes;
+  std::vector<Uint32> converted_pixels;   /* Scratch for update_frame() */
+
+  /* Calls into the renderer for the frame being drawn, and the last one. */
+  unsigned int draw_calls;
+  unsigned int last_draw_calls;
 
  public:
   VideoSDL();
@@ -102,6 +152,12 @@ class VideoSDL : public Video {
                          const Video::Color color, Video::Frame *dest);
   virtual void draw_line(int x, int y, int x1, int y1,
                          const Video::Color color, Video::Frame *dest);
+  virtual bool draw_triangles(const Video::Image *image,
+                              const Video::Vertex *vertices, size_t count,
+                              Video::Frame *dest);
+  virtual void update_frame(int x, int y, unsigned int width,
+                            unsigned int height, const void *pixels,
+                            Video::Frame *dest);
 
   virtual void swap_buffers();
 
@@ -110,12 +166,16 @@ class VideoSDL : public Video {
   virtual float get_zoom_factor() { return zoom_factor; }
   virtual bool set_zoom_factor(float factor);
   virtual void get_screen_factor(float *fx, float *fy);
+  virtual unsigned int get_draw_calls() { return last_draw_calls; }
 
  protected:
   SDL_Surface *create_surface(int width, int height);
   SDL_Surface *create_surface_from_data(void *data, int width, int height);
   SDL_Texture *create_texture(int width, int height);
   SDL_Texture *create_texture_from_data(void *data, int width, int height);
+  void update_prescaled(int width, int height);
+  bool pack_image(Video::Image *image, void *data);
+  void flush_batch();
 };
 
 #endif  // SRC_VIDEO_SDL_H_
@@ -22,6 +22,7 @@
 #ifndef SRC_VIDEO_H_
 #define SRC_VIDEO_H_
 
+#include <cstddef>
 #include <exception>
 #include <string>
 
@@ -46,6 +47,15 @@ class Video {
     unsigned char a;
   } Color;
 
+  /* A corner of a triangle, at x, y in the frame, showing the pixel at
+     u, v of the image. */
+  typedef struct Vertex {
+    float x;
+    float y;
+    float u;
+    float v;
+  } Vertex;
+
   class Frame;
   class Image;
 
@@ -84,6 +94,15 @@ class Video {
                          const Video::Color color, Frame *dest) = 0;
   virtual void draw_line(int x, int y, int x1, int y1,
                          const Video::Color color, Frame *dest) = 0;
+  /* Draw triangles of the image, three vertices each. Returns false when
+     the video can't, and the caller has to draw them some other way. */
+  virtual bool draw_triangles(const Image *image, const Vertex *vertices,
+                              size_t count, Frame *dest) = 0;
+  /* Replace the pixels of a rectangle of the frame with the given ones,
+     four bytes each in the byte order of sprites. */
+  virtual void update_frame(int x, int y, unsigned int width,
+                            unsigned int height, const void *pixels,
+                            Frame *dest) = 0;
 
   virtual void swap_buffers() = 0;
 
@@ -93,6 +112,8 @@ class Video {
   virtual float get_zoom_factor() = 0;
   virtual bool set_zoom_factor(float factor) = 0;
   virtual void get_screen_factor(float *fx, float *fy) = 0;
+  /* Drawing calls the last frame took, batched ones counted once. */
+  virtual unsigned int get_draw_calls() = 0;
 };
 
 #endif  // SRC_VIDEO_H_
@@ -22,9 +22,12 @@
 #include "src/viewport.h"
 
 #include <algorithm>
+#include <cstdlib>
+#include <map>
 #include <memory>
 #include <utility>
 #include <sstream>
+#include <iomanip>
 #include <string>   //to satisfy cpplinter
 #include <vector>   //to satisfy cpplinter
 
@@ -34,10 +37,14 @@
 #include "src/debug.h"
 #include "src/data.h"
 #include "src/audio.h"
+#include "src/event_loop.h"
 #include "src/gfx.h"
 #include "src/interface.h"
 #include "src/popup.h"
 #include "src/pathfinder.h"
+#include "src/profiler.h"
+#include "src/alloc-stats.h"
+#include "src/sprite-tables.h"
 
 #define MAP_TILE_WIDTH   32
 #define MAP_TILE_HEIGHT  20
@@ -51,6 +58,8 @@
 
 MapPos ai_overlay_clicked_pos = bad_map_pos;
 
+bool Viewport::landscape_triangles = false;
+
 static const uint8_t tri_spr[] = {
   32, 32, 32, 32, 32, 32, 32, 32,
   32, 32, 32, 32, 32, 32, 32, 32,
@@ -105,6 +114,17 @@ Viewport::draw_triangle_up(int lx, int ly, int m, int left, int right,
 
   int sprite = tri_spr[index];
 
+  if (landscape_triangles) {
+    const int corners[] = {
+      MAP_TILE_WIDTH/2, 0,
+      0, MAP_TILE_HEIGHT + 4*(m - left),
+      MAP_TILE_WIDTH, MAP_TILE_HEIGHT + 4*(m - right)
+    };
+    if (tile->draw_masked_triangle(lx, ly, Data::AssetMapMaskUp, mask,
+                                   Data::AssetMapGround, sprite, corners)) {
+      return;
+    }
+  }
   tile->draw_masked_sprite(lx, ly, Data::AssetMapMaskUp, mask,
                             Data::AssetMapGround, sprite);
 }
@@ -144,6 +164,18 @@ Viewport::draw_triangle_down(int lx, int ly, int m, int left, int right,
 
   int sprite = tri_spr[index];
 
+  if (landscape_triangles) {
+    const int corners[] = {
+      MAP_TILE_WIDTH/2, 0,
+      0, -MAP_TILE_HEIGHT - 4*(left - m),
+      MAP_TILE_WIDTH, -MAP_TILE_HEIGHT - 4*(right - m)
+    };
+    if (tile->draw_masked_triangle(lx, ly + MAP_TILE_HEIGHT,
+                                   Data::AssetMapMaskDown, mask,
+                                   Data::AssetMapGround, sprite, corners)) {
+      return;
+    }
+  }
   tile->draw_masked_sprite(lx, ly + MAP_TILE_HEIGHT,
                             Data::AssetMapMaskDown, mask,
                             Data::AssetMapGround, sprite);
@@ -271,10 +303,13 @@ Viewport::draw_down_tile_col(MapPos pos, int x_base, int y_base,
 void
 Viewport::layout() {
   landscape_tiles.clear();
+  tiles_lru.clear();
+  tiles_bytes = 0;
 }
 
-void
-Viewport::redraw_map_pos(MapPos pos) {
+/* Id of the cached landscape tile that shows a map position. */
+unsigned int
+Viewport::landscape_tile_id(MapPos pos) {
   int mx, my;
   map_pix_from_map_coord(pos, map->get_height(pos), &mx, &my);
 
@@ -286,26 +321,71 @@ Viewport::redraw_map_pos(MapPos pos) {
 
   int tc = (mx / tile_width) % horiz_tiles;
   int tr = (my / tile_height) % vert_tiles;
-  int tid = tc + horiz_tiles*tr;
+  return tc + horiz_tiles*tr;
+}
 
-  TilesMap::iterator it = landscape_tiles.find(tid);
-  if (it != landscape_tiles.end()) {
-    landscape_tiles.erase(tid);
+/* Ids of the tiles whose roads and borders can reach pos. A segment
+   sprite reaches past the pixel of its position by less than a map tile
+   sideways and two upwards, and the changes come for all six neighbours
+   of what changed, so the tiles under the corners of that box are all
+   the ones to redraw. */
+void
+Viewport::get_overlay_tile_ids(MapPos pos, std::vector<unsigned int> *tids) {
+  int horiz_tiles = map->get_cols()/MAP_TILE_COLS;
+
+  int mx, my;
+  map_pix_from_map_coord(pos, map->get_height(pos), &mx, &my);
+  for (int dx : { -MAP_TILE_WIDTH, MAP_TILE_WIDTH }) {
+    for (int dy : { -2*MAP_TILE_HEIGHT, 2*MAP_TILE_HEIGHT }) {
+      int tc, tr;
+      tile_at_map_pix(mx + dx, my + dy, &tc, &tr);
+      tids->push_back(tc + horiz_tiles*tr);
+    }
   }
 }
 
-Frame *
-Viewport::get_tile_frame(unsigned int tid, int tc, int tr) {
-  TilesMap::iterator it = landscape_tiles.find(tid);
+/* The tile is kept, and redrawn when it is next needed. */
+void
+Viewport::redraw_map_pos(MapPos pos) {
+  TilesMap::iterator it = landscape_tiles.find(landscape_tile_id(pos));
   if (it != landscape_tiles.end()) {
-    return it->second.get();
+    it->second.dirty = true;
   }
+  on_borders_changed(pos);
+}
+
+/* Column and row of the tile at a map pixel, which may be outside the
+   map on any side. Wraps the same way draw_landscape() does. */
+void
+Viewport::tile_at_map_pix(int mx, int my, int *tc, int *tr) {
+  int horiz_tiles = map->get_cols()/MAP_TILE_COLS;
+  int vert_tiles = map->get_rows()/MAP_TILE_ROWS;
 
   int tile_width = MAP_TILE_COLS*MAP_TILE_WIDTH;
   int tile_height = MAP_TILE_ROWS*MAP_TILE_HEIGHT;
 
-  std::unique_ptr<Frame> tile_frame(
-    Graphics::get_instance().create_frame(tile_width, tile_height));
+  int map_width = map->get_cols()*MAP_TILE_WIDTH;
+  int map_height = map->get_rows()*MAP_TILE_HEIGHT;
+
+  while (my >= map_height) {
+    my -= map_height;
+    mx += (map->get_rows()*MAP_TILE_WIDTH)/2;
+  }
+  while (my < 0) {
+    my += map_height;
+    mx -= (map->get_rows()*MAP_TILE_WIDTH)/2;
+  }
+  mx = ((mx % map_width) + map_width) % map_width;
+
+  *tc = (mx / tile_width) % horiz_tiles;
+  *tr = (my / tile_height) % vert_tiles;
+}
+
+void
+Viewport::render_tile(Frame *tile_frame, int tc, int tr) {
+  int tile_width = MAP_TILE_COLS*MAP_TILE_WIDTH;
+  int tile_height = MAP_TILE_ROWS*MAP_TILE_HEIGHT;
+
   tile_frame->fill_rect(0, 0, tile_width, tile_height, Color::black);
 
   int col = (tc*MAP_TILE_COLS + (tr*MAP_TILE_ROWS)/2) % map->get_cols();
@@ -317,9 +397,9 @@ Viewport::get_tile_frame(unsigned int tid, int tc, int tr) {
   /* Draw one extra column as half a column will be outside the
    map tile on both right and left side.. */
   for (int col = 0; col < MAP_TILE_COLS+1; col++) {
-    draw_up_tile_col(pos, x_base, 0, tile_height, tile_frame.get());
+    draw_up_tile_col(pos, x_base, 0, tile_height, tile_frame);
     draw_down_tile_col(pos, x_base + MAP_TILE_WIDTH/2, 0, tile_height,
-                       tile_frame.get());
+                       tile_frame);
 
     pos = map->move_right(pos);
     x_base += MAP_TILE_WIDTH;
@@ -335,14 +415,189 @@ Viewport::get_tile_frame(unsigned int tid, int tc, int tr) {
                            << map->get_cols() << "," << map->get_rows()
                            << ", tc,tr: " << tc << "," << tr << ", tw,th: "
                            << tile_width << "," << tile_height;
+}
 
-  landscape_tiles[tid] = std::move(tile_frame);
+/* Roads and borders of the positions that can be drawn into the tile,
+   over a clear frame. The rows below the tile reach into it when they are
+   high up, and the segments of the row and columns around it cross its
+   edges. */
+void
+Viewport::render_overlay_tile(Frame *tile_frame, int tc, int tr) {
+  int col = (tc*MAP_TILE_COLS + (tr*MAP_TILE_ROWS)/2) % map->get_cols();
+  int row = tr*MAP_TILE_ROWS;
+  MapPos origin = map->pos(col, row);
 
-  return landscape_tiles[tid].get();
+  for (int dr = -2; dr < MAP_TILE_ROWS + 9; dr++) {
+    for (int dc = dr/2 - 2; dc < dr/2 + MAP_TILE_COLS + 2; dc++) {
+      MapPos pos = map->pos_add(origin, dc, dr);
+      int lx = MAP_TILE_WIDTH*dc - (MAP_TILE_WIDTH/2)*dr;
+      int ly = MAP_TILE_HEIGHT*dr;
+
+      /* For each direction right, down right and down,
+         draw the corresponding paths and borders. */
+      for (Direction d : cycle_directions_cw(DirectionRight, 3)) {
+        MapPos other_pos = map->move(pos, d);
+
+        if (map->has_path(pos, d)) {
+          draw_path_segment(lx, ly, pos, d, tile_frame);
+        } else if (map->has_owner(pos) != map->has_owner(other_pos) ||
+                   map->get_owner(pos) != map->get_owner(other_pos)) {
+          draw_border_segment(lx, ly, pos, d, tile_frame);
+        }
+      }
+    }
+  }
+}
+
+/* The cache entry of a tile, made the most recently drawn one. */
+Viewport::LandscapeTile &
+Viewport::get_tile(unsigned int tid) {
+  TilesMap::iterator it = landscape_tiles.find(tid);
+  if (it == landscape_tiles.end()) {
+    it = landscape_tiles.insert(std::make_pair(tid, LandscapeTile())).first;
+    it->second.dirty = false;
+    it->second.overlay_dirty = false;
+    it->second.lru = tiles_lru.insert(tiles_lru.begin(), tid);
+  } else {
+    tiles_lru.splice(tiles_lru.begin(), tiles_lru, it->second.lru);
+  }
+  it->second.drawn = tiles_round;
+  return it->second;
+}
+
+Frame *
+Viewport::get_tile_frame(unsigned int tid, int tc, int tr) {
+  LandscapeTile &tile = get_tile(tid);
+  if (tile.frame) {
+    if (tile.dirty) {
+      render_tile(tile.frame.get(), tc, tr);
+      tile.dirty = false;
+    }
+    return tile.frame.get();
+  }
+
+  int tile_width = MAP_TILE_COLS*MAP_TILE_WIDTH;
+  int tile_height = MAP_TILE_ROWS*MAP_TILE_HEIGHT;
+
+  tile.frame.reset(Graphics::get_instance().create_frame(tile_width,
+                                                         tile_height));
+  render_tile(tile.frame.get(), tc, tr);
+  tile.dirty = false;
+  tiles_bytes += tile_width*tile_height*4;
+
+  trim_tile_cache();
+
+  return tile.frame.get();
+}
+
+/* A dirty overlay gets a new frame, which starts out clear. */
+Frame *
+Viewport::get_overlay_frame(unsigned int tid, int tc, int tr) {
+  LandscapeTile &tile = get_tile(tid);
+  if (tile.overlay && !tile.overlay_dirty) {
+    return tile.overlay.get();
+  }
+
+  int tile_width = MAP_TILE_COLS*MAP_TILE_WIDTH;
+  int tile_height = MAP_TILE_ROWS*MAP_TILE_HEIGHT;
+
+  if (!tile.overlay) {
+    tiles_bytes += tile_width*tile_height*4;
+  }
+  tile.overlay.reset(Graphics::get_instance().create_frame(tile_width,
+                                                           tile_height));
+  render_overlay_tile(tile.overlay.get(), tc, tr);
+  tile.overlay_dirty = false;
+
+  trim_tile_cache();
+
+  return tile.overlay.get();
 }
 
+/* Drop the least recently drawn tiles until the cache is within budget,
+   but never one drawn in this frame. */
 void
-Viewport::draw_landscape() {
+Viewport::trim_tile_cache() {
+  size_t tile_bytes = MAP_TILE_COLS*MAP_TILE_WIDTH *
+                      MAP_TILE_ROWS*MAP_TILE_HEIGHT*4;
+  while (tiles_bytes > tile_cache_budget && !tiles_lru.empty()) {
+    TilesMap::iterator it = landscape_tiles.find(tiles_lru.back());
+    if (it->second.drawn == tiles_round) {
+      break;
+    }
+    if (it->second.frame) tiles_bytes -= tile_bytes;
+    if (it->second.overlay) tiles_bytes -= tile_bytes;
+    landscape_tiles.erase(it);
+    tiles_lru.pop_back();
+  }
+}
+
+void
+Viewport::add_memory_usage(MemoryUsage *usage) const {
+  usage->add("viewport.landscape_tiles", landscape_tiles.size(),
+             tiles_bytes + MemoryUsage::tree_bytes(landscape_tiles) +
+             MemoryUsage::list_bytes(tiles_lru));
+}
+
+/* Render the tiles just past the edges the view is scrolling towards,
+   a few each frame, so that scrolling doesn't stall on whole tiles. */
+void
+Viewport::prefetch_tiles() {
+  if (scroll_x == 0 && scroll_y == 0) {
+    return;
+  }
+
+  int horiz_tiles = map->get_cols()/MAP_TILE_COLS;
+
+  int tile_width = MAP_TILE_COLS*MAP_TILE_WIDTH;
+  int tile_height = MAP_TILE_ROWS*MAP_TILE_HEIGHT;
+
+  /* Points one tile past the visible edges, stepped less than a tile
+     apart so that no tile along the edge is missed. */
+  std::vector<std::pair<int, int>> ahead;
+  int edge_x = (scroll_x > 0) ? offset_x + width + tile_width/2 :
+                                offset_x - tile_width/2;
+  int edge_y = (scroll_y > 0) ? offset_y + height + tile_height/2 :
+                                offset_y - tile_height/2;
+  if (scroll_x != 0) {
+    for (int y = offset_y; y < offset_y + height + tile_height/2;
+         y += tile_height/2) {
+      ahead.push_back(std::make_pair(edge_x, y));
+    }
+  }
+  if (scroll_y != 0) {
+    for (int x = offset_x; x < offset_x + width + tile_width/2;
+         x += tile_width/2) {
+      ahead.push_back(std::make_pair(x, edge_y));
+    }
+  }
+  if (scroll_x != 0 && scroll_y != 0) {
+    ahead.push_back(std::make_pair(edge_x, edge_y));
+  }
+
+  unsigned int rendered = 0;
+  for (const std::pair<int, int> &point : ahead) {
+    int tc, tr;
+    tile_at_map_pix(point.first, point.second, &tc, &tr);
+    unsigned int tid = tc + horiz_tiles*tr;
+    bool paths = (layers & LayerPaths) != 0;
+    TilesMap::iterator it = landscape_tiles.find(tid);
+    if (it != landscape_tiles.end() && it->second.frame &&
+        !it->second.dirty && (!paths || (it->second.overlay &&
+                                         !it->second.overlay_dirty))) {
+      continue;
+    }
+    get_tile_frame(tid, tc, tr);
+    if (paths) get_overlay_frame(tid, tc, tr);
+    if (++rendered >= tile_prefetch_per_frame) {
+      break;
+    }
+  }
+}
+
+/* Copy the cached tiles, or their overlays, that the view shows. */
+void
+Viewport::draw_cached_tiles(bool overlay) {
   int horiz_tiles = map->get_cols()/MAP_TILE_COLS;
   int vert_tiles = map->get_rows()/MAP_TILE_ROWS;
 
@@ -372,7 +627,8 @@ Viewport::draw_landscape() {
       int tr = (my / tile_height) % vert_tiles;
       int tid = tc + horiz_tiles*tr;
 
-      Frame *tile_frame = get_tile_frame(tid, tc, tr);
+      Frame *tile_frame = overlay ? get_overlay_frame(tid, tc, tr) :
+                                    get_tile_frame(tid, tc, tr);
 
       int w = tile_width - tx;
       if (lx+w > width) {
@@ -393,9 +649,16 @@ Viewport::draw_landscape() {
   }
 }
 
+void
+Viewport::draw_landscape() {
+  draw_cached_tiles(false);
+  prefetch_tiles();
+}
+
 
 void
-Viewport::draw_path_segment(int lx, int ly, MapPos pos, Direction dir) {
+Viewport::draw_path_segment(int lx, int ly, MapPos pos, Direction dir,
+                            Frame *dest) {
   int h1 = map->get_height(pos);
   int h2 = map->get_height(map->move(pos, dir));
   int h_diff = h1 - h2;
@@ -454,13 +717,14 @@ Viewport::draw_path_segment(int lx, int ly, MapPos pos, Direction dir) {
     sprite += 3;
   }
 
-  frame->draw_masked_sprite(lx, ly,
-                            Data::AssetPathMask, mask,
-                            Data::AssetPathGround, sprite);
+  dest->draw_masked_sprite(lx, ly,
+                           Data::AssetPathMask, mask,
+                           Data::AssetPathGround, sprite);
 }
 
 void
-Viewport::draw_border_segment(int lx, int ly, MapPos pos, Direction dir) {
+Viewport::draw_border_segment(int lx, int ly, MapPos pos, Direction dir,
+                              Frame *dest) {
   int h1 = map->get_height(pos);
   int h2 = map->get_height(map->move(pos, dir));
   int h_diff = h2 - h1;
@@ -520,7 +784,7 @@ Viewport::draw_border_segment(int lx, int ly, MapPos pos, Direction dir) {
     sprite += 3;
   }
 
-  frame->draw_sprite(lx, ly, Data::AssetMapBorder, sprite, false);
+  dest->draw_sprite(lx, ly, Data::AssetMapBorder, sprite, false);
 }
 
 MapPos
@@ -544,64 +808,12 @@ Viewport::get_offset(int *x_off, int *y_off, int *col, int *row) {
   return map->pos(col_0, row_0);
 }
 
+/* Roads and borders change far less often than frames are drawn, so
+   they are kept in overlays of the landscape tiles, redrawn when the
+   map journal tells of paths or owners changing under them. */
 void
 Viewport::draw_paths_and_borders() {
-  int x_off = 0;
-  int y_off = 0;
-  MapPos base_pos = get_offset(&x_off, &y_off);
-
-  for (int x_base = x_off; x_base < width + MAP_TILE_WIDTH;
-       x_base += MAP_TILE_WIDTH) {
-    MapPos pos = base_pos;
-    int y_base = y_off;
-    int row = 0;
-
-    while (1) {
-      int lx;
-      if (row % 2 == 0) {
-        lx = x_base;
-      } else {
-        lx = x_base - MAP_TILE_WIDTH/2;
-      }
-
-      int ly = y_base - 4* map->get_height(pos);
-      if (ly >= height) break;
-
-      /* For each direction right, down right and down,
-         draw the corresponding paths and borders. */
-      for (Direction d : cycle_directions_cw(DirectionRight, 3)) {
-        MapPos other_pos = map->move(pos, d);
-
-        if (map->has_path(pos, d)) {
-          draw_path_segment(lx, y_base, pos, d);
-        } else if (map->has_owner(pos) != map->has_owner(other_pos) ||
-                   map->get_owner(pos) != map->get_owner(other_pos)) {
-          draw_border_segment(lx, y_base, pos, d);
-        }
-      }
-#if 0
-      for (int d = DIR_RIGHT; d <= DIR_UP_RIGHT; d++) {
-        if (map->has_path(pos, (dir_t)d)) {
-          int x, y;
-          screen_pix_from_map_coord(pos, &x, &y);
-          int x1, y1;
-          screen_pix_from_map_coord(map->move(pos, (dir_t)d), &x1, &y1);
-          frame->draw_line(x, y, x1, y1, 76);
-        }
-      }
-#endif
-      if (row % 2 == 0) {
-        pos = map->move_down(pos);
-      } else {
-        pos = map->move_down_right(pos);
-      }
-
-      y_base += MAP_TILE_HEIGHT;
-      row += 1;
-    }
-
-    base_pos = map->move_right(base_pos);
-  }
+  draw_cached_tiles(true);
 
   /* If we're in road construction mode, also draw
      the temporarily placed roads. */
@@ -620,7 +832,7 @@ Viewport::draw_paths_and_borders() {
       screen_pix_from_map_coord(draw_pos, &sx, &sy);
 
       draw_path_segment(sx, sy + 4 * map->get_height(draw_pos), draw_pos,
-                        draw_dir);
+                        draw_dir, frame);
 
       pos = map->move(pos, dir);
     }
@@ -708,8 +920,27 @@ Viewport::draw_ocupation_flag(Building *building, int lx, int ly, float mul) {
   }
 }
 
+/* Mine elevator, drawn before the mine itself. */
 void
-Viewport::draw_unharmed_building(Building *building, int lx, int ly) {
+Viewport::draw_mine_elevator(Building *building, int lx, int ly) {
+  Random random;
+
+  if (building->is_active()) { /* Draw elevator up */
+    draw_game_sprite(lx-6, ly-39, 152);
+  }
+  if (building->is_playing_sfx()) { /* Draw elevator down */
+    draw_game_sprite(lx-6, ly-39, 153);
+    MapPos pos = building->get_position();
+    if ((((interface->get_game()->get_tick() +
+           reinterpret_cast<uint8_t*>(&pos)[1]) >> 3) & 7) == 0
+        && random.random() < 40000) {
+      play_sound(Audio::TypeSfxElevator);
+    }
+  }
+}
+
+void
+Viewport::draw_pigs(Building *building, int lx, int ly) {
   Random random;
 
   static const int pigfarm_anim[] = {
@@ -737,377 +968,118 @@ Viewport::draw_unharmed_building(Building *building, int lx, int ly) {
     0xa2, 0, 0xa2, 0
   };
 
-  if (building->is_done()) {
-    Building::Type type = building->get_type();
-    switch (type) {
-    case Building::TypeFisher:
-    case Building::TypeLumberjack:
-    case Building::TypeStonecutter:
-    case Building::TypeForester:
-    case Building::TypeStock:
-    case Building::TypeFarm:
-    case Building::TypeButcher:
-    case Building::TypeSawmill:
-    case Building::TypeToolMaker:
-    case Building::TypeCastle:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      break;
-    case Building::TypeBoatbuilder:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      if (building->get_res_count_in_stock(1) > 0) {
-        /* TODO x might not be correct */
-        draw_game_sprite(lx+3, ly + 13,
-                         174 + building->get_res_count_in_stock(1));
-      }
-      break;
-    case Building::TypeStoneMine:
-    case Building::TypeCoalMine:
-    case Building::TypeIronMine:
-    case Building::TypeGoldMine:
-      if (building->is_active()) { /* Draw elevator up */
-        draw_game_sprite(lx-6, ly-39, 152);
-      }
-      if (building->is_playing_sfx()) { /* Draw elevator down */
-        draw_game_sprite(lx-6, ly-39, 153);
-        MapPos pos = building->get_position();
-        if ((((interface->get_game()->get_tick() +
-               reinterpret_cast<uint8_t*>(&pos)[1]) >> 3) & 7) == 0
-            && random.random() < 40000) {
-          play_sound(Audio::TypeSfxElevator);
-        }
-      }
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      break;
-    case Building::TypeHut:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      draw_ocupation_flag(building, lx - 14, ly + 2, 2);
-      break;
-    case Building::TypePigFarm:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      if (building->get_res_count_in_stock(1) > 0) {
-        if ((random.random() & 0x7f) <
-            static_cast<int>(building->get_res_count_in_stock(1))) {
-          play_sound(Audio::TypeSfxPigOink);
-        }
+  if (building->get_res_count_in_stock(1) > 0) {
+    if ((random.random() & 0x7f) <
+        static_cast<int>(building->get_res_count_in_stock(1))) {
+      play_sound(Audio::TypeSfxPigOink);
+    }
 
-        int pigs_count = building->get_res_count_in_stock(1);
-
-        int pigs_layout[] = {
-          0,   0,   0,  0,
-          6, 140,  -2,  6,
-          5, 280,   8,  8,
-          3, 420, -11,  8,
-          1,  40,   2, 11,
-          7, 180,  -8, 13,
-          8, 320,  13, 14,
-          2, 460,   0, 17,
-          4,  90, -11, 19,
-        };
-
-        for (int p = 1; p <= pigs_count; p++) {
-          if (pigs_count >= pigs_layout[p * 4]) {
-            int i = (pigs_layout[p * 4 + 1]
-                     + (interface->get_game()->get_tick() >> 3)) & 0xfe;
-            draw_game_sprite(lx + pigfarm_anim[i + 1] + pigs_layout[p * 4 + 2],
-                             ly + pigs_layout[p * 4 + 3], pigfarm_anim[i]);
-          }
-        }
-      }
-      break;
-    case Building::TypeMill:
-      if (building->is_active()) {
-        if ((interface->get_game()->get_tick() >> 4) & 3) {
-          building->stop_playing_sfx();
-        } else if (!building->is_playing_sfx()) {
-          building->start_playing_sfx();
-          play_sound(Audio::TypeSfxMillGrinding);
-        }
-        draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type] +
-                                ((interface->get_game()->get_tick() >> 4) & 3));
-      } else {
-        draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      }
-      break;
-    case Building::TypeBaker:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      if (building->is_active()) {
-        draw_game_sprite(lx + 5, ly-21,
-                         154 + ((interface->get_game()->get_tick() >> 3) & 7));
-      }
-      break;
-    case Building::TypeSteelSmelter:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      if (building->is_active()) {
-        int i = (interface->get_game()->get_tick() >> 3) & 7;
-        if (i == 0 || (i == 7 && !building->is_playing_sfx())) {
-          building->start_playing_sfx();
-          play_sound(Audio::TypeSfxGoldBoils);
-        } else if (i != 7) {
-          building->stop_playing_sfx();
-        }
+    int pigs_count = building->get_res_count_in_stock(1);
 
-        draw_game_sprite(lx+6, ly-32, 128+i);
-      }
-      break;
-    case Building::TypeWeaponSmith:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      if (building->is_active()) {
-        draw_game_sprite(lx-16, ly-21,
-                         128 + ((interface->get_game()->get_tick() >> 3) & 7));
-      }
-      break;
-    case Building::TypeTower:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      draw_ocupation_flag(building, lx + 13, ly - 18, 1.f);
-      break;
-    case Building::TypeFortress:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      draw_ocupation_flag(building, lx - 12, ly - 21, 0.5f);
-      if (building->has_knight()) {
-        draw_game_sprite(lx+22, ly - 34 - (building->get_knight_count()+1)/2,
-                    182 + (((interface->get_game()->get_tick() >> 3) + 2) & 3) +
-                         4 * static_cast<int>(building->get_threat_level()));
-      }
-      break;
-    case Building::TypeGoldSmelter:
-      draw_shadow_and_building_sprite(lx, ly, map_building_sprite[type]);
-      if (building->is_active()) {
-        int i = (interface->get_game()->get_tick() >> 3) & 7;
-        if (i == 0 || (i == 7 && !building->is_playing_sfx())) {
-          building->start_playing_sfx();
-          play_sound(Audio::TypeSfxGoldBoils);
-        } else if (i != 7) {
-          building->stop_playing_sfx();
-        }
+    static const int pigs_layout[] = {
+      0,   0,   0,  0,
+      6, 140,  -2,  6,
+      5, 280,   8,  8,
+      3, 420, -11,  8,
+      1,  40,   2, 11,
+      7, 180,  -8, 13,
+      8, 320,  13, 14,
+      2, 460,   0, 17,
+      4,  90, -11, 19,
+    };
 
-        draw_game_sprite(lx-7, ly-33, 128+i);
+    for (int p = 1; p <= pigs_count; p++) {
+      if (pigs_count >= pigs_layout[p * 4]) {
+        int i = (pigs_layout[p * 4 + 1]
+                 + (interface->get_game()->get_tick() >> 3)) & 0xfe;
+        draw_game_sprite(lx + pigfarm_anim[i + 1] + pigs_layout[p * 4 + 2],
+                         ly + pigs_layout[p * 4 + 3], pigfarm_anim[i]);
       }
-      break;
-    default:
-      NOT_REACHED();
-      break;
     }
-  } else { /* unfinished building */
+  }
+}
+
+/* The building sprites come from SpriteTables::get_building_look(), the
+   extras of a few types are drawn by the hooks here. */
+void
+Viewport::draw_unharmed_building(Building *building, int lx, int ly) {
+  if (!building->is_done()) { /* unfinished building */
     if (building->get_type() != Building::TypeCastle) {
       draw_building_unfinished(building, building->get_type(), lx, ly);
     } else {
       draw_shadow_and_building_unfinished(lx, ly, 0xb2,
                                           building->get_progress());
     }
+    return;
+  }
+
+  Building::Type type = building->get_type();
+  if (type == Building::TypeNone) {
+    NOT_REACHED();
+    return;
+  }
+  const SpriteTables::BuildingLook &look =
+                                        SpriteTables::get_building_look(type);
+  unsigned int tick = interface->get_game()->get_tick();
+
+  int sprite = map_building_sprite[type];
+  if (look.extra == SpriteTables::ExtraElevator) {
+    draw_mine_elevator(building, lx, ly);
+  } else if (look.extra == SpriteTables::ExtraMillSails &&
+             building->is_active()) {
+    if ((tick >> 4) & 3) {
+      building->stop_playing_sfx();
+    } else if (!building->is_playing_sfx()) {
+      building->start_playing_sfx();
+      play_sound(Audio::TypeSfxMillGrinding);
+    }
+    sprite += (tick >> 4) & 3;
+  }
+  draw_shadow_and_building_sprite(lx, ly, sprite);
+
+  if (look.flag_mul != 0.f) {
+    draw_ocupation_flag(building, lx + look.flag_x, ly + look.flag_y,
+                        look.flag_mul);
+  }
+
+  if (look.work_sprite != 0 && building->is_active()) {
+    int i = (tick >> 3) & 7;
+    if (look.work_boils) {
+      if (i == 0 || (i == 7 && !building->is_playing_sfx())) {
+        building->start_playing_sfx();
+        play_sound(Audio::TypeSfxGoldBoils);
+      } else if (i != 7) {
+        building->stop_playing_sfx();
+      }
+    }
+    draw_game_sprite(lx + look.work_x, ly + look.work_y, look.work_sprite + i);
+  }
+
+  switch (look.extra) {
+  case SpriteTables::ExtraBoat:
+    if (building->get_res_count_in_stock(1) > 0) {
+      /* TODO x might not be correct */
+      draw_game_sprite(lx+3, ly + 13,
+                       174 + building->get_res_count_in_stock(1));
+    }
+    break;
+  case SpriteTables::ExtraPigs:
+    draw_pigs(building, lx, ly);
+    break;
+  case SpriteTables::ExtraSecondFlag:
+    if (building->has_knight()) {
+      draw_game_sprite(lx+22, ly - 34 - (building->get_knight_count()+1)/2,
+                       182 + (((tick >> 3) + 2) & 3) +
+                       4 * static_cast<int>(building->get_threat_level()));
+    }
+    break;
+  default:
+    break;
   }
 }
 
 void
 Viewport::draw_burning_building(Building *building, int lx, int ly) {
-  const int building_anim_offset_from_type[] = {
-    0, 10, 26, 39, 49, 62, 78, 97, 97, 116,
-    129, 157, 167, 198, 211, 236, 255, 277, 305, 324,
-    349, 362, 381, 418, 446
-  };
-
-  const int building_burn_animation[] = {
-    /* Unfinished */
-    0, -8, 2,
-    8, 0, 4,
-    0, 8, 2, -1,
-
-    /* Fisher */
-    0, -8, -10,
-    0, 4, -12,
-    8, -8, 4,
-    8, 7, 4,
-    0, -2, 8, -1,
-
-    /* Lumberjack */
-    0, 3, -13,
-    0, -8, -10,
-    8, 9, 3,
-    8, -6, 3, -1,
-
-    /* Boat builder */
-    0, -1, -12,
-    8, -8, 11,
-    8, 7, 5, -1,
-
-    /* Stone cutter */
-    0, 6, -14,
-    0, -9, -11,
-    8, -8, 5,
-    8, 6, 5, -1,
-
-    /* Stone mine */
-    8, -4, -40,
-    8, -8, -15,
-    8, 3, -14,
-    8, -9, 4,
-    8, 6, 5, -1,
-
-    /* Coal mine */
-    8, -4, -40,
-    8, -1, -18,
-    8, -8, -15,
-    8, 6, 2,
-    8, 0, 8,
-    8, -8, 9, -1,
-
-    /* Iron mine, gold mine */
-    8, -4, -40,
-    8, -2, -19,
-    8, -9, -14,
-    8, -8, 2,
-    8, 6, 2,
-    0, -4, 8, -1,
-
-    /* Forester */
-    0, 8, -11,
-    0, -6, -8,
-    8, -8, 4,
-    8, 6, 4, -1,
-
-    /* Stock */
-    0, -2, -25,
-    0, 6, -17,
-    0, -9, -16,
-    8, -21, 1,
-    8, 21, 2,
-    0, 15, 18,
-    0, -16, 10,
-    8, -8, 15,
-    8, 5, 15, -1,
-
-    /* Hut */
-    0, 0, -11,
-    8, -8, 5,
-    8, 8, 5, -1,
-
-    /* Farm */
-    8, 22, -2,
-    8, 7, -5,
-    8, -3, -1,
-    8, -23, 0,
-    8, -12, 4,
-    0, 25, 5,
-    0, 21, 13,
-    0, -17, 8,
-    0, -10, 15,
-    0, -2, 15, -1,
-
-    /* Butcher */
-    8, -15, 3,
-    8, 20, 3,
-    8, 7, 3,
-    8, -4, 3, -1,
-
-    /* Pig farm */
-    8, 0, -2,
-    8, 22, 1,
-    8, 15, 5,
-    8, -20, -1,
-    8, -11, 3,
-    0, 20, 12,
-    0, -16, 7,
-    0, -12, 14, -1,
-
-    /* Mill */
-    0, 7, -33,
-    0, 5, -20,
-    8, -2, -24,
-    8, -6, 1,
-    8, 4, 2,
-    0, -3, 6, -1,
-
-    /* Baker */
-    0, -15, -16,
-    0, -4, -19,
-    0, 3, -16,
-    8, -13, 2,
-    8, -9, 7,
-    8, 6, 7,
-    0, 17, 1, -1,
-
-    /* Saw mill */
-    0, 7, -19,
-    0, -1, -14,
-    0, 16, -13,
-    0, 5, -8,
-    8, 14, 4,
-    0, 10, 9,
-    0, -17, 8,
-    8, -11, 10,
-    8, -1, 12, -1,
-
-    /* Steel smelter */
-    0, 5, -19,
-    0, 16, -16,
-    8, -14, 2,
-    8, -10, 5,
-    8, 15, 5,
-    8, 2, 5, -1,
-
-    /* Tool maker */
-    8, 7, -19,
-    0, -11, -17,
-    0, -4, -11,
-    0, 12, -10,
-    8, -20, 0,
-    8, -15, 7,
-    8, 1, 7,
-    8, 15, 7, -1,
-
-    /* Weapon smith */
-    8, -15, 1,
-    8, -10, 3,
-    8, 20, 3,
-    8, 5, 3, -1,
-
-    /* Tower */
-    0, -6, -30,
-    0, 7, -14,
-    8, -11, -3,
-    0, -8, 4,
-    8, 9, 5,
-    8, -4, 5, -1,
-
-    /* Fortress */
-    0, -3, -30,
-    0, -15, -26,
-    0, 21, -29,
-    0, -13, -17,
-    8, 4, -11,
-    8, -2, -6,
-    8, -22, 0,
-    8, -17, 8,
-    8, 20, 1,
-    8, 10, 8,
-    8, 4, 13,
-    8, -11, 15, -1,
-
-    /* Gold smelter */
-    0, -15, -20,
-    0, 10, -22,
-    0, -3, -25,
-    0, -8, -10,
-    0, 7, -10,
-    0, -13, 2,
-    8, -8, 5,
-    8, 6, 5,
-    0, 16, 6, -1,
-
-    /* Castle */
-    0, 11, -46,
-    0, -19, -42,
-    8, 1, -27,
-    8, 10, -13,
-    0, -7, -24,
-    8, -16, -6,
-    0, -23, 4,
-    8, -2, 0,
-    8, 12, 12,
-    8, -14, 17,
-    8, -4, 19,
-    0, 13, 19, -1
-  };
-
   /* Play sound effect. */
   if (((building->get_burning_counter() >> 3) & 3) == 3 &&
       !building->is_playing_sfx()) {
@@ -1125,15 +1097,14 @@ Viewport::draw_burning_building(Building *building, int lx, int ly) {
                                                 // done in update_buildings().
     draw_unharmed_building(building, lx, ly);
 
-    int type = 0;
+    Building::Type type = Building::TypeNone;
     if (building->is_done() ||
         building->get_progress() >= 16000) {
       type = building->get_type();
     }
 
     int offset = ((building->get_burning_counter() >> 3) & 7) ^ 7;
-    const int *anim = building_burn_animation +
-                      building_anim_offset_from_type[type];
+    const int *anim = SpriteTables::get_burn_animation(type);
     while (anim[0] >= 0) {
       draw_game_sprite(lx+anim[1], ly+anim[2], 136 + anim[0] + offset);
       offset = (offset + 3) & 7;
@@ -1172,15 +1143,38 @@ Viewport::draw_water_waves(MapPos pos, int lx, int ly) {
   }
 }
 
+/* Note what each tile of a row has to draw in the given layers, tiles
+   with nothing left out. */
 void
-Viewport::draw_water_waves_row(MapPos pos, int y_base, int cols,
-                                 int x_base) {
+Viewport::collect_row_items(MapPos pos, int cols, int x_base, int layers_) {
+  row_items.clear();
   for (int i = 0; i < cols; i++, x_base += MAP_TILE_WIDTH,
        pos = map->move_right(pos)) {
-    if (map->type_up(pos) <= Map::TerrainWater3 ||
-        map->type_down(pos) <= Map::TerrainWater3) {
+    unsigned int kinds = 0;
+    if ((layers_ & LayerLandscape) &&
+        (map->type_up(pos) <= Map::TerrainWater3 ||
+         map->type_down(pos) <= Map::TerrainWater3)) {
+      kinds |= RowItemWaves;
+    }
+    if ((layers_ & LayerObjects) && map->get_obj(pos) != Map::ObjectNone) {
+      kinds |= RowItemObject;
+    }
+    if (layers_ & LayerSerfs) {
+      if (map->has_serf(pos)) kinds |= RowItemSerf;
+      if (map->get_idle_serf(pos)) kinds |= RowItemIdleSerf;
+    }
+    if (kinds != 0) {
+      row_items.push_back(RowItem{ pos, x_base, kinds });
+    }
+  }
+}
+
+void
+Viewport::draw_water_waves_row(int y_base) {
+  for (const RowItem &item : row_items) {
+    if (item.kinds & RowItemWaves) {
       /*player->water_in_view += 1;*/
-      draw_water_waves(pos, x_base, y_base);
+      draw_water_waves(item.pos, item.x, y_base);
     }
   }
 }
@@ -1220,10 +1214,11 @@ Viewport::draw_flag_and_res(MapPos pos, int lx, int ly) {
 }
 
 void
-Viewport::draw_map_objects_row(MapPos pos, int y_base, int cols, int x_base) {
-  for (int i = 0; i < cols;
-       i++, x_base += MAP_TILE_WIDTH, pos = map->move_right(pos)) {
-    if (map->get_obj(pos) == Map::ObjectNone) continue;
+Viewport::draw_map_objects_row(int y_base) {
+  for (const RowItem &item : row_items) {
+    if ((item.kinds & RowItemObject) == 0) continue;
+    MapPos pos = item.pos;
+    int x_base = item.x;
 
     int ly = y_base - 4 * map->get_height(pos);
     if (map->get_obj(pos) < Map::ObjectTree0) {
@@ -1360,490 +1355,92 @@ Viewport::draw_row_serf(int lx, int ly, bool shadow, const Color &color,
 /* Translate serf type into the corresponding sprite code. */
 int
 Viewport::serf_get_body(Serf *serf) {
-  const int transporter_type[] = {
-    0, 0x3000, 0x3500, 0x3b00, 0x4100, 0x4600, 0x4b00, 0x1400,
-    0x700, 0x5100, 0x800, 0x1c00, 0x1d00, 0x1e00, 0x1a00, 0x1b00,
-    0x6800, 0x6d00, 0x6500, 0x6700, 0x6b00, 0x6a00, 0x6600, 0x6900,
-    0x6c00, 0x5700, 0x5600, 0, 0, 0, 0, 0
-  };
-
-  const int sailor_type[] = {
-    0, 0x3100, 0x3600, 0x3c00, 0x4200, 0x4700, 0x4c00, 0x1500,
-    0x900, 0x7700, 0xa00, 0x2100, 0x2200, 0x2300, 0x1f00, 0x2000,
-    0x6e00, 0x6f00, 0x7000, 0x7100, 0x7200, 0x7300, 0x7400, 0x7500,
-    0x7600, 0x5f00, 0x6000, 0, 0, 0, 0, 0
-  };
-
   Data::Animation animation = data_source->get_animation(serf->get_animation(),
                                                          serf->get_counter());
-  int t = animation.sprite;
-
-  switch (serf->get_type()) {
-  case Serf::TypeTransporter:
-  case Serf::TypeGeneric:
-    if (serf->get_state() == Serf::StateIdleOnPath) {
-      return -1;
-    } else if ((serf->get_state() == Serf::StateTransporting ||
-                serf->get_state() == Serf::StateDelivering) &&
-               serf->get_delivery() != 0) {
-      t += transporter_type[serf->get_delivery()];
-    }
-    break;
-  case Serf::TypeSailor:
-    if (serf->get_state() == Serf::StateTransporting && t < 0x80) {
-      if (((t & 7) == 4 && !serf->playing_sfx()) ||
-          (t & 7) == 3) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxRowing);
-      } else {
-        serf->stop_playing_sfx();
-      }
-    }
-
-    if ((serf->get_state() == Serf::StateTransporting &&
-         serf->get_delivery() == 0) ||
-        serf->get_state() == Serf::StateLostSailor ||
-        serf->get_state() == Serf::StateFreeSailing) {
-      if (t < 0x80) {
-        if (((t & 7) == 4 && !serf->playing_sfx()) ||
-            (t & 7) == 3) {
-          serf->start_playing_sfx();
-          play_sound(Audio::TypeSfxRowing);
-        } else {
-          serf->stop_playing_sfx();
-        }
-      }
-      t += 0x200;
-    } else if (serf->get_state() == Serf::StateTransporting) {
-      t += sailor_type[serf->get_delivery()];
-    } else {
-      t += 0x100;
-    }
-    break;
-  case Serf::TypeDigger:
-    if (t < 0x80) {
-      t += 0x300;
-    } else if (t == 0x83 || t == 0x84) {
-      if (t == 0x83 || !serf->playing_sfx()) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxDigging);
-      }
-      t += 0x380;
-    } else {
-      serf->stop_playing_sfx();
-      t += 0x380;
-    }
-    break;
-  case Serf::TypeBuilder:
-    if (t < 0x80) {
-      t += 0x500;
-    } else if ((t & 7) == 4 || (t & 7) == 5) {
-      if ((t & 7) == 4 || !serf->playing_sfx()) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxHammerBlow);
-      }
-      t += 0x580;
-    } else {
-      serf->stop_playing_sfx();
-      t += 0x580;
-    }
-    break;
-  case Serf::TypeTransporterInventory:
-    if (serf->get_state() == Serf::StateBuildingCastle) {
-      return -1;
-    } else {
-      int res = serf->get_delivery();
-      t += transporter_type[res];
-    }
-    break;
-  case Serf::TypeLumberjack:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateFreeWalking &&
-          serf->get_free_walking_neg_dist1() == -128 &&
-          serf->get_free_walking_neg_dist2() == 1) {
-        t += 0x1000;
-      } else {
-        t += 0xb00;
-      }
-    } else if ((t == 0x86 && !serf->playing_sfx()) ||
-         t == 0x85) {
-      serf->start_playing_sfx();
-      play_sound(Audio::TypeSfxAxBlow);
-      /* TODO Dangerous reference to unknown state vars.
-         It is probably free walking. */
-      if (serf->get_free_walking_neg_dist2() == 0 &&
-          serf->get_counter() < 64) {
-        play_sound(Audio::TypeSfxTreeFall);
-      }
-      t += 0xe80;
-    } else if (t != 0x86) {
-      serf->stop_playing_sfx();
-      t += 0xe80;
-    }
-    break;
-  case Serf::TypeSawmiller:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-            Serf::StateDropResourceOut) {
-        t += 0x1700;
-      } else {
-        t += 0xc00;
-      }
-    } else {
-      /* player_num += 4; ??? */
-      if (t == 0xb3 || t == 0xbb || t == 0xc3 || t == 0xcb ||
-          (!serf->playing_sfx() && (t == 0xb7 || t == 0xbf ||
-                t == 0xc7 || t == 0xcf))) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxSawing);
-      } else if (t != 0xb7 && t != 0xbf && t != 0xc7 && t != 0xcf) {
-        serf->stop_playing_sfx();
-      }
-      t += 0x1580;
-    }
-    break;
-  case Serf::TypeStonecutter:
-    if (t < 0x80) {
-      if ((serf->get_state() == Serf::StateFreeWalking &&
-           serf->get_free_walking_neg_dist1() == -128 &&
-           serf->get_free_walking_neg_dist2() == 1) ||
-          (serf->get_state() == Serf::StateStoneCutting &&
-           serf->get_free_walking_neg_dist1() == 2)) {
-        t += 0x1200;
-      } else {
-        t += 0xd00;
-      }
-    } else if (t == 0x85 || (t == 0x86 && !serf->playing_sfx())) {
-      serf->start_playing_sfx();
-      play_sound(Audio::TypeSfxPickBlow);
-      t += 0x1280;
-    } else if (t != 0x86) {
-      serf->stop_playing_sfx();
-      t += 0x1280;
-    }
-    break;
-  case Serf::TypeForester:
-    if (t < 0x80) {
-      t += 0xe00;
-    } else if (t == 0x86 || (t == 0x87 && !serf->playing_sfx())) {
-      serf->start_playing_sfx();
-      play_sound(Audio::TypeSfxPlanting);
-      t += 0x1080;
-    } else if (t != 0x87) {
-      serf->stop_playing_sfx();
-      t += 0x1080;
-    }
-    break;
-  case Serf::TypeMiner:
-    if (t < 0x80) {
-      if ((serf->get_state() != Serf::StateMining ||
-           serf->get_mining_res() == 0) &&
-          (serf->get_state() != Serf::StateLeavingBuilding ||
-           serf->get_leaving_building_next_state() !=
-           Serf::StateDropResourceOut)) {
-        t += 0x1800;
-      } else {
-        Resource::Type res = Resource::TypeNone;
-
-        switch (serf->get_state()) {
-        case Serf::StateMining:
-          res = (Resource::Type)(serf->get_mining_res() - 1);
-          break;
-        case Serf::StateLeavingBuilding:
-          res = (Resource::Type)(serf->get_leaving_building_field_B() - 1);
-          break;
-        default:
-          NOT_REACHED();
-          break;
-        }
-
-        switch (res) {
-          case Resource::TypeStone: t += 0x2700; break;
-          case Resource::TypeIronOre: t += 0x2500; break;
-          case Resource::TypeCoal: t += 0x2600; break;
-          case Resource::TypeGoldOre: t += 0x2400; break;
-          default: NOT_REACHED(); break;
-        }
-      }
-    } else {
-      t += 0x2a80;
-    }
-    break;
-  case Serf::TypeSmelter:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-          Serf::StateDropResourceOut) {
-        if (serf->get_leaving_building_field_B() == 1 + Resource::TypeSteel) {
-          t += 0x2900;
-        } else {
-          t += 0x2800;
-        }
-      } else {
-        t += 0x1900;
-      }
-    } else {
-      /* edi10 += 4; */
-      t += 0x2980;
-    }
-    break;
-  case Serf::TypeFisher:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateFreeWalking &&
-          serf->get_free_walking_neg_dist1() == -128 &&
-          serf->get_free_walking_neg_dist2() == 1) {
-        t += 0x2f00;
-      } else {
-        t += 0x2c00;
-      }
-    } else {
-      if (t != 0x80 && t != 0x87 && t != 0x88 && t != 0x8f) {
-        play_sound(Audio::TypeSfxFishingRodReel);
-      }
+  SpriteTables::SerfLook look = SpriteTables::get_serf_look(serf,
+                                                            animation.sprite);
+  SpriteTables::SerfSounds sounds = SpriteTables::get_serf_sounds(look);
+  if (sounds.playing == SpriteTables::PlayingStart) {
+    serf->start_playing_sfx();
+  } else if (sounds.playing == SpriteTables::PlayingStop) {
+    serf->stop_playing_sfx();
+  }
+  for (int i = 0; i < sounds.count; i++) {
+    play_sound(sounds.sound[i]);
+  }
+  return SpriteTables::get_serf_body(look);
+}
 
-      /* TODO no check for state */
-      if (serf->get_free_walking_neg_dist2() == 1) {
-        t += 0x2d80;
-      } else {
-        t += 0x2c80;
-      }
-    }
-    break;
-  case Serf::TypePigFarmer:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-            Serf::StateDropResourceOut) {
-        t += 0x3400;
-      } else {
-        t += 0x3200;
-      }
-    } else {
-      t += 0x3280;
-    }
-    break;
-  case Serf::TypeButcher:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-            Serf::StateDropResourceOut) {
-        t += 0x3a00;
-      } else {
-        t += 0x3700;
-      }
-    } else {
-      /* edi10 += 4; */
-      if ((t == 0xb2 || t == 0xba || t == 0xc2 || t == 0xca) &&
-          !serf->playing_sfx()) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxBackswordBlow);
-      } else if (t != 0xb2 && t != 0xba && t != 0xc2 && t != 0xca) {
-        serf->stop_playing_sfx();
-      }
-      t += 0x3780;
-    }
-    break;
-  case Serf::TypeFarmer:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateFreeWalking &&
-          serf->get_free_walking_neg_dist1() == -128 &&
-          serf->get_free_walking_neg_dist2() == 1) {
-        t += 0x4000;
-      } else {
-        t += 0x3d00;
-      }
-    } else {
-      /* TODO access to state without state check */
-      if (serf->get_free_walking_neg_dist1() == 0) {
-        t += 0x3d80;
-      } else if (t == 0x83 || (t == 0x84 && !serf->playing_sfx())) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxMowing);
-        t += 0x3e80;
-      } else if (t != 0x83 && t != 0x84) {
-        serf->stop_playing_sfx();
-        t += 0x3e80;
-      }
-    }
-    break;
-  case Serf::TypeMiller:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-            Serf::StateDropResourceOut) {
-        t += 0x4500;
-      } else {
-        t += 0x4300;
-      }
-    } else {
-      /* edi10 += 4; */
-      t += 0x4380;
-    }
-    break;
-  case Serf::TypeBaker:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-            Serf::StateDropResourceOut) {
-        t += 0x4a00;
-      } else {
-        t += 0x4800;
-      }
-    } else {
-      /* edi10 += 4; */
-      t += 0x4880;
-    }
-    break;
-  case Serf::TypeBoatBuilder:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-            Serf::StateDropResourceOut) {
-        t += 0x5000;
-      } else {
-        t += 0x4e00;
-      }
-    } else if (t == 0x84 || t == 0x85) {
-      if (t == 0x84 || !serf->playing_sfx()) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxWoodHammering);
-      }
-      t += 0x4e80;
-    } else {
-      serf->stop_playing_sfx();
-      t += 0x4e80;
-    }
-    break;
-  case Serf::TypeToolmaker:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-            Serf::StateDropResourceOut) {
-        switch (serf->get_leaving_building_field_B() - 1) {
-          case Resource::TypeShovel: t += 0x5a00; break;
-          case Resource::TypeHammer: t += 0x5b00; break;
-          case Resource::TypeRod: t += 0x5c00; break;
-          case Resource::TypeCleaver: t += 0x5d00; break;
-          case Resource::TypeScythe: t += 0x5e00; break;
-          case Resource::TypeAxe: t += 0x6100; break;
-          case Resource::TypeSaw: t += 0x6200; break;
-          case Resource::TypePick: t += 0x6300; break;
-          case Resource::TypePincer: t += 0x6400; break;
-          default: NOT_REACHED(); break;
-        }
-      } else {
-        t += 0x5800;
-      }
-    } else {
-      /* edi10 += 4; */
-      if (t == 0x83 || (t == 0xb2 && !serf->playing_sfx())) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxSawing);
-      } else if (t == 0x87 || (t == 0xb6 && !serf->playing_sfx())) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxWoodHammering);
-      } else if (t != 0xb2 && t != 0xb6) {
-        serf->stop_playing_sfx();
-      }
-      t += 0x5880;
-    }
-    break;
-  case Serf::TypeWeaponSmith:
-    if (t < 0x80) {
-      if (serf->get_state() == Serf::StateLeavingBuilding &&
-          serf->get_leaving_building_next_state() ==
-            Serf::StateDropResourceOut) {
-        if (serf->get_leaving_building_field_B() == 1+Resource::TypeSword) {
-          t += 0x5500;
-        } else {
-          t += 0x5400;
-        }
-      } else {
-        t += 0x5200;
-      }
-    } else {
-      /* edi10 += 4; */
-      if (t == 0x83 || (t == 0x84 && !serf->playing_sfx())) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxMetalHammering);
-      } else if (t != 0x84) {
-        serf->stop_playing_sfx();
-      }
-      t += 0x5280;
-    }
-    break;
-  case Serf::TypeGeologist:
-    if (t < 0x80) {
-      t += 0x3900;
-    } else if (t == 0x83 || t == 0x84 || t == 0x86) {
-      if (t == 0x83 || !serf->playing_sfx()) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxGeologistSampling);
-      }
-      t += 0x4c80;
-    } else if (t == 0x8c || t == 0x8d) {
-      if (t == 0x8c || !serf->playing_sfx()) {
-        serf->start_playing_sfx();
-        play_sound(Audio::TypeSfxResourceFound);
-      }
-      t += 0x4c80;
-    } else {
-      serf->stop_playing_sfx();
-      t += 0x4c80;
-    }
-    break;
-  case Serf::TypeKnight0:
-  case Serf::TypeKnight1:
-  case Serf::TypeKnight2:
-  case Serf::TypeKnight3:
-  case Serf::TypeKnight4: {
-    int k = serf->get_type() - Serf::TypeKnight0;
-
-    if (t < 0x80) {
-      t += 0x7800 + 0x100*k;
-    } else if (t < 0xc0) {
-      if (serf->get_state() == Serf::StateKnightAttacking ||
-          serf->get_state() == Serf::StateKnightAttackingFree) {
-        if (serf->get_counter() >= 24 || serf->get_counter() < 8) {
-          serf->stop_playing_sfx();
-        } else if (!serf->playing_sfx()) {
-          serf->start_playing_sfx();
-          if (serf->get_attacking_field_D() == 0 ||
-              serf->get_attacking_field_D() == 4) {
-            play_sound(Audio::TypeSfxFight01);
-          } else if (serf->get_attacking_field_D() == 2) {
-            /* TODO when is TypeSfxFight02 played? */
-            play_sound(Audio::TypeSfxFight03);
-          } else {
-            play_sound(Audio::TypeSfxFight04);
-          }
-        }
-      }
+/* Frames are drawn more often than serfs move on, so work out the body
+   of a serf again only when what it depends on changed. That also plays
+   the sound effects of an animation step once rather than every frame. */
+const Viewport::SerfBody &
+Viewport::get_serf_body(Serf *serf) {
+  unsigned int index = serf->get_index();
+  if (index >= serf_bodies.size()) {
+    serf_bodies.resize(index + 1, SerfBody{ -1, -1, -1, -1, -1,
+                                            Data::Animation(), -1, bad_map_pos,
+                                            0, 0, 0, 0 });
+  }
+  SerfBody &cached = serf_bodies[index];
+  if (cached.animation != serf->get_animation() ||
+      cached.counter != serf->get_counter() ||
+      cached.type != serf->get_type() ||
+      cached.state != serf->get_state() ||
+      cached.delivery != serf->get_delivery()) {
+    Data::Animation last_frame = cached.frame;
+    bool same_walk = (cached.animation == serf->get_animation() &&
+                      cached.pos == serf->get_pos());
+    cached.animation = serf->get_animation();
+    cached.counter = serf->get_counter();
+    cached.type = serf->get_type();
+    cached.state = serf->get_state();
+    cached.delivery = serf->get_delivery();
+    cached.frame = data_source->get_animation(cached.animation,
+                                              cached.counter);
+    cached.body = serf_get_body(serf);
+
+    unsigned int tick = interface->get_game()->get_tick();
+    if (!same_walk) {
+      cached.pos = serf->get_pos();
+      cached.from_x = cached.frame.x;
+      cached.from_y = cached.frame.y;
+      cached.moved_tick = tick;
+      cached.slide_ticks = 0;
+    } else if (cached.frame.x != last_frame.x ||
+               cached.frame.y != last_frame.y) {
+      /* Only small steps are slid, a frame that has waited long or jumps
+         far is not part of a walk. */
+      unsigned int lasted = tick - cached.moved_tick;
+      bool step = std::abs(cached.frame.x - last_frame.x) <= max_slide_pixels &&
+                  std::abs(cached.frame.y - last_frame.y) <= max_slide_pixels;
+      cached.from_x = last_frame.x;
+      cached.from_y = last_frame.y;
+      cached.moved_tick = tick;
+      cached.slide_ticks = (step && lasted <= max_slide_ticks) ? lasted : 0;
+    }
+  }
+  return cached;
+}
 
-      t += 0x7cd0 + 0x200*k;
-    } else {
-      t += 0x7d90 + 0x200*k;
-    }
+void
+Viewport::get_serf_offset(const SerfBody &serf_body, int *x, int *y) {
+  *x = serf_body.frame.x;
+  *y = serf_body.frame.y;
+  if (serf_body.slide_ticks == 0) {
+    return;
   }
-    break;
-  case Serf::TypeDead:
-    if ((!serf->playing_sfx() &&
-         (t == 2 || t == 5)) ||
-        (t == 1 || t == 4)) {
-      serf->start_playing_sfx();
-      play_sound(Audio::TypeSfxSerfDying);
-    } else {
-      serf->stop_playing_sfx();
-    }
-    t += 0x8700;
-    break;
-  default:
-    NOT_REACHED();
-    break;
+  float t = (draw_tick - static_cast<float>(serf_body.moved_tick)) /
+            static_cast<float>(serf_body.slide_ticks);
+  if (t >= 1.f) {
+    return;
   }
-
-  return t;
+  t = std::max(0.f, t);
+  *x = serf_body.from_x +
+       static_cast<int>(static_cast<float>(*x - serf_body.from_x) * t);
+  *y = serf_body.from_y +
+       static_cast<int>(static_cast<float>(*y - serf_body.from_y) * t);
+  sliding = true;
 }
 
 void
@@ -1882,12 +1479,16 @@ Viewport::draw_active_serf(Serf *serf, MapPos pos, int x_base, int y_base) {
     return;
   }
 
-  Data::Animation animation = data_source->get_animation(serf->get_animation(),
-                                                         serf->get_counter());
+  /* Copied, as looking up the defending serf below can move the cache. */
+  const SerfBody &serf_body = get_serf_body(serf);
+  Data::Animation animation = serf_body.frame;
+  int body = serf_body.body;
 
-  int lx = x_base + animation.x;
-  int ly = y_base + animation.y - 4 * map->get_height(pos);
-  int body = serf_get_body(serf);
+  int off_x = 0;
+  int off_y = 0;
+  get_serf_offset(serf_body, &off_x, &off_y);
+  int lx = x_base + off_x;
+  int ly = y_base + off_y - 4 * map->get_height(pos);
 
   if (body > -1) {
     Color color = interface->get_player_color(serf->get_owner());
@@ -1906,7 +1507,7 @@ Viewport::draw_active_serf(Serf *serf, MapPos pos, int x_base, int y_base) {
       // no AI running for this player, do nothing
     }
     else {
-      std::vector<int> ai_mark_serf = *(interface->get_ai_ptr(current_player_index)->get_ai_mark_serf());
+      std::shared_ptr<const AI::Overlay> overlay = ai->get_overlay();
 
       // automatically mark waiting serfs
       bool auto_mark_this_serf = false;
@@ -1929,7 +1530,7 @@ Viewport::draw_active_serf(Serf *serf, MapPos pos, int x_base, int y_base) {
       }
       */
 
-      if (std::count(ai_mark_serf.begin(), ai_mark_serf.end(), serf->get_index()) > 0
+      if ((overlay && std::binary_search(overlay->mark_serf.begin(), overlay->mark_serf.end(), static_cast<int>(serf->get_index())))
         || auto_mark_this_serf == true) {
         //frame->draw_number(lx, ly, serf->get_index(), Color(50, 50, 200));
         std::string state_details = "";
@@ -1971,8 +1572,8 @@ Viewport::draw_active_serf(Serf *serf, MapPos pos, int x_base, int y_base) {
                 //  this red/green_blue stuff is related to darkening color effect as wait_counter increases, but is not actually needed
                 //frame->draw_string(lx, ly + 8, state_details, Color(red, green_blue, green_blue));
                 // just use a fixed color
-        frame->draw_string(lx, ly + 8, state_details, colors.at("white"));
-        //frame->draw_string(1, 1, status, ai->get_mark_color("white"));
+        frame->draw_string(lx, ly + 8, state_details, mark_colors[MarkWhite]);
+        //frame->draw_string(1, 1, status, ai->get_mark_color(MarkWhite));
       }
     }
   }
@@ -1992,13 +1593,14 @@ Viewport::draw_active_serf(Serf *serf, MapPos pos, int x_base, int y_base) {
     if (index != 0) {
       Serf *def_serf = interface->get_game()->get_serf(index);
 
-      Data::Animation animation =
-                           data_source->get_animation(def_serf->get_animation(),
-                                                      def_serf->get_counter());
+      const SerfBody &def_body = get_serf_body(def_serf);
 
-      int lx = x_base + animation.x;
-      int ly = y_base + animation.y - 4 * map->get_height(pos);
-      int body = serf_get_body(def_serf);
+      int off_x = 0;
+      int off_y = 0;
+      get_serf_offset(def_body, &off_x, &off_y);
+      int lx = x_base + off_x;
+      int ly = y_base + off_y - 4 * map->get_height(pos);
+      int body = def_body.body;
 
       if (body > -1) {
         Color color = interface->get_player_color(def_serf->get_owner());
@@ -2039,7 +1641,7 @@ Viewport::draw_active_serf(Serf *serf, MapPos pos, int x_base, int y_base) {
    Note that idle serfs do not have their serf_t object linked from the map
    so they are drawn seperately from active serfs. */
 void
-Viewport::draw_serf_row(MapPos pos, int y_base, int cols, int x_base) {
+Viewport::draw_serf_row(int y_base) {
   const int arr_1[] = {
     0x240, 0x40, 0x380, 0x140, 0x300, 0x80, 0x180, 0x200,
     0, 0x340, 0x280, 0x100, 0x1c0, 0x2c0, 0x3c0, 0xc0
@@ -2075,8 +1677,9 @@ Viewport::draw_serf_row(MapPos pos, int y_base, int cols, int x_base) {
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
   };
 
-  for (int i = 0; i < cols;
-       i++, x_base += MAP_TILE_WIDTH, pos = map->move_right(pos)) {
+  for (const RowItem &item : row_items) {
+    MapPos pos = item.pos;
+    int x_base = item.x;
 #if 0
     /* Draw serf marker */
     if (map->has_serf(pos)) {
@@ -2087,7 +1690,7 @@ Viewport::draw_serf_row(MapPos pos, int y_base, int cols, int x_base) {
 #endif
 
     /* Active serf */
-    if (map->has_serf(pos)) {
+    if (item.kinds & RowItemSerf) {
       Serf *serf = interface->get_game()->get_serf_at_pos(pos);
     //tlongstretch
     if (serf == nullptr) {
@@ -2104,7 +1707,7 @@ Viewport::draw_serf_row(MapPos pos, int y_base, int cols, int x_base) {
     }
 
     /* Idle serf */
-    if (map->get_idle_serf(pos)) {
+    if (item.kinds & RowItemIdleSerf) {
       int lx, ly, body;
       if (map->is_in_water(pos)) { /* Sailor */
         lx = x_base;
@@ -2127,11 +1730,12 @@ Viewport::draw_serf_row(MapPos pos, int y_base, int cols, int x_base) {
 /* Draw serfs that should appear behind the building at their
    current position. */
 void
-Viewport::draw_serf_row_behind(MapPos pos, int y_base, int cols, int x_base) {
-  for (int i = 0; i < cols;
-       i++, x_base += MAP_TILE_WIDTH, pos = map->move_right(pos)) {
+Viewport::draw_serf_row_behind(int y_base) {
+  for (const RowItem &item : row_items) {
     /* Active serf */
-    if (map->has_serf(pos)) {
+    if (item.kinds & RowItemSerf) {
+      MapPos pos = item.pos;
+      int x_base = item.x;
       Serf *serf = interface->get_game()->get_serf_at_pos(pos);
     //tlongstretch
     if (serf == nullptr) {
@@ -2173,15 +1777,16 @@ Viewport::draw_game_objects(int layers_) {
   /* Loop until objects drawn fall outside the frame. */
   while (1) {
     /* short row */
-    if (draw_landscape) draw_water_waves_row(pos, ly, short_row_len, lx);
+    collect_row_items(pos, short_row_len, lx, layers_);
+    if (draw_landscape) draw_water_waves_row(ly);
     if (draw_serfs) {
-      draw_serf_row_behind(pos, ly, short_row_len, lx);
+      draw_serf_row_behind(ly);
     }
     if (draw_objects) {
-      draw_map_objects_row(pos, ly, short_row_len, lx);
+      draw_map_objects_row(ly);
     }
     if (draw_serfs) {
-      draw_serf_row(pos, ly, short_row_len, lx);
+      draw_serf_row(ly);
     }
 
     ly += MAP_TILE_HEIGHT;
@@ -2190,17 +1795,18 @@ Viewport::draw_game_objects(int layers_) {
     pos = map->move_down(pos);
 
     /* long row */
+    collect_row_items(pos, long_row_len, lx - 16, layers_);
     if (draw_landscape) {
-      draw_water_waves_row(pos, ly, long_row_len, lx - 16);
+      draw_water_waves_row(ly);
     }
     if (draw_serfs) {
-      draw_serf_row_behind(pos, ly, long_row_len, lx - 16);
+      draw_serf_row_behind(ly);
     }
     if (draw_objects) {
-      draw_map_objects_row(pos, ly, long_row_len, lx - 16);
+      draw_map_objects_row(ly);
     }
     if (draw_serfs) {
-      draw_serf_row(pos, ly, long_row_len, lx - 16);
+      draw_serf_row(ly);
     }
 
     ly += MAP_TILE_HEIGHT;
@@ -2291,7 +1897,7 @@ Viewport::draw_ai_grid_overlay() {
     return;
   }
   //Log::Debug["viewport"] << "Player" << current_player_index << " is an AI, enabling AI overlay";
-  ColorDotMap ai_mark_pos = *(ai->get_ai_mark_pos());
+  std::shared_ptr<const AI::Overlay> overlay = ai->get_overlay();
   Road *ai_mark_road = ai->get_ai_mark_road();
 
   for (int x_base = x_off; x_base < width + MAP_TILE_WIDTH;
@@ -2312,10 +1918,12 @@ Viewport::draw_ai_grid_overlay() {
       int ly = y_base - 4 * map->get_height(pos);
       if (ly >= height) break;
 
-      if (ai_mark_pos.count(pos) > 0) {
-        if (pos != map->pos(0, 0)) {
-          frame->fill_rect(lx - 2, ly + 0, 5, 5, ai->get_mark_color(ai_mark_pos.at(pos)));
-          frame->fill_rect(lx - 3, ly + 1, 7, 3, ai->get_mark_color(ai_mark_pos.at(pos)));
+      if (overlay) {
+        std::vector<MapPos>::const_iterator mark = std::lower_bound(overlay->mark_pos.begin(), overlay->mark_pos.end(), pos);
+        if (mark != overlay->mark_pos.end() && *mark == pos && pos != map->pos(0, 0)) {
+          const Color &color = AI::get_overlay_color(overlay->mark_color[mark - overlay->mark_pos.begin()]);
+          frame->fill_rect(lx - 2, ly + 0, 5, 5, color);
+          frame->fill_rect(lx - 3, ly + 1, 7, 3, color);
         }
       }
 
@@ -2353,38 +1961,285 @@ Viewport::draw_ai_grid_overlay() {
           screen_pix_from_map_coord(thispos, &this_sx, &this_sy);
           //Log::Info["viewport"] << "called screen_pix_from_map_coord with TO MapPos " << thispos << ", got x,y " << this_sx << "," << this_sy;
 
-          frame->draw_line(prev_sx, prev_sy, this_sx, this_sy, game->get_mark_color("white"));
+          frame->draw_line(prev_sx, prev_sy, this_sx, this_sy, game->get_mark_color(MarkWhite));
           prevpos = thispos;
   }
   */
 
   // draw AI status text box
   std::string status = ai->get_ai_status();
-  //frame->draw_string(50, 50, "FOO\n", game->get_mark_color("white"));
-  frame->draw_string(1, 1, "Player" + std::to_string(current_player_index) + " " + status, ai->get_mark_color("white"));
+  //frame->draw_string(50, 50, "FOO\n", game->get_mark_color(MarkWhite));
+  frame->draw_string(1, 1, "Player" + std::to_string(current_player_index) + " " + status, ai->get_mark_color(MarkWhite));
 
   // draw AI expansion goals text box
   int row = 1;   // text rows are 10 pixels apart, start at row 1 (2nd row, after ai_status row)
-  frame->draw_string(1, row * 10, "expansion_goals:", ai->get_mark_color("white"));
-  for (std::string goal : ai->get_ai_expansion_goals()) {
+  frame->draw_string(1, row * 10, "expansion_goals:", ai->get_mark_color(MarkWhite));
+  ExpandGoals goals = ai->get_ai_expansion_goals();
+  for (unsigned int goal = 0; goal < ExpandGoalCount; goal++) {
+    if (!goals.test(goal)) {
+      continue;
+    }
     row++;
-    frame->draw_string(1, row * 10, "   " + goal, ai->get_mark_color("white"));
+    frame->draw_string(1, row * 10, "   " + NameExpandGoal[goal], ai->get_mark_color(MarkWhite));
   }
 
   // draw cursor map click position
   if (ai_overlay_clicked_pos != bad_map_pos) {
-    frame->draw_string(500, 1, "clicked on " + std::to_string(ai_overlay_clicked_pos), colors.at("white"));
+    frame->draw_string(500, 1, "clicked on " + std::to_string(ai_overlay_clicked_pos), mark_colors[MarkWhite]);
   }
 
   // draw current game speed
-  frame->draw_string(800, 1, "game speed: " + std::to_string(ai->get_game_speed()), colors.at("white"));
+  frame->draw_string(800, 1, "game speed: " + std::to_string(ai->get_game_speed()), mark_colors[MarkWhite]);
   // draw current loop count
-  frame->draw_string(800, 10, "AI loop: " + std::to_string(ai->get_loop_count()), colors.at("white"));
+  frame->draw_string(800, 10, "AI loop: " + std::to_string(ai->get_loop_count()), mark_colors[MarkWhite]);
+
+  // draw game update timings from the profiler
+  row = 3;
+  for (const Profiler::Stats &stats : Profiler::get_stats("game.update")) {
+    std::stringstream line;
+    line << std::fixed << std::setprecision(1) << stats.name.substr(5) << " avg "
+      << stats.avg_ns() / 1000. << "us p99 " << stats.p99_ns / 1000. << "us";
+    frame->draw_string(800, row * 10, line.str(), mark_colors[MarkWhite]);
+    row++;
+  }
 
 }
 
 
 
+// where the time of each AI player's last loops went, one column per AI.  Only
+//  reads the loops each AI published when it finished them
+void
+Viewport::draw_ai_stats_overlay() {
+  static const int max_steps_shown = 12;
+  const Color &white = mark_colors[MarkWhite];
+  int col = 0;
+  for (unsigned int index = 0; index < 5; index++) {
+    AI *ai = interface->get_ai_ptr(index);
+    if (ai == NULL) {
+      continue;
+    }
+    int x = 1 + col * 250;
+    col++;
+    int row = 4;
+    std::shared_ptr<const AIStats::Loops> loops = ai->get_loop_stats();
+    if (!loops || loops->empty()) {
+      frame->draw_string(x, row * 10, ai->name + " no loop done yet", white);
+      continue;
+    }
+    const AIStats::Loop &last = loops->front();
+    // the averages are over all the loops kept, per loop
+    double loop_ms = 0.;
+    std::map<std::string, double> avg_ms;
+    for (const AIStats::Loop &loop : *loops) {
+      loop_ms += loop.step_ns / 1e6 / loops->size();
+      for (const AIStats::Step &step : loop.steps) {
+        avg_ms[step.name] += step.ns / 1e6 / loops->size();
+      }
+    }
+    auto percent = [](uint64_t hits, uint64_t misses) {
+      uint64_t total = hits + misses;
+      return (total == 0) ? std::string("-") :
+        std::to_string(hits * 100 / total) + "%";
+    };
+    std::vector<std::string> lines;
+    std::stringstream line;
+    line << std::fixed << std::setprecision(1);
+    line << ai->name << " loop #" << last.loop << " " << last.ticks << " ticks";
+    lines.push_back(line.str());
+    line.str("");
+    line << "busy " << last.step_ns / 1e6 << "ms, avg " << loop_ms << "ms";
+    lines.push_back(line.str());
+    line.str("");
+    line << "lock wait " << last.lock_wait_ns / 1e6 << "ms";
+    lines.push_back(line.str());
+    line.str("");
+    if (AllocStats::enabled) {
+      line << "allocs " << last.allocs << ", " << last.alloc_bytes / 1024.
+           << "kB";
+      if (!last.alloc_sites.empty()) {
+        line << ", most " << last.alloc_sites.front().name.substr(0, 16);
+      }
+      lines.push_back(line.str());
+      line.str("");
+    }
+    line << "plot_road " << last.counters[AIStats::PlotRoadCalls] << " calls, "
+         << last.counters[AIStats::PlotRoadNodes] << " nodes, "
+         << last.counters[AIStats::PlotRoadCorridors] << " corridors";
+    lines.push_back(line.str());
+    line.str("");
+    line << "game events " << last.counters[AIStats::GameEventsRead] << " read, "
+         << last.counters[AIStats::GameEventsLost] << " times lost";
+    lines.push_back(line.str());
+    lines.push_back("cache hits: plot " +
+      percent(last.counters[AIStats::RoadPlotCacheHits], last.counters[AIStats::RoadPlotCacheMisses]) +
+      ", area " +
+      percent(last.counters[AIStats::AreaScoreCacheHits], last.counters[AIStats::AreaScoreCacheMisses]) +
+      ", flags " +
+      percent(last.counters[AIStats::FlagDistsHits], last.counters[AIStats::FlagDistsMisses]));
+    lines.push_back("step        last / avg ms");
+    int shown = 0;
+    for (const AIStats::Step &step : last.steps) {
+      if (shown++ >= max_steps_shown) {
+        break;
+      }
+      line.str("");
+      std::string step_name = (step.name.compare(0, 3, "do_") == 0) ? step.name.substr(3) : step.name;
+      line << " " << step_name.substr(0, 22) << " " << step.ns / 1e6 << " / " << avg_ms[step.name];
+      lines.push_back(line.str());
+    }
+    for (const std::string &text : lines) {
+      frame->draw_string(x, row * 10, text, white);
+      row++;
+    }
+  }
+}
+
+/* Frame and tick times of the last frames as a graph, one column per
+   frame, with what the renderer, the caches, the AI and the game hold */
+void
+Viewport::draw_perf_overlay() {
+  static const int graph_width = EventLoop::frame_times_kept;
+  static const int graph_height = 100;
+  static const float graph_ms = 50.f;   /* at the top of the graph */
+  const Color &white = mark_colors[MarkWhite];
+  const Color &frame_color = mark_colors[MarkDkGreen];
+  const Color &update_color = mark_colors[MarkRed];
+
+  int x = std::max(1, width - graph_width - 8);
+  int y = 40;
+  auto ms_y = [&](float ms) {
+    int h = static_cast<int>(ms * graph_height / graph_ms);
+    return y + graph_height - std::min(graph_height, std::max(0, h));
+  };
+  frame->fill_rect(x, y, graph_width, graph_height, mark_colors[MarkBlack]);
+  frame->draw_line(x, ms_y(TICK_LENGTH), x + graph_width - 1,
+                   ms_y(TICK_LENGTH), mark_colors[MarkDkGray]);
+
+  const EventLoop &event_loop = EventLoop::get_instance();
+  unsigned int frames = std::min(event_loop.get_frame_count(),
+                                 EventLoop::frame_times_kept);
+  float frame_sum = 0.f;
+  float frame_max = 0.f;
+  float draw_sum = 0.f;
+  float update_sum = 0.f;
+  unsigned int updates = 0;
+  for (unsigned int back = 0; back < frames; back++) {
+    const EventLoop::FrameTime &time = event_loop.get_frame_time(back);
+    int cx = x + graph_width - 1 - static_cast<int>(back);
+    frame->draw_line(cx, ms_y(time.frame_ms), cx, y + graph_height - 1,
+                     frame_color);
+    if (time.updates > 0) {
+      frame->draw_line(cx, ms_y(time.update_ms), cx, y + graph_height - 1,
+                       update_color);
+    }
+    frame_sum += time.frame_ms;
+    frame_max = std::max(frame_max, time.frame_ms);
+    draw_sum += time.draw_ms;
+    update_sum += time.update_ms;
+    updates += time.updates;
+  }
+
+  std::vector<std::string> lines;
+  std::stringstream line;
+  line << std::fixed << std::setprecision(1);
+  if (frames > 0) {
+    line << "frame " << frame_sum / frames << "ms avg, " << frame_max
+         << "ms max, " << 1000.f * frames / std::max(1.f, frame_sum) << " fps";
+    lines.push_back(line.str());
+    line.str("");
+    line << "draw " << draw_sum / frames << "ms, "
+         << Graphics::get_instance().get_draw_calls() << " draw calls";
+    lines.push_back(line.str());
+    line.str("");
+  }
+  if (updates > 0) {
+    line << "update " << update_sum / updates << "ms per tick";
+    for (const Profiler::Stats &stats : Profiler::get_stats("game.update")) {
+      if (stats.name == "game.update") {
+        line << ", p99 " << stats.p99_ns / 1e6 << "ms";
+      }
+    }
+    lines.push_back(line.str());
+    line.str("");
+  }
+
+  /* Share of the wall time of its last loop an AI spent in its steps */
+  Game *game = interface->get_game().get();
+  for (unsigned int index = 0; index < 5; index++) {
+    AI *ai = interface->get_ai_ptr(index);
+    if (ai == NULL) {
+      continue;
+    }
+    std::shared_ptr<const AIStats::Loops> loops = ai->get_loop_stats();
+    if (!loops || loops->empty() || game->get_game_speed() == 0) {
+      continue;
+    }
+    const AIStats::Loop &last = loops->front();
+    double loop_ms = static_cast<double>(last.ticks) * TICK_LENGTH /
+                     game->get_game_speed();
+    line << ai->name << " busy "
+         << ((loop_ms > 0.) ? 100. * last.step_ns / 1e6 / loop_ms : 0.)
+         << "%, lock wait " << last.lock_wait_ns / 1e6 << "ms";
+    lines.push_back(line.str());
+    line.str("");
+  }
+
+  Image::CacheStats images = Image::get_cache_stats();
+  uint64_t lookups = images.hits + images.misses;
+  line << "images " << images.images << ", " << images.bytes / 1048576.
+       << " of " << images.budget / 1048576. << "MB, hits "
+       << ((lookups > 0) ? 100. * images.hits / lookups : 0.) << "%";
+  lines.push_back(line.str());
+  line.str("");
+  line << "tiles " << landscape_tiles.size() << ", "
+       << tiles_bytes / 1048576. << " of " << tile_cache_budget / 1048576.
+       << "MB";
+  lines.push_back(line.str());
+  line.str("");
+  line << "serfs " << game->get_serf_count() << ", flags "
+       << game->get_flag_count() << ", buildings "
+       << game->get_building_count();
+  lines.push_back(line.str());
+  line.str("");
+
+  /* Memory by owner, counted again about once a second */
+  static const unsigned int perf_memory_frames = 30;
+  if (perf_memory.get_entries().empty() ||
+      event_loop.get_frame_count() - perf_memory_frame >= perf_memory_frames) {
+    perf_memory = MemoryUsage();
+    game->add_memory_usage(&perf_memory);
+    Image::add_memory_usage(&perf_memory);
+    add_memory_usage(&perf_memory);
+    Data::get_instance().get_data_source()->add_memory_usage(&perf_memory);
+    for (unsigned int index = 0; index < 5; index++) {
+      AI *ai = interface->get_ai_ptr(index);
+      std::shared_ptr<const MemoryUsage> usage =
+        (ai != NULL) ? ai->get_memory_usage() : nullptr;
+      if (usage) {
+        perf_memory.add(*usage);
+      }
+    }
+    perf_memory_frame = event_loop.get_frame_count();
+  }
+  line << "memory " << MemoryUsage::get_resident_bytes() / 1048576.
+       << "MB, peak " << MemoryUsage::get_peak_resident_bytes() / 1048576.
+       << "MB";
+  lines.push_back(line.str());
+  line.str("");
+  line << "game " << perf_memory.get_bytes("game.") / 1048576. << "MB, map "
+       << perf_memory.get_bytes("map.") / 1048576. << "MB, ai "
+       << perf_memory.get_bytes("ai.") / 1048576. << "MB, data "
+       << perf_memory.get_bytes("data.") / 1048576. << "MB";
+  lines.push_back(line.str());
+
+  int ly = y + graph_height + 2;
+  for (const std::string &text : lines) {
+    frame->draw_string(x, ly, text, white);
+    ly += 10;
+  }
+}
+
 void
 Viewport::draw_map_cursor() {
   if (layers & LayerBuilds) {
@@ -2476,7 +2331,19 @@ Viewport::internal_draw() {
   if (map == NULL) {
     return;
   }
+  PROFILE_SCOPE("frame.draw.viewport");
+
+  Game *game = interface->get_game().get();
+  sliding = false;
+  draw_tick = static_cast<float>(game->get_tick()) +
+              EventLoop::get_instance().get_tick_progress() *
+              static_cast<float>(game->get_game_speed());
+  if (game->get_game_speed() == 0) {
+    /* Paused, draw every serf at the end of its slide */
+    draw_tick += static_cast<float>(max_slide_ticks);
+  }
 
+  tiles_round++;
   if (layers & LayerLandscape) {
     draw_landscape();
   }
@@ -2491,6 +2358,12 @@ Viewport::internal_draw() {
     draw_ai_grid_overlay();
   }
   draw_game_objects(layers);
+  if (layers & LayerAIStats) {
+    draw_ai_stats_overlay();
+  }
+  if (layers & LayerPerf) {
+    draw_perf_overlay();
+  }
   if (layers & LayerCursor) {
     draw_map_cursor();
   }
@@ -2708,7 +2581,14 @@ Viewport::handle_drag(int lx, int ly) {
 }
 
 Viewport::Viewport(Interface *_interface, PMap _map)
-  : interface(_interface)
+  : tiles_bytes(0)
+  , tiles_round(0)
+  , scroll_x(0)
+  , scroll_y(0)
+  , perf_memory_frame(0)
+  , draw_tick(0.f)
+  , sliding(false)
+  , interface(_interface)
   , map(_map) {
   map->add_change_handler(this);
   layers = LayerAll;
@@ -2737,6 +2617,60 @@ Viewport::on_object_changed(MapPos pos) {
   }
 }
 
+void
+Viewport::on_borders_changed(MapPos pos) {
+  std::vector<unsigned int> tids;
+  get_overlay_tile_ids(pos, &tids);
+  for (unsigned int tid : tids) {
+    TilesMap::iterator it = landscape_tiles.find(tid);
+    if (it != landscape_tiles.end()) {
+      it->second.overlay_dirty = true;
+    }
+  }
+}
+
+/* A tick's worth of changes usually falls into a handful of landscape
+   tiles, so mark each of those once rather than once per position. */
+void
+Viewport::on_changes(const Map::Changes &changes) {
+  std::vector<unsigned int> tids;
+  tids.reserve(changes.heights.size());
+  for (MapPos pos : changes.heights) {
+    tids.push_back(landscape_tile_id(pos));
+  }
+  std::sort(tids.begin(), tids.end());
+  tids.erase(std::unique(tids.begin(), tids.end()), tids.end());
+  for (unsigned int tid : tids) {
+    TilesMap::iterator it = landscape_tiles.find(tid);
+    if (it != landscape_tiles.end()) {
+      it->second.dirty = true;
+    }
+  }
+
+  /* Roads and borders move with the heights under them. */
+  tids.clear();
+  for (MapPos pos : changes.heights) {
+    get_overlay_tile_ids(pos, &tids);
+  }
+  for (MapPos pos : changes.borders) {
+    get_overlay_tile_ids(pos, &tids);
+  }
+  std::sort(tids.begin(), tids.end());
+  tids.erase(std::unique(tids.begin(), tids.end()), tids.end());
+  for (unsigned int tid : tids) {
+    TilesMap::iterator it = landscape_tiles.find(tid);
+    if (it != landscape_tiles.end()) {
+      it->second.overlay_dirty = true;
+    }
+  }
+
+  MapPos cursor_pos = interface->get_map_cursor_pos();
+  if (std::find(changes.objects.begin(), changes.objects.end(), cursor_pos) !=
+      changes.objects.end()) {
+    interface->update_map_cursor_pos(cursor_pos);
+  }
+}
+
 /* Space transformations. */
 /* The game world space is a three dimensional space with the axes
    named "column", "row" and "height". The (column, row) coordinate
@@ -2893,6 +2827,8 @@ Viewport::move_to_map_pos(MapPos pos) {
 
   offset_x = mx;
   offset_y = my;
+  scroll_x = 0;
+  scroll_y = 0;
 
   set_redraw();
 }
@@ -2905,6 +2841,11 @@ Viewport::move_by_pixels(int lx, int ly) {
   offset_x += lx;
   offset_y += ly;
 
+  if (lx != 0 || ly != 0) {
+    scroll_x = (lx > 0) - (lx < 0);
+    scroll_y = (ly > 0) - (ly < 0);
+  }
+
   if (offset_y < 0) {
     offset_y += lheight;
     offset_x -= (map->get_rows()*MAP_TILE_WIDTH)/2;
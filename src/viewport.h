@@ -22,12 +22,15 @@
 #ifndef SRC_VIEWPORT_H_
 #define SRC_VIEWPORT_H_
 
+#include <list>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "src/gui.h"
 #include "src/map.h"
 #include "src/building.h"
+#include "src/memory-usage.h"
 
 class Interface;
 class DataSource;
@@ -43,6 +46,8 @@ class Viewport : public GuiObject, public Map::Handler {
     LayerGrid = 1<<5,
     LayerBuilds = 1<<6,
   LayerAI = 1<<7,
+  LayerAIStats = 1<<8,
+    LayerPerf = 1<<9,
     LayerAll = (LayerLandscape |
                 LayerPaths |
                 LayerObjects |
@@ -51,9 +56,76 @@ class Viewport : public GuiObject, public Map::Handler {
   } Layer;
 
  protected:
-  /* Cache prerendered tiles of the landscape. */
-  typedef std::map<unsigned int, std::unique_ptr<Frame>> TilesMap;
+  /* Cache prerendered tiles of the landscape, and of the roads and
+     borders drawn over it. The least recently drawn tiles are dropped once
+     the cache holds more than tile_cache_budget bytes, and tiles the map
+     changed under are redrawn the next time they are needed. */
+  static const size_t tile_cache_budget = 64*1024*1024;
+  /* Draw the ground of the tiles as textured triangles rather than
+     masked sprites, where the video can. */
+  static bool landscape_triangles;
+  /* Tiles past the edge the view scrolls towards rendered per frame. */
+  static const unsigned int tile_prefetch_per_frame = 1;
+
+  typedef std::list<unsigned int> TilesLRU;  /* Most recently drawn first. */
+  typedef struct LandscapeTile {
+    std::unique_ptr<Frame> frame;
+    bool dirty;
+    std::unique_ptr<Frame> overlay;   /* Paths and borders, clear elsewhere */
+    bool overlay_dirty;
+    unsigned int drawn;   /* Value of tiles_round when last drawn. */
+    TilesLRU::iterator lru;
+  } LandscapeTile;
+  typedef std::map<unsigned int, LandscapeTile> TilesMap;
   TilesMap landscape_tiles;
+  TilesLRU tiles_lru;
+  size_t tiles_bytes;
+  unsigned int tiles_round;
+  int scroll_x, scroll_y;   /* Sign of the last move_by_pixels. */
+  /* What the perf overlay counted on frame perf_memory_frame; walking
+     every node container is too slow to do each frame. */
+  MemoryUsage perf_memory;
+  unsigned int perf_memory_frame;
+
+  /* What a row of visible tiles has to draw, found in one pass over
+     the row so that the drawing passes skip the empty tiles. */
+  typedef enum RowItemKind {
+    RowItemWaves = 1<<0,
+    RowItemObject = 1<<1,
+    RowItemSerf = 1<<2,
+    RowItemIdleSerf = 1<<3,
+  } RowItemKind;
+  typedef struct RowItem {
+    MapPos pos;
+    int x;
+    unsigned int kinds;
+  } RowItem;
+  std::vector<RowItem> row_items;
+
+  /* Animation frame and body sprite of each active serf by serf index,
+     good while its animation, counter, type, state and delivery are the
+     ones they were worked out for.  When the frame moves the serf while it
+     stays on the same tile in the same animation, it is drawn sliding from
+     the last frame to this one, as long as the last frame lasted, so walking
+     looks smooth between the frames of the animation. */
+  typedef struct SerfBody {
+    int animation;
+    int counter;
+    int type;
+    int state;
+    int delivery;
+    Data::Animation frame;
+    int body;
+    MapPos pos;
+    int from_x, from_y;
+    unsigned int moved_tick;   /* game tick the frame moved */
+    unsigned int slide_ticks;  /* 0 when not sliding */
+  } SerfBody;
+  std::vector<SerfBody> serf_bodies;
+  static const unsigned int max_slide_ticks = 64;
+  static const int max_slide_pixels = 8;
+  float draw_tick;   /* game tick, and how far into the next, being drawn */
+  bool sliding;      /* a serf was drawn between two frames */
 
   int offset_x, offset_y;
   unsigned int layers;
@@ -70,6 +142,10 @@ class Viewport : public GuiObject, public Map::Handler {
   virtual ~Viewport();
 
   void switch_layer(Layer layer) { layers ^= layer; }
+  static void set_landscape_triangles(bool enable) {
+    landscape_triangles = enable; }
+  /* Whether the next frame should be drawn even without a game update */
+  bool is_sliding() const { return sliding; }
 
   bool weather_enabled() { return weather; }
   void enable_weather() { weather = true; }
@@ -84,10 +160,14 @@ class Viewport : public GuiObject, public Map::Handler {
   void screen_pix_from_map_coord(MapPos pos, int *sx, int *sy);
   MapPos map_pos_from_screen_pix(int x, int y);
 
+  unsigned int landscape_tile_id(MapPos pos);
   void redraw_map_pos(MapPos pos);
 
   void update();
 
+  /* The landscape tiles kept for redrawing */
+  void add_memory_usage(MemoryUsage *usage) const;
+
  protected:
   void draw_triangle_up(int x, int y, int m, int left, int right, MapPos pos,
                         Frame *frame);
@@ -98,8 +178,11 @@ class Viewport : public GuiObject, public Map::Handler {
   void draw_down_tile_col(MapPos pos, int x_base, int y_base, int max_y,
                           Frame *frame);
   void draw_landscape();
-  void draw_path_segment(int x, int y, MapPos pos, Direction dir);
-  void draw_border_segment(int x, int y, MapPos pos, Direction dir);
+  void draw_cached_tiles(bool overlay);
+  void draw_path_segment(int x, int y, MapPos pos, Direction dir,
+                         Frame *dest);
+  void draw_border_segment(int x, int y, MapPos pos, Direction dir,
+                           Frame *dest);
   void draw_paths_and_borders();
   void draw_game_sprite(int x, int y, int index);
   void draw_serf(int x, int y, const Color &color, int head, int body);
@@ -110,18 +193,23 @@ class Viewport : public GuiObject, public Map::Handler {
   void draw_building_unfinished(Building *building, Building::Type bld_type,
                                 int x, int y);
   void draw_ocupation_flag(Building *building, int x, int y, float mul);
+  void draw_mine_elevator(Building *building, int x, int y);
+  void draw_pigs(Building *building, int x, int y);
   void draw_unharmed_building(Building *building, int x, int y);
   void draw_burning_building(Building *building, int x, int y);
   void draw_building(MapPos pos, int x, int y);
   void draw_water_waves(MapPos pos, int x, int y);
-  void draw_water_waves_row(MapPos pos, int y_base, int cols, int x_base);
+  void collect_row_items(MapPos pos, int cols, int x_base, int layers);
+  void draw_water_waves_row(int y_base);
   void draw_flag_and_res(MapPos pos, int x, int y);
-  void draw_map_objects_row(MapPos pos, int y_base, int cols, int x_base);
+  void draw_map_objects_row(int y_base);
   void draw_row_serf(int x, int y, bool shadow, const Color &color, int body);
   int serf_get_body(Serf *serf);
+  const SerfBody &get_serf_body(Serf *serf);
+  void get_serf_offset(const SerfBody &serf_body, int *x, int *y);
   void draw_active_serf(Serf *serf, MapPos pos, int x_base, int y_base);
-  void draw_serf_row(MapPos pos, int y_base, int cols, int x_base);
-  void draw_serf_row_behind(MapPos pos, int y_base, int cols, int x_base);
+  void draw_serf_row(int y_base);
+  void draw_serf_row_behind(int y_base);
   void draw_game_objects(int layers);
   void draw_map_cursor_sprite(MapPos pos, int sprite);
   void draw_map_cursor_possible_build();
@@ -129,6 +217,8 @@ class Viewport : public GuiObject, public Map::Handler {
   void draw_base_grid_overlay(const Color &color);
   void draw_height_grid_overlay(const Color &color);
   void draw_ai_grid_overlay();
+  void draw_ai_stats_overlay();
+  void draw_perf_overlay();
   MapPos get_offset(int *x_off, int *y_off,
                     int *col = nullptr, int *row = nullptr);
 
@@ -138,11 +228,22 @@ class Viewport : public GuiObject, public Map::Handler {
   virtual bool handle_dbl_click(int x, int y, Event::Button button);
   virtual bool handle_drag(int x, int y);
 
+  void tile_at_map_pix(int mx, int my, int *tc, int *tr);
+  void render_tile(Frame *tile_frame, int tc, int tr);
+  void render_overlay_tile(Frame *tile_frame, int tc, int tr);
+  LandscapeTile &get_tile(unsigned int tid);
   Frame *get_tile_frame(unsigned int tid, int tc, int tr);
+  Frame *get_overlay_frame(unsigned int tid, int tc, int tr);
+  /* Add the tiles the roads and borders at pos can be drawn into. */
+  void get_overlay_tile_ids(MapPos pos, std::vector<unsigned int> *tids);
+  void trim_tile_cache();
+  void prefetch_tiles();
 
  public:
   virtual void on_height_changed(MapPos pos);
   virtual void on_object_changed(MapPos pos);
+  virtual void on_borders_changed(MapPos pos);
+  virtual void on_changes(const Map::Changes &changes);
 };
 
 #endif  // SRC_VIEWPORT_H_
@@ -0,0 +1,272 @@
+/*
+ * bench_map.cc - Map search, generation and update benchmarks
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/ai.h"
+#include "src/flag.h"
+#include "src/game.h"
+#include "src/log.h"
+#include "src/map-generator.h"
+#include "src/pathfinder.h"
+#include "src/random.h"
+#include "tests/benchmark.h"
+
+static const char fixture_seed[] = "8667715887436237";
+
+// A game with one player whose castle is in the middle of the map, and a
+// chain of a dozen flags around it, starting at the castle flag.
+typedef struct Fixture {
+  PGame game;
+  Player *player;
+  MapPos castle_pos;
+  MapPos castle_flag;
+  // Spots for a flag in the land of the player, to plot roads from to the
+  // castle flag
+  std::vector<MapPos> ends;
+  // Spots in the land of the player, as roads can't leave it, to plot roads
+  // between with pathfinder_map
+  std::vector<std::pair<MapPos, MapPos>> pairs;
+} Fixture;
+
+static bool
+make_fixture(unsigned int map_size, Fixture *fixture) {
+  PGame game = std::make_shared<Game>();
+  game->init(map_size, Random(fixture_seed));
+  PMap map = game->get_map();
+  Player *player = game->get_player(game->add_player(40, 40, 40));
+  MapPos center = map->pos(map->get_cols() / 2, map->get_rows() / 2);
+  fixture->castle_pos = bad_map_pos;
+  for (unsigned int off = 0; off <= 3268; off++) {
+    MapPos pos = map->pos_add_extended_spirally(center, off);
+    if (game->can_build_castle(pos, player) &&
+        game->build_castle(pos, player)) {
+      fixture->castle_pos = pos;
+      break;
+    }
+  }
+  // Small maps may have no room near the middle
+  if (fixture->castle_pos == bad_map_pos) {
+    for (MapPos pos : map->geom()) {
+      if (game->can_build_castle(pos, player) &&
+          game->build_castle(pos, player)) {
+        fixture->castle_pos = pos;
+        break;
+      }
+    }
+  }
+  if (fixture->castle_pos == bad_map_pos) {
+    return false;
+  }
+  fixture->castle_flag = map->move_down_right(fixture->castle_pos);
+
+  unsigned int flags = 0;
+  MapPos last_flag = fixture->castle_flag;
+  for (unsigned int off = 20; off <= 300 && flags < 12; off += 7) {
+    MapPos pos = map->pos_add_extended_spirally(fixture->castle_pos, off);
+    if (!game->can_build_flag(pos, player)) continue;
+    Road road = pathfinder_map(map.get(), pos, last_flag);
+    if (road.is_valid() && game->build_flag(pos, player)) {
+      if (game->build_road(road, player)) {
+        last_flag = pos;
+        flags++;
+      } else {
+        game->demolish_flag(pos, player);
+      }
+    }
+  }
+
+  fixture->ends.clear();
+  for (unsigned int off = 60; off <= 500 && fixture->ends.size() < 16;
+       off += 11) {
+    MapPos pos = map->pos_add_extended_spirally(fixture->castle_pos, off);
+    if (game->can_build_flag(pos, player)) {
+      fixture->ends.push_back(pos);
+    }
+  }
+
+  // Searches that fail right away at the start would say little
+  Random random(fixture_seed);
+  fixture->pairs.clear();
+  for (int i = 0; i < 1000 && fixture->pairs.size() < 16; i++) {
+    MapPos start = map->pos_add_extended_spirally(fixture->castle_pos,
+                                                  random.random() % 500);
+    MapPos end = map->pos_add_extended_spirally(fixture->castle_pos,
+                                                random.random() % 500);
+    if (!map->has_owner(start) ||
+        map->get_owner(start) != player->get_index() ||
+        map->get_obj(start) != Map::ObjectNone) {
+      continue;
+    }
+    if (pathfinder_map(map.get(), start, end).get_length() > 5) {
+      fixture->pairs.push_back(std::make_pair(start, end));
+    }
+  }
+
+  fixture->game = game;
+  fixture->player = player;
+  return !fixture->ends.empty() && !fixture->pairs.empty();
+}
+
+// Moving by adding the column and row of an offset and masking each, the
+// way it was done before MapGeometry::move
+static MapPos
+generic_pos_add(const MapGeometry &geom, MapPos pos, MapPos off) {
+  return geom.pos((geom.pos_col(pos) + geom.pos_col(off)) & geom.col_mask(),
+                  (geom.pos_row(pos) + geom.pos_row(off)) & geom.row_mask());
+}
+
+static bool
+count_flag(Flag*, void *data) {
+  (*reinterpret_cast<unsigned int*>(data))++;
+  return false;
+}
+
+static void
+bench_map_size(Benchmark *bench, unsigned int map_size) {
+  std::string size = ".size" + std::to_string(map_size);
+
+  bench->run("generate" + size, [map_size]() {
+    Map map{MapGeometry(map_size)};
+    ClassicMissionMapGenerator generator(map, Random(fixture_seed));
+    generator.init();
+    generator.generate();
+  });
+
+  // One run moves from every tile of the map in each direction, each move
+  // depending on the last so none are left out
+  MapGeometry geom(map_size);
+  MapPos offsets[6];
+  for (Direction d : cycle_directions_cw()) {
+    offsets[d] = geom.move(0, d);
+  }
+  MapPos generic_pos = 0;
+  Benchmark::Result *result = bench->run("move_generic" + size, [&]() {
+    for (MapPos pos : geom) {
+      for (Direction d : cycle_directions_cw()) {
+        generic_pos ^= generic_pos_add(geom, pos ^ generic_pos, offsets[d]);
+      }
+    }
+  });
+  if (result != nullptr) {
+    result->values.push_back({ "ns_per_tile",
+                               result->ns_per_op / geom.tile_count() });
+  }
+  MapPos packed_pos = 0;
+  result = bench->run("move" + size, [&]() {
+    for (MapPos pos : geom) {
+      for (Direction d : cycle_directions_cw()) {
+        packed_pos ^= geom.move(pos ^ packed_pos, d);
+      }
+    }
+  });
+  if (result != nullptr) {
+    result->values.push_back({ "ns_per_tile",
+                               result->ns_per_op / geom.tile_count() });
+  }
+
+  Fixture fixture;
+  if (!make_fixture(map_size, &fixture)) {
+    bench->fail("no fixture for map size " + std::to_string(map_size));
+    return;
+  }
+  Game *game = fixture.game.get();
+  Map *map = game->get_map().get();
+
+  size_t pair = 0;
+  bench->run("pathfinder_map" + size, [&]() {
+    const std::pair<MapPos, MapPos> &ends =
+      fixture.pairs[pair++ % fixture.pairs.size()];
+    pathfinder_map(map, ends.first, ends.second);
+  });
+
+  AI ai(fixture.game, fixture.player->get_index(), AIPlusOptions());
+  size_t end = 0;
+  Roads potential_roads;
+  bench->run("plot_road" + size, [&]() {
+    potential_roads.clear();
+    ai.plot_road_uncached(fixture.ends[end++ % fixture.ends.size()],
+                          fixture.castle_flag, &potential_roads);
+  });
+
+  Flag *castle_flag = game->get_flag_at_pos(fixture.castle_flag);
+  unsigned int visited = 0;
+  bench->run("flag_search" + size, [&]() {
+    FlagSearch::single(castle_flag, count_flag, true, false, &visited);
+  });
+
+  bench->run("update_land_ownership" + size, [&]() {
+    game->update_land_ownership(fixture.castle_pos);
+  });
+
+  // One run checks every tile of the map
+  unsigned int buildable = 0;
+  result = bench->run("can_build" + size, [&]() {
+    for (MapPos pos : map->geom()) {
+      buildable += game->can_build_small(pos) + game->can_build_large(pos) +
+                   game->can_build_mine(pos) + game->can_build_military(pos) +
+                   game->can_build_flag(pos, fixture.player) +
+                   game->can_build_building(pos, Building::TypeHut,
+                                            fixture.player);
+    }
+  });
+  if (result != nullptr) {
+    result->values.push_back({ "ns_per_tile",
+                               result->ns_per_op / map->geom().tile_count() });
+  }
+
+  // Last, as it grows trees and moves fish
+  unsigned int tick = 0;
+  Random random(fixture_seed);
+  bench->run("map_update" + size, [&]() {
+    tick += 2;
+    map->update(tick, &random);
+  });
+}
+
+int
+main(int argc, char *argv[]) {
+  unsigned int only_size = 0;
+
+  Benchmark bench("map");
+  bench.get_command_line()->add_option('m', "Only bench maps of SIZE")
+                .add_parameter("SIZE", [&only_size](std::istream& s) {
+                  s >> only_size;
+                  return (only_size >= 3 && only_size <= 10);
+                });
+  if (!bench.process(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+  Log::set_level(Log::LevelError);
+
+  for (unsigned int map_size = 3; map_size <= 10; map_size++) {
+    if (only_size == 0 || map_size == only_size) {
+      bench_map_size(&bench, map_size);
+    }
+  }
+  return bench.finish();
+}
@@ -0,0 +1,221 @@
+/*
+ * bench_render.cc - Viewport and minimap drawing benchmarks
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/data.h"
+#include "src/game.h"
+#include "src/gfx.h"
+#include "src/interface.h"
+#include "src/log.h"
+#include "src/minimap.h"
+#include "src/savegame.h"
+#include "src/viewport.h"
+#include "tests/benchmark.h"
+
+// Built with the dummy video, so the frames are drawn into memory and the
+// numbers are those of the drawing code, not of a GPU or a display.
+
+typedef std::vector<std::pair<int, int>> CameraPath;
+
+// The view slides across the map in eight directions in turn, a screen
+// width or so in each, as a player looking around would.
+static CameraPath
+default_camera_path() {
+  const int steps[8][2] = { { 16, 0 }, { 12, 12 }, { 0, 16 }, { -12, 12 },
+                            { -16, 0 }, { -12, -12 }, { 0, -16 },
+                            { 12, -12 } };
+  CameraPath path;
+  for (const int *step : steps) {
+    for (int i = 0; i < 48; i++) {
+      path.push_back(std::make_pair(step[0], step[1]));
+    }
+  }
+  return path;
+}
+
+// A recorded path has the pixels the view moved by between two frames, x
+// and y, one frame a line.
+static bool
+load_camera_path(const std::string &path_file, CameraPath *path) {
+  std::ifstream file(path_file);
+  if (!file.is_open()) {
+    return false;
+  }
+  int dx = 0;
+  int dy = 0;
+  while (file >> dx >> dy) {
+    path->push_back(std::make_pair(dx, dy));
+  }
+  return !path->empty();
+}
+
+static void
+add_draw_calls(Benchmark::Result *result, uint64_t draw_calls,
+               uint64_t frames) {
+  if (result != nullptr && frames > 0) {
+    result->values.push_back({ "ms_per_frame", result->ns_per_op / 1e6 });
+    result->values.push_back({ "draw_calls_per_frame",
+                               static_cast<double>(draw_calls) / frames });
+  }
+}
+
+int
+main(int argc, char *argv[]) {
+  std::string data_dir;
+  std::string save_file;
+  std::string path_file;
+  unsigned int map_size = 8;
+  unsigned int ticks = 20000;
+
+  Benchmark bench("render");
+  CommandLine *command_line = bench.get_command_line();
+  command_line->add_option('d', "Set the data directory")
+                .add_parameter("DATA-PATH", [&data_dir](std::istream& s) {
+                  s >> data_dir;
+                  return true;
+                });
+  command_line->add_option('l', "Use the saved game FILE as the fixture")
+                .add_parameter("FILE", [&save_file](std::istream& s) {
+                  std::getline(s, save_file);
+                  return true;
+                });
+  command_line->add_option('m', "Map size of the fixture (default 8)")
+                .add_parameter("SIZE", [&map_size](std::istream& s) {
+                  s >> map_size;
+                  return (map_size >= 1 && map_size <= 10);
+                });
+  command_line->add_option('n', "Ticks to play the fixture (default 20000)")
+                .add_parameter("TICKS", [&ticks](std::istream& s) {
+                  s >> ticks;
+                  return true;
+                });
+  command_line->add_option('p', "Move the view along the path in FILE")
+                .add_parameter("FILE", [&path_file](std::istream& s) {
+                  std::getline(s, path_file);
+                  return true;
+                });
+  if (!bench.process(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+  Log::set_level(Log::LevelError);
+
+  CameraPath path;
+  if (path_file.empty()) {
+    path = default_camera_path();
+  } else if (!load_camera_path(path_file, &path)) {
+    std::cerr << "failed to load the camera path '" << path_file << "'\n";
+    return EXIT_FAILURE;
+  }
+
+  // Sprites come from the game data as they do for the game
+  if (!Data::get_instance().load(data_dir)) {
+    std::cerr << "no game data found, see -d\n";
+    return EXIT_FAILURE;
+  }
+
+  PGame game;
+  if (!save_file.empty()) {
+    game = std::make_shared<Game>();
+    if (!GameStore::get_instance().load(save_file, game.get())) {
+      std::cerr << "failed to load '" << save_file << "'\n";
+      return EXIT_FAILURE;
+    }
+  } else {
+    game = make_late_game(map_size, ticks);
+    if (!game) {
+      std::cerr << "failed to make the fixture\n";
+      return EXIT_FAILURE;
+    }
+  }
+  std::cout << "fixture: map size " << game->get_map()->get_size() << ", "
+            << game->get_serf_count() << " serfs, "
+            << game->get_building_count() << " buildings, "
+            << path.size() << " frames of camera path\n";
+
+  Graphics &gfx = Graphics::get_instance();
+  unsigned int width = 0;
+  unsigned int height = 0;
+  gfx.get_resolution(&width, &height);
+  std::unique_ptr<Frame> screen(gfx.get_screen_frame());
+
+  Interface interface;
+  interface.set_size(width, height);
+  interface.set_game(game);
+  Viewport *viewport = interface.get_viewport();
+
+  // Each run draws the next frame of the path, tiles coming into view
+  // and all
+  size_t frame = 0;
+  uint64_t draw_calls = 0;
+  uint64_t frames = 0;
+  Benchmark::Result *result = bench.run("viewport.pan", [&]() {
+    const std::pair<int, int> &step = path[frame++ % path.size()];
+    viewport->move_by_pixels(step.first, step.second);
+    viewport->draw(screen.get());
+    gfx.swap_buffers();
+    draw_calls += gfx.get_draw_calls();
+    frames++;
+  });
+  add_draw_calls(result, draw_calls, frames);
+
+  // The view stays, but serfs moved, so all of it is drawn again from the
+  // tiles cached of it
+  draw_calls = 0;
+  frames = 0;
+  result = bench.run("viewport.redraw", [&]() {
+    viewport->set_redraw();
+    viewport->draw(screen.get());
+    gfx.swap_buffers();
+    draw_calls += gfx.get_draw_calls();
+    frames++;
+  });
+  add_draw_calls(result, draw_calls, frames);
+
+  MinimapGame minimap(&interface, game);
+  minimap.set_displayed(true);
+  minimap.set_size(128, 128);
+  minimap.set_ownership_mode(MinimapGame::OwnershipModeMixed);
+  minimap.set_draw_roads(true);
+  minimap.move_to_map_pos(viewport->get_current_map_pos());
+
+  frame = 0;
+  draw_calls = 0;
+  frames = 0;
+  result = bench.run("minimap.pan", [&]() {
+    const std::pair<int, int> &step = path[frame++ % path.size()];
+    minimap.move_by_pixels(step.first / 4, step.second / 4);
+    minimap.draw(screen.get());
+    gfx.swap_buffers();
+    draw_calls += gfx.get_draw_calls();
+    frames++;
+  });
+  add_draw_calls(result, draw_calls, frames);
+
+  return bench.finish();
+}
@@ -0,0 +1,127 @@
+/*
+ * bench_save_game.cc - Save game write and read throughput
+ *
+ * Copyright (C) 2016-2017  Jon Lund Steffensen <jonlst@gmail.com>
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "src/game.h"
+#include "src/log.h"
+#include "src/savegame.h"
+#include "tests/benchmark.h"
+
+static std::string
+write_game(Game *game, GameStore::Format format) {
+  std::stringstream stream;
+  GameStore::get_instance().write(&stream, game, format);
+  return stream.str();
+}
+
+static void
+add_throughput(Benchmark::Result *result, size_t size) {
+  if (result != nullptr) {
+    result->values.push_back({ "bytes", static_cast<double>(size) });
+    result->values.push_back({ "mb_per_s",
+                               size / result->ns_per_op * 1e9 / 1e6 });
+  }
+}
+
+int
+main(int argc, char *argv[]) {
+  unsigned int map_size = 10;
+  unsigned int ticks = 20000;
+  std::string save_file;
+
+  Benchmark bench("save_game");
+  CommandLine *command_line = bench.get_command_line();
+  command_line->add_option('l', "Use the saved game FILE as the fixture")
+                .add_parameter("FILE", [&save_file](std::istream& s) {
+                  std::getline(s, save_file);
+                  return true;
+                });
+  command_line->add_option('m', "Map size of the fixture (default 10)")
+                .add_parameter("SIZE", [&map_size](std::istream& s) {
+                  s >> map_size;
+                  return (map_size >= 1 && map_size <= 10);
+                });
+  command_line->add_option('n', "Ticks to play the fixture (default 20000)")
+                .add_parameter("TICKS", [&ticks](std::istream& s) {
+                  s >> ticks;
+                  return true;
+                });
+  if (!bench.process(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+  Log::set_level(Log::LevelError);
+
+  GameStore &store = GameStore::get_instance();
+  std::unique_ptr<Game> game;
+  if (!save_file.empty()) {
+    game.reset(new Game());
+    if (!store.load(save_file, game.get())) {
+      std::cerr << "failed to load '" << save_file << "'\n";
+      return EXIT_FAILURE;
+    }
+  } else {
+    game = make_late_game(map_size, ticks);
+    if (!game) {
+      std::cerr << "failed to make the fixture\n";
+      return EXIT_FAILURE;
+    }
+  }
+  std::cout << "fixture: map size " << game->get_map()->get_size() << ", "
+            << game->get_serf_count() << " serfs, "
+            << game->get_flag_count() << " flags, "
+            << game->get_building_count() << " buildings, tick "
+            << game->get_tick() << "\n";
+
+  const std::string text = write_game(game.get(), GameStore::FormatText);
+  for (GameStore::Format format : { GameStore::FormatText,
+                                    GameStore::FormatCompact }) {
+    std::string name = (format == GameStore::FormatText) ? "text" : "compact";
+    std::string saved = write_game(game.get(), format);
+
+    add_throughput(bench.run(name + ".write", [&game, format]() {
+      std::stringstream stream;
+      GameStore::get_instance().write(&stream, game.get(), format);
+    }), saved.size());
+
+    add_throughput(bench.run(name + ".read", [&saved]() {
+      std::stringstream stream(saved);
+      std::unique_ptr<Game> loaded(new Game());
+      GameStore::get_instance().read(&stream, loaded.get());
+    }), saved.size());
+
+    // What the tests check on small games: loading and saving again as text
+    // gives the text the game was saved as.
+    std::stringstream stream(saved);
+    std::unique_ptr<Game> loaded(new Game());
+    if (!store.read(&stream, loaded.get()) ||
+        write_game(loaded.get(), GameStore::FormatText) != text) {
+      bench.fail(name + " save does not load into the same game");
+    }
+  }
+
+  return bench.finish();
+}
@@ -0,0 +1,367 @@
+/*
+ * benchmark.cc - Harness for the benchmark programs
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "tests/benchmark.h"
+
+#include <atomic>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+#include "src/alloc-stats.h"
+#include "src/pathfinder.h"
+#include "src/random.h"
+
+// A build counting allocations by scope replaces operator new in
+// alloc-stats.cc already, and its counts are used instead.
+#if !FREESERF_ALLOC_STATS
+
+static std::atomic<uint64_t> alloc_count(0);
+static std::atomic<uint64_t> alloc_bytes(0);
+static std::atomic<uint64_t> live_bytes(0);
+static std::atomic<uint64_t> peak_bytes(0);
+
+// Every block starts with its size, padded so what follows stays aligned
+// for any type.
+static const size_t block_header = alignof(std::max_align_t);
+
+static void *
+allocate(size_t size) {
+  char *block = static_cast<char*>(std::malloc(size + block_header));
+  if (block == nullptr) {
+    return nullptr;
+  }
+  *reinterpret_cast<size_t*>(block) = size;
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  uint64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_bytes.compare_exchange_weak(peak, live)) {
+  }
+  return block + block_header;
+}
+
+static void
+deallocate(void *data) {
+  if (data == nullptr) {
+    return;
+  }
+  char *block = static_cast<char*>(data) - block_header;
+  live_bytes.fetch_sub(*reinterpret_cast<size_t*>(block),
+                       std::memory_order_relaxed);
+  std::free(block);
+}
+
+void *
+operator new(size_t size) {
+  void *data = allocate(size);
+  if (data == nullptr) {
+    throw std::bad_alloc();
+  }
+  return data;
+}
+
+void *
+operator new[](size_t size) {
+  return operator new(size);
+}
+
+void *
+operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void *
+operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void *data) noexcept { deallocate(data); }
+void operator delete[](void *data) noexcept { deallocate(data); }
+void operator delete(void *data, size_t) noexcept { deallocate(data); }
+void operator delete[](void *data, size_t) noexcept { deallocate(data); }
+void operator delete(void *data, const std::nothrow_t&) noexcept {
+  deallocate(data); }
+void operator delete[](void *data, const std::nothrow_t&) noexcept {
+  deallocate(data); }
+
+uint64_t
+Benchmark::get_alloc_count() {
+  return alloc_count.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Benchmark::get_alloc_bytes() {
+  return alloc_bytes.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Benchmark::get_live_bytes() {
+  return live_bytes.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Benchmark::get_peak_bytes() {
+  return peak_bytes.load(std::memory_order_relaxed);
+}
+
+void
+Benchmark::reset_peak_bytes() {
+  peak_bytes.store(live_bytes.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+}
+
+#else  // !FREESERF_ALLOC_STATS
+
+uint64_t
+Benchmark::get_alloc_count() {
+  return AllocStats::get_totals().count;
+}
+
+uint64_t
+Benchmark::get_alloc_bytes() {
+  return AllocStats::get_totals().bytes;
+}
+
+uint64_t
+Benchmark::get_live_bytes() {
+  return AllocStats::get_live_bytes();
+}
+
+uint64_t
+Benchmark::get_peak_bytes() {
+  return AllocStats::get_peak_bytes();
+}
+
+void
+Benchmark::reset_peak_bytes() {
+  AllocStats::reset_peak_bytes();
+}
+
+#endif  // !FREESERF_ALLOC_STATS
+
+Benchmark::Benchmark(const std::string &_suite)
+  : suite(_suite)
+  , min_seconds(0.5) {
+  command_line.add_option('f', "Only run benchmarks with NAME in their name")
+                .add_parameter("NAME", [this](std::istream& s) {
+                  std::getline(s, filter);
+                  return true;
+                });
+  command_line.add_option('h', "Show this help text", [this](){
+                  command_line.show_help();
+                  exit(EXIT_SUCCESS);
+                });
+  command_line.add_option('o', "Write the results as JSON to FILE")
+                .add_parameter("FILE", [this](std::istream& s) {
+                  std::getline(s, json_file);
+                  return true;
+                });
+  command_line.add_option('t', "Time each benchmark for at least SECONDS")
+                .add_parameter("SECONDS", [this](std::istream& s) {
+                  s >> min_seconds;
+                  return (min_seconds > 0.);
+                });
+}
+
+bool
+Benchmark::process(int argc, char *argv[]) {
+  return command_line.process(argc, argv);
+}
+
+bool
+Benchmark::wanted(const std::string &name) const {
+  return filter.empty() || (name.find(filter) != std::string::npos);
+}
+
+Benchmark::Result *
+Benchmark::run(const std::string &name, std::function<void()> body) {
+  if (!wanted(name)) {
+    return nullptr;
+  }
+  typedef std::chrono::steady_clock Clock;
+  body();
+
+  Result result = {};
+  result.name = name;
+  for (uint64_t batch = 1; ; batch *= 2) {
+    uint64_t allocs = get_alloc_count();
+    uint64_t bytes = get_alloc_bytes();
+    uint64_t live = get_live_bytes();
+    reset_peak_bytes();
+    Clock::time_point start = Clock::now();
+    for (uint64_t op = 0; op < batch; op++) {
+      body();
+    }
+    double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+    if (seconds >= min_seconds || batch >= (uint64_t(1) << 40)) {
+      result.ops = batch;
+      result.ns_per_op = seconds * 1e9 / batch;
+      result.allocs_per_op =
+        static_cast<double>(get_alloc_count() - allocs) / batch;
+      result.bytes_per_op =
+        static_cast<double>(get_alloc_bytes() - bytes) / batch;
+      uint64_t peak = get_peak_bytes();
+      result.peak_bytes = (peak > live) ? peak - live : 0;
+      break;
+    }
+  }
+  results.push_back(result);
+  return &results.back();
+}
+
+void
+Benchmark::fail(const std::string &message) {
+  failures.push_back(message);
+}
+
+int
+Benchmark::finish() {
+  std::cout << std::left << std::setw(36) << suite << std::right
+            << std::setw(14) << "ns/op" << std::setw(12) << "allocs/op"
+            << std::setw(14) << "bytes/op" << std::setw(14) << "peak bytes"
+            << "\n";
+  for (const Result &result : results) {
+    std::cout << std::left << std::setw(36) << result.name << std::right
+              << std::fixed << std::setprecision(1)
+              << std::setw(14) << result.ns_per_op
+              << std::setw(12) << result.allocs_per_op
+              << std::setw(14) << result.bytes_per_op
+              << std::setw(14) << result.peak_bytes;
+    for (const Value &value : result.values) {
+      std::cout << "  " << value.name << " " << std::setprecision(2)
+                << value.value;
+    }
+    std::cout << "\n";
+  }
+  for (const std::string &failure : failures) {
+    std::cout << "FAILED: " << failure << "\n";
+  }
+
+  if (!json_file.empty()) {
+    std::ofstream stream(json_file);
+    write_json(&stream);
+    if (!stream.good()) {
+      std::cerr << "failed to write '" << json_file << "'\n";
+      return EXIT_FAILURE;
+    }
+  }
+  return failures.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Names and messages are made by the benchmarks and never need escaping
+// beyond quotes and backslashes.
+static std::string
+json_string(const std::string &text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+void
+Benchmark::write_json(std::ostream *stream) const {
+  *stream << "{\"suite\": " << json_string(suite) << ", \"results\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &result = results[i];
+    *stream << ((i > 0) ? ",\n " : "\n ") << "{\"name\": "
+            << json_string(result.name) << ", \"ops\": " << result.ops
+            << ", \"ns_per_op\": " << result.ns_per_op
+            << ", \"allocs_per_op\": " << result.allocs_per_op
+            << ", \"bytes_per_op\": " << result.bytes_per_op
+            << ", \"peak_bytes\": " << result.peak_bytes;
+    for (const Value &value : result.values) {
+      *stream << ", " << json_string(value.name) << ": " << value.value;
+    }
+    *stream << "}";
+  }
+  *stream << "\n], \"failures\": [";
+  for (size_t i = 0; i < failures.size(); i++) {
+    *stream << ((i > 0) ? ", " : "") << json_string(failures[i]);
+  }
+  *stream << "]}\n";
+}
+
+// Four players with their castles in the four quarters of the map, and a
+// few of each kind of building connected to them, played for a while so
+// the serfs spread out. The players get far more reproduction than the
+// game lets them pick, a serf every 25 updates, so there are thousands of
+// serfs after a few minutes of game time instead of hours.
+std::unique_ptr<Game>
+make_late_game(unsigned int map_size, unsigned int ticks) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(map_size, Random("8667715887436237"));
+  PMap map = game->get_map();
+  unsigned int cols = map->get_cols();
+  unsigned int rows = map->get_rows();
+  Building::Type types[] = { Building::TypeLumberjack, Building::TypeForester,
+                             Building::TypeStonecutter, Building::TypeSawmill,
+                             Building::TypeFisher, Building::TypeFarm,
+                             Building::TypeMill, Building::TypeBaker,
+                             Building::TypeHut, Building::TypeHut };
+  for (unsigned int i = 0; i < 4; i++) {
+    Player *player = game->get_player(game->add_player(40, 40, 59));
+    MapPos center = map->pos(cols / 4 + (i % 2) * cols / 2,
+                             rows / 4 + (i / 2) * rows / 2);
+    MapPos castle_pos = bad_map_pos;
+    for (unsigned int off = 0; off <= 3268; off++) {
+      MapPos pos = map->pos_add_extended_spirally(center, off);
+      if (game->can_build_castle(pos, player) &&
+          game->build_castle(pos, player)) {
+        castle_pos = pos;
+        break;
+      }
+    }
+    if (castle_pos == bad_map_pos) {
+      return nullptr;
+    }
+
+    MapPos castle_flag = map->move_down_right(castle_pos);
+    unsigned int off = 20;
+    for (Building::Type type : types) {
+      for (; off <= 600; off++) {
+        MapPos pos = map->pos_add_extended_spirally(castle_pos, off);
+        if (!game->can_build_building(pos, type, player)) continue;
+        Road road = pathfinder_map(map.get(), map->move_down_right(pos),
+                                   castle_flag);
+        if (road.is_valid() && game->build_building(pos, type, player) &&
+            game->build_road(road, player)) {
+          break;
+        }
+      }
+    }
+  }
+
+  for (unsigned int tick = 0; tick < ticks; tick++) {
+    game->update();
+  }
+  return game;
+}
@@ -0,0 +1,105 @@
+/*
+ * benchmark.h - Harness for the benchmark programs
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TESTS_BENCHMARK_H_
+#define TESTS_BENCHMARK_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "src/command_line.h"
+#include "src/game.h"
+
+// The bench_* programs next to the tests time the hot paths of the game
+// and write what they find as JSON, so regressions can be tracked over
+// time. They are built with the tests but not run by ctest, as they take a
+// while and their numbers only mean something on a quiet machine.
+//
+// Each benchmark runs its body once to warm up, and then in batches that
+// double in size until a batch took long enough to time. Allocations are
+// counted by the global operator new benchmark.cc replaces, so each result
+// also has the allocations per run and the most memory a run had allocated
+// at once.
+class Benchmark {
+ public:
+  typedef struct Value {
+    std::string name;
+    double value;
+  } Value;
+
+  typedef struct Result {
+    std::string name;
+    uint64_t ops;
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_op;    // Allocated, whether freed again or not
+    uint64_t peak_bytes;    // Above what was allocated before the run
+    std::vector<Value> values;  // What else the benchmark reports
+  } Result;
+
+  // Allocations made since the program started, on any thread.
+  static uint64_t get_alloc_count();
+  static uint64_t get_alloc_bytes();
+  static uint64_t get_live_bytes();
+  static uint64_t get_peak_bytes();
+  static void reset_peak_bytes();
+
+ protected:
+  std::string suite;
+  CommandLine command_line;
+  std::string json_file;
+  std::string filter;
+  double min_seconds;
+  std::vector<Result> results;
+  std::vector<std::string> failures;
+
+ public:
+  explicit Benchmark(const std::string &suite);
+
+  // For the options of the benchmark program, next to -f, -o and -t.
+  CommandLine *get_command_line() { return &command_line; }
+  bool process(int argc, char *argv[]);
+
+  // Whether the benchmark of this name is to run at all.
+  bool wanted(const std::string &name) const;
+  // Time body, if wanted. The result can be added to until the next run.
+  Result *run(const std::string &name, std::function<void()> body);
+  // A check the benchmark made on its results went wrong.
+  void fail(const std::string &message);
+
+  // Print the results, write them as JSON if asked to, and return the exit
+  // code of the program.
+  int finish();
+  void write_json(std::ostream *stream) const;
+};
+
+// Four players on a map of map_size, with thousands of serfs after ticks
+// updates, or nullptr if there was no room for their castles. For the
+// benchmarks that want a game as it looks late in a match.
+std::unique_ptr<Game> make_late_game(unsigned int map_size,
+                                     unsigned int ticks);
+
+#endif  // TESTS_BENCHMARK_H_
@@ -0,0 +1,75 @@
+/*
+ * test_ai_arena.cc - Tests for the AI loop arena
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+
+#include "src/ai_arena.h"
+
+TEST(AIArena, ReusesItsBlocksAfterReset) {
+  AIArena arena;
+  for (int loop = 0; loop < 3; loop++) {
+    ArenaVector<uint64_t> numbers{AIArenaAllocator<uint64_t>(&arena)};
+    ArenaSet<int> set{std::less<int>(), AIArenaAllocator<int>(&arena)};
+    for (int i = 0; i < 20000; i++) {
+      numbers.push_back(i);
+      set.insert(i % 100);
+    }
+    EXPECT_EQ(19999u, numbers.back());
+    EXPECT_EQ(100u, set.size());
+    numbers = ArenaVector<uint64_t>{AIArenaAllocator<uint64_t>(&arena)};
+    set.clear();
+    arena.reset();
+  }
+  // only the first loop had to ask for blocks
+  size_t blocks = arena.get_block_count();
+  size_t bytes = arena.get_allocated_bytes();
+  arena.allocate(100, 8);
+  EXPECT_EQ(blocks, arena.get_block_count());
+  EXPECT_EQ(bytes, arena.get_allocated_bytes());
+}
+
+TEST(AIArena, ScopeGivesBackWhatItTook) {
+  AIArena arena;
+  void *before = arena.allocate(16, 16);
+  void *in_scope = nullptr;
+  {
+    AIArena::Scope scope(&arena);
+    in_scope = arena.allocate(1000, 8);
+    std::shared_ptr<int> shared =
+      std::allocate_shared<int>(AIArenaAllocator<int>(&arena), 5);
+    EXPECT_EQ(5, *shared);
+  }
+  EXPECT_EQ(in_scope, arena.allocate(1000, 8));
+  EXPECT_NE(before, in_scope);
+}
+
+TEST(AIArena, AlignsAndTakesLargeRequests) {
+  AIArena arena;
+  arena.allocate(3, 1);
+  void *aligned = arena.allocate(8, 64);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(aligned) % 64);
+  char *large = static_cast<char*>(arena.allocate(3 * AIArena::block_size, 8));
+  large[3 * AIArena::block_size - 1] = 1;
+  EXPECT_LE(4 * AIArena::block_size, arena.get_allocated_bytes());
+}
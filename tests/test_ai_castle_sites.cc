@@ -0,0 +1,122 @@
+/*
+ * test_ai_castle_sites.cc - Tests for scoring castle sites
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+
+#include "src/ai_castle_sites.h"
+#include "src/game.h"
+#include "src/random.h"
+
+namespace {
+
+const CastleSites::Minimums min = { 16, 5, 250 };
+
+std::unique_ptr<Game>
+make_game() {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  return game;
+}
+
+}  // namespace
+
+TEST(CastleSites, ScoresWhatIsAround) {
+  std::unique_ptr<Game> game = make_game();
+  PMap map = game->get_map();
+  unsigned int tiles = 1 + 3 * CastleSites::radius * (CastleSites::radius + 1);
+
+  for (MapPos pos = 0; pos < map->get_size(); pos += 211) {
+    unsigned int trees = 0;
+    unsigned int stones = 0;
+    unsigned int building_sites = 0;
+    for (unsigned int i = 0; i < tiles; i++) {
+      MapPos at = map->pos_add_extended_spirally(pos, i);
+      Map::Object obj = map->get_obj(at);
+      if (obj >= Map::ObjectTree0 && obj <= Map::ObjectPine7) trees++;
+      if (obj >= Map::ObjectStone0 && obj <= Map::ObjectStone7) {
+        stones += 1 + Map::ObjectStone7 - obj;
+      }
+      if (game->can_build_large(at)) {
+        building_sites += 3;
+      } else if (game->can_build_small(at)) {
+        building_sites += 1;
+      }
+    }
+    CastleSites::Site site = CastleSites::score(game.get(), *map, pos);
+    EXPECT_EQ(trees, site.trees) << pos;
+    EXPECT_EQ(stones, site.stones) << pos;
+    EXPECT_EQ(building_sites, site.building_sites) << pos;
+  }
+}
+
+TEST(CastleSites, SameSitesOnAnyThreadCount) {
+  std::unique_ptr<Game> game = make_game();
+  CastleSites::Sites one = CastleSites::find(game.get(), min, 1);
+  CastleSites::Sites many = CastleSites::find(game.get(), min, 7);
+  ASSERT_LT(0u, one.size());
+  ASSERT_EQ(one.size(), many.size());
+  for (size_t i = 0; i < one.size(); i++) {
+    EXPECT_EQ(one[i].pos, many[i].pos);
+    EXPECT_TRUE(CastleSites::is_acceptable(one[i], min));
+    EXPECT_TRUE(game->get_buildable(one[i].pos) & Game::BuildableCastle);
+    if (i > 0) {
+      EXPECT_GE(one[i - 1].score, one[i].score);
+    }
+  }
+}
+
+TEST(CastleSites, KeptForTheMap) {
+  CastleSites::clear_cache();
+  std::unique_ptr<Game> game = make_game();
+  std::shared_ptr<const CastleSites::Sites> sites =
+                                          CastleSites::get(game.get(), min);
+  // Another game on the same map gets the same sites without scoring again.
+  std::unique_ptr<Game> again = make_game();
+  EXPECT_EQ(sites, CastleSites::get(again.get(), min));
+
+  std::unique_ptr<Game> other(new Game());
+  other->init(3, Random("3762658723465872"));
+  EXPECT_NE(sites, CastleSites::get(other.get(), min));
+  CastleSites::clear_cache();
+}
+
+TEST(CastleSites, SpreadApart) {
+  std::unique_ptr<Game> game = make_game();
+  PMap map = game->get_map();
+  CastleSites::Sites sites = CastleSites::find(game.get(), min);
+  CastleSites::Sites spread = CastleSites::spread(*map, sites, 20);
+  ASSERT_LT(0u, spread.size());
+  EXPECT_EQ(sites[0].pos, spread[0].pos);
+  for (size_t i = 0; i < spread.size(); i++) {
+    for (size_t j = 0; j < i; j++) {
+      int dx = map->dist_x(spread[i].pos, spread[j].pos);
+      int dy = map->dist_y(spread[i].pos, spread[j].pos);
+      int dist = ((dx > 0 && dy > 0) || (dx < 0 && dy < 0)) ?
+                 std::max(std::abs(dx), std::abs(dy)) :
+                 std::abs(dx) + std::abs(dy);
+      EXPECT_LE(20, dist);
+    }
+  }
+}
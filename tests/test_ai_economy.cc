@@ -0,0 +1,135 @@
+/*
+ * test_ai_economy.cc - Tests for the flow model of production chains
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "src/ai_economy.h"
+#include "src/game.h"
+#include "src/random.h"
+
+namespace {
+
+void
+add_building(GameSnapshot::PlayerView *view, Building::Type type,
+             bool done = true) {
+  GameSnapshot::BuildingView building = {};
+  building.index = static_cast<unsigned int>(view->buildings.size() + 1);
+  building.type = type;
+  building.done = done;
+  building.has_serf = done;
+  view->buildings.push_back(building);
+}
+
+void
+set_stock(GameSnapshot::PlayerView *view, Resource::Type res,
+          unsigned int count) {
+  if (view->inventories.empty()) {
+    view->inventories.push_back(GameSnapshot::InventoryView());
+  }
+  view->inventories[0].resources[res] = count;
+}
+
+}  // namespace
+
+TEST(EconomyForecast, NothingWorking) {
+  GameSnapshot::PlayerView view;
+  set_stock(&view, Resource::TypePlank, 20);
+  add_building(&view, Building::TypeSawmill, false);
+  EconomyForecast economy;
+  economy.update(view);
+  EXPECT_EQ(0u, economy.get_working(Building::TypeSawmill));
+  EXPECT_EQ(20u, economy.get_stock(Resource::TypePlank));
+  const EconomyForecast::Forecast &forecast = economy.forecast(10);
+  EXPECT_EQ(10u, forecast.minutes);
+  for (unsigned int r = 0; r < EconomyForecast::resource_types; r++) {
+    EXPECT_EQ(-1, forecast.short_in[r]);
+  }
+  EXPECT_DOUBLE_EQ(20, forecast.stock[Resource::TypePlank]);
+}
+
+TEST(EconomyForecast, RunsOutOfInput) {
+  GameSnapshot::PlayerView view;
+  set_stock(&view, Resource::TypeLumber, 10);
+  add_building(&view, Building::TypeSawmill);
+  EconomyForecast economy;
+  economy.update(view);
+
+  // Three planks a minute until the lumber is gone in the fourth minute.
+  EXPECT_DOUBLE_EQ(3, economy.get_projected(Resource::TypePlank, 1));
+  EXPECT_EQ(-1, economy.get_short_in(Resource::TypeLumber, 1));
+  EXPECT_DOUBLE_EQ(10, economy.get_projected(Resource::TypePlank, 5));
+  EXPECT_DOUBLE_EQ(0, economy.get_projected(Resource::TypeLumber, 5));
+  EXPECT_EQ(3, economy.get_short_in(Resource::TypeLumber, 5));
+
+  // A lumberjack brings a third of what the sawmill could take, so the
+  // lumber lasts two minutes longer, then planks come as the lumber does.
+  add_building(&view, Building::TypeLumberjack);
+  economy.update(view);
+  EXPECT_EQ(1u, economy.get_working(Building::TypeLumberjack));
+  EXPECT_DOUBLE_EQ(10 + 20, economy.get_projected(Resource::TypePlank, 20));
+  EXPECT_EQ(5, economy.get_short_in(Resource::TypeLumber, 20));
+}
+
+TEST(EconomyForecast, MinesTakeAnyFood) {
+  GameSnapshot::PlayerView view;
+  set_stock(&view, Resource::TypeFish, 2);
+  set_stock(&view, Resource::TypeBread, 1);
+  set_stock(&view, Resource::TypeIronOre, 10);
+  add_building(&view, Building::TypeCoalMine);
+  add_building(&view, Building::TypeSteelSmelter);
+  EconomyForecast economy;
+  economy.update(view);
+
+  // The mine digs the three foods' worth of coal in the first two minutes,
+  // and the smelter turns it into steel as it comes.
+  const EconomyForecast::Forecast &forecast = economy.forecast(10);
+  EXPECT_DOUBLE_EQ(0, forecast.stock[Resource::TypeFish]);
+  EXPECT_DOUBLE_EQ(0, forecast.stock[Resource::TypeBread]);
+  EXPECT_DOUBLE_EQ(0, forecast.stock[Resource::TypeCoal]);
+  EXPECT_DOUBLE_EQ(3, forecast.stock[Resource::TypeSteel]);
+  EXPECT_DOUBLE_EQ(7, forecast.stock[Resource::TypeIronOre]);
+  EXPECT_EQ(2, forecast.short_in[Resource::TypeFish]);
+  EXPECT_EQ(2, forecast.short_in[Resource::TypeMeat]);
+  EXPECT_EQ(0, forecast.short_in[Resource::TypeCoal]);
+}
+
+TEST(EconomyForecast, FromSnapshot) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), game->get_player(0)));
+  game->update();
+
+  EconomyForecast economy;
+  economy.update(game->get_snapshot(), 0);
+  Inventory *castle =
+    game->get_player_inventories(game->get_player(0)).front();
+  for (unsigned int r = 0; r < EconomyForecast::resource_types; r++) {
+    Resource::Type res = static_cast<Resource::Type>(r);
+    EXPECT_EQ(castle->get_count_of(res), economy.get_stock(res));
+  }
+  // The castle makes nothing.
+  EXPECT_DOUBLE_EQ(castle->get_count_of(Resource::TypePlank),
+                   economy.get_projected(Resource::TypePlank, 30));
+}
@@ -0,0 +1,117 @@
+/*
+ * test_ai_flag_dists.cc - Tests for road distances from the stocks
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "src/ai_flag_dists.h"
+#include "src/game.h"
+#include "src/random.h"
+
+namespace {
+
+bool
+build_straight_road(Game *game, MapPos start, Direction dir, int length,
+                    Player *player) {
+  Road road;
+  road.start(start);
+  for (int i = 0; i < length; i++) {
+    road.extend(dir);
+  }
+  return game->build_road(road, player);
+}
+
+}  // namespace
+
+// castle flag - 2 - a - 2 - b - 3 - c, later with a longer second road
+// from b to c.
+TEST(FlagDists, FewestFlagsThenFewestTiles) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+  MapPos castle_flag = map->move_down_right(map->pos(6, 6));
+
+  MapPos a = map->move_right_n(castle_flag, 2);
+  MapPos b = map->move_right_n(a, 2);
+  MapPos c = map->move_right_n(b, 3);
+  ASSERT_TRUE(game->build_flag(a, player));
+  ASSERT_TRUE(game->build_flag(b, player));
+  ASSERT_TRUE(game->build_flag(c, player));
+  ASSERT_TRUE(build_straight_road(game.get(), castle_flag, DirectionRight, 2,
+                                  player));
+  ASSERT_TRUE(build_straight_road(game.get(), a, DirectionRight, 2, player));
+  ASSERT_TRUE(build_straight_road(game.get(), b, DirectionRight, 3, player));
+  MapPos lone = map->move_down_n(castle_flag, 2);
+  ASSERT_TRUE(game->build_flag(lone, player));
+
+  FlagDists dists;
+  dists.build(*map, std::vector<MapPos>{ castle_flag, b }, castle_flag);
+  FlagDists::Dist dist;
+  ASSERT_TRUE(dists.get(*map, castle_flag, castle_flag, &dist));
+  EXPECT_EQ(0u, dist.flag_dist);
+  EXPECT_EQ(0u, dist.tile_dist);
+  EXPECT_FALSE(dist.contains_castle_flag);
+  ASSERT_TRUE(dists.get(*map, castle_flag, c, &dist));
+  EXPECT_EQ(3u, dist.flag_dist);
+  EXPECT_EQ(7u, dist.tile_dist);
+  EXPECT_FALSE(dist.contains_castle_flag);
+
+  // Towards b, the way from the castle flag passes it.
+  ASSERT_TRUE(dists.get(*map, b, castle_flag, &dist));
+  EXPECT_EQ(2u, dist.flag_dist);
+  EXPECT_EQ(4u, dist.tile_dist);
+  EXPECT_TRUE(dist.contains_castle_flag);
+  ASSERT_TRUE(dists.get(*map, b, c, &dist));
+  EXPECT_EQ(1u, dist.flag_dist);
+  EXPECT_EQ(3u, dist.tile_dist);
+  EXPECT_FALSE(dist.contains_castle_flag);
+
+  // Neither unconnected flags nor targets that are not stocks are known.
+  EXPECT_FALSE(dists.get(*map, castle_flag, lone, &dist));
+  EXPECT_FALSE(dists.get(*map, a, c, &dist));
+
+  // A second, longer road from b to c, and one more flag on the way to d.
+  Road road;
+  road.start(b);
+  road.extend(DirectionDown);
+  road.extend(DirectionDown);
+  road.extend(DirectionRight);
+  road.extend(DirectionRight);
+  road.extend(DirectionRight);
+  road.extend(DirectionUp);
+  road.extend(DirectionUp);
+  ASSERT_TRUE(game->build_road(road, player));
+  MapPos d = map->move_up_left(map->move_up_left(c));
+  ASSERT_TRUE(game->build_flag(d, player));
+  ASSERT_TRUE(build_straight_road(game.get(), c, DirectionUpLeft, 2, player));
+  dists.build(*map, std::vector<MapPos>{ b }, castle_flag);
+  ASSERT_TRUE(dists.get(*map, b, c, &dist));
+  EXPECT_EQ(1u, dist.flag_dist);
+  EXPECT_EQ(3u, dist.tile_dist);
+  ASSERT_TRUE(dists.get(*map, b, d, &dist));
+  EXPECT_EQ(2u, dist.flag_dist);
+  EXPECT_EQ(5u, dist.tile_dist);
+}
@@ -0,0 +1,85 @@
+/*
+ * test_ai_governor.cc - Tests for the AI CPU budget
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include "src/ai_governor.h"
+#include "src/freeserf.h"
+
+TEST(AIGovernor, CreditIsEarnedPerTickUpToOneSlice) {
+  AIGovernor governor(1000, 50000);
+  EXPECT_EQ(50000, governor.get_slice_us());
+  EXPECT_EQ(0u, governor.get_wait_ms());
+
+  governor.refill(100);
+  governor.charge(80000);
+  EXPECT_EQ(-30000, governor.get_credit_us());
+  EXPECT_EQ(0, governor.get_slice_us());
+
+  // Paid back after 30 more ticks, then capped at one slice.
+  governor.refill(120);
+  EXPECT_EQ(-10000, governor.get_credit_us());
+  governor.refill(130);
+  EXPECT_EQ(0, governor.get_credit_us());
+  governor.refill(1000);
+  EXPECT_EQ(50000, governor.get_credit_us());
+
+  // A game loaded at an earlier tick earns from there on.
+  governor.charge(50000);
+  governor.refill(10);
+  EXPECT_EQ(0, governor.get_credit_us());
+  governor.refill(15);
+  EXPECT_EQ(5000, governor.get_credit_us());
+}
+
+TEST(AIGovernor, WaitFollowsGameSpeed) {
+  EXPECT_EQ(static_cast<unsigned int>(10 * TICK_LENGTH),
+            AIGovernor::ticks_to_ms(10, 1));
+  EXPECT_EQ(static_cast<unsigned int>(5 * TICK_LENGTH),
+            AIGovernor::ticks_to_ms(10, 2));
+  EXPECT_EQ(1u, AIGovernor::ticks_to_ms(1, 40));
+  EXPECT_EQ(0u, AIGovernor::ticks_to_ms(0, 2));
+
+  // Twice the speed, half the wait for the same debt.
+  AIGovernor slow(1000, 50000);
+  AIGovernor fast(1000, 50000);
+  slow.start_slice(0, 1);
+  fast.start_slice(0, 2);
+  slow.charge(150000);
+  fast.charge(150000);
+  EXPECT_EQ(100u * TICK_LENGTH, slow.get_wait_ms());
+  EXPECT_EQ(50u * TICK_LENGTH, fast.get_wait_ms());
+}
+
+TEST(AIGovernor, SliceEndsOnTime) {
+  AIGovernor governor(1000, 20000);
+  governor.start_slice(0, 2);
+  EXPECT_FALSE(governor.slice_used());
+  while (!governor.slice_used()) {
+  }
+  // Slightly over, so at most a tick to wait.
+  unsigned int wait_ms = governor.end_slice(0);
+  EXPECT_LE(wait_ms, AIGovernor::ticks_to_ms(1, 2));
+  EXPECT_LE(governor.get_credit_us(), 0);
+
+  governor.start_slice(0, 2);
+  EXPECT_TRUE(governor.slice_used());
+}
@@ -0,0 +1,195 @@
+/*
+ * test_ai_map_analysis.cc - Tests for the map analysis the AIs share
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "src/ai_map_analysis.h"
+#include "src/game.h"
+#include "src/random.h"
+
+namespace {
+
+// spiral_dist(6), all within 6 rows of the center and one more for the
+//  triangles around the outer tiles
+const unsigned int tiles = 127;
+const int radius = 7;
+
+std::unique_ptr<Game>
+make_game() {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  return game;
+}
+
+// the way score_area counted them tile by tile
+MapAnalysis::Counts
+count_tiles(const Map &map, MapPos center) {
+  MapAnalysis::Counts counts = {};
+  for (unsigned int i = 0; i < tiles; i++) {
+    MapPos pos = map.pos_add_extended_spirally(center, i);
+    Map::Object obj = map.get_obj(pos);
+    unsigned int terrain = map.terrain_up_left(pos);
+    if ((obj == Map::ObjectNone &&
+         (terrain & (Map::terrain_bits(Map::TerrainGrass0, Map::TerrainGrass3) |
+                     Map::terrain_bits(Map::TerrainWater0, Map::TerrainWater3)))) ||
+        (obj >= Map::ObjectSeeds0 && obj <= Map::ObjectFieldExpired) ||
+        (obj >= Map::ObjectField0 && obj <= Map::ObjectField5)) {
+      counts.foods++;
+    }
+    if (obj >= Map::ObjectTree0 && obj <= Map::ObjectPine7) counts.trees++;
+    if (obj >= Map::ObjectStone0 && obj <= Map::ObjectStone7) {
+      counts.stones += 1 + Map::ObjectStone7 - obj;
+    }
+    if (terrain & Map::terrain_bits(Map::TerrainTundra0, Map::TerrainSnow0)) {
+      counts.hills++;
+    }
+    if (obj == Map::ObjectSignLargeGold) counts.gold_signs += 3;
+    if (obj == Map::ObjectSignSmallGold) counts.gold_signs += 1;
+    if (obj == Map::ObjectSignLargeIron) counts.iron_signs += 3;
+    if (obj == Map::ObjectSignSmallIron) counts.iron_signs += 1;
+    if (obj == Map::ObjectSignLargeCoal) counts.coal_signs += 3;
+    if (obj == Map::ObjectSignSmallCoal) counts.coal_signs += 1;
+    if (obj == Map::ObjectSignLargeStone) counts.stone_signs += 3;
+    if (obj == Map::ObjectSignSmallStone) counts.stone_signs += 1;
+  }
+  return counts;
+}
+
+void
+expect_counts(const MapAnalysis::Counts &expected,
+              const MapAnalysis::Counts &counts, MapPos pos) {
+  EXPECT_EQ(expected.foods, counts.foods) << pos;
+  EXPECT_EQ(expected.trees, counts.trees) << pos;
+  EXPECT_EQ(expected.stones, counts.stones) << pos;
+  EXPECT_EQ(expected.hills, counts.hills) << pos;
+  EXPECT_EQ(expected.gold_signs, counts.gold_signs) << pos;
+  EXPECT_EQ(expected.iron_signs, counts.iron_signs) << pos;
+  EXPECT_EQ(expected.coal_signs, counts.coal_signs) << pos;
+  EXPECT_EQ(expected.stone_signs, counts.stone_signs) << pos;
+}
+
+}  // namespace
+
+TEST(MapAnalysis, CountsWhatIsAround) {
+  std::unique_ptr<Game> game = make_game();
+  PMap map = game->get_map();
+  std::shared_ptr<MapAnalysis> analysis = MapAnalysis::get(map);
+  for (MapPos pos = 0; pos < map->geom().tile_count(); pos += 97) {
+    expect_counts(count_tiles(*map, pos), analysis->count_in(pos, tiles, radius),
+                  pos);
+  }
+  // put some signs down, which are not in a new map
+  MapPos center = map->pos(40, 40);
+  map->set_object(map->move_right(center), Map::ObjectSignLargeGold, -1);
+  map->set_object(map->move_down(center), Map::ObjectSignSmallCoal, -1);
+  map->set_object(map->move_left(center), Map::ObjectSignLargeStone, -1);
+  MapAnalysis::Counts counts = analysis->count_in(center, tiles, radius);
+  expect_counts(count_tiles(*map, center), counts, center);
+  EXPECT_EQ(3u, counts.gold_signs);
+  EXPECT_EQ(1u, counts.coal_signs);
+}
+
+// A block is counted again once the map changes in it, and only then.
+TEST(MapAnalysis, CountsChangedBlocksAgain) {
+  std::unique_ptr<Game> game = make_game();
+  PMap map = game->get_map();
+  std::shared_ptr<MapAnalysis> analysis = MapAnalysis::get(map);
+  MapPos pos = map->pos(20, 20);
+  analysis->count_in(pos, tiles, radius);
+  EXPECT_EQ(0u, analysis->get_recount_count());
+
+  unsigned int block = analysis->get_block(pos);
+  MapAnalysis::Region before = analysis->get_region(block);
+  map->set_object(pos, Map::ObjectTree0, -1);
+  MapAnalysis::Counts counts = analysis->count_in(pos, tiles, radius);
+  EXPECT_EQ(1u, analysis->get_recount_count());
+  expect_counts(count_tiles(*map, pos), counts, pos);
+  MapAnalysis::Region after = analysis->get_region(block);
+  EXPECT_NE(before.changes, after.changes);
+  EXPECT_EQ(map->get_block_changes(block), after.changes);
+  analysis->count_in(pos, tiles, radius);
+  EXPECT_EQ(1u, analysis->get_recount_count());
+
+  // the regions add up to the whole map
+  unsigned int trees = 0;
+  for (unsigned int i = 0; i < analysis->get_region_count(); i++) {
+    trees += analysis->get_region(i).counts.trees;
+  }
+  unsigned int map_trees = 0;
+  for (MapPos at = 0; at < map->geom().tile_count(); at++) {
+    map_trees += (map->get_obj(at) >= Map::ObjectTree0 &&
+                  map->get_obj(at) <= Map::ObjectPine7);
+  }
+  EXPECT_EQ(map_trees, trees);
+}
+
+TEST(MapAnalysis, SharedByTheMap) {
+  std::unique_ptr<Game> game = make_game();
+  std::shared_ptr<MapAnalysis> analysis = MapAnalysis::get(game->get_map());
+  EXPECT_EQ(analysis, MapAnalysis::get(game->get_map()));
+  std::unique_ptr<Game> other = make_game();
+  EXPECT_NE(analysis, MapAnalysis::get(other->get_map()));
+}
+
+TEST(MapAnalysis, FindsClusters) {
+  std::unique_ptr<Game> game = make_game();
+  PMap map = game->get_map();
+  std::shared_ptr<MapAnalysis> analysis = MapAnalysis::get(map);
+  const std::vector<MapAnalysis::Cluster> &clusters = analysis->get_clusters();
+
+  unsigned int surface_tiles = 0;
+  unsigned int hills_tiles = 0;
+  for (const MapAnalysis::Cluster &cluster : clusters) {
+    if (cluster.type == MapAnalysis::ClusterHills) {
+      hills_tiles += cluster.tiles;
+      EXPECT_EQ(static_cast<unsigned int>(&cluster - &clusters[0]),
+                analysis->get_hills_cluster(cluster.pos));
+    } else {
+      surface_tiles += cluster.tiles;
+      EXPECT_EQ(static_cast<unsigned int>(&cluster - &clusters[0]),
+                analysis->get_surface_cluster(cluster.pos));
+    }
+  }
+  EXPECT_EQ(map->geom().tile_count(), surface_tiles);
+
+  unsigned int hills = 0;
+  for (MapPos pos = 0; pos < map->geom().tile_count(); pos++) {
+    unsigned int surface = analysis->get_surface_cluster(pos);
+    ASSERT_GT(clusters.size(), surface);
+    EXPECT_EQ(map->is_in_water(pos),
+              clusters[surface].type == MapAnalysis::ClusterWater);
+    bool in_hills = analysis->get_hills_cluster(pos) != MapAnalysis::no_cluster;
+    EXPECT_EQ(map->types_within(pos, Map::TerrainTundra0, Map::TerrainSnow0),
+              in_hills);
+    hills += in_hills;
+    // a neighbour on the same surface is in the same cluster
+    MapPos right = map->move_right(pos);
+    if (map->is_in_water(pos) == map->is_in_water(right)) {
+      EXPECT_EQ(surface, analysis->get_surface_cluster(right));
+      EXPECT_EQ(!map->is_in_water(pos), analysis->is_reachable(pos, right));
+    } else {
+      EXPECT_FALSE(analysis->is_reachable(pos, right));
+    }
+  }
+  EXPECT_EQ(hills, hills_tiles);
+}
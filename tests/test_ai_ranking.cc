@@ -0,0 +1,102 @@
+/*
+ * test_ai_ranking.cc - Tests for ranking scored map positions
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "src/ai_ranking.h"
+#include "src/lookup.h"
+#include "src/random.h"
+
+// The ranking gives the order the AI used to get from copying a
+// std::set<std::pair<MapPos, unsigned int>> into a set sorted by value.
+TEST(MapPosRanking, SameOrderAsSortedSet) {
+  Random random("8667715887436237");
+  for (int round = 0; round < 20; round++) {
+    std::set<std::pair<MapPos, unsigned int>> set;
+    MapPosRanking ranking;
+    for (int i = 0; i < 40; i++) {
+      // Few distinct values, so there are ties and repeats.
+      std::pair<MapPos, unsigned int> entry(random.random() % 16,
+                                            random.random() % 5);
+      set.insert(entry);
+      ranking.insert(entry);
+    }
+
+    auto desc = [](const std::pair<MapPos, unsigned int> &a,
+                   const std::pair<MapPos, unsigned int> &b) {
+      return (a.second != b.second) ? (a.second > b.second) : (a.first < b.first);
+    };
+    auto asc = [](const std::pair<MapPos, unsigned int> &a,
+                  const std::pair<MapPos, unsigned int> &b) {
+      return (a.second != b.second) ? (a.second < b.second) : (a.first > b.first);
+    };
+    std::vector<MapPos> expected_desc;
+    for (auto entry : std::set<std::pair<MapPos, unsigned int>,
+                               decltype(desc)>(set.begin(), set.end(), desc)) {
+      expected_desc.push_back(entry.first);
+    }
+    std::vector<MapPos> expected_asc;
+    for (auto entry : std::set<std::pair<MapPos, unsigned int>,
+                               decltype(asc)>(set.begin(), set.end(), asc)) {
+      expected_asc.push_back(entry.first);
+    }
+
+    EXPECT_EQ(expected_desc, ranking.best_first());
+    EXPECT_EQ(expected_asc, ranking.lowest_first());
+
+    // Asking for the first few gives the same first few.
+    std::vector<MapPos> top = ranking.best_first(3);
+    ASSERT_LE(top.size(), 3u);
+    for (size_t i = 0; i < top.size(); i++) {
+      EXPECT_EQ(expected_desc[i], top[i]);
+    }
+  }
+}
+
+// The overlay marks keep the order and the first color a std::map did.
+TEST(ColorDotMap, SameAsMap) {
+  Random random("8667715887436237");
+  std::map<MapPos, MarkColor> map;
+  ColorDotMap dots;
+  for (int i = 0; i < 500; i++) {
+    MapPos pos = random.random() % 64;
+    MarkColor color = static_cast<MarkColor>(random.random() % MarkColorCount);
+    if (random.random() % 4 == 0) {
+      map.erase(pos);
+      dots.erase(pos);
+    } else {
+      map.insert(ColorDot(pos, color));
+      dots.insert(ColorDot(pos, color));
+    }
+    ASSERT_EQ(map.size(), dots.size());
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), dots.begin(),
+      [](const std::pair<const MapPos, MarkColor> &a, const ColorDot &b) {
+        return a.first == b.first && a.second == b.second; }));
+  }
+  dots.clear();
+  EXPECT_EQ(0u, dots.size());
+}
@@ -0,0 +1,128 @@
+/*
+ * test_ai_road_plot_cache.cc - Tests for the roads an AI keeps plotted
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "src/ai.h"
+#include "src/game.h"
+#include "src/random.h"
+
+namespace {
+
+// a game with the castle of one player, and the castle flag and a spot for
+//  a flag some way from it in the player's land
+class RoadPlotCache : public ::testing::Test {
+ protected:
+  PGame game;
+  PMap map;
+  Player *player;
+  MapPos castle_flag;
+  MapPos end;
+
+  void SetUp() override {
+    game = std::make_shared<Game>();
+    game->init(3, Random("8667715887436237"));
+    map = game->get_map();
+    player = game->get_player(game->add_player(40, 40, 40));
+    MapPos center = map->pos(map->get_cols() / 2, map->get_rows() / 2);
+    MapPos castle_pos = bad_map_pos;
+    for (unsigned int off = 0; off <= 3268; off++) {
+      MapPos pos = map->pos_add_extended_spirally(center, off);
+      if (game->can_build_castle(pos, player) &&
+          game->build_castle(pos, player)) {
+        castle_pos = pos;
+        break;
+      }
+    }
+    ASSERT_NE(bad_map_pos, castle_pos);
+    castle_flag = map->move_down_right(castle_pos);
+    end = bad_map_pos;
+    for (unsigned int off = 60; off <= 500; off++) {
+      MapPos pos = map->pos_add_extended_spirally(castle_pos, off);
+      if (game->can_build_flag(pos, player)) {
+        end = pos;
+        break;
+      }
+    }
+    ASSERT_NE(bad_map_pos, end);
+  }
+};
+
+bool
+road_has_tile(PMap map, const Road &road, MapPos tile) {
+  MapPos pos = road.get_source();
+  for (Direction dir : road.get_dirs()) {
+    if (pos == tile) return true;
+    pos = map->move(pos, dir);
+  }
+  return pos == tile;
+}
+
+}  // namespace
+
+TEST_F(RoadPlotCache, ReusesAnUnchangedPlot) {
+  AI ai(game, player->get_index(), AIPlusOptions());
+  Roads potential_roads;
+  Road road = ai.plot_road_cached(end, castle_flag, &potential_roads);
+  ASSERT_TRUE(road.is_valid());
+  EXPECT_EQ(0u, ai.get_stats_count(AIStats::RoadPlotCacheHits));
+  EXPECT_EQ(1u, ai.get_stats_count(AIStats::RoadPlotCacheMisses));
+
+  Roads again_roads;
+  Road again = ai.plot_road_cached(end, castle_flag, &again_roads);
+  EXPECT_EQ(1u, ai.get_stats_count(AIStats::RoadPlotCacheHits));
+  EXPECT_EQ(1u, ai.get_stats_count(AIStats::RoadPlotCacheMisses));
+  EXPECT_EQ(road.get_source(), again.get_source());
+  EXPECT_TRUE(road.get_dirs() == again.get_dirs());
+  EXPECT_EQ(potential_roads.size(), again_roads.size());
+
+  // a change far from the road leaves it be
+  MapPos far = map->pos_add(end, static_cast<int>(map->get_cols() / 2),
+                            static_cast<int>(map->get_rows() / 2));
+  map->set_object(far, Map::ObjectTree0, -1);
+  again_roads.clear();
+  ai.plot_road_cached(end, castle_flag, &again_roads);
+  EXPECT_EQ(2u, ai.get_stats_count(AIStats::RoadPlotCacheHits));
+}
+
+TEST_F(RoadPlotCache, ReplotsAfterAChangeOnTheRoad) {
+  AI ai(game, player->get_index(), AIPlusOptions());
+  Roads potential_roads;
+  Road road = ai.plot_road_cached(end, castle_flag, &potential_roads);
+  ASSERT_TRUE(road.is_valid());
+  ASSERT_LT(2u, road.get_length());
+
+  // a stone in the middle of the road plotted, which roads can't go over
+  MapPos middle = road.get_source();
+  for (size_t i = 0; i < road.get_length() / 2; i++) {
+    middle = map->move(middle, road.get_dirs().at(i));
+  }
+  map->set_object(middle, Map::ObjectStone0, -1);
+
+  potential_roads.clear();
+  Road replotted = ai.plot_road_cached(end, castle_flag, &potential_roads);
+  EXPECT_EQ(0u, ai.get_stats_count(AIStats::RoadPlotCacheHits));
+  EXPECT_EQ(2u, ai.get_stats_count(AIStats::RoadPlotCacheMisses));
+  ASSERT_TRUE(replotted.is_valid());
+  EXPECT_FALSE(road_has_tile(map, replotted, middle));
+}
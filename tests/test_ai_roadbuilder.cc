@@ -0,0 +1,93 @@
+/*
+ * test_ai_roadbuilder.cc - Tests for the road builder tables
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "src/ai_roadbuilder.h"
+#include "src/random.h"
+
+TEST(RoadBuilderRoads, PackKeepsTheOrderOfTheEnds) {
+  Random random("8667715887436237");
+  RoadBuilderRoads roads;
+  std::map<RoadEnds, RoadBuilderRoad*> expected;
+  std::vector<std::pair<RoadEnds, RoadBuilderRoad*>> added;
+  for (int i = 0; i < 500; i++) {
+    RoadEnds ends(random.random() % 300,
+                  static_cast<Direction>(random.random() % 7 - 1),
+                  random.random() * 7919 % 0x20000,
+                  static_cast<Direction>(random.random() % 7 - 1));
+    ASSERT_EQ(ends, RoadBuilderRoads::unpack(RoadBuilderRoads::pack(ends)));
+    RoadBuilderRoad *road = roads.get(ends);
+    if (expected.count(ends)) {
+      EXPECT_EQ(expected[ends], road);
+      continue;
+    }
+    *road = RoadBuilderRoad(ends, Road());
+    expected[ends] = road;
+    added.push_back(std::make_pair(ends, road));
+  }
+  ASSERT_EQ(expected.size(), roads.size());
+  // nothing moved while the table grew
+  for (std::pair<RoadEnds, RoadBuilderRoad*> road : added) {
+    EXPECT_EQ(road.second, roads.find(road.first));
+    EXPECT_EQ(std::get<0>(road.first), road.second->get_end1());
+    EXPECT_EQ(std::get<2>(road.first), road.second->get_end2());
+  }
+  auto it = expected.begin();
+  for (RoadBuilderRoads::Entry entry : roads) {
+    ASSERT_TRUE(it != expected.end());
+    EXPECT_EQ(it->first, RoadBuilderRoads::unpack(entry.first));
+    EXPECT_EQ(it->second, entry.second);
+    EXPECT_EQ(it->second, roads.find(it->first));
+    ++it;
+  }
+}
+
+TEST(RoadBuilder, ResetKeepsTheStorage) {
+  RoadBuilderPool pool;
+  RoadBuilder *first;
+  {
+    RoadBuilderPool::Lease lease(&pool, 10, 20);
+    RoadBuilder &rb = *lease;
+    first = &rb;
+    rb.set_score(30, 2, 7, true);
+    rb.new_proad(RoadEnds(10, DirectionRight, 30, DirectionLeft), Road());
+    EXPECT_TRUE(rb.has_score(30));
+    EXPECT_EQ(7u, rb.get_score(30).get_tile_dist());
+    EXPECT_TRUE(rb.get_score(30).get_contains_castle_flag());
+    EXPECT_EQ(1u, rb.get_proad_count());
+    // taken while the first is out
+    RoadBuilderPool::Lease other(&pool, 40, 50);
+    EXPECT_NE(first, &*other);
+  }
+  RoadBuilderPool::Lease lease(&pool, 11, 21);
+  RoadBuilder &rb = *lease;
+  EXPECT_EQ(11u, rb.get_start_pos());
+  EXPECT_EQ(21u, rb.get_target_pos());
+  EXPECT_FALSE(rb.has_score(30));
+  EXPECT_EQ(0u, rb.get_proad_count());
+  rb.set_score(30, 1, 1, false);
+  EXPECT_FALSE(rb.get_score(30).get_contains_castle_flag());
+}
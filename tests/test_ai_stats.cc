@@ -0,0 +1,67 @@
+/*
+ * test_ai_stats.cc - Tests for the AI loop timings
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "src/ai_stats.h"
+
+TEST(AIStats, KeepsTheLastLoops) {
+  static const Profiler::Section slow("ai.do_test_slow");
+  static const Profiler::Section fast("ai.do_test_fast");
+  static const Profiler::Section lock("lock.game.test_wait");
+  static const Profiler::Section other("game.test_other");
+  AIStats stats;
+  EXPECT_TRUE(stats.get_loops()->empty());
+
+  for (unsigned int loop = 1; loop <= AIStats::loops_kept + 2; loop++) {
+    stats.begin_step();
+    Profiler::record(slow.get_id(), 3000 * loop);
+    Profiler::record(fast.get_id(), 10);
+    Profiler::record(fast.get_id(), 20);
+    Profiler::record(lock.get_id(), 400);
+    Profiler::record(other.get_id(), 50);
+    stats.end_step();
+    // not in a step
+    Profiler::record(slow.get_id(), 1000000);
+    stats.count(AIStats::PlotRoadCalls, loop);
+    stats.count(AIStats::FlagDistsHits);
+    stats.end_loop(loop, 100 * loop);
+  }
+
+  std::shared_ptr<const AIStats::Loops> loops = stats.get_loops();
+  ASSERT_EQ(AIStats::loops_kept, loops->size());
+  const AIStats::Loop &last = loops->front();
+  EXPECT_EQ(AIStats::loops_kept + 2, last.loop);
+  EXPECT_EQ(100 * last.loop, last.ticks);
+  EXPECT_EQ(400u, last.lock_wait_ns);
+  EXPECT_EQ(last.loop, last.counters[AIStats::PlotRoadCalls]);
+  EXPECT_EQ(1u, last.counters[AIStats::FlagDistsHits]);
+  EXPECT_EQ(0u, last.counters[AIStats::PlotRoadNodes]);
+  ASSERT_EQ(2u, last.steps.size());
+  EXPECT_EQ("do_test_slow", last.steps[0].name);
+  EXPECT_EQ(3000u * last.loop, last.steps[0].ns);
+  EXPECT_EQ("do_test_fast", last.steps[1].name);
+  EXPECT_EQ(30u, last.steps[1].ns);
+  EXPECT_EQ(2u, last.steps[1].count);
+  EXPECT_EQ(3u, loops->back().loop);
+}
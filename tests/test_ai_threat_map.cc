@@ -0,0 +1,110 @@
+/*
+ * test_ai_threat_map.cc - Tests for military strength by area
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+
+#include "src/ai_threat_map.h"
+#include "src/game.h"
+#include "src/random.h"
+
+namespace {
+
+// The incrementally kept map against one made from this snapshot alone,
+// and the buildings near each military building against all of them.
+void
+expect_threat_map_current(const ThreatMap &threat_map,
+                          std::shared_ptr<const GameSnapshot> snapshot,
+                          const Map &map) {
+  ThreatMap fresh;
+  fresh.update(snapshot, map);
+  int total = 0;
+  for (unsigned int p = 0; p < GameSnapshot::max_players; p++) {
+    for (const GameSnapshot::BuildingView &building :
+         snapshot->get_player(p).buildings) {
+      if (building.military) total += building.knight_count;
+    }
+  }
+  int counted = 0;
+  for (unsigned int p = 0; p < GameSnapshot::max_players; p++) {
+    for (MapPos pos = 0; pos < map.get_size(); pos += 97) {
+      EXPECT_EQ(fresh.get_strength(map, p, pos, 1),
+                threat_map.get_strength(map, p, pos, 1));
+    }
+    // A radius over the whole map counts everything once.
+    counted += threat_map.get_strength(map, p, 0, 100);
+  }
+  EXPECT_EQ(total, counted);
+
+  for (unsigned int p = 0; p < GameSnapshot::max_players; p++) {
+    for (const GameSnapshot::BuildingView &from :
+         snapshot->get_player(p).buildings) {
+      std::set<unsigned int> near;
+      threat_map.for_each_military_near(map, from.pos,
+                                        [&](const ThreatMap::Military &m) {
+        EXPECT_TRUE(near.insert(m.view->index).second);
+      });
+      for (unsigned int q = 0; q < GameSnapshot::max_players; q++) {
+        for (const GameSnapshot::BuildingView &to :
+             snapshot->get_player(q).buildings) {
+          if (to.military && snapshot->tile_dist(from.pos, to.pos) <= 13) {
+            EXPECT_EQ(1u, near.count(to.index));
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST(ThreatMap, FollowsTheGame) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  game->add_player(12, 64, 35);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), game->get_player(0)));
+  ASSERT_TRUE(game->build_castle(map->pos(28, 6), game->get_player(1)));
+
+  ThreatMap threat_map;
+  threat_map.update(game->get_snapshot(), *map);
+  expect_threat_map_current(threat_map, game->get_snapshot(), *map);
+
+  for (int round = 0; round < 5; round++) {
+    for (int tick = 0; tick < 400; tick++) {
+      game->update();
+    }
+    std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+    threat_map.update(snapshot, *map);
+    expect_threat_map_current(threat_map, snapshot, *map);
+  }
+
+  // One castle gone.
+  ASSERT_TRUE(game->demolish_building(map->pos(28, 6), game->get_player(1)));
+  game->update();
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  threat_map.update(snapshot, *map);
+  expect_threat_map_current(threat_map, snapshot, *map);
+  EXPECT_EQ(0, threat_map.get_strength(*map, 1, map->pos(28, 6), 100));
+}
@@ -0,0 +1,132 @@
+/*
+ * test_alloc_stats.cc - Tests for allocations counted by profiler scope
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/alloc-stats.h"
+#include "src/profiler.h"
+
+namespace {
+
+const Profiler::Section outer_section("test.alloc.outer");
+const Profiler::Section inner_section("test.alloc.inner");
+
+}  // namespace
+
+TEST(AllocStats, ScopeFollowsTimers) {
+  if (!Profiler::track_scope) {
+    return;
+  }
+  EXPECT_EQ(Profiler::max_sections, Profiler::get_scope());
+  {
+    Profiler::ScopedTimer outer(outer_section);
+    EXPECT_EQ(outer_section.get_id(), Profiler::get_scope());
+    {
+      Profiler::PhaseTimer phases;
+      phases.next(inner_section);
+      EXPECT_EQ(inner_section.get_id(), Profiler::get_scope());
+      phases.next(outer_section);
+      EXPECT_EQ(outer_section.get_id(), Profiler::get_scope());
+      phases.stop();
+      EXPECT_EQ(outer_section.get_id(), Profiler::get_scope());
+    }
+  }
+  EXPECT_EQ(Profiler::max_sections, Profiler::get_scope());
+}
+
+TEST(AllocStats, CountsByScope) {
+  std::vector<std::unique_ptr<char[]>> blocks;
+  blocks.reserve(10);
+  std::vector<AllocStats::Counts> scopes(AllocStats::scope_count);
+  AllocStats::get_thread_scopes(&scopes[0]);
+  AllocStats::Counts before = AllocStats::get_thread_totals();
+  {
+    Profiler::ScopedTimer timer(inner_section);
+    for (int i = 0; i < 10; i++) {
+      blocks.emplace_back(new char[100]);
+    }
+  }
+  AllocStats::Counts after = AllocStats::get_thread_totals();
+  std::vector<AllocStats::Counts> now(AllocStats::scope_count);
+  AllocStats::get_thread_scopes(&now[0]);
+
+  if (!AllocStats::enabled) {
+    EXPECT_EQ(0u, after.count);
+    EXPECT_EQ(0u, AllocStats::get_totals().count);
+    return;
+  }
+  EXPECT_EQ(10u, after.count - before.count);
+  EXPECT_EQ(1000u, after.bytes - before.bytes);
+  unsigned int id = Profiler::track_scope ? inner_section.get_id() :
+                                            Profiler::max_sections;
+  EXPECT_EQ(10u, now[id].count - scopes[id].count);
+  EXPECT_EQ(1000u, now[id].bytes - scopes[id].bytes);
+}
+
+TEST(AllocStats, OtherThreadsInTotals) {
+  if (!AllocStats::enabled) {
+    return;
+  }
+  std::vector<std::unique_ptr<int>> values;
+  values.reserve(5);
+  AllocStats::Counts before = AllocStats::get_totals();
+  AllocStats::Counts thread_before = AllocStats::get_thread_totals();
+  std::thread worker([&values]() {
+    for (int i = 0; i < 5; i++) {
+      values.emplace_back(new int(i));
+    }
+  });
+  worker.join();
+  // Starting the thread allocates a little too.
+  EXPECT_LE(5u, AllocStats::get_totals().count - before.count);
+  EXPECT_GT(5u, AllocStats::get_thread_totals().count - thread_before.count);
+}
+
+TEST(AllocStats, Sites) {
+  std::vector<AllocStats::Counts> scopes(AllocStats::scope_count);
+  scopes[inner_section.get_id()] = { 3, 300 };
+  scopes[outer_section.get_id()] = { 7, 70 };
+  scopes[Profiler::max_sections] = { 5, 50 };
+
+  std::vector<AllocStats::Site> sites = AllocStats::get_sites(&scopes[0], 2);
+  ASSERT_EQ(2u, sites.size());
+  EXPECT_EQ("test.alloc.outer", sites[0].name);
+  EXPECT_EQ(7u, sites[0].count);
+  EXPECT_EQ(70u, sites[0].bytes);
+  EXPECT_EQ("(no scope)", sites[1].name);
+
+  sites = AllocStats::get_sites(&scopes[0], 10);
+  ASSERT_EQ(3u, sites.size());
+  EXPECT_EQ("test.alloc.inner", sites[2].name);
+}
+
+TEST(AllocStats, Report) {
+  AllocStats::reset();
+  EXPECT_TRUE(AllocStats::get_top_sites(10).empty());
+  std::stringstream report;
+  AllocStats::write_report(&report, 50);
+  EXPECT_EQ(0u, report.str().find("allocations "));
+}
@@ -0,0 +1,98 @@
+/*
+ * test_buildable.cc - Cached buildability tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "src/game.h"
+#include "src/random.h"
+
+namespace {
+
+class BuildableGame : public Game {
+ public:
+  using Game::compute_buildable;
+};
+
+// Compare every cached tile with what the map says now.
+void
+expect_cache_current(BuildableGame *game) {
+  PMap map = game->get_map();
+  unsigned int stale = 0;
+  for (MapPos pos : map->geom()) {
+    if (game->get_buildable(pos) != game->compute_buildable(pos)) stale++;
+  }
+  EXPECT_EQ(0u, stale);
+}
+
+}  // namespace
+
+TEST(Buildable, CacheFollowsChanges) {
+  std::unique_ptr<BuildableGame> game(new BuildableGame());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  expect_cache_current(game.get());
+
+  MapPos castle_pos = map->pos(6, 6);
+  ASSERT_TRUE(game->build_castle(castle_pos, player));
+  EXPECT_FALSE(game->can_build_military(castle_pos));
+  expect_cache_current(game.get());
+
+  // A small and a large building and a flag, then take them away again.
+  // The large one levels the ground while the game runs.
+  MapPos building_pos[2] = { 0, 0 };
+  Building::Type types[2] = { Building::TypeLumberjack, Building::TypeFarm };
+  for (int b = 0; b < 2; b++) {
+    for (int i = 40; i < 200 && building_pos[b] == 0; i++) {
+      MapPos pos = map->pos_add_extended_spirally(castle_pos, i);
+      if (game->can_build_building(pos, types[b], player)) {
+        ASSERT_TRUE(game->build_building(pos, types[b], player));
+        building_pos[b] = pos;
+      }
+    }
+    ASSERT_NE(0u, building_pos[b]);
+    expect_cache_current(game.get());
+  }
+
+  MapPos flag_pos = 0;
+  for (int i = 20; i < 120 && flag_pos == 0; i++) {
+    MapPos pos = map->pos_add_extended_spirally(castle_pos, i);
+    if (game->can_build_flag(pos, player)) {
+      ASSERT_TRUE(game->build_flag(pos, player));
+      flag_pos = pos;
+    }
+  }
+  ASSERT_NE(0u, flag_pos);
+  expect_cache_current(game.get());
+
+  for (int tick = 0; tick < 200; tick++) {
+    game->update();
+  }
+  expect_cache_current(game.get());
+
+  EXPECT_TRUE(game->demolish_building(building_pos[0], player));
+  EXPECT_TRUE(game->demolish_building(building_pos[1], player));
+  EXPECT_TRUE(game->demolish_flag(flag_pos, player));
+  expect_cache_current(game.get());
+}
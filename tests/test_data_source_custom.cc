@@ -0,0 +1,146 @@
+/*
+ * test_data_source_custom.cc - Tests for custom data loading
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "src/data-source-custom.h"
+
+namespace {
+
+void
+make_dir(const std::string &path) {
+#ifdef _WIN32
+  _mkdir(path.c_str());
+#else
+  mkdir(path.c_str(), S_IRWXU);
+#endif
+}
+
+// A data folder with no animations and one icon, removed again at the end.
+class CustomFolder {
+ protected:
+  std::string path;
+  std::vector<std::string> files;
+
+ public:
+  explicit CustomFolder(const std::string &_path) : path(_path) {
+    make_dir(path);
+    make_dir(path + "/animation");
+    make_dir(path + "/icon");
+    write("meta.ini", "[general]\nname = Test pack/1\nscale = 2\n");
+    write("animation/meta.ini", "[general]\n");
+    for (size_t i = 0; i < Data::get_resource_count(Data::AssetAnimation);
+         i++) {
+      std::stringstream name;
+      name << "animation/" << std::setfill('0') << std::setw(3) << i << ".ini";
+      write(name.str(), "[general]\ncount = 0\n");
+    }
+    write("icon/meta.ini", "[000]\nimage_path = 000.png\n");
+    write("icon/000.png", "not really");
+  }
+
+  ~CustomFolder() {
+    for (const std::string &file : files) {
+      std::remove((path + "/" + file).c_str());
+    }
+    for (const char *dir : { "/animation", "/icon", "" }) {
+#ifdef _WIN32
+      _rmdir((path + dir).c_str());
+#else
+      rmdir((path + dir).c_str());
+#endif
+    }
+  }
+
+  const std::string &get_path() const { return path; }
+
+  void write(const std::string &name, const std::string &text) {
+    std::ofstream file(path + "/" + name, std::ios_base::trunc);
+    file << text;
+    if (std::find(files.begin(), files.end(), name) == files.end()) {
+      files.push_back(name);
+    }
+  }
+};
+
+class TestSource : public DataSourceCustom {
+ public:
+  explicit TestSource(const std::string &path) : DataSourceCustom(path) {}
+
+  using DataSourceCustom::decodes_in_parallel;
+  using DataSourceCustom::get_sprite_checksum;
+};
+
+}  // namespace
+
+TEST(DataSourceCustom, Load) {
+  CustomFolder folder("test_custom_data");
+  TestSource source(folder.get_path());
+  ASSERT_TRUE(source.check());
+  ASSERT_TRUE(source.load());
+  EXPECT_EQ("test pack/1", source.get_name());  // Config values are lowercase
+  EXPECT_EQ(2u, source.get_scale());
+  EXPECT_TRUE(source.decodes_in_parallel());
+  EXPECT_EQ(0u, source.get_animation_phase_count(0));
+  // No meta file for these, so nothing to decode.
+  Data::MaskImage parts = source.get_sprite_parts(Data::AssetMapObject, 0);
+  EXPECT_FALSE(std::get<0>(parts));
+  EXPECT_FALSE(std::get<1>(parts));
+}
+
+TEST(DataSourceCustom, ChecksumFollowsFiles) {
+  CustomFolder folder("test_custom_data");
+  TestSource first(folder.get_path());
+  ASSERT_TRUE(first.load());
+  EXPECT_NE(0u, first.get_sprite_checksum());
+
+  TestSource again(folder.get_path());
+  ASSERT_TRUE(again.load());
+  EXPECT_EQ(first.get_sprite_checksum(), again.get_sprite_checksum());
+
+  folder.write("icon/000.png", "now a different size");
+  TestSource changed_image(folder.get_path());
+  ASSERT_TRUE(changed_image.load());
+  EXPECT_NE(first.get_sprite_checksum(), changed_image.get_sprite_checksum());
+
+  folder.write("icon/meta.ini", "[000]\nimage_path = 000.png\ndelta_x = 1\n");
+  TestSource changed_meta(folder.get_path());
+  ASSERT_TRUE(changed_meta.load());
+  EXPECT_NE(changed_image.get_sprite_checksum(),
+            changed_meta.get_sprite_checksum());
+}
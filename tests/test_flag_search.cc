@@ -0,0 +1,340 @@
+/*
+ * test_flag_search.cc - FlagSearch tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "src/game.h"
+#include "src/flag.h"
+#include "src/random.h"
+
+// The queue never dereferences its entries, any distinct values will do.
+static Flag *
+fake_flag(size_t i) {
+  return reinterpret_cast<Flag*>((i + 1) * sizeof(void*));
+}
+
+TEST(FlagSearch, QueueWrapsAndGrows) {
+  FlagSearch::Queue queue;
+  size_t capacity = queue.capacity();
+
+  // Cycle through the ring a few times without growing.
+  for (size_t round = 0; round < 3; round++) {
+    for (size_t i = 0; i < capacity - 1; i++) queue.push(fake_flag(i));
+    for (size_t i = 0; i < capacity - 1; i++) {
+      ASSERT_EQ(fake_flag(i), queue.pop());
+    }
+  }
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(capacity, queue.capacity());
+
+  // Overflow while the head is in the middle of the ring.
+  queue.push(fake_flag(0));
+  queue.pop();
+  for (size_t i = 0; i < capacity * 3; i++) queue.push(fake_flag(i));
+  EXPECT_LT(capacity, queue.capacity());
+  for (size_t i = 0; i < capacity * 3; i++) {
+    ASSERT_EQ(fake_flag(i), queue.pop());
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+typedef struct CountVisitsData {
+  unsigned int target;
+  unsigned int visits;
+} CountVisitsData;
+
+static bool
+count_visits_cb(Flag *flag, void *d) {
+  CountVisitsData *data = reinterpret_cast<CountVisitsData*>(d);
+  data->visits++;
+  return (flag->get_index() == data->target);
+}
+
+TEST(FlagSearch, BatchMatchesSingleSearches) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+
+  // Grow a chain of flags from the castle flag.
+  Flag *castle_flag = game->get_flag_at_pos(map->move_down_right(
+                                                            map->pos(6, 6)));
+  ASSERT_TRUE(castle_flag != nullptr);
+  std::vector<Flag*> chain = { castle_flag };
+  for (Direction dir : cycle_directions_cw()) {
+    MapPos pos = chain.back()->get_position();
+    Road road;
+    road.start(pos);
+    for (int i = 0; i < 2; i++) {
+      pos = map->move(pos, dir);
+      road.extend(dir);
+    }
+    if (!game->build_flag(pos, player)) continue;
+    if (!game->build_road(road, player)) continue;
+    chain.push_back(game->get_flag_at_pos(pos));
+  }
+  ASSERT_LT(1u, chain.size()) << "No roads could be built";
+
+  std::vector<CountVisitsData> single(chain.size());
+  for (size_t i = 0; i < chain.size(); i++) {
+    single[i] = { chain[i]->get_index(), 0 };
+    EXPECT_TRUE(FlagSearch::single(castle_flag, count_visits_cb, true, false,
+                                   &single[i]));
+  }
+
+  std::vector<CountVisitsData> batched(chain.size());
+  std::vector<FlagSearch::Request> requests(chain.size());
+  for (size_t i = 0; i < chain.size(); i++) {
+    batched[i] = { chain[i]->get_index(), 0 };
+    requests[i] = { count_visits_cb, &batched[i], false };
+  }
+  FlagSearch search(game.get());
+  search.add_source(castle_flag);
+  EXPECT_TRUE(search.execute_batch(requests.data(), requests.size(),
+                                   true, false));
+
+  for (size_t i = 0; i < chain.size(); i++) {
+    EXPECT_TRUE(requests[i].done);
+    EXPECT_EQ(single[i].visits, batched[i].visits);
+  }
+}
+
+TEST(FlagSearch, NearestInventoryFollowsRoads) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+  Flag *castle_flag = game->get_flag_at_pos(map->move_down_right(
+                                                            map->pos(6, 6)));
+  ASSERT_TRUE(castle_flag != nullptr);
+
+  Flag *flag = nullptr;
+  MapPos road_pos = 0;
+  for (Direction dir : cycle_directions_cw()) {
+    MapPos pos = castle_flag->get_position();
+    Road road;
+    road.start(pos);
+    for (int i = 0; i < 2; i++) {
+      pos = map->move(pos, dir);
+      road.extend(dir);
+    }
+    if (!game->build_flag(pos, player)) continue;
+    if (!game->build_road(road, player)) continue;
+    flag = game->get_flag_at_pos(pos);
+    road_pos = map->move(castle_flag->get_position(), dir);
+    break;
+  }
+  ASSERT_TRUE(flag != nullptr) << "No road could be built";
+
+  int castle_index = static_cast<int>(castle_flag->get_index());
+  EXPECT_EQ(castle_index, flag->find_nearest_inventory_for_serf());
+  EXPECT_EQ(castle_index, flag->find_nearest_inventory_for_serf());
+  // No transporter has reached the road yet.
+  EXPECT_EQ(-1, flag->find_nearest_inventory_for_resource());
+  std::vector<unsigned int> castle_only = { castle_flag->get_index() };
+  EXPECT_EQ(castle_only, flag->get_inventories_in_reach());
+
+  ASSERT_TRUE(game->demolish_road(road_pos, player));
+  EXPECT_EQ(-1, flag->find_nearest_inventory_for_serf());
+  EXPECT_TRUE(flag->get_inventories_in_reach().empty());
+  EXPECT_EQ(castle_index, castle_flag->find_nearest_inventory_for_serf());
+  EXPECT_EQ(castle_only, castle_flag->get_inventories_in_reach());
+}
+
+TEST(Flag, PathTilesFollowSplitAndMerge) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+  Flag *castle_flag = game->get_flag_at_pos(map->move_down_right(
+                                                            map->pos(6, 6)));
+  ASSERT_TRUE(castle_flag != nullptr);
+
+  Flag *flag = nullptr;
+  Direction dir = DirectionNone;
+  std::vector<MapPos> tiles;
+  for (Direction d : cycle_directions_cw()) {
+    MapPos pos = castle_flag->get_position();
+    Road road;
+    road.start(pos);
+    std::vector<MapPos> road_tiles;
+    for (int i = 0; i < 4; i++) {
+      pos = map->move(pos, d);
+      road.extend(d);
+      road_tiles.push_back(pos);
+    }
+    if (!game->build_flag(pos, player)) continue;
+    if (!game->build_road(road, player)) continue;
+    flag = game->get_flag_at_pos(pos);
+    dir = d;
+    tiles = road_tiles;
+    break;
+  }
+  ASSERT_TRUE(flag != nullptr) << "No road could be built";
+
+  const Flag::PathTiles &ahead = castle_flag->get_path_tiles(dir);
+  ASSERT_EQ(tiles.size(), ahead.size());
+  for (size_t i = 0; i < tiles.size(); i++) {
+    EXPECT_EQ(tiles[i], ahead[i].pos);
+    EXPECT_EQ(dir, ahead[i].dir);
+  }
+  const Flag::PathTiles &back = flag->get_path_tiles(reverse_direction(dir));
+  ASSERT_EQ(tiles.size(), back.size());
+  EXPECT_EQ(castle_flag->get_position(), back.back().pos);
+  EXPECT_EQ(ahead.back().cost, back.back().cost);
+
+  // Split the road in the middle, then join it again.
+  ASSERT_TRUE(game->build_flag(tiles[1], player));
+  EXPECT_EQ(2u, castle_flag->get_path_tiles(dir).size());
+  EXPECT_EQ(2u, flag->get_path_tiles(reverse_direction(dir)).size());
+  ASSERT_TRUE(game->demolish_flag(tiles[1], player));
+  ASSERT_EQ(tiles.size(), castle_flag->get_path_tiles(dir).size());
+  EXPECT_EQ(flag->get_position(),
+            castle_flag->get_path_tiles(dir).back().pos);
+  EXPECT_EQ(castle_flag->get_position(),
+            flag->get_path_tiles(reverse_direction(dir)).back().pos);
+
+  ASSERT_TRUE(game->demolish_road(tiles[0], player));
+  EXPECT_TRUE(castle_flag->get_path_tiles(dir).empty());
+  EXPECT_TRUE(flag->get_path_tiles(reverse_direction(dir)).empty());
+}
+
+// Schedules slots and moves time back, standing in for the transporters
+// and the ticks of a running game.
+class TrafficFlag : public Flag {
+ public:
+  TrafficFlag(Game *game, unsigned int index) : Flag(game, index) {}
+
+  void schedule(unsigned int slot_, Direction dir) { set_slot_dir(slot_, dir); }
+  void age(unsigned int ticks) {
+    traffic_tick -= ticks;
+    for (ResourceSlot &s : slot) {
+      s.since -= ticks;
+    }
+  }
+};
+
+TEST(Flag, TrafficCounts) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  TrafficFlag flag(game.get(), 1);
+
+  Resource::Type res;
+  unsigned int dest;
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(flag.drop_resource(Resource::TypePlank, 0));
+  }
+  EXPECT_EQ(2u, flag.get_traffic_queue());  // (1 + 2 + 3 + 4) / 4
+
+  flag.schedule(0, DirectionRight);
+  flag.schedule(1, DirectionRight);
+  flag.schedule(2, DirectionLeft);
+  flag.age(1000);
+  ASSERT_TRUE(flag.pick_up_resource(0, &res, &dest));
+  flag.age(3000);
+  ASSERT_TRUE(flag.pick_up_resource(1, &res, &dest));
+  ASSERT_TRUE(flag.pick_up_resource(2, &res, &dest));
+  EXPECT_EQ(2u, flag.get_traffic_carried(DirectionRight));
+  EXPECT_EQ(2500u, flag.get_traffic_wait(DirectionRight));
+  EXPECT_TRUE(flag.is_congested(DirectionRight));
+  EXPECT_EQ(1u, flag.get_traffic_carried(DirectionLeft));
+  EXPECT_EQ(0u, flag.get_traffic_carried(DirectionDown));
+  EXPECT_EQ(0u, flag.get_traffic_wait(DirectionDown));
+  EXPECT_FALSE(flag.is_congested(DirectionDown));
+
+  // Older traffic counts for less, the average wait stays.
+  flag.age(Flag::traffic_half_life);
+  EXPECT_EQ(1u, flag.get_traffic_carried(DirectionRight));
+  EXPECT_EQ(2500u, flag.get_traffic_wait(DirectionRight));
+  flag.age(16 * Flag::traffic_half_life);
+  EXPECT_EQ(0u, flag.get_traffic_carried(DirectionRight));
+  EXPECT_EQ(0u, flag.get_traffic_queue());
+  EXPECT_FALSE(flag.is_congested(DirectionRight));
+
+  // Picking up halves what is kept.
+  flag.schedule(3, DirectionRight);
+  ASSERT_TRUE(flag.pick_up_resource(3, &res, &dest));
+  EXPECT_EQ(1u, flag.get_traffic_carried(DirectionRight));
+  EXPECT_EQ(Flag::traffic_half_life, flag.get_traffic_wait(DirectionRight));
+}
+
+// The slots are found by their masks: the lowest empty one for a drop, and
+// for a pickup the lowest of those headed the way with the highest priority.
+TEST(Flag, SlotMasks) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  TrafficFlag flag(game.get(), 1);
+
+  const Resource::Type types[] = {
+    Resource::TypePlank, Resource::TypeGoldOre, Resource::TypeStone,
+    Resource::TypeGoldBar, Resource::TypePlank, Resource::TypeGoldBar,
+    Resource::TypeFish, Resource::TypeCoal };
+  for (Resource::Type type : types) {
+    EXPECT_TRUE(flag.has_empty_slot());
+    ASSERT_TRUE(flag.drop_resource(type, 0));
+  }
+  EXPECT_FALSE(flag.has_empty_slot());
+  EXPECT_FALSE(flag.drop_resource(Resource::TypePlank, 0));
+
+  for (unsigned int i = 0; i < 6; i++) flag.schedule(i, DirectionRight);
+  flag.schedule(6, DirectionLeft);
+  flag.prioritize_pickup(DirectionRight, player);
+  ASSERT_TRUE(flag.is_scheduled(DirectionRight));
+  unsigned int best = 0;
+  for (unsigned int i = 1; i < 6; i++) {
+    if (player->get_flag_prio(types[i]) > player->get_flag_prio(types[best])) {
+      best = i;
+    }
+  }
+  EXPECT_EQ(best, flag.scheduled_slot(DirectionRight));
+  flag.prioritize_pickup(DirectionDown, player);
+  EXPECT_FALSE(flag.is_scheduled(DirectionDown));
+
+  Resource::Type res;
+  unsigned int dest;
+  ASSERT_TRUE(flag.pick_up_resource(best, &res, &dest));
+  EXPECT_EQ(types[best], res);
+  EXPECT_FALSE(flag.pick_up_resource(best, &res, &dest));
+  ASSERT_TRUE(flag.pick_up_resource(2, &res, &dest));
+  EXPECT_TRUE(flag.has_empty_slot());
+  ASSERT_TRUE(flag.drop_resource(Resource::TypeWheat, 0));
+  EXPECT_EQ(Resource::TypeWheat, flag.get_resource_at_slot(std::min(best, 2u)));
+
+  // Losing the path leaves nothing headed that way.
+  flag.invalidate_resource_path(DirectionRight);
+  flag.prioritize_pickup(DirectionRight, player);
+  EXPECT_FALSE(flag.is_scheduled(DirectionRight));
+  flag.prioritize_pickup(DirectionLeft, player);
+  ASSERT_TRUE(flag.is_scheduled(DirectionLeft));
+  EXPECT_EQ(6u, flag.scheduled_slot(DirectionLeft));
+}
@@ -0,0 +1,81 @@
+/*
+ * test_flow_field.cc - Flow field tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "src/flow-field.h"
+#include "src/game.h"
+#include "src/random.h"
+
+TEST(FlowField, StepsCloserFromEveryReachableTile) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  PMap map = game->get_map();
+  MapPos target = map->pos(20, 20);
+  FlowField field(map.get(), target);
+  EXPECT_EQ(0u, field.get_distance(map.get(), target));
+
+  unsigned int reached = 0;
+  for (MapPos pos : map->geom()) {
+    unsigned int steps = field.get_distance(map.get(), pos);
+    if (steps == FlowField::unreachable || pos == target) {
+      continue;
+    }
+    reached++;
+    ASSERT_TRUE(FlowField::can_pass(map.get(), pos));
+    ASSERT_LE(abs(map->dist_x(target, pos)), FlowField::radius);
+    ASSERT_LE(abs(map->dist_y(target, pos)), FlowField::radius);
+    // a neighbour one step closer, and none more than one step closer
+    bool closer = false;
+    for (Direction d : cycle_directions_cw()) {
+      unsigned int other = field.get_distance(map.get(), map->move(pos, d));
+      closer |= (other + 1 == steps);
+      ASSERT_TRUE(other == FlowField::unreachable || other + 1 >= steps);
+    }
+    ASSERT_TRUE(closer) << "at " << map->pos_col(pos) << ","
+                        << map->pos_row(pos);
+  }
+  EXPECT_GT(reached, 0u);
+}
+
+TEST(FlowField, SharedUntilTheMapChanges) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  PMap map = game->get_map();
+  MapPos target = map->pos(20, 20);
+  std::shared_ptr<const FlowField> first = game->get_flow_field(target);
+  EXPECT_EQ(first, game->get_flow_field(target));
+  EXPECT_NE(first, game->get_flow_field(map->pos(30, 30)));
+
+  map->set_object(map->move_right(target), Map::ObjectStone0, -1);
+  std::shared_ptr<const FlowField> changed = game->get_flow_field(target);
+  EXPECT_NE(first, changed);
+  EXPECT_EQ(FlowField::unreachable,
+            changed->get_distance(map.get(), map->move_right(target)));
+
+  FlowFields fields;
+  for (unsigned int i = 0; i < FlowFields::max_fields + 5; i++) {
+    fields.get(map.get(), map->pos(i % 60, i / 60));
+  }
+  EXPECT_EQ(FlowFields::max_fields, fields.size());
+}
@@ -0,0 +1,132 @@
+/*
+ * test_game_autosave.cc - Autosave tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/game.h"
+#include "src/random.h"
+#include "src/savegame.h"
+
+// The save written on the autosave thread is the game as it was at the end
+// of the update that took it, and the game can go on meanwhile.
+TEST(GameAutosave, SavesTheGameAtTheTick) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  ASSERT_TRUE(game->build_castle(game->get_map()->pos(6, 6),
+                                 game->get_player(0)));
+  for (int i = 0; i < 300; i++) game->update();
+
+  GameAutosave *autosave = game->get_autosave();
+  autosave->request("test_autosave_", GameStore::FormatCompact);
+  EXPECT_TRUE(autosave->is_requested());
+  game->update();
+  EXPECT_FALSE(autosave->is_requested());
+  std::stringstream expected;
+  GameStore::get_instance().write(&expected, game.get());
+  std::string path = "test_autosave_" + std::to_string(game->get_tick()) +
+                     ".save";
+  for (int i = 0; i < 100; i++) game->update();
+
+  autosave->wait();
+  EXPECT_EQ(1u, autosave->get_save_count());
+  GameAutosave::Timing timing = autosave->get_last_timing();
+  EXPECT_EQ(path, timing.path);
+  EXPECT_TRUE(timing.saved);
+  EXPECT_GE(timing.snapshot_ms, 0.);
+  EXPECT_GE(timing.write_ms, 0.);
+
+  std::unique_ptr<Game> loaded_game(new Game());
+  ASSERT_TRUE(GameStore::get_instance().load(path, loaded_game.get()));
+  std::remove(path.c_str());
+  std::stringstream loaded;
+  GameStore::get_instance().write(&loaded, loaded_game.get());
+  EXPECT_TRUE(expected.str() == loaded.str());
+}
+
+// Nothing is taken until an update, and a game that goes away writes the
+// save it has taken first.
+TEST(GameAutosave, WritesWhatWasTakenBeforeGoing) {
+  std::string path;
+  {
+    std::unique_ptr<Game> game(new Game());
+    game->init(3, Random("8667715887436237"));
+    game->get_autosave()->request("test_autosave_going_");
+    EXPECT_EQ(0u, game->get_autosave()->get_save_count());
+    game->update();
+    path = "test_autosave_going_" + std::to_string(game->get_tick()) +
+           ".save";
+  }
+
+  std::unique_ptr<Game> loaded_game(new Game());
+  EXPECT_TRUE(GameStore::get_instance().load(path, loaded_game.get()));
+  std::remove(path.c_str());
+}
+
+// Deltas only hold what changed, load into the same game as a full save
+// would, and every third save is full again.
+TEST(GameAutosave, DeltasLoadTheSameGame) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  ASSERT_TRUE(game->build_castle(game->get_map()->pos(6, 6),
+                                 game->get_player(0)));
+  GameAutosave *autosave = game->get_autosave();
+  autosave->set_full_every(3);
+
+  std::vector<std::string> paths;
+  std::vector<size_t> sizes;
+  for (int save = 0; save < 4; save++) {
+    for (int i = 0; i < 200; i++) game->update();
+    autosave->request("test_autosave_delta_");
+    game->update();
+    autosave->wait();
+    GameAutosave::Timing timing = autosave->get_last_timing();
+    EXPECT_TRUE(timing.saved);
+    EXPECT_EQ(save % 3 != 0, timing.delta) << "save " << save;
+    paths.push_back(timing.path);
+
+    std::ifstream file(timing.path, std::ios::binary | std::ios::ate);
+    sizes.push_back(static_cast<size_t>(file.tellg()));
+
+    std::stringstream expected;
+    GameStore::get_instance().write(&expected, game.get());
+    std::unique_ptr<Game> loaded_game(new Game());
+    ASSERT_TRUE(GameStore::get_instance().load(timing.path,
+                                               loaded_game.get()));
+    std::stringstream loaded;
+    GameStore::get_instance().write(&loaded, loaded_game.get());
+    EXPECT_TRUE(expected.str() == loaded.str()) << "save " << save;
+  }
+  EXPECT_LT(sizes[1], sizes[0] / 2);
+  EXPECT_LT(sizes[2], sizes[0] / 2);
+
+  for (const std::string &path : paths) {
+    std::remove(path.c_str());
+  }
+}
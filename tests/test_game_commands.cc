@@ -0,0 +1,144 @@
+/*
+ * test_game_commands.cc - Game command queue tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <memory>
+#include <vector>
+
+#include "src/game.h"
+#include "src/random.h"
+
+class GameCommandsTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<Game> game;
+  PMap map;
+  MapPos castle_flag_pos;
+
+  void SetUp() override {
+    game.reset(new Game());
+    game->init(3, Random("8667715887436237"));
+    game->add_player(35, 30, 40);
+    map = game->get_map();
+    ASSERT_TRUE(game->build_castle(map->pos(6, 6), game->get_player(0)));
+    castle_flag_pos = map->move_down_right(map->pos(6, 6));
+  }
+
+  static bool ready(const std::future<bool> &result) {
+    return result.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+};
+
+TEST_F(GameCommandsTest, AppliedAtNextUpdate) {
+  MapPos flag_pos = map->move_right_n(castle_flag_pos, 2);
+  GameCommands *commands = game->get_commands();
+
+  std::future<bool> flag = commands->build_flag(flag_pos, 0);
+  Road road;
+  road.start(castle_flag_pos);
+  road.extend(DirectionRight);
+  road.extend(DirectionRight);
+  std::future<bool> built = commands->build_road(road, 0);
+  // Building on the same spot again has to fail, after the first one.
+  std::future<bool> again = commands->build_flag(flag_pos, 0);
+
+  EXPECT_EQ(3u, commands->size());
+  EXPECT_FALSE(ready(flag));
+  EXPECT_FALSE(map->has_flag(flag_pos));
+
+  game->update();
+
+  EXPECT_EQ(0u, commands->size());
+  ASSERT_TRUE(ready(flag));
+  ASSERT_TRUE(ready(built));
+  ASSERT_TRUE(ready(again));
+  EXPECT_TRUE(flag.get());
+  EXPECT_TRUE(built.get());
+  EXPECT_FALSE(again.get());
+  EXPECT_TRUE(map->has_flag(flag_pos));
+  EXPECT_TRUE(map->has_path(castle_flag_pos, DirectionRight));
+
+  std::future<bool> demolished =
+             commands->demolish_road(map->move_right(castle_flag_pos), 0);
+  game->update();
+  EXPECT_TRUE(demolished.get());
+  EXPECT_FALSE(map->has_path(castle_flag_pos, DirectionRight));
+}
+
+TEST_F(GameCommandsTest, RecordedInOrder) {
+  typedef struct Entry {
+    unsigned int tick;
+    GameCommands::Type type;
+    bool result;
+  } Entry;
+  std::vector<Entry> log;
+  GameCommands *commands = game->get_commands();
+  commands->set_recorder([&log](unsigned int tick,
+                                const GameCommands::Command &command,
+                                bool result) {
+    log.push_back({tick, command.type, result}); });
+
+  MapPos flag_pos = map->move_right_n(castle_flag_pos, 3);
+  commands->build_flag(flag_pos, 0);
+  commands->demolish_flag(flag_pos, 0);
+  commands->demolish_flag(flag_pos, 0);
+  // Unknown players are rejected.
+  commands->build_flag(flag_pos, 3);
+  unsigned int tick = game->get_tick();
+  game->update();
+
+  ASSERT_EQ(4u, log.size());
+  EXPECT_EQ(GameCommands::TypeBuildFlag, log[0].type);
+  EXPECT_TRUE(log[0].result);
+  EXPECT_EQ(GameCommands::TypeDemolishFlag, log[1].type);
+  EXPECT_TRUE(log[1].result);
+  EXPECT_EQ(GameCommands::TypeDemolishFlag, log[2].type);
+  EXPECT_FALSE(log[2].result);
+  EXPECT_EQ(GameCommands::TypeBuildFlag, log[3].type);
+  EXPECT_FALSE(log[3].result);
+  for (const Entry &entry : log) {
+    EXPECT_EQ(tick, entry.tick);
+  }
+}
+
+TEST_F(GameCommandsTest, SendsGeologistsAndAttacks) {
+  MapPos flag_pos = map->move_right_n(castle_flag_pos, 2);
+  GameCommands *commands = game->get_commands();
+  std::future<bool> nowhere = commands->send_geologist(flag_pos, 0);
+  commands->build_flag(flag_pos, 0);
+  Road road;
+  road.start(castle_flag_pos);
+  road.extend(DirectionRight);
+  road.extend(DirectionRight);
+  commands->build_road(road, 0);
+  std::future<bool> sent = commands->send_geologist(flag_pos, 0);
+  // Only enemy buildings can be attacked.
+  std::future<bool> own = commands->attack(map->pos(6, 6), 5, 0);
+  std::future<bool> empty = commands->attack(map->pos(20, 20), 5, 0);
+  game->update();
+
+  EXPECT_FALSE(nowhere.get());
+  EXPECT_TRUE(sent.get());
+  EXPECT_FALSE(own.get());
+  EXPECT_FALSE(empty.get());
+}
@@ -0,0 +1,172 @@
+/*
+ * test_game_events.cc - Tests for the events of a game
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/game.h"
+#include "src/game-events.h"
+#include "src/random.h"
+
+TEST(GameEvents, ReadInOrder) {
+  GameEvents events(4);
+  events.publish(GameEvent::TypeObjectChanged, 1, 0, 2);
+  GameEvents::Reader reader = events.subscribe();
+  events.set_tick(7);
+  for (unsigned int i = 0; i < 10; i++) {
+    events.publish(GameEvent::TypeSerfChanged, 100 + i, 1, i, 3);
+  }
+
+  std::vector<GameEvent> read;
+  EXPECT_TRUE(events.read(&reader, [&read](const GameEvent &event) {
+    read.push_back(event);
+  }));
+  ASSERT_EQ(10u, read.size());
+  for (unsigned int i = 0; i < 10; i++) {
+    EXPECT_EQ(GameEvent::TypeSerfChanged, read[i].type);
+    EXPECT_EQ(7u, read[i].tick);
+    EXPECT_EQ(100 + i, read[i].pos);
+    EXPECT_EQ(1u, read[i].player);
+    EXPECT_EQ(i, read[i].index);
+    EXPECT_EQ(3u, read[i].data);
+  }
+
+  // Nothing new, nothing read.
+  read.clear();
+  EXPECT_TRUE(events.read(&reader, [&read](const GameEvent &event) {
+    read.push_back(event);
+  }));
+  EXPECT_TRUE(read.empty());
+}
+
+TEST(GameEvents, SlowReadersLoseTheOldest) {
+  GameEvents events(4);
+  GameEvents::Reader reader = events.subscribe();
+  for (unsigned int i = 0; i < 40; i++) {
+    events.publish(GameEvent::TypeRoadBuilt, i, 0, i);
+  }
+  std::vector<unsigned int> read;
+  EXPECT_FALSE(events.read(&reader, [&read](const GameEvent &event) {
+    read.push_back(event.index);
+  }));
+  ASSERT_EQ(events.get_capacity(), read.size());
+  EXPECT_EQ(40 - events.get_capacity(), read.front());
+  EXPECT_EQ(39u, read.back());
+  EXPECT_EQ(40u, reader.get_next());
+}
+
+TEST(GameEvents, ReadWhileWritten) {
+  GameEvents events(6);
+  const unsigned int count = 200000;
+  GameEvents::Reader reader = events.subscribe();
+  std::atomic<bool> done(false);
+  std::thread writer([&events, &done, count]() {
+    for (unsigned int i = 0; i < count; i++) {
+      events.publish(GameEvent::TypeObjectChanged, i, i, i, i);
+    }
+    done = true;
+  });
+
+  // Whatever is read is whole and in order, lost events or not.
+  unsigned int read = 0;
+  int64_t last = -1;
+  bool ok = true;
+  while (true) {
+    bool finished = done;
+    events.read(&reader, [&](const GameEvent &event) {
+      ok = ok && static_cast<int64_t>(event.index) > last &&
+           event.pos == event.index && event.player == event.index &&
+           event.data == event.index;
+      last = event.index;
+      read++;
+    });
+    if (finished) break;
+  }
+  writer.join();
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(count - 1, last);
+  EXPECT_LT(0u, read);
+}
+
+TEST(GameEvents, GameChanges) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  GameEvents::Reader reader = game->get_events()->subscribe();
+
+  MapPos castle = map->pos(6, 6);
+  ASSERT_TRUE(game->build_castle(castle, player));
+  bool founded = false;
+  unsigned int objects = 0;
+  unsigned int owned = 0;
+  EXPECT_TRUE(game->get_events()->read(&reader, [&](const GameEvent &event) {
+    if (event.type == GameEvent::TypeBuildingChanged &&
+        event.data == GameEvent::BuildingFounded) {
+      founded = true;
+      EXPECT_EQ(castle, event.pos);
+      EXPECT_EQ(0u, event.player);
+    } else if (event.type == GameEvent::TypeObjectChanged &&
+               event.pos == castle) {
+      EXPECT_EQ(Map::ObjectCastle, static_cast<Map::Object>(event.index));
+      objects++;
+    } else if (event.type == GameEvent::TypeOwnerChanged &&
+               event.index == 1) {
+      owned++;
+    }
+  }));
+  EXPECT_TRUE(founded);
+  EXPECT_EQ(1u, objects);
+  EXPECT_LT(0u, owned);
+
+  // A road from the castle flag to a new flag.
+  MapPos flag_pos = map->move_down_right(castle);
+  Road road;
+  road.start(flag_pos);
+  road.extend(DirectionRight);
+  road.extend(DirectionRight);
+  ASSERT_TRUE(game->build_flag(road.get_end(map.get()), player));
+  ASSERT_TRUE(game->build_road(road, player));
+  bool built = false;
+  game->get_events()->read(&reader, [&](const GameEvent &event) {
+    if (event.type == GameEvent::TypeRoadBuilt) {
+      built = true;
+      EXPECT_EQ(flag_pos, event.pos);
+      EXPECT_EQ(2u, event.data);
+    }
+  });
+  EXPECT_TRUE(built);
+
+  // Serfs setting off from the castle.
+  for (int i = 0; i < 500; i++) {
+    game->update();
+  }
+  unsigned int serfs = 0;
+  game->get_events()->read(&reader, [&](const GameEvent &event) {
+    if (event.type == GameEvent::TypeSerfChanged) serfs++;
+  });
+  EXPECT_LT(0u, serfs);
+}
@@ -0,0 +1,127 @@
+/*
+ * test_game_fork.cc - Tests for copying a running game
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+#include "src/game.h"
+#include "src/mission.h"
+#include "src/pathfinder.h"
+#include "src/savegame.h"
+
+class GameForkTest : public ::testing::Test {
+ protected:
+  PGame game;
+
+  static std::string save(PGame game) {
+    std::stringstream stream;
+    EXPECT_TRUE(GameStore::get_instance().write(&stream, game.get()));
+    return stream.str();
+  }
+
+  // A castle with a few huts on roads to it, run until the serfs are busy
+  // building them.
+  void SetUp() override {
+    PGameInfo game_info(new GameInfo(Random("8667715887436237")));
+    game_info->set_map_size(3);
+    game = game_info->instantiate();
+    ASSERT_TRUE(game);
+    Player *player = game->get_player(0);
+    PMap map = game->get_map();
+
+    MapPos castle_pos = bad_map_pos;
+    for (MapPos pos : map->geom()) {
+      if (game->can_build_castle(pos, player)) {
+        castle_pos = pos;
+        break;
+      }
+    }
+    ASSERT_NE(bad_map_pos, castle_pos);
+    ASSERT_TRUE(game->build_castle(castle_pos, player));
+
+    MapPos castle_flag = map->move_down_right(castle_pos);
+    unsigned int built = 0;
+    for (unsigned int off = 20; off <= 300 && built < 3; off++) {
+      MapPos pos = map->pos_add_extended_spirally(castle_pos, off);
+      if (!game->can_build_building(pos, Building::TypeLumberjack, player)) {
+        continue;
+      }
+      Road road = pathfinder_map(map.get(), map->move_down_right(pos),
+                                 castle_flag);
+      if (road.is_valid() &&
+          game->build_building(pos, Building::TypeLumberjack, player) &&
+          game->build_road(road, player)) {
+        built++;
+      }
+    }
+    ASSERT_GT(built, 0u);
+
+    for (int i = 0; i < 2000; i++) {
+      game->update();
+    }
+  }
+};
+
+TEST_F(GameForkTest, SavesTheSame) {
+  PGame fork = game->fork();
+  ASSERT_TRUE(fork);
+  EXPECT_EQ(game->get_tick(), fork->get_tick());
+  EXPECT_EQ(game->get_serf_count(), fork->get_serf_count());
+  EXPECT_EQ(game->get_building_count(), fork->get_building_count());
+  EXPECT_EQ(save(game), save(fork));
+}
+
+TEST_F(GameForkTest, PlaysOnTheSame) {
+  PGame fork = game->fork();
+  for (int i = 0; i < 2000; i++) {
+    game->update();
+    fork->update();
+  }
+  EXPECT_EQ(game->get_tick(), fork->get_tick());
+  EXPECT_EQ(save(game), save(fork));
+}
+
+TEST_F(GameForkTest, LeavesTheGameAlone) {
+  std::string before = save(game);
+  PGame fork = game->fork();
+  Player *player = fork->get_player(0);
+  for (Building *building : fork->get_player_buildings(player)) {
+    if (building->get_type() == Building::TypeLumberjack) {
+      ASSERT_TRUE(fork->demolish_building(building->get_position(), player));
+      break;
+    }
+  }
+  for (int i = 0; i < 500; i++) {
+    fork->update();
+  }
+  EXPECT_NE(before, save(fork));
+  EXPECT_EQ(before, save(game));
+
+  // The game plays on once the fork is gone.
+  fork.reset();
+  for (int i = 0; i < 500; i++) {
+    game->update();
+  }
+  EXPECT_NE(before, save(game));
+}
@@ -0,0 +1,55 @@
+/*
+ * test_game_host.cc - Tests for games hosted side by side
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/game-host.h"
+#include "src/random.h"
+
+TEST(GameHost, GamesSideBySide) {
+  const unsigned int count = 3;
+  std::vector<GameResult> results(count);
+  std::vector<bool> played(count, false);
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < count; i++) {
+    threads.push_back(std::thread([i, &results, &played]() {
+      GameHost::Setup setup;
+      setup.seed = std::string(Random(static_cast<uint16_t>(i + 1)));
+      setup.ticks = 300;
+      played[i] = GameHost::play(setup, &results[i]);
+    }));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    ASSERT_TRUE(played[i]) << "game " << i;
+    EXPECT_EQ(std::string(Random(static_cast<uint16_t>(i + 1))),
+              results[i].seed);
+    EXPECT_EQ(300u, results[i].ticks);
+    EXPECT_GT(results[i].game_tick, 0u);
+  }
+  EXPECT_NE(results[0].seed, results[1].seed);
+}
@@ -0,0 +1,164 @@
+/*
+ * test_game_replay.cc - Tests for recording and replaying games
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "src/game-replay.h"
+#include "src/game.h"
+
+class GameReplayTest : public ::testing::Test {
+ protected:
+  GameReplay recorded;
+  MapPos castle_pos;
+
+  static MapPos find_castle_pos(PGame game, unsigned int player) {
+    PMap map = game->get_map();
+    for (MapPos pos = 0; pos < map->get_cols() * map->get_rows(); pos++) {
+      if (game->can_build_castle(pos, game->get_player(player))) {
+        return pos;
+      }
+    }
+    return bad_map_pos;
+  }
+
+  // A game where the first player builds a castle straight on the game and
+  // queues a flag and a road from it, run for 500 updates.
+  void SetUp() override {
+    PGameInfo game_info(new GameInfo(Random("8667715887436237")));
+    game_info->set_map_size(3);
+    recorded.set_setup(*game_info);
+    PGame game = game_info->instantiate();
+    ASSERT_TRUE(game);
+    recorded.start_recording(game.get(), 50);
+
+    castle_pos = find_castle_pos(game, 0);
+    ASSERT_NE(bad_map_pos, castle_pos);
+    ASSERT_TRUE(game->build_castle(castle_pos, game->get_player(0)));
+    game->update();
+
+    PMap map = game->get_map();
+    MapPos castle_flag_pos = map->move_down_right(castle_pos);
+    game->get_commands()->build_flag(map->move_right_n(castle_flag_pos, 2),
+                                     0);
+    Road road;
+    road.start(castle_flag_pos);
+    road.extend(DirectionRight);
+    road.extend(DirectionRight);
+    game->get_commands()->build_road(road, 0);
+    for (int i = 0; i < 499; i++) {
+      game->update();
+    }
+    recorded.stop_recording(game.get());
+  }
+
+  void write_and_read(GameReplay *replay) {
+    std::stringstream stream;
+    EXPECT_TRUE(recorded.write(&stream));
+    EXPECT_TRUE(replay->read(&stream));
+  }
+};
+
+TEST_F(GameReplayTest, RecordsCommandsAndHashes) {
+  const std::vector<GameReplay::Entry> &entries = recorded.get_entries();
+  size_t commands = 0;
+  size_t hashes = 0;
+  for (const GameReplay::Entry &entry : entries) {
+    if (entry.type == GameReplay::EntryCommand) {
+      commands++;
+    } else {
+      hashes++;
+    }
+  }
+  EXPECT_EQ(3u, commands);
+  EXPECT_EQ(10u, hashes);
+  EXPECT_EQ(GameCommands::TypeBuildCastle, entries[0].command.type);
+  EXPECT_EQ(castle_pos, entries[0].command.pos);
+  EXPECT_TRUE(entries[0].result);
+}
+
+TEST_F(GameReplayTest, WritesAndReadsBack) {
+  GameReplay replay;
+  write_and_read(&replay);
+  EXPECT_EQ(recorded.get_seed(), replay.get_seed());
+  EXPECT_EQ(50u, replay.get_hash_interval());
+  ASSERT_EQ(recorded.get_entries().size(), replay.get_entries().size());
+  for (size_t i = 0; i < replay.get_entries().size(); i++) {
+    const GameReplay::Entry &a = recorded.get_entries()[i];
+    const GameReplay::Entry &b = replay.get_entries()[i];
+    EXPECT_EQ(a.type, b.type);
+    EXPECT_EQ(a.tick, b.tick);
+    EXPECT_EQ(a.hash, b.hash);
+    EXPECT_EQ(a.command.type, b.command.type);
+    EXPECT_EQ(a.command.pos, b.command.pos);
+    EXPECT_EQ(a.command.road.get_length(), b.command.road.get_length());
+  }
+
+  std::stringstream garbage("FSERFRP0");
+  EXPECT_FALSE(replay.read(&garbage));
+}
+
+TEST_F(GameReplayTest, ReplaysTheSame) {
+  GameReplay replay;
+  write_and_read(&replay);
+  PGame game = replay.make_game_info()->instantiate();
+  GameReplay::Result result = replay.replay(game.get());
+  EXPECT_FALSE(result.diverged);
+  EXPECT_EQ(10u, result.hashes_checked);
+  EXPECT_EQ(3u, result.commands);
+  EXPECT_EQ(0u, result.results_differ);
+}
+
+TEST_F(GameReplayTest, FindsTheFirstDivergence) {
+  GameReplay replay;
+  write_and_read(&replay);
+  PGame game = replay.make_game_info()->instantiate();
+  // A castle of a second player the log doesn't know about, where the
+  // first one had its castle
+  MapPos pos = find_castle_pos(game, 1);
+  ASSERT_NE(bad_map_pos, pos);
+  ASSERT_TRUE(game->build_castle(pos, game->get_player(1)));
+  GameReplay::Result result = replay.replay(game.get());
+  EXPECT_TRUE(result.diverged);
+  EXPECT_EQ(1u, result.hashes_checked);
+  EXPECT_EQ(replay.get_entries()[1].tick, result.tick);
+  EXPECT_NE(result.expected, result.hash);
+}
+
+// The hash is of the serf counts of each type and not of what is kept next
+// to them, such as the idle serfs the AIs read.
+TEST(GameReplay, HashesTheSerfCounts) {
+  PGameInfo game_info(new GameInfo(Random("8667715887436237")));
+  game_info->set_map_size(3);
+  PGame game = game_info->instantiate();
+  ASSERT_TRUE(game);
+  Player *player = game->get_player(0);
+  uint64_t hash = GameReplay::hash_state(game.get());
+
+  player->count_idle_serf(Serf::TypeTransporter, 1);
+  player->count_idle_serf(Serf::TypeDead, 1);
+  EXPECT_EQ(hash, GameReplay::hash_state(game.get()));
+
+  player->increase_serf_count(Serf::TypeKnight4);
+  EXPECT_NE(hash, GameReplay::hash_state(game.get()));
+}
@@ -0,0 +1,80 @@
+/*
+ * test_game_result.cc - Headless game result tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+
+#include "src/game.h"
+#include "src/game-result.h"
+#include "src/random.h"
+
+TEST(GameResult, SamplesOncePerStatsUpdate) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(12, 64, 40);
+  game->add_player(13, 64, 40);
+
+  GameResult result;
+  for (int tick = 0; tick < 1000; tick++) {
+    game->update();
+    result.update(game.get());
+  }
+  // The stats are updated every 1500 game ticks, two per update.
+  ASSERT_EQ(4u, result.samples.size());
+  EXPECT_EQ(0u, result.samples[0].player);
+  EXPECT_EQ(1u, result.samples[1].player);
+  EXPECT_EQ(result.samples[0].tick, result.samples[1].tick);
+  EXPECT_LT(result.samples[1].tick, result.samples[2].tick);
+}
+
+TEST(GameResult, ReadsWhatItWrites) {
+  GameResult result;
+  result.seed = "8667715887436237";
+  result.map_size = 4;
+  result.options = "101";
+  result.ticks = 20000;
+  result.game_tick = 40000;
+  result.seconds = 12.5;
+  result.winner = 1;
+  result.samples.push_back({ 1500, 0, { 40, 45, 35, 50 } });
+  result.samples.push_back({ 1500, 1, { 60, 55, 65, 50 } });
+
+  std::stringstream stream;
+  ASSERT_TRUE(result.write(&stream));
+  GameResult copy;
+  ASSERT_TRUE(copy.read(&stream));
+  EXPECT_EQ(result.seed, copy.seed);
+  EXPECT_EQ(result.map_size, copy.map_size);
+  EXPECT_EQ(result.options, copy.options);
+  EXPECT_EQ(result.ticks, copy.ticks);
+  EXPECT_EQ(result.game_tick, copy.game_tick);
+  EXPECT_DOUBLE_EQ(result.seconds, copy.seconds);
+  EXPECT_EQ(result.winner, copy.winner);
+  ASSERT_EQ(2u, copy.samples.size());
+  EXPECT_EQ(1u, copy.samples[1].player);
+  EXPECT_EQ(65, copy.samples[1].values[GameResult::AspectBuildings]);
+  EXPECT_DOUBLE_EQ(1600., copy.get_ticks_per_second());
+
+  std::stringstream truncated("game 8667715887436237 4\n");
+  EXPECT_FALSE(copy.read(&truncated));
+}
@@ -0,0 +1,175 @@
+/*
+ * test_game_snapshot.cc - Game snapshot tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "src/game.h"
+#include "src/game-snapshot.h"
+#include "src/random.h"
+
+TEST(GameSnapshot, MatchesGame) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  ASSERT_NE(nullptr, snapshot);
+  const GameSnapshot::PlayerView &view = snapshot->get_player(0);
+
+  ASSERT_EQ(1u, view.buildings.size());
+  EXPECT_EQ(Building::TypeCastle, view.buildings[0].type);
+  EXPECT_EQ(map->pos(6, 6), view.buildings[0].pos);
+  ASSERT_EQ(1u, view.flags.size());
+  EXPECT_EQ(map->move_down_right(map->pos(6, 6)), view.flags[0].pos);
+  EXPECT_TRUE(view.flags[0].has_building);
+  EXPECT_EQ(view.buildings[0].index, view.flags[0].building_index);
+  size_t serfs = 0;
+  for (Serf *serf : game->get_player_serfs(player)) {
+    if (serf->get_index() != 0) serfs++;
+  }
+  EXPECT_EQ(serfs, view.serfs.size());
+  ASSERT_EQ(1u, view.inventories.size());
+  EXPECT_EQ(view.buildings[0].index, view.inventories[0].building_index);
+
+  for (MapPos pos : map->geom()) {
+    ASSERT_EQ(map->has_owner(pos), snapshot->has_owner(pos));
+    if (map->has_owner(pos)) {
+      ASSERT_EQ(map->get_owner(pos), snapshot->get_owner(pos));
+    }
+    ASSERT_EQ(map->get_obj(pos), snapshot->get_obj(pos));
+  }
+}
+
+TEST(GameSnapshot, PublishedEachTick) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+
+  // Nothing is published until somebody asks for a snapshot.
+  game->update();
+  std::shared_ptr<const GameSnapshot> first = game->get_snapshot();
+  EXPECT_EQ(0u, first->get_version());
+
+  uint64_t version = 0;
+  for (int i = 0; i < 200; i++) {
+    game->update();
+    std::shared_ptr<const GameSnapshot> current = game->get_snapshot();
+    EXPECT_GT(current->get_version(), version);
+    EXPECT_EQ(game->get_tick(), current->get_tick());
+    version = current->get_version();
+  }
+
+  // A snapshot that is still held is never written to again.
+  std::shared_ptr<const GameSnapshot> held = game->get_snapshot();
+  unsigned int tick = held->get_tick();
+  size_t serfs = held->get_player(0).serfs.size();
+  for (int i = 0; i < 50; i++) {
+    game->update();
+  }
+  EXPECT_EQ(version, held->get_version());
+  EXPECT_EQ(tick, held->get_tick());
+  EXPECT_EQ(serfs, held->get_player(0).serfs.size());
+  EXPECT_NE(held, game->get_snapshot());
+}
+
+TEST(GameSnapshot, SeesChangesBetweenTicks) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+  game->get_snapshot();
+  game->update();
+  ASSERT_EQ(1u, game->get_snapshot()->get_player(0).flags.size());
+
+  MapPos flag_pos = map->pos(9, 6);
+  ASSERT_TRUE(game->build_flag(flag_pos, player));
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  ASSERT_EQ(2u, snapshot->get_player(0).flags.size());
+  EXPECT_EQ(Map::ObjectFlag, snapshot->get_obj(flag_pos));
+}
+
+TEST(GameSnapshot, NearestBuildingsMatchSpiral) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  MapPos castle_pos = map->pos(6, 6);
+  ASSERT_TRUE(game->build_castle(castle_pos, player));
+  for (int i = 40; i < 400; i += 7) {
+    MapPos pos = map->pos_add_extended_spirally(castle_pos, i);
+    if (game->can_build_building(pos, Building::TypeLumberjack, player)) {
+      game->build_building(pos, Building::TypeLumberjack, player);
+    }
+  }
+
+  std::shared_ptr<const GameSnapshot> snapshot = game->get_snapshot();
+  const GameSnapshot::BuildingView *found[64];
+  for (int radius = 0; radius <= 10; radius++) {
+    // The first 1 + 3r(r + 1) positions of the spiral are those within r.
+    std::vector<MapPos> expected;
+    for (int i = 0; i < 1 + 3 * radius * (radius + 1); i++) {
+      MapPos pos = map->pos_add_extended_spirally(castle_pos, i);
+      EXPECT_LE(snapshot->tile_dist(castle_pos, pos), radius);
+      Building *building = game->get_building_at_pos(pos);
+      if (map->has_building(pos) &&
+          building->get_type() == Building::TypeLumberjack) {
+        expected.push_back(pos);
+      }
+    }
+    size_t count = snapshot->nearest_buildings(0, Building::TypeLumberjack,
+                                               castle_pos, radius, found, 64);
+    ASSERT_EQ(expected.size(), count);
+    for (size_t i = 0; i < count; i++) {
+      EXPECT_NE(expected.end(), std::find(expected.begin(), expected.end(),
+                                          found[i]->pos));
+      if (i > 0) {
+        EXPECT_LE(snapshot->tile_dist(castle_pos, found[i - 1]->pos),
+                  snapshot->tile_dist(castle_pos, found[i]->pos));
+      }
+    }
+    if (count > 0) {
+      EXPECT_EQ(found[0], snapshot->nearest_building(0,
+                  Building::TypeLumberjack, castle_pos, radius,
+                  [](const GameSnapshot::BuildingView &) { return true; }));
+    }
+  }
+
+  size_t all = snapshot->nearest_buildings(0, Building::TypeLumberjack,
+                                           castle_pos, 10, found, 64);
+  ASSERT_GT(all, 2u);
+  EXPECT_EQ(2u, snapshot->nearest_buildings(0, Building::TypeLumberjack,
+                                            castle_pos, 10, found, 2));
+  EXPECT_EQ(0u, snapshot->nearest_buildings(0, Building::TypeFarm,
+                                            castle_pos, 10, found, 64));
+}
@@ -0,0 +1,211 @@
+/*
+ * test_game_watchdog.cc - Waiting serf and unserved road tracking tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "src/game.h"
+#include "src/random.h"
+#include "src/savegame.h"
+
+namespace {
+
+// Compare the watchdog with what the serfs and flags say now.
+void
+expect_watchdog_current(Game *game) {
+  std::set<unsigned int> waiting;
+  for (const GameWatchdog::WaitingSerf &entry :
+       game->get_watchdog()->get_waiting_serfs()) {
+    EXPECT_TRUE(waiting.insert(entry.serf).second);
+    EXPECT_LE(entry.since, game->get_tick());
+  }
+  std::set<std::pair<unsigned int, int>> unserved;
+  for (const GameWatchdog::UnservedPath &entry :
+       game->get_watchdog()->get_unserved_paths()) {
+    EXPECT_TRUE(unserved.insert(std::make_pair(entry.flag, entry.dir)).second);
+  }
+
+  for (unsigned int i = 1; i < 5000; i++) {
+    Serf *serf = game->get_serf(i);
+    if (serf == nullptr) continue;
+    EXPECT_EQ(serf->get_state() == Serf::StateWaitIdleOnPath,
+              waiting.count(i) == 1) << "serf " << i;
+  }
+  for (unsigned int i = 1; i < 5000; i++) {
+    Flag *flag = game->get_flag(i);
+    if (flag == nullptr) continue;
+    for (Direction d : cycle_directions_cw()) {
+      EXPECT_EQ(flag->has_path(d) && !flag->has_transporter(d),
+                unserved.count(std::make_pair(i, static_cast<int>(d))) == 1)
+        << "flag " << i << " dir " << d;
+    }
+  }
+}
+
+void
+put16(std::vector<uint8_t> *data, size_t offset, uint16_t value) {
+  std::memcpy(&(*data)[offset], &value, sizeof(value));
+}
+
+void
+put32(std::vector<uint8_t> *data, size_t offset, uint32_t value) {
+  std::memcpy(&(*data)[offset], &value, sizeof(value));
+}
+
+// An original save of a map of size 3 with no players, and flags 1 and 2
+// at 10,10 and 12,10 joined by a road that has no transporter yet.
+std::vector<uint8_t>
+make_binary_save() {
+  const size_t header = 250;
+  const size_t player_size = 8628;
+  MapGeometry geom(3);
+  const size_t map_offset = header + 4 * player_size;
+  const size_t flags_offset = map_offset + 8 * geom.tile_count();
+  const size_t flag_size = 70;
+  std::vector<uint8_t> data(flags_offset + 4 + 3 * flag_size + 3 * 4, 0);
+
+  put16(&data, 90, 3);   // max flag index
+  put16(&data, 190, 3);  // map size
+
+  for (unsigned int y = 0; y < geom.rows(); y++) {
+    size_t row = map_offset + 8 * y * geom.cols();
+    for (unsigned int x = 0; x < geom.cols(); x++) {
+      uint8_t *tile = &data[row + 4 * x];
+      tile[2] = (Map::TerrainGrass1 << 4) | Map::TerrainGrass1;
+      if (y != 10 || x < 10 || x > 12) continue;
+      tile[0] = ((x < 12) ? (1 << DirectionRight) : 0) |
+                ((x > 10) ? (1 << DirectionLeft) : 0);
+      if (x != 11) {
+        tile[3] = Map::ObjectFlag;
+        put16(&data, row + 4 * geom.cols() + 4 * x, (x == 10) ? 1 : 2);
+      }
+    }
+  }
+
+  data[flags_offset] = 0x60;  // flags 1 and 2
+  uint8_t *flags = &data[flags_offset + 4];
+  struct { unsigned int index; Direction dir; Direction other_dir; } ends[] = {
+    { 1, DirectionRight, DirectionLeft },
+    { 2, DirectionLeft, DirectionRight },
+  };
+  for (const auto &end : ends) {
+    uint8_t *flag = flags + flag_size * end.index;
+    flag[3] = 1 << end.dir;
+    flag[6 + end.dir] = 2;
+    unsigned int other = 3 - end.index;
+    put32(&data, (flag - data.data()) + 36 + 4 * end.dir,
+          static_cast<uint32_t>(flag_size * other));
+    flag[60 + end.dir] = end.other_dir;
+  }
+  return data;
+}
+
+}  // namespace
+
+TEST(GameWatchdog, RemovesByMovingTheLastEntry) {
+  GameWatchdog watchdog;
+  watchdog.serf_waiting(3, 10);
+  watchdog.serf_waiting(7, 20);
+  watchdog.serf_waiting(3, 30);  // Still waiting since 10
+  watchdog.serf_waiting(5, 40);
+  watchdog.serf_moving(3);
+  watchdog.serf_moving(9);  // Never waited
+  ASSERT_EQ(2u, watchdog.get_waiting_serfs().size());
+  EXPECT_EQ(5u, watchdog.get_waiting_serfs()[0].serf);
+  EXPECT_EQ(7u, watchdog.get_waiting_serfs()[1].serf);
+  watchdog.serf_moving(5);
+  watchdog.serf_waiting(3, 50);
+  ASSERT_EQ(2u, watchdog.get_waiting_serfs().size());
+  EXPECT_EQ(3u, watchdog.get_waiting_serfs()[1].serf);
+  EXPECT_EQ(50u, watchdog.get_waiting_serfs()[1].since);
+
+  watchdog.path_unserved(4, DirectionDown, 100);
+  watchdog.path_unserved(4, DirectionDown, 200);
+  ASSERT_EQ(1u, watchdog.get_unserved_paths().size());
+  EXPECT_EQ(100u, watchdog.get_unserved_paths()[0].since);
+  watchdog.transporter_called(4, DirectionDown, 300);
+  EXPECT_EQ(300u, watchdog.get_unserved_paths()[0].since);
+  watchdog.path_served(4, DirectionDown);
+  EXPECT_TRUE(watchdog.get_unserved_paths().empty());
+}
+
+TEST(GameWatchdog, FollowsTheGame) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  MapPos castle_flag_pos = map->move_down_right(map->pos(6, 6));
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+
+  // A few roads out of the castle flag, so transporters are called and
+  // resources wait to be carried.
+  MapPos flag_pos = map->move_right_n(castle_flag_pos, 2);
+  ASSERT_TRUE(game->build_flag(flag_pos, player));
+  Road road;
+  road.start(castle_flag_pos);
+  road.extend(DirectionRight);
+  road.extend(DirectionRight);
+  ASSERT_TRUE(game->build_road(road, player));
+  MapPos down_pos = map->move_down(map->move_down(castle_flag_pos));
+  ASSERT_TRUE(game->build_flag(down_pos, player));
+  Road down;
+  down.start(castle_flag_pos);
+  down.extend(DirectionDown);
+  down.extend(DirectionDown);
+  ASSERT_TRUE(game->build_road(down, player));
+  expect_watchdog_current(game.get());
+  EXPECT_FALSE(game->get_watchdog()->get_unserved_paths().empty());
+
+  for (int tick = 0; tick < 2000; tick++) {
+    game->update();
+  }
+  expect_watchdog_current(game.get());
+
+  EXPECT_TRUE(game->demolish_road(map->move_right(castle_flag_pos), player));
+  expect_watchdog_current(game.get());
+  EXPECT_TRUE(game->demolish_flag(flag_pos, player));
+  expect_watchdog_current(game.get());
+  EXPECT_TRUE(game->demolish_road(map->move_down(castle_flag_pos), player));
+  expect_watchdog_current(game.get());
+  for (int tick = 0; tick < 500; tick++) {
+    game->update();
+  }
+  expect_watchdog_current(game.get());
+}
+
+// An original save keeps no watchdog, so it is worked out once the flags
+// are in.
+TEST(GameWatchdog, RebuiltForAnOriginalSave) {
+  std::vector<uint8_t> data = make_binary_save();
+  std::unique_ptr<Game> game(new Game());
+  SaveReaderBinary reader(data.data(), data.size());
+  reader >> *game;
+  ASSERT_NE(nullptr, game->get_flag(1));
+  ASSERT_TRUE(game->get_flag(1)->has_path(DirectionRight));
+  EXPECT_EQ(2u, game->get_watchdog()->get_unserved_paths().size());
+  expect_watchdog_current(game.get());
+}
@@ -0,0 +1,125 @@
+/*
+ * test_image_cache.cc - Tests for the cache of decoded images
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "src/data-source.h"
+#include "src/gfx.h"
+#include "src/video.h"
+
+namespace {
+
+// 8 x 8 pixels, 256 bytes decoded
+const size_t image_bytes = 4 * 8 * 8;
+
+Image *
+make_image(unsigned int size = 8) {
+  return new Image(&Video::get_instance(),
+                   std::make_shared<SpriteBase>(size, size));
+}
+
+// a cache of three images, empty before and after each test.  The counts
+//  go on from test to test, so they are compared with those at the start
+class ImageCache : public ::testing::Test {
+ protected:
+  Image::CacheStats start;
+
+  void SetUp() override {
+    Image::clear_cache();
+    Image::set_cache_budget(3 * image_bytes);
+    start = Image::get_cache_stats();
+  }
+  void TearDown() override {
+    Image::clear_cache();
+    Image::set_cache_budget(Image::default_cache_budget);
+  }
+};
+
+}  // namespace
+
+TEST_F(ImageCache, EvictsTheLeastRecentlyDrawn) {
+  Image *first = make_image();
+  Image::cache_image(1, first);
+  Image::cache_image(2, make_image());
+  Image::cache_image(3, make_image());
+  Image::CacheStats stats = Image::get_cache_stats();
+  EXPECT_EQ(3u, stats.images);
+  EXPECT_EQ(start.evictions, stats.evictions);
+
+  // drawing 1 again leaves 2 the oldest
+  EXPECT_EQ(first, Image::get_cached_image(1));
+  Image::cache_image(4, make_image());
+  EXPECT_EQ(nullptr, Image::get_cached_image(2));
+  EXPECT_EQ(first, Image::get_cached_image(1));
+  EXPECT_NE(nullptr, Image::get_cached_image(3));
+  EXPECT_NE(nullptr, Image::get_cached_image(4));
+
+  // 3 and 4 were drawn after 1 now
+  Image::cache_image(5, make_image());
+  EXPECT_EQ(nullptr, Image::get_cached_image(1));
+  EXPECT_NE(nullptr, Image::get_cached_image(3));
+
+  stats = Image::get_cache_stats();
+  EXPECT_EQ(2u, stats.evictions - start.evictions);
+  EXPECT_EQ(2u, stats.misses - start.misses);
+}
+
+TEST_F(ImageCache, StaysWithinTheBudget) {
+  for (uint64_t id = 0; id < 20; id++) {
+    Image::cache_image(id, make_image());
+    Image::CacheStats stats = Image::get_cache_stats();
+    EXPECT_GE(stats.budget, stats.bytes);
+    EXPECT_GE(3u, stats.images);
+  }
+  Image::CacheStats stats = Image::get_cache_stats();
+  EXPECT_EQ(3 * image_bytes, stats.bytes);
+  EXPECT_EQ(17u, stats.evictions - start.evictions);
+  for (uint64_t id = 17; id < 20; id++) {
+    EXPECT_NE(nullptr, Image::get_cached_image(id));
+  }
+
+  // a lower budget evicts down to it at once
+  Image::set_cache_budget(image_bytes);
+  stats = Image::get_cache_stats();
+  EXPECT_EQ(1u, stats.images);
+  EXPECT_EQ(image_bytes, stats.bytes);
+  EXPECT_NE(nullptr, Image::get_cached_image(19));
+}
+
+TEST_F(ImageCache, KeepsTheImageJustAdded) {
+  Image::cache_image(1, make_image());
+  // more than the whole budget, but about to be drawn
+  Image *large = make_image(16);
+  Image::cache_image(2, large);
+  Image::CacheStats stats = Image::get_cache_stats();
+  EXPECT_EQ(1u, stats.images);
+  EXPECT_EQ(4 * image_bytes, stats.bytes);
+  EXPECT_EQ(large, Image::get_cached_image(2));
+  EXPECT_EQ(nullptr, Image::get_cached_image(1));
+
+  // caching an id again replaces the image
+  Image *replaced = make_image();
+  Image::cache_image(2, replaced);
+  EXPECT_EQ(replaced, Image::get_cached_image(2));
+  EXPECT_EQ(image_bytes, Image::get_cache_stats().bytes);
+}
@@ -0,0 +1,101 @@
+/*
+ * test_land_ownership.cc - Land ownership tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "src/game.h"
+#include "src/random.h"
+
+namespace {
+
+std::vector<int>
+get_owners(PMap map) {
+  std::vector<int> owners;
+  for (MapPos pos : map->geom()) {
+    owners.push_back(map->has_owner(pos) ? map->get_owner(pos) : -1);
+  }
+  return owners;
+}
+
+// Found castles for two players whose land meets, returns the second
+// castle's position.
+MapPos
+build_castles(Game *game) {
+  PMap map = game->get_map();
+  EXPECT_TRUE(game->build_castle(map->pos(6, 6), game->get_player(0)));
+  for (int col = 18; col < 24; col++) {
+    for (int row = 2; row < 12; row++) {
+      if (game->build_castle(map->pos(col, row), game->get_player(1))) {
+        return map->pos(col, row);
+      }
+    }
+  }
+  ADD_FAILURE() << "no place for the second castle";
+  return 0;
+}
+
+}  // namespace
+
+TEST(LandOwnership, CastlesClaimLand) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  game->add_player(35, 30, 40);
+  PMap map = game->get_map();
+  MapPos castle_pos = build_castles(game.get());
+
+  // The tiles next to each castle are claimed outright by its owner.
+  EXPECT_EQ(0u, map->get_owner(map->pos(6, 6)));
+  EXPECT_EQ(0u, map->get_owner(map->move_down_right(map->pos(6, 6))));
+  EXPECT_EQ(1u, map->get_owner(castle_pos));
+  EXPECT_EQ(1u, map->get_owner(map->move_left(castle_pos)));
+
+  // Land area counters follow the tiles that actually changed owner.
+  int land[2] = { 0, 0 };
+  for (int owner : get_owners(map)) {
+    if (owner >= 0) land[owner]++;
+  }
+  EXPECT_EQ(land[0], game->get_player(0)->get_land_area());
+  EXPECT_EQ(land[1], game->get_player(1)->get_land_area());
+}
+
+TEST(LandOwnership, RecalculationKeepsOwners) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  game->add_player(35, 30, 40);
+  PMap map = game->get_map();
+  build_castles(game.get());
+  std::vector<int> owners = get_owners(map);
+  int land_0 = game->get_player(0)->get_land_area();
+  int land_1 = game->get_player(1)->get_land_area();
+
+  // Nothing changed, so updating again must not move the border, and
+  // influence already applied must not be counted twice.
+  game->init_land_ownership();
+  game->update_land_ownership(map->pos(13, 6));
+  EXPECT_EQ(owners, get_owners(map));
+  EXPECT_EQ(land_0, game->get_player(0)->get_land_area());
+  EXPECT_EQ(land_1, game->get_player(1)->get_land_area());
+}
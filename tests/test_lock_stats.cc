@@ -0,0 +1,100 @@
+/*
+ * test_lock_stats.cc - Lock contention statistics tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <string>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/game.h"
+#include "src/lock-stats.h"
+
+static const LockStats::Stats *
+find_site(const std::vector<LockStats::Stats> &stats, const char *function) {
+  for (const LockStats::Stats &site : stats) {
+    if (site.function == function) {
+      return &site;
+    }
+  }
+  return nullptr;
+}
+
+static void
+hold_mutex(LockStats::Mutex *mutex) {
+  for (int i = 0; i < 50; i++) {
+    LOCK_SCOPE(*mutex);
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+TEST(LockStats, CountsWaitsAndHoldsPerSite) {
+  LockStats::reset();
+  LockStats::set_enabled(true);
+  LockStats::Mutex mutex;
+  std::thread other(hold_mutex, &mutex);
+  hold_mutex(&mutex);
+  other.join();
+  LockStats::set_enabled(false);
+
+  std::vector<LockStats::Stats> stats = LockStats::get_stats();
+  const LockStats::Stats *site = find_site(stats, "hold_mutex");
+  ASSERT_NE(nullptr, site);
+  EXPECT_EQ("test_lock_stats.cc", site->file);
+  EXPECT_EQ(100u, site->count);
+  EXPECT_GE(site->hold_total_ns, 100u * 100000u);
+  EXPECT_GE(site->hold_max_ns, 100000u);
+  EXPECT_LE(site->wait_max_ns, site->wait_total_ns);
+  EXPECT_LE(site->contended, site->count);
+}
+
+static void
+take_game_lock(GameLock *lock) {
+  lock->lock(LOCK_SITE());
+  lock->unlock();
+  lock->lock_shared(LOCK_SITE());
+  lock->unlock_shared();
+}
+
+TEST(LockStats, GameLockSitesOnlyWhenEnabled) {
+  GameLock lock;
+  LockStats::reset();
+  take_game_lock(&lock);
+  EXPECT_EQ(nullptr, find_site(LockStats::get_stats(), "take_game_lock"));
+
+  LockStats::set_enabled(true);
+  take_game_lock(&lock);
+  take_game_lock(&lock);
+  LockStats::set_enabled(false);
+
+  // the exclusive and the shared site
+  unsigned int sites = 0;
+  for (const LockStats::Stats &site : LockStats::get_stats()) {
+    if (site.function == "take_game_lock") {
+      EXPECT_EQ(2u, site.count);
+      EXPECT_EQ(0u, site.contended);
+      sites++;
+    }
+  }
+  EXPECT_EQ(2u, sites);
+  EXPECT_FALSE(GameLock::held_by_this_thread());
+}
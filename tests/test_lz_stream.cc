@@ -0,0 +1,141 @@
+/*
+ * test_lz_stream.cc - Save game compression tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "src/debug.h"
+#include "src/lz-stream.h"
+
+// like a save game, many lines that are nearly the same
+static std::string
+text_data(std::mt19937 *random, size_t lines) {
+  std::ostringstream text;
+  for (size_t line = 0; line < lines; line++) {
+    if (line % 40 == 0) {
+      text << "[serf " << line / 40 << "]\n";
+    }
+    text << "value_" << (*random)() % 20 << " = " << (*random)() % 1000
+         << "," << (*random)() % 7 << ",0,0\n";
+  }
+  return text.str();
+}
+
+static std::string
+random_data(std::mt19937 *random, size_t size) {
+  std::string data(size, 0);
+  for (char &c : data) {
+    c = static_cast<char>((*random)() & 0xFF);
+  }
+  return data;
+}
+
+static std::string
+pack_streaming(const std::string &data) {
+  std::ostringstream packed;
+  LZOutBuf buf(&packed);
+  std::ostream os(&buf);
+  // small writes and large ones, across blocks
+  size_t pos = 0;
+  for (size_t part = 1; pos < data.size(); part = part * 3 + 1) {
+    size_t count = std::min(part, data.size() - pos);
+    os.write(data.data() + pos, count);
+    pos += count;
+  }
+  EXPECT_TRUE(buf.finish());
+  return packed.str();
+}
+
+static std::string
+unpack_streaming(const std::string &packed) {
+  std::istringstream is(packed);
+  LZInBuf buf(&is);
+  return std::string((std::istreambuf_iterator<char>(&buf)),
+                     std::istreambuf_iterator<char>());
+}
+
+TEST(LZStream, RoundTrips) {
+  std::mt19937 random(2021);
+  std::vector<std::string> samples = {
+    std::string(),
+    "a",
+    "abcd",
+    std::string(100000, 'x'),
+    text_data(&random, 20),
+    text_data(&random, 30000),
+    random_data(&random, 1000),
+    random_data(&random, LZStream::block_size * 2 + 7),
+    text_data(&random, 3000) + random_data(&random, 5000) +
+      text_data(&random, 3000),
+  };
+  for (const std::string &data : samples) {
+    std::string packed = LZStream::pack(data.data(), data.size());
+    ASSERT_TRUE(LZStream::is_packed(packed.data(), packed.size()));
+    EXPECT_EQ(data, LZStream::unpack(packed.data(), packed.size()))
+      << data.size() << " bytes";
+    EXPECT_EQ(packed, pack_streaming(data)) << data.size() << " bytes";
+    EXPECT_EQ(data, unpack_streaming(packed)) << data.size() << " bytes";
+  }
+}
+
+TEST(LZStream, PacksText) {
+  std::mt19937 random(7);
+  std::string data = text_data(&random, 30000);
+  std::string packed = LZStream::pack(data.data(), data.size());
+  EXPECT_LT(packed.size(), data.size() / 2);
+  // stored, not grown much, when it doesn't pack
+  std::string noise = random_data(&random, 100000);
+  packed = LZStream::pack(noise.data(), noise.size());
+  EXPECT_LT(packed.size(), noise.size() + 64);
+}
+
+TEST(LZStream, RejectsBadData) {
+  std::mt19937 random(99);
+  std::string data = text_data(&random, 2000);
+  std::string packed = LZStream::pack(data.data(), data.size());
+
+  EXPECT_FALSE(LZStream::is_packed(data.data(), data.size()));
+  EXPECT_THROW(LZStream::unpack(data.data(), data.size()), ExceptionFreeserf);
+  // cut short
+  for (size_t size : { size_t(8), size_t(12), packed.size() / 2,
+                       packed.size() - 8 }) {
+    EXPECT_THROW(LZStream::unpack(packed.data(), size), ExceptionFreeserf)
+      << size;
+    EXPECT_THROW(unpack_streaming(packed.substr(0, size)), ExceptionFreeserf)
+      << size;
+  }
+  // damaged bytes either unpack to something or throw, never more
+  for (int round = 0; round < 200; round++) {
+    std::string bad = packed;
+    for (int b = 0; b < 4; b++) {
+      bad[16 + random() % (bad.size() - 24)] =
+        static_cast<char>(random() & 0xFF);
+    }
+    try {
+      std::string out = LZStream::unpack(bad.data(), bad.size());
+      EXPECT_LE(out.size(), packed.size() * 256);
+    } catch (ExceptionFreeserf &e) {
+    }
+  }
+}
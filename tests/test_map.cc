@@ -21,11 +21,16 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <string>
 #include <vector>
 #include <iterator>
+#include <memory>
 
+#include "src/game.h"
 #include "src/map.h"
 #include "src/map-generator.h"
 #include "src/map-geometry.h"
@@ -126,3 +131,509 @@ TEST(Map, ClassicMissionMapGenerator) {
     }
   }
 }
+
+// Map updates must only depend on the seed, saved games and replays rely
+// on it.
+TEST(Map, UpdateIsReproducible) {
+  const MapGeometry geom(3);
+  Map map_0(geom);
+  Map map_1(geom);
+  Map map_2(geom);
+  Random random = Random("8667715887436237");
+  ClassicMissionMapGenerator generator(map_1, random);
+  generator.init();
+  generator.generate();
+  map_0.init_tiles(generator);
+  map_1.init_tiles(generator);
+  map_2.init_tiles(generator);
+  ASSERT_TRUE(map_1 == map_2);
+
+  Random rnd_1 = Random("8667715887436237");
+  Random rnd_2 = Random("8667715887436237");
+  for (unsigned int tick = 2; tick < 20000; tick += 2) {
+    map_1.update(tick, &rnd_1);
+    map_2.update(tick, &rnd_2);
+  }
+  EXPECT_FALSE(map_0 == map_1) << "trees and fish should have changed";
+  EXPECT_TRUE(map_1 == map_2);
+  EXPECT_EQ(std::string(rnd_1), std::string(rnd_2));
+}
+
+// The terrain bits of each tile are the types of the triangles around it.
+TEST(Map, TerrainBitsMatchTypes) {
+  const MapGeometry geom(3);
+  Map map(geom);
+  Random random = Random("8667715887436237");
+  ClassicMissionMapGenerator generator(map, random);
+  generator.init();
+  generator.generate();
+  map.init_tiles(generator);
+
+  for (MapPos pos : map.geom()) {
+    MapPos up_left = map.move_up_left(pos);
+    Map::Terrain near[] = {
+      map.type_up(pos), map.type_down(pos),
+      map.type_up(up_left), map.type_down(up_left) };
+    Map::Terrain around[] = {
+      near[0], near[1], near[2], near[3],
+      map.type_down(map.move_left(pos)), map.type_up(map.move_up(pos)) };
+    for (int low = Map::TerrainWater0; low <= Map::TerrainSnow1; low++) {
+      for (int high = low; high <= Map::TerrainSnow1; high++) {
+        bool within = true;
+        for (Map::Terrain type : around) {
+          within = within && (type >= low && type <= high);
+        }
+        bool any = false;
+        for (Map::Terrain type : near) {
+          any = any || (type >= low && type <= high);
+        }
+        Map::Terrain l = static_cast<Map::Terrain>(low);
+        Map::Terrain h = static_cast<Map::Terrain>(high);
+        ASSERT_EQ(within, map.types_within(pos, l, h)) << pos;
+        ASSERT_EQ(any, (map.terrain_up_left(pos) &
+                        Map::terrain_bits(l, h)) != 0) << pos;
+      }
+    }
+  }
+}
+
+namespace {
+
+class RecordingHandler : public Map::Handler {
+ public:
+  std::vector<MapPos> heights;
+  std::vector<MapPos> objects;
+  std::vector<MapPos> borders;
+  int batches = 0;
+
+  virtual void on_height_changed(MapPos pos) { heights.push_back(pos); }
+  virtual void on_object_changed(MapPos pos) { objects.push_back(pos); }
+  virtual void on_borders_changed(MapPos pos) { borders.push_back(pos); }
+  virtual void on_changes(const Map::Changes &changes) {
+    batches++;
+    Map::Handler::on_changes(changes);
+  }
+};
+
+}  // namespace
+
+TEST(Map, HeldChangesAreCoalesced) {
+  Map map(MapGeometry(3));
+  RecordingHandler handler;
+  map.add_change_handler(&handler);
+
+  // Without holding, every change notifies the six neighbours right away.
+  MapPos pos = map.pos(10, 10);
+  map.set_height(pos, 5);
+  EXPECT_EQ(6u, handler.heights.size());
+  EXPECT_EQ(0, handler.batches);
+  handler.heights.clear();
+
+  // Held changes arrive once, in one batch, with shared neighbours listed
+  // only once.
+  map.hold_changes();
+  map.set_height(pos, 6);
+  map.set_height(pos, 7);
+  map.set_height(map.move_right(pos), 8);
+  map.set_object(pos, Map::ObjectTree0, -1);
+  EXPECT_TRUE(handler.heights.empty());
+  EXPECT_TRUE(handler.objects.empty());
+  map.release_changes();
+  EXPECT_EQ(1, handler.batches);
+  EXPECT_EQ(10u, handler.heights.size());
+  EXPECT_EQ(6u, handler.objects.size());
+  std::vector<MapPos> sorted = handler.heights;
+  std::sort(sorted.begin(), sorted.end());
+  EXPECT_TRUE(std::unique(sorted.begin(), sorted.end()) == sorted.end());
+
+  // The journal starts empty again after a release.
+  handler.heights.clear();
+  handler.objects.clear();
+  map.hold_changes();
+  map.set_height(pos, 9);
+  map.release_changes();
+  EXPECT_EQ(2, handler.batches);
+  EXPECT_EQ(6u, handler.heights.size());
+
+  map.del_change_handler(&handler);
+}
+
+// Leveling a hexagon waits for the next release even when changes are not
+// held, and tells each neighbour once.
+TEST(Map, LevelingWaitsForRelease) {
+  Map map(MapGeometry(3));
+  RecordingHandler handler;
+  map.add_change_handler(&handler);
+
+  MapPos pos = map.pos(10, 10);
+  std::vector<MapPos> hexagon = { pos };
+  for (Direction d : cycle_directions_cw()) {
+    hexagon.push_back(map.move(pos, d));
+  }
+  uint64_t before = map.get_changes_near(pos);
+  map.set_heights(hexagon, 12);
+  EXPECT_NE(before, map.get_changes_near(pos));
+  for (MapPos p : hexagon) {
+    EXPECT_EQ(12u, map.get_height(p));
+  }
+  EXPECT_TRUE(handler.heights.empty());
+
+  map.release_changes();
+  EXPECT_EQ(1, handler.batches);
+  EXPECT_EQ(19u, handler.heights.size());  // The hexagon and the ring round
+  std::vector<MapPos> sorted = handler.heights;
+  std::sort(sorted.begin(), sorted.end());
+  EXPECT_TRUE(std::unique(sorted.begin(), sorted.end()) == sorted.end());
+
+  map.del_change_handler(&handler);
+}
+
+// Paths and owners wait for the next release too, and land that stays
+// unowned is no change.
+TEST(Map, BordersWaitForRelease) {
+  Map map(MapGeometry(3));
+  RecordingHandler handler;
+  map.add_change_handler(&handler);
+
+  MapPos pos = map.pos(10, 10);
+  map.del_owner(pos);
+  map.release_changes();
+  EXPECT_EQ(0, handler.batches);
+
+  map.set_owner(pos, 1);
+  map.add_path(pos, DirectionRight);
+  map.add_path(map.move_right(pos), DirectionLeft);
+  EXPECT_TRUE(handler.borders.empty());
+  map.release_changes();
+  EXPECT_EQ(1, handler.batches);
+  EXPECT_EQ(10u, handler.borders.size());
+  EXPECT_TRUE(handler.heights.empty());
+
+  handler.borders.clear();
+  map.del_owner(pos);
+  map.release_changes();
+  EXPECT_EQ(2, handler.batches);
+  EXPECT_EQ(6u, handler.borders.size());
+
+  map.del_change_handler(&handler);
+}
+
+TEST(Map, ChangesInAreaCoverTheWholeSquare) {
+  Map map(MapGeometry(3));
+  MapPos center = map.pos(20, 20);
+  const int radius = 9;
+
+  // Every tile in the square moves the count, whichever block it is in.
+  for (int y = -radius; y <= radius; y++) {
+    for (int x = -radius; x <= radius; x++) {
+      uint32_t before = map.get_changes_in(center, radius);
+      map.set_object(map.pos_add(center, x, y), Map::ObjectTree0, -1);
+      EXPECT_NE(before, map.get_changes_in(center, radius));
+    }
+  }
+
+  // Tiles two blocks away do not.
+  uint32_t before = map.get_changes_in(center, radius);
+  map.set_object(map.pos_add(center, 0, 2 * radius + 8), Map::ObjectStone0,
+                 -1);
+  EXPECT_EQ(before, map.get_changes_in(center, radius));
+}
+
+namespace {
+
+class CachingGenerator : public ClassicMissionMapGenerator {
+ public:
+  CachingGenerator(const Map &map, const Random &random)
+    : ClassicMissionMapGenerator(map, random) {}
+  using ClassicMapGenerator::get_cache_path;
+};
+
+}  // namespace
+
+TEST(Map, GeneratorThreadsGiveSameMap) {
+  const MapGeometry geom(5);
+  Map map(geom);
+  ClassicMissionMapGenerator serial(map, Random("8667715887436237"));
+  serial.init();
+  serial.set_threads(1);
+  serial.generate();
+  ClassicMissionMapGenerator parallel(map, Random("8667715887436237"));
+  parallel.init();
+  parallel.set_threads(4);
+  parallel.generate();
+  EXPECT_TRUE(serial.get_landscape() == parallel.get_landscape());
+}
+
+TEST(Map, PreparedMapIsTheGeneratedOne) {
+  const MapGeometry geom(4);
+  Map map(geom);
+  ClassicMissionMapGenerator reference(map, Random("8667715887436237"));
+  reference.init();
+  reference.generate();
+
+  MapPreparer preparer;
+  preparer.prepare(3, Random("1234567812345678"));
+  // changed before the first is done, only the last one is kept
+  preparer.prepare(4, Random("8667715887436237"));
+  MapPreparer::PLandscape prepared =
+    preparer.take(4, Random("8667715887436237"));
+  ASSERT_TRUE(prepared != nullptr);
+  EXPECT_TRUE(reference.get_landscape() == *prepared);
+  EXPECT_EQ(prepared, preparer.get_ready(4, Random("8667715887436237")));
+  EXPECT_EQ(nullptr, preparer.get_ready(3, Random("1234567812345678")));
+
+  // one never asked for is generated there and then
+  MapPreparer::PLandscape other =
+    preparer.take(3, Random("1234567812345678"));
+  ASSERT_TRUE(other != nullptr);
+  EXPECT_EQ(MapGeometry(3).tile_count(), other->size());
+}
+
+TEST(Map, GeneratorCache) {
+  const MapGeometry geom(4);
+  Map map(geom);
+  ClassicMissionMapGenerator reference(map, Random("8667715887436237"));
+  reference.init();
+  reference.generate();
+
+  ClassicMapGenerator::set_cache_folder(".");
+  CachingGenerator first(map, Random("8667715887436237"));
+  first.init();
+  std::string path = first.get_cache_path();
+  std::remove(path.c_str());
+  first.generate();
+  std::ifstream written(path.c_str());
+  EXPECT_TRUE(written.is_open());
+  written.close();
+
+  // A different seed must not pick up the cached map.
+  CachingGenerator other(map, Random("1234567812345678"));
+  other.init();
+  EXPECT_NE(path, other.get_cache_path());
+
+  CachingGenerator second(map, Random("8667715887436237"));
+  second.init();
+  second.generate();
+  ClassicMapGenerator::set_cache_folder("");
+  std::remove(path.c_str());
+
+  EXPECT_TRUE(reference.get_landscape() == first.get_landscape());
+  EXPECT_TRUE(reference.get_landscape() == second.get_landscape());
+}
+
+TEST(Map, RoadDirsPastInlineWords) {
+  // Long enough to spill out of the inline words and back.
+  std::vector<Direction> expected;
+  Road::Dirs dirs;
+  for (int i = 0; i < 200; i++) {
+    Direction d = static_cast<Direction>((i * 7 + i / 5) % 6);
+    dirs.push_back(d);
+    expected.push_back(d);
+  }
+  ASSERT_EQ(expected.size(), dirs.size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), dirs.begin()));
+  EXPECT_TRUE(std::equal(expected.rbegin(), expected.rend(), dirs.rbegin()));
+  EXPECT_EQ(expected.front(), dirs.front());
+  EXPECT_EQ(expected.back(), dirs.back());
+
+  Road::Dirs copy = dirs;
+  EXPECT_EQ(dirs, copy);
+  while (copy.size() > 10) copy.pop_back();
+  Road::Dirs prefix;
+  for (int i = 0; i < 10; i++) prefix.push_back(expected[i]);
+  EXPECT_EQ(prefix, copy);
+  copy.push_back(DirectionRight);
+  EXPECT_NE(prefix, copy);
+  copy.clear();
+  EXPECT_TRUE(copy.empty());
+  EXPECT_EQ(Road::Dirs(), copy);
+}
+
+TEST(Map, TileChunksOnlyAllocateWhatIsSet) {
+  MapGeometry geom(12);
+  TileChunks<uint32_t> chunks;
+  chunks.reset(geom);
+  ASSERT_EQ(geom.tile_count() / 64, chunks.get_chunk_count());
+  EXPECT_EQ(0u, chunks.get_allocated_chunk_count());
+
+  // zeros don't allocate
+  chunks.set(geom.pos(5, 5), 0);
+  EXPECT_EQ(0u, chunks.get_allocated_chunk_count());
+
+  // neighbours in the same 8x8 square share a chunk, the far corner not
+  MapPos pos = geom.pos(geom.cols() - 3, geom.rows() - 1);
+  chunks.set(pos, 17);
+  chunks.set(geom.move_up_left(pos), 18);
+  chunks.set(geom.move_right_n(pos, 3), 19);
+  EXPECT_EQ(2u, chunks.get_allocated_chunk_count());
+  EXPECT_EQ(17u, chunks.get(pos));
+  EXPECT_EQ(18u, chunks.get(geom.move_up_left(pos)));
+  // three right of there wraps around to the first column
+  EXPECT_EQ(19u, chunks.get(geom.pos(0, geom.rows() - 1)));
+  for (MapPos other : geom) {
+    if (other != pos && other != geom.move_up_left(pos) &&
+        other != geom.move_right_n(pos, 3)) {
+      ASSERT_EQ(0u, chunks.get(other));
+    }
+  }
+
+  // a chunk set back to zero compares the same as one never allocated
+  TileChunks<uint32_t> other;
+  other.reset(geom);
+  other.set(pos, 17);
+  other.set(geom.move_up_left(pos), 18);
+  EXPECT_NE(chunks, other);
+  chunks.set(geom.move_right_n(pos, 3), 0);
+  EXPECT_EQ(chunks, other);
+}
+
+TEST(Map, LargerThanClassicSizes) {
+  MapGeometry geom(14);
+  Map map(geom);
+  EXPECT_EQ(geom.tile_count(), static_cast<unsigned int>(1 << 23));
+  MapPos pos = map.pos(map.get_cols() - 1, map.get_rows() - 1);
+  map.set_serf_index(pos, 1234);
+  EXPECT_EQ(1234u, map.get_serf_index(pos));
+  EXPECT_EQ(0u, map.get_serf_index(map.move_right(pos)));
+  EXPECT_THROW(MapGeometry(max_map_size + 1), ExceptionFreeserf);
+}
+
+namespace {
+
+// What the sums stand for, tile by tile along the AI's spiral.
+void
+count_spirally(const Map &map, MapPos center, int radius,
+               unsigned int minerals[5], unsigned int signs[5],
+               unsigned int *trees, unsigned int *stones) {
+  unsigned int tiles = 1 + 3 * radius * (radius + 1);
+  for (int i = 0; i < 5; i++) {
+    minerals[i] = 0;
+    signs[i] = 0;
+  }
+  *trees = 0;
+  *stones = 0;
+  for (unsigned int i = 0; i < tiles; i++) {
+    MapPos pos = map.pos_add_extended_spirally(center, i);
+    Map::Object obj = map.get_obj(pos);
+    if (obj == Map::ObjectNone || obj >= Map::ObjectTree0) {
+      minerals[map.get_res_type(pos)] += map.get_res_amount(pos);
+    }
+    if (obj >= Map::ObjectSignLargeGold && obj <= Map::ObjectSignSmallStone) {
+      signs[1 + (obj - Map::ObjectSignLargeGold) / 2]++;
+    }
+    if (obj >= Map::ObjectTree0 && obj <= Map::ObjectPine7) {
+      (*trees)++;
+    }
+    if (obj >= Map::ObjectStone0 && obj <= Map::ObjectStone7) {
+      *stones += 1 + Map::ObjectStone7 - obj;
+    }
+  }
+}
+
+}  // namespace
+
+TEST(Map, AreaTotals) {
+  const MapGeometry geom(3);
+  Map map(geom);
+  Random random = Random("8667715887436237");
+  ClassicMissionMapGenerator generator(map, random);
+  generator.init();
+  generator.generate();
+  map.init_tiles(generator);
+
+  // geologists, miners, builders, foresters and stonecutters at work
+  Random work = Random("2342345234523452");
+  for (int i = 0; i < 2000; i++) {
+    MapPos pos = map.get_rnd_coord(nullptr, nullptr, &work);
+    switch (work.random() % 6) {
+    case 0: {
+      int sign = Map::ObjectSignLargeGold + work.random() % 9;
+      map.set_object(pos, static_cast<Map::Object>(sign), -1);
+      break;
+    }
+    case 1:
+      if (map.get_res_type(pos) != Map::MineralsNone) {
+        map.remove_ground_deposit(pos, 1 + work.random() % 8);
+      }
+      break;
+    case 2:
+      map.set_object(pos, Map::ObjectFlag, 0);
+      break;
+    case 3: {
+      int tree = Map::ObjectTree0 +
+                 work.random() % (Map::ObjectPine7 - Map::ObjectTree0 + 1);
+      map.set_object(pos, static_cast<Map::Object>(tree), -1);
+      break;
+    }
+    case 4: {
+      int stone = Map::ObjectStone0 + work.random() % 8;
+      map.set_object(pos, static_cast<Map::Object>(stone), -1);
+      break;
+    }
+    default:
+      map.set_object(pos, Map::ObjectNone, 0);
+      break;
+    }
+  }
+
+  for (int i = 0; i < 200; i++) {
+    MapPos center = map.get_rnd_coord(nullptr, nullptr, &random);
+    for (int radius : { 0, 1, 4, 9, 22 }) {
+      unsigned int minerals[5];
+      unsigned int signs[5];
+      unsigned int trees;
+      unsigned int stones;
+      count_spirally(map, center, radius, minerals, signs, &trees, &stones);
+      unsigned int any_signs = 0;
+      for (int type = Map::MineralsGold; type <= Map::MineralsStone; type++) {
+        Map::Minerals mineral = static_cast<Map::Minerals>(type);
+        ASSERT_EQ(minerals[type], map.get_minerals_in(center, radius, mineral))
+          << center << " " << radius << " " << type;
+        ASSERT_EQ(signs[type], map.get_signs_in(center, radius, mineral))
+          << center << " " << radius << " " << type;
+        any_signs += signs[type];
+      }
+      ASSERT_EQ(any_signs, map.get_signs_in(center, radius));
+      ASSERT_EQ(trees, map.get_trees_in(center, radius));
+      ASSERT_EQ(stones, map.get_stones_in(center, radius));
+    }
+  }
+}
+
+// The spiral of the ground analysis in the original game.
+TEST(Map, GroundAnalysisTotals) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  PMap map = game->get_map();
+  const int radius = 25;
+
+  Random random = Random("5925235925912398");
+  for (int i = 0; i < 50; i++) {
+    MapPos pos = map->get_rnd_coord(nullptr, nullptr, &random);
+    int expected[5] = { 0 };
+    auto sample = [&map, &expected](MapPos at, int weight) {
+      Map::Object obj = map->get_obj(at);
+      if ((obj == Map::ObjectNone || obj >= Map::ObjectTree0) &&
+          map->get_res_type(at) != Map::MineralsNone) {
+        expected[map->get_res_type(at)] += weight * map->get_res_amount(at);
+      }
+    };
+    MapPos at = pos;
+    sample(at, radius);
+    for (int shell = 0; shell < radius - 1; shell++) {
+      at = map->move_right(at);
+      for (Direction d : cycle_directions_cw(DirectionDown)) {
+        for (int j = 0; j < shell + 1; j++) {
+          sample(at, radius - shell);
+          at = map->move(at, d);
+        }
+      }
+    }
+
+    int estimates[5];
+    game->prepare_ground_analysis(pos, estimates);
+    for (int type = Map::MineralsGold; type <= Map::MineralsStone; type++) {
+      EXPECT_EQ(std::min(expected[type] >> 4, 999), estimates[type]) << pos;
+    }
+  }
+}
@@ -85,3 +85,39 @@ TEST(MapGeometry, LongerCCWDirectionCycle) {
 
   EXPECT_EQ(expected, dirs);
 }
+
+namespace {
+
+// Position addition as it was done before the packed version, splitting
+// the position into col and row and joining them again.
+MapPos
+generic_pos_add(const MapGeometry &geom, MapPos pos, MapPos off) {
+  return geom.pos((geom.pos_col(pos) + geom.pos_col(off)) & geom.col_mask(),
+                  (geom.pos_row(pos) + geom.pos_row(off)) & geom.row_mask());
+}
+
+}  // namespace
+
+TEST(MapGeometry, MoveMatchesGenericAdd) {
+  for (unsigned int size = 1; size <= 10; size++) {
+    MapGeometry geom(size);
+    MapPos right = geom.pos(1, 0);
+    MapPos down = geom.pos(0, 1);
+    MapPos left = geom.pos(geom.col_mask(), 0);
+    MapPos up = geom.pos(0, geom.row_mask());
+    MapPos offsets[] = { right, right | down, down, left, left | up, up };
+    for (MapPos pos : geom) {
+      for (Direction d : cycle_directions_cw()) {
+        ASSERT_EQ(generic_pos_add(geom, pos, offsets[d]), geom.move(pos, d))
+          << "size " << size << " pos " << pos << " dir " << d;
+      }
+      // Multiples beyond the map size and negative counts wrap the same way.
+      for (int n : { -3, -1, 5, 1000 }) {
+        ASSERT_EQ(generic_pos_add(geom, pos, right * n),
+                  geom.move_right_n(pos, n));
+        ASSERT_EQ(generic_pos_add(geom, pos, down * n),
+                  geom.move_down_n(pos, n));
+      }
+    }
+  }
+}
@@ -0,0 +1,98 @@
+/*
+ * test_memory_usage.cc - Memory accounting tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/game.h"
+#include "src/memory-usage.h"
+#include "src/random.h"
+
+TEST(MemoryUsage, AddsUpEntriesByPrefix) {
+  MemoryUsage usage;
+  usage.add("game.serfs", 10, 1000);
+  usage.add("game.flags", 2, 200);
+  usage.add("map.tiles", 1, 50);
+  usage.add("game.serfs", 5, 500);
+  ASSERT_EQ(3u, usage.get_entries().size());
+  EXPECT_EQ(15u, usage.get_entries()[0].count);
+  EXPECT_EQ(1700u, usage.get_bytes("game."));
+  EXPECT_EQ(50u, usage.get_bytes("map."));
+  EXPECT_EQ(1750u, usage.get_bytes());
+
+  MemoryUsage other;
+  other.add("ai.flag_dists", 1, 64);
+  other.add("map.tiles", 1, 50);
+  usage.add(other);
+  EXPECT_EQ(4u, usage.get_entries().size());
+  EXPECT_EQ(100u, usage.get_bytes("map."));
+
+  std::vector<int> vector;
+  vector.reserve(100);
+  EXPECT_EQ(vector.capacity() * sizeof(int), MemoryUsage::vector_bytes(vector));
+  std::map<int, int> tree = { { 1, 2 }, { 3, 4 } };
+  EXPECT_EQ(2 * (sizeof(std::pair<const int, int>) +
+                 MemoryUsage::tree_node_overhead),
+            MemoryUsage::tree_bytes(tree));
+
+  std::stringstream report;
+  usage.write_report(&report);
+  EXPECT_NE(std::string::npos, report.str().find("game.serfs"));
+}
+
+static size_t
+entry_count(const MemoryUsage &usage, const std::string &name) {
+  for (const MemoryUsage::Entry &entry : usage.get_entries()) {
+    if (entry.name == name) {
+      return entry.count;
+    }
+  }
+  return 0;
+}
+
+TEST(MemoryUsage, GameCountsObjects) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  MemoryUsage before;
+  game->add_memory_usage(&before);
+  EXPECT_GT(before.get_bytes("map."), 0u);
+
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+  MemoryUsage after;
+  game->add_memory_usage(&after);
+  // the collections allocate ahead, so one castle adds objects, not bytes
+  EXPECT_EQ(entry_count(before, "game.buildings") + 1,
+            entry_count(after, "game.buildings"));
+  EXPECT_GT(entry_count(after, "game.flags"), entry_count(before, "game.flags"));
+  EXPECT_GE(after.get_bytes("game.buildings"),
+            before.get_bytes("game.buildings"));
+  EXPECT_GT(after.get_bytes("game.buildings"), 0u);
+  // the castle and its flag take chunks of the sparse tile fields
+  EXPECT_LT(before.get_bytes("map.tiles"), after.get_bytes("map.tiles"));
+}
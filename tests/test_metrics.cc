@@ -0,0 +1,113 @@
+/*
+ * test_metrics.cc - Tests for the metrics of a running game
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/game.h"
+#include "src/metrics.h"
+#include "src/profiler.h"
+#include "src/random.h"
+
+TEST(Metrics, WritesPrometheusText) {
+  Metrics metrics;
+  metrics.add("test_tick", "A tick", Metrics::TypeCounter);
+  metrics.set(42);
+  metrics.add("test_bytes", "Bytes by owner", Metrics::TypeGauge);
+  metrics.set(1.5, { { "owner", "a \"b\"" } });
+  metrics.set(2, { { "owner", "c" }, { "kind", "d" } });
+
+  std::stringstream text;
+  metrics.write(&text, Metrics::FormatPrometheus);
+  EXPECT_EQ("# HELP test_tick A tick\n"
+            "# TYPE test_tick counter\n"
+            "test_tick 42\n"
+            "# HELP test_bytes Bytes by owner\n"
+            "# TYPE test_bytes gauge\n"
+            "test_bytes{owner=\"a \\\"b\\\"\"} 1.5\n"
+            "test_bytes{owner=\"c\",kind=\"d\"} 2\n", text.str());
+}
+
+TEST(Metrics, WritesJsonLines) {
+  Metrics metrics;
+  metrics.set_time(1000.25);
+  metrics.add("test_tick", "A tick", Metrics::TypeCounter);
+  metrics.set(42);
+  metrics.add("test_seconds", "Seconds", Metrics::TypeSummary);
+  metrics.set(0.5, { { "quantile", "0.5" } });
+  metrics.set(3, Metrics::Labels(), "_count");
+
+  std::stringstream text;
+  metrics.write(&text, Metrics::FormatJsonLines);
+  EXPECT_EQ("{\"time\":1000.250,\"metrics\":["
+            "{\"name\":\"test_tick\",\"value\":42},"
+            "{\"name\":\"test_seconds\",\"labels\":{\"quantile\":\"0.5\"},"
+            "\"value\":0.5},"
+            "{\"name\":\"test_seconds_count\",\"value\":3}]}\n", text.str());
+  EXPECT_EQ(Metrics::FormatJsonLines,
+            MetricsExporter::format_of("fleet/game.jsonl"));
+  EXPECT_EQ(Metrics::FormatPrometheus,
+            MetricsExporter::format_of("fleet/game.prom"));
+}
+
+// The metrics of a game come from the game and the profiler, and the file
+// holds the last of them.
+TEST(Metrics, ExportsGame) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  ASSERT_TRUE(game->build_castle(game->get_map()->pos(6, 6),
+                                 game->get_player(0)));
+  Profiler::reset();
+  for (int i = 0; i < 200; i++) game->update();
+
+  std::string path = "test_metrics.prom";
+  MetricsExporter exporter(path, 0);
+  std::vector<AI*> ais;
+  ASSERT_TRUE(exporter.update(game.get(), ais));
+  for (int i = 0; i < 100; i++) game->update();
+  ASSERT_TRUE(exporter.update(game.get(), ais));
+
+  std::ifstream file(path);
+  std::string text((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  file.close();
+  std::remove(path.c_str());
+  EXPECT_NE(std::string::npos, text.find("freeserf_game_tick " +
+                                         std::to_string(game->get_tick())));
+  EXPECT_NE(std::string::npos, text.find("freeserf_objects{kind=\"serfs\"} " +
+                                         std::to_string(
+                                           game->get_serf_count())));
+  if (Profiler::enabled) {
+    EXPECT_NE(std::string::npos,
+              text.find("freeserf_tick_duration_seconds_count 300\n"));
+    EXPECT_NE(std::string::npos,
+      text.find("freeserf_tick_duration_seconds{quantile=\"0.99\"} "));
+  }
+  EXPECT_NE(std::string::npos, text.find("freeserf_memory_bytes{owner="));
+  EXPECT_NE(std::string::npos, text.find("freeserf_ticks_per_second "));
+}
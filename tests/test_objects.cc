@@ -0,0 +1,128 @@
+/*
+ * test_objects.cc - Game objects collection tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "src/objects.h"
+
+class TestObject : public GameObject {
+ public:
+  static int alive;
+
+  TestObject(Game *game, unsigned int index) : GameObject(game, index) {
+    alive++;
+  }
+  virtual ~TestObject() { alive--; }
+};
+
+int TestObject::alive = 0;
+
+typedef Collection<TestObject, 4> TestObjects;
+
+TEST(Collection, ReusesFreedIndexesOldestFirst) {
+  TestObjects objects(nullptr);
+  std::vector<TestObject*> created;
+  for (unsigned int i = 0; i < 10; i++) {
+    created.push_back(objects.allocate());
+    EXPECT_EQ(i, created.back()->get_index());
+  }
+  EXPECT_EQ(10u, objects.size());
+
+  objects.erase(6);
+  objects.erase(2);
+  objects.erase(9);  // Last index is dropped, not queued for reuse.
+  EXPECT_EQ(7u, objects.size());
+  EXPECT_FALSE(objects.exists(2));
+  EXPECT_EQ(7, TestObject::alive);
+
+  // Surviving objects keep their address.
+  EXPECT_EQ(created[7], objects[7]);
+
+  EXPECT_EQ(6u, objects.allocate()->get_index());
+  EXPECT_EQ(2u, objects.allocate()->get_index());
+  EXPECT_EQ(9u, objects.allocate()->get_index());
+
+  unsigned int count = 0;
+  for (TestObject *object : objects) {
+    EXPECT_EQ(count, object->get_index());
+    count++;
+  }
+  EXPECT_EQ(10u, count);
+
+  objects.clear();
+  EXPECT_EQ(0, TestObject::alive);
+}
+
+TEST(Collection, InsertsAtIndexLikeLoading) {
+  TestObjects objects(nullptr);
+  objects.get_or_insert(5);
+  objects.get_or_insert(2);
+  EXPECT_EQ(2u, objects.size());
+  EXPECT_TRUE(objects.exists(5));
+  EXPECT_FALSE(objects.exists(3));
+
+  // Gaps left while loading are handed out in index order.
+  EXPECT_EQ(0u, objects.allocate()->get_index());
+  EXPECT_EQ(1u, objects.allocate()->get_index());
+  EXPECT_EQ(3u, objects.allocate()->get_index());
+  EXPECT_EQ(4u, objects.allocate()->get_index());
+  EXPECT_EQ(6u, objects.allocate()->get_index());
+  EXPECT_EQ(7u, objects.size());
+
+  objects.clear();
+  EXPECT_EQ(0, TestObject::alive);
+}
+
+TEST(OwnedObjects, ListsInIndexOrderWhileChanging) {
+  TestObjects objects(nullptr);
+  OwnedObjects<TestObject, 4> owned(&objects, 2);
+  for (unsigned int i = 0; i < 8; i++) {
+    objects.allocate();
+  }
+  for (unsigned int i : { 5u, 1u, 7u, 3u }) {
+    owned.add(i, 0);
+  }
+  owned.add(2, 1);
+  owned.add(4, 5);  // Past the owners, left out
+  owned.set_owner(7, 0, 1);
+  EXPECT_EQ(3u, owned.get(0).size());
+  EXPECT_EQ(2u, owned.get(1).size());
+  EXPECT_TRUE(owned.get(5).empty());
+  EXPECT_EQ(5u, owned.get_count());
+
+  // Objects removed and added behind and ahead of the iterator.
+  std::vector<unsigned int> seen;
+  for (TestObject *object : owned.get(0)) {
+    seen.push_back(object->get_index());
+    if (object->get_index() == 3) {
+      owned.remove(3, 0);
+      owned.remove(5, 0);
+      owned.add(0, 0);
+      owned.add(6, 0);
+    }
+  }
+  EXPECT_EQ(std::vector<unsigned int>({ 1, 3, 6 }), seen);
+
+  objects.clear();
+  EXPECT_EQ(0, TestObject::alive);
+}
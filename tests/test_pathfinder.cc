@@ -0,0 +1,97 @@
+/*
+ * test_pathfinder.cc - Path finder tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+#include <queue>
+
+#include "src/game.h"
+#include "src/pathfinder.h"
+#include "src/random.h"
+
+// Whether end can be reached from start under the same rules that
+// pathfinder_map applies (searching from end towards start).
+static bool
+reachable(Map *map, MapPos start, MapPos end) {
+  std::vector<bool> seen(map->geom().tile_count(), false);
+  std::queue<MapPos> queue;
+  queue.push(end);
+  seen[end] = true;
+  while (!queue.empty()) {
+    MapPos pos = queue.front();
+    queue.pop();
+    if (pos == start) return true;
+    for (Direction d : cycle_directions_cw()) {
+      MapPos new_pos = map->move(pos, d);
+      if (seen[new_pos] || !map->is_road_segment_valid(pos, d) ||
+          (map->get_obj(new_pos) == Map::ObjectFlag && new_pos != start)) {
+        continue;
+      }
+      seen[new_pos] = true;
+      queue.push(new_pos);
+    }
+  }
+  return false;
+}
+
+TEST(Pathfinder, MapPathsAreValidAndRepeatable) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+
+  std::vector<MapPos> owned;
+  for (MapPos pos : map->geom()) {
+    if (map->has_owner(pos) && !map->has_flag(pos)) owned.push_back(pos);
+  }
+  ASSERT_LT(10u, owned.size());
+
+  unsigned int found = 0;
+  for (size_t i = 0; i < owned.size(); i += 7) {
+    MapPos start = owned[i];
+    MapPos end = owned[(i * 13 + 5) % owned.size()];
+    if (start == end) continue;
+
+    Road road = pathfinder_map(map.get(), start, end);
+    EXPECT_EQ(reachable(map.get(), start, end), road.is_valid())
+      << "from " << start << " to " << end;
+    if (!road.is_valid()) continue;
+    found++;
+
+    // The road must be walkable from start and arrive at end.
+    EXPECT_EQ(start, road.get_source());
+    MapPos pos = start;
+    for (Direction dir : road.get_dirs()) {
+      EXPECT_TRUE(map->is_road_segment_valid(pos, dir));
+      pos = map->move(pos, dir);
+    }
+    EXPECT_EQ(end, pos);
+
+    // Scratch state is reused, a second search must give the same road.
+    Road again = pathfinder_map(map.get(), start, end);
+    EXPECT_EQ(road.get_dirs(), again.get_dirs());
+  }
+  EXPECT_LT(0u, found);
+}
@@ -0,0 +1,232 @@
+/*
+ * test_player_stats.cc - Player statistics tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "src/game.h"
+#include "src/pathfinder.h"
+#include "src/random.h"
+#include "src/savegame.h"
+
+namespace {
+
+// Count the serfs idle in stock by walking all serfs.
+Serf::SerfCounts
+count_idle_serfs(Game *game, Player *player) {
+  Serf::SerfCounts res = {};
+  for (Serf *serf : game->get_player_serfs(player)) {
+    if (serf->get_state() == Serf::StateIdleInStock) {
+      res[serf->get_type()] += 1;
+    }
+  }
+  return res;
+}
+
+// The serfs idle in the castle, by walking all serfs, against its roster.
+void
+expect_roster(Game *game, Inventory *inventory) {
+  Serf::SerfCounts scanned = {};
+  for (Serf *serf : game->get_owned_serfs(game->get_player(0))) {
+    if (serf->get_state() == Serf::StateIdleInStock &&
+        serf->get_idle_in_stock_inv_index() == inventory->get_index()) {
+      scanned[serf->get_type()] += 1;
+    }
+  }
+  Serf::SerfCounts listed = {};
+  for (Serf *serf : game->get_serfs_in_inventory(inventory)) {
+    ASSERT_EQ(Serf::StateIdleInStock, serf->get_state());
+    listed[serf->get_type()] += 1;
+  }
+  EXPECT_EQ(scanned, listed);
+}
+
+// Each of the objects listed for the players is theirs, in index order,
+// and together they are all of them but the NULL objects at index 0.
+template<class Range>
+size_t
+expect_owned(Range range, unsigned int owner) {
+  size_t count = 0;
+  int last = -1;
+  for (auto object : range) {
+    EXPECT_EQ(owner, object->get_owner());
+    EXPECT_LT(last, static_cast<int>(object->get_index()));
+    last = object->get_index();
+    count++;
+  }
+  EXPECT_EQ(range.size(), count);
+  return count;
+}
+
+void
+expect_owned(Game *game) {
+  size_t serfs = 0;
+  size_t buildings = 0;
+  for (unsigned int p = 0; p < 2; p++) {
+    Player *player = game->get_player(p);
+    serfs += expect_owned(game->get_owned_serfs(player), p);
+    buildings += expect_owned(game->get_owned_buildings(player), p);
+    EXPECT_EQ(1u, expect_owned(game->get_owned_inventories(player), p));
+    EXPECT_EQ(game->get_player_buildings(player).size(),
+              game->get_owned_buildings(player).size());
+  }
+  EXPECT_EQ(game->get_serf_count() - 1, serfs);
+  EXPECT_EQ(game->get_building_count() - 1, buildings);
+}
+
+}  // namespace
+
+TEST(PlayerStats, IdleSerfsFollowGame) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  MapPos castle_pos = map->pos(6, 6);
+  ASSERT_TRUE(game->build_castle(castle_pos, player));
+  EXPECT_EQ(count_idle_serfs(game.get(), player),
+            player->get_stats_serfs_idle());
+
+  // Buildings that call serfs out of the castle and specialize them.
+  MapPos castle_flag = map->move_down_right(castle_pos);
+  Building::Type types[] = { Building::TypeLumberjack,
+                             Building::TypeStonecutter,
+                             Building::TypeForester };
+  int i = 30;
+  for (Building::Type type : types) {
+    for (; i < 400; i++) {
+      MapPos pos = map->pos_add_extended_spirally(castle_pos, i);
+      if (!game->can_build_building(pos, type, player)) continue;
+      Road road = pathfinder_map(map.get(), map->move_down_right(pos),
+                                 castle_flag);
+      if (road.is_valid() && game->build_building(pos, type, player) &&
+          game->build_road(road, player)) {
+        break;
+      }
+    }
+  }
+
+  for (int tick = 0; tick < 3000; tick++) {
+    game->update();
+    if (tick % 50 == 0) {
+      ASSERT_EQ(count_idle_serfs(game.get(), player),
+                player->get_stats_serfs_idle()) << "tick " << tick;
+      expect_roster(game.get(), game->get_inventory(0));
+      ASSERT_FALSE(HasFailure()) << "tick " << tick;
+    }
+  }
+
+  // The counts are not saved; loading counts them again.
+  std::stringstream str;
+  ASSERT_TRUE(GameStore::get_instance().write(&str, game.get()));
+  str.seekg(0, std::ios::beg);
+  std::unique_ptr<Game> loaded(new Game());
+  ASSERT_TRUE(GameStore::get_instance().read(&str, loaded.get()));
+  EXPECT_EQ(player->get_stats_serfs_idle(),
+            loaded->get_player(0)->get_stats_serfs_idle());
+  expect_roster(loaded.get(), loaded->get_inventory(0));
+}
+
+TEST(PlayerStats, OwnedObjectsFollowGame) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  game->add_player(12, 30, 40);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), game->get_player(0)));
+  ASSERT_TRUE(game->build_castle(map->pos(30, 30), game->get_player(1)));
+  for (int i = 30; i < 200; i += 7) {
+    MapPos pos = map->pos_add_extended_spirally(map->pos(6, 6), i);
+    game->build_building(pos, Building::TypeHut, game->get_player(0));
+  }
+
+  expect_owned(game.get());
+  for (int tick = 0; tick < 3000; tick++) {
+    game->update();
+    if (tick % 100 == 0) {
+      expect_owned(game.get());
+      ASSERT_FALSE(HasFailure()) << "tick " << tick;
+    }
+  }
+
+  std::stringstream str;
+  ASSERT_TRUE(GameStore::get_instance().write(&str, game.get()));
+  str.seekg(0, std::ios::beg);
+  std::unique_ptr<Game> loaded(new Game());
+  ASSERT_TRUE(GameStore::get_instance().read(&str, loaded.get()));
+  expect_owned(loaded.get());
+}
+
+// Knights found for attacks from the lists of buildings are those the walk
+// of the tiles around the target finds, with the small map wrapping around.
+TEST(PlayerStats, AttackKnightsSameAsScan) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  game->add_player(12, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  MapPos castle_pos = map->pos(6, 6);
+  ASSERT_TRUE(game->build_castle(castle_pos, player));
+  ASSERT_TRUE(game->build_castle(map->pos(30, 30), game->get_player(1)));
+  MapPos castle_flag = map->move_down_right(castle_pos);
+  for (int i = 30; i < 400; i += 5) {
+    MapPos pos = map->pos_add_extended_spirally(castle_pos, i);
+    if (!game->can_build_building(pos, Building::TypeHut, player)) continue;
+    Road road = pathfinder_map(map.get(), map->move_down_right(pos),
+                               castle_flag);
+    if (!road.is_valid() ||
+        !game->build_building(pos, Building::TypeHut, player)) {
+      continue;
+    }
+    if (!game->build_road(road, player)) {
+      game->demolish_building(pos, player);
+    }
+  }
+  player->change_knight_occupation(0, 0, -4);
+
+  int found = 0;
+  for (int tick = 0; tick < 12000; tick++) {
+    game->update();
+    if (tick % 1000 != 999) continue;
+    for (unsigned int y = 0; y < map->get_rows(); y += 3) {
+      for (unsigned int x = 0; x < map->get_cols(); x += 3) {
+        MapPos pos = map->pos(x, y);
+        int knights = player->knights_available_for_attack(pos);
+        int buildings = player->attacking_building_count;
+        std::vector<int> by_shell(player->attacking_knights,
+                                  player->attacking_knights + 4);
+        EXPECT_EQ(player->knights_available_for_attack_by_scan(pos),
+                  knights);
+        EXPECT_EQ(player->attacking_building_count, buildings);
+        EXPECT_EQ(std::vector<int>(player->attacking_knights,
+                                   player->attacking_knights + 4),
+                  by_shell);
+        found += buildings;
+      }
+    }
+    ASSERT_FALSE(HasFailure()) << "tick " << tick;
+  }
+  EXPECT_LT(0, found);
+}
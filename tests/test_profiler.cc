@@ -0,0 +1,91 @@
+/*
+ * test_profiler.cc - Profiler tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/profiler.h"
+
+TEST(Profiler, BucketsCoverValues) {
+  unsigned int last = 0;
+  for (uint64_t ns = 0; ns < (1ull << 40); ns = ns * 9 / 8 + 1) {
+    unsigned int bucket = Profiler::bucket_of(ns);
+    ASSERT_LT(bucket, Profiler::bucket_count);
+    EXPECT_LE(last, bucket);
+    EXPECT_LE(ns, Profiler::bucket_upper_bound(bucket));
+    if (bucket > 0) {
+      EXPECT_LT(Profiler::bucket_upper_bound(bucket - 1), ns);
+    }
+    last = bucket;
+  }
+}
+
+TEST(Profiler, MergesThreadsAndResets) {
+  static const Profiler::Section section("test.merge");
+  Profiler::reset();
+
+  auto work = []() {
+    for (uint64_t i = 1; i <= 100; i++) {
+      Profiler::record(section.get_id(), i * 1000);
+    }
+  };
+  std::thread other(work);
+  work();
+  other.join();
+
+  std::vector<Profiler::Stats> stats = Profiler::get_stats("test.merge");
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(200u, stats[0].count);
+  EXPECT_EQ(1000u, stats[0].min_ns);
+  EXPECT_EQ(100000u, stats[0].max_ns);
+  EXPECT_DOUBLE_EQ(50500., stats[0].avg_ns());
+  EXPECT_LE(50000u, stats[0].p50_ns);
+  EXPECT_GE(60000u, stats[0].p50_ns);
+  EXPECT_LE(90000u, stats[0].p90_ns);
+  EXPECT_GE(100000u, stats[0].p90_ns);
+  EXPECT_LE(99000u, stats[0].p99_ns);
+  EXPECT_GE(100000u, stats[0].p99_ns);
+
+  Profiler::reset();
+  EXPECT_TRUE(Profiler::get_stats("test.merge").empty());
+  Profiler::record(section.get_id(), 5);
+  stats = Profiler::get_stats("test.merge");
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(1u, stats[0].count);
+}
+
+TEST(Profiler, TallyOnlyTheAttachedThread) {
+  static const Profiler::Section section("test.tally");
+  Profiler::Tally tally;
+  EXPECT_EQ(nullptr, Profiler::attach_tally(&tally));
+  Profiler::record(section.get_id(), 1000);
+  std::thread other([]() { Profiler::record(section.get_id(), 7); });
+  other.join();
+  Profiler::record(section.get_id(), 500);
+  EXPECT_EQ(&tally, Profiler::attach_tally(nullptr));
+  Profiler::record(section.get_id(), 9);
+
+  EXPECT_EQ(2u, tally.count[section.get_id()]);
+  EXPECT_EQ(1500u, tally.total_ns[section.get_id()]);
+  EXPECT_EQ("test.tally", Profiler::get_section_name(section.get_id()));
+}
@@ -0,0 +1,99 @@
+/*
+ * test_random.cc - Random number generator tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <vector>
+
+#include "src/random.h"
+
+TEST(Random, SequenceUnchanged) {
+  // what save games and generated maps depend on
+  Random random("8667715887436237");
+  EXPECT_EQ("8667715887436237", static_cast<std::string>(random));
+  Random copy(random);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(random.random(), copy.random());
+  }
+  Random stepped(1, 2, 3);
+  EXPECT_EQ(0u, stepped.random());
+  EXPECT_EQ(1u, stepped.random());
+}
+
+TEST(Random, StreamsByCounter) {
+  Random seed("8667715887436237");
+  RandomStream map = seed.get_stream(Random::StreamMapUpdate);
+  EXPECT_EQ(map.get_key(),
+            Random("8667715887436237").get_stream(
+              Random::StreamMapUpdate).get_key());
+  // getting a stream leaves the sequence alone
+  Random copy("8667715887436237");
+  EXPECT_EQ(copy.random(), seed.random());
+
+  // out of order, and in bulk from any offset, the same values
+  std::vector<uint16_t> forward;
+  for (uint64_t i = 0; i < 103; i++) {
+    forward.push_back(map.get(i));
+  }
+  for (uint64_t i = 103; i-- > 0;) {
+    ASSERT_EQ(forward[i], map.get(i));
+  }
+  for (uint64_t first = 0; first < 5; first++) {
+    std::vector<uint16_t> block(97);
+    map.fill(block.data(), block.size(), first);
+    for (size_t i = 0; i < block.size(); i++) {
+      ASSERT_EQ(forward[first + i], block[i]);
+    }
+  }
+}
+
+TEST(Random, SplitStreamsDiffer) {
+  RandomStream ai = Random("8667715887436237").get_stream(Random::StreamAI);
+  std::set<uint64_t> keys;
+  std::set<uint64_t> firsts;
+  for (uint64_t region = 0; region < 1000; region++) {
+    RandomStream stream = ai.split(region);
+    keys.insert(stream.get_key());
+    firsts.insert(stream.get64(0));
+    EXPECT_EQ(stream.get_key(), ai.split(region).get_key());
+  }
+  EXPECT_EQ(1000u, keys.size());
+  EXPECT_EQ(1000u, firsts.size());
+  EXPECT_NE(ai.get_key(), Random("8667715887436237").get_stream(
+                            Random::StreamGame).get_key());
+  Random game = Random("8667715887436237").split(Random::StreamGame);
+  EXPECT_EQ(static_cast<std::string>(game),
+            static_cast<std::string>(
+              Random("8667715887436237").split(Random::StreamGame)));
+  EXPECT_NE("8667715887436237", static_cast<std::string>(game));
+
+  // roughly even over the bits
+  unsigned int ones = 0;
+  for (uint64_t i = 0; i < 4096; i++) {
+    uint16_t value = ai.get(i);
+    for (int bit = 0; bit < 16; bit++) {
+      ones += (value >> bit) & 1;
+    }
+  }
+  EXPECT_GT(ones, 4096u * 16u * 45u / 100u);
+  EXPECT_LT(ones, 4096u * 16u * 55u / 100u);
+}
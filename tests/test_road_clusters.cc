@@ -0,0 +1,126 @@
+/*
+ * test_road_clusters.cc - Tests for planning long roads over map clusters
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <queue>
+#include <vector>
+
+#include "src/road-clusters.h"
+
+namespace {
+
+void
+own_all(Map *map) {
+  for (MapPos pos : map->geom()) {
+    map->set_owner(pos, 0);
+  }
+}
+
+// Whether a road gets from start to end without leaving the corridor.
+bool
+reachable_in(Map *map, const RoadClusters::Corridor &corridor,
+             MapPos start, MapPos end) {
+  std::vector<bool> seen(map->geom().tile_count(), false);
+  std::queue<MapPos> queue;
+  queue.push(start);
+  seen[start] = true;
+  while (!queue.empty()) {
+    MapPos pos = queue.front();
+    queue.pop();
+    if (pos == end) return true;
+    for (Direction d : cycle_directions_cw()) {
+      MapPos new_pos = map->move(pos, d);
+      if (seen[new_pos] || !corridor.contains(new_pos) ||
+          !map->is_road_segment_valid(pos, d)) {
+        continue;
+      }
+      seen[new_pos] = true;
+      queue.push(new_pos);
+    }
+  }
+  return false;
+}
+
+// Stones down the whole of column col, leaving a gap at row gap if any.
+void
+build_wall(Map *map, unsigned int col, int gap) {
+  for (unsigned int row = 0; row < map->get_rows(); row++) {
+    if (static_cast<int>(row) == gap) continue;
+    map->set_object(map->pos(col, row), Map::ObjectStone0, -1);
+  }
+}
+
+}  // namespace
+
+TEST(RoadClusters, OpenMapCorridor) {
+  Map map(MapGeometry(4));
+  own_all(&map);
+  RoadClusters clusters;
+
+  MapPos start = map.pos(5, 5);
+  MapPos end = map.pos(60, 50);
+  RoadClusters::Corridor corridor;
+  ASSERT_TRUE(clusters.find_corridor(&map, start, end, &corridor));
+  EXPECT_TRUE(corridor.contains(start));
+  EXPECT_TRUE(corridor.contains(end));
+  EXPECT_LT(corridor.get_cluster_count(),
+            (map.get_cols() / RoadClusters::cluster_size) *
+            (map.get_rows() / RoadClusters::cluster_size));
+  EXPECT_TRUE(reachable_in(&map, corridor, start, end));
+  EXPECT_LT(0u, clusters.get_node_count());
+  EXPECT_LT(0u, clusters.get_allocated_bytes());
+}
+
+TEST(RoadClusters, ShortRoadsAreLeftToTileSearch) {
+  Map map(MapGeometry(4));
+  own_all(&map);
+  RoadClusters clusters;
+
+  RoadClusters::Corridor corridor;
+  EXPECT_FALSE(clusters.find_corridor(&map, map.pos(5, 5), map.pos(20, 12),
+                                      &corridor));
+}
+
+TEST(RoadClusters, FollowsMapChanges) {
+  Map map(MapGeometry(4));
+  own_all(&map);
+  RoadClusters clusters;
+
+  // The map wraps, so the wall has to go down two columns to cut it.
+  build_wall(&map, 30, -1);
+  build_wall(&map, 94, -1);
+  MapPos start = map.pos(10, 20);
+  MapPos end = map.pos(60, 20);
+  RoadClusters::Corridor corridor;
+  EXPECT_FALSE(clusters.find_corridor(&map, start, end, &corridor));
+
+  // Through the gap, once there is one.
+  MapPos gap = map.pos(30, 45);
+  map.set_object(gap, Map::ObjectNone, -1);
+  ASSERT_TRUE(clusters.find_corridor(&map, start, end, &corridor));
+  EXPECT_TRUE(corridor.contains(gap));
+  EXPECT_TRUE(reachable_in(&map, corridor, start, end));
+
+  // And not after it closes again.
+  map.set_object(gap, Map::ObjectStone0, -1);
+  EXPECT_FALSE(clusters.find_corridor(&map, start, end, &corridor));
+}
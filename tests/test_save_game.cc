@@ -20,12 +20,19 @@
  */
 
 #include <gtest/gtest.h>
+#include <sys/stat.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <memory>
+#include <string>
 
+#include "src/configfile.h"
 #include "src/game.h"
+#include "src/pathfinder.h"
 #include "src/random.h"
 #include "src/savegame.h"
 #include "src/mission.h"
@@ -77,3 +84,316 @@ TEST(SaveGame, RandomMapSaveGame) {
   // Check player land area
   EXPECT_EQ(player_0->get_land_area(), loaded_player_0->get_land_area());
 }
+
+namespace {
+
+// Play a random map game with a few connected buildings and return its
+// saved state.
+std::string
+play_and_save(unsigned int ticks) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  MapPos castle_pos = map->pos(6, 6);
+  if (!game->build_castle(castle_pos, player)) return std::string();
+
+  MapPos castle_flag = map->move_down_right(castle_pos);
+  Building::Type types[] = { Building::TypeLumberjack,
+                             Building::TypeStonecutter,
+                             Building::TypeSawmill };
+  int i = 30;
+  for (Building::Type type : types) {
+    for (; i < 400; i++) {
+      MapPos pos = map->pos_add_extended_spirally(castle_pos, i);
+      if (!game->can_build_building(pos, type, player)) continue;
+      Road road = pathfinder_map(map.get(), map->move_down_right(pos),
+                                 castle_flag);
+      if (road.is_valid() && game->build_building(pos, type, player) &&
+          game->build_road(road, player)) {
+        break;
+      }
+    }
+  }
+
+  for (unsigned int tick = 0; tick < ticks; tick++) game->update();
+
+  std::stringstream str;
+  GameStore::get_instance().write(&str, game.get());
+  return str.str();
+}
+
+}  // namespace
+
+// A game only depends on its seed and the commands given to it. Replays
+// and any change to how a tick is computed are checked against this.
+TEST(SaveGame, SameSeedPlaysTheSame) {
+  std::string first = play_and_save(4000);
+  ASSERT_FALSE(first.empty());
+  EXPECT_TRUE(first == play_and_save(4000));
+}
+
+// A compact save loads into the same game as the text one, and converting
+// between the two formats loses nothing.
+TEST(SaveGame, CompactSaveLoadsTheSame) {
+  std::string text = play_and_save(1000);
+  ASSERT_FALSE(text.empty());
+
+  std::stringstream text_in(text);
+  std::unique_ptr<Game> game(new Game());
+  ASSERT_TRUE(GameStore::get_instance().read(&text_in, game.get()));
+
+  std::stringstream compact;
+  ASSERT_TRUE(GameStore::get_instance().write(&compact, game.get(),
+                                              GameStore::FormatCompact));
+  EXPECT_LT(compact.str().size(), text.size() / 2);
+
+  std::unique_ptr<Game> loaded_game(new Game());
+  ASSERT_TRUE(GameStore::get_instance().read(&compact, loaded_game.get()));
+  std::stringstream loaded_text;
+  GameStore::get_instance().write(&loaded_text, loaded_game.get());
+  EXPECT_TRUE(text == loaded_text.str());
+
+  std::stringstream text_again(text);
+  std::stringstream converted_compact;
+  ASSERT_TRUE(GameStore::get_instance().convert(&text_again,
+                                                &converted_compact,
+                                                GameStore::FormatCompact));
+  std::stringstream converted;
+  ASSERT_TRUE(GameStore::get_instance().convert(&converted_compact, &converted,
+                                                GameStore::FormatText));
+  text_again.str(text);
+  text_again.clear();
+  std::stringstream expected;
+  ASSERT_TRUE(GameStore::get_instance().convert(&text_again, &expected,
+                                                GameStore::FormatText));
+  EXPECT_TRUE(expected.str() == converted.str());
+}
+
+// A spectator stream loads into the game as of its last frame, and the
+// frames after the first only hold what changed.
+TEST(SaveGame, SpectatorStreamFollowsTheGame) {
+  std::string text = play_and_save(500);
+  ASSERT_FALSE(text.empty());
+  std::stringstream text_in(text);
+  std::unique_ptr<Game> game(new Game());
+  ASSERT_TRUE(GameStore::get_instance().read(&text_in, game.get()));
+
+  std::stringstream stream;
+  SpectatorWriter writer(&stream);
+  size_t first_size = 0;
+  ASSERT_TRUE(writer.write_frame(game.get(), &first_size));
+  size_t largest_size = 0;
+  for (int frame = 0; frame < 20; frame++) {
+    for (int tick = 0; tick < 50; tick++) game->update();
+    size_t size = 0;
+    ASSERT_TRUE(writer.write_frame(game.get(), &size));
+    largest_size = std::max(largest_size, size);
+  }
+  EXPECT_LT(largest_size, first_size / 4);
+
+  SpectatorReader reader;
+  int frames = 0;
+  while (reader.read_frame(&stream)) frames++;
+  EXPECT_EQ(21, frames);
+
+  std::unique_ptr<Game> spectated(new Game());
+  ASSERT_TRUE(reader.load(spectated.get()));
+  EXPECT_EQ(*game->get_map(), *spectated->get_map());
+  std::stringstream expected;
+  GameStore::get_instance().write(&expected, game.get());
+  std::stringstream loaded;
+  GameStore::get_instance().write(&loaded, spectated.get());
+  EXPECT_TRUE(expected.str() == loaded.str());
+}
+
+// Packed save games, of either format, load without being told they are
+// packed, and take less room than the text.
+TEST(SaveGame, PackedSaveLoadsTheSame) {
+  std::string text = play_and_save(1000);
+  ASSERT_FALSE(text.empty());
+  std::stringstream text_in(text);
+  std::unique_ptr<Game> game(new Game());
+  ASSERT_TRUE(GameStore::get_instance().read(&text_in, game.get()));
+
+  GameStore &store = GameStore::get_instance();
+  store.set_compressed(true);
+  for (GameStore::Format format : { GameStore::FormatText,
+                                    GameStore::FormatCompact }) {
+    std::string path = "test_packed_" + std::to_string(format) + ".save";
+    ASSERT_TRUE(store.save(path, game.get(), format));
+    std::unique_ptr<Game> loaded_game(new Game());
+    ASSERT_TRUE(store.load(path, loaded_game.get()));
+    std::ifstream packed(path, std::ios::binary);
+    std::string packed_data((std::istreambuf_iterator<char>(packed)),
+                            std::istreambuf_iterator<char>());
+    std::remove(path.c_str());
+    EXPECT_LT(packed_data.size(), text.size() / 4);
+
+    std::stringstream loaded_text;
+    store.write(&loaded_text, loaded_game.get());
+    EXPECT_TRUE(text == loaded_text.str());
+
+    std::stringstream packed_in(packed_data);
+    std::unique_ptr<Game> read_game(new Game());
+    ASSERT_TRUE(store.read(&packed_in, read_game.get()));
+  }
+  store.set_compressed(false);
+}
+
+// The text is read as ConfigFile reads it, however odd it is.
+TEST(SaveGame, TextReadsAsConfigFile) {
+  std::string text =
+    "stray = before any section\n"
+    "[Game 0]\n"
+    "  Tick = 123  \n"
+    "list = 1,2,-3,007,Ab,,0\n"
+    "ends = 4,5,\n"
+    "comma = ,\n"
+    "empty =\n"
+    "no equals sign\n"
+    "; a comment\n"
+    "# another = 1\n"
+    "twice = 1\n"
+    "twice = 2\n"
+    "big = 123456789012345678901234,-0,+5\r\n"
+    "[serf 12]\n"
+    "state = 5\n"
+    "[game 0]\n"
+    "again = only this\n"
+    "[flag 3]";
+
+  std::stringstream config_in(text);
+  ConfigFile config;
+  ASSERT_TRUE(config.read(&config_in));
+  std::stringstream expected;
+  config.write(&expected);
+
+  std::stringstream in(text);
+  std::stringstream converted;
+  ASSERT_TRUE(GameStore::get_instance().convert(&in, &converted,
+                                                GameStore::FormatText));
+  EXPECT_EQ(expected.str(), converted.str());
+}
+
+// The text written straight from the game is the one a snapshot writes, and
+// the one ConfigFile writes when converting it.
+TEST(SaveGame, StreamedTextWritesAsConfigFile) {
+  std::string text = play_and_save(1000);
+  ASSERT_FALSE(text.empty());
+  std::stringstream text_in(text);
+  std::unique_ptr<Game> game(new Game());
+  ASSERT_TRUE(GameStore::get_instance().read(&text_in, game.get()));
+
+  GameStore &store = GameStore::get_instance();
+  std::string path = "test_streamed_text.save";
+  ASSERT_TRUE(store.save(path, store.take_snapshot(game.get()),
+                         GameStore::FormatText));
+  std::ifstream snapshot_in(path, std::ios::binary);
+  std::string snapshot((std::istreambuf_iterator<char>(snapshot_in)),
+                       std::istreambuf_iterator<char>());
+  snapshot_in.close();
+  std::remove(path.c_str());
+
+  std::stringstream streamed;
+  ASSERT_TRUE(store.write(&streamed, game.get()));
+  EXPECT_TRUE(streamed.str() == snapshot);
+
+  // which reads names lowercase, and has an empty section for the values
+  //  before any section
+  std::stringstream in(streamed.str());
+  std::stringstream converted;
+  ASSERT_TRUE(store.convert(&in, &converted, GameStore::FormatText));
+  std::string expected = converted.str();
+  size_t global = expected.find("[global]\n");
+  ASSERT_NE(std::string::npos, global);
+  expected.erase(global, std::string("[global]\n").size());
+  std::string lowercase = streamed.str();
+  std::transform(lowercase.begin(), lowercase.end(), lowercase.begin(),
+                 ::tolower);
+  EXPECT_TRUE(lowercase == expected);
+}
+
+namespace {
+
+// A store over a folder of its own.
+class FolderGameStore : public GameStore {
+ public:
+  explicit FolderGameStore(const std::string &folder) {
+    folder_path = folder;
+  }
+};
+
+}  // namespace
+
+// The list of save games comes from the index, which saves put themselves
+// in, and which follows the files that come, change and go.
+TEST(SaveGame, SaveIndexFollowsTheFolder) {
+  std::string folder = "test_save_index";
+  mkdir(folder.c_str(), S_IRWXU);
+  std::string index_path = folder + "/saves.index";
+  std::remove(index_path.c_str());
+
+  std::stringstream text(play_and_save(200));
+  std::unique_ptr<Game> game(new Game());
+  ASSERT_TRUE(GameStore::get_instance().read(&text, game.get()));
+
+  {
+    FolderGameStore store(folder);
+    ASSERT_TRUE(store.save(folder + "/first.save", game.get()));
+    ASSERT_TRUE(store.save(folder + "/second.save", game.get(),
+                           GameStore::FormatCompact));
+    const std::vector<GameStore::SaveInfo> &saves = store.get_saved_games();
+    ASSERT_EQ(2u, saves.size());
+    for (const GameStore::SaveInfo &info : saves) {
+      EXPECT_EQ(game->get_tick(), info.tick) << info.name;
+      EXPECT_EQ(1u, info.players) << info.name;
+      EXPECT_LT(0, info.size) << info.name;
+    }
+    ASSERT_EQ(1u, store.get_saved_games(1, 10).size());
+    EXPECT_EQ(saves[1].path, store.get_saved_games(1, 10)[0].path);
+    EXPECT_TRUE(store.get_saved_games(2, 10).empty());
+  }
+
+  // a file not written by the store is read once and indexed
+  std::ifstream first(folder + "/first.save", std::ios::binary);
+  std::ofstream third(folder + "/third.save", std::ios::binary);
+  third << first.rdbuf();
+  third.close();
+  {
+    FolderGameStore store(folder);
+    ASSERT_EQ(3u, store.get_saved_games().size());
+  }
+
+  // what the index says is believed while the file stays as it was
+  std::ifstream index_in(index_path);
+  std::string index((std::istreambuf_iterator<char>(index_in)),
+                    std::istreambuf_iterator<char>());
+  index_in.close();
+  std::string tick = "\t" + std::to_string(game->get_tick()) + "\t";
+  size_t third_line = index.find("third.save");
+  ASSERT_NE(std::string::npos, third_line);
+  size_t third_tick = index.find(tick, third_line);
+  ASSERT_NE(std::string::npos, third_tick);
+  index.replace(third_tick, tick.size(), "\t12345\t");
+  std::ofstream index_out(index_path, std::ios::trunc);
+  index_out << index;
+  index_out.close();
+
+  std::remove((folder + "/first.save").c_str());
+  {
+    FolderGameStore store(folder);
+    const std::vector<GameStore::SaveInfo> &saves = store.get_saved_games();
+    ASSERT_EQ(2u, saves.size());
+    for (const GameStore::SaveInfo &info : saves) {
+      EXPECT_EQ((info.name == "third") ? 12345u : game->get_tick(), info.tick)
+        << info.name;
+    }
+  }
+
+  std::remove((folder + "/second.save").c_str());
+  std::remove((folder + "/third.save").c_str());
+  std::remove(index_path.c_str());
+  std::remove(folder.c_str());
+}
@@ -0,0 +1,131 @@
+/*
+ * test_serf_index.cc - Serf position index tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "src/game.h"
+#include "src/random.h"
+
+// Compare the index against a scan over all serfs.
+static void
+check_index(Game *game, Player *player) {
+  PMap map = game->get_map();
+  SerfIndex *index = game->get_serf_index();
+  std::vector<unsigned int> regions(index->get_region_count(), 0);
+  unsigned int placed = 0;
+
+  for (Serf *serf : game->get_player_serfs(player)) {
+    MapPos pos = serf->get_pos();
+    if (pos == bad_map_pos) continue;
+    placed++;
+    regions[index->get_region(pos)]++;
+
+    bool found = false;
+    for (Serf *other : game->get_serfs_at_pos(pos)) {
+      ASSERT_EQ(pos, other->get_pos());
+      if (other == serf) found = true;
+    }
+    EXPECT_TRUE(found) << "serf " << serf->get_index() << " at " << pos;
+  }
+
+  unsigned int indexed = 0;
+  for (MapPos pos : map->geom()) {
+    for (Serf *serf : game->get_serfs_at_pos(pos)) {
+      (void)serf;
+      indexed++;
+    }
+  }
+  EXPECT_EQ(placed, indexed);
+
+  for (MapPos pos : map->geom()) {
+    EXPECT_EQ(regions[index->get_region(pos)], index->count_in_region(pos));
+  }
+}
+
+TEST(SerfIndex, FollowsMovingSerfs) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+
+  // Give the castle some roads so transporters walk out.
+  MapPos castle_flag_pos = map->move_down_right(map->pos(6, 6));
+  for (Direction dir : cycle_directions_cw()) {
+    MapPos pos = castle_flag_pos;
+    Road road;
+    road.start(pos);
+    for (int i = 0; i < 3; i++) {
+      pos = map->move(pos, dir);
+      road.extend(dir);
+    }
+    if (game->build_flag(pos, player)) game->build_road(road, player);
+  }
+
+  check_index(game.get(), player);
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 200; i++) game->update();
+    check_index(game.get(), player);
+  }
+}
+
+// A serf marked for deletion is updated one last time by the sweep, and
+// deleted once the sweep is done.
+TEST(SerfIndex, LeftByDeletedSerfs) {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  Player *player = game->get_player(0);
+  PMap map = game->get_map();
+  ASSERT_TRUE(game->build_castle(map->pos(6, 6), player));
+  MapPos castle_flag_pos = map->move_down_right(map->pos(6, 6));
+  MapPos pos = map->move_right_n(castle_flag_pos, 3);
+  Road road;
+  road.start(castle_flag_pos);
+  for (int i = 0; i < 3; i++) road.extend(DirectionRight);
+  ASSERT_TRUE(game->build_flag(pos, player));
+  ASSERT_TRUE(game->build_road(road, player));
+
+  Serf *walking = nullptr;
+  for (int i = 0; i < 500 && walking == nullptr; i++) {
+    game->update();
+    for (Serf *serf : game->get_player_serfs(player)) {
+      if (!serf->is_sleeping() && serf->get_pos() != bad_map_pos &&
+          serf->get_state() != Serf::StateIdleInStock) {
+        walking = serf;
+        break;
+      }
+    }
+  }
+  ASSERT_NE(nullptr, walking);
+
+  unsigned int index = walking->get_index();
+  size_t count = game->get_serf_count();
+  walking->mark_for_deletion();
+  game->update();
+  EXPECT_EQ(nullptr, game->get_serf(index));
+  EXPECT_EQ(count - 1, game->get_serf_count());
+  check_index(game.get(), player);
+}
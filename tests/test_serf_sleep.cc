@@ -0,0 +1,220 @@
+/*
+ * test_serf_sleep.cc - Tests for serfs and buildings left out of updates
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "src/game.h"
+#include "src/pathfinder.h"
+#include "src/random.h"
+
+namespace {
+
+std::unique_ptr<Game>
+start_game() {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  game->build_castle(game->get_map()->pos(6, 6), game->get_player(0));
+  return game;
+}
+
+// Place buildings of the given types near the castle, each with a road
+// from its flag to the castle flag. Returns where they were placed.
+std::vector<MapPos>
+add_buildings(Game *game, const std::vector<Building::Type> &types) {
+  std::vector<MapPos> placed;
+  PMap map = game->get_map();
+  Player *player = game->get_player(0);
+  MapPos castle_pos = map->pos(6, 6);
+  MapPos castle_flag = map->move_down_right(castle_pos);
+  int i = 30;
+  for (Building::Type type : types) {
+    for (; i < 400; i++) {
+      MapPos pos = map->pos_add_extended_spirally(castle_pos, i);
+      if (!game->can_build_building(pos, type, player)) continue;
+      MapPos flag_pos = map->move_down_right(pos);
+      Road road = pathfinder_map(map.get(), flag_pos, castle_flag);
+      if (!road.is_valid() || !game->build_building(pos, type, player)) {
+        continue;
+      }
+      if (!game->build_road(road, player)) {
+        game->demolish_building(pos, player);
+        continue;
+      }
+      placed.push_back(pos);
+      break;
+    }
+  }
+  return placed;
+}
+
+}  // namespace
+
+// A game whose serfs sleep plays out the same as one where every serf is
+// woken before each update.
+TEST(SerfSleep, SameAsAlwaysAwake) {
+  std::unique_ptr<Game> sleepy = start_game();
+  std::unique_ptr<Game> awake = start_game();
+
+  unsigned int slept = 0;
+  for (int i = 0; i < 3000; i++) {
+    sleepy->update();
+    awake->wake_serfs();
+    awake->update();
+  }
+  for (Serf *serf : sleepy->get_player_serfs(sleepy->get_player(0))) {
+    if (serf->is_sleeping()) slept++;
+  }
+  EXPECT_LT(0u, slept);
+
+  sleepy->wake_serfs();
+  awake->wake_serfs();
+  ASSERT_EQ(sleepy->get_tick(), awake->get_tick());
+  for (Serf *serf : awake->get_player_serfs(awake->get_player(0))) {
+    Serf *other = sleepy->get_serf(serf->get_index());
+    ASSERT_NE(nullptr, other);
+    EXPECT_EQ(serf->get_state(), other->get_state());
+    EXPECT_EQ(serf->get_type(), other->get_type());
+    EXPECT_EQ(serf->get_pos(), other->get_pos());
+    EXPECT_EQ(serf->get_counter(), other->get_counter());
+  }
+}
+
+// Buildings left out of the updates while passive play out the same as
+// updating every building every tick.
+TEST(BuildingSleep, SameAsSweep) {
+  std::vector<Building::Type> types = {
+    Building::TypeSawmill, Building::TypeLumberjack, Building::TypeStonecutter,
+    Building::TypeBoatbuilder, Building::TypeForester };
+  std::unique_ptr<Game> sleepy = start_game();
+  std::unique_ptr<Game> awake = start_game();
+  std::vector<MapPos> placed = add_buildings(sleepy.get(), types);
+  ASSERT_EQ(placed, add_buildings(awake.get(), types));
+  ASSERT_EQ(types.size(), placed.size());
+  awake->set_building_sleep(false);
+
+  // The sawmill waits for its digger to level the ground, then burns down
+  // in the middle of it.
+  unsigned int slept = 0;
+  for (int i = 0; i < 8000; i++) {
+    if (i == 6000) {
+      Building *sawmill = sleepy->get_building_at_pos(placed[0]);
+      ASSERT_NE(nullptr, sawmill);
+      EXPECT_TRUE(sawmill->is_sleeping());
+      EXPECT_TRUE(sleepy->demolish_building(placed[0], sleepy->get_player(0)));
+      EXPECT_TRUE(awake->demolish_building(placed[0], awake->get_player(0)));
+    }
+    sleepy->update();
+    awake->update();
+    for (Building *building : sleepy->get_player_buildings(
+                                                  sleepy->get_player(0))) {
+      if (building->is_sleeping()) {
+        // Anything that changes a sleeping building wakes it first.
+        EXPECT_TRUE(building->can_sleep());
+        slept++;
+      }
+    }
+  }
+  EXPECT_LT(0u, slept);
+  EXPECT_EQ(nullptr, sleepy->get_building_at_pos(placed[0]));
+
+  ASSERT_EQ(sleepy->get_tick(), awake->get_tick());
+  Game::ListBuildings buildings =
+                         awake->get_player_buildings(awake->get_player(0));
+  EXPECT_EQ(types.size(), buildings.size());  // Castle, not the sawmill
+  for (Building *building : buildings) {
+    Building *other = sleepy->get_building(building->get_index());
+    ASSERT_NE(nullptr, other);
+    EXPECT_EQ(building->get_type(), other->get_type());
+    EXPECT_EQ(building->is_done(), other->is_done());
+    EXPECT_EQ(building->has_serf(), other->has_serf());
+    EXPECT_EQ(building->get_progress(), other->get_progress());
+    for (int j = 0; j < 2; j++) {
+      EXPECT_EQ(building->get_res_count_in_stock(j),
+                other->get_res_count_in_stock(j));
+    }
+  }
+}
+
+// Flags left out of the updates while nothing waits at them play out the
+// same as updating every flag every tick.
+TEST(FlagSleep, SameAsSweep) {
+  std::vector<Building::Type> types = {
+    Building::TypeLumberjack, Building::TypeStonecutter,
+    Building::TypeForester, Building::TypeLumberjack };
+  std::unique_ptr<Game> sleepy = start_game();
+  std::unique_ptr<Game> awake = start_game();
+  std::vector<MapPos> placed = add_buildings(sleepy.get(), types);
+  ASSERT_EQ(placed, add_buildings(awake.get(), types));
+  ASSERT_EQ(types.size(), placed.size());
+  awake->set_flag_sleep(false);
+
+  // The road to the last building goes in the middle of it, taking its
+  // transporter and a path from the flags at both ends.
+  unsigned int slept = 0;
+  bool demolished = false;
+  MapPos last_flag = sleepy->get_map()->move_down_right(placed.back());
+  for (int i = 0; i < 8000; i++) {
+    if (i == 5000) {
+      Flag *flag = sleepy->get_flag_at_pos(last_flag);
+      ASSERT_NE(nullptr, flag);
+      for (Direction d : cycle_directions_cw()) {
+        if (!flag->has_path(d) || d == DirectionUpLeft) continue;
+        MapPos road_pos = sleepy->get_map()->move(last_flag, d);
+        EXPECT_TRUE(sleepy->demolish_road(road_pos, sleepy->get_player(0)));
+        EXPECT_TRUE(awake->demolish_road(road_pos, awake->get_player(0)));
+        demolished = true;
+        break;
+      }
+    }
+    sleepy->update();
+    awake->update();
+    for (Flag *flag : *sleepy->get_flags()) {
+      if (flag->is_sleeping()) {
+        EXPECT_TRUE(flag->can_sleep());
+        slept++;
+      }
+    }
+  }
+  EXPECT_TRUE(demolished);
+  EXPECT_LT(0u, slept);
+
+  ASSERT_EQ(sleepy->get_tick(), awake->get_tick());
+  ASSERT_EQ(awake->get_flag_count(), sleepy->get_flag_count());
+  for (Flag *flag : *awake->get_flags()) {
+    Flag *other = sleepy->get_flag(flag->get_index());
+    ASSERT_NE(nullptr, other);
+    EXPECT_EQ(flag->paths(), other->paths());
+    EXPECT_EQ(flag->transporters(), other->transporters());
+    for (int j = 0; j < FLAG_MAX_RES_COUNT; j++) {
+      EXPECT_EQ(flag->get_resource_at_slot(j), other->get_resource_at_slot(j));
+    }
+  }
+  for (Serf *serf : awake->get_player_serfs(awake->get_player(0))) {
+    Serf *other = sleepy->get_serf(serf->get_index());
+    ASSERT_NE(nullptr, other);
+    EXPECT_EQ(serf->get_state(), other->get_state());
+    EXPECT_EQ(serf->get_pos(), other->get_pos());
+  }
+}
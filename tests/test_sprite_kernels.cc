@@ -0,0 +1,142 @@
+/*
+ * test_sprite_kernels.cc - Sprite kernel tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "src/sprite-kernels.h"
+
+typedef std::vector<uint32_t> Pixels;
+
+// pixels with many fully clear and fully opaque ones, like sprites have
+static Pixels
+random_pixels(std::mt19937 *random, size_t count) {
+  Pixels pixels(count);
+  for (uint32_t &pixel : pixels) {
+    pixel = (*random)();
+    switch ((*random)() % 4) {
+      case 0: pixel &= 0x00FFFFFF; break;
+      case 1: pixel |= 0xFF000000; break;
+      default: break;
+    }
+    if ((*random)() % 16 == 0) {
+      pixel = 0xFFFFFFFF;
+    }
+  }
+  return pixels;
+}
+
+// run kernel on a copy of pixels once with the plain loops and once with
+//  the best ones, and expect the same bytes
+static void
+expect_same(const Pixels &pixels, std::function<void(uint32_t*)> kernel) {
+  Pixels plain = pixels;
+  SpriteKernels::set_level(SpriteKernels::LevelScalar);
+  kernel(plain.data());
+  Pixels best = pixels;
+  SpriteKernels::set_level(SpriteKernels::get_best_level());
+  kernel(best.data());
+  ASSERT_EQ(plain, best) << "with "
+    << SpriteKernels::get_level_name(SpriteKernels::get_best_level())
+    << ", " << pixels.size() << " pixels";
+}
+
+TEST(SpriteKernels, SameAsScalar) {
+  std::mt19937 random(12345);
+  for (size_t count = 0; count < 70; count++) {
+    Pixels pixels = random_pixels(&random, count);
+    Pixels other = random_pixels(&random, count);
+    // some pixels the same, for compare
+    for (size_t i = 0; i < count; i += 3) {
+      other[i] = pixels[i];
+    }
+    uint32_t color = random();
+    expect_same(pixels, [&](uint32_t *p) {
+      SpriteKernels::mask(p, other.data(), p, count); });
+    expect_same(pixels, [&](uint32_t *p) {
+      SpriteKernels::compare(p, p, other.data(), count); });
+    expect_same(pixels, [&](uint32_t *p) {
+      SpriteKernels::fill(p, color, count); });
+    expect_same(pixels, [&](uint32_t *p) {
+      SpriteKernels::fill_opaque(p, color, count); });
+    expect_same(pixels, [&](uint32_t *p) {
+      SpriteKernels::add(p, other.data(), count); });
+    expect_same(pixels, [&](uint32_t *p) {
+      SpriteKernels::clear_masked(p, other.data(), count); });
+    expect_same(pixels, [&](uint32_t *p) {
+      SpriteKernels::blend(p, other.data(), count); });
+    expect_same(pixels, [&](uint32_t *p) {
+      SpriteKernels::alpha_mask(p, count); });
+  }
+}
+
+// every front color channel and alpha, over a few backs, including
+//  channels larger than alpha that premultiplied pixels shouldn't have
+TEST(SpriteKernels, BlendEveryAlpha) {
+  Pixels front;
+  for (uint32_t alpha = 0; alpha < 0x100; alpha++) {
+    for (uint32_t channel = 0; channel < 0x100; channel++) {
+      front.push_back((alpha << 24) | (channel << 16) |
+                      ((0xFF - channel) << 8) | (channel / 3));
+    }
+  }
+  for (uint32_t back : { 0x00000000u, 0xFF808080u, 0x12FF00A5u,
+                         0xFFFFFFFFu }) {
+    expect_same(Pixels(front.size(), back), [&](uint32_t *p) {
+      SpriteKernels::blend(p, front.data(), front.size()); });
+  }
+}
+
+TEST(SpriteKernels, AlphaMaskEveryColor) {
+  std::mt19937 random(4321);
+  Pixels pixels;
+  for (uint32_t gray = 0; gray < 0x100; gray++) {
+    pixels.push_back(0xFF000000 | (gray << 16) | (gray << 8) | gray);
+    pixels.push_back(0x80000000 | (random() & 0x00FFFFFF));
+    pixels.push_back(random() & 0x00FFFFFF);
+  }
+  expect_same(pixels, [&](uint32_t *p) {
+    SpriteKernels::alpha_mask(p, pixels.size()); });
+  // all pale, so the least alpha is taken off
+  Pixels pale(37, 0xFF101010);
+  pale[5] = 0xFF202020;
+  expect_same(pale, [&](uint32_t *p) {
+    SpriteKernels::alpha_mask(p, pale.size()); });
+}
+
+// a few pixels worked out by hand, so the plain loops stay what they were
+TEST(SpriteKernels, BlendKnownPixels) {
+  SpriteKernels::set_level(SpriteKernels::get_best_level());
+  Pixels back = { 0xFF204060, 0xFF204060, 0xFF204060, 0xFF204060,
+                  0xFF204060 };
+  Pixels front = { 0x00FFFFFF, 0xFF010203, 0x80404040, 0x80808080,
+                   0x01010101 };
+  SpriteKernels::blend(back.data(), front.data(), back.size());
+  EXPECT_EQ(0xFF204060u, back[0]);
+  EXPECT_EQ(0xFF010203u, back[1]);
+  // 0x40 unmultiplied by 0x80 is 0x7F, then (0x7F * 0x80 + back * 0x7F) / 0xFF
+  EXPECT_EQ(0xFF4F5F6Fu, back[2]);
+  EXPECT_EQ(0xFF8F9FAFu, back[3]);
+  EXPECT_EQ(0xFF204060u, back[4]);
+}
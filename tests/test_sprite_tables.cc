@@ -0,0 +1,175 @@
+/*
+ * test_sprite_tables.cc - Tests for serf and building sprites by type
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include "src/sprite-tables.h"
+
+namespace {
+
+SpriteTables::SerfLook
+make_look(Serf::Type type, Serf::State state, int sprite) {
+  SpriteTables::SerfLook look = {};
+  look.type = type;
+  look.state = state;
+  look.sprite = sprite;
+  return look;
+}
+
+}  // namespace
+
+TEST(SpriteTables, WalkingAndWorking) {
+  SpriteTables::SerfLook look = make_look(Serf::TypeDigger,
+                                          Serf::StateWalking, 0x12);
+  EXPECT_EQ(0x312, SpriteTables::get_serf_body(look));
+  look.sprite = 0x90;
+  EXPECT_EQ(0x410, SpriteTables::get_serf_body(look));
+
+  look = make_look(Serf::TypeKnight2, Serf::StateWalking, 0x10);
+  EXPECT_EQ(0x7a10, SpriteTables::get_serf_body(look));
+  look.sprite = 0x90;
+  EXPECT_EQ(0x8160, SpriteTables::get_serf_body(look));
+  look.sprite = 0xc0;
+  EXPECT_EQ(0x8250, SpriteTables::get_serf_body(look));
+}
+
+TEST(SpriteTables, CarryingOut) {
+  SpriteTables::SerfLook look = make_look(Serf::TypeToolmaker,
+                                          Serf::StateLeavingBuilding, 0x10);
+  look.leaving_next_state = Serf::StateDropResourceOut;
+  look.leaving_res = 1 + Resource::TypeSaw;
+  EXPECT_EQ(0x6210, SpriteTables::get_serf_body(look));
+
+  look.type = Serf::TypeSmelter;
+  look.leaving_res = 1 + Resource::TypeSteel;
+  EXPECT_EQ(0x2910, SpriteTables::get_serf_body(look));
+  look.leaving_res = 1 + Resource::TypeGoldBar;
+  EXPECT_EQ(0x2810, SpriteTables::get_serf_body(look));
+
+  look.type = Serf::TypeBaker;
+  EXPECT_EQ(0x4a10, SpriteTables::get_serf_body(look));
+  look.leaving_next_state = Serf::StateWalking;
+  EXPECT_EQ(0x4810, SpriteTables::get_serf_body(look));
+
+  look = make_look(Serf::TypeMiner, Serf::StateMining, 0x10);
+  look.mining_res = 1 + Resource::TypeCoal;
+  EXPECT_EQ(0x2610, SpriteTables::get_serf_body(look));
+  look.mining_res = 0;
+  EXPECT_EQ(0x1810, SpriteTables::get_serf_body(look));
+}
+
+TEST(SpriteTables, Outdoors) {
+  SpriteTables::SerfLook look = make_look(Serf::TypeStonecutter,
+                                          Serf::StateStoneCutting, 0x10);
+  look.free_dist1 = 2;
+  EXPECT_EQ(0x1210, SpriteTables::get_serf_body(look));
+
+  look.type = Serf::TypeLumberjack;
+  EXPECT_EQ(0xb10, SpriteTables::get_serf_body(look));
+  look.state = Serf::StateFreeWalking;
+  look.free_dist1 = -128;
+  look.free_dist2 = 1;
+  EXPECT_EQ(0x1010, SpriteTables::get_serf_body(look));
+}
+
+TEST(SpriteTables, NotDrawn) {
+  EXPECT_EQ(-1, SpriteTables::get_serf_body(
+                  make_look(Serf::TypeTransporter, Serf::StateIdleOnPath, 0)));
+  EXPECT_EQ(-1, SpriteTables::get_serf_body(
+                  make_look(Serf::TypeTransporterInventory,
+                            Serf::StateBuildingCastle, 0)));
+}
+
+TEST(SpriteTables, Sounds) {
+  SpriteTables::SerfLook look = make_look(Serf::TypeLumberjack,
+                                          Serf::StateFreeWalking, 0x85);
+  look.counter = 10;
+  SpriteTables::SerfSounds sounds = SpriteTables::get_serf_sounds(look);
+  EXPECT_EQ(SpriteTables::PlayingStart, sounds.playing);
+  ASSERT_EQ(2, sounds.count);
+  EXPECT_EQ(Audio::TypeSfxAxBlow, sounds.sound[0]);
+  EXPECT_EQ(Audio::TypeSfxTreeFall, sounds.sound[1]);
+  EXPECT_EQ(0xf05, SpriteTables::get_serf_body(look));
+
+  // The blow goes on, and the sprite is held while it plays.
+  look.sprite = 0x86;
+  look.playing_sfx = true;
+  sounds = SpriteTables::get_serf_sounds(look);
+  EXPECT_EQ(SpriteTables::PlayingKeep, sounds.playing);
+  EXPECT_EQ(0, sounds.count);
+  EXPECT_EQ(0x86, SpriteTables::get_serf_body(look));
+
+  look.sprite = 0x88;
+  sounds = SpriteTables::get_serf_sounds(look);
+  EXPECT_EQ(SpriteTables::PlayingStop, sounds.playing);
+  EXPECT_EQ(0, sounds.count);
+
+  // Walking makes no sound.
+  look.sprite = 0x10;
+  sounds = SpriteTables::get_serf_sounds(look);
+  EXPECT_EQ(SpriteTables::PlayingKeep, sounds.playing);
+
+  // A sailor without cargo rows twice.
+  look = make_look(Serf::TypeSailor, Serf::StateTransporting, 0x03);
+  sounds = SpriteTables::get_serf_sounds(look);
+  EXPECT_EQ(SpriteTables::PlayingStart, sounds.playing);
+  EXPECT_EQ(2, sounds.count);
+  EXPECT_EQ(0x203, SpriteTables::get_serf_body(look));
+}
+
+TEST(SpriteTables, Buildings) {
+  const SpriteTables::BuildingLook &hut =
+                    SpriteTables::get_building_look(Building::TypeHut);
+  EXPECT_EQ(-14, hut.flag_x);
+  EXPECT_EQ(2.f, hut.flag_mul);
+  EXPECT_EQ(0, hut.work_sprite);
+
+  const SpriteTables::BuildingLook &smelter =
+                    SpriteTables::get_building_look(Building::TypeGoldSmelter);
+  EXPECT_EQ(128, smelter.work_sprite);
+  EXPECT_TRUE(smelter.work_boils);
+  EXPECT_EQ(0.f, smelter.flag_mul);
+
+  EXPECT_EQ(SpriteTables::ExtraElevator,
+            SpriteTables::get_building_look(Building::TypeCoalMine).extra);
+  EXPECT_EQ(SpriteTables::ExtraNone,
+            SpriteTables::get_building_look(Building::TypeCastle).extra);
+}
+
+TEST(SpriteTables, BurnAnimation) {
+  const int *unfinished = SpriteTables::get_burn_animation(Building::TypeNone);
+  EXPECT_EQ(0, unfinished[0]);
+  EXPECT_EQ(-8, unfinished[1]);
+  EXPECT_EQ(2, unfinished[2]);
+  EXPECT_EQ(-1, unfinished[9]);
+
+  EXPECT_EQ(SpriteTables::get_burn_animation(Building::TypeIronMine),
+            SpriteTables::get_burn_animation(Building::TypeGoldMine));
+
+  const int *castle = SpriteTables::get_burn_animation(Building::TypeCastle);
+  EXPECT_EQ(11, castle[1]);
+  EXPECT_EQ(-46, castle[2]);
+  int flames = 0;
+  for (const int *anim = castle; anim[0] >= 0; anim += 3) {
+    flames++;
+  }
+  EXPECT_EQ(12, flames);
+}
@@ -0,0 +1,105 @@
+/*
+ * test_thread_policy.cc - Tests for thread priorities and cores by role
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <vector>
+
+#include "src/configfile.h"
+#include "src/thread-policy.h"
+
+TEST(ThreadPolicy, Defaults) {
+  EXPECT_EQ(ThreadPolicy::PriorityNormal,
+            ThreadPolicy::get(ThreadPolicy::RoleSimulation).priority);
+  EXPECT_EQ(ThreadPolicy::PriorityNormal,
+            ThreadPolicy::get(ThreadPolicy::RoleRender).priority);
+  EXPECT_LT(ThreadPolicy::get(ThreadPolicy::RoleAI).priority,
+            ThreadPolicy::PriorityNormal);
+  EXPECT_LT(ThreadPolicy::get(ThreadPolicy::RoleIO).priority,
+            ThreadPolicy::PriorityNormal);
+  EXPECT_TRUE(ThreadPolicy::get(ThreadPolicy::RoleAI).cores.empty());
+}
+
+TEST(ThreadPolicy, Parse) {
+  ThreadPolicy::Setting saved = ThreadPolicy::get(ThreadPolicy::RoleAI);
+
+  ASSERT_TRUE(ThreadPolicy::parse("ai=lowest@1-3,6"));
+  ThreadPolicy::Setting setting = ThreadPolicy::get(ThreadPolicy::RoleAI);
+  EXPECT_EQ(ThreadPolicy::PriorityLowest, setting.priority);
+  EXPECT_EQ(std::vector<unsigned int>({ 1, 2, 3, 6 }), setting.cores);
+
+  ASSERT_TRUE(ThreadPolicy::parse("ai=high"));
+  setting = ThreadPolicy::get(ThreadPolicy::RoleAI);
+  EXPECT_EQ(ThreadPolicy::PriorityHigh, setting.priority);
+  EXPECT_TRUE(setting.cores.empty());
+
+  // Nothing changes for what cannot be read.
+  EXPECT_FALSE(ThreadPolicy::parse("ai"));
+  EXPECT_FALSE(ThreadPolicy::parse("gpu=low"));
+  EXPECT_FALSE(ThreadPolicy::parse("ai=urgent"));
+  EXPECT_FALSE(ThreadPolicy::parse("ai=low@3-1"));
+  EXPECT_FALSE(ThreadPolicy::parse("ai=low@x"));
+  EXPECT_EQ(ThreadPolicy::PriorityHigh,
+            ThreadPolicy::get(ThreadPolicy::RoleAI).priority);
+
+  ThreadPolicy::set(ThreadPolicy::RoleAI, saved);
+}
+
+TEST(ThreadPolicy, Load) {
+  ThreadPolicy::Setting saved_render =
+    ThreadPolicy::get(ThreadPolicy::RoleRender);
+  ThreadPolicy::Setting saved_io = ThreadPolicy::get(ThreadPolicy::RoleIO);
+
+  std::stringstream text("[threads]\n"
+                         "render = High@0\n"
+                         "io = low\n");
+  ConfigFile config;
+  ASSERT_TRUE(config.read(&text));
+  EXPECT_TRUE(ThreadPolicy::load(config));
+  ThreadPolicy::Setting render = ThreadPolicy::get(ThreadPolicy::RoleRender);
+  EXPECT_EQ(ThreadPolicy::PriorityHigh, render.priority);
+  EXPECT_EQ(std::vector<unsigned int>({ 0 }), render.cores);
+  EXPECT_EQ(ThreadPolicy::PriorityLow,
+            ThreadPolicy::get(ThreadPolicy::RoleIO).priority);
+
+  std::stringstream bad("[threads]\n"
+                        "io = soon\n");
+  ConfigFile bad_config;
+  ASSERT_TRUE(bad_config.read(&bad));
+  EXPECT_FALSE(ThreadPolicy::load(bad_config));
+  EXPECT_EQ(ThreadPolicy::PriorityLow,
+            ThreadPolicy::get(ThreadPolicy::RoleIO).priority);
+
+  ThreadPolicy::set(ThreadPolicy::RoleRender, saved_render);
+  ThreadPolicy::set(ThreadPolicy::RoleIO, saved_io);
+}
+
+// Lowering a thread never takes privileges.
+TEST(ThreadPolicy, ApplyBelowNormal) {
+  bool applied = false;
+  std::thread worker([&applied]() {
+    applied = ThreadPolicy::apply(ThreadPolicy::RoleIO);
+  });
+  worker.join();
+  EXPECT_TRUE(applied);
+}
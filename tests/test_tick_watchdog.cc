@@ -0,0 +1,123 @@
+/*
+ * test_tick_watchdog.cc - Tests for the captures of slow updates
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+#include "src/game.h"
+#include "src/random.h"
+#include "src/savegame.h"
+#include "src/trace.h"
+
+static std::unique_ptr<Game>
+start_game() {
+  std::unique_ptr<Game> game(new Game());
+  game->init(3, Random("8667715887436237"));
+  game->add_player(35, 30, 40);
+  if (!game->build_castle(game->get_map()->pos(6, 6), game->get_player(0))) {
+    return nullptr;
+  }
+  for (int i = 0; i < 100; i++) game->update();
+  return game;
+}
+
+static std::string
+read_file(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+}
+
+// A slow update leaves the trace before it and the game after it behind,
+// and the slow updates right after it are only counted.
+TEST(TickWatchdog, CapturesSlowUpdates) {
+  std::unique_ptr<Game> game = start_game();
+  ASSERT_TRUE(game);
+  TickWatchdog *watchdog = game->get_tick_watchdog();
+  watchdog->set_prefix("test_watchdog_");
+  watchdog->set_budgets(20, 0);
+  EXPECT_TRUE(Trace::is_active());
+  for (int i = 0; i < 10; i++) game->update();
+  EXPECT_EQ(0u, watchdog->get_overrun_count());
+
+  bool slow = true;
+  game->set_update_observer([&slow]() {
+    if (slow) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    }
+  });
+  game->update();
+  unsigned int slow_tick = game->get_tick();
+  game->update();
+  slow = false;
+  game->update();
+  watchdog->wait();
+  EXPECT_EQ(2u, watchdog->get_overrun_count());
+  EXPECT_EQ(1u, watchdog->get_capture_count());
+
+  TickWatchdog::Capture capture = watchdog->get_last_capture();
+  EXPECT_TRUE(capture.saved);
+  EXPECT_EQ(slow_tick, capture.tick);
+  EXPECT_NE(std::string::npos, capture.reason.find("update of tick"));
+  std::string trace = read_file(capture.trace_path);
+  std::remove(capture.trace_path.c_str());
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"game.update\""));
+
+  std::unique_ptr<Game> loaded_game(new Game());
+  ASSERT_TRUE(GameStore::get_instance().load(capture.save_path,
+                                             loaded_game.get()));
+  std::remove(capture.save_path.c_str());
+  // taken at the end of the first slow update
+  EXPECT_EQ(slow_tick, loaded_game->get_tick());
+  Trace::stop();
+}
+
+// A slow AI loop is captured at the end of the next update.
+TEST(TickWatchdog, CapturesSlowAILoops) {
+  std::unique_ptr<Game> game = start_game();
+  ASSERT_TRUE(game);
+  TickWatchdog *watchdog = game->get_tick_watchdog();
+  watchdog->set_prefix("test_watchdog_ai_");
+  watchdog->set_budgets(0, 100);
+  watchdog->check_ai_loop(1, 50000000);
+  game->update();
+  EXPECT_EQ(0u, watchdog->get_overrun_count());
+
+  watchdog->check_ai_loop(1, 500000000);
+  game->update();
+  watchdog->wait();
+  EXPECT_EQ(1u, watchdog->get_overrun_count());
+  ASSERT_EQ(1u, watchdog->get_capture_count());
+  TickWatchdog::Capture capture = watchdog->get_last_capture();
+  EXPECT_TRUE(capture.saved);
+  EXPECT_EQ("AI loop of player 1 took 500.0 ms", capture.reason);
+  EXPECT_EQ("test_watchdog_ai_" + std::to_string(game->get_tick()) + ".save",
+            capture.save_path);
+  std::remove(capture.trace_path.c_str());
+  std::remove(capture.save_path.c_str());
+  Trace::stop();
+}
@@ -0,0 +1,98 @@
+/*
+ * test_trace.cc - Trace tests
+ *
+ * Copyright (C) 2021  tlongstretch
+ *
+ * This file is part of freeserf.
+ *
+ * freeserf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * freeserf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with freeserf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <thread>   //NOLINT (build/c++11) this is a Google Chromium req, not relevant to general C++.
+
+#include "src/profiler.h"
+#include "src/trace.h"
+
+static size_t
+count_of(const std::string &text, const std::string &what) {
+  size_t count = 0;
+  for (size_t pos = text.find(what); pos != std::string::npos;
+       pos = text.find(what, pos + what.size())) {
+    count++;
+  }
+  return count;
+}
+
+TEST(Trace, RecordsSectionsAndCountersOfThreads) {
+  static const Profiler::Section section("test.trace.section");
+  Trace::start("");
+
+  auto work = []() {
+    for (int i = 0; i < 10; i++) {
+      Profiler::ScopedTimer timer(section);
+    }
+    Trace::counter("test.trace.counter", 42);
+  };
+  std::thread other([&work]() {
+    Trace::set_thread_name("other");
+    work();
+  });
+  work();
+  other.join();
+  Trace::stop();
+  // nothing is recorded once stopped
+  work();
+
+  std::stringstream json;
+  Trace::write_json(&json);
+  std::string text = json.str();
+  EXPECT_EQ(20u, count_of(text, "\"name\":\"test.trace.section\""));
+  EXPECT_EQ(2u, count_of(text, "\"name\":\"test.trace.counter\",\"args\":"
+                               "{\"value\":42}"));
+  EXPECT_EQ(1u, count_of(text, "{\"name\":\"other\"}"));
+}
+
+TEST(Trace, KeepsNewestEvents) {
+  Trace::start("", 4);
+  for (int i = 0; i < 10; i++) {
+    Trace::counter("test.trace.newest", i);
+  }
+  Trace::stop();
+
+  std::stringstream json;
+  Trace::write_json(&json);
+  std::string text = json.str();
+  EXPECT_EQ(4u, count_of(text, "\"name\":\"test.trace.newest\""));
+  EXPECT_EQ(std::string::npos, text.find("{\"value\":5}"));
+  EXPECT_NE(std::string::npos, text.find("{\"value\":6}"));
+  EXPECT_LT(text.find("{\"value\":6}"), text.find("{\"value\":9}"));
+}
+
+TEST(Trace, WritesTheLastStretch) {
+  Trace::start("");
+  Trace::counter("test.trace.stretch", 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  Trace::counter("test.trace.stretch", 2);
+  Trace::stop();
+
+  std::stringstream json;
+  Trace::write_json(&json, std::chrono::milliseconds(100));
+  std::string text = json.str();
+  EXPECT_EQ(1u, count_of(text, "\"name\":\"test.trace.stretch\""));
+  EXPECT_NE(std::string::npos, text.find("{\"value\":2}"));
+}